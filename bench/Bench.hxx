@@ -0,0 +1,92 @@
+#ifndef HARUHI_BENCH_HXX
+#define HARUHI_BENCH_HXX
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace bench {
+
+// keeps the optimizer from dropping benchmarked results
+template <typename T>
+inline void
+keep(const T& v) noexcept {
+  asm volatile("" : : "r,m"(v) : "memory");
+}
+
+// runs fn(iters) a few times and prints the best ns per item
+template <typename Fn>
+inline double
+run(const char* name, uint64_t items, Fn&& fn, int reps = 5) noexcept {
+  using clock = std::chrono::steady_clock;
+  fn(); // warmup
+  double best = 1e30;
+  for(int r = 0; r < reps; ++r) {
+    auto t0 = clock::now();
+    fn();
+    auto dt = std::chrono::duration<double, std::nano>(clock::now() - t0).count();
+    if(dt < best) best = dt;
+  }
+  const double per = best / (double)items;
+  printf("%-40s %10.3f ns/item %12.3f Mitems/s\n", name, per, 1e3 / per);
+  return per;
+}
+
+// ns per item over the timed repetitions
+struct Stats {
+  double median, mean, stddev, min, max;
+  int reps;
+};
+
+// runs fn for at least warmup ms, then times reps runs of it
+template <typename Fn>
+inline Stats
+measure(uint64_t items, Fn&& fn, int reps = 15, double warmup = 50.) noexcept {
+  using clock = std::chrono::steady_clock;
+  const auto until = clock::now() + std::chrono::duration<double, std::milli>(warmup);
+  do fn(); while(clock::now() < until);
+
+  std::vector<double> per(reps);
+  for(int r = 0; r < reps; ++r) {
+    auto t0 = clock::now();
+    fn();
+    per[r] = std::chrono::duration<double, std::nano>(clock::now() - t0).count() / (double)items;
+  }
+  std::sort(per.begin(), per.end());
+  Stats s = {};
+  s.reps = reps;
+  s.min = per.front();
+  s.max = per.back();
+  s.median = reps & 1 ? per[reps / 2] : .5 * (per[reps / 2 - 1] + per[reps / 2]);
+  for(double v : per) s.mean += v;
+  s.mean /= reps;
+  for(double v : per) s.stddev += (v - s.mean) * (v - s.mean);
+  s.stddev = reps > 1 ? std::sqrt(s.stddev / (reps - 1)) : 0.;
+  return s;
+}
+
+// keeps the calling thread on one cpu, false where that isn't possible.
+// macos only takes affinity hints, so it is always false there
+inline bool
+pinThread(int cpu) noexcept {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
+
+} // ns bench
+
+#endif
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <AssetArchive.hxx>
+#include <WorkerPool.hxx>
+
+#ifdef HARUHI_HAS_SPNG
+#include <ImageUtil.hxx>
+#endif
+
+#include "Bench.hxx"
+
+// startup cost of n textures: mapping the archive against reading it and,
+// with libspng, against decoding the png every launch
+// benchArchive [count] [image.png]
+int main(int argc, char * argv[]) {
+  const size_t N = argc > 1 ? strtoul(argv[1], nullptr, 10) : 64;
+  const char* png = argc > 2 ? argv[2] : nullptr;
+  const char* pth = "bench_archive.hpak";
+
+  uint32_t w = 512, h = 512;
+  std::vector<uint8_t> pixels;
+
+#ifdef HARUHI_HAS_SPNG
+  using namespace HaruhiResourceLoader::ImageUtil;
+  if(png) {
+    auto probe = probeImages(&png, 1);
+    if(probe[0].error) {
+      printf("%s: %s\n", png, errorString(probe[0].error));
+      return EXIT_FAILURE;
+    }
+    w = probe[0].info.width;
+    h = probe[0].info.height;
+    pixels.resize(probe[0].info.size);
+    const DecodeRequest req = { png, pixels.data(), pixels.size(), 0 };
+    decodeImages(&req, 1);
+  }
+#else
+  if(png)
+    printf("built without libspng, ignoring %s\n", png);
+  png = nullptr;
+#endif
+
+  if(pixels.empty()) {
+    pixels.resize((size_t)w * h * 4);
+    for(size_t i = 0; i < pixels.size(); ++i)
+      pixels[i] = (uint8_t)(i * 131 >> 3);
+  }
+
+  HaruhiAssetPacker packer;
+  const HaruhiAssetPacker::Image img = { w, h, pixels.data(), 0 };
+  for(size_t i = 0; i < N; ++i)
+    packer.addTexture("tex" + std::to_string(i), &img, 1);
+  if(int err = packer.write(pth)) {
+    printf("%s: %s\n", pth, strerror(-err));
+    return EXIT_FAILURE;
+  }
+
+  printf("%zu textures of %ux%u, per texture\n", N, w, h);
+
+  // what a draw touches first, one byte per page of every texture
+  auto touch = [](const HaruhiAssetArchive& ar) {
+    unsigned sum = 0;
+    for(uint32_t t = 0; t < ar.textureCount(); ++t) {
+      const archive::TextureEntry& e = ar.texture(t);
+      const uint8_t* p = ar.levelData(e, 0);
+      for(size_t o = 0; o < e.mips[0].size; o += 4096)
+        sum += p[o];
+    }
+    return sum;
+  };
+
+  bench::run("archive mmap + touch", N, [&] {
+    HaruhiAssetArchive ar;
+    ar.open(pth);
+    bench::keep(touch(ar));
+  });
+
+  std::vector<uint8_t> copy;
+  bench::run("archive fread into heap", N, [&] {
+    FILE* fp = fopen(pth, "rb");
+    fseek(fp, 0, SEEK_END);
+    copy.resize(ftell(fp));
+    fseek(fp, 0, SEEK_SET);
+    bench::keep(fread(copy.data(), 1, copy.size(), fp));
+    fclose(fp);
+  });
+
+#ifdef HARUHI_HAS_SPNG
+  if(png) {
+    std::vector<uint8_t> dst(pixels.size() * N);
+    std::vector<DecodeRequest> reqs(N);
+    for(size_t i = 0; i < N; ++i)
+      reqs[i] = { png, dst.data() + i * pixels.size(), pixels.size(), 0 };
+
+    bench::run("png decode serial", N, [&] {
+      bench::keep(decodeImages(reqs.data(), N).size());
+    }, 3);
+    HaruhiWorkerPool pool;
+    bench::run("png decode pool", N, [&] {
+      bench::keep(decodeImages(reqs.data(), N, &pool).size());
+    }, 3);
+  }
+#endif
+
+  remove(pth);
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,40 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <TextureAtlas.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+// packing and composing n small sprites into 2048^2 pages
+// benchAtlas [count]
+int main(int argc, char * argv[]) {
+  const size_t N = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000;
+
+  std::vector<uint32_t> ws(N), hs(N);
+  uint32_t seed = 1;
+  size_t texels = 0;
+  for(size_t i = 0; i < N; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    ws[i] = 8 + (seed >> 8) % 57;
+    hs[i] = 8 + (seed >> 20) % 57;
+    texels += ws[i] * hs[i];
+  }
+  std::vector<uint32_t> pixels(64 * 64, 0xff8040ff);
+
+  HaruhiTextureAtlas atlas(2048, 2);
+  for(size_t i = 0; i < N; ++i)
+    atlas.add("sprite" + std::to_string(i), ws[i], hs[i], pixels.data(), 64 * 4);
+
+  bench::run("atlas pack", N, [&] { atlas.pack(); });
+  printf("%zu sprites, %zu texels, %u pages, %.1f%% occupancy\n",
+    N, texels, atlas.pageCount(), atlas.occupancy() * 100.);
+
+  bench::run("atlas compose serial", N, [&] { atlas.compose(); }, 3);
+  HaruhiWorkerPool pool;
+  bench::run("atlas compose pool", N, [&] { atlas.compose(&pool); }, 3);
+
+  return 0;
+}
\ No newline at end of file
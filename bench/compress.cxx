@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <BlockCompress.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+// encoding a size x size RGBA8 texture with every codec and quality,
+// quality as PSNR of the decoded result, speed as source MB/s per core
+// benchCompress [size]
+int main(int argc, char * argv[]) {
+  using namespace texcomp;
+
+  const uint32_t S = argc > 1 ? strtoul(argv[1], nullptr, 10) : 512;
+
+  // gradients, noise and hard edges, a cutout alpha
+  std::vector<uint8_t> px((size_t)S * S * 4), opaque(px.size()), out(px.size());
+  uint32_t seed = 1;
+  for(uint32_t y = 0; y < S; ++y)
+    for(uint32_t x = 0; x < S; ++x) {
+      seed = seed * 1103515245u + 12345u;
+      uint8_t* p = px.data() + ((size_t)y * S + x) * 4;
+      const int n = (int)(seed >> 24 & 15) - 8;
+      p[0] = (uint8_t)std::clamp(128 + (int)(100 * std::sin(x * .05f)) + n, 0, 255);
+      p[1] = (uint8_t)std::clamp((int)(x * 255 / S) + n, 0, 255);
+      p[2] = ((x / 32 + y / 32) & 1) ? 200 : 40;
+      p[3] = std::sin(x * .09f) * std::sin(y * .07f) > -.5f ? 255 : 0;
+    }
+  // BC1 alpha blacks out the color, it gets the image without
+  for(size_t i = 0; i < px.size(); ++i)
+    opaque[i] = i % 4 == 3 ? 255 : px[i];
+
+  HaruhiWorkerPool pool;
+  printf("%ux%u, %u core(s)\n", S, S, pool.concurrency());
+
+  for(uint32_t c = 0; c < CODEC_COUNT; ++c) {
+    const Codec codec = Codec(c);
+    const uint8_t* src = codec == CODEC_BC1 ? opaque.data() : px.data();
+    std::vector<uint8_t> blocks(encodedSize(codec, S, S));
+    for(uint32_t q = QUALITY_FAST; q <= QUALITY_HIGH; ++q) {
+      const Quality quality = Quality(q);
+      const std::string name = std::string(codecName(codec)) + (q ? " high" : " fast");
+
+      const double ns = bench::run((name + " serial").c_str(), (uint64_t)S * S, [&] {
+        encode(codec, quality, src, S, S, 0, blocks.data());
+      }, q ? 1 : 3);
+      const double pool_ns = bench::run((name + " pool").c_str(), (uint64_t)S * S, [&] {
+        encode(codec, quality, src, S, S, 0, blocks.data(), &pool);
+      }, q ? 1 : 3);
+
+      decode(codec, blocks.data(), S, S, out.data());
+      printf("%-40s %10.2f dB rgb %6.2f dB rgba %8.1f MB/s/core serial %8.1f MB/s/core pool\n",
+             name.c_str(), psnr(src, out.data(), (size_t)S * S),
+             psnr(src, out.data(), (size_t)S * S, true),
+             4e3 / ns, 4e3 / pool_ns / pool.concurrency());
+    }
+  }
+
+  return 0;
+}
\ No newline at end of file
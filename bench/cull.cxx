@@ -0,0 +1,111 @@
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <BoundsTree.hxx>
+#include <MathUtil.hxx>
+#include <SceneSystems.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+// frustum culling N boxes spread over a flat 2 km square, the camera in
+// the middle seeing out to 500 m
+// benchCull [objects]
+int main(int argc, char * argv[]) {
+  const size_t N = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> xz(-1000.f, 1000.f), y(-20.f, 20.f), size(.5f, 4.f);
+  std::vector<cull::Aabb> boxes(N);
+  for(auto& b : boxes) {
+    const math::float3 c = { xz(rng), y(rng), xz(rng) }, e = { size(rng), size(rng), size(rng) };
+    b = { c - e, c + e };
+  }
+
+  const math::float4x4 proj = math::makePerspective(90. * 3.141592 / 180., 16. / 9., .1, 500.);
+  std::vector<cull::Frustum> views;
+  for(int i = 0; i < 16; ++i)
+    views.push_back(cull::makeFrustum(proj * math::makeYRotate(i * 2. * 3.141592 / 16.)));
+
+  size_t visible = 0;
+  bench::run("brute force classify", N, [&] {
+    visible = 0;
+    for(const auto& b : boxes) visible += cull::classify(views[0], b) != cull::RESULT_OUTSIDE;
+    bench::keep(visible);
+  });
+
+  HaruhiBoundsTree tree;
+  for(const auto& b : boxes) tree.insert(b);
+  bench::run("rebuild", N, [&] { tree.rebuild(); }, 3);
+
+  std::vector<uint32_t> out;
+  out.reserve(N);
+  cull::Stats stats = {};
+  bench::run("bvh cull", N, [&] {
+    out.clear();
+    stats = tree.cull(views[0], out);
+  });
+  printf("  visible %zu (brute force %zu), culled %zu, tested %zu, nodes %zu\n",
+         stats.visible, visible, stats.culled, stats.tested, stats.nodes);
+
+  bench::run("bvh cull 16 directions", N * views.size(), [&] {
+    for(const auto& f : views) {
+      out.clear();
+      tree.cull(f, out);
+    }
+  });
+
+  HaruhiWorkerPool pool;
+  printf("pool of %u\n", pool.concurrency());
+  bench::run("bvh cull pool", N, [&] {
+    out.clear();
+    stats = tree.cull(views[0], out, &pool);
+  });
+
+  // a tenth of the objects moving a little each frame
+  std::uniform_real_distribution<float> step(-.5f, .5f);
+  bench::run("update 1/10 + refit", N / 10, [&] {
+    for(uint32_t p = 0; p < N; p += 10) {
+      const math::float3 d = { step(rng), 0., step(rng) };
+      boxes[p] = { boxes[p].min + d, boxes[p].max + d };
+      tree.update(p, boxes[p]);
+    }
+    tree.refit();
+  });
+  bench::run("update 1/10 + refit pool", N / 10, [&] {
+    for(uint32_t p = 0; p < N; p += 10) {
+      const math::float3 d = { step(rng), 0., step(rng) };
+      boxes[p] = { boxes[p].min + d, boxes[p].max + d };
+      tree.update(p, boxes[p]);
+    }
+    tree.refit(&pool);
+  });
+  bench::run("bvh cull after refits", N, [&] {
+    out.clear();
+    stats = tree.cull(views[0], out);
+  });
+
+  // the renderer's path, entities to packed visible instances
+  HaruhiEntityWorld world;
+  for(const auto& b : boxes)
+    world.create(scene::Transform{ (b.min + b.max) * .5f, { 0., 0., 0., 1. }, { 1., 1., 1. } },
+                 scene::Mesh{ { 1., 1., 1., 1. }, 0 },
+                 scene::Bounds{ (b.max - b.min) * .5f, cull::NULL_PROXY });
+  HaruhiVisibility visibility;
+  visibility.update(world, &pool);
+  HaruhiInstanceGather gather;
+  std::vector<shader_t::InstanceData> instances(N);
+  bench::run("gather everything", N, [&] {
+    // a fresh target recomposes all of them
+    HaruhiInstanceGather fresh;
+    fresh.write(world, 0, instances.data(), N, &pool);
+  }, 3);
+  bench::run("cull + gather visible", N, [&] {
+    const auto& v = visibility.cull(proj, &pool);
+    gather.writeVisible(world, v.data(), v.size(), instances.data(), N, &pool);
+  }, 3);
+  printf("  %zu of %zu instances uploaded\n", visibility.stats().visible, N);
+  return 0;
+}
\ No newline at end of file
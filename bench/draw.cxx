@@ -0,0 +1,88 @@
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <DrawQueue.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+namespace {
+
+// a scene's worth of distinct objects, drawn one packet each
+struct Object {
+  uint16_t pipeline, texture, mesh;
+  float depth;
+};
+
+} // ns
+
+// recording, sorting and replaying N draws into the null backend
+// benchDraw [draws]
+int main(int argc, char * argv[]) {
+  const size_t N = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+  constexpr size_t GRAIN = 1024;
+
+  std::mt19937 rng(9);
+  std::uniform_int_distribution<unsigned> pipeline(0, 7), texture(0, 63), mesh(0, 255);
+  std::uniform_real_distribution<float> depth(.1f, 500.f);
+  std::vector<Object> objects(N);
+  for(auto& o : objects)
+    o = { uint16_t(pipeline(rng)), uint16_t(texture(rng)), uint16_t(mesh(rng)), depth(rng) };
+
+  HaruhiDrawQueue queue;
+  auto record = [&](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i) {
+      const Object& o = objects[i];
+      queue.list(i / GRAIN).add(
+        cmd::makeKey(cmd::PASS_OPAQUE, o.pipeline, o.texture, o.depth),
+        { o.pipeline, 0, o.texture, o.mesh, o.mesh, 0, uint32_t(i * 64), 0, 36, 1, 0 });
+    }
+  };
+  const size_t lists = (N + GRAIN - 1) / GRAIN;
+
+  bench::run("record", N, [&] {
+    queue.reset(lists);
+    record(0, N);
+  });
+
+  HaruhiWorkerPool pool;
+  printf("pool of %u\n", pool.concurrency());
+  bench::run("record pool", N, [&] {
+    queue.reset(lists);
+    pool.parallelFor(N, GRAIN, record);
+  });
+
+  bench::run("sort", N, [&] { queue.sort(); });
+
+  HaruhiNullDrawBackend backend;
+  cmd::SubmitStats stats = {};
+  bench::run("submit", N, [&] {
+    backend.reset();
+    stats = queue.submit(backend);
+  });
+  printf("  %zu draws: %zu pipeline, %zu texture, %zu vertex buffer, %zu instance buffer changes\n",
+         stats.draws, stats.pipelines, stats.textures, stats.vertexBuffers, stats.instanceBuffers);
+
+  // recorded order straight into the backend, what sorting saves
+  size_t changes = 0;
+  {
+    uint16_t p = cmd::NONE, t = cmd::NONE, m = cmd::NONE;
+    for(const Object& o : objects) {
+      changes += (o.pipeline != p) + (o.texture != t) + (o.mesh != m);
+      p = o.pipeline, t = o.texture, m = o.mesh;
+    }
+  }
+  printf("  unsorted %zu state changes, sorted %zu\n", changes,
+         stats.pipelines + stats.textures + stats.vertexBuffers);
+
+  bench::run("record + sort + submit pool", N, [&] {
+    queue.reset(lists);
+    pool.parallelFor(N, GRAIN, record);
+    queue.sort();
+    backend.reset();
+    queue.submit(backend);
+  });
+  return 0;
+}
\ No newline at end of file
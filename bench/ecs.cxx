@@ -0,0 +1,116 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <EntityWorld.hxx>
+#include <SceneSystems.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+namespace {
+
+struct Position { float x, y, z; };
+struct Velocity { float x, y, z; };
+struct Health { int hp; };
+
+// what the chunk columns replace, one struct per object
+struct Object {
+  Position p;
+  Velocity v;
+  Health h;
+  math::float4 color;
+};
+
+} // ns
+
+// iterating and updating a world of N entities spread over a few archetypes
+// benchEcs [entities]
+int main(int argc, char * argv[]) {
+  const size_t N = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+  HaruhiEntityWorld world;
+  std::vector<ecs::Entity> es;
+  std::vector<Object> objects(N);
+  es.reserve(N);
+  for(size_t i = 0; i < N; ++i) {
+    const Position p = { float(i), 0, 0 };
+    const Velocity v = { 1, .5, .25 };
+    es.push_back(i % 4 ? world.create(p, v) : world.create(p, v, Health{ 100 }));
+    objects[i] = { p, v, { 100 }, { 1, 1, 1, 1 } };
+  }
+  printf("%zu entities, %zu archetypes\n", world.size(), world.archetypeCount());
+
+  bench::run("aos vector position += velocity", N, [&] {
+    for(auto& o : objects) {
+      o.p.x += o.v.x * .016f;
+      o.p.y += o.v.y * .016f;
+      o.p.z += o.v.z * .016f;
+    }
+    bench::keep(objects[N / 2]);
+  });
+  bench::run("ecs each position += velocity", N, [&] {
+    world.each<Position, const Velocity>([](size_t n, Position* __restrict p, const Velocity* __restrict v) {
+      for(size_t i = 0; i < n; ++i) {
+        p[i].x += v[i].x * .016f;
+        p[i].y += v[i].y * .016f;
+        p[i].z += v[i].z * .016f;
+      }
+    });
+  });
+  bench::run("ecs each read only sum", N, [&] {
+    float sum = 0;
+    world.each<const Position>([&](size_t n, const Position* __restrict p) {
+      for(size_t i = 0; i < n; ++i) sum += p[i].x;
+    });
+    bench::keep(sum);
+  });
+  bench::run("ecs get per entity", N, [&] {
+    for(auto e : es) {
+      Position* p = world.get<Position>(e);
+      p->x += 1.f;
+    }
+  });
+
+  HaruhiWorkerPool pool;
+  bench::run("ecs each position += velocity pool", N, [&] {
+    world.each<Position, const Velocity>(&pool, [](size_t n, Position* __restrict p, const Velocity* __restrict v) {
+      for(size_t i = 0; i < n; ++i) {
+        p[i].x += v[i].x * .016f;
+        p[i].y += v[i].y * .016f;
+        p[i].z += v[i].z * .016f;
+      }
+    });
+  });
+
+  HaruhiEntityCommands cmds;
+  bench::run("ecs deferred add + remove of 1/16", N / 16, [&] {
+    for(size_t i = 0; i < N; i += 16)
+      cmds.add(es[i], Health{ 1 });
+    world.apply(cmds);
+    for(size_t i = 0; i < N; i += 16)
+      cmds.remove<Health>(es[i]);
+    world.apply(cmds);
+  }, 3);
+
+  // the renderer's gather, everything changed each frame
+  HaruhiEntityWorld scene;
+  for(size_t i = 0; i < N; ++i)
+    scene.create(scene::Transform{ { float(i), 0., 0. }, { 0., 0., 0., 1. }, { 1., 1., 1. } },
+                 scene::Mesh{ { 1., 1., 1., 1. }, 0 },
+                 scene::Spin{ { 0., 0., 0., 1. }, { 0., 1., 0. }, 0., .01 });
+  HaruhiInstanceGather gather;
+  std::vector<shader_t::InstanceData> instances(N);
+  bench::run("spin + instance gather", N, [&] {
+    scene::spin(scene);
+    gather.write(scene, 0, instances.data(), N);
+  });
+  bench::run("spin + instance gather pool", N, [&] {
+    scene::spin(scene, &pool);
+    gather.write(scene, 0, instances.data(), N, &pool);
+  });
+  bench::run("instance gather unchanged", N, [&] {
+    gather.write(scene, 0, instances.data(), N);
+  });
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <MathUtil.hxx>
+#include <TransformStore.hxx>
+#include <VertexFormat.hxx>
+
+#include "Bench.hxx"
+
+// full 128 byte instances against 32 byte compact ones, what composing
+// them costs and what copying a frame's worth to the gpu buffer costs
+// benchInstance [instances]
+int main(int argc, char * argv[]) {
+  using namespace math;
+
+  const size_t N = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+
+  HaruhiTransformStore store;
+  for(size_t i = 0; i < N; ++i)
+    store.add({ float(i % 100), float(i / 100), -3. }, makeQuat({ 0., 1., 0. }, i * 1e-3f),
+              { 1.f + (i % 7) * .1f, 1., 1. }, { .5, .5, .5, 1. });
+
+  std::vector<shader_t::InstanceData> full(N), fullGpu(N);
+  std::vector<shader_t::CompactInstanceData> compact(N), compactGpu(N);
+  const size_t fullBytes = N * sizeof(shader_t::InstanceData);
+  const size_t compactBytes = N * sizeof(shader_t::CompactInstanceData);
+  printf("%zu instances: %.2f MB full, %.2f MB compact per frame, %.1f vs %.1f MB/s at 60 fps\n",
+         N, fullBytes / 1e6, compactBytes / 1e6, fullBytes * 60 / 1e6, compactBytes * 60 / 1e6);
+
+  // per instance, as the entity gather writes them
+  bench::run("compose full, makeTRS", N, [&] {
+    for(size_t i = 0; i < N; ++i) {
+      const float4x4 m = makeTRS(store.position(i), store.rotation(i), store.scale(i));
+      full[i].instanceTransform = m;
+      full[i].instanceNormalTransform = discardTranslation(m);
+      full[i].instanceColor = { .5, .5, .5, 1. };
+    }
+    bench::keep(full[N - 1]);
+  });
+  bench::run("compose full, soa", N, [&] {
+    store.markAllDirty();
+    store.writeInstances(0, full.data());
+  });
+  bench::run("pack compact", N, [&] {
+    for(size_t i = 0; i < N; ++i)
+      compact[i] = vtx::packInstance(store.position(i), store.rotation(i), store.scale(i), { .5, .5, .5, 1. });
+    bench::keep(compact[N - 1]);
+  });
+
+  // the upload itself, the gpu buffer's pages are touched every frame
+  const double fullCopy = bench::run("copy full", N, [&] {
+    memcpy(fullGpu.data(), full.data(), fullBytes);
+    bench::keep(fullGpu[N - 1]);
+  });
+  const double compactCopy = bench::run("copy compact", N, [&] {
+    memcpy(compactGpu.data(), compact.data(), compactBytes);
+    bench::keep(compactGpu[N - 1]);
+  });
+  printf("  copy %.1fx faster, %.0f vs %.0f MB/s\n", fullCopy / compactCopy,
+         sizeof(shader_t::InstanceData) * 1e3 / fullCopy,
+         sizeof(shader_t::CompactInstanceData) * 1e3 / compactCopy);
+
+  // what the vertex shader adds per instance, on the cpu
+  bench::run("expand compact (cpu reference)", N, [&] {
+    for(size_t i = 0; i < N; ++i)
+      full[i] = vtx::expandInstance(compact[i]);
+    bench::keep(full[N - 1]);
+  });
+  return 0;
+}
\ No newline at end of file
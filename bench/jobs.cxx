@@ -0,0 +1,107 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+namespace {
+
+uint64_t
+fib(HaruhiWorkerPool& pool, int n) {
+  if(n < 16) {
+    uint64_t a = 0, b = 1;
+    for(int i = 0; i < n; ++i) {
+      const uint64_t c = a + b;
+      a = b;
+      b = c;
+    }
+    return a;
+  }
+  uint64_t x = 0, y = 0;
+  HaruhiWorkerPool::Counter c;
+  pool.run([&] { x = fib(pool, n - 1); }, &c);
+  y = fib(pool, n - 2);
+  pool.wait(c);
+  return x + y;
+}
+
+// a few hundred ns of math per item
+float
+kernel(size_t i) noexcept {
+  float v = (float)i;
+  for(int k = 0; k < 32; ++k)
+    v = std::sqrt(v * 1.0001f + 1.f);
+  return v;
+}
+
+struct Times {
+  double empty, range, spawn, graph;
+};
+
+} // ns
+
+// the same workloads from 1 worker up to the thread limit, with the
+// speedup against one worker. scaling needs the cores to show it
+// benchJobs [max threads]
+int main(int argc, char * argv[]) {
+  const unsigned limit = argc > 1 ? strtoul(argv[1], nullptr, 10) : 64;
+  printf("hardware threads %u\n", std::thread::hardware_concurrency());
+
+  constexpr size_t JOBS = 1 << 16, ITEMS = 1 << 20, NODES = 256;
+  std::vector<float> out(ITEMS);
+  std::vector<Times> times;
+
+  for(unsigned threads = 1; threads <= limit; threads *= 2) {
+    HaruhiWorkerPool pool(threads);
+    const std::string at = " x" + std::to_string(threads);
+    Times t;
+
+    t.empty = bench::run(("empty jobs" + at).c_str(), JOBS, [&] {
+      HaruhiWorkerPool::Counter c;
+      for(size_t i = 0; i < JOBS; ++i)
+        pool.run([] {}, &c);
+      pool.wait(c);
+    });
+    t.range = bench::run(("parallelFor" + at).c_str(), ITEMS, [&] {
+      pool.parallelFor(ITEMS, 4096, [&](size_t b, size_t e) {
+        for(size_t i = b; i < e; ++i)
+          out[i] = kernel(i);
+      });
+      bench::keep(out[ITEMS / 2]);
+    });
+    // fib(30) spawns about 2k leaves of 16
+    t.spawn = bench::run(("recursive spawn" + at).c_str(), 1, [&] {
+      bench::keep(fib(pool, 30));
+    });
+
+    // wide layers, each node depends on two of the layer above
+    HaruhiTaskGraph graph;
+    std::vector<HaruhiTaskGraph::Task> tasks;
+    for(size_t i = 0; i < NODES; ++i) {
+      tasks.push_back(graph.add("node", [&out, i] {
+        for(size_t k = i * 1024; k < (i + 1) * 1024; ++k)
+          out[k] = kernel(k);
+      }));
+      if(i >= 16) {
+        graph.precede(tasks[i - 16], tasks[i]);
+        graph.precede(tasks[i - 16 + (i + 1) % 16], tasks[i]);
+      }
+    }
+    t.graph = bench::run(("task graph" + at).c_str(), NODES, [&] {
+      graph.run(pool);
+    });
+    times.push_back(t);
+  }
+
+  printf("\n%-8s %10s %12s %16s %11s\n", "threads", "empty", "parallelFor", "recursive spawn", "task graph");
+  for(size_t i = 0; i < times.size(); ++i)
+    printf("%-8u %9.2fx %11.2fx %15.2fx %10.2fx\n", 1u << i,
+      times[0].empty / times[i].empty, times[0].range / times[i].range,
+      times[0].spawn / times[i].spawn, times[0].graph / times[i].graph);
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <Terrain.hxx>
+#include <VoxelLight.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+// a generated world of 512 x 256 x 512 blocks lit from scratch on pools of
+// growing size, then single edits lit incrementally: a lamp placed and
+// taken away on the surface, and a block put over open sky and taken
+// away. the edit lines read as ns per edit
+// benchLight [chunks per side]
+int main(int argc, char * argv[]) {
+  const int side = argc > 1 ? atoi(argv[1]) : 16;
+  constexpr int S = voxel::CHUNK_SIZE;
+
+  terrain::Settings settings;
+  settings.amplitude = 64.f;
+  std::vector<voxel::ChunkCoord> coords;
+  for(int cx = 0; cx < side; ++cx)
+    for(int cz = 0; cz < side; ++cz)
+      for(int cy = -4; cy < 4; ++cy) coords.push_back({ cx, cy, cz });
+
+  HaruhiVoxelWorld world;
+  HaruhiVoxelLight light(world);
+  const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+  {
+    HaruhiWorkerPool pool(hw);
+    terrain::generate(settings, world, coords.data(), coords.size(), &pool);
+  }
+  printf("%d x %d x %d blocks, %zu chunks\n", side * S, 8 * S, side * S, coords.size());
+
+  char name[64];
+  for(unsigned threads = 1; threads <= hw; threads *= 2) {
+    HaruhiWorkerPool pool(threads);
+    snprintf(name, sizeof(name), "relight, pool of %u", threads);
+    const double ns = bench::run(name, coords.size(), [&] {
+      light.relight(coords.data(), coords.size(), &pool);
+    }, 2);
+    printf("  %.0f chunks/s, %.1f ms for the world\n", 1e9 / ns, ns * coords.size() * 1e-6);
+    if(threads < hw && threads * 2 > hw) threads = hw / 2;
+  }
+
+  // spots on the surface away from each other, and above them in the air
+  struct Spot {
+    int x, y, z;
+  };
+  std::vector<Spot> spots;
+  for(int i = 0; i < 64; ++i) {
+    const int x = 24 + (i % 8) * (side * S - 48) / 8, z = 24 + (i / 8) * (side * S - 48) / 8;
+    int y = 4 * S - 1;
+    while(y > -4 * S && world.get(x, y - 1, z) == voxel::BLOCK_AIR) --y;
+    spots.push_back({ x, y, z });
+  }
+
+  size_t writes = 0;
+  const double lamp = bench::run("lamp placed and removed", spots.size() * 2, [&] {
+    for(const Spot& s : spots) {
+      world.set(s.x, s.y, s.z, voxel::BLOCK_LAMP);
+      writes += light.changed(s.x, s.y, s.z);
+      world.set(s.x, s.y, s.z, voxel::BLOCK_AIR);
+      writes += light.changed(s.x, s.y, s.z);
+    }
+  });
+  printf("  %.1f us per edit, %zu light writes\n", lamp * 1e-3, writes / (spots.size() * 2 * 6));
+
+  writes = 0;
+  const double roof = bench::run("block over sky placed and removed", spots.size() * 2, [&] {
+    for(const Spot& s : spots) {
+      world.set(s.x, s.y + 8, s.z, voxel::BLOCK_STONE);
+      writes += light.changed(s.x, s.y + 8, s.z);
+      world.set(s.x, s.y + 8, s.z, voxel::BLOCK_AIR);
+      writes += light.changed(s.x, s.y + 8, s.z);
+    }
+  });
+  printf("  %.1f us per edit, %zu light writes\n", roof * 1e-3, writes / (spots.size() * 2 * 6));
+  return 0;
+}
\ No newline at end of file
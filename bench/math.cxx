@@ -0,0 +1,110 @@
+#include <cstdio>
+#include <vector>
+
+#include <MathUtil.hxx>
+
+#include "Bench.hxx"
+
+#if defined(__APPLE__)
+#include <simd/simd.h>
+
+// the MathUtil code this library replaced, kept for comparison
+namespace legacy {
+
+static simd::float4x4
+makeXRotate(float a) {
+  return simd_matrix_from_rows(
+    (simd::float4){ 1., 0., 0., 0. },
+    (simd::float4){ 0., cosf(a), sinf(a), 0. },
+    (simd::float4){ 0., -sinf(a), cosf(a), 0. },
+    (simd::float4){ 0., 0., 0., 1. });
+}
+
+static simd::float4x4
+makeYRotate(float a) {
+  return simd_matrix_from_rows(
+    (simd::float4){ cosf(a), 0., sinf(a), 0. },
+    (simd::float4){ 0., 1., 0., 0. },
+    (simd::float4){ -sinf(a), 0., cosf(a), 0. },
+    (simd::float4){ 0., 0., 0., 1. });
+}
+
+static simd::float4x4
+makeTranslate(const simd::float3& v) {
+  return simd_matrix(
+    (simd::float4){ 1., 0., 0., 0. },
+    (simd::float4){ 0., 1., 0., 0. },
+    (simd::float4){ 0., 0., 1., 0. },
+    (simd::float4){ v.x, v.y, v.z, 1. });
+}
+
+} // ns legacy
+#endif
+
+int main() {
+  using namespace math;
+
+  constexpr size_t N = 1 << 16;
+
+#if defined(HARUHI_SIMD_AVX2)
+  printf("backend: avx2\n");
+#elif defined(HARUHI_SIMD_SSE2)
+  printf("backend: sse2\n");
+#elif defined(HARUHI_SIMD_NEON)
+  printf("backend: neon\n");
+#else
+  printf("backend: scalar\n");
+#endif
+
+  std::vector<float4x4> out(N);
+  std::vector<float> angles(N);
+  for(size_t i = 0; i < N; ++i)
+    angles[i] = (float)i * 1e-3f;
+
+  // the per instance transform of HaruhiRenderer::draw
+  bench::run("translate*rotX*rotY chained", N, [&] {
+    for(size_t i = 0; i < N; ++i)
+      out[i] = makeTranslate({ 0., 0., -3. }) * makeXRotate(.2) * makeYRotate(angles[i]);
+    bench::keep(out[N - 1]);
+  });
+
+  bench::run("translate*rotX*rotY fused", N, [&] {
+    for(size_t i = 0; i < N; ++i)
+      out[i] = makeTranslateXYRotate({ 0., 0., -3. }, .2, angles[i]);
+    bench::keep(out[N - 1]);
+  });
+
+#if defined(__APPLE__)
+  std::vector<simd::float4x4> legacy_out(N);
+  bench::run("translate*rotX*rotY <simd/simd.h>", N, [&] {
+    for(size_t i = 0; i < N; ++i)
+      legacy_out[i] =
+        legacy::makeTranslate({ 0., 0., -3. })
+        * legacy::makeXRotate(.2) * legacy::makeYRotate(angles[i]);
+    bench::keep(legacy_out[N - 1]);
+  });
+#endif
+
+  bench::run("makeTRS", N, [&] {
+    for(size_t i = 0; i < N; ++i)
+      out[i] = makeTRS(
+        { 1., 2., 3. }, makeQuat({ 0., 1., 0. }, angles[i]), { 1., 1., 1. });
+    bench::keep(out[N - 1]);
+  });
+
+  const float4x4 m = makeXRotate(.3) * makeTranslate({ 1., 2., 3. });
+  bench::run("float4x4 * float4x4", N, [&] {
+    for(size_t i = 0; i < N; ++i)
+      out[i] = out[i] * m;
+    bench::keep(out[N - 1]);
+  });
+
+  std::vector<float3x3> normals(N);
+  bench::run("discardTranslation", N, [&] {
+    for(size_t i = 0; i < N; ++i)
+      normals[i] = discardTranslation(out[i]);
+    bench::keep(normals[N - 1]);
+  });
+
+  return 0;
+}
\ No newline at end of file
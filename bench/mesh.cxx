@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <MeshOptimizer.hxx>
+#include <VertexFormat.hxx>
+
+#include "Bench.hxx"
+
+namespace {
+
+using shader_t::VertexData;
+
+// uv sphere, rings by segments
+void
+sphere(int rings, int segments, std::vector<VertexData>& verts, std::vector<uint32_t>& indices) {
+  for(int r = 0; r <= rings; ++r)
+    for(int s = 0; s <= segments; ++s) {
+      const float th = 3.14159265f * r / rings, ph = 2.f * 3.14159265f * s / segments;
+      const math::float3 n = { std::sin(th) * std::cos(ph), std::cos(th), std::sin(th) * std::sin(ph) };
+      verts.push_back({ n * 2.f, n, { float(s) / segments, float(r) / rings } });
+    }
+  for(int r = 0; r < rings; ++r)
+    for(int s = 0; s < segments; ++s) {
+      const uint32_t a = r * (segments + 1) + s, b = a + 1, c = a + segments + 1, d = c + 1;
+      indices.insert(indices.end(), { a, c, b, b, c, d });
+    }
+}
+
+void
+print(const char* label, const std::vector<uint32_t>& indices, size_t vertices) {
+  const mesh::CacheStats c = mesh::analyzeVertexCache(indices.data(), indices.size(), vertices);
+  const mesh::FetchStats f48 = mesh::analyzeVertexFetch(indices.data(), indices.size(), vertices, sizeof(VertexData));
+  const mesh::FetchStats f16 = mesh::analyzeVertexFetch(indices.data(), indices.size(), vertices,
+                                                        sizeof(shader_t::PackedVertexData));
+  printf("  %-28s acmr %.3f atvr %.3f, fetched %8zu bytes (overfetch %.2f), packed %8zu bytes\n",
+         label, c.acmr, c.atvr, f48.bytes, f48.overfetch, f16.bytes);
+}
+
+} // ns
+
+// cache, overdraw and fetch passes over a scrambled sphere, with the
+// stats before and after each, and the vertex packing
+// benchMesh [rings]
+int main(int argc, char * argv[]) {
+  const int rings = argc > 1 ? atoi(argv[1]) : 128;
+
+  std::vector<VertexData> verts;
+  std::vector<uint32_t> indices;
+  sphere(rings, rings * 2, verts, indices);
+  const size_t V = verts.size(), T = indices.size() / 3;
+  printf("%zu vertices, %zu triangles\n", V, T);
+  print("generated order", indices, V);
+
+  // what an exporter with no care for order hands over
+  std::mt19937 rng(1);
+  {
+    std::vector<size_t> order(T);
+    for(size_t i = 0; i < T; ++i) order[i] = i;
+    std::shuffle(order.begin(), order.end(), rng);
+    std::vector<uint32_t> out;
+    for(size_t t : order) out.insert(out.end(), indices.begin() + t * 3, indices.begin() + t * 3 + 3);
+    std::vector<uint32_t> perm(V);
+    for(size_t i = 0; i < V; ++i) perm[i] = uint32_t(i);
+    std::shuffle(perm.begin(), perm.end(), rng);
+    std::vector<VertexData> scattered(V);
+    mesh::remapVertices(scattered.data(), verts.data(), V, sizeof(VertexData), perm.data());
+    mesh::remapIndices(indices.data(), out.data(), out.size(), perm.data());
+    verts = scattered;
+  }
+  print("scrambled", indices, V);
+
+  std::vector<uint32_t> cached(indices.size()), overdrawn(indices.size()), fetched(indices.size());
+  bench::run("optimizeVertexCache", T, [&] {
+    mesh::optimizeVertexCache(cached.data(), indices.data(), indices.size(), V);
+  }, 3);
+  print("vertex cache", cached, V);
+
+  bench::run("optimizeOverdraw", T, [&] {
+    mesh::optimizeOverdraw(overdrawn.data(), cached.data(), cached.size(), verts.data(), V);
+  }, 3);
+  print("overdraw", overdrawn, V);
+
+  std::vector<uint32_t> remap(V);
+  std::vector<VertexData> remapped(V);
+  bench::run("vertex fetch remap", V, [&] {
+    mesh::optimizeVertexFetchRemap(remap.data(), overdrawn.data(), overdrawn.size(), V);
+    mesh::remapIndices(fetched.data(), overdrawn.data(), overdrawn.size(), remap.data());
+    mesh::remapVertices(remapped.data(), verts.data(), V, sizeof(VertexData), remap.data());
+  }, 3);
+  print("vertex fetch", fetched, V);
+
+  const vtx::Quantization q = vtx::fitQuantization(remapped.data(), V);
+  std::vector<shader_t::PackedVertexData> packed(V);
+  bench::run("pack", V, [&] { vtx::pack(remapped.data(), V, q, packed.data()); });
+  bench::run("unpack", V, [&] { vtx::unpack(packed.data(), V, q, remapped.data()); });
+  printf("  vertex buffer %zu -> %zu bytes\n", V * sizeof(VertexData), V * sizeof(shader_t::PackedVertexData));
+  return 0;
+}
\ No newline at end of file
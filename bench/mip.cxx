@@ -0,0 +1,37 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <MipChain.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+// full chain of a size x size RGBA8 texture
+// benchMip [size]
+int main(int argc, char * argv[]) {
+  const uint32_t S = argc > 1 ? strtoul(argv[1], nullptr, 10) : 2048;
+
+  std::vector<uint8_t> px((size_t)S * S * 4);
+  for(size_t i = 0; i < px.size(); ++i)
+    px[i] = (uint8_t)(i * 2654435761u >> 13);
+
+  HaruhiMipChain chain;
+  HaruhiMipChain::Options cutout = {};
+  cutout.alphaCutoff = .5f;
+
+  printf("%ux%u, %u levels, per source texel\n", S, S, HaruhiMipChain::levelCount(S, S));
+  bench::run("mip chain serial", (uint64_t)S * S, [&] {
+    chain.build(px.data(), S, S, 0);
+  }, 3);
+  bench::run("mip chain serial alpha coverage", (uint64_t)S * S, [&] {
+    chain.build(px.data(), S, S, 0, cutout);
+  }, 3);
+
+  HaruhiWorkerPool pool;
+  bench::run("mip chain pool", (uint64_t)S * S, [&] {
+    chain.build(px.data(), S, S, 0, {}, &pool);
+  }, 3);
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <MeshLoader.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+namespace {
+
+// a terrain grid as exporters write it, n by n quads
+std::string
+terrainObj(int n) {
+  std::string s;
+  char line[160];
+  for(int y = 0; y <= n; ++y)
+    for(int x = 0; x <= n; ++x) {
+      const double h = std::sin(x * .05) * std::cos(y * .07) * 4.;
+      snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n",
+               x * .25, h, y * .25, x / double(n), y / double(n), -std::cos(x * .05) * .2, .97, .1);
+      s += line;
+    }
+  for(int y = 0; y < n; ++y)
+    for(int x = 0; x < n; ++x) {
+      const int a = y * (n + 1) + x + 1, b = a + 1, c = a + n + 1, d = c + 1;
+      snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+               a, a, a, c, c, c, d, d, d, b, b, b);
+      s += line;
+    }
+  return s;
+}
+
+// the usual sscanf loader, positions, texcoords and normals only
+size_t
+scanfObj(const char* text, size_t size) {
+  std::vector<float> v;
+  std::vector<int> f;
+  std::string line;
+  for(const char* p = text, *end = text + size; p < end;) {
+    const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+    if(!eol) eol = end;
+    line.assign(p, eol);
+    float a, b, c;
+    int i[12];
+    if(sscanf(line.c_str(), "v %f %f %f", &a, &b, &c) == 3
+       || sscanf(line.c_str(), "vt %f %f", &a, &b) == 2
+       || sscanf(line.c_str(), "vn %f %f %f", &a, &b, &c) == 3)
+      v.push_back(a);
+    else if(sscanf(line.c_str(), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d", i, i + 1, i + 2, i + 3, i + 4,
+                   i + 5, i + 6, i + 7, i + 8, i + 9, i + 10, i + 11) >= 9)
+      f.insert(f.end(), i, i + 3);
+    p = eol + 1;
+  }
+  return v.size() + f.size();
+}
+
+} // ns
+
+// obj loading in MB/s from a file in /tmp, serially and on pools of
+// growing size, against sscanf and how fast memchr gets through the text.
+// Mitems/s reads as MB/s
+// benchModel [quads per side]
+int main(int argc, char * argv[]) {
+  const int n = argc > 1 ? atoi(argv[1]) : 600;
+  const char* pth = "/tmp/haruhi_bench_model.obj";
+
+  const std::string text = terrainObj(n);
+  FILE* fp = fopen(pth, "wb");
+  if(!fp || fwrite(text.data(), 1, text.size(), fp) != text.size() || fclose(fp)) {
+    printf("can't write %s\n", pth);
+    return EXIT_FAILURE;
+  }
+  const size_t B = text.size();
+  printf("%.1f MB, %d vertices, %d triangles\n", B / 1e6, (n + 1) * (n + 1), n * n * 2);
+
+  bench::run("memchr lines", B, [&] {
+    size_t lines = 0;
+    for(const char* p = text.data(), *end = p + B; (p = static_cast<const char*>(memchr(p, '\n', end - p))); ++p)
+      ++lines;
+    bench::keep(lines);
+  });
+  bench::run("sscanf parse", B, [&] { bench::keep(scanfObj(text.data(), B)); }, 2);
+
+  model::Mesh m;
+  model::LoadStats stats = {};
+  bench::run("parseObj serial", B, [&] { model::parseObj(text.data(), B, m, nullptr, &stats); });
+  printf("  parse %.1f ms, build %.1f ms, %zu vertices\n", stats.parseMs, stats.buildMs, m.vertices.size());
+  bench::run("loadObj serial", B, [&] { model::loadObj(pth, m); });
+
+  const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+  for(unsigned threads = 1; threads <= hw; threads *= 2) {
+    HaruhiWorkerPool pool(threads);
+    char name[64];
+    snprintf(name, sizeof(name), "loadObj pool of %u", threads);
+    bench::run(name, B, [&] { model::loadObj(pth, m, &pool, &stats); });
+    printf("  map %.2f ms, parse %.1f ms, build %.1f ms\n", stats.mapMs, stats.parseMs, stats.buildMs);
+    if(threads < hw && threads * 2 > hw) threads = hw / 2;
+  }
+
+  remove(pth);
+  return 0;
+}
\ No newline at end of file
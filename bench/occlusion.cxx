@@ -0,0 +1,103 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <MathUtil.hxx>
+#include <OcclusionBuffer.hxx>
+#include <VoxelWorld.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+using namespace voxel;
+
+namespace {
+
+// rolling hills of grass over dirt and stone, peaks around y = 54
+void
+terrain(HaruhiVoxelWorld& w, ChunkCoord c) {
+  voxel::BlockStorage& b = w.edit(c);
+  for(int z = 0; z < CHUNK_SIZE; ++z)
+    for(int x = 0; x < CHUNK_SIZE; ++x) {
+      const float wx = float(c.x * CHUNK_SIZE + x), wz = float(c.z * CHUNK_SIZE + z);
+      const int h = int(40.f + 10.f * std::sin(wx * .07f) * std::cos(wz * .05f) + 4.f * std::sin(wx * .3f + wz * .2f));
+      for(int y = 0; y < CHUNK_SIZE; ++y) {
+        const int wy = c.y * CHUNK_SIZE + y;
+        b.set((z * CHUNK_SIZE + y) * CHUNK_SIZE + x,
+              wy < h - 4 ? BLOCK_STONE : wy < h - 1 ? BLOCK_DIRT : wy < h ? BLOCK_GRASS : BLOCK_AIR);
+      }
+    }
+}
+
+} // ns
+
+// occluders from the opaque faces of a hilly voxel world, the camera low
+// between the hills, and boxes scattered over it tested against them
+// benchOcclusion [boxes] [depth.pgm]
+int main(int argc, char * argv[]) {
+  const size_t N = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+  const char* pgm = argc > 2 ? argv[2] : nullptr;
+
+  HaruhiWorkerPool pool;
+  printf("pool of %u\n", pool.concurrency());
+
+  HaruhiVoxelWorld world;
+  for(int cz = -12; cz < 0; ++cz)
+    for(int cx = -6; cx < 6; ++cx)
+      for(int cy = 0; cy < 2; ++cy) terrain(world, { cx, cy, cz });
+  world.remesh(&pool);
+
+  const math::float4x4 viewProj =
+    math::makePerspective(90. * 3.141592 / 180., 16. / 9., .1, 500.) * math::makeTranslate({ 0., -46., 0. });
+  const cull::Frustum frustum = cull::makeFrustum(viewProj);
+
+  HaruhiOcclusionBuffer serial(320, 180), parallel(320, 180, &pool);
+  auto occluders = [&](HaruhiOcclusionBuffer& buf) {
+    buf.begin(viewProj);
+    world.forEachChunk([&](const ChunkCoord& c, const ChunkMesh& mesh) {
+      constexpr float S = CHUNK_SIZE;
+      const cull::Aabb bounds = { { c.x * S, c.y * S, c.z * S }, { (c.x + 1) * S, (c.y + 1) * S, (c.z + 1) * S } };
+      if(cull::classify(frustum, bounds) == cull::RESULT_OUTSIDE) return;
+      for(uint32_t v : mesh.occluders)
+        buf.addQuad(mesh.vertices[v].pos, mesh.vertices[v + 1].pos,
+                    mesh.vertices[v + 2].pos, mesh.vertices[v + 3].pos);
+    });
+  };
+
+  occluders(serial);
+  const size_t tris = serial.queued();
+  bench::run("gather occluders", tris, [&] { occluders(serial); });
+  bench::run("render", tris, [&] { serial.render(); });
+  const auto& t = serial.timings();
+  printf("  %zu triangles, %.1f%% culled, %.1f%% clipped, setup %.2f ms raster %.2f ms per render\n", tris,
+         100. * t.culled / t.triangles, 100. * t.clipped / t.triangles,
+         t.setupMs * tris / t.triangles, t.rasterMs * tris / t.triangles);
+  occluders(parallel);
+  bench::run("render pool", tris, [&] { parallel.render(); });
+
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<float> x(-192.f, 192.f), y(20.f, 60.f), z(-384.f, -2.f), size(.5f, 2.f);
+  std::vector<cull::Aabb> boxes;
+  for(size_t i = 0; i < N; ++i) {
+    const math::float3 c = { x(rng), y(rng), z(rng) }, e = { size(rng), size(rng), size(rng) };
+    const cull::Aabb b = { c - e, c + e };
+    if(cull::classify(frustum, b) != cull::RESULT_OUTSIDE) boxes.push_back(b);
+  }
+
+  size_t visible = 0;
+  bench::run("test boxes in view", boxes.size(), [&] {
+    visible = 0;
+    for(const auto& b : boxes) visible += serial.visible(b);
+    bench::keep(visible);
+  });
+  printf("  %zu of %zu boxes in view occluded (%.1f%%)\n", boxes.size() - visible, boxes.size(),
+         100. * (boxes.size() - visible) / boxes.size());
+
+  if(pgm) {
+    if(serial.writePGM(pgm)) printf("depth written to %s\n", pgm);
+    else printf("can't write %s\n", pgm);
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <Profiler.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+// cost of a marker against the same loop without one
+// benchProfile [markers]
+int main(int argc, char * argv[]) {
+  const size_t N = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+  uint64_t sum = 0;
+  const double empty = bench::run("empty loop", N, [&] {
+    for(size_t i = 0; i < N; ++i) {
+      sum += i;
+      bench::keep(sum);
+    }
+  });
+
+  const double scoped = bench::run("scope", N, [&] {
+    for(size_t i = 0; i < N; ++i) {
+      prof::Scope s("bench");
+      sum += i;
+      bench::keep(sum);
+    }
+  });
+
+  const double counted = bench::run("counter", N, [&] {
+    for(size_t i = 0; i < N; ++i) {
+      prof::counter("bench", int64_t(i));
+      sum += i;
+      bench::keep(sum);
+    }
+  });
+
+  // the compiled out macro, for comparison with the empty loop
+  bench::run("disabled macro", N, [&] {
+    for(size_t i = 0; i < N; ++i) {
+      ((void)0);
+      sum += i;
+      bench::keep(sum);
+    }
+  });
+  printf("  %.1f ns per scope, %.1f ns per counter\n", scoped - empty, counted - empty);
+
+  // every worker writes its own ring
+  HaruhiWorkerPool pool;
+  printf("pool of %u\n", pool.concurrency());
+  bench::run("scope pool", N, [&] {
+    pool.parallelFor(N, 4096, [](size_t b, size_t e) {
+      uint64_t local = 0;
+      for(size_t i = b; i < e; ++i) {
+        prof::Scope s("bench");
+        local += i;
+        bench::keep(local);
+      }
+    });
+  });
+
+  bench::run("collect", prof::RING_SIZE, [&] { bench::keep(prof::collect().size()); });
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <Broadphase.hxx>
+#include <Terrain.hxx>
+#include <VoxelQuery.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+namespace {
+
+// the plain dda, one cell at a time through world.get
+bool
+naive(const HaruhiVoxelWorld& w, const voxel::Ray& ray) {
+  const float o[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+  const float d[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+  int p[3], step[3];
+  float next[3], delta[3];
+  for(int a = 0; a < 3; ++a) {
+    p[a] = int(std::floor(o[a]));
+    step[a] = d[a] > 0.f ? 1 : d[a] < 0.f ? -1 : 0;
+    delta[a] = step[a] ? float(step[a]) / d[a] : INFINITY;
+    next[a] = step[a] > 0 ? (float(p[a] + 1) - o[a]) * delta[a] : step[a] ? (o[a] - float(p[a])) * delta[a] : INFINITY;
+  }
+  for(;;) {
+    if(w.get(p[0], p[1], p[2])) return true;
+    int e = 0;
+    for(int a = 1; a < 3; ++a)
+      if(next[a] < next[e]) e = a;
+    if(!(next[e] <= ray.length)) return false;
+    p[e] += step[e];
+    next[e] += delta[e];
+  }
+}
+
+} // ns
+
+// a generated world of 512 x 256 x 512 blocks: rays from the sky down onto
+// the hills and short picking rays from just above them, on pools of
+// growing size and through the plain dda for comparison. then bodies
+// falling and sliding over the hills, and the sweep and prune over their
+// boxes. rays and steps read as ns per ray or body
+// benchQuery [chunks per side]
+int main(int argc, char * argv[]) {
+  const int side = argc > 1 ? atoi(argv[1]) : 16;
+  constexpr int S = voxel::CHUNK_SIZE;
+
+  terrain::Settings settings;
+  settings.amplitude = 64.f;
+  std::vector<voxel::ChunkCoord> coords;
+  for(int cx = 0; cx < side; ++cx)
+    for(int cz = 0; cz < side; ++cz)
+      for(int cy = -4; cy < 4; ++cy) coords.push_back({ cx, cy, cz });
+
+  HaruhiVoxelWorld world;
+  const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+  {
+    HaruhiWorkerPool pool(hw);
+    terrain::generate(settings, world, coords.data(), coords.size(), &pool);
+  }
+  printf("%d x %d x %d blocks, %zu chunks\n", side * S, 8 * S, side * S, coords.size());
+  HaruhiVoxelQuery query(world);
+
+  // the first air above the ground
+  const auto surface = [&](int x, int z) {
+    int y = 4 * S - 1;
+    while(y > -4 * S && world.get(x, y - 1, z) == voxel::BLOCK_AIR) --y;
+    return y;
+  };
+
+  constexpr size_t N = 1 << 16;
+  std::mt19937 rng(17);
+  std::uniform_real_distribution<float> across(8.f, float(side * S - 8)), unit(-1.f, 1.f);
+  std::vector<voxel::Ray> sky(N), pick(N);
+  for(size_t i = 0; i < N; ++i) {
+    sky[i] = { { across(rng), float(4 * S - 1), across(rng) }, { unit(rng), -1.f, unit(rng) }, 512.f };
+    const float x = across(rng), z = across(rng);
+    pick[i] = { { x, float(surface(int(x), int(z))) + 1.6f, z }, { unit(rng), unit(rng) - .3f, unit(rng) }, 8.f };
+  }
+
+  std::vector<voxel::RayHit> hits(N);
+  char name[64];
+  for(const auto& set : { std::make_pair("sky", &sky), std::make_pair("pick", &pick) }) {
+    const std::vector<voxel::Ray>& rays = *set.second;
+    snprintf(name, sizeof(name), "%s rays, plain dda", set.first);
+    bench::run(name, N, [&] {
+      size_t n = 0;
+      for(const voxel::Ray& r : rays) n += naive(world, r);
+      bench::keep(n);
+    }, 2);
+    for(unsigned threads = 1; threads <= hw; threads *= 2) {
+      HaruhiWorkerPool pool(threads);
+      snprintf(name, sizeof(name), "%s rays, pool of %u", set.first, threads);
+      const double ns = bench::run(name, N, [&] {
+        query.raycast(rays.data(), N, hits.data(), threads > 1 ? &pool : nullptr);
+        bench::keep(hits[N - 1]);
+      });
+      printf("  %.2f M rays/s\n", 1e3 / ns);
+      if(threads < hw && threads * 2 > hw) threads = hw / 2;
+    }
+  }
+
+  // bodies dropped onto the hills, walking about
+  constexpr size_t B = 1 << 14;
+  std::vector<voxel::Body> start(B);
+  for(voxel::Body& b : start) {
+    const float x = across(rng), z = across(rng);
+    const math::float3 p = { x, float(surface(int(x), int(z))) + 2.f * (1.f + unit(rng)), z };
+    b = { { p, p + math::float3{ .6f, 1.8f, .6f } }, { 4.f * unit(rng), 0.f, 4.f * unit(rng) }, 0 };
+  }
+  constexpr int FRAMES = 30;
+  std::vector<voxel::Body> bodies;
+  for(unsigned threads = 1; threads <= hw; threads *= 2) {
+    HaruhiWorkerPool pool(threads);
+    snprintf(name, sizeof(name), "body steps, pool of %u", threads);
+    const double ns = bench::run(name, B * FRAMES, [&] {
+      bodies = start;
+      for(int f = 0; f < FRAMES; ++f)
+        query.step(bodies.data(), B, 1.f / 60.f, { 0.f, -30.f, 0.f }, threads > 1 ? &pool : nullptr);
+      bench::keep(bodies[B - 1]);
+    }, 2);
+    printf("  %.2f M body steps/s\n", 1e3 / ns);
+    if(threads < hw && threads * 2 > hw) threads = hw / 2;
+  }
+
+  // the same bodies' boxes over the frames of their walk
+  std::vector<std::vector<cull::Aabb>> frames(FRAMES, std::vector<cull::Aabb>(B));
+  bodies = start;
+  for(int f = 0; f < FRAMES; ++f) {
+    query.step(bodies.data(), B, 1.f / 60.f, { 0.f, -30.f, 0.f });
+    for(size_t i = 0; i < B; ++i) frames[f][i] = bodies[i].box;
+  }
+  HaruhiBroadphase broad;
+  size_t pairs = 0;
+  bench::run("sweep and prune update", B * FRAMES, [&] {
+    for(const std::vector<cull::Aabb>& boxes : frames) pairs = broad.update(boxes.data(), B);
+  }, 2);
+  printf("  %zu pairs\n", pairs);
+  return 0;
+}
\ No newline at end of file
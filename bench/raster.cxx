@@ -0,0 +1,68 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <MathUtil.hxx>
+#include <Primitives.hxx>
+#include <SoftRasterizer.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+// per stage cost of the software pipeline for a field of cubes
+int main(int argc, char * argv[]) {
+  const size_t N = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000;
+  constexpr uint32_t W = 1280, H = 720;
+  constexpr int FRAMES = 10;
+
+  shader_t::VertexData verts[primitives::CUBE_VERTEX_COUNT];
+  uint16_t indices[primitives::CUBE_INDEX_COUNT];
+  primitives::makeCube(.5f, verts, indices);
+
+  std::vector<uint8_t> texels(16 * 16 * 4);
+  for(size_t i = 0; i < texels.size(); ++i)
+    texels[i] = (uint8_t)(i * 37);
+  const HaruhiSoftRasterizer::Texture tex = { 16, 16, texels.data() };
+
+  std::vector<shader_t::InstanceData> inst(N);
+  const size_t side = 100;
+  for(size_t i = 0; i < N; ++i) {
+    const math::float3 p = {
+      float(i % side) - side * .5f, float(i / side % side) * .5f - 10.f, -5.f - float(i / side) };
+    inst[i].instanceTransform = math::makeTranslateXYRotate(p, .2f, i * .1f);
+    inst[i].instanceNormalTransform = math::discardTranslation(inst[i].instanceTransform);
+  }
+
+  shader_t::CameraData cam;
+  cam.perspTransform = math::makePerspective(90. * 3.141592 / 180., float(W) / H, .03, 500.);
+  cam.worldTransform = math::makeIdentity();
+  cam.worldNormalTransform = math::discardTranslation(cam.worldTransform);
+
+  const HaruhiSoftRasterizer::DrawCall dc = {
+    verts, primitives::CUBE_VERTEX_COUNT, indices, primitives::CUBE_INDEX_COUNT,
+    inst.data(), inst.size(), &cam, &tex };
+
+  printf("%zu cubes at %ux%u, ms per frame\n", N, W, H);
+  for(unsigned t = 1; t <= std::thread::hardware_concurrency(); t *= 2) {
+    HaruhiWorkerPool pool(t);
+    HaruhiSoftRasterizer rast(W, H, t > 1 ? &pool : nullptr);
+
+    rast.clear({ 0., .8, 1., 1. });
+    rast.draw(dc); // warmup
+    rast.resetTimings();
+    for(int f = 0; f < FRAMES; ++f) {
+      rast.clear({ 0., .8, 1., 1. });
+      rast.draw(dc);
+    }
+
+    const auto& tm = rast.timings();
+    printf("threads %2u  vertex %8.3f  setup %8.3f  raster %8.3f  total %8.3f  (%llu frags)\n", t,
+      tm.vertexMs / FRAMES, tm.setupMs / FRAMES, tm.rasterMs / FRAMES,
+      (tm.vertexMs + tm.setupMs + tm.rasterMs) / FRAMES,
+      (unsigned long long)(tm.fragments / FRAMES));
+
+    if(t == 1 && argc > 2)
+      rast.writePPM(argv[2]);
+  }
+  return 0;
+}
@@ -0,0 +1,67 @@
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <ResourceTable.hxx>
+
+#include "Bench.hxx"
+
+// lookups of n named fake resources, the string keyed map the pool used to
+// be against names and handles
+// benchResource [count]
+int main(int argc, char * argv[]) {
+  using namespace resource;
+
+  const size_t N = argc > 1 ? strtoul(argv[1], nullptr, 10) : 4096;
+  constexpr size_t LOOKUPS = 1 << 20;
+
+  std::vector<std::string> names(N);
+  std::vector<Name> hashed;
+  std::vector<int> objects(N);
+  for(size_t i = 0; i < N; ++i) {
+    names[i] = "textures/block_" + std::to_string(i);
+    hashed.emplace_back(names[i]);
+  }
+
+  std::map<std::string, int*> map;
+  HaruhiResourceTable table;
+  std::vector<Handle> handles;
+  for(size_t i = 0; i < N; ++i) {
+    map[names[i]] = &objects[i];
+    handles.push_back(table.add(CATEGORY_TEXTURE, hashed[i], &objects[i], 1));
+  }
+
+  bench::run("std::map<std::string> lookup", LOOKUPS, [&] {
+    for(size_t i = 0; i < LOOKUPS; ++i)
+      bench::keep(map[names[i * 7919 % N]]);
+  });
+  bench::run("table find by name", LOOKUPS, [&] {
+    for(size_t i = 0; i < LOOKUPS; ++i)
+      bench::keep(table.find(CATEGORY_TEXTURE, hashed[i * 7919 % N]));
+  });
+  bench::run("table get by handle", LOOKUPS, [&] {
+    for(size_t i = 0; i < LOOKUPS; ++i)
+      bench::keep(table.get(handles[i * 7919 % N]));
+  });
+  bench::run("table acquire + release", LOOKUPS, [&] {
+    for(size_t i = 0; i < LOOKUPS; ++i) {
+      const Handle h = handles[i * 7919 % N];
+      table.acquire(h);
+      table.release(h);
+    }
+  });
+
+  // a budget of half the entries, every add evicts the oldest
+  HaruhiResourceTable lru;
+  lru.setBudget(CATEGORY_TEXTURE, N / 2);
+  size_t next = 0;
+  bench::run("table add with lru eviction", LOOKUPS, [&] {
+    for(size_t i = 0; i < LOOKUPS; ++i, ++next)
+      lru.add(CATEGORY_TEXTURE, Name{ std::string_view((const char*)&next, sizeof(next)) },
+              &objects[next % N], 1);
+  }, 3);
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <Terrain.hxx>
+#include <VoxelWorld.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+// a generated world of 512 x 256 x 512 blocks in palette chunks against
+// the same blocks in dense 64k arrays behind a hashed map: bytes per
+// chunk, then random world reads and writes and whole rows unpacked. the
+// access lines read as ns per block
+// benchStorage [chunks per side]
+int main(int argc, char * argv[]) {
+  const int side = argc > 1 ? atoi(argv[1]) : 16;
+  constexpr int S = voxel::CHUNK_SIZE;
+
+  terrain::Settings settings;
+  settings.amplitude = 64.f;
+  std::vector<voxel::ChunkCoord> coords;
+  for(int cx = 0; cx < side; ++cx)
+    for(int cz = 0; cz < side; ++cz)
+      for(int cy = -4; cy < 4; ++cy) coords.push_back({ cx, cy, cz });
+
+  HaruhiVoxelWorld world;
+  {
+    HaruhiWorkerPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    terrain::generate(settings, world, coords.data(), coords.size(), &pool);
+  }
+
+  // the baseline, every chunk a dense array
+  const auto key = [](int cx, int cy, int cz) {
+    return uint64_t(uint32_t(cx) & 0x1FFFFF) << 42 | uint64_t(uint32_t(cy) & 0x1FFFFF) << 21 |
+           uint64_t(uint32_t(cz) & 0x1FFFFF);
+  };
+  std::unordered_map<uint64_t, std::unique_ptr<voxel::Block[]>> dense;
+  size_t uniform = 0, widths[17] = {};
+  for(const voxel::ChunkCoord& c : coords) {
+    const voxel::BlockStorage* b = world.blocks(c);
+    uniform += b->uniform();
+    ++widths[b->bits()];
+    auto& d = dense[key(c.x, c.y, c.z)];
+    d = std::make_unique<voxel::Block[]>(voxel::CHUNK_VOLUME);
+    b->store(d.get());
+  }
+  const double perChunk = double(world.blockBytes()) / coords.size();
+  printf("%d x %d x %d blocks, %zu chunks, %zu uniform\n", side * S, 8 * S, side * S, coords.size(), uniform);
+  printf("  width 1/2/4/8/16: %zu/%zu/%zu/%zu/%zu chunks\n", widths[1], widths[2], widths[4], widths[8], widths[16]);
+  printf("  %.0f bytes per chunk, dense %zu, %.1fx smaller\n", perChunk,
+         voxel::CHUNK_VOLUME * sizeof(voxel::Block), voxel::CHUNK_VOLUME * sizeof(voxel::Block) / perChunk);
+
+  constexpr size_t N = 1 << 20;
+  struct Cell {
+    int x, y, z;
+  };
+  std::vector<Cell> cells(N);
+  std::mt19937 rng(3);
+  for(Cell& c : cells) c = { int(rng() % (side * S)), int(rng() % (8 * S)) - 4 * S, int(rng() % (side * S)) };
+  const auto denseAt = [&](const Cell& c) -> voxel::Block& {
+    return dense[key(c.x >> 5, c.y >> 5, c.z >> 5)][((c.z & 31) * S + (c.y & 31)) * S + (c.x & 31)];
+  };
+
+  bench::run("random get, palette", N, [&] {
+    size_t sum = 0;
+    for(const Cell& c : cells) sum += world.get(c.x, c.y, c.z);
+    bench::keep(sum);
+  });
+  bench::run("random get, dense", N, [&] {
+    size_t sum = 0;
+    for(const Cell& c : cells) sum += denseAt(c);
+    bench::keep(sum);
+  });
+
+  // the same block back, or a lamp into a palette that may lack one
+  bench::run("random set, palette", N, [&] {
+    for(size_t i = 0; i < N; ++i) {
+      const Cell& c = cells[i];
+      world.set(c.x, c.y, c.z, i & 7 ? world.get(c.x, c.y, c.z) : voxel::Block(voxel::BLOCK_LAMP));
+    }
+  });
+  bench::run("random set, dense", N, [&] {
+    for(size_t i = 0; i < N; ++i) {
+      voxel::Block& b = denseAt(cells[i]);
+      b = i & 7 ? b : voxel::Block(voxel::BLOCK_LAMP);
+    }
+  });
+
+  voxel::Block row[S];
+  bench::run("row unpack, palette", coords.size() * voxel::CHUNK_VOLUME, [&] {
+    for(const voxel::ChunkCoord& c : coords) {
+      const voxel::BlockStorage* b = world.blocks(c);
+      for(int r = 0; r < voxel::CHUNK_AREA; ++r) {
+        b->row(r, row);
+        bench::keep(row);
+      }
+    }
+  }, 2);
+  bench::run("row copy, dense", coords.size() * voxel::CHUNK_VOLUME, [&] {
+    for(const voxel::ChunkCoord& c : coords) {
+      const voxel::Block* b = dense[key(c.x, c.y, c.z)].get();
+      for(int r = 0; r < voxel::CHUNK_AREA; ++r) {
+        std::copy(b + r * S, b + r * S + S, row);
+        bench::keep(row);
+      }
+    }
+  }, 2);
+  return 0;
+}
\ No newline at end of file
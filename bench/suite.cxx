@@ -0,0 +1,513 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <MathUtil.hxx>
+#include <MeshLoader.hxx>
+#include <Noise.hxx>
+#include <Primitives.hxx>
+#include <ResourceTable.hxx>
+#include <Terrain.hxx>
+#include <TransformStore.hxx>
+#include <VertexFormat.hxx>
+#include <VoxelLight.hxx>
+#include <VoxelQuery.hxx>
+#include <VoxelWorld.hxx>
+#include <WorkerPool.hxx>
+
+#ifdef HARUHI_HAS_SPNG
+#include <ImageUtil.hxx>
+#endif
+
+#include "Bench.hxx"
+
+namespace {
+
+struct Case {
+  std::string name;
+  uint64_t items;
+  std::function<void()> fn;
+};
+
+struct Result {
+  std::string name;
+  uint64_t items;
+  bench::Stats stats;
+};
+
+const char*
+backend() noexcept {
+#if defined(HARUHI_SIMD_AVX2)
+  return "avx2";
+#elif defined(HARUHI_SIMD_SSE2)
+  return "sse2";
+#elif defined(HARUHI_SIMD_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+// a terrain slice and the checkerboard worst case, padded for meshChunk
+void
+fillTerrain(voxel::Block* b) noexcept {
+  using namespace voxel;
+  for(int z = 0; z < PADDED_SIZE; ++z)
+    for(int y = 0; y < PADDED_SIZE; ++y)
+      for(int x = 0; x < PADDED_SIZE; ++x) {
+        const int h = int(14.f + 6.f * std::sin(x * .2f) * std::cos(z * .15f));
+        b[(z * PADDED_SIZE + y) * PADDED_SIZE + x] =
+          y < h - 3 ? BLOCK_STONE : y < h - 1 ? BLOCK_DIRT : y < h ? BLOCK_GRASS : BLOCK_AIR;
+      }
+}
+
+void
+fillCheckerboard(voxel::Block* b) noexcept {
+  using namespace voxel;
+  for(int i = 0; i < PADDED_VOLUME; ++i) {
+    const int x = i % PADDED_SIZE, y = i / PADDED_SIZE % PADDED_SIZE, z = i / (PADDED_SIZE * PADDED_SIZE);
+    b[i] = (x + y + z) & 1 ? BLOCK_STONE : BLOCK_AIR;
+  }
+}
+
+std::vector<Case>
+makeCases(const char* resourceDir) {
+  using namespace math;
+  std::vector<Case> cases;
+
+  // MathUtil builders
+  {
+    constexpr size_t N = 1 << 14;
+    auto out = std::make_shared<std::vector<float4x4>>(N);
+    cases.push_back({ "math/makePerspective", N, [out] {
+      for(size_t i = 0; i < N; ++i)
+        (*out)[i] = makePerspective(1.f + i * 1e-5f, 16.f / 9.f, .1f, 100.f);
+      bench::keep((*out)[N - 1]);
+    } });
+    cases.push_back({ "math/translate*rotX*rotY chained", N, [out] {
+      for(size_t i = 0; i < N; ++i)
+        (*out)[i] = makeTranslate({ 0., 0., -3. }) * makeXRotate(.2f) * makeYRotate(i * 1e-3f);
+      bench::keep((*out)[N - 1]);
+    } });
+    cases.push_back({ "math/makeTranslateXYRotate", N, [out] {
+      for(size_t i = 0; i < N; ++i)
+        (*out)[i] = makeTranslateXYRotate({ 0., 0., -3. }, .2f, i * 1e-3f);
+      bench::keep((*out)[N - 1]);
+    } });
+    cases.push_back({ "math/makeTRS", N, [out] {
+      for(size_t i = 0; i < N; ++i)
+        (*out)[i] = makeTRS({ 1., 2., 3. }, makeQuat({ 0., 1., 0. }, i * 1e-3f), { 2., 2., 2. });
+      bench::keep((*out)[N - 1]);
+    } });
+  }
+
+#ifdef HARUHI_HAS_SPNG
+  // the whole png path, file read included
+  {
+    using namespace HaruhiResourceLoader::ImageUtil;
+    const std::string pth = std::string(resourceDir) + "/blocks.png";
+    void* probe = std::get<2>(load_image_at(pth.c_str()));
+    if(!probe) {
+      printf("%s: can't decode, skipping the png case\n", pth.c_str());
+    } else {
+      free(probe);
+      cases.push_back({ "image/load_image_at blocks.png", 1, [pth] {
+        auto [size, ihdr, pixels] = load_image_at(pth.c_str());
+        bench::keep(size);
+        free(pixels);
+      } });
+    }
+  }
+#else
+  (void)resourceDir;
+#endif
+
+  // resource table lookups over a few thousand names
+  {
+    using namespace resource;
+    constexpr size_t N = 4096, LOOKUPS = 1 << 16;
+    struct State {
+      std::vector<Name> names;
+      std::vector<Handle> handles;
+      std::vector<int> objects;
+      HaruhiResourceTable table;
+    };
+    auto st = std::make_shared<State>();
+    st->objects.resize(N);
+    for(size_t i = 0; i < N; ++i) {
+      st->names.emplace_back("textures/block_" + std::to_string(i));
+      st->handles.push_back(st->table.add(CATEGORY_TEXTURE, st->names[i], &st->objects[i], 1));
+    }
+    cases.push_back({ "resource/find by name", LOOKUPS, [st] {
+      for(size_t i = 0; i < LOOKUPS; ++i)
+        bench::keep(st->table.find(CATEGORY_TEXTURE, st->names[i * 7919 % N]));
+    } });
+    cases.push_back({ "resource/get by handle", LOOKUPS, [st] {
+      for(size_t i = 0; i < LOOKUPS; ++i)
+        bench::keep(st->table.get(st->handles[i * 7919 % N]));
+    } });
+  }
+
+  // instance transforms, as composed every frame
+  {
+    constexpr size_t N = 100000;
+    struct State {
+      HaruhiTransformStore store;
+      std::vector<shader_t::InstanceData> buf;
+      HaruhiWorkerPool pool;
+    };
+    auto st = std::make_shared<State>();
+    for(size_t i = 0; i < N; ++i)
+      st->store.add({ float(i % 100), float(i / 100), -3. }, makeQuat({ 0., 1., 0. }, i * 1e-3f));
+    st->buf.resize(N);
+    cases.push_back({ "transform/compose all dirty", N, [st] {
+      st->store.markAllDirty();
+      st->store.writeInstances(0, st->buf.data());
+    } });
+    cases.push_back({ "transform/compose 1% dirty", N, [st] {
+      for(size_t i = 0; i < N; i += 100)
+        st->store.setPosition(i, { 1., 2., 3. });
+      st->store.writeInstances(0, st->buf.data());
+    } });
+    cases.push_back({ "transform/compose all dirty pool", N, [st] {
+      st->store.markAllDirty();
+      st->store.writeInstances(0, st->buf.data(), &st->pool);
+    } });
+    // a quarter of the bytes, for the vertex shader to expand
+    auto compact = std::make_shared<std::vector<shader_t::CompactInstanceData>>(N);
+    cases.push_back({ "transform/pack compact", N, [st, compact] {
+      for(size_t i = 0; i < N; ++i)
+        (*compact)[i] = vtx::packInstance(st->store.position(i), st->store.rotation(i), st->store.scale(i),
+                                          { 1., 1., 1., 1. });
+      bench::keep(compact->back());
+    } });
+  }
+
+  // mesh generation, primitives and greedy chunk meshes
+  {
+    constexpr size_t CUBES = 4096;
+    auto vertices = std::make_shared<std::vector<shader_t::VertexData>>(primitives::CUBE_VERTEX_COUNT);
+    auto indices = std::make_shared<std::vector<uint16_t>>(primitives::CUBE_INDEX_COUNT);
+    cases.push_back({ "mesh/makeCube", CUBES, [vertices, indices] {
+      for(size_t i = 0; i < CUBES; ++i) {
+        primitives::makeCube(1.f + i * 1e-4f, vertices->data(), indices->data());
+        bench::keep(vertices->back());
+      }
+    } });
+
+    struct Chunk {
+      std::vector<voxel::Block> blocks;
+      voxel::ChunkMesh mesh;
+    };
+    auto terrain = std::make_shared<Chunk>(), checker = std::make_shared<Chunk>();
+    terrain->blocks.resize(voxel::PADDED_VOLUME);
+    checker->blocks.resize(voxel::PADDED_VOLUME);
+    fillTerrain(terrain->blocks.data());
+    fillCheckerboard(checker->blocks.data());
+    for(auto c : { terrain, checker }) {
+      const std::string name = c == terrain ? "mesh/greedy terrain chunk" : "mesh/greedy checkerboard chunk";
+      cases.push_back({ name, 1, [c] {
+        voxel::meshChunk(c->blocks.data(), { 0., 0., 0. }, c->mesh);
+        bench::keep(c->mesh.indices.size());
+      } });
+    }
+
+    // what uploading a chunk adds
+    voxel::meshChunk(terrain->blocks.data(), { 0., 0., 0. }, terrain->mesh);
+    auto packed = std::make_shared<std::vector<shader_t::PackedVertexData>>(terrain->mesh.vertices.size());
+    cases.push_back({ "mesh/pack terrain chunk", packed->size(), [terrain, packed] {
+      const vtx::Quantization q = { {}, 1.f / 1024.f, {}, { 1.f / 2048.f, 1.f / 2048.f } };
+      vtx::pack(terrain->mesh.vertices.data(), terrain->mesh.vertices.size(), q, packed->data());
+      bench::keep(packed->back());
+    } });
+
+    // a 64 by 64 quad obj from memory, per byte
+    auto text = std::make_shared<std::string>();
+    char line[96];
+    for(int y = 0; y <= 64; ++y)
+      for(int x = 0; x <= 64; ++x) {
+        snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0 1 0\n",
+                 x * .5, std::sin(x * .2) * std::cos(y * .3), y * .5, x / 64., y / 64.);
+        *text += line;
+      }
+    for(int y = 0; y < 64; ++y)
+      for(int x = 0; x < 64; ++x) {
+        const int a = y * 65 + x + 1, b = a + 1, c = a + 65, d = c + 1;
+        snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, d, d, d, b, b, b);
+        *text += line;
+      }
+    auto obj = std::make_shared<model::Mesh>();
+    cases.push_back({ "mesh/parse obj", text->size(), [text, obj] {
+      model::parseObj(text->data(), text->size(), *obj);
+      bench::keep(obj->indexCount());
+    } });
+  }
+
+  {
+    // per sample, and one chunk under the surface with its caves
+    constexpr size_t N = 1 << 14;
+    auto pos = std::make_shared<std::vector<float>>(4 * N);
+    for(size_t i = 0; i < N; ++i) {
+      (*pos)[i] = float(i % 128) * .37f;
+      (*pos)[N + i] = float(i / 128) * .37f;
+      (*pos)[2 * N + i] = float(i % 61) * .29f;
+    }
+    cases.push_back({ "noise/simplex3 batch", N, [pos] {
+      float* p = pos->data();
+      noise::sample3(noise::Fractal(), 1, p, p + N, p + 2 * N, p + 3 * N, N);
+      bench::keep(p[3 * N]);
+    } });
+    auto settings = std::make_shared<terrain::Settings>();
+    cases.push_back({ "noise/warped fbm2 batch", N, [pos, settings] {
+      float* p = pos->data();
+      noise::sample2(settings->ground, 1, p, p + N, p + 3 * N, N);
+      bench::keep(p[3 * N]);
+    } });
+    auto blocks = std::make_shared<std::vector<voxel::Block>>(voxel::CHUNK_VOLUME);
+    cases.push_back({ "voxel/generate chunk", 1, [settings, blocks] {
+      terrain::generateChunk(*settings, { 0, -1, 0 }, blocks->data());
+      bench::keep(blocks->front());
+    } });
+    auto storage = std::make_shared<voxel::BlockStorage>();
+    cases.push_back({ "voxel/pack chunk", 1, [blocks, storage] {
+      storage->assign(blocks->data());
+      bench::keep(storage->bits());
+    } });
+  }
+  {
+    // a 4x2x4 chunk patch of hills lit from scratch, and a lamp on it
+    struct Lit {
+      HaruhiVoxelWorld world;
+      HaruhiVoxelLight light{ world };
+      std::vector<voxel::ChunkCoord> coords;
+      int y = 0;
+    };
+    auto st = std::make_shared<Lit>();
+    for(int x = 0; x < 4; ++x)
+      for(int z = 0; z < 4; ++z)
+        for(int y = -1; y < 1; ++y) st->coords.push_back({ x, y, z });
+    terrain::generate(terrain::Settings(), st->world, st->coords.data(), st->coords.size());
+    st->light.relight(st->coords.data(), st->coords.size());
+    for(st->y = 31; st->y > -32 && st->world.get(64, st->y - 1, 64) == voxel::BLOCK_AIR; --st->y) {}
+    cases.push_back({ "voxel/relight chunk", st->coords.size(), [st] {
+      bench::keep(st->light.relight(st->coords.data(), st->coords.size()));
+    } });
+    cases.push_back({ "voxel/light lamp edit", 2, [st] {
+      st->world.set(64, st->y, 64, voxel::BLOCK_LAMP);
+      bench::keep(st->light.changed(64, st->y, 64));
+      st->world.set(64, st->y, 64, voxel::BLOCK_AIR);
+      bench::keep(st->light.changed(64, st->y, 64));
+    } });
+  }
+  {
+    // rays down onto the same patch of hills, and bodies dropped on it
+    struct Queried {
+      HaruhiVoxelWorld world;
+      HaruhiVoxelQuery query{ world };
+      std::vector<voxel::Ray> rays;
+      std::vector<voxel::RayHit> hits;
+      std::vector<voxel::Body> start, bodies;
+    };
+    auto st = std::make_shared<Queried>();
+    std::vector<voxel::ChunkCoord> coords;
+    for(int x = 0; x < 4; ++x)
+      for(int z = 0; z < 4; ++z)
+        for(int y = -1; y < 1; ++y) coords.push_back({ x, y, z });
+    terrain::generate(terrain::Settings(), st->world, coords.data(), coords.size());
+    for(int i = 0; i < 1024; ++i) {
+      const float x = 4.f + float(i % 32) * 3.7f, z = 4.f + float(i / 32) * 3.7f;
+      st->rays.push_back({ { x, 31.5f, z }, { float(i % 7) * .1f - .3f, -1.f, float(i % 5) * .1f - .2f }, 64.f });
+      st->bodies.push_back({ { { x, 20.f, z }, { x + .6f, 21.8f, z + .6f } }, { 1.f, 0.f, -1.f }, 0 });
+    }
+    st->hits.resize(st->rays.size());
+    st->start = st->bodies;
+    cases.push_back({ "voxel/raycast", st->rays.size(), [st] {
+      st->query.raycast(st->rays.data(), st->rays.size(), st->hits.data());
+      bench::keep(st->hits.back());
+    } });
+    // every run steps the bodies from where they were dropped
+    cases.push_back({ "voxel/body step", st->bodies.size(), [st] {
+      st->bodies = st->start;
+      st->query.step(st->bodies.data(), st->bodies.size(), 1.f / 60.f, { 0.f, -30.f, 0.f });
+      bench::keep(st->bodies.back());
+    } });
+  }
+  return cases;
+}
+
+void
+writeJsonString(FILE* fp, const std::string& s) noexcept {
+  fputc('"', fp);
+  for(char c : s) {
+    if(c == '"' || c == '\\') fprintf(fp, "\\%c", c);
+    else if((unsigned char)c < 0x20) fprintf(fp, "\\u%04x", c);
+    else fputc(c, fp);
+  }
+  fputc('"', fp);
+}
+
+bool
+writeJson(const char* pth, const std::vector<Result>& results, int cpu) noexcept {
+  FILE* fp = fopen(pth, "w");
+  if(!fp) return false;
+#ifdef NDEBUG
+  const char* build = "release";
+#else
+  const char* build = "debug";
+#endif
+  fprintf(fp, "{\n  \"version\": 1,\n  \"backend\": \"%s\",\n  \"build\": \"%s\",\n  \"cpu\": %d,\n  \"results\": [",
+          backend(), build, cpu);
+  for(size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    fprintf(fp, "%s\n    { \"name\": ", i ? "," : "");
+    writeJsonString(fp, r.name);
+    fprintf(fp, ", \"items\": %llu, \"reps\": %d, \"median_ns\": %.6g, \"mean_ns\": %.6g, "
+                "\"stddev_ns\": %.6g, \"min_ns\": %.6g, \"max_ns\": %.6g }",
+            (unsigned long long)r.items, r.stats.reps, r.stats.median, r.stats.mean,
+            r.stats.stddev, r.stats.min, r.stats.max);
+  }
+  fprintf(fp, "\n  ]\n}\n");
+  return fclose(fp) == 0;
+}
+
+// reads back what writeJson wrote, name and median of every result
+bool
+readBaseline(const char* pth, std::vector<std::pair<std::string, double>>& out) {
+  FILE* fp = fopen(pth, "r");
+  if(!fp) return false;
+  std::string text;
+  char buf[4096];
+  for(size_t n; (n = fread(buf, 1, sizeof(buf), fp)) > 0;)
+    text.append(buf, n);
+  fclose(fp);
+
+  for(size_t at = text.find("\"name\""); at != std::string::npos; at = text.find("\"name\"", at)) {
+    size_t q = text.find('"', text.find(':', at));
+    if(q == std::string::npos) return false;
+    std::string name;
+    for(++q; q < text.size() && text[q] != '"'; ++q) {
+      if(text[q] == '\\' && q + 1 < text.size()) {
+        ++q;
+        if(text[q] == 'u' && q + 4 < text.size()) {
+          name += char(strtol(text.substr(q + 1, 4).c_str(), nullptr, 16));
+          q += 4;
+          continue;
+        }
+      }
+      name += text[q];
+    }
+    const size_t m = text.find("\"median_ns\"", q);
+    if(m == std::string::npos) return false;
+    out.emplace_back(name, strtod(text.c_str() + text.find(':', m) + 1, nullptr));
+    at = m;
+  }
+  return true;
+}
+
+// a regression is slower than the threshold allows with even the fastest
+// run slower than the baseline median, so a single noisy run can't trip it
+int
+compare(const std::vector<Result>& results, const std::vector<std::pair<std::string, double>>& baseline,
+        double threshold) noexcept {
+  int regressions = 0;
+  printf("\n%-40s %16s %16s %9s\n", "compared to baseline", "baseline", "now", "change");
+  for(const Result& r : results) {
+    auto it = std::find_if(baseline.begin(), baseline.end(), [&](const auto& b) { return b.first == r.name; });
+    if(it == baseline.end()) {
+      printf("%-40s %16s %13.3f ns %9s  new\n", r.name.c_str(), "-", r.stats.median, "");
+      continue;
+    }
+    const double change = r.stats.median / it->second - 1.;
+    const char* verdict = "";
+    if(change > threshold && r.stats.min > it->second) {
+      verdict = "  REGRESSION";
+      ++regressions;
+    } else if(change < -threshold) {
+      verdict = "  faster";
+    }
+    printf("%-40s %13.3f ns %13.3f ns %+8.1f%%%s\n", r.name.c_str(), it->second, r.stats.median,
+           change * 100., verdict);
+  }
+  for(const auto& b : baseline)
+    if(std::none_of(results.begin(), results.end(), [&](const Result& r) { return r.name == b.first; }))
+      printf("%-40s %13.3f ns %16s %9s  not run\n", b.first.c_str(), b.second, "-", "");
+  return regressions;
+}
+
+void
+usage() noexcept {
+  printf("haruhi_bench [--list] [--filter substring] [--reps n] [--warmup ms] [--cpu n]\n"
+         "             [--json out.json] [--compare baseline.json] [--threshold fraction]\n"
+         "  --cpu pins the benchmark thread, -1 leaves it alone (default 0)\n"
+         "  --compare exits with 1 when a case is slower than the baseline by more\n"
+         "  than the threshold (default .1)\n");
+}
+
+} // ns
+
+// the engine's hot paths in one run, for tracking them over time
+// configure with -DCMAKE_BUILD_TYPE=Release for meaningful numbers
+int main(int argc, char * argv[]) {
+  const char* filter = nullptr;
+  const char* json = nullptr;
+  const char* baseline = nullptr;
+  int reps = 15, cpu = 0;
+  double warmup = 50., threshold = .1;
+  bool list = false;
+  for(int i = 1; i < argc; ++i) {
+    auto arg = [&](const char* opt) { return !strcmp(argv[i], opt) && i + 1 < argc; };
+    if(arg("--filter")) filter = argv[++i];
+    else if(arg("--reps")) reps = std::max(1, atoi(argv[++i]));
+    else if(arg("--warmup")) warmup = atof(argv[++i]);
+    else if(arg("--cpu")) cpu = atoi(argv[++i]);
+    else if(arg("--json")) json = argv[++i];
+    else if(arg("--compare")) baseline = argv[++i];
+    else if(arg("--threshold")) threshold = atof(argv[++i]);
+    else if(!strcmp(argv[i], "--list")) list = true;
+    else {
+      usage();
+      return strcmp(argv[i], "--help") ? EXIT_FAILURE : 0;
+    }
+  }
+
+  std::vector<std::pair<std::string, double>> base;
+  if(baseline && !readBaseline(baseline, base)) {
+    printf("can't read the baseline %s\n", baseline);
+    return EXIT_FAILURE;
+  }
+
+  const std::vector<Case> cases = makeCases(HARUHI_BENCH_RESOURCE_DIR);
+  if(list) {
+    for(const Case& c : cases) printf("%s\n", c.name.c_str());
+    return 0;
+  }
+
+  // pools made by the cases spawn their workers before this, unpinned
+  if(cpu >= 0 && !bench::pinThread(cpu)) {
+    printf("can't pin to cpu %d, running unpinned\n", cpu);
+    cpu = -1;
+  }
+  printf("backend: %s, %d reps after %.0f ms warmup, cpu %d\n", backend(), reps, warmup, cpu);
+  printf("%-40s %16s %16s %16s\n", "", "median", "stddev", "min");
+
+  std::vector<Result> results;
+  for(const Case& c : cases) {
+    if(filter && c.name.find(filter) == std::string::npos) continue;
+    const bench::Stats s = bench::measure(c.items, c.fn, reps, warmup);
+    printf("%-40s %13.3f ns %13.3f ns %13.3f ns\n", c.name.c_str(), s.median, s.stddev, s.min);
+    results.push_back({ c.name, c.items, s });
+  }
+
+  if(json && !writeJson(json, results, cpu)) {
+    printf("can't write %s\n", json);
+    return EXIT_FAILURE;
+  }
+  if(baseline && compare(results, base, threshold)) return 1;
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <Noise.hxx>
+#include <Terrain.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+// noise samples per second on one pinned core, position at a time and
+// batched, then whole chunk columns generated on pools of growing size.
+// the batch lines read as Msamples/s per core, the pool lines as chunks/s
+// benchTerrain [columns per side]
+int main(int argc, char * argv[]) {
+  const int side = argc > 1 ? atoi(argv[1]) : 8;
+  const bool pinned = bench::pinThread(0);
+  printf("%d lanes%s\n", noise::lanes(), pinned ? ", pinned to cpu 0" : "");
+
+  const size_t N = 1 << 16;
+  std::vector<float> x(N), y(N), z(N), out(N);
+  for(size_t i = 0; i < N; ++i) {
+    x[i] = float(i % 256) * .37f;
+    y[i] = float(i / 256) * .37f;
+    z[i] = float(i % 97) * .29f;
+  }
+
+  using Noise2 = float (*)(uint32_t, float, float) noexcept;
+  using Noise3 = float (*)(uint32_t, float, float, float) noexcept;
+  struct Kind {
+    const char* name;
+    noise::Kind kind;
+    Noise2 fn2;
+    Noise3 fn3;
+  };
+  const Kind kinds[] = {
+    { "value", noise::KIND_VALUE, noise::value2, noise::value3 },
+    { "simplex", noise::KIND_SIMPLEX, noise::simplex2, noise::simplex3 },
+    { "cellular", noise::KIND_CELLULAR, noise::cellular2, noise::cellular3 },
+  };
+  char name[64];
+  for(const Kind& k : kinds) {
+    noise::Fractal f;
+    f.kind = k.kind;
+    snprintf(name, sizeof(name), "%s2 one at a time", k.name);
+    bench::run(name, N, [&] { for(size_t i = 0; i < N; ++i) out[i] = k.fn2(1, x[i], y[i]); bench::keep(out[0]); });
+    snprintf(name, sizeof(name), "%s2 batch", k.name);
+    bench::run(name, N, [&] { noise::sample2(f, 1, x.data(), y.data(), out.data(), N); bench::keep(out[0]); });
+    snprintf(name, sizeof(name), "%s3 one at a time", k.name);
+    bench::run(name, N, [&] { for(size_t i = 0; i < N; ++i) out[i] = k.fn3(1, x[i], y[i], z[i]); bench::keep(out[0]); });
+    snprintf(name, sizeof(name), "%s3 batch", k.name);
+    bench::run(name, N, [&] { noise::sample3(f, 1, x.data(), y.data(), z.data(), out.data(), N); bench::keep(out[0]); });
+  }
+
+  // what the heightmap samples, per octave
+  const terrain::Settings settings;
+  bench::run("warped fbm2 batch, 5 octaves", N * 15, [&] {
+    noise::sample2(settings.ground, 1, x.data(), y.data(), out.data(), N);
+    bench::keep(out[0]);
+  });
+
+  std::vector<voxel::ChunkCoord> coords;
+  for(int cx = 0; cx < side; ++cx)
+    for(int cz = 0; cz < side; ++cz)
+      for(int cy = -2; cy < 2; ++cy) coords.push_back({ cx, cy, cz });
+  std::vector<voxel::Block> blocks(voxel::CHUNK_VOLUME);
+  bench::run("generateChunk", coords.size(), [&] {
+    for(const voxel::ChunkCoord& c : coords) terrain::generateChunk(settings, c, blocks.data());
+    bench::keep(blocks[0]);
+  }, 2);
+
+  const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+  for(unsigned threads = 1; threads <= hw; threads *= 2) {
+    HaruhiWorkerPool pool(threads);
+    snprintf(name, sizeof(name), "generate, pool of %u", threads);
+    const double ns = bench::run(name, coords.size(), [&] {
+      HaruhiVoxelWorld world;
+      terrain::generate(settings, world, coords.data(), coords.size(), &pool);
+    }, 2);
+    printf("  %.0f chunks/s\n", 1e9 / ns);
+    if(threads < hw && threads * 2 > hw) threads = hw / 2;
+  }
+  return 0;
+}
\ No newline at end of file
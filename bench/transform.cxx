@@ -0,0 +1,55 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <MathUtil.hxx>
+#include <TransformStore.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+int main(int argc, char * argv[]) {
+  using namespace math;
+
+  const size_t N = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+
+  HaruhiTransformStore store;
+  for(size_t i = 0; i < N; ++i)
+    store.add({ float(i % 100), float(i / 100), -3. }, makeQuat({ 0., 1., 0. }, i * 1e-3f));
+
+  std::vector<shader_t::InstanceData> buf(N);
+
+  // what draw did per instance before: chained builders + discardTranslation
+  bench::run("inline makeTranslate*rot*rot", N, [&] {
+    for(size_t i = 0; i < N; ++i) {
+      buf[i].instanceTransform =
+        makeTranslate(store.position(i)) * makeXRotate(.2) * makeYRotate(i * 1e-3f);
+      buf[i].instanceNormalTransform = discardTranslation(buf[i].instanceTransform);
+    }
+    bench::keep(buf[N - 1]);
+  });
+
+  bench::run("soa compose, 1 thread, all dirty", N, [&] {
+    store.markAllDirty();
+    store.writeInstances(0, buf.data());
+  });
+
+  for(unsigned t = 2; t <= std::thread::hardware_concurrency(); t *= 2) {
+    HaruhiWorkerPool pool(t);
+    char name[64];
+    snprintf(name, sizeof(name), "soa compose, %u threads, all dirty", t);
+    bench::run(name, N, [&] {
+      store.markAllDirty();
+      store.writeInstances(0, buf.data(), &pool);
+    });
+  }
+
+  // typical frame, a small fraction of instances move
+  bench::run("soa compose, 1% dirty", N, [&] {
+    for(size_t i = 0; i < N; i += 100)
+      store.setPosition(i, { 1., 2., 3. });
+    store.writeInstances(0, buf.data());
+  });
+
+  return 0;
+}
\ No newline at end of file
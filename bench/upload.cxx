@@ -0,0 +1,69 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <FrameAllocator.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+namespace {
+
+// heap pages, flushes are free
+class HeapBackend : public HaruhiUploadBackend {
+public:
+  bool allocate(size_t size, Page& page) noexcept override {
+    page.cpu = static_cast<uint8_t*>(aligned_alloc(256, (size + 255) / 256 * 256));
+    page.size = size;
+    page.buffer = page.cpu;
+    return page.cpu;
+  }
+  void free(const Page& page) noexcept override { ::free(page.cpu); }
+  void flush(const Page&, size_t, size_t) noexcept override {}
+};
+
+} // ns
+
+// per frame suballocation of small constant blocks, against malloc
+// benchUpload [allocations per frame]
+int main(int argc, char * argv[]) {
+  const size_t N = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+
+  HeapBackend backend;
+  HaruhiFrameFence fence;
+  HaruhiFrameAllocator alloc(backend, fence, 3, 16 << 20);
+  // nothing waits on a gpu here
+  fence.signal(~uint64_t(0));
+
+  bench::run("malloc + free 64B", N, [&] {
+    for(size_t i = 0; i < N; ++i) {
+      void* p = malloc(64);
+      bench::keep(p);
+      free(p);
+    }
+  });
+  bench::run("frame allocator 64B", N, [&] {
+    alloc.beginFrame();
+    for(size_t i = 0; i < N; ++i)
+      bench::keep(alloc.allocate(64, 16).cpu);
+    alloc.endFrame();
+  });
+  bench::run("frame allocator 64B spilling 1MB pages", N, [&] {
+    alloc.beginFrame();
+    for(size_t i = 0; i < N; ++i)
+      bench::keep(alloc.allocate(64 << 4, 256).cpu);
+    alloc.endFrame();
+  });
+
+  HaruhiWorkerPool pool;
+  bench::run("frame allocator 64B pool", N, [&] {
+    alloc.beginFrame();
+    pool.parallelFor(N, 1024, [&](size_t b, size_t e) {
+      for(size_t i = b; i < e; ++i)
+        bench::keep(alloc.allocate(64, 16).cpu);
+    });
+    alloc.endFrame();
+  });
+
+  return 0;
+}
\ No newline at end of file
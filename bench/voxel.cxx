@@ -0,0 +1,116 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <VoxelWorld.hxx>
+#include <WorkerPool.hxx>
+
+#include "Bench.hxx"
+
+using namespace voxel;
+
+namespace {
+
+// rolling hills of grass over dirt and stone, a few caves
+void
+terrain(HaruhiVoxelWorld& w, ChunkCoord c) {
+  voxel::BlockStorage& b = w.edit(c);
+  for(int z = 0; z < CHUNK_SIZE; ++z)
+    for(int x = 0; x < CHUNK_SIZE; ++x) {
+      const float wx = float(c.x * CHUNK_SIZE + x), wz = float(c.z * CHUNK_SIZE + z);
+      const int h = int(40.f + 10.f * std::sin(wx * .07f) * std::cos(wz * .05f) + 4.f * std::sin(wx * .3f + wz * .2f));
+      for(int y = 0; y < CHUNK_SIZE; ++y) {
+        const int wy = c.y * CHUNK_SIZE + y;
+        Block v = BLOCK_AIR;
+        if(wy < h - 4) v = BLOCK_STONE;
+        else if(wy < h - 1) v = BLOCK_DIRT;
+        else if(wy < h) v = BLOCK_GRASS;
+        if(v && std::sin(wx * .3f) * std::sin(wy * .4f) * std::sin(wz * .35f) > .6f) v = BLOCK_AIR;
+        b.set((z * CHUNK_SIZE + y) * CHUNK_SIZE + x, v);
+      }
+    }
+}
+
+} // ns
+
+// meshing cost per chunk for a few kinds of content, whole world remeshes
+// and the latency of single block edits
+// benchVoxel [world chunks per side]
+int main(int argc, char * argv[]) {
+  const int side = argc > 1 ? atoi(argv[1]) : 8;
+
+  // one chunk meshed over and over, its content decides the cost
+  auto perChunk = [](const char* name, auto&& fill) {
+    HaruhiVoxelWorld w;
+    fill(w);
+    w.remesh();
+    const ChunkMesh* m = w.mesh({ 0, 1, 0 });
+    char label[64];
+    snprintf(label, sizeof(label), "%s (%zu quads)", name, m->quads());
+    // an interior block, only its own chunk is queued
+    const Block keep = w.get(5, CHUNK_SIZE + 5, 5);
+    int n = 0;
+    bench::run(label, 1, [&] {
+      w.set(5, CHUNK_SIZE + 5, 5, ++n & 1 ? Block(BLOCK_BRICK) : keep);
+      w.remesh();
+    });
+  };
+
+  perChunk("terrain chunk", [](HaruhiVoxelWorld& w) {
+    for(int y = 0; y < 3; ++y) terrain(w, { 0, y, 0 });
+  });
+  perChunk("random 1/4 solid chunk", [](HaruhiVoxelWorld& w) {
+    std::mt19937 rng(1);
+    voxel::BlockStorage& b = w.edit({ 0, 1, 0 });
+    for(int i = 0; i < CHUNK_VOLUME; ++i)
+      b.set(i, rng() % 4 ? Block(BLOCK_AIR) : Block(1 + rng() % 3));
+  });
+  perChunk("checkerboard chunk", [](HaruhiVoxelWorld& w) {
+    voxel::BlockStorage& b = w.edit({ 0, 1, 0 });
+    for(int z = 0; z < CHUNK_SIZE; ++z)
+      for(int y = 0; y < CHUNK_SIZE; ++y)
+        for(int x = 0; x < CHUNK_SIZE; ++x)
+          b.set((z * CHUNK_SIZE + y) * CHUNK_SIZE + x, (x + y + z) & 1 ? BLOCK_STONE : BLOCK_AIR);
+  });
+
+  HaruhiVoxelWorld world;
+  auto regenerate = [&] {
+    for(int z = 0; z < side; ++z)
+      for(int y = 0; y < 3; ++y)
+        for(int x = 0; x < side; ++x)
+          terrain(world, { x, y, z });
+  };
+  const size_t chunks = side * side * 3;
+  regenerate();
+  world.remesh();
+
+  auto requeue = [&] {
+    for(int z = 0; z < side; ++z)
+      for(int y = 0; y < 3; ++y)
+        for(int x = 0; x < side; ++x)
+          world.edit({ x, y, z });
+  };
+  bench::run("world remesh per chunk", chunks, [&] {
+    requeue();
+    world.remesh();
+  }, 3);
+  HaruhiWorkerPool pool;
+  bench::run("world remesh per chunk pool", chunks, [&] {
+    requeue();
+    world.remesh(&pool);
+  }, 3);
+
+  // digging through a chunk corner touches up to four chunks
+  int n = 0;
+  bench::run("edit + remesh, interior block", 1, [&] {
+    world.set(16, 20, 16, ++n & 1 ? BLOCK_AIR : BLOCK_STONE);
+    world.remesh(&pool, 2.);
+  });
+  bench::run("edit + remesh, chunk corner block", 1, [&] {
+    world.set(31, 31, 31, ++n & 1 ? BLOCK_AIR : BLOCK_STONE);
+    world.remesh(&pool, 2.);
+  });
+  return 0;
+}
\ No newline at end of file
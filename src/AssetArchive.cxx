@@ -0,0 +1,271 @@
+#include "AssetArchive.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace archive {
+
+size_t
+rowBytes(Format fmt, uint32_t width) noexcept {
+  switch(fmt) {
+  case FORMAT_RGBA8_SRGB: return (size_t)width * 4;
+  case FORMAT_BC1_SRGB: return (size_t)(width + 3) / 4 * 8;
+  case FORMAT_BC3_SRGB:
+  case FORMAT_BC7_SRGB:
+  case FORMAT_ASTC_4x4_SRGB: return (size_t)(width + 3) / 4 * 16;
+  case FORMAT_ASTC_6x6_SRGB: return (size_t)(width + 5) / 6 * 16;
+  }
+  return 0;
+}
+
+uint32_t
+rowCount(Format fmt, uint32_t height) noexcept {
+  switch(fmt) {
+  case FORMAT_RGBA8_SRGB: return height;
+  case FORMAT_BC1_SRGB:
+  case FORMAT_BC3_SRGB:
+  case FORMAT_BC7_SRGB:
+  case FORMAT_ASTC_4x4_SRGB: return (height + 3) / 4;
+  case FORMAT_ASTC_6x6_SRGB: return (height + 5) / 6;
+  }
+  return 0;
+}
+
+} // ns archive
+
+namespace {
+
+size_t
+alignUp(size_t v, size_t a) noexcept {
+  return (v + a - 1) / a * a;
+}
+
+bool
+knownFormat(uint32_t fmt) noexcept {
+  return fmt <= archive::FORMAT_ASTC_6x6_SRGB;
+}
+
+} // ns
+
+HaruhiAssetArchive::HaruhiAssetArchive()
+  : p_base_(nullptr), size_(0), p_toc_(nullptr), count_(0) {}
+
+HaruhiAssetArchive::~HaruhiAssetArchive() {
+  close();
+}
+
+int
+HaruhiAssetArchive::open(const char* pth) noexcept {
+  close();
+
+  int fd = ::open(pth, O_RDONLY);
+  if(fd < 0) return -errno;
+
+  struct stat st;
+  if(fstat(fd, &st) != 0) {
+    int err = -errno;
+    ::close(fd);
+    return err;
+  }
+  if(st.st_size < (off_t)sizeof(archive::Header)) {
+    ::close(fd);
+    return -EINVAL;
+  }
+
+  void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  int err = p == MAP_FAILED ? -errno : 0;
+  // the mapping keeps the file alive
+  ::close(fd);
+  if(err) return err;
+
+  p_base_ = static_cast<const uint8_t*>(p);
+  size_ = st.st_size;
+
+  if((err = validate())) close();
+  return err;
+}
+
+void
+HaruhiAssetArchive::close() noexcept {
+  if(p_base_)
+    munmap(const_cast<uint8_t*>(p_base_), size_);
+  p_base_ = nullptr;
+  size_ = 0;
+  p_toc_ = nullptr;
+  count_ = 0;
+}
+
+// nothing in the file is trusted, every offset is checked once here so the
+// accessors don't have to
+int
+HaruhiAssetArchive::validate() noexcept {
+  using namespace archive;
+
+  const Header* h = reinterpret_cast<const Header*>(p_base_);
+  if(memcmp(h->magic, MAGIC, sizeof(MAGIC)) || h->version != VERSION
+     || h->fileSize > size_ || h->tocOffset % alignof(TextureEntry)
+     || h->tocOffset < sizeof(Header) || h->tocOffset > h->fileSize
+     || (h->fileSize - h->tocOffset) / sizeof(TextureEntry) < h->textureCount)
+    return -EINVAL;
+
+  const TextureEntry* toc = reinterpret_cast<const TextureEntry*>(p_base_ + h->tocOffset);
+  for(uint32_t i = 0; i < h->textureCount; ++i) {
+    const TextureEntry& e = toc[i];
+    if(!memchr(e.name, 0, NAME_LENGTH) || !knownFormat(e.format)
+       || e.width == 0 || e.height == 0
+       || e.mipCount == 0 || e.mipCount > MAX_MIPS)
+      return -EINVAL;
+    if(i && strcmp(toc[i - 1].name, e.name) >= 0)
+      return -EINVAL;
+
+    for(uint32_t l = 0; l < e.mipCount; ++l) {
+      const MipLevel& m = e.mips[l];
+      const Format fmt = Format(e.format);
+      // levels are uploaded with their own sizes, they have to fit the texture
+      if(m.width != std::max(1u, e.width >> l) || m.height != std::max(1u, e.height >> l))
+        return -EINVAL;
+      if(m.offset % DATA_ALIGNMENT || m.offset < sizeof(Header)
+         || m.offset > h->tocOffset || m.size > h->tocOffset - m.offset
+         || m.rowPitch < rowBytes(fmt, m.width)
+         || m.size < (uint64_t)m.rowPitch * rowCount(fmt, m.height))
+        return -EINVAL;
+    }
+  }
+
+  p_toc_ = toc;
+  count_ = h->textureCount;
+  return 0;
+}
+
+const archive::TextureEntry*
+HaruhiAssetArchive::findTexture(const char* name) const noexcept {
+  const archive::TextureEntry* end = p_toc_ + count_;
+  const archive::TextureEntry* it = std::lower_bound(p_toc_, end, name,
+    [](const archive::TextureEntry& e, const char* n) { return strcmp(e.name, n) < 0; });
+  return it != end && strcmp(it->name, name) == 0 ? it : nullptr;
+}
+
+const uint8_t*
+HaruhiAssetArchive::levelData(const archive::TextureEntry& e, uint32_t level) const noexcept {
+  assert(level < e.mipCount);
+  return p_base_ + e.mips[level].offset;
+}
+
+HaruhiAssetPacker::HaruhiAssetPacker(size_t rowAlignment)
+  : row_alignment_(rowAlignment) {
+  assert(rowAlignment && (rowAlignment & (rowAlignment - 1)) == 0);
+  assert(rowAlignment <= archive::DATA_ALIGNMENT);
+}
+
+bool
+HaruhiAssetPacker::addTexture(const std::string& name, const Image* levels, uint32_t count,
+                              archive::Format fmt) {
+  using namespace archive;
+
+  if(name.empty() || name.size() >= NAME_LENGTH || !knownFormat(fmt)
+     || count == 0 || count > MAX_MIPS || levels[0].width == 0 || levels[0].height == 0)
+    return false;
+  for(auto& t : textures_)
+    if(name == t.entry.name) return false;
+
+  Pending p = {};
+  memcpy(p.entry.name, name.c_str(), name.size());
+  p.entry.format = fmt;
+  p.entry.width = levels[0].width;
+  p.entry.height = levels[0].height;
+  p.entry.mipCount = count;
+
+  size_t off = 0;
+  for(uint32_t l = 0; l < count; ++l) {
+    const Image& img = levels[l];
+    if(img.width != std::max(1u, levels[0].width >> l)
+       || img.height != std::max(1u, levels[0].height >> l) || !img.data)
+      return false;
+
+    const size_t row = rowBytes(fmt, img.width);
+    const size_t pitch = alignUp(row, row_alignment_);
+    const uint32_t rows = rowCount(fmt, img.height);
+    const size_t src_pitch = img.rowPitch ? img.rowPitch : row;
+
+    p.entry.mips[l] = { off, pitch * rows, img.width, img.height, (uint32_t)pitch, 0 };
+    p.texels.resize(off + pitch * rows);
+    const uint8_t* src = static_cast<const uint8_t*>(img.data);
+    for(uint32_t y = 0; y < rows; ++y)
+      memcpy(p.texels.data() + off + y * pitch, src + y * src_pitch, row);
+    off = alignUp(off + pitch * rows, DATA_ALIGNMENT);
+  }
+
+  textures_.push_back(std::move(p));
+  return true;
+}
+
+int
+HaruhiAssetPacker::write(const char* pth) const noexcept {
+  using namespace archive;
+
+  std::vector<const Pending*> sorted(textures_.size());
+  for(size_t i = 0; i < textures_.size(); ++i)
+    sorted[i] = &textures_[i];
+  std::sort(sorted.begin(), sorted.end(), [](const Pending* a, const Pending* b) {
+    return strcmp(a->entry.name, b->entry.name) < 0;
+  });
+
+  // relocate the level offsets into file offsets
+  std::vector<TextureEntry> toc(sorted.size());
+  std::vector<size_t> starts(sorted.size());
+  size_t off = DATA_ALIGNMENT;
+  for(size_t i = 0; i < sorted.size(); ++i) {
+    starts[i] = off;
+    toc[i] = sorted[i]->entry;
+    for(uint32_t l = 0; l < toc[i].mipCount; ++l)
+      toc[i].mips[l].offset += off;
+    off = alignUp(off + sorted[i]->texels.size(), DATA_ALIGNMENT);
+  }
+
+  Header h = {};
+  memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.textureCount = (uint32_t)toc.size();
+  h.tocOffset = off;
+  h.fileSize = alignUp(off + toc.size() * sizeof(TextureEntry), FILE_ALIGNMENT);
+
+  // write next to the target and rename, readers never see a partial file
+  const std::string tmp = std::string(pth) + ".tmp";
+  FILE* fp = fopen(tmp.c_str(), "wb");
+  if(!fp) return -errno;
+
+  static const uint8_t zeros[FILE_ALIGNMENT] = {};
+  size_t pos = 0;
+  bool ok = true;
+  auto put = [&](const void* p, size_t n) {
+    ok = ok && fwrite(p, 1, n, fp) == n;
+    pos += n;
+  };
+  auto padTo = [&](size_t target) {
+    while(ok && pos < target)
+      put(zeros, std::min(target - pos, sizeof(zeros)));
+  };
+
+  put(&h, sizeof(h));
+  for(size_t i = 0; i < sorted.size(); ++i) {
+    padTo(starts[i]);
+    put(sorted[i]->texels.data(), sorted[i]->texels.size());
+  }
+  padTo(h.tocOffset);
+  put(toc.data(), toc.size() * sizeof(TextureEntry));
+  padTo(h.fileSize);
+
+  int err = ok ? 0 : -EIO;
+  if(fclose(fp) != 0 && !err) err = -errno;
+  if(!err && rename(tmp.c_str(), pth) != 0) err = -errno;
+  if(err) remove(tmp.c_str());
+  return err;
+}
\ No newline at end of file
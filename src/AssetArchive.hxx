@@ -0,0 +1,139 @@
+#ifndef HARUHI_ASSETARCHIVE_HXX
+#define HARUHI_ASSETARCHIVE_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// packed asset archive, textures are stored ready to upload so loading one
+// is an mmap and a page fault per touched page
+//
+// layout: Header | texel data ... | TextureEntry[count] sorted by name
+// every mip level starts at a DATA_ALIGNMENT offset with rows padded to the
+// row alignment given to the packer, the file is padded to FILE_ALIGNMENT
+// so the whole mapping can back a no-copy gpu buffer
+namespace archive {
+
+constexpr char MAGIC[4] = { 'H', 'P', 'A', 'K' };
+constexpr uint32_t VERSION = 1;
+constexpr uint32_t MAX_MIPS = 16;
+constexpr uint32_t NAME_LENGTH = 48;
+constexpr size_t DATA_ALIGNMENT = 256;
+constexpr size_t FILE_ALIGNMENT = 16384;
+
+enum Format : uint32_t {
+  FORMAT_RGBA8_SRGB = 0,
+  // block compressed, a row is one row of blocks, see BlockCompress.hxx
+  FORMAT_BC1_SRGB = 1,
+  FORMAT_BC3_SRGB = 2,
+  FORMAT_BC7_SRGB = 3,
+  FORMAT_ASTC_4x4_SRGB = 4,
+  FORMAT_ASTC_6x6_SRGB = 5,
+};
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t textureCount;
+  uint32_t _pad;
+  uint64_t tocOffset;
+  uint64_t fileSize;
+};
+
+struct MipLevel {
+  uint64_t offset; // from the start of the file
+  uint64_t size;
+  uint32_t width, height;
+  uint32_t rowPitch;
+  uint32_t _pad;
+};
+
+struct TextureEntry {
+  char name[NAME_LENGTH]; // nul terminated
+  uint32_t format;
+  uint32_t width, height;
+  uint32_t mipCount;
+  MipLevel mips[MAX_MIPS];
+};
+
+static_assert(sizeof(Header) == 32);
+static_assert(sizeof(MipLevel) == 32);
+static_assert(sizeof(TextureEntry) == 64 + 32 * MAX_MIPS);
+
+// bytes of one packed row and number of rows for a level of the format
+size_t rowBytes(Format, uint32_t) noexcept;
+uint32_t rowCount(Format, uint32_t) noexcept;
+
+} // ns archive
+
+// read only view of an archive file, entries and texel pointers stay valid
+// until the archive is closed or destroyed
+class HaruhiAssetArchive {
+  const uint8_t* p_base_;
+  size_t size_;
+  const archive::TextureEntry* p_toc_;
+  uint32_t count_;
+
+  int validate() noexcept;
+
+public:
+  HaruhiAssetArchive();
+  ~HaruhiAssetArchive();
+
+  HaruhiAssetArchive(const HaruhiAssetArchive&) = delete;
+  HaruhiAssetArchive& operator=(const HaruhiAssetArchive&) = delete;
+
+  // 0 on success, -errno when the file can't be mapped, -EINVAL when it
+  // isn't a well formed archive of this version
+  int open(const char*) noexcept;
+  void close() noexcept;
+
+  bool isOpen() const noexcept { return p_base_; }
+  const uint8_t* data() const noexcept { return p_base_; }
+  size_t size() const noexcept { return size_; }
+
+  uint32_t textureCount() const noexcept { return count_; }
+  const archive::TextureEntry& texture(uint32_t i) const noexcept { return p_toc_[i]; }
+
+  // binary search over the sorted toc, nullptr if absent
+  const archive::TextureEntry* findTexture(const char*) const noexcept;
+
+  const uint8_t* levelData(const archive::TextureEntry&, uint32_t) const noexcept;
+};
+
+// builds an archive in memory and writes it out in one go
+class HaruhiAssetPacker {
+public:
+  struct Image {
+    uint32_t width, height;
+    const void* data;
+    size_t rowPitch; // 0 for tightly packed rows
+  };
+
+private:
+  struct Pending {
+    archive::TextureEntry entry;
+    std::vector<uint8_t> texels; // levels laid out relative to the first
+  };
+
+  size_t row_alignment_;
+  std::vector<Pending> textures_;
+
+public:
+  // rows are padded to a multiple of rowAlignment, a power of two no larger
+  // than archive::DATA_ALIGNMENT (gpu linear texture alignment)
+  explicit HaruhiAssetPacker(size_t = archive::DATA_ALIGNMENT);
+
+  // levels from largest to smallest, false on a bad name, a duplicate or
+  // inconsistent level sizes
+  bool addTexture(const std::string&, const Image*, uint32_t,
+                  archive::Format = archive::FORMAT_RGBA8_SRGB);
+
+  size_t textureCount() const noexcept { return textures_.size(); }
+
+  // 0 or -errno
+  int write(const char*) const noexcept;
+};
+
+#endif
\ No newline at end of file
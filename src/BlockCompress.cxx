@@ -0,0 +1,881 @@
+#include "BlockCompress.hxx"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+#include "SimdMath.hxx"
+#include "WorkerPool.hxx"
+
+namespace texcomp {
+
+namespace {
+
+constexpr int MAX_TEXELS = 36;
+
+// texels of one block as r, g, b, a planes, padded to a multiple of 4
+struct Block {
+  alignas(16) float c[4][MAX_TEXELS];
+  int count;
+  bool transparent; // some alpha below 128
+};
+
+void
+loadBlock(const uint8_t* pSrc, size_t pitch, uint32_t w, uint32_t h,
+          uint32_t x0, uint32_t y0, uint32_t bw, uint32_t bh, Block& b) noexcept {
+  b.count = (int)(bw * bh);
+  b.transparent = false;
+  for(uint32_t y = 0; y < bh; ++y) {
+    const uint8_t* row = pSrc + std::min(y0 + y, h - 1) * pitch;
+    for(uint32_t x = 0; x < bw; ++x) {
+      const uint8_t* p = row + std::min(x0 + x, w - 1) * 4;
+      const int i = (int)(y * bw + x);
+      for(int ch = 0; ch < 4; ++ch)
+        b.c[ch][i] = p[ch];
+      b.transparent |= p[3] < 128;
+    }
+  }
+}
+
+// nearest palette entry per texel over channels [first, last), returns the
+// summed squared error. four texels per step
+float
+fitIndices(const Block& b, const float (*pal)[4], int n, int first, int last,
+           uint8_t* idx) noexcept {
+  using namespace math::vec;
+
+  float total = 0.f;
+  for(int i = 0; i < b.count; i += 4) {
+    v4 best = splat(1e30f), best_i = splat(0.f);
+    for(int p = 0; p < n; ++p) {
+      v4 e = splat(0.f);
+      for(int ch = first; ch < last; ++ch) {
+        const v4 d = sub(load(b.c[ch] + i), splat(pal[p][ch]));
+        e = madd(d, d, e);
+      }
+      const v4 m = cmplt(e, best);
+      best = select(m, e, best);
+      best_i = select(m, splat((float)p), best_i);
+    }
+    alignas(16) float be[4], bi[4];
+    store(be, best);
+    store(bi, best_i);
+    for(int k = 0; k < 4; ++k) {
+      idx[i + k] = (uint8_t)bi[k];
+      total += be[k];
+    }
+  }
+  return total;
+}
+
+float
+clamp255(float v) noexcept {
+  return std::clamp(v, 0.f, 255.f);
+}
+
+// endpoints on the principal axis through the texels, the extremes pulled
+// in by inset of the extent
+void
+principalFit(const Block& b, int first, int last, float inset, float* e0, float* e1) noexcept {
+  float mean[4] = {}, lo[4], hi[4];
+  for(int ch = first; ch < last; ++ch) {
+    lo[ch] = 255.f;
+    hi[ch] = 0.f;
+    for(int i = 0; i < b.count; ++i) {
+      mean[ch] += b.c[ch][i];
+      lo[ch] = std::min(lo[ch], b.c[ch][i]);
+      hi[ch] = std::max(hi[ch], b.c[ch][i]);
+    }
+    mean[ch] /= b.count;
+  }
+
+  float cov[4][4] = {};
+  for(int i = 0; i < b.count; ++i)
+    for(int r = first; r < last; ++r)
+      for(int c = r; c < last; ++c)
+        cov[r][c] += (b.c[r][i] - mean[r]) * (b.c[c][i] - mean[c]);
+  for(int r = first; r < last; ++r)
+    for(int c = first; c < r; ++c)
+      cov[r][c] = cov[c][r];
+
+  // power iteration from the bounding box diagonal
+  float axis[4] = {};
+  for(int ch = first; ch < last; ++ch)
+    axis[ch] = hi[ch] - lo[ch] + 1e-3f;
+  for(int it = 0; it < 8; ++it) {
+    float next[4] = {}, len = 0.f;
+    for(int r = first; r < last; ++r) {
+      for(int c = first; c < last; ++c)
+        next[r] += cov[r][c] * axis[c];
+      len += next[r] * next[r];
+    }
+    if(len < 1e-12f) break;
+    len = 1.f / std::sqrt(len);
+    for(int ch = first; ch < last; ++ch)
+      axis[ch] = next[ch] * len;
+  }
+  float norm = 0.f;
+  for(int ch = first; ch < last; ++ch)
+    norm += axis[ch] * axis[ch];
+  norm = 1.f / std::sqrt(norm);
+  for(int ch = first; ch < last; ++ch)
+    axis[ch] *= norm;
+
+  float tmin = 1e30f, tmax = -1e30f;
+  for(int i = 0; i < b.count; ++i) {
+    float t = 0.f;
+    for(int ch = first; ch < last; ++ch)
+      t += (b.c[ch][i] - mean[ch]) * axis[ch];
+    tmin = std::min(tmin, t);
+    tmax = std::max(tmax, t);
+  }
+  const float d = (tmax - tmin) * inset;
+  tmin += d;
+  tmax -= d;
+  for(int ch = first; ch < last; ++ch) {
+    e0[ch] = clamp255(mean[ch] + axis[ch] * tmin);
+    e1[ch] = clamp255(mean[ch] + axis[ch] * tmax);
+  }
+}
+
+// endpoints minimizing the error for fixed interpolation fractions t
+bool
+leastSquares(const Block& b, int first, int last, const float* t, float* e0, float* e1) noexcept {
+  float aa = 0.f, ab = 0.f, bb = 0.f, ax[4] = {}, bx[4] = {};
+  for(int i = 0; i < b.count; ++i) {
+    const float s = 1.f - t[i];
+    aa += s * s;
+    ab += s * t[i];
+    bb += t[i] * t[i];
+    for(int ch = first; ch < last; ++ch) {
+      ax[ch] += s * b.c[ch][i];
+      bx[ch] += t[i] * b.c[ch][i];
+    }
+  }
+  const float det = aa * bb - ab * ab;
+  if(std::fabs(det) < 1e-4f) return false;
+  const float inv = 1.f / det;
+  for(int ch = first; ch < last; ++ch) {
+    e0[ch] = clamp255((bb * ax[ch] - ab * bx[ch]) * inv);
+    e1[ch] = clamp255((aa * bx[ch] - ab * ax[ch]) * inv);
+  }
+  return true;
+}
+
+// little endian bit packing of one 128 bit block
+struct Bits {
+  uint8_t* p;
+  unsigned pos;
+
+  void put(uint32_t v, unsigned n) noexcept {
+    for(unsigned i = 0; i < n; ++i, ++pos)
+      if(v >> i & 1) p[pos >> 3] |= uint8_t(1u << (pos & 7));
+  }
+  uint32_t get(unsigned n) noexcept {
+    uint32_t v = 0;
+    for(unsigned i = 0; i < n; ++i, ++pos)
+      v |= uint32_t(p[pos >> 3] >> (pos & 7) & 1) << i;
+    return v;
+  }
+};
+
+// ---- BC1 color, also the color half of BC3
+
+uint16_t
+to565(const float* c) noexcept {
+  const uint32_t r = (uint32_t)(c[0] * 31.f / 255.f + .5f);
+  const uint32_t g = (uint32_t)(c[1] * 63.f / 255.f + .5f);
+  const uint32_t b = (uint32_t)(c[2] * 31.f / 255.f + .5f);
+  return uint16_t(r << 11 | g << 5 | b);
+}
+
+void
+from565(uint16_t v, int* c) noexcept {
+  const int r = v >> 11, g = v >> 5 & 63, b = v & 31;
+  c[0] = r << 3 | r >> 2;
+  c[1] = g << 2 | g >> 4;
+  c[2] = b << 3 | b >> 2;
+}
+
+// 4 colors when c0 > c1 (or always for BC3), else 3 and transparent black
+int
+bc1Palette(uint16_t c0, uint16_t c1, bool forceFour, int (*pal)[4]) noexcept {
+  from565(c0, pal[0]);
+  from565(c1, pal[1]);
+  pal[0][3] = pal[1][3] = 255;
+  const bool four = forceFour || c0 > c1;
+  for(int ch = 0; ch < 3; ++ch) {
+    if(four) {
+      pal[2][ch] = (2 * pal[0][ch] + pal[1][ch]) / 3;
+      pal[3][ch] = (pal[0][ch] + 2 * pal[1][ch]) / 3;
+    } else {
+      pal[2][ch] = (pal[0][ch] + pal[1][ch]) / 2;
+      pal[3][ch] = 0;
+    }
+  }
+  pal[2][3] = 255;
+  pal[3][3] = four ? 255 : 0;
+  return four ? 4 : 3;
+}
+
+struct ColorFit {
+  uint16_t c0, c1;
+  uint8_t idx[16];
+  float err;
+};
+
+// orders the endpoints for the mode and picks indices
+void
+evalColor(const Block& b, uint16_t c0, uint16_t c1, bool punch, bool bc3, ColorFit& out) noexcept {
+  if(punch ? c0 > c1 : c0 < c1) std::swap(c0, c1);
+
+  int ipal[4][4];
+  const int n = bc1Palette(c0, c1, bc3, ipal);
+  float pal[4][4];
+  for(int i = 0; i < 4; ++i)
+    for(int ch = 0; ch < 4; ++ch)
+      pal[i][ch] = (float)ipal[i][ch];
+
+  out.c0 = c0;
+  out.c1 = c1;
+  out.err = fitIndices(b, pal, std::min(n, 3 + !punch), 0, 3, out.idx);
+  if(punch)
+    for(int i = 0; i < 16; ++i)
+      if(b.c[3][i] < 128.f) out.idx[i] = 3;
+}
+
+void
+encodeColor(const Block& b, Quality q, bool bc3, uint8_t* pOut) noexcept {
+  const bool punch = !bc3 && b.transparent;
+  float e0[4], e1[4];
+  principalFit(b, 0, 3, q == QUALITY_FAST ? 1.f / 16.f : 0.f, e0, e1);
+
+  ColorFit best, cur;
+  best.err = 1e30f;
+  const int iters = q == QUALITY_FAST ? 1 : 4;
+  for(int it = 0; it < iters; ++it) {
+    evalColor(b, to565(e0), to565(e1), punch, bc3, cur);
+    if(cur.err < best.err) best = cur;
+    if(it + 1 == iters) break;
+
+    // fractions of the chosen entries, then refit
+    const bool four = bc3 || cur.c0 > cur.c1;
+    static const float T4[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+    static const float T3[4] = { 0.f, 1.f, .5f, 0.f };
+    float t[16];
+    for(int i = 0; i < 16; ++i)
+      t[i] = (four ? T4 : T3)[cur.idx[i]];
+    if(!leastSquares(b, 0, 3, t, e0, e1)) break;
+  }
+
+  if(q == QUALITY_HIGH) {
+    // nudge each 565 component while it helps
+    static const uint16_t FIELDS[3][2] = { { 11, 31 }, { 5, 63 }, { 0, 31 } };
+    for(int pass = 0; pass < 2; ++pass) {
+      bool improved = false;
+      for(int e = 0; e < 2; ++e)
+        for(auto& f : FIELDS)
+          for(int d = -1; d <= 1; d += 2) {
+            uint16_t c[2] = { best.c0, best.c1 };
+            const int v = (c[e] >> f[0] & f[1]) + d;
+            if(v < 0 || v > f[1]) continue;
+            c[e] = uint16_t((c[e] & ~(f[1] << f[0])) | v << f[0]);
+            evalColor(b, c[0], c[1], punch, bc3, cur);
+            if(cur.err < best.err) {
+              best = cur;
+              improved = true;
+            }
+          }
+      if(!improved) break;
+    }
+  }
+
+  // equal endpoints decode as 3 colors, index 0 is the color either way
+  if(!punch && best.c0 == best.c1)
+    memset(best.idx, 0, sizeof(best.idx));
+
+  pOut[0] = uint8_t(best.c0);
+  pOut[1] = uint8_t(best.c0 >> 8);
+  pOut[2] = uint8_t(best.c1);
+  pOut[3] = uint8_t(best.c1 >> 8);
+  uint32_t bits = 0;
+  for(int i = 0; i < 16; ++i)
+    bits |= uint32_t(best.idx[i]) << (2 * i);
+  memcpy(pOut + 4, &bits, 4);
+}
+
+// ---- BC4 alpha of BC3
+
+int
+alphaPalette(int a0, int a1, int* pal) noexcept {
+  pal[0] = a0;
+  pal[1] = a1;
+  if(a0 > a1) {
+    for(int k = 2; k < 8; ++k)
+      pal[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+    return 8;
+  }
+  for(int k = 2; k < 6; ++k)
+    pal[k] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+  pal[6] = 0;
+  pal[7] = 255;
+  return 8;
+}
+
+float
+evalAlpha(const Block& b, int a0, int a1, uint8_t* idx) noexcept {
+  int ipal[8];
+  alphaPalette(a0, a1, ipal);
+  float pal[8][4] = {};
+  for(int k = 0; k < 8; ++k)
+    pal[k][3] = (float)ipal[k];
+  return fitIndices(b, pal, 8, 3, 4, idx);
+}
+
+void
+encodeAlpha(const Block& b, Quality q, uint8_t* pOut) noexcept {
+  int lo = 255, hi = 0, lo_in = 255, hi_in = 0;
+  for(int i = 0; i < 16; ++i) {
+    const int a = (int)b.c[3][i];
+    lo = std::min(lo, a);
+    hi = std::max(hi, a);
+    if(a != 0 && a != 255) {
+      lo_in = std::min(lo_in, a);
+      hi_in = std::max(hi_in, a);
+    }
+  }
+
+  int a0 = hi, a1 = lo;
+  uint8_t idx[16], tmp[16];
+  float err = evalAlpha(b, a0, a1, idx);
+
+  if(q == QUALITY_HIGH) {
+    // 6 interpolated values plus exact 0 and 255
+    if(lo_in <= hi_in) {
+      const float e = evalAlpha(b, lo_in, hi_in, tmp);
+      if(e < err) {
+        err = e;
+        a0 = lo_in;
+        a1 = hi_in;
+        memcpy(idx, tmp, 16);
+      }
+    }
+    // widen or narrow the 8 value range by a step
+    for(int d0 = -2; d0 <= 2; ++d0)
+      for(int d1 = -2; d1 <= 2; ++d1) {
+        const int c0 = hi + d0, c1 = lo + d1;
+        if(c0 > 255 || c1 < 0 || c0 <= c1) continue;
+        const float e = evalAlpha(b, c0, c1, tmp);
+        if(e < err) {
+          err = e;
+          a0 = c0;
+          a1 = c1;
+          memcpy(idx, tmp, 16);
+        }
+      }
+  }
+
+  pOut[0] = uint8_t(a0);
+  pOut[1] = uint8_t(a1);
+  uint64_t bits = 0;
+  for(int i = 0; i < 16; ++i)
+    bits |= uint64_t(idx[i]) << (3 * i);
+  for(int k = 0; k < 6; ++k)
+    pOut[2 + k] = uint8_t(bits >> (8 * k));
+}
+
+// ---- BC7 mode 6, one subset with 7777 endpoints, a p bit each, 4 bit indices
+
+constexpr int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct Bc7Fit {
+  int q[2][4], p[2];
+  uint8_t idx[16];
+  float err;
+};
+
+float
+evalBc7(const Block& b, const int (*q)[4], const int* p, uint8_t* idx) noexcept {
+  int e[2][4];
+  for(int k = 0; k < 2; ++k)
+    for(int ch = 0; ch < 4; ++ch)
+      e[k][ch] = q[k][ch] << 1 | p[k];
+  float pal[16][4];
+  for(int i = 0; i < 16; ++i)
+    for(int ch = 0; ch < 4; ++ch)
+      pal[i][ch] = (float)(((64 - BC7_WEIGHTS4[i]) * e[0][ch] + BC7_WEIGHTS4[i] * e[1][ch] + 32) >> 6);
+  return fitIndices(b, pal, 16, 0, 4, idx);
+}
+
+void
+quantizeBc7(const float* e, int p, int* q) noexcept {
+  for(int ch = 0; ch < 4; ++ch)
+    q[ch] = std::clamp((int)std::lround((e[ch] - p) * .5f), 0, 127);
+}
+
+void
+encodeBc7(const Block& b, Quality q, uint8_t* pOut) noexcept {
+  float e[2][4];
+  principalFit(b, 0, 4, 0.f, e[0], e[1]);
+
+  // the first candidate is always taken, a NaN error can't leave best unset
+  Bc7Fit best = {}, cur = {};
+  bool fitted = false;
+  const int iters = q == QUALITY_FAST ? 1 : 3;
+  for(int it = 0; it < iters; ++it) {
+    if(q == QUALITY_FAST) {
+      // p bit closest per endpoint
+      for(int k = 0; k < 2; ++k) {
+        float best_d = 1e30f;
+        for(int p = 0; p < 2; ++p) {
+          int t[4];
+          quantizeBc7(e[k], p, t);
+          float d = 0.f;
+          for(int ch = 0; ch < 4; ++ch)
+            d += ((t[ch] << 1 | p) - e[k][ch]) * ((t[ch] << 1 | p) - e[k][ch]);
+          if(d < best_d) {
+            best_d = d;
+            cur.p[k] = p;
+            memcpy(cur.q[k], t, sizeof(t));
+          }
+        }
+      }
+      cur.err = evalBc7(b, cur.q, cur.p, cur.idx);
+      if(!fitted || cur.err < best.err) {
+        best = cur;
+        fitted = true;
+      }
+    } else {
+      // every p bit pair against the block
+      for(int pp = 0; pp < 4; ++pp) {
+        cur.p[0] = pp & 1;
+        cur.p[1] = pp >> 1;
+        quantizeBc7(e[0], cur.p[0], cur.q[0]);
+        quantizeBc7(e[1], cur.p[1], cur.q[1]);
+        cur.err = evalBc7(b, cur.q, cur.p, cur.idx);
+        if(!fitted || cur.err < best.err) {
+          best = cur;
+          fitted = true;
+        }
+      }
+      float t[16];
+      for(int i = 0; i < 16; ++i)
+        t[i] = BC7_WEIGHTS4[best.idx[i]] / 64.f;
+      if(!leastSquares(b, 0, 4, t, e[0], e[1])) break;
+    }
+  }
+
+  // the anchor index has an implicit 0 msb
+  if(best.idx[0] >= 8) {
+    std::swap(best.q[0], best.q[1]);
+    std::swap(best.p[0], best.p[1]);
+    for(auto& i : best.idx) i = uint8_t(15 - i);
+  }
+
+  memset(pOut, 0, 16);
+  Bits bits = { pOut, 0 };
+  bits.put(1u << 6, 7);
+  for(int ch = 0; ch < 4; ++ch) {
+    bits.put(best.q[0][ch], 7);
+    bits.put(best.q[1][ch], 7);
+  }
+  bits.put(best.p[0], 1);
+  bits.put(best.p[1], 1);
+  bits.put(best.idx[0], 3);
+  for(int i = 1; i < 16; ++i)
+    bits.put(best.idx[i], 4);
+}
+
+// ---- ASTC, single partition, CEM 12 (LDR RGBA direct) at 8 bits,
+// a 4x4 weight grid of 2 bit weights infilled over the footprint
+
+// D H B B A A R0 0 0 R2 R1 with W = B + 4, H = A + 2 and R = 4 (0..3)
+constexpr uint32_t ASTC_BLOCK_MODE = 2 << 5 | 2;
+constexpr uint32_t ASTC_CEM_RGBA = 12;
+constexpr int ASTC_GRID = 4;
+constexpr int ASTC_WEIGHTS2[4] = { 0, 21, 43, 64 };
+
+// bilinear infill of the weight grid, per texel 4 grid indices and weights
+// summing to 16
+struct Infill {
+  uint8_t grid[MAX_TEXELS][4];
+  uint8_t w[MAX_TEXELS][4];
+  // texels each grid weight contributes to
+  uint8_t users[ASTC_GRID * ASTC_GRID][MAX_TEXELS];
+  uint8_t userCount[ASTC_GRID * ASTC_GRID];
+
+  Infill(int bw, int bh) noexcept : userCount() {
+    const int ds = (1024 + bw / 2) / (bw - 1);
+    const int dt = (1024 + bh / 2) / (bh - 1);
+    for(int t = 0; t < bh; ++t)
+      for(int s = 0; s < bw; ++s) {
+        const int gs = (ds * s * (ASTC_GRID - 1) + 32) >> 6;
+        const int gt = (dt * t * (ASTC_GRID - 1) + 32) >> 6;
+        const int js = gs >> 4, fs = gs & 15;
+        const int jt = gt >> 4, ft = gt & 15;
+        const int v0 = js + jt * ASTC_GRID;
+        const int w11 = (fs * ft + 8) >> 4;
+        const int i = t * bw + s;
+        // taps past the grid edge always get a zero weight
+        grid[i][0] = uint8_t(v0);
+        grid[i][1] = uint8_t(std::min(v0 + 1, ASTC_GRID * ASTC_GRID - 1));
+        grid[i][2] = uint8_t(std::min(v0 + ASTC_GRID, ASTC_GRID * ASTC_GRID - 1));
+        grid[i][3] = uint8_t(std::min(v0 + ASTC_GRID + 1, ASTC_GRID * ASTC_GRID - 1));
+        w[i][0] = uint8_t(16 - fs - ft + w11);
+        w[i][1] = uint8_t(fs - w11);
+        w[i][2] = uint8_t(ft - w11);
+        w[i][3] = uint8_t(w11);
+        for(int k = 0; k < 4; ++k)
+          if(w[i][k]) users[grid[i][k]][userCount[grid[i][k]]++] = uint8_t(i);
+      }
+  }
+
+  int weight(int i, const uint8_t* g) const noexcept {
+    int sum = 8;
+    for(int k = 0; k < 4; ++k)
+      sum += ASTC_WEIGHTS2[g[grid[i][k]]] * w[i][k];
+    return sum >> 4;
+  }
+};
+
+// footprints are square, the width picks the table
+const Infill&
+infill(int bw) noexcept {
+  static const Infill i4(4, 4), i6(6, 6);
+  return bw == 4 ? i4 : i6;
+}
+
+// decode_srgb interpolation, endpoints widened with 0x80
+int
+astcTexel(int c0, int c1, int w) noexcept {
+  const int a = c0 << 8 | 0x80, b = c1 << 8 | 0x80;
+  return ((a * (64 - w) + b * w + 32) >> 6) >> 8;
+}
+
+float
+astcError(const Block& b, const Infill& inf, const int (*q)[4], const uint8_t* g, int i) noexcept {
+  const int w = inf.weight(i, g);
+  float err = 0.f;
+  for(int ch = 0; ch < 4; ++ch) {
+    const float d = astcTexel(q[0][ch], q[1][ch], w) - b.c[ch][i];
+    err += d * d;
+  }
+  return err;
+}
+
+void
+encodeAstc(const Block& b, Quality q, int bw, uint8_t* pOut) noexcept {
+  const Infill& inf = infill(bw);
+  constexpr int G = ASTC_GRID * ASTC_GRID;
+
+  float e[2][4];
+  principalFit(b, 0, 4, 0.f, e[0], e[1]);
+
+  int best_q[2][4];
+  uint8_t best_g[G];
+  float best_err = 1e30f;
+
+  const int iters = q == QUALITY_FAST ? 1 : 3;
+  for(int it = 0; it < iters; ++it) {
+    int qe[2][4];
+    for(int k = 0; k < 2; ++k)
+      for(int ch = 0; ch < 4; ++ch)
+        qe[k][ch] = (int)std::lround(e[k][ch]);
+    // a smaller rgb sum on the second endpoint would mean blue contraction
+    if(qe[1][0] + qe[1][1] + qe[1][2] < qe[0][0] + qe[0][1] + qe[0][2])
+      std::swap(qe[0], qe[1]);
+
+    // ideal weight per texel along the endpoint line
+    float d[4], dd = 0.f;
+    for(int ch = 0; ch < 4; ++ch) {
+      d[ch] = float(qe[1][ch] - qe[0][ch]);
+      dd += d[ch] * d[ch];
+    }
+    float ideal[MAX_TEXELS];
+    for(int i = 0; i < b.count; ++i) {
+      float t = 0.f;
+      for(int ch = 0; ch < 4; ++ch)
+        t += (b.c[ch][i] - qe[0][ch]) * d[ch];
+      ideal[i] = dd > 0.f ? std::clamp(t / dd, 0.f, 1.f) * 64.f : 0.f;
+    }
+
+    // grid weights as the infill weighted average of what they cover
+    float acc[G] = {}, norm[G] = {};
+    for(int i = 0; i < b.count; ++i)
+      for(int k = 0; k < 4; ++k) {
+        acc[inf.grid[i][k]] += inf.w[i][k] * ideal[i];
+        norm[inf.grid[i][k]] += inf.w[i][k];
+      }
+    uint8_t g[G];
+    for(int j = 0; j < G; ++j) {
+      const float v = norm[j] > 0.f ? acc[j] / norm[j] : 0.f;
+      int bi = 0;
+      for(int k = 1; k < 4; ++k)
+        if(std::fabs(ASTC_WEIGHTS2[k] - v) < std::fabs(ASTC_WEIGHTS2[bi] - v)) bi = k;
+      g[j] = uint8_t(bi);
+    }
+
+    float texel_err[MAX_TEXELS], err = 0.f;
+    for(int i = 0; i < b.count; ++i)
+      err += texel_err[i] = astcError(b, inf, qe, g, i);
+    if(q == QUALITY_HIGH) {
+      // try every value per grid weight, only its texels change
+      for(int pass = 0; pass < 2; ++pass)
+        for(int j = 0; j < G; ++j) {
+          const uint8_t keep = g[j];
+          for(uint8_t k = 0; k < 4; ++k) {
+            if(k == keep) continue;
+            g[j] = k;
+            float delta = 0.f, trial[MAX_TEXELS];
+            for(int u = 0; u < inf.userCount[j]; ++u) {
+              const int i = inf.users[j][u];
+              trial[u] = astcError(b, inf, qe, g, i);
+              delta += trial[u] - texel_err[i];
+            }
+            if(delta < 0.f) {
+              err += delta;
+              for(int u = 0; u < inf.userCount[j]; ++u)
+                texel_err[inf.users[j][u]] = trial[u];
+              break;
+            }
+            g[j] = keep;
+          }
+        }
+    }
+
+    if(err < best_err) {
+      best_err = err;
+      memcpy(best_q, qe, sizeof(qe));
+      memcpy(best_g, g, sizeof(g));
+    }
+    if(it + 1 == iters) break;
+
+    float t[MAX_TEXELS];
+    for(int i = 0; i < b.count; ++i)
+      t[i] = inf.weight(i, g) / 64.f;
+    if(!leastSquares(b, 0, 4, t, e[0], e[1])) break;
+  }
+
+  memset(pOut, 0, 16);
+  Bits bits = { pOut, 0 };
+  bits.put(ASTC_BLOCK_MODE, 11);
+  bits.put(0, 2); // one partition
+  bits.put(ASTC_CEM_RGBA, 4);
+  for(int ch = 0; ch < 4; ++ch) {
+    bits.put(best_q[0][ch], 8);
+    bits.put(best_q[1][ch], 8);
+  }
+  // weights are stored bit reversed from the top of the block
+  for(int j = 0; j < G; ++j)
+    for(int k = 0; k < 2; ++k)
+      if(best_g[j] >> k & 1) {
+        const unsigned pos = 127 - (2 * j + k);
+        pOut[pos >> 3] |= uint8_t(1u << (pos & 7));
+      }
+}
+
+// ---- decoding
+
+void
+magenta(uint8_t (*px)[4], int n) noexcept {
+  for(int i = 0; i < n; ++i) {
+    px[i][0] = 255; px[i][1] = 0; px[i][2] = 255; px[i][3] = 255;
+  }
+}
+
+void
+decodeColor(const uint8_t* p, bool bc3, uint8_t (*px)[4]) noexcept {
+  const uint16_t c0 = uint16_t(p[0] | p[1] << 8), c1 = uint16_t(p[2] | p[3] << 8);
+  int pal[4][4];
+  bc1Palette(c0, c1, bc3, pal);
+  uint32_t bits;
+  memcpy(&bits, p + 4, 4);
+  for(int i = 0; i < 16; ++i) {
+    const int* c = pal[bits >> (2 * i) & 3];
+    for(int ch = 0; ch < 4; ++ch)
+      px[i][ch] = uint8_t(c[ch]);
+  }
+}
+
+void
+decodeAlpha(const uint8_t* p, uint8_t (*px)[4]) noexcept {
+  int pal[8];
+  alphaPalette(p[0], p[1], pal);
+  uint64_t bits = 0;
+  for(int k = 0; k < 6; ++k)
+    bits |= uint64_t(p[2 + k]) << (8 * k);
+  for(int i = 0; i < 16; ++i)
+    px[i][3] = uint8_t(pal[bits >> (3 * i) & 7]);
+}
+
+void
+decodeBc7(const uint8_t* p, uint8_t (*px)[4]) noexcept {
+  Bits bits = { const_cast<uint8_t*>(p), 0 };
+  if(bits.get(7) != 1u << 6) {
+    magenta(px, 16);
+    return;
+  }
+  int q[2][4], pb[2];
+  for(int ch = 0; ch < 4; ++ch) {
+    q[0][ch] = (int)bits.get(7);
+    q[1][ch] = (int)bits.get(7);
+  }
+  pb[0] = (int)bits.get(1);
+  pb[1] = (int)bits.get(1);
+  for(int i = 0; i < 16; ++i) {
+    const int w = BC7_WEIGHTS4[bits.get(i ? 4 : 3)];
+    for(int ch = 0; ch < 4; ++ch)
+      px[i][ch] = uint8_t(((64 - w) * (q[0][ch] << 1 | pb[0]) + w * (q[1][ch] << 1 | pb[1]) + 32) >> 6);
+  }
+}
+
+void
+decodeAstc(const uint8_t* p, int bw, int bh, uint8_t (*px)[4]) noexcept {
+  Bits bits = { const_cast<uint8_t*>(p), 0 };
+  if(bits.get(11) != ASTC_BLOCK_MODE || bits.get(2) != 0 || bits.get(4) != ASTC_CEM_RGBA) {
+    magenta(px, bw * bh);
+    return;
+  }
+  int v[8];
+  for(int k = 0; k < 8; ++k)
+    v[k] = (int)bits.get(8);
+
+  int e[2][4];
+  if(v[1] + v[3] + v[5] >= v[0] + v[2] + v[4]) {
+    for(int ch = 0; ch < 4; ++ch) {
+      e[0][ch] = v[2 * ch];
+      e[1][ch] = v[2 * ch + 1];
+    }
+  } else {
+    // blue contraction
+    for(int k = 0; k < 2; ++k) {
+      const int* s = v + (1 - k);
+      e[k][0] = (s[0] + s[4]) >> 1;
+      e[k][1] = (s[2] + s[4]) >> 1;
+      e[k][2] = s[4];
+      e[k][3] = s[6];
+    }
+  }
+
+  uint8_t g[ASTC_GRID * ASTC_GRID];
+  for(int j = 0; j < ASTC_GRID * ASTC_GRID; ++j) {
+    int w = 0;
+    for(int k = 0; k < 2; ++k) {
+      const unsigned pos = 127 - (2 * j + k);
+      w |= (p[pos >> 3] >> (pos & 7) & 1) << k;
+    }
+    g[j] = uint8_t(w);
+  }
+
+  const Infill& inf = infill(bw);
+  for(int i = 0; i < bw * bh; ++i) {
+    const int w = inf.weight(i, g);
+    for(int ch = 0; ch < 4; ++ch)
+      px[i][ch] = uint8_t(astcTexel(e[0][ch], e[1][ch], w));
+  }
+}
+
+} // ns
+
+const char*
+codecName(Codec c) noexcept {
+  static const char* NAMES[CODEC_COUNT] = { "bc1", "bc3", "bc7", "astc4x4", "astc6x6" };
+  return c < CODEC_COUNT ? NAMES[c] : "?";
+}
+
+uint32_t
+blockWidth(Codec c) noexcept {
+  return c == CODEC_ASTC_6x6 ? 6 : 4;
+}
+
+uint32_t
+blockHeight(Codec c) noexcept {
+  return blockWidth(c);
+}
+
+uint32_t
+blockBytes(Codec c) noexcept {
+  return c == CODEC_BC1 ? 8 : 16;
+}
+
+size_t
+encodedSize(Codec c, uint32_t w, uint32_t h) noexcept {
+  const size_t bx = (w + blockWidth(c) - 1) / blockWidth(c);
+  const size_t by = (h + blockHeight(c) - 1) / blockHeight(c);
+  return bx * by * blockBytes(c);
+}
+
+void
+encode(Codec c, Quality q, const uint8_t* pSrc, uint32_t w, uint32_t h, size_t rowPitch,
+       uint8_t* pDst, HaruhiWorkerPool* pPool) noexcept {
+  const uint32_t bw = blockWidth(c), bh = blockHeight(c);
+  const uint32_t bx = (w + bw - 1) / bw, by = (h + bh - 1) / bh;
+  const size_t pitch = rowPitch ? rowPitch : (size_t)w * 4;
+  const uint32_t bytes = blockBytes(c);
+
+  auto fn = [&](size_t b, size_t e) {
+    Block blk;
+    for(size_t y = b; y < e; ++y)
+      for(uint32_t x = 0; x < bx; ++x) {
+        loadBlock(pSrc, pitch, w, h, x * bw, (uint32_t)y * bh, bw, bh, blk);
+        uint8_t* out = pDst + (y * bx + x) * bytes;
+        switch(c) {
+        case CODEC_BC1: encodeColor(blk, q, false, out); break;
+        case CODEC_BC3:
+          encodeAlpha(blk, q, out);
+          encodeColor(blk, q, true, out + 8);
+          break;
+        case CODEC_BC7: encodeBc7(blk, q, out); break;
+        case CODEC_ASTC_4x4:
+        case CODEC_ASTC_6x6: encodeAstc(blk, q, bw, out); break;
+        default: break;
+        }
+      }
+  };
+  if(pPool) pPool->parallelFor(by, 1, fn);
+  else fn(0, by);
+}
+
+void
+decode(Codec c, const uint8_t* pSrc, uint32_t w, uint32_t h, uint8_t* pDst) noexcept {
+  const uint32_t bw = blockWidth(c), bh = blockHeight(c);
+  const uint32_t bx = (w + bw - 1) / bw, by = (h + bh - 1) / bh;
+  const uint32_t bytes = blockBytes(c);
+
+  uint8_t px[MAX_TEXELS][4];
+  for(uint32_t y = 0; y < by; ++y)
+    for(uint32_t x = 0; x < bx; ++x) {
+      const uint8_t* blk = pSrc + ((size_t)y * bx + x) * bytes;
+      switch(c) {
+      case CODEC_BC1: decodeColor(blk, false, px); break;
+      case CODEC_BC3:
+        decodeColor(blk + 8, true, px);
+        decodeAlpha(blk, px);
+        break;
+      case CODEC_BC7: decodeBc7(blk, px); break;
+      case CODEC_ASTC_4x4:
+      case CODEC_ASTC_6x6: decodeAstc(blk, (int)bw, (int)bh, px); break;
+      default: magenta(px, MAX_TEXELS); break;
+      }
+
+      for(uint32_t ty = 0; ty < bh && y * bh + ty < h; ++ty)
+        for(uint32_t tx = 0; tx < bw && x * bw + tx < w; ++tx)
+          memcpy(pDst + (((size_t)y * bh + ty) * w + x * bw + tx) * 4, px[ty * bw + tx], 4);
+    }
+}
+
+double
+psnr(const uint8_t* a, const uint8_t* b, size_t texels, bool alpha) noexcept {
+  const int channels = alpha ? 4 : 3;
+  double sum = 0.;
+  for(size_t i = 0; i < texels; ++i)
+    for(int ch = 0; ch < channels; ++ch) {
+      const double d = double(a[i * 4 + ch]) - b[i * 4 + ch];
+      sum += d * d;
+    }
+  const double mse = sum / (texels * channels);
+  return mse > 0. ? 10. * std::log10(255. * 255. / mse) : 99.;
+}
+
+} // ns texcomp
\ No newline at end of file
@@ -0,0 +1,56 @@
+#ifndef HARUHI_BLOCKCOMPRESS_HXX
+#define HARUHI_BLOCKCOMPRESS_HXX
+
+#include <cstddef>
+#include <cstdint>
+
+class HaruhiWorkerPool;
+
+// block compression of RGBA8 images into gpu ready blocks
+//
+// BC1 (with punch through alpha), BC3, BC7 mode 6 and single partition
+// LDR ASTC with a 4x4 grid of 2 bit weights and 8 bit RGBA endpoints, for
+// 4x4 and 6x6 footprints. endpoints are fit in the stored (sRGB encoded)
+// space like every offline encoder does. fast is a principal axis range
+// fit, high refines the endpoints by least squares against the chosen
+// weights and searches the quantized neighbourhood
+namespace texcomp {
+
+enum Codec : uint32_t {
+  CODEC_BC1,
+  CODEC_BC3,
+  CODEC_BC7,
+  CODEC_ASTC_4x4,
+  CODEC_ASTC_6x6,
+  CODEC_COUNT
+};
+
+enum Quality : uint32_t {
+  QUALITY_FAST, // load time
+  QUALITY_HIGH, // offline
+};
+
+const char* codecName(Codec) noexcept;
+
+uint32_t blockWidth(Codec) noexcept;
+uint32_t blockHeight(Codec) noexcept;
+uint32_t blockBytes(Codec) noexcept;
+
+// bytes of the whole image, blocks are row major without padding
+size_t encodedSize(Codec, uint32_t, uint32_t) noexcept;
+
+// partial edge blocks repeat the last row/column, block rows are encoded
+// in parallel on the pool
+void encode(Codec, Quality, const uint8_t*, uint32_t, uint32_t, size_t,
+            uint8_t*, HaruhiWorkerPool* = nullptr) noexcept;
+
+// reference decoder for the block types encode emits, unknown blocks
+// decode to magenta. RGBA8 rows of width * 4 bytes
+void decode(Codec, const uint8_t*, uint32_t, uint32_t, uint8_t*) noexcept;
+
+// over rgb, or rgba when alpha is set
+double psnr(const uint8_t*, const uint8_t*, size_t, bool = false) noexcept;
+
+} // ns texcomp
+
+#endif
\ No newline at end of file
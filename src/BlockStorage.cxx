@@ -0,0 +1,177 @@
+#include "BlockStorage.hxx"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+using voxel::Block;
+constexpr uint16_t NO_SLOT = 0xFFFF;
+
+// words of CHUNK_VOLUME indices of 1 << shift bits
+constexpr size_t
+wordCount(uint32_t shift) noexcept {
+  return (size_t(voxel::CHUNK_VOLUME) << shift) / 64;
+}
+
+// the narrowest width for n palette entries
+uint32_t
+shiftFor(size_t n) noexcept {
+  uint32_t shift = 0;
+  while(shift < 4 && (size_t(1) << (1u << shift)) < n) ++shift;
+  return shift;
+}
+
+// CHUNK_VOLUME indices unpacked, one per thread
+uint16_t*
+scratch() {
+  thread_local std::unique_ptr<uint16_t[]> indices;
+  if(!indices) indices = std::make_unique<uint16_t[]>(voxel::CHUNK_VOLUME);
+  return indices.get();
+}
+
+} // ns
+
+namespace voxel {
+
+BlockStorage::BlockStorage(Block b) : palette_(1, b), shift_(0), mask_(0), bricks_(b ? ~uint64_t(0) : 0) {}
+
+void
+BlockStorage::pack(uint32_t shift, const uint16_t* pIndices) {
+  shift_ = shift;
+  mask_ = (uint64_t(1) << (1u << shift)) - 1;
+  const size_t n = wordCount(shift);
+  words_ = std::make_unique<uint64_t[]>(n);
+  const uint32_t per = 64 >> shift;
+  for(size_t w = 0; w < n; ++w) {
+    uint64_t v = 0;
+    for(uint32_t k = 0; k < per; ++k) v |= uint64_t(pIndices[w * per + k]) << (k << shift);
+    words_[w] = v;
+  }
+}
+
+// repacks over the entries still used, with room for one more
+void
+BlockStorage::compact() {
+  uint16_t* indices = scratch();
+  std::vector<uint16_t> remap(palette_.size(), NO_SLOT);
+  std::vector<Block> used;
+  bricks_ = 0;
+  for(int i = 0; i < CHUNK_VOLUME; ++i) {
+    const uint32_t bit = uint32_t(i) << shift_;
+    uint16_t& slot = remap[words_[bit >> 6] >> (bit & 63) & mask_];
+    if(slot == NO_SLOT) {
+      slot = uint16_t(used.size());
+      used.push_back(palette_[words_[bit >> 6] >> (bit & 63) & mask_]);
+    }
+    indices[i] = slot;
+    bricks_ |= uint64_t(used[slot] != 0) << brickOf(i);
+  }
+  palette_ = std::move(used);
+  pack(shiftFor(palette_.size() + 1), indices);
+}
+
+void
+BlockStorage::set(int i, Block b) {
+  size_t slot = std::find(palette_.begin(), palette_.end(), b) - palette_.begin();
+  // already the one block of the chunk
+  if(!words_ && slot == 0) return;
+  if(slot == palette_.size()) {
+    if(!words_) {
+      // every cell is index 0, the old block
+      shift_ = 0;
+      mask_ = 1;
+      words_ = std::make_unique<uint64_t[]>(wordCount(0));
+    } else if(palette_.size() > mask_) {
+      compact();
+      slot = palette_.size();
+    }
+    palette_.push_back(b);
+  }
+  const uint32_t bit = uint32_t(i) << shift_;
+  uint64_t& w = words_[bit >> 6];
+  w = (w & ~(mask_ << (bit & 63))) | uint64_t(slot) << (bit & 63);
+  bricks_ |= uint64_t(b != 0) << brickOf(i);
+}
+
+void
+BlockStorage::fill(Block b) {
+  palette_.assign(1, b);
+  palette_.shrink_to_fit();
+  words_.reset();
+  shift_ = 0;
+  mask_ = 0;
+  bricks_ = b ? ~uint64_t(0) : 0;
+}
+
+void
+BlockStorage::assign(const Block* pBlocks) {
+  // palette slots by block, reset after every chunk
+  thread_local std::unique_ptr<uint16_t[]> slots;
+  if(!slots) {
+    slots = std::make_unique<uint16_t[]>(size_t(1) << 16);
+    std::fill(slots.get(), slots.get() + (size_t(1) << 16), NO_SLOT);
+  }
+  uint16_t* indices = scratch();
+  palette_.clear();
+  for(int i = 0; i < CHUNK_VOLUME; ++i) {
+    uint16_t& slot = slots[pBlocks[i]];
+    if(slot == NO_SLOT) {
+      slot = uint16_t(palette_.size());
+      palette_.push_back(pBlocks[i]);
+    }
+    indices[i] = slot;
+  }
+  for(Block b : palette_) slots[b] = NO_SLOT;
+
+  if(palette_.size() == 1) {
+    fill(palette_[0]);
+  } else {
+    palette_.shrink_to_fit();
+    pack(shiftFor(palette_.size()), indices);
+    // a brick's row of 8 blocks is two words
+    bricks_ = 0;
+    for(int i = 0; i < CHUNK_VOLUME; i += BRICK_SIZE) {
+      uint64_t a, b;
+      memcpy(&a, pBlocks + i, sizeof(a));
+      memcpy(&b, pBlocks + i + 4, sizeof(b));
+      bricks_ |= uint64_t((a | b) != 0) << brickOf(i);
+    }
+  }
+}
+
+void
+BlockStorage::store(Block* pOut) const noexcept {
+  if(!words_) {
+    std::fill(pOut, pOut + CHUNK_VOLUME, palette_[0]);
+    return;
+  }
+  const uint32_t per = 64 >> shift_;
+  for(size_t w = 0; w < wordCount(shift_); ++w) {
+    uint64_t v = words_[w];
+    for(uint32_t k = 0; k < per; ++k, v >>= 1u << shift_) pOut[w * per + k] = palette_[v & mask_];
+  }
+}
+
+void
+BlockStorage::row(int r, Block* pOut) const noexcept {
+  if(!words_) {
+    std::fill(pOut, pOut + CHUNK_SIZE, palette_[0]);
+    return;
+  }
+  // a row is whole words from 2 bits up, half of one at 1 bit
+  const uint32_t bit = uint32_t(r * CHUNK_SIZE) << shift_;
+  const uint32_t per = std::min<uint32_t>(64 >> shift_, CHUNK_SIZE);
+  const uint64_t* pWords = &words_[bit >> 6];
+  for(int x = 0; x < CHUNK_SIZE; x += per) {
+    uint64_t v = *pWords++ >> (bit & 63);
+    for(uint32_t k = 0; k < per; ++k, v >>= 1u << shift_) pOut[x + k] = palette_[v & mask_];
+  }
+}
+
+size_t
+BlockStorage::bytes() const noexcept {
+  return sizeof(*this) + palette_.capacity() * sizeof(Block) + (words_ ? wordCount(shift_) * sizeof(uint64_t) : 0);
+}
+
+} // ns voxel
\ No newline at end of file
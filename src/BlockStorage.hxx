@@ -0,0 +1,76 @@
+#ifndef HARUHI_BLOCKSTORAGE_HXX
+#define HARUHI_BLOCKSTORAGE_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// the blocks of one chunk, palette compressed
+//
+// a chunk holds few kinds of blocks, so cells store an index into the
+// chunk's palette of blocks, bit packed at the narrowest width of 1, 2,
+// 4, 8 or 16 bits that fits the palette. entries never straddle a word,
+// a cell is a shift and a mask away. a chunk of one block, all air or
+// all stone, keeps no indices at all. setting a block the palette lacks
+// adds it, widening the indices when the palette is full, after first
+// dropping entries no cell uses any more. a mask of the bricks holding
+// anything but air lets queries skip the empty ones
+namespace voxel {
+
+constexpr int CHUNK_SIZE = 32;
+constexpr int CHUNK_AREA = CHUNK_SIZE * CHUNK_SIZE;
+constexpr int CHUNK_VOLUME = CHUNK_AREA * CHUNK_SIZE;
+// bricks of BRICK_SIZE^3 cells, 64 per chunk
+constexpr int BRICK_SIZE = 8;
+
+using Block = uint16_t;
+
+class BlockStorage {
+  std::vector<Block> palette_;
+  // CHUNK_VOLUME << shift_ bits, null for a single block
+  std::unique_ptr<uint64_t[]> words_;
+  uint32_t shift_;
+  uint64_t mask_;
+  // bit (z / 8 * 4 + y / 8) * 4 + x / 8 per brick that may hold a block
+  // other than air. exact after fill and assign, set only adds bits
+  uint64_t bricks_;
+
+  void pack(uint32_t, const uint16_t*);
+  void compact();
+
+public:
+  explicit BlockStorage(Block = 0);
+
+  // cells are x fastest, (z * CHUNK_SIZE + y) * CHUNK_SIZE + x
+  Block get(int i) const noexcept {
+    if(!words_) return palette_[0];
+    const uint32_t bit = uint32_t(i) << shift_;
+    return palette_[words_[bit >> 6] >> (bit & 63) & mask_];
+  }
+  void set(int, Block);
+
+  // every cell at once, from or to a dense array
+  void fill(Block);
+  void assign(const Block*);
+  void store(Block*) const noexcept;
+  // the CHUNK_SIZE cells of row z * CHUNK_SIZE + y
+  void row(int, Block*) const noexcept;
+
+  // the brick of cell i, its bit in bricks()
+  static uint32_t brickOf(int i) noexcept { return uint32_t(i >> 13 << 4 | (i >> 8 & 3) << 2 | (i >> 3 & 3)); }
+  uint64_t bricks() const noexcept { return bricks_; }
+
+  // one block in every cell, value() is it
+  bool uniform() const noexcept { return !words_; }
+  Block value() const noexcept { return palette_[0]; }
+  size_t paletteSize() const noexcept { return palette_.size(); }
+  // bits per cell, 0 when uniform
+  uint32_t bits() const noexcept { return words_ ? 1u << shift_ : 0; }
+  // heap and inline bytes
+  size_t bytes() const noexcept;
+};
+
+} // ns voxel
+
+#endif
\ No newline at end of file
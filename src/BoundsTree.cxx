@@ -0,0 +1,509 @@
+#include "BoundsTree.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+
+#include "WorkerPool.hxx"
+
+namespace {
+
+// extent of empty slots and lanes, fails every plane test
+constexpr float EMPTY_EXTENT = -1e30f;
+
+inline cull::Aabb
+merge(const cull::Aabb& a, const cull::Aabb& b) noexcept {
+  return {
+    { std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z) },
+    { std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z) }
+  };
+}
+
+inline void
+markDirty(uint8_t& flag) noexcept {
+  std::atomic_ref<uint8_t>(flag).store(1, std::memory_order_relaxed);
+}
+
+} // ns
+
+namespace cull {
+
+Frustum
+makeFrustum(const math::float4x4& m) noexcept {
+  const auto& c = m.columns;
+  const math::float4 r0 = { c[0].x, c[1].x, c[2].x, c[3].x };
+  const math::float4 r1 = { c[0].y, c[1].y, c[2].y, c[3].y };
+  const math::float4 r2 = { c[0].z, c[1].z, c[2].z, c[3].z };
+  const math::float4 r3 = { c[0].w, c[1].w, c[2].w, c[3].w };
+
+  Frustum f = { { r3 + r0, r3 - r0, r3 + r1, r3 - r1, r2, r3 - r2 } };
+  for(math::float4& p : f.planes) {
+    const float l = math::length(p.xyz());
+    if(l > 0.f) p = p * (1.f / l);
+  }
+  return f;
+}
+
+Result
+classify(const Frustum& f, const Aabb& box) noexcept {
+  const math::float3 c = (box.min + box.max) * .5f;
+  const math::float3 e = (box.max - box.min) * .5f;
+  Result r = RESULT_INSIDE;
+  for(const math::float4& p : f.planes) {
+    const float d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+    const float s = std::abs(p.x) * e.x + std::abs(p.y) * e.y + std::abs(p.z) * e.z;
+    if(d + s < 0.f) return RESULT_OUTSIDE;
+    if(d - s < 0.f) r = RESULT_INTERSECTING;
+  }
+  return r;
+}
+
+} // ns cull
+
+// planes splatted once per query
+struct HaruhiBoundsTree::Walk {
+  math::vec::v4 nx[6], ny[6], nz[6], w[6], ax[6], ay[6], az[6];
+#if defined(HARUHI_SIMD_AVX2)
+  __m256 nx8[6], ny8[6], nz8[6], w8[6], ax8[6], ay8[6], az8[6];
+#endif
+
+  explicit Walk(const cull::Frustum& f) noexcept {
+    using namespace math::vec;
+    for(int i = 0; i < 6; ++i) {
+      const math::float4& p = f.planes[i];
+      nx[i] = splat(p.x); ny[i] = splat(p.y); nz[i] = splat(p.z); w[i] = splat(p.w);
+      ax[i] = splat(std::abs(p.x)); ay[i] = splat(std::abs(p.y)); az[i] = splat(std::abs(p.z));
+#if defined(HARUHI_SIMD_AVX2)
+      nx8[i] = _mm256_set1_ps(p.x); ny8[i] = _mm256_set1_ps(p.y);
+      nz8[i] = _mm256_set1_ps(p.z); w8[i] = _mm256_set1_ps(p.w);
+      ax8[i] = _mm256_set1_ps(std::abs(p.x)); ay8[i] = _mm256_set1_ps(std::abs(p.y));
+      az8[i] = _mm256_set1_ps(std::abs(p.z));
+#endif
+    }
+  }
+
+  // outside and fully inside bits of four boxes
+  void
+  test(const float* cx, const float* cy, const float* cz,
+       const float* ex, const float* ey, const float* ez, int& out, int& in) const noexcept {
+    using namespace math::vec;
+    const v4 x = loadu(cx), y = loadu(cy), z = loadu(cz);
+    const v4 sx = loadu(ex), sy = loadu(ey), sz = loadu(ez);
+    const v4 zero = splat(0.f);
+    v4 o = cmplt(zero, zero), n = cmpge(zero, zero);
+    for(int i = 0; i < 6; ++i) {
+      const v4 d = madd(nx[i], x, madd(ny[i], y, madd(nz[i], z, w[i])));
+      const v4 s = madd(ax[i], sx, madd(ay[i], sy, mul(az[i], sz)));
+      o = or_(o, cmplt(add(d, s), zero));
+      n = and_(n, cmpge(sub(d, s), zero));
+    }
+    out = movemask(o);
+    in = movemask(n);
+  }
+
+  // outside bits of eight boxes
+  int
+  test8(const float* cx, const float* cy, const float* cz,
+        const float* ex, const float* ey, const float* ez) const noexcept {
+#if defined(HARUHI_SIMD_AVX2)
+    using math::vec::madd8;
+    const __m256 x = _mm256_loadu_ps(cx), y = _mm256_loadu_ps(cy), z = _mm256_loadu_ps(cz);
+    const __m256 sx = _mm256_loadu_ps(ex), sy = _mm256_loadu_ps(ey), sz = _mm256_loadu_ps(ez);
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 o = zero;
+    for(int i = 0; i < 6; ++i) {
+      const __m256 d = madd8(nx8[i], x, madd8(ny8[i], y, madd8(nz8[i], z, w8[i])));
+      const __m256 s = madd8(ax8[i], sx, madd8(ay8[i], sy, _mm256_mul_ps(az8[i], sz)));
+      o = _mm256_or_ps(o, _mm256_cmp_ps(_mm256_add_ps(d, s), zero, _CMP_LT_OQ));
+    }
+    return _mm256_movemask_ps(o);
+#else
+    int lo, hi, unused;
+    test(cx, cy, cz, ex, ey, ez, lo, unused);
+    test(cx + 4, cy + 4, cz + 4, ex + 4, ey + 4, ez + 4, hi, unused);
+    return lo | hi << 4;
+#endif
+  }
+};
+
+HaruhiBoundsTree::HaruhiBoundsTree()
+: size_(0)
+{
+  rebuild();
+}
+
+void
+HaruhiBoundsTree::setSlot(uint32_t s, const cull::Aabb& box) noexcept {
+  cx_[s] = (box.min.x + box.max.x) * .5f;
+  cy_[s] = (box.min.y + box.max.y) * .5f;
+  cz_[s] = (box.min.z + box.max.z) * .5f;
+  ex_[s] = (box.max.x - box.min.x) * .5f;
+  ey_[s] = (box.max.y - box.min.y) * .5f;
+  ez_[s] = (box.max.z - box.min.z) * .5f;
+}
+
+void
+HaruhiBoundsTree::clearSlot(uint32_t s) noexcept {
+  cx_[s] = cy_[s] = cz_[s] = 0.f;
+  ex_[s] = ey_[s] = ez_[s] = EMPTY_EXTENT;
+  slot_proxy_[s] = cull::NULL_PROXY;
+}
+
+cull::Aabb
+HaruhiBoundsTree::slotBox(uint32_t s) const noexcept {
+  return {
+    { cx_[s] - ex_[s], cy_[s] - ey_[s], cz_[s] - ez_[s] },
+    { cx_[s] + ex_[s], cy_[s] + ey_[s], cz_[s] + ez_[s] }
+  };
+}
+
+void
+HaruhiBoundsTree::setLane(uint32_t ref, const cull::Aabb* pBox) noexcept {
+  Node& n = nodes_[ref / 4];
+  const uint32_t l = ref % 4;
+  if(!pBox) {
+    n.cx[l] = n.cy[l] = n.cz[l] = 0.f;
+    n.ex[l] = n.ey[l] = n.ez[l] = EMPTY_EXTENT;
+    return;
+  }
+  n.cx[l] = (pBox->min.x + pBox->max.x) * .5f;
+  n.cy[l] = (pBox->min.y + pBox->max.y) * .5f;
+  n.cz[l] = (pBox->min.z + pBox->max.z) * .5f;
+  n.ex[l] = (pBox->max.x - pBox->min.x) * .5f;
+  n.ey[l] = (pBox->max.y - pBox->min.y) * .5f;
+  n.ez[l] = (pBox->max.z - pBox->min.z) * .5f;
+}
+
+namespace {
+
+// objects in the left part, a multiple of LEAF_SIZE so only the last leaf
+// of the tree is partly filled. halves along the widest centroid axis
+template <typename Item>
+uint32_t
+split(Item* items, uint32_t n) noexcept {
+  const uint32_t leaves = (n + cull::LEAF_SIZE - 1) / cull::LEAF_SIZE;
+  if(leaves <= 1) return n;
+
+  math::float3 lo = items[0].box.min + items[0].box.max, hi = lo;
+  for(uint32_t i = 1; i < n; ++i) {
+    const math::float3 c = items[i].box.min + items[i].box.max;
+    lo = { std::min(lo.x, c.x), std::min(lo.y, c.y), std::min(lo.z, c.z) };
+    hi = { std::max(hi.x, c.x), std::max(hi.y, c.y), std::max(hi.z, c.z) };
+  }
+  const math::float3 span = hi - lo;
+  const int axis = span.x >= span.y && span.x >= span.z ? 0 : span.y >= span.z ? 1 : 2;
+
+  const uint32_t mid = (leaves + 1) / 2 * cull::LEAF_SIZE;
+  std::nth_element(items, items + mid, items + n, [axis](const Item& a, const Item& b) {
+    const float* pa = &a.box.min.x, * pb = &b.box.min.x;
+    const float* qa = &a.box.max.x, * qb = &b.box.max.x;
+    return pa[axis] + qa[axis] < pb[axis] + qb[axis];
+  });
+  return mid;
+}
+
+} // ns
+
+uint32_t
+HaruhiBoundsTree::build(Item* items, uint32_t n, uint32_t parent, uint32_t& nextLeaf) {
+  const uint32_t node = nodes_.size();
+  nodes_.emplace_back();
+  node_parent_.push_back(parent);
+  node_dirty_.push_back(0);
+  for(uint32_t l = 0; l < 4; ++l) {
+    setLane(node * 4 + l, nullptr);
+    nodes_[node].child[l] = cull::NULL_PROXY;
+    nodes_[node].begin[l] = nodes_[node].end[l] = 0;
+  }
+
+  // up to four groups from two levels of halving
+  Item* group[4];
+  uint32_t count[4], groups = 0;
+  const uint32_t mid = split(items, n);
+  for(auto [p, m] : { std::pair(items, mid), std::pair(items + mid, n - mid) }) {
+    if(!m) continue;
+    const uint32_t q = split(p, m);
+    group[groups] = p; count[groups++] = q;
+    if(m > q) { group[groups] = p + q; count[groups++] = m - q; }
+  }
+
+  for(uint32_t l = 0; l < groups; ++l) {
+    cull::Aabb box = group[l][0].box;
+    for(uint32_t i = 1; i < count[l]; ++i) box = merge(box, group[l][i].box);
+
+    const uint32_t begin = nextLeaf * cull::LEAF_SIZE;
+    uint32_t child;
+    if(count[l] <= cull::LEAF_SIZE) {
+      const uint32_t leaf = nextLeaf++;
+      leaf_parent_[leaf] = node * 4 + l;
+      for(uint32_t i = 0; i < count[l]; ++i) {
+        const uint32_t s = begin + i;
+        setSlot(s, group[l][i].box);
+        slot_proxy_[s] = group[l][i].proxy;
+        proxy_slot_[group[l][i].proxy] = s;
+      }
+      child = leaf | LEAF_BIT;
+    } else {
+      child = build(group[l], count[l], node * 4 + l, nextLeaf);
+    }
+    setLane(node * 4 + l, &box);
+    nodes_[node].child[l] = child;
+    nodes_[node].begin[l] = begin;
+    nodes_[node].end[l] = nextLeaf * cull::LEAF_SIZE;
+  }
+  return node;
+}
+
+void
+HaruhiBoundsTree::rebuild() {
+  std::vector<Item> items;
+  items.reserve(size_);
+  for(uint32_t s = 0; s < slot_proxy_.size(); ++s)
+    if(slot_proxy_[s] != cull::NULL_PROXY)
+      items.push_back({ slotBox(s), slot_proxy_[s] });
+  for(size_t i = 0; i < pending_.size(); ++i)
+    items.push_back({ pending_boxes_[i], pending_[i] });
+  pending_.clear();
+  pending_boxes_.clear();
+
+  const uint32_t n = items.size();
+  const uint32_t leaves = (n + cull::LEAF_SIZE - 1) / cull::LEAF_SIZE;
+  const size_t slots = size_t(leaves) * cull::LEAF_SIZE;
+  for(auto* v : { &cx_, &cy_, &cz_, &ex_, &ey_, &ez_ }) v->resize(slots);
+  slot_proxy_.resize(slots);
+  for(uint32_t s = 0; s < slots; ++s) clearSlot(s);
+  leaf_parent_.assign(leaves, 0);
+  leaf_dirty_.assign(leaves, 0);
+
+  nodes_.clear();
+  node_parent_.clear();
+  node_dirty_.clear();
+  uint32_t nextLeaf = 0;
+  build(items.data(), n, cull::NULL_PROXY, nextLeaf);
+}
+
+uint32_t
+HaruhiBoundsTree::insert(const cull::Aabb& box) {
+  uint32_t proxy;
+  if(!free_.empty()) {
+    proxy = free_.back();
+    free_.pop_back();
+  } else {
+    proxy = proxy_slot_.size();
+    proxy_slot_.push_back(cull::NULL_PROXY);
+  }
+  proxy_slot_[proxy] = uint32_t(pending_.size()) | PENDING_BIT;
+  pending_.push_back(proxy);
+  pending_boxes_.push_back(box);
+  ++size_;
+  return proxy;
+}
+
+void
+HaruhiBoundsTree::update(uint32_t proxy, const cull::Aabb& box) noexcept {
+  const uint32_t s = proxy_slot_[proxy];
+  if(s & PENDING_BIT) {
+    pending_boxes_[s & ~PENDING_BIT] = box;
+    return;
+  }
+  setSlot(s, box);
+  markDirty(leaf_dirty_[s / cull::LEAF_SIZE]);
+}
+
+void
+HaruhiBoundsTree::remove(uint32_t proxy) noexcept {
+  const uint32_t s = proxy_slot_[proxy];
+  if(s & PENDING_BIT) {
+    const uint32_t i = s & ~PENDING_BIT;
+    pending_[i] = pending_.back();
+    pending_boxes_[i] = pending_boxes_.back();
+    proxy_slot_[pending_[i]] = i | PENDING_BIT;
+    pending_.pop_back();
+    pending_boxes_.pop_back();
+  } else {
+    clearSlot(s);
+    markDirty(leaf_dirty_[s / cull::LEAF_SIZE]);
+  }
+  proxy_slot_[proxy] = cull::NULL_PROXY;
+  free_.push_back(proxy);
+  --size_;
+}
+
+cull::Aabb
+HaruhiBoundsTree::bounds(uint32_t proxy) const noexcept {
+  const uint32_t s = proxy_slot_[proxy];
+  return s & PENDING_BIT ? pending_boxes_[s & ~PENDING_BIT] : slotBox(s);
+}
+
+void
+HaruhiBoundsTree::refitLeaf(uint32_t leaf) noexcept {
+  const uint32_t base = leaf * cull::LEAF_SIZE;
+  bool any = false;
+  cull::Aabb box;
+  for(uint32_t s = base; s < base + cull::LEAF_SIZE; ++s) {
+    if(slot_proxy_[s] == cull::NULL_PROXY) continue;
+    box = any ? merge(box, slotBox(s)) : slotBox(s);
+    any = true;
+  }
+  const uint32_t ref = leaf_parent_[leaf];
+  setLane(ref, any ? &box : nullptr);
+  markDirty(node_dirty_[ref / 4]);
+}
+
+void
+HaruhiBoundsTree::refitNode(uint32_t node) noexcept {
+  const Node& n = nodes_[node];
+  bool any = false;
+  cull::Aabb box;
+  for(uint32_t l = 0; l < 4; ++l) {
+    if(n.ex[l] < 0.f) continue;
+    const cull::Aabb b = {
+      { n.cx[l] - n.ex[l], n.cy[l] - n.ey[l], n.cz[l] - n.ez[l] },
+      { n.cx[l] + n.ex[l], n.cy[l] + n.ey[l], n.cz[l] + n.ez[l] }
+    };
+    box = any ? merge(box, b) : b;
+    any = true;
+  }
+  const uint32_t ref = node_parent_[node];
+  setLane(ref, any ? &box : nullptr);
+  node_dirty_[ref / 4] = 1;
+}
+
+void
+HaruhiBoundsTree::refit(HaruhiWorkerPool* pPool) {
+  if(pending_.size() >= cull::LEAF_SIZE && pending_.size() * 8 >= size_) {
+    rebuild();
+    return;
+  }
+
+  // leaves of one node write different lanes of it
+  auto run = [this](size_t b, size_t e) {
+    for(size_t leaf = b; leaf < e; ++leaf) {
+      if(!leaf_dirty_[leaf]) continue;
+      leaf_dirty_[leaf] = 0;
+      refitLeaf(leaf);
+    }
+  };
+  if(pPool) pPool->parallelFor(leaf_dirty_.size(), 1024, run);
+  else run(0, leaf_dirty_.size());
+
+  // children come after their parent
+  for(size_t node = nodes_.size(); node-- > 1;) {
+    if(!node_dirty_[node]) continue;
+    node_dirty_[node] = 0;
+    refitNode(node);
+  }
+  node_dirty_[0] = 0;
+}
+
+void
+HaruhiBoundsTree::accept(uint32_t begin, uint32_t end, std::vector<uint32_t>& out,
+                         cull::Stats& stats) const noexcept {
+  for(uint32_t s = begin; s < end; ++s)
+    if(slot_proxy_[s] != cull::NULL_PROXY) {
+      out.push_back(slot_proxy_[s]);
+      ++stats.visible;
+    }
+}
+
+void
+HaruhiBoundsTree::testLeaf(uint32_t leaf, const Walk& w, std::vector<uint32_t>& out,
+                           cull::Stats& stats) const noexcept {
+  const uint32_t base = leaf * cull::LEAF_SIZE;
+  const int outside = w.test8(&cx_[base], &cy_[base], &cz_[base], &ex_[base], &ey_[base], &ez_[base]);
+  for(uint32_t s = base; s < base + cull::LEAF_SIZE; ++s) {
+    if(slot_proxy_[s] == cull::NULL_PROXY) continue;
+    ++stats.tested;
+    if(outside >> (s - base) & 1) continue;
+    out.push_back(slot_proxy_[s]);
+    ++stats.visible;
+  }
+}
+
+void
+HaruhiBoundsTree::walk(uint32_t node, const Walk& w, std::vector<uint32_t>& out,
+                       cull::Stats& stats) const noexcept {
+  const Node& n = nodes_[node];
+  int outside, inside;
+  w.test(n.cx, n.cy, n.cz, n.ex, n.ey, n.ez, outside, inside);
+  ++stats.nodes;
+  for(uint32_t l = 0; l < 4; ++l) {
+    const uint32_t child = n.child[l];
+    if(child == cull::NULL_PROXY || outside >> l & 1) continue;
+    if(inside >> l & 1) accept(n.begin[l], n.end[l], out, stats);
+    else if(child & LEAF_BIT) testLeaf(child & ~LEAF_BIT, w, out, stats);
+    else walk(child, w, out, stats);
+  }
+}
+
+cull::Stats
+HaruhiBoundsTree::cull(const cull::Frustum& f, std::vector<uint32_t>& out,
+                       HaruhiWorkerPool* pPool) const {
+  const Walk w(f);
+  cull::Stats stats = { 0, 0, 0, 0, 0 };
+
+  if(!pPool || pPool->concurrency() == 1) {
+    walk(0, w, out, stats);
+  } else {
+    // open the top of the tree until there is enough to spread, keeping
+    // the order so the output matches the serial walk
+    enum Kind { KIND_NODE, KIND_LEAF, KIND_RANGE };
+    struct Work { Kind kind; uint32_t index, begin, end; };
+    std::vector<Work> work = { { KIND_NODE, 0, 0, 0 } }, next;
+    const size_t wanted = size_t(pPool->concurrency()) * 4;
+    bool opened = true;
+    while(opened && work.size() < wanted) {
+      opened = false;
+      next.clear();
+      for(const Work& it : work) {
+        if(it.kind != KIND_NODE) {
+          next.push_back(it);
+          continue;
+        }
+        opened = true;
+        const Node& n = nodes_[it.index];
+        int outside, inside;
+        w.test(n.cx, n.cy, n.cz, n.ex, n.ey, n.ez, outside, inside);
+        ++stats.nodes;
+        for(uint32_t l = 0; l < 4; ++l) {
+          const uint32_t child = n.child[l];
+          if(child == cull::NULL_PROXY || outside >> l & 1) continue;
+          if(inside >> l & 1) next.push_back({ KIND_RANGE, 0, n.begin[l], n.end[l] });
+          else if(child & LEAF_BIT) next.push_back({ KIND_LEAF, child & ~LEAF_BIT, 0, 0 });
+          else next.push_back({ KIND_NODE, child, 0, 0 });
+        }
+      }
+      work.swap(next);
+    }
+
+    std::vector<std::vector<uint32_t>> parts(work.size());
+    std::vector<cull::Stats> partStats(work.size(), cull::Stats{ 0, 0, 0, 0, 0 });
+    pPool->parallelFor(work.size(), 1, [&](size_t b, size_t e) {
+      for(size_t i = b; i < e; ++i) {
+        const Work& it = work[i];
+        if(it.kind == KIND_NODE) walk(it.index, w, parts[i], partStats[i]);
+        else if(it.kind == KIND_LEAF) testLeaf(it.index, w, parts[i], partStats[i]);
+        else accept(it.begin, it.end, parts[i], partStats[i]);
+      }
+    });
+
+    size_t total = out.size();
+    for(const auto& p : parts) total += p.size();
+    out.reserve(total);
+    for(size_t i = 0; i < work.size(); ++i) {
+      out.insert(out.end(), parts[i].begin(), parts[i].end());
+      stats.nodes += partStats[i].nodes;
+      stats.tested += partStats[i].tested;
+      stats.visible += partStats[i].visible;
+    }
+  }
+
+  for(size_t i = 0; i < pending_.size(); ++i) {
+    ++stats.tested;
+    if(cull::classify(f, pending_boxes_[i]) == cull::RESULT_OUTSIDE) continue;
+    out.push_back(pending_[i]);
+    ++stats.visible;
+  }
+  stats.culled = size_ - stats.visible;
+  return stats;
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#ifndef HARUHI_BOUNDSTREE_HXX
+#define HARUHI_BOUNDSTREE_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "SimdMath.hxx"
+
+class HaruhiWorkerPool;
+
+namespace cull {
+
+constexpr uint32_t NULL_PROXY = ~0u;
+
+// objects per leaf, one avx2 register or two 4-wide ones per test
+constexpr uint32_t LEAF_SIZE = 8;
+
+struct Aabb {
+  math::float3 min, max;
+};
+
+// planes (n, w) with n . p + w >= 0 inside, left right bottom top near far
+struct Frustum {
+  math::float4 planes[6];
+};
+
+// from a projection * view matrix, metal clip space (0 <= z <= w)
+Frustum makeFrustum(const math::float4x4&) noexcept;
+
+enum Result {
+  RESULT_OUTSIDE,
+  RESULT_INTERSECTING,
+  RESULT_INSIDE
+};
+
+// scalar reference for a single box
+Result classify(const Frustum&, const Aabb&) noexcept;
+
+struct Stats {
+  // 4-wide node tests and objects tested one by one in leaves
+  size_t nodes;
+  size_t tested;
+  // visible ones include those of subtrees found fully inside, untested
+  size_t visible;
+  size_t culled;
+  // in the frustum but hidden, only counted by HaruhiVisibility
+  size_t occluded;
+};
+
+} // ns cull
+
+// dynamic bvh over object bounds for visibility queries. proxies are
+// stable ids handed out by insert
+//
+// objects live in leaves of LEAF_SIZE slots stored as structure of arrays
+// (center, half extent), inner nodes hold the bounds of four children the
+// same way, so one node or one leaf is tested against a plane in a few
+// vector ops. moving objects keep their slot, refit only widens or
+// shrinks the bounds above them. inserts wait in a flat list until enough
+// pile up for a rebuild
+class HaruhiBoundsTree {
+  struct Node {
+    float cx[4], cy[4], cz[4];
+    float ex[4], ey[4], ez[4];
+    // node index, leaf index | LEAF_BIT or NULL_PROXY
+    uint32_t child[4];
+    // slot ranges [begin, end) below each child, subtrees accepted whole
+    // append theirs without testing
+    uint32_t begin[4], end[4];
+  };
+  static constexpr uint32_t LEAF_BIT = 1u << 31;
+  static constexpr uint32_t PENDING_BIT = 1u << 31;
+
+  std::vector<Node> nodes_;
+  // node * 4 + lane holding each node's (after the root) and leaf's bounds
+  std::vector<uint32_t> node_parent_, leaf_parent_;
+  std::vector<uint8_t> node_dirty_, leaf_dirty_;
+
+  // per slot, LEAF_SIZE slots per leaf. empty slots have a negative extent
+  std::vector<float> cx_, cy_, cz_, ex_, ey_, ez_;
+  std::vector<uint32_t> slot_proxy_;
+
+  // slot per proxy, or index into pending_ | PENDING_BIT
+  std::vector<uint32_t> proxy_slot_;
+  std::vector<uint32_t> free_;
+  std::vector<uint32_t> pending_;
+  std::vector<cull::Aabb> pending_boxes_;
+  size_t size_;
+
+  struct Item {
+    cull::Aabb box;
+    uint32_t proxy;
+  };
+
+  void setSlot(uint32_t, const cull::Aabb&) noexcept;
+  void clearSlot(uint32_t) noexcept;
+  cull::Aabb slotBox(uint32_t) const noexcept;
+  void setLane(uint32_t, const cull::Aabb*) noexcept;
+  uint32_t build(Item*, uint32_t, uint32_t, uint32_t&);
+  void refitLeaf(uint32_t) noexcept;
+  void refitNode(uint32_t) noexcept;
+
+  struct Walk;
+  void walk(uint32_t, const Walk&, std::vector<uint32_t>&, cull::Stats&) const noexcept;
+  void accept(uint32_t, uint32_t, std::vector<uint32_t>&, cull::Stats&) const noexcept;
+  void testLeaf(uint32_t, const Walk&, std::vector<uint32_t>&, cull::Stats&) const noexcept;
+
+public:
+  HaruhiBoundsTree();
+
+  uint32_t insert(const cull::Aabb&);
+  // safe to call concurrently for different proxies, not with anything else
+  void update(uint32_t, const cull::Aabb&) noexcept;
+  void remove(uint32_t) noexcept;
+  // as stored, off by rounding once in the tree
+  cull::Aabb bounds(uint32_t) const noexcept;
+
+  // brings the node bounds up to date after updates and removes, rebuilds
+  // instead when the pending inserts reach an eighth of the tree
+  void refit(HaruhiWorkerPool* = nullptr);
+  void rebuild();
+
+  size_t size() const noexcept { return size_; }
+  size_t pending() const noexcept { return pending_.size(); }
+
+  // appends the proxies of boxes not fully outside, tree order then
+  // pending inserts. results are the same with and without a pool
+  cull::Stats cull(const cull::Frustum&, std::vector<uint32_t>&,
+                   HaruhiWorkerPool* = nullptr) const;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "Broadphase.hxx"
+
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+inline float
+component(const math::float3& v, int axis) noexcept {
+  return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+inline bool
+overlaps(const cull::Aabb& a, const cull::Aabb& b) noexcept {
+  return a.min.x <= b.max.x && b.min.x <= a.max.x &&
+         a.min.y <= b.max.y && b.min.y <= a.max.y &&
+         a.min.z <= b.max.z && b.min.z <= a.max.z;
+}
+
+} // ns
+
+HaruhiBroadphase::HaruhiBroadphase() noexcept : axis_(0) {}
+
+size_t
+HaruhiBroadphase::update(const cull::Aabb* pBoxes, size_t n) {
+  // spread of the centers per axis. the axis only changes when another
+  // one spreads twice as much, every change is a full sort
+  double sum[3] = {}, squares[3] = {};
+  for(size_t i = 0; i < n; ++i) {
+    const math::float3 c = pBoxes[i].min + pBoxes[i].max;
+    sum[0] += c.x, sum[1] += c.y, sum[2] += c.z;
+    squares[0] += double(c.x) * c.x, squares[1] += double(c.y) * c.y, squares[2] += double(c.z) * c.z;
+  }
+  double spread[3];
+  for(int a = 0; a < 3; ++a) spread[a] = n ? squares[a] - sum[a] * sum[a] / double(n) : 0.;
+  const int widest = int(std::max_element(spread, spread + 3) - spread);
+  const bool resort = order_.size() != n || (widest != axis_ && spread[widest] > 2. * spread[axis_]);
+  if(resort) {
+    if(widest != axis_ && spread[widest] > 2. * spread[axis_]) axis_ = widest;
+    order_.resize(n);
+    std::iota(order_.begin(), order_.end(), 0u);
+    std::sort(order_.begin(), order_.end(), [&](uint32_t a, uint32_t b) {
+      return component(pBoxes[a].min, axis_) < component(pBoxes[b].min, axis_);
+    });
+  }
+  min_.resize(n);
+  max_.resize(n);
+  for(size_t i = 0; i < n; ++i) {
+    min_[i] = component(pBoxes[order_[i]].min, axis_);
+    max_[i] = component(pBoxes[order_[i]].max, axis_);
+  }
+
+  // last update's order, nearly sorted
+  for(size_t i = 1; i < n; ++i) {
+    const float lo = min_[i], hi = max_[i];
+    const uint32_t id = order_[i];
+    size_t j = i;
+    for(; j > 0 && min_[j - 1] > lo; --j) {
+      min_[j] = min_[j - 1];
+      max_[j] = max_[j - 1];
+      order_[j] = order_[j - 1];
+    }
+    min_[j] = lo;
+    max_[j] = hi;
+    order_[j] = id;
+  }
+
+  pairs_.clear();
+  for(size_t i = 0; i < n; ++i) {
+    const float end = max_[i];
+    const uint32_t a = order_[i];
+    for(size_t j = i + 1; j < n && min_[j] <= end; ++j) {
+      const uint32_t b = order_[j];
+      if(overlaps(pBoxes[a], pBoxes[b])) pairs_.push_back({ std::min(a, b), std::max(a, b) });
+    }
+  }
+  return pairs_.size();
+}
\ No newline at end of file
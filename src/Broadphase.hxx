@@ -0,0 +1,42 @@
+#ifndef HARUHI_BROADPHASE_HXX
+#define HARUHI_BROADPHASE_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "BoundsTree.hxx"
+
+namespace cull {
+
+// two overlapping boxes, a < b
+struct Pair {
+  uint32_t a, b;
+};
+
+} // ns cull
+
+// sweep and prune over the boxes of moving objects
+//
+// boxes are sorted by their min along the axis their centers spread the
+// most on, and kept in that order from one update to the next. objects
+// only move a little per frame, so an insertion sort puts them back in
+// order in close to linear time. the sweep then tests a box only against
+// those starting before it ends on that axis
+class HaruhiBroadphase {
+  // ids in sweep order, their min and max on the axis
+  std::vector<uint32_t> order_;
+  std::vector<float> min_, max_;
+  std::vector<cull::Pair> pairs_;
+  int axis_;
+
+public:
+  HaruhiBroadphase() noexcept;
+
+  // boxes by id, the same ids every update. a different count starts
+  // over. returns the number of overlapping pairs
+  size_t update(const cull::Aabb*, size_t);
+  const std::vector<cull::Pair>& pairs() const noexcept { return pairs_; }
+};
+
+#endif
\ No newline at end of file
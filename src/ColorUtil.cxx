@@ -0,0 +1,37 @@
+#include "ColorUtil.hxx"
+
+#include <cmath>
+
+namespace color {
+
+namespace {
+
+float
+toLinear(float c) noexcept {
+  return c <= .04045f ? c / 12.92f : std::pow((c + .055f) / 1.055f, 2.4f);
+}
+
+} // ns
+
+SrgbTables::SrgbTables() noexcept {
+  for(int i = 0; i < 256; ++i) {
+    decode[i] = toLinear(i / 255.f);
+    unorm[i] = i / 255.f;
+  }
+  for(int i = 0; i < 4096; ++i) {
+    const float l = (i + .5f) / 4096.f;
+    const float c = l <= .0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.f / 2.4f) - .055f;
+    encode[i] = (uint8_t)std::min(255.f, c * 255.f + .5f);
+  }
+  for(int i = 0; i < 255; ++i)
+    threshold[i] = toLinear((i + .5f) / 255.f);
+  threshold[255] = 2.f;
+}
+
+const SrgbTables&
+srgb() noexcept {
+  static const SrgbTables tables;
+  return tables;
+}
+
+} // ns color
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef HARUHI_COLORUTIL_HXX
+#define HARUHI_COLORUTIL_HXX
+
+#include <algorithm>
+#include <cstdint>
+
+namespace color {
+
+// sRGB transfer function lookups shared by the cpu texel paths
+struct SrgbTables {
+  float decode[256];
+  float unorm[256]; // i / 255, for linear channels
+  uint8_t encode[4096];
+  // linear value halfway between code i and i + 1
+  float threshold[256];
+
+  SrgbTables() noexcept;
+
+  // 12 bit table, good to about one code near black
+  uint8_t toSrgb(float l) const noexcept {
+    const int i = (int)(std::clamp(l, 0.f, 1.f) * 4095.f);
+    return encode[i];
+  }
+
+  // correctly rounded, the table guess is fixed up against the thresholds
+  uint8_t toSrgbExact(float l) const noexcept {
+    int c = toSrgb(l);
+    while(c < 255 && l >= threshold[c]) ++c;
+    while(c > 0 && l < threshold[c - 1]) --c;
+    return (uint8_t)c;
+  }
+};
+
+const SrgbTables& srgb() noexcept;
+
+} // ns color
+
+#endif
\ No newline at end of file
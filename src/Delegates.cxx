@@ -105,7 +105,8 @@ HaruhiDelegate::applicationDidFinishLaunching(NS::Notification * pNot) {
 
   HaruhiResourceLoader::loadResources(
     p_device_,
-    engine_->accessResourcePool());
+    engine_->accessResourcePool(),
+    engine_->accessWorkerPool());
 
   viewDelegate_ = new HaruhiViewDelegate(engine_, p_device_);
   p_mtkView_->setDelegate(viewDelegate_);
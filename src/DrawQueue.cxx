@@ -0,0 +1,101 @@
+#include "DrawQueue.hxx"
+
+#include <algorithm>
+#include <utility>
+
+void
+HaruhiNullDrawBackend::reset() noexcept {
+  std::fill(std::begin(counts_), std::end(counts_), 0);
+  indices_ = 0;
+  calls_.clear();
+}
+
+void
+HaruhiDrawQueue::reset(size_t lists) {
+  if(lists_.size() < lists)
+    lists_.resize(lists);
+  for(auto& it : lists_)
+    it.clear();
+  used_ = lists;
+  sorted_.clear();
+}
+
+// lsd radix over the key bytes, all eight histograms from one read. bytes
+// every key shares, the pass bits mostly, are skipped
+void
+HaruhiDrawQueue::sort() {
+  size_t n = 0;
+  for(size_t i = 0; i < used_; ++i)
+    n += lists_[i].size();
+  entries_.resize(n);
+  scratch_.resize(n);
+  sorted_.resize(n);
+  if(!n) return;
+
+  size_t hist[8][256] = {};
+  size_t k = 0;
+  for(size_t i = 0; i < used_; ++i) {
+    const cmd::DrawList& list = lists_[i];
+    for(size_t j = 0; j < list.size(); ++j) {
+      const uint64_t key = list.keys_[j];
+      entries_[k++] = { key, &list.packets_[j] };
+      for(int d = 0; d < 8; ++d)
+        ++hist[d][key >> (d * 8) & 0xff];
+    }
+  }
+
+  Entry* src = entries_.data();
+  Entry* dst = scratch_.data();
+  for(int d = 0; d < 8; ++d) {
+    const unsigned shift = d * 8;
+    if(hist[d][src[0].key >> shift & 0xff] == n) continue;
+    size_t offsets[256];
+    size_t sum = 0;
+    for(int b = 0; b < 256; ++b) {
+      offsets[b] = sum;
+      sum += hist[d][b];
+    }
+    for(size_t i = 0; i < n; ++i)
+      dst[offsets[src[i].key >> shift & 0xff]++] = src[i];
+    std::swap(src, dst);
+  }
+
+  for(size_t i = 0; i < n; ++i)
+    sorted_[i] = *src[i].packet;
+}
+
+cmd::SubmitStats
+HaruhiDrawQueue::submit(HaruhiDrawBackend& backend) const noexcept {
+  cmd::SubmitStats stats = { 0, 0, 0, 0, 0, 0 };
+  uint16_t pipeline = cmd::NONE, depthState = cmd::NONE, texture = cmd::NONE;
+  uint16_t vertices = cmd::NONE, instances = cmd::NONE;
+  uint32_t instanceOffset = 0;
+
+  for(const cmd::Packet& p : sorted_) {
+    if(p.pipeline != pipeline) {
+      backend.setPipeline(pipeline = p.pipeline);
+      ++stats.pipelines;
+    }
+    if(p.depthState != depthState) {
+      backend.setDepthState(depthState = p.depthState);
+      ++stats.depthStates;
+    }
+    if(p.texture != texture) {
+      backend.setTexture(texture = p.texture);
+      ++stats.textures;
+    }
+    if(p.vertexBuffer != vertices) {
+      backend.setVertexBuffer(vertices = p.vertexBuffer);
+      ++stats.vertexBuffers;
+    }
+    if(p.instanceBuffer != instances || p.instanceOffset != instanceOffset) {
+      instances = p.instanceBuffer;
+      instanceOffset = p.instanceOffset;
+      backend.setInstanceBuffer(instances, instanceOffset);
+      ++stats.instanceBuffers;
+    }
+    backend.drawIndexed(p.indexBuffer, p.firstIndex, p.indexCount, p.instanceCount, p.baseVertex);
+    ++stats.draws;
+  }
+  return stats;
+}
\ No newline at end of file
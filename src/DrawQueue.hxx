@@ -0,0 +1,189 @@
+#ifndef HARUHI_DRAWQUEUE_HXX
+#define HARUHI_DRAWQUEUE_HXX
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class HaruhiDrawQueue;
+
+// draw packets recorded on any thread, sorted by a 64 bit key and replayed
+// through a backend with redundant state changes dropped
+namespace cmd {
+
+// no object bound yet, ids are the backend's
+constexpr uint16_t NONE = 0xffff;
+
+// passes draw in this order whatever their other key bits, up to 16
+enum Pass : uint8_t {
+  PASS_OPAQUE,
+  PASS_TRANSPARENT,
+  PASS_OVERLAY
+};
+
+// one indexed draw and everything it binds. indices are 16 bit, the
+// instance buffer goes to the vertex stage next to the vertices
+struct Packet {
+  uint16_t pipeline;
+  uint16_t depthState;
+  uint16_t texture;
+  uint16_t vertexBuffer;
+  uint16_t indexBuffer;
+  uint16_t instanceBuffer;
+  uint32_t instanceOffset; // bytes
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t instanceCount;
+  int32_t baseVertex;
+};
+
+// non negative floats order like their bits
+inline uint32_t
+depthBits(float depth) noexcept {
+  uint32_t bits;
+  depth = depth > 0.f ? depth : 0.f;
+  memcpy(&bits, &depth, sizeof(bits));
+  return bits;
+}
+
+// pass:4 pipeline:12 material:16 depth:32, fewest state changes first,
+// then front to back
+inline uint64_t
+makeKey(unsigned pass, unsigned pipeline, unsigned material, float depth) noexcept {
+  return uint64_t(pass & 0xf) << 60 | uint64_t(pipeline & 0xfff) << 48
+         | uint64_t(material & 0xffff) << 32 | depthBits(depth);
+}
+
+// pass:4 depth:32 pipeline:12 material:16, back to front for blending
+inline uint64_t
+makeBackToFrontKey(unsigned pass, unsigned pipeline, unsigned material, float depth) noexcept {
+  return uint64_t(pass & 0xf) << 60 | uint64_t(~depthBits(depth)) << 28
+         | uint64_t(pipeline & 0xfff) << 16 | (material & 0xffff);
+}
+
+// recorded by one thread at a time
+class DrawList {
+  friend class ::HaruhiDrawQueue;
+  std::vector<uint64_t> keys_;
+  std::vector<Packet> packets_;
+
+public:
+  void add(uint64_t key, const Packet& p) {
+    keys_.push_back(key);
+    packets_.push_back(p);
+  }
+  size_t size() const noexcept { return keys_.size(); }
+  void clear() noexcept { keys_.clear(); packets_.clear(); }
+};
+
+// calls made by the last submit
+struct SubmitStats {
+  size_t draws;
+  size_t pipelines, depthStates, textures, vertexBuffers, instanceBuffers;
+};
+
+} // ns cmd
+
+// what a graphics api needs to do for the packets, only called for state
+// that actually changes
+class HaruhiDrawBackend {
+public:
+  virtual ~HaruhiDrawBackend() = default;
+
+  virtual void setPipeline(uint16_t) noexcept = 0;
+  virtual void setDepthState(uint16_t) noexcept = 0;
+  virtual void setTexture(uint16_t) noexcept = 0;
+  virtual void setVertexBuffer(uint16_t) noexcept = 0;
+  // buffer, byte offset
+  virtual void setInstanceBuffer(uint16_t, uint32_t) noexcept = 0;
+  // index buffer, first index, index count, instance count, base vertex
+  virtual void drawIndexed(uint16_t, uint32_t, uint32_t, uint32_t, int32_t) noexcept = 0;
+};
+
+// counts the calls and optionally keeps them, for tests and for
+// measuring the cpu side without a gpu
+class HaruhiNullDrawBackend : public HaruhiDrawBackend {
+public:
+  enum Op : uint8_t {
+    OP_PIPELINE,
+    OP_DEPTH_STATE,
+    OP_TEXTURE,
+    OP_VERTEX_BUFFER,
+    OP_INSTANCE_BUFFER,
+    OP_DRAW,
+    OP_COUNT
+  };
+
+  // id is the index buffer for draws, args as passed
+  struct Call {
+    Op op;
+    uint16_t id;
+    uint32_t args[4];
+  };
+
+private:
+  bool record_;
+  size_t counts_[OP_COUNT];
+  uint64_t indices_;
+  std::vector<Call> calls_;
+
+  void add(Op op, uint16_t id, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0) {
+    ++counts_[op];
+    if(record_) calls_.push_back({ op, id, { a, b, c, d } });
+  }
+
+public:
+  explicit HaruhiNullDrawBackend(bool record = false) : record_(record) { reset(); }
+
+  void setPipeline(uint16_t id) noexcept override { add(OP_PIPELINE, id); }
+  void setDepthState(uint16_t id) noexcept override { add(OP_DEPTH_STATE, id); }
+  void setTexture(uint16_t id) noexcept override { add(OP_TEXTURE, id); }
+  void setVertexBuffer(uint16_t id) noexcept override { add(OP_VERTEX_BUFFER, id); }
+  void setInstanceBuffer(uint16_t id, uint32_t offset) noexcept override {
+    add(OP_INSTANCE_BUFFER, id, offset);
+  }
+  void drawIndexed(uint16_t id, uint32_t first, uint32_t count, uint32_t instances,
+                   int32_t baseVertex) noexcept override {
+    indices_ += uint64_t(count) * instances;
+    add(OP_DRAW, id, first, count, instances, uint32_t(baseVertex));
+  }
+
+  size_t count(Op op) const noexcept { return counts_[op]; }
+  // indices drawn over all instances
+  uint64_t indices() const noexcept { return indices_; }
+  const std::vector<Call>& calls() const noexcept { return calls_; }
+  void reset() noexcept;
+};
+
+// per frame packet lists merged into one sorted stream
+//
+// reset picks the number of lists, then every list can be recorded by its
+// own thread. sort merges them with a stable radix sort on the keys, ties
+// keep list order and recording order, so the stream only depends on
+// which list got what. submit replays it, binding only what changed
+class HaruhiDrawQueue {
+  struct Entry {
+    uint64_t key;
+    const cmd::Packet* packet;
+  };
+
+  std::vector<cmd::DrawList> lists_;
+  size_t used_;
+  std::vector<Entry> entries_, scratch_;
+  std::vector<cmd::Packet> sorted_;
+
+public:
+  HaruhiDrawQueue() : used_(0) {}
+
+  // clears everything recorded, keeping the memory
+  void reset(size_t);
+  size_t lists() const noexcept { return used_; }
+  cmd::DrawList& list(size_t i) noexcept { return lists_[i]; }
+
+  void sort();
+  // valid after sort
+  const std::vector<cmd::Packet>& sorted() const noexcept { return sorted_; }
+  cmd::SubmitStats submit(HaruhiDrawBackend&) const noexcept;
+};
+
+#endif
\ No newline at end of file
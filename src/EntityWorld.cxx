@@ -0,0 +1,395 @@
+#include "EntityWorld.hxx"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+ecs::ComponentInfo g_components[ecs::MAX_COMPONENTS];
+std::atomic<ecs::ComponentId> g_component_count(0);
+
+constexpr size_t COLUMN_ALIGN = 64;
+
+size_t
+alignUp(size_t v, size_t a) noexcept {
+  return (v + a - 1) / a * a;
+}
+
+} // ns
+
+namespace ecs {
+
+ComponentId
+registerComponent(size_t size, size_t align) noexcept {
+  const ComponentId id = g_component_count.fetch_add(1, std::memory_order_relaxed);
+  if(id >= MAX_COMPONENTS) {
+    printf("more than %u component types\n", MAX_COMPONENTS);
+    abort();
+  }
+  if(align > COLUMN_ALIGN) {
+    printf("component alignment %zu over %zu\n", align, COLUMN_ALIGN);
+    abort();
+  }
+  g_components[id] = { size, align };
+  return id;
+}
+
+const ComponentInfo&
+componentInfo(ComponentId id) noexcept {
+  assert(id < g_component_count.load(std::memory_order_relaxed));
+  return g_components[id];
+}
+
+} // ns ecs
+
+void
+HaruhiEntityCommands::push(Kind kind, ecs::Entity e, ecs::ComponentId id,
+                           const void* pData, size_t size) {
+  const size_t at = payload_.size();
+  if(size) {
+    payload_.resize(at + size);
+    memcpy(payload_.data() + at, pData, size);
+  }
+  ops_.push_back({ kind, id, e, at });
+}
+
+void
+HaruhiEntityCommands::destroy(ecs::Entity e) {
+  std::lock_guard<std::mutex> lk(mtx_);
+  push(KIND_DESTROY, e, 0, nullptr, 0);
+}
+
+void
+HaruhiEntityCommands::clear() noexcept {
+  ops_.clear();
+  payload_.clear();
+}
+
+HaruhiEntityWorld::HaruhiEntityWorld()
+: size_(0), version_(0), structure_(0), iterating_(0)
+{
+  ;
+}
+
+HaruhiEntityWorld::~HaruhiEntityWorld() {
+  for(Archetype* a : archetypes_)
+    for(Chunk* c : a->chunks) {
+      free(c->data);
+      delete c;
+    }
+}
+
+// columns in id order, each starting on a cache line, as many rows as fit
+HaruhiEntityWorld::Archetype*
+HaruhiEntityWorld::archetypeFor(ecs::Mask mask) {
+  auto& slot = by_mask_[mask];
+  if(slot) return slot.get();
+
+  auto a = std::make_unique<Archetype>();
+  a->mask = mask;
+  a->count = 0;
+  std::fill(std::begin(a->with), std::end(a->with), nullptr);
+  std::fill(std::begin(a->without), std::end(a->without), nullptr);
+
+  size_t row = sizeof(ecs::Entity);
+  a->sizes.push_back(sizeof(ecs::Entity));
+  for(ecs::Mask m = mask; m; m &= m - 1) {
+    const ecs::ComponentId id = __builtin_ctzll(m);
+    a->ids.push_back(id);
+    a->sizes.push_back(ecs::componentInfo(id).size);
+    row += ecs::componentInfo(id).size;
+  }
+
+  auto layout = [&](size_t n) {
+    size_t off = 0;
+    a->offsets.clear();
+    for(uint32_t size : a->sizes) {
+      off = alignUp(off, COLUMN_ALIGN);
+      a->offsets.push_back(off);
+      off += n * size;
+    }
+    return off;
+  };
+  size_t n = ecs::CHUNK_BYTES / row;
+  while(n > 1 && layout(n) > ecs::CHUNK_BYTES) --n;
+  if(layout(n) > ecs::CHUNK_BYTES) {
+    printf("archetype row of %zu bytes does not fit a chunk\n", row);
+    abort();
+  }
+  a->capacity = n;
+
+  slot = std::move(a);
+  archetypes_.push_back(slot.get());
+  return slot.get();
+}
+
+HaruhiEntityWorld::Archetype*
+HaruhiEntityWorld::neighbour(Archetype* a, ecs::ComponentId id, bool add) {
+  Archetype*& edge = add ? a->with[id] : a->without[id];
+  if(!edge) {
+    const ecs::Mask bit = ecs::Mask(1) << id;
+    edge = archetypeFor(add ? a->mask | bit : a->mask & ~bit);
+  }
+  return edge;
+}
+
+HaruhiEntityWorld::Chunk*
+HaruhiEntityWorld::newChunk(const Archetype& a) {
+  Chunk* c = new Chunk;
+  c->data = static_cast<uint8_t*>(aligned_alloc(COLUMN_ALIGN, ecs::CHUNK_BYTES));
+  if(!c->data) {
+    printf("out of memory for a chunk\n");
+    abort();
+  }
+  c->count = 0;
+  c->versions.assign(a.ids.size(), 0);
+  return c;
+}
+
+void
+HaruhiEntityWorld::place(ecs::Entity e, Archetype* a) {
+  if(a->chunks.empty() || a->chunks.back()->count == a->capacity)
+    a->chunks.push_back(newChunk(*a));
+  Chunk* c = a->chunks.back();
+  const uint32_t row = c->count++;
+  ++a->count;
+  memcpy(c->data + row * sizeof(ecs::Entity), &e, sizeof(e));
+  // rows moving around count as writes
+  std::fill(c->versions.begin(), c->versions.end(), version_.fetch_add(1, std::memory_order_relaxed) + 1);
+
+  Record& r = records_[e.index];
+  r.archetype = a;
+  r.chunk = a->chunks.size() - 1;
+  r.row = row;
+}
+
+// swap removes the row with the archetype's last one, chunks stay dense
+void
+HaruhiEntityWorld::unplace(Archetype* a, uint32_t chunk, uint32_t row) noexcept {
+  Chunk* last = a->chunks.back();
+  const uint32_t last_row = last->count - 1;
+  Chunk* c = a->chunks[chunk];
+
+  if(c != last || row != last_row) {
+    for(size_t k = 0; k < a->sizes.size(); ++k) {
+      const size_t size = a->sizes[k];
+      memcpy(c->data + a->offsets[k] + row * size,
+             last->data + a->offsets[k] + last_row * size, size);
+    }
+    ecs::Entity moved;
+    memcpy(&moved, c->data + row * sizeof(ecs::Entity), sizeof(moved));
+    records_[moved.index].chunk = chunk;
+    records_[moved.index].row = row;
+    std::fill(c->versions.begin(), c->versions.end(), version_.fetch_add(1, std::memory_order_relaxed) + 1);
+  }
+
+  --last->count;
+  --a->count;
+  if(!last->count) {
+    free(last->data);
+    delete last;
+    a->chunks.pop_back();
+  }
+}
+
+// the entity's columns both archetypes have are carried over
+void
+HaruhiEntityWorld::migrate(ecs::Entity e, Archetype* to) {
+  const Record from = records_[e.index];
+  Archetype* a = from.archetype;
+  place(e, to);
+  const Record& now = records_[e.index];
+
+  const Chunk* src = a->chunks[from.chunk];
+  Chunk* dst = to->chunks[now.chunk];
+  for(ecs::Mask m = a->mask & to->mask; m; m &= m - 1) {
+    const ecs::ComponentId id = __builtin_ctzll(m);
+    const size_t size = ecs::componentInfo(id).size;
+    memcpy(column(*to, *dst, slotOf(*to, id)) + now.row * size,
+           column(*a, *src, slotOf(*a, id)) + from.row * size, size);
+  }
+  unplace(a, from.chunk, from.row);
+}
+
+ecs::Entity
+HaruhiEntityWorld::createRaw(const ecs::ComponentId* ids, const void* const* data, size_t n) {
+  assert(!iterating_.load(std::memory_order_relaxed));
+  ecs::Mask mask = 0;
+  for(size_t i = 0; i < n; ++i)
+    mask |= ecs::Mask(1) << ids[i];
+  assert(size_t(__builtin_popcountll(mask)) == n && "component given twice");
+
+  ecs::Entity e;
+  if(!free_.empty()) {
+    e.index = free_.back();
+    free_.pop_back();
+  } else {
+    e.index = records_.size();
+    records_.push_back({ nullptr, 0, 0, 0 });
+  }
+  e.generation = records_[e.index].generation;
+
+  Archetype* a = archetypeFor(mask);
+  place(e, a);
+  const Record& r = records_[e.index];
+  Chunk* c = a->chunks[r.chunk];
+  for(size_t i = 0; i < n; ++i) {
+    const size_t size = ecs::componentInfo(ids[i]).size;
+    memcpy(column(*a, *c, slotOf(*a, ids[i])) + r.row * size, data[i], size);
+  }
+  ++size_;
+  ++structure_;
+  return e;
+}
+
+void
+HaruhiEntityWorld::destroy(ecs::Entity e) noexcept {
+  assert(!iterating_.load(std::memory_order_relaxed));
+  if(!alive(e)) return;
+  Record& r = records_[e.index];
+  unplace(r.archetype, r.chunk, r.row);
+  r.archetype = nullptr;
+  ++r.generation;
+  free_.push_back(e.index);
+  --size_;
+  ++structure_;
+}
+
+bool
+HaruhiEntityWorld::alive(ecs::Entity e) const noexcept {
+  return e.index < records_.size() && records_[e.index].archetype &&
+         records_[e.index].generation == e.generation;
+}
+
+void*
+HaruhiEntityWorld::pointer(ecs::Entity e, ecs::ComponentId id, bool write) noexcept {
+  if(!alive(e)) return nullptr;
+  const Record& r = records_[e.index];
+  const Archetype& a = *r.archetype;
+  if(!(a.mask & (ecs::Mask(1) << id))) return nullptr;
+
+  Chunk& c = *a.chunks[r.chunk];
+  const uint32_t slot = slotOf(a, id);
+  if(write)
+    c.versions[slot] = version_.fetch_add(1, std::memory_order_relaxed) + 1;
+  return column(a, c, slot) + r.row * a.sizes[slot + 1];
+}
+
+void
+HaruhiEntityWorld::addRaw(ecs::Entity e, ecs::ComponentId id, const void* pData) {
+  assert(!iterating_.load(std::memory_order_relaxed));
+  if(!alive(e)) return;
+  Archetype* a = records_[e.index].archetype;
+  if(!(a->mask & (ecs::Mask(1) << id))) {
+    migrate(e, neighbour(a, id, true));
+    ++structure_;
+  }
+  memcpy(pointer(e, id, true), pData, ecs::componentInfo(id).size);
+}
+
+void
+HaruhiEntityWorld::removeRaw(ecs::Entity e, ecs::ComponentId id) {
+  assert(!iterating_.load(std::memory_order_relaxed));
+  if(!alive(e)) return;
+  Archetype* a = records_[e.index].archetype;
+  if(!(a->mask & (ecs::Mask(1) << id))) return;
+  migrate(e, neighbour(a, id, false));
+  ++structure_;
+}
+
+void
+HaruhiEntityWorld::matching(ecs::Mask mask, std::vector<ChunkRef>& refs) const {
+  size_t first = 0;
+  for(Archetype* a : archetypes_) {
+    if((a->mask & mask) != mask) continue;
+    for(Chunk* c : a->chunks) {
+      refs.push_back({ a, c, first });
+      first += c->count;
+    }
+  }
+}
+
+void
+HaruhiEntityWorld::apply(HaruhiEntityCommands& cmds) {
+  using Commands = HaruhiEntityCommands;
+  std::vector<ecs::ComponentId> ids;
+  std::vector<const void*> data;
+
+  const auto& ops = cmds.ops_;
+  for(size_t i = 0; i < ops.size(); ++i) {
+    const Commands::Op& op = ops[i];
+    const void* payload = cmds.payload_.data() + op.payload;
+    switch(op.kind) {
+    case Commands::KIND_CREATE:
+      ids.clear();
+      data.clear();
+      for(; i + 1 < ops.size() && ops[i + 1].kind == Commands::KIND_ADD && !ops[i + 1].entity; ++i) {
+        ids.push_back(ops[i + 1].component);
+        data.push_back(cmds.payload_.data() + ops[i + 1].payload);
+      }
+      createRaw(ids.data(), data.data(), ids.size());
+      break;
+    case Commands::KIND_DESTROY:
+      destroy(op.entity);
+      break;
+    case Commands::KIND_ADD:
+      addRaw(op.entity, op.component, payload);
+      break;
+    case Commands::KIND_REMOVE:
+      removeRaw(op.entity, op.component);
+      break;
+    }
+  }
+  cmds.clear();
+}
+
+HaruhiSystemSchedule::HaruhiSystemSchedule()
+: p_world_(nullptr), built_(false)
+{
+  ;
+}
+
+HaruhiSystemSchedule::System
+HaruhiSystemSchedule::add(const char* name, ecs::Mask reads, ecs::Mask writes,
+                          SystemFn fn, bool mainThread) {
+  systems_.push_back({ name, reads | writes, writes, std::move(fn), mainThread,
+                       std::make_unique<HaruhiEntityCommands>() });
+  built_ = false;
+  return System(systems_.size() - 1);
+}
+
+void
+HaruhiSystemSchedule::after(System before, System s) {
+  assert(before < systems_.size() && s < systems_.size());
+  extra_.push_back({ before, s });
+  built_ = false;
+}
+
+void
+HaruhiSystemSchedule::build() {
+  graph_.clear();
+  for(System s = 0; s < systems_.size(); ++s) {
+    const Entry& e = systems_[s];
+    graph_.add(e.name, [this, s] {
+      systems_[s].fn(*p_world_, *systems_[s].commands);
+    }, e.main_thread);
+    for(System p = 0; p < s; ++p) {
+      const Entry& o = systems_[p];
+      if((o.writes & e.reads) || (e.writes & o.reads))
+        graph_.precede(p, s);
+    }
+  }
+  for(const auto& it : extra_)
+    graph_.precede(it.first, it.second);
+  built_ = true;
+}
+
+void
+HaruhiSystemSchedule::run(HaruhiEntityWorld& world, HaruhiWorkerPool& pool) {
+  if(!built_) build();
+  p_world_ = &world;
+  graph_.run(pool);
+  for(auto& it : systems_)
+    world.apply(*it.commands);
+}
\ No newline at end of file
@@ -0,0 +1,375 @@
+#ifndef HARUHI_ENTITYWORLD_HXX
+#define HARUHI_ENTITYWORLD_HXX
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "WorkerPool.hxx"
+
+// archetype entity component storage
+//
+// entities with the same set of components share an archetype, whose
+// entities live in 16 KiB chunks with one 64 byte aligned array per
+// component (and one of entity ids). queries walk the chunks of every
+// matching archetype and hand the arrays to the callback, so the inner
+// loops run over plain restrict pointers. components are trivially
+// copyable, moving between archetypes is a memcpy per column
+namespace ecs {
+
+constexpr size_t CHUNK_BYTES = 16 << 10;
+constexpr unsigned MAX_COMPONENTS = 64;
+
+using ComponentId = uint32_t;
+using Mask = uint64_t;
+
+struct Entity {
+  uint32_t index;
+  uint32_t generation;
+
+  explicit operator bool() const noexcept { return index != ~0u; }
+  bool operator==(const Entity&) const noexcept = default;
+};
+
+constexpr Entity NULL_ENTITY = { ~0u, 0 };
+
+struct ComponentInfo {
+  size_t size;
+  size_t align;
+};
+
+// ids are handed out on first use, at most MAX_COMPONENTS types
+ComponentId registerComponent(size_t, size_t) noexcept;
+const ComponentInfo& componentInfo(ComponentId) noexcept;
+
+template <typename T>
+struct ComponentType {
+  static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>,
+                "components are moved with memcpy");
+  static ComponentId id() noexcept {
+    static const ComponentId id = registerComponent(sizeof(T), alignof(T));
+    return id;
+  }
+};
+
+// const T is the same component, only read
+template <typename T>
+inline ComponentId
+componentId() noexcept {
+  return ComponentType<std::remove_const_t<T>>::id();
+}
+
+template <typename... Cs>
+inline Mask
+maskOf() noexcept {
+  return (Mask(0) | ... | (Mask(1) << componentId<Cs>()));
+}
+
+// what a chunk query sees besides the component arrays
+struct ChunkInfo {
+  const Entity* entities;
+  size_t count;
+  // position of entities[0] in the query's order
+  size_t first;
+  // newest write to any of the queried columns, see HaruhiEntityWorld::version
+  uint64_t version;
+};
+
+} // ns ecs
+
+class HaruhiEntityWorld;
+
+// structural changes recorded while a world is iterated, applied in order
+// by HaruhiEntityWorld::apply. recording is thread safe
+class HaruhiEntityCommands {
+  friend class HaruhiEntityWorld;
+
+  enum Kind : uint32_t {
+    KIND_CREATE, // the adds following it go to the new entity
+    KIND_DESTROY,
+    KIND_ADD,
+    KIND_REMOVE,
+  };
+
+  struct Op {
+    Kind kind;
+    ecs::ComponentId component;
+    ecs::Entity entity;
+    size_t payload; // offset of the component bytes for adds
+  };
+
+  std::mutex mtx_;
+  std::vector<Op> ops_;
+  std::vector<uint8_t> payload_;
+
+  void push(Kind, ecs::Entity, ecs::ComponentId, const void*, size_t);
+
+public:
+  template <typename... Cs>
+  void create(const Cs&... cs) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    push(KIND_CREATE, ecs::NULL_ENTITY, 0, nullptr, 0);
+    (push(KIND_ADD, ecs::NULL_ENTITY, ecs::componentId<Cs>(), &cs, sizeof(Cs)), ...);
+  }
+
+  void destroy(ecs::Entity);
+
+  template <typename T>
+  void add(ecs::Entity e, const T& v) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    push(KIND_ADD, e, ecs::componentId<T>(), &v, sizeof(T));
+  }
+
+  template <typename T>
+  void remove(ecs::Entity e) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    push(KIND_REMOVE, e, ecs::componentId<T>(), nullptr, 0);
+  }
+
+  bool empty() const noexcept { return ops_.empty(); }
+  void clear() noexcept;
+};
+
+class HaruhiEntityWorld {
+  struct Chunk {
+    uint8_t* data;
+    uint32_t count;
+    // per column, the world version of the last write through a query
+    std::vector<uint64_t> versions;
+  };
+
+  struct Archetype {
+    ecs::Mask mask;
+    std::vector<ecs::ComponentId> ids; // ascending, column i holds ids[i]
+    std::vector<uint32_t> offsets, sizes; // the entity column is at 0
+    uint32_t capacity;
+    std::vector<Chunk*> chunks;
+    size_t count;
+    // archetype with the component added/removed, filled lazily
+    Archetype* with[ecs::MAX_COMPONENTS];
+    Archetype* without[ecs::MAX_COMPONENTS];
+  };
+
+  struct Record {
+    Archetype* archetype; // null when the slot is free
+    uint32_t chunk, row;
+    uint32_t generation;
+  };
+
+  std::unordered_map<ecs::Mask, std::unique_ptr<Archetype>> by_mask_;
+  std::vector<Archetype*> archetypes_; // creation order, queries walk it
+  std::vector<Record> records_;
+  std::vector<uint32_t> free_;
+  size_t size_;
+  std::atomic<uint64_t> version_;
+  uint64_t structure_;
+  std::atomic<int> iterating_;
+
+  Archetype* archetypeFor(ecs::Mask);
+  Archetype* neighbour(Archetype*, ecs::ComponentId, bool);
+  Chunk* newChunk(const Archetype&);
+  // appends e to the archetype, the row is uninitialized
+  void place(ecs::Entity, Archetype*);
+  void unplace(Archetype*, uint32_t, uint32_t) noexcept;
+  void migrate(ecs::Entity, Archetype*);
+
+  static uint32_t slotOf(const Archetype& a, ecs::ComponentId id) noexcept {
+    const ecs::Mask below = (ecs::Mask(1) << id) - 1;
+    return __builtin_popcountll(a.mask & below);
+  }
+  static uint8_t* column(const Archetype& a, const Chunk& c, uint32_t slot) noexcept {
+    return c.data + a.offsets[slot + 1];
+  }
+
+  ecs::Entity createRaw(const ecs::ComponentId*, const void* const*, size_t);
+  void* pointer(ecs::Entity, ecs::ComponentId, bool) noexcept;
+  void addRaw(ecs::Entity, ecs::ComponentId, const void*);
+  void removeRaw(ecs::Entity, ecs::ComponentId);
+
+  template <typename T>
+  static T* columnOf(const Archetype& a, Chunk& c, uint64_t stamp) noexcept {
+    const uint32_t slot = slotOf(a, ecs::componentId<T>());
+    if constexpr(!std::is_const_v<T>)
+      c.versions[slot] = stamp;
+    return reinterpret_cast<T*>(column(a, c, slot));
+  }
+
+  template <typename... Cs>
+  static uint64_t versionOf(const Archetype& a, const Chunk& c) noexcept {
+    uint64_t v = 0;
+    ((v = std::max(v, c.versions[slotOf(a, ecs::componentId<Cs>())])), ...);
+    return v;
+  }
+
+  struct ChunkRef {
+    Archetype* archetype;
+    Chunk* chunk;
+    size_t first;
+  };
+  void matching(ecs::Mask, std::vector<ChunkRef>&) const;
+
+  // structural changes while a query runs would move rows under it
+  struct Iterating {
+    std::atomic<int>& n;
+    explicit Iterating(std::atomic<int>& c) : n(c) { n.fetch_add(1, std::memory_order_relaxed); }
+    ~Iterating() { n.fetch_sub(1, std::memory_order_relaxed); }
+  };
+
+public:
+  HaruhiEntityWorld();
+  ~HaruhiEntityWorld();
+  HaruhiEntityWorld(const HaruhiEntityWorld&) = delete;
+  HaruhiEntityWorld& operator=(const HaruhiEntityWorld&) = delete;
+
+  template <typename... Cs>
+  ecs::Entity create(const Cs&... cs) {
+    const ecs::ComponentId ids[] = { ecs::componentId<Cs>()..., 0 };
+    const void* data[] = { static_cast<const void*>(&cs)..., nullptr };
+    return createRaw(ids, data, sizeof...(Cs));
+  }
+  void destroy(ecs::Entity) noexcept;
+  bool alive(ecs::Entity) const noexcept;
+
+  // replaces the component when the entity already has it
+  template <typename T>
+  void add(ecs::Entity e, const T& v) { addRaw(e, ecs::componentId<T>(), &v); }
+  template <typename T>
+  void remove(ecs::Entity e) { removeRaw(e, ecs::componentId<T>()); }
+
+  template <typename T>
+  bool has(ecs::Entity e) const noexcept {
+    if(!alive(e)) return false;
+    return records_[e.index].archetype->mask & (ecs::Mask(1) << ecs::componentId<T>());
+  }
+  // null when the entity lacks it, a mutable pointer counts as a write
+  template <typename T>
+  T* get(ecs::Entity e) noexcept {
+    return static_cast<T*>(pointer(e, ecs::componentId<T>(), !std::is_const_v<T>));
+  }
+
+  size_t size() const noexcept { return size_; }
+  size_t archetypeCount() const noexcept { return archetypes_.size(); }
+
+  // bumped by every query or get that hands out mutable columns
+  uint64_t version() const noexcept { return version_.load(std::memory_order_relaxed); }
+  // bumped by every create, destroy, add and remove, query order is
+  // stable while it stays the same
+  uint64_t structure() const noexcept { return structure_; }
+
+  // fn(size_t n, Cs*... columns) once per chunk holding all of Cs.
+  // const components are read only, the others mark their column written
+  template <typename... Cs, typename Fn>
+  void each(Fn&& fn) {
+    eachChunk<Cs...>([&](const ecs::ChunkInfo& c, Cs*... cols) { fn(c.count, cols...); });
+  }
+  template <typename... Cs, typename Fn>
+  void each(HaruhiWorkerPool* pPool, Fn&& fn) {
+    eachChunk<Cs...>(pPool, [&](const ecs::ChunkInfo& c, Cs*... cols) { fn(c.count, cols...); });
+  }
+
+  // fn(const ecs::ChunkInfo&, Cs*... columns)
+  template <typename... Cs, typename Fn>
+  void eachChunk(Fn&& fn) {
+    Iterating guard(iterating_);
+    const ecs::Mask mask = ecs::maskOf<Cs...>();
+    const uint64_t stamp = version_.fetch_add(1, std::memory_order_relaxed) + 1;
+    size_t first = 0;
+    for(Archetype* a : archetypes_) {
+      if((a->mask & mask) != mask) continue;
+      for(Chunk* c : a->chunks) {
+        const ecs::ChunkInfo info = {
+          reinterpret_cast<const ecs::Entity*>(c->data), c->count, first, versionOf<Cs...>(*a, *c)
+        };
+        fn(info, columnOf<Cs>(*a, *c, stamp)...);
+        first += c->count;
+      }
+    }
+  }
+
+  // chunks spread over the pool, fn must be safe to call concurrently
+  template <typename... Cs, typename Fn>
+  void eachChunk(HaruhiWorkerPool* pPool, Fn&& fn) {
+    if(!pPool || pPool->concurrency() == 1) {
+      eachChunk<Cs...>(std::forward<Fn>(fn));
+      return;
+    }
+    Iterating guard(iterating_);
+    std::vector<ChunkRef> refs;
+    matching(ecs::maskOf<Cs...>(), refs);
+    const uint64_t stamp = version_.fetch_add(1, std::memory_order_relaxed) + 1;
+    pPool->parallelFor(refs.size(), 1, [&](size_t b, size_t e) {
+      for(size_t i = b; i < e; ++i) {
+        Archetype& a = *refs[i].archetype;
+        Chunk& c = *refs[i].chunk;
+        const ecs::ChunkInfo info = {
+          reinterpret_cast<const ecs::Entity*>(c.data), c.count, refs[i].first, versionOf<Cs...>(a, c)
+        };
+        fn(info, columnOf<Cs>(a, c, stamp)...);
+      }
+    });
+  }
+
+  // entities holding all of Cs
+  template <typename... Cs>
+  size_t count() const noexcept {
+    const ecs::Mask mask = ecs::maskOf<Cs...>();
+    size_t n = 0;
+    for(const Archetype* a : archetypes_)
+      if((a->mask & mask) == mask) n += a->count;
+    return n;
+  }
+
+  // runs the recorded changes in order and clears the buffer. changes to
+  // entities that died in the meantime are dropped
+  void apply(HaruhiEntityCommands&);
+};
+
+// systems run as a task graph, a system waits for every earlier one it
+// conflicts with (one writes a component the other reads or writes).
+// each system records structural changes into its own command buffer,
+// applied in registration order once all systems are done
+class HaruhiSystemSchedule {
+public:
+  using SystemFn = std::function<void(HaruhiEntityWorld&, HaruhiEntityCommands&)>;
+  using System = uint32_t;
+
+private:
+  struct Entry {
+    const char* name;
+    ecs::Mask reads, writes;
+    SystemFn fn;
+    bool main_thread;
+    std::unique_ptr<HaruhiEntityCommands> commands;
+  };
+
+  std::vector<Entry> systems_;
+  std::vector<std::pair<System, System>> extra_;
+  HaruhiTaskGraph graph_;
+  HaruhiEntityWorld* p_world_;
+  bool built_;
+
+  void build();
+
+public:
+  HaruhiSystemSchedule();
+
+  // writes imply reads
+  System add(const char*, ecs::Mask, ecs::Mask, SystemFn, bool = false);
+  // extra ordering the component masks don't show
+  void after(System, System);
+
+  size_t size() const noexcept { return systems_.size(); }
+  const char* name(System s) const noexcept { return systems_[s].name; }
+
+  void run(HaruhiEntityWorld&, HaruhiWorkerPool&);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include "FrameAllocator.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+void
+HaruhiFrameFence::signal(uint64_t frame) noexcept {
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if(frame > completed_.load(std::memory_order_relaxed))
+      completed_.store(frame, std::memory_order_release);
+  }
+  cv_.notify_all();
+}
+
+void
+HaruhiFrameFence::wait(uint64_t frame) noexcept {
+  if(completed() >= frame) return;
+  std::unique_lock<std::mutex> lk(mtx_);
+  cv_.wait(lk, [&] { return completed() >= frame; });
+}
+
+HaruhiFrameAllocator::HaruhiFrameAllocator(HaruhiUploadBackend& backend, HaruhiFrameFence& fence,
+                                           unsigned framesInFlight, size_t ringSize, size_t pageSize)
+: backend_(backend), fence_(fence), frames_(framesInFlight), page_size_(pageSize), frame_(0),
+  p_current_(&frames_[0])
+{
+  assert(framesInFlight && ringSize && pageSize);
+  for(auto& f : frames_) {
+    if(!backend_.allocate(ringSize, f.ring)) {
+      printf("upload ring of %zu bytes failed\n", ringSize);
+      abort();
+    }
+    f.used.store(0, std::memory_order_relaxed);
+  }
+}
+
+// the gpu must be done with every frame by now
+HaruhiFrameAllocator::~HaruhiFrameAllocator() {
+  for(auto& f : frames_) {
+    backend_.free(f.ring);
+    for(auto& o : f.overflow)
+      backend_.free(o.page);
+  }
+  for(auto& p : spare_)
+    backend_.free(p);
+}
+
+uint64_t
+HaruhiFrameAllocator::beginFrame() noexcept {
+  ++frame_;
+  // the last frame on this ring
+  if(frame_ > frames_.size())
+    fence_.wait(frame_ - frames_.size());
+
+  p_current_ = &frames_[frame_ % frames_.size()];
+  Frame& f = *p_current_;
+  f.used.store(0, std::memory_order_relaxed);
+  // standard pages are kept for the next overflow, oversized ones go back
+  for(auto& o : f.overflow) {
+    if(o.page.size == page_size_) spare_.push_back(o.page);
+    else backend_.free(o.page);
+  }
+  f.overflow.clear();
+  return frame_;
+}
+
+void
+HaruhiFrameAllocator::endFrame() noexcept {
+  Frame& f = *p_current_;
+  if(const size_t used = f.used.load(std::memory_order_acquire))
+    backend_.flush(f.ring, 0, used);
+  for(auto& o : f.overflow)
+    backend_.flush(o.page, 0, o.used);
+}
+
+HaruhiFrameAllocator::Allocation
+HaruhiFrameAllocator::allocate(size_t size, size_t align) noexcept {
+  assert(frame_ && align && (align & (align - 1)) == 0);
+  Frame& f = *p_current_;
+  size_t cur = f.used.load(std::memory_order_relaxed);
+  for(;;) {
+    const size_t start = (cur + align - 1) & ~(align - 1);
+    if(start + size > f.ring.size)
+      return allocateOverflow(size, align);
+    if(f.used.compare_exchange_weak(cur, start + size, std::memory_order_relaxed))
+      return { f.ring.cpu + start, f.ring.buffer, start };
+  }
+}
+
+HaruhiFrameAllocator::Allocation
+HaruhiFrameAllocator::allocateOverflow(size_t size, size_t align) noexcept {
+  std::lock_guard<std::mutex> lk(overflow_mtx_);
+  Frame& f = *p_current_;
+
+  if(!f.overflow.empty()) {
+    Overflow& o = f.overflow.back();
+    const size_t start = (o.used + align - 1) & ~(align - 1);
+    if(start + size <= o.page.size) {
+      o.used = start + size;
+      return { o.page.cpu + start, o.page.buffer, start };
+    }
+  }
+
+  // page bases are at least as aligned as anything asked for
+  HaruhiUploadBackend::Page page;
+  if(size <= page_size_ && !spare_.empty()) {
+    page = spare_.back();
+    spare_.pop_back();
+  } else if(!backend_.allocate(std::max(size, page_size_), page)) {
+    return { nullptr, nullptr, 0 };
+  }
+  f.overflow.push_back({ page, size });
+  return { page.cpu, page.buffer, 0 };
+}
+
+HaruhiFrameAllocator::Stats
+HaruhiFrameAllocator::stats() noexcept {
+  std::lock_guard<std::mutex> lk(overflow_mtx_);
+  Frame& f = *p_current_;
+  Stats s = { f.used.load(std::memory_order_relaxed), 0, f.overflow.size() };
+  for(auto& o : f.overflow)
+    s.overflowBytes += o.used;
+  return s;
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+#ifndef HARUHI_FRAMEALLOCATOR_HXX
+#define HARUHI_FRAMEALLOCATOR_HXX
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// gpu visible, persistently mapped memory of some backend
+class HaruhiUploadBackend {
+public:
+  struct Page {
+    uint8_t* cpu;
+    size_t size;
+    void* buffer; // the backend's buffer object
+  };
+
+  virtual ~HaruhiUploadBackend() = default;
+
+  // false when out of memory
+  virtual bool allocate(size_t, Page&) noexcept = 0;
+  virtual void free(const Page&) noexcept = 0;
+  // makes cpu writes of [offset, offset + size) visible to the gpu
+  virtual void flush(const Page&, size_t, size_t) noexcept = 0;
+};
+
+// completion signal of numbered frames, signaled from whatever thread the
+// backend reports completion on
+class HaruhiFrameFence {
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::atomic<uint64_t> completed_;
+
+public:
+  HaruhiFrameFence() : completed_(0) {}
+
+  // frames complete in order, signaling frame n completes everything before
+  void signal(uint64_t) noexcept;
+  uint64_t completed() const noexcept { return completed_.load(std::memory_order_acquire); }
+  void wait(uint64_t) noexcept;
+};
+
+// per frame upload memory, one ring per frame in flight
+//
+// allocations bump a lock free offset in the frame's ring and spill into
+// overflow pages when it is full. endFrame flushes exactly the used ranges.
+// beginFrame waits for the frame that last used the ring, then resets it and
+// returns its overflow pages. allocate is thread safe, begin and end are not
+class HaruhiFrameAllocator {
+public:
+  struct Allocation {
+    void* cpu;
+    void* buffer; // bind buffer at offset
+    size_t offset;
+  };
+
+  struct Stats {
+    size_t ringBytes;     // used in the ring
+    size_t overflowBytes; // used in overflow pages
+    size_t overflowPages;
+  };
+
+private:
+  struct Overflow {
+    HaruhiUploadBackend::Page page;
+    size_t used;
+  };
+
+  struct Frame {
+    HaruhiUploadBackend::Page ring;
+    std::atomic<size_t> used;
+    std::vector<Overflow> overflow;
+  };
+
+  HaruhiUploadBackend& backend_;
+  HaruhiFrameFence& fence_;
+  std::vector<Frame> frames_;
+  size_t page_size_;
+  std::vector<HaruhiUploadBackend::Page> spare_;
+  std::mutex overflow_mtx_;
+  uint64_t frame_;
+  Frame* p_current_;
+
+  Allocation allocateOverflow(size_t, size_t) noexcept;
+
+public:
+  // rings of ring bytes, overflow pages of at least page bytes
+  HaruhiFrameAllocator(HaruhiUploadBackend&, HaruhiFrameFence&, unsigned, size_t, size_t = 1 << 20);
+  ~HaruhiFrameAllocator();
+
+  HaruhiFrameAllocator(const HaruhiFrameAllocator&) = delete;
+  HaruhiFrameAllocator& operator=(const HaruhiFrameAllocator&) = delete;
+
+  // the new frame's number, 1 for the first. signal it on the fence once
+  // the gpu is done with it
+  uint64_t beginFrame() noexcept;
+  void endFrame() noexcept;
+
+  // align is a power of two, cpu is nullptr when the backend is out of memory
+  Allocation allocate(size_t, size_t = 16) noexcept;
+
+  uint64_t frame() const noexcept { return frame_; }
+  unsigned framesInFlight() const noexcept { return (unsigned)frames_.size(); }
+  Stats stats() noexcept;
+};
+
+#endif
\ No newline at end of file
@@ -1,13 +1,17 @@
 #include "GameEngine.hxx"
 
-std::unique_ptr<HaruhiResourcePool>
-Haruhi::res_pool_ = {};
-
-Haruhi::Haruhi() {
-  res_pool_ = std::make_unique<HaruhiResourcePool>(HaruhiResourcePool());
+Haruhi::Haruhi()
+: res_pool_(std::make_unique<HaruhiResourcePool>()),
+  workers_(std::make_unique<HaruhiWorkerPool>())
+{
 }
 
 HaruhiResourcePool*
 Haruhi::accessResourcePool() const noexcept {
   return res_pool_.get();
+}
+
+HaruhiWorkerPool*
+Haruhi::accessWorkerPool() const noexcept {
+  return workers_.get();
 }
\ No newline at end of file
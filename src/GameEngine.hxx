@@ -1,16 +1,22 @@
 #ifndef HARUHI_GAMEENGINE_HXX
 #define HARUHI_GAMEENGINE_HXX
 
+#include <memory>
+
 #include "ResourcePool.hxx"
+#include "WorkerPool.hxx"
 
 // yes, game engine itself is actually haruhi
 class Haruhi {
-  static std::unique_ptr<HaruhiResourcePool> res_pool_;
+  std::unique_ptr<HaruhiResourcePool> res_pool_;
+  // the engine's scheduler, built here so the app thread is its main thread
+  std::unique_ptr<HaruhiWorkerPool> workers_;
 public:
 
   Haruhi();
 
   HaruhiResourcePool* accessResourcePool() const noexcept;
+  HaruhiWorkerPool* accessWorkerPool() const noexcept;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include "ImageUtil.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "WorkerPool.hxx"
+
+namespace HaruhiResourceLoader {
+
+namespace ImageUtil {
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+double
+msBetween(clock::time_point a, clock::time_point b) noexcept {
+  return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+// libspng can't rebind a context to a new stream, what survives between
+// files decoded on the same thread is the file buffer
+thread_local std::vector<uint8_t> tls_file_buf;
+
+struct _spng_ctx_deleter {
+  void operator()(spng_ctx* p) const noexcept {
+    spng_ctx_free(p);
+  }
+};
+using spng_unique = std::unique_ptr<spng_ctx, _spng_ctx_deleter>;
+
+int
+readFile(const char* pth, std::vector<uint8_t>& out, size_t& size, size_t limit = SIZE_MAX) noexcept {
+  FILE* fp = fopen(pth, "rb");
+  if(!fp) return -errno;
+
+  int err = 0;
+  long len = -1;
+  if(fseek(fp, 0, SEEK_END) == 0) len = ftell(fp);
+  if(len < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+    err = -errno;
+  } else {
+    size = std::min<size_t>(len, limit);
+    if(out.size() < size) out.resize(size);
+    if(fread(out.data(), 1, size, fp) != size)
+      err = -EIO;
+  }
+  fclose(fp);
+  return err;
+}
+
+int
+readHeader(spng_ctx* ctx, spng_ihdr& ihdr, ImageInfo& info) noexcept {
+  int err = spng_get_ihdr(ctx, &ihdr);
+  if(err) return err;
+  size_t sz = 0;
+  err = spng_decoded_image_size(ctx, SPNG_FMT_RGBA8, &sz);
+  if(err) return err;
+  info = { ihdr.width, ihdr.height, sz };
+  return 0;
+}
+
+DecodeResult
+probeOne(const char* pth) noexcept {
+  DecodeResult res = {};
+  const auto t0 = clock::now();
+
+  // signature + IHDR fit in the first 33 bytes
+  std::vector<uint8_t>& buf = tls_file_buf;
+  size_t sz = 0;
+  res.error = readFile(pth, buf, sz, 64);
+  res.readMs = msBetween(t0, clock::now());
+  if(res.error) return res;
+
+  spng_unique ctx(spng_ctx_new(0));
+  if(!ctx) {
+    res.error = SPNG_EMEM;
+    return res;
+  }
+  spng_ihdr ihdr;
+  res.error = spng_set_png_buffer(ctx.get(), buf.data(), sz);
+  if(!res.error)
+    res.error = readHeader(ctx.get(), ihdr, res.info);
+  return res;
+}
+
+DecodeResult
+decodeOne(const DecodeRequest& req, spng_ihdr* pIhdr = nullptr) noexcept {
+  DecodeResult res = {};
+  const auto t0 = clock::now();
+
+  std::vector<uint8_t>& buf = tls_file_buf;
+  size_t sz = 0;
+  res.error = readFile(req.path, buf, sz);
+  const auto t1 = clock::now();
+  res.readMs = msBetween(t0, t1);
+  if(res.error) return res;
+
+  spng_unique ctx(spng_ctx_new(0));
+  if(!ctx) {
+    res.error = SPNG_EMEM;
+    return res;
+  }
+
+  spng_ihdr ihdr;
+  if((res.error = spng_set_png_buffer(ctx.get(), buf.data(), sz))
+      || (res.error = readHeader(ctx.get(), ihdr, res.info)))
+    return res;
+  if(pIhdr) *pIhdr = ihdr;
+
+  const size_t row = (size_t)res.info.width * 4;
+  const size_t pitch = req.rowPitch ? req.rowPitch : row;
+  if(!req.dst || pitch < row || pitch * (res.info.height - 1) + row > req.capacity) {
+    res.error = SPNG_EBUFSIZ;
+    return res;
+  }
+
+  if(pitch == row) {
+    res.error = spng_decode_image(ctx.get(), req.dst, res.info.size, SPNG_FMT_RGBA8, 0);
+  } else {
+    // padded rows, e.g. linear textures with an aligned bytesPerRow
+    res.error = spng_decode_image(ctx.get(), nullptr, 0, SPNG_FMT_RGBA8, SPNG_DECODE_PROGRESSIVE);
+    uint8_t* dst = static_cast<uint8_t*>(req.dst);
+    spng_row_info ri;
+    while(!res.error) {
+      if((res.error = spng_get_row_info(ctx.get(), &ri))) break;
+      res.error = spng_decode_row(ctx.get(), dst + ri.row_num * pitch, row);
+    }
+    if(res.error == SPNG_EOI) res.error = 0;
+  }
+
+  res.decodeMs = msBetween(t1, clock::now());
+  return res;
+}
+
+} // ns
+
+const char*
+errorString(int err) noexcept {
+  if(err < 0) return strerror(-err);
+  return spng_strerror(err);
+}
+
+std::vector<DecodeResult>
+probeImages(const char* const* paths, size_t n, HaruhiWorkerPool* pPool) noexcept {
+  std::vector<DecodeResult> res(n);
+  auto fn = [&](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i)
+      res[i] = probeOne(paths[i]);
+  };
+  if(pPool) pPool->parallelFor(n, 8, fn);
+  else fn(0, n);
+  return res;
+}
+
+std::vector<DecodeResult>
+decodeImages(const DecodeRequest* reqs, size_t n, HaruhiWorkerPool* pPool) noexcept {
+  std::vector<DecodeResult> res(n);
+  auto fn = [&](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i)
+      res[i] = decodeOne(reqs[i]);
+  };
+  if(pPool) pPool->parallelFor(n, 1, fn);
+  else fn(0, n);
+  return res;
+}
+
+std::tuple<size_t, std::unique_ptr<spng_ihdr>, void*>
+load_image_at(const char * img_pth) noexcept {
+  assert(img_pth);
+
+  const DecodeResult probe = probeOne(img_pth);
+  if(probe.error) {
+    printf("%s: %s\n", img_pth, errorString(probe.error));
+    return { 0, nullptr, nullptr };
+  }
+
+  void* img_buf = malloc(probe.info.size);
+  if(!img_buf)
+    return { 0, nullptr, nullptr };
+
+  auto ihdr = std::make_unique<spng_ihdr>((struct spng_ihdr){});
+  const DecodeResult res = decodeOne({ img_pth, img_buf, probe.info.size, 0 }, ihdr.get());
+  if(res.error) {
+    printf("%s: %s\n", img_pth, errorString(res.error));
+    free(img_buf);
+    return { 0, nullptr, nullptr };
+  }
+
+  return std::make_tuple(res.info.size, std::move(ihdr), img_buf);
+}
+
+} // ns ImageUtil
+
+} // ns HaruhiResourceLoader
\ No newline at end of file
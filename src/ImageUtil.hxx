@@ -0,0 +1,55 @@
+#ifndef HARUHI_IMAGEUTIL_HXX
+#define HARUHI_IMAGEUTIL_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include <spng/spng.h>
+
+class HaruhiWorkerPool;
+
+namespace HaruhiResourceLoader {
+
+namespace ImageUtil {
+
+// everything is decoded as RGBA8
+struct ImageInfo {
+  uint32_t width, height;
+  size_t size; // tightly packed decoded bytes
+};
+
+struct DecodeRequest {
+  const char* path;
+  void* dst;       // decoded rows go straight here
+  size_t capacity; // bytes available at dst
+  size_t rowPitch; // 0 for width * 4
+};
+
+struct DecodeResult {
+  int error;       // 0, an spng error or -errno for io failures
+  ImageInfo info;
+  double readMs, decodeMs;
+};
+
+const char* errorString(int) noexcept;
+
+// reads only the png header, so a batch can be laid out in one allocation
+std::vector<DecodeResult>
+probeImages(const char* const*, size_t, HaruhiWorkerPool* = nullptr) noexcept;
+
+// decodes every request on the pool, results keep the request order
+std::vector<DecodeResult>
+decodeImages(const DecodeRequest*, size_t, HaruhiWorkerPool* = nullptr) noexcept;
+
+// malloc'd RGBA8, { 0, nullptr, nullptr } when the file can't be decoded
+std::tuple<size_t, std::unique_ptr<spng_ihdr>, void*>
+load_image_at(const char *) noexcept;
+
+} // ns ImageUtil
+
+} // ns HaruhiResourceLoader
+
+#endif
\ No newline at end of file
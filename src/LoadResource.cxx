@@ -1,64 +1,234 @@
 #include "LoadResource.hxx"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <vector>
+
 // #include <mtl.hpp>
 #include <MetalKit/MetalKit.hpp>
 
+#include "AssetArchive.hxx"
+#include "MipChain.hxx"
+#include "Profiler.hxx"
 #include "ResourcePool.hxx"
 
 namespace HaruhiResourceLoader {
 
-namespace ImageUtil {
-
-std::tuple<size_t, std::unique_ptr<spng_ihdr>, void*>
-load_image_at(const char * img_pth) noexcept {
-  assert(img_pth);
+namespace {
 
-  spng_ctx* p_ctx = spng_ctx_new(0);
-  assert(p_ctx);
+struct TextureSource {
+  const char* name;
+  const char* path;
+  bool mips;
+  float alphaCutoff; // see HaruhiMipChain::Options
+  uint32_t maxLevels; // 0 for the full chain, atlases stop before tiles blend
+};
 
-  auto block_texture = fopen(img_pth, "rb");
+// blocks is an atlas of 16 px tiles, levels past log2(16) mix neighbours
+constexpr TextureSource TEXTURES[] = {
+  { "blocks", "./resource/blocks.png", true, 0.f, 5 },
+};
 
-  spng_set_png_file(p_ctx, block_texture);
+// baked by haruhiPack at build time
+constexpr const char* ARCHIVE_PATH = "./assets.hpak";
 
-  size_t img_sz;
-  spng_decoded_image_size(p_ctx, SPNG_FMT_RGBA8, &img_sz);
-
-  void* img_buf = malloc(img_sz);
-  spng_decode_image(p_ctx, img_buf, img_sz, SPNG_FMT_RGBA8, 0);
+size_t
+alignUp(size_t v, size_t a) noexcept {
+  return (v + a - 1) / a * a;
+}
 
-  auto ihdr = std::make_unique<spng_ihdr>((struct spng_ihdr){});
-  spng_get_ihdr(p_ctx, ihdr.get());
+MTL::PixelFormat
+pixelFormat(archive::Format fmt) noexcept {
+  switch(fmt) {
+  case archive::FORMAT_RGBA8_SRGB: return MTL::PixelFormatRGBA8Unorm_sRGB;
+  case archive::FORMAT_BC1_SRGB: return MTL::PixelFormatBC1_RGBA_sRGB;
+  case archive::FORMAT_BC3_SRGB: return MTL::PixelFormatBC3_RGBA_sRGB;
+  case archive::FORMAT_BC7_SRGB: return MTL::PixelFormatBC7_RGBAUnorm_sRGB;
+  case archive::FORMAT_ASTC_4x4_SRGB: return MTL::PixelFormatASTC_4x4_sRGB;
+  case archive::FORMAT_ASTC_6x6_SRGB: return MTL::PixelFormatASTC_6x6_sRGB;
+  }
+  return MTL::PixelFormatInvalid;
+}
 
-  spng_ctx_free(p_ctx);
+// BC on macs with the feature, ASTC on apple gpus
+bool
+supported(MTL::Device* pDevice, archive::Format fmt) noexcept {
+  switch(fmt) {
+  case archive::FORMAT_RGBA8_SRGB: return true;
+  case archive::FORMAT_BC1_SRGB:
+  case archive::FORMAT_BC3_SRGB:
+  case archive::FORMAT_BC7_SRGB: return pDevice->supportsBCTextureCompression();
+  case archive::FORMAT_ASTC_4x4_SRGB:
+  case archive::FORMAT_ASTC_6x6_SRGB: return pDevice->supportsFamily(MTL::GPUFamilyApple2);
+  }
+  return false;
+}
 
-  return std::make_tuple(img_sz, std::move(ihdr), img_buf);
+// single level RGBA8 textures alias the mapping through one no-copy buffer,
+// mip chains and block compressed levels are copied level by level since
+// buffer textures have neither
+bool
+loadArchive(MTL::Device* pDevice, HaruhiResourcePool* pResPool, const char* pth) noexcept {
+  auto ar = std::make_unique<HaruhiAssetArchive>();
+  if(int err = ar->open(pth)) {
+    if(err != -ENOENT) printf("%s: %s\n", pth, strerror(-err));
+    return false;
+  }
+
+  const archive::TextureEntry* entries[sizeof(TEXTURES) / sizeof(TEXTURES[0])];
+  for(size_t i = 0; i < sizeof(TEXTURES) / sizeof(TEXTURES[0]); ++i) {
+    entries[i] = ar->findTexture(TEXTURES[i].name);
+    if(!entries[i]) {
+      printf("%s: no texture %s, using the pngs\n", pth, TEXTURES[i].name);
+      return false;
+    }
+    if(!supported(pDevice, archive::Format(entries[i]->format))) {
+      printf("%s: %s is compressed for another gpu, using the pngs\n", pth, TEXTURES[i].name);
+      return false;
+    }
+  }
+
+  MTL::Buffer* pBuf = pDevice->newBuffer(
+    ar->data(), ar->size(), MTL::ResourceStorageModeShared, nullptr);
+
+  for(size_t i = 0; i < sizeof(TEXTURES) / sizeof(TEXTURES[0]); ++i) {
+    const archive::TextureEntry& e = *entries[i];
+    const MTL::PixelFormat fmt = pixelFormat(archive::Format(e.format));
+    const bool linear = e.mipCount == 1 && e.format == archive::FORMAT_RGBA8_SRGB;
+    const size_t align = linear ? pDevice->minimumLinearTextureAlignmentForPixelFormat(fmt) : 1;
+    const bool alias = pBuf && linear
+      && e.mips[0].offset % align == 0 && e.mips[0].rowPitch % align == 0;
+
+    MTL::TextureDescriptor* pTexDesc =
+      MTL::TextureDescriptor::texture2DDescriptor(fmt, e.width, e.height, false);
+    pTexDesc->setTextureType(MTL::TextureType2D);
+    pTexDesc->setUsage(MTL::TextureUsageShaderRead);
+
+    MTL::Texture* tex;
+    if(alias) {
+      pTexDesc->setStorageMode(MTL::StorageModeShared);
+      tex = pBuf->newTexture(pTexDesc, e.mips[0].offset, e.mips[0].rowPitch);
+    } else {
+      pTexDesc->setMipmapLevelCount(e.mipCount);
+      pTexDesc->setStorageMode(MTL::StorageModeManaged);
+      tex = pDevice->newTexture(pTexDesc);
+      for(uint32_t l = 0; l < e.mipCount; ++l)
+        tex->replaceRegion(
+          MTL::Region::Make2D(0, 0, e.mips[l].width, e.mips[l].height),
+          l, ar->levelData(e, l), e.mips[l].rowPitch);
+    }
+    if(!pResPool->addTexture(pResPool->table().intern(TEXTURES[i].name), tex))
+      printf("%s: texture name taken, dropped\n", TEXTURES[i].name);
+  }
+
+  if(pBuf) pBuf->release();
+  pResPool->adoptArchive(std::move(ar));
+  return true;
 }
 
-} // ns ImageUtil
+} // ns
 
 void
-loadResources(MTL::Device* pDevice, HaruhiResourcePool* pResPool) noexcept {
+loadResources(MTL::Device* pDevice, HaruhiResourcePool* pResPool, HaruhiWorkerPool* pWorkers) noexcept {
   using namespace NS;
-
-  // png
-  auto [sz, ihdr, buf] = ImageUtil::load_image_at("./resource/blocks.png");
-
-  MTL::TextureDescriptor* pTexDesc =
-    MTL::TextureDescriptor::texture2DDescriptor(
-      MTL::PixelFormatRGBA8Unorm_sRGB, ihdr->width, ihdr->height, false);
-  pTexDesc->setTextureType(MTL::TextureType2D);
-  pTexDesc->setUsage(MTL::TextureUsageRenderTarget|MTL::TextureUsageShaderRead);
-  // pTexDesc->setResourceOptions(MTL::ResourceStorageModeManaged);
-  pTexDesc->setStorageMode(MTL::StorageModeManaged);
-
-  auto tex_buf = pDevice->newBuffer(sz, MTL::StorageModeManaged);
-  memcpy(tex_buf->contents(), buf, sz);
-  tex_buf->didModifyRange(Range::Make(0, sz));
-  free(buf);
-  // printf("%u %lu\n", ihdr->width, sz);
-  auto blocks = tex_buf->newTexture(pTexDesc, 0, 4*ihdr->width);
-
-  pResPool->setTexture("blocks", blocks);
+  using namespace ImageUtil;
+  HARUHI_PROFILE_SCOPE("loadResources");
+
+  if(loadArchive(pDevice, pResPool, ARCHIVE_PATH))
+    return;
+
+  constexpr size_t N = sizeof(TEXTURES) / sizeof(TEXTURES[0]);
+
+  const char* paths[N];
+  for(size_t i = 0; i < N; ++i)
+    paths[i] = TEXTURES[i].path;
+
+  // headers first, then every png decodes in parallel. buffer backed
+  // textures land straight in one staging buffer, mipped ones in host
+  // memory the chain is built from, it's uploaded level by level anyway
+  auto probes = probeImages(paths, N, pWorkers);
+
+  const size_t align =
+    pDevice->minimumLinearTextureAlignmentForPixelFormat(MTL::PixelFormatRGBA8Unorm_sRGB);
+
+  size_t offsets[N], pitches[N], total = 0;
+  std::vector<uint8_t> host[N];
+  for(size_t i = 0; i < N; ++i) {
+    if(probes[i].error) {
+      printf("%s: %s\n", paths[i], errorString(probes[i].error));
+      abort();
+    }
+    if(TEXTURES[i].mips) {
+      pitches[i] = probes[i].info.width * 4;
+      offsets[i] = 0;
+      host[i].resize(pitches[i] * probes[i].info.height);
+    } else {
+      pitches[i] = alignUp(probes[i].info.width * 4, align);
+      offsets[i] = total;
+      total = alignUp(total + pitches[i] * probes[i].info.height, align);
+    }
+  }
+
+  MTL::Buffer* pStaging = nullptr;
+  uint8_t* p_contents = nullptr;
+  if(total) {
+    pStaging = pDevice->newBuffer(total, MTL::ResourceStorageModeManaged);
+    p_contents = reinterpret_cast<uint8_t*>(pStaging->contents());
+  }
+
+  DecodeRequest reqs[N];
+  for(size_t i = 0; i < N; ++i)
+    reqs[i] = TEXTURES[i].mips
+      ? DecodeRequest{ paths[i], host[i].data(), host[i].size(), pitches[i] }
+      : DecodeRequest{ paths[i], p_contents + offsets[i], total - offsets[i], pitches[i] };
+
+  auto results = decodeImages(reqs, N, pWorkers);
+  for(size_t i = 0; i < N; ++i)
+    if(results[i].error) {
+      printf("%s: %s\n", paths[i], errorString(results[i].error));
+      abort();
+    }
+  if(pStaging) pStaging->didModifyRange(Range::Make(0, total));
+
+  HaruhiMipChain chain;
+  for(size_t i = 0; i < N; ++i) {
+    const uint32_t w = results[i].info.width, h = results[i].info.height;
+    MTL::TextureDescriptor* pTexDesc =
+      MTL::TextureDescriptor::texture2DDescriptor(
+        MTL::PixelFormatRGBA8Unorm_sRGB, w, h, TEXTURES[i].mips);
+    pTexDesc->setTextureType(MTL::TextureType2D);
+    pTexDesc->setUsage(MTL::TextureUsageRenderTarget|MTL::TextureUsageShaderRead);
+    pTexDesc->setStorageMode(MTL::StorageModeManaged);
+
+    MTL::Texture* tex;
+    if(TEXTURES[i].mips) {
+      // buffer backed textures can't have mips, the chain is uploaded instead
+      HaruhiMipChain::Options opts = {};
+      opts.alphaCutoff = TEXTURES[i].alphaCutoff;
+      opts.maxLevels = pTexDesc->mipmapLevelCount();
+      if(TEXTURES[i].maxLevels)
+        opts.maxLevels = std::min<uint32_t>(opts.maxLevels, TEXTURES[i].maxLevels);
+      chain.build(host[i].data(), w, h, pitches[i], opts, pWorkers);
+      std::vector<uint8_t>().swap(host[i]);
+
+      pTexDesc->setMipmapLevelCount(chain.levelCount());
+      tex = pDevice->newTexture(pTexDesc);
+      for(uint32_t l = 0; l < chain.levelCount(); ++l) {
+        const HaruhiMipChain::Level& lv = chain.level(l);
+        tex->replaceRegion(MTL::Region::Make2D(0, 0, lv.width, lv.height),
+          l, chain.levelData(l), lv.width * 4);
+      }
+    } else {
+      // textures keep the staging buffer alive
+      tex = pStaging->newTexture(pTexDesc, offsets[i], pitches[i]);
+    }
+    if(!pResPool->addTexture(pResPool->table().intern(TEXTURES[i].name), tex))
+      printf("%s: texture name taken, dropped\n", TEXTURES[i].name);
+  }
+
+  if(pStaging) pStaging->release();
 }
 
 } // ns HaruhiResourceLoader
\ No newline at end of file
@@ -1,27 +1,18 @@
 #ifndef HARUHI_LOADRESOURCE_HXX
 #define HARUHI_LOADRESOURCE_HXX
 
-#include <memory>
-#include <tuple>
-
-#include <spng/spng.h>
+#include "ImageUtil.hxx"
 
 namespace MTL {
 class Device;
 } // ns MTL
 class HaruhiResourcePool;
+class HaruhiWorkerPool;
 
 namespace HaruhiResourceLoader {
 
-namespace ImageUtil {
-
-std::tuple<size_t, std::unique_ptr<spng_ihdr>, void*>
-load_image_at(const char *) noexcept;
-
-} // ns ImageUtil
-
 void
-loadResources(MTL::Device*, HaruhiResourcePool*) noexcept;
+loadResources(MTL::Device*, HaruhiResourcePool*, HaruhiWorkerPool* = nullptr) noexcept;
 
 } // ns HaruhiResourceLoader
 
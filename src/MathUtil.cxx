@@ -2,21 +2,25 @@
 
 namespace math {
 
-using simd::float4;
-
 const float3
 add(const float3& a, const float3& b) {
   return { a.x + b.x, a.y + b.y, a.z + b.z };
 }
 
-const simd_float4x4
+const float4x4
 makeIdentity() {
-  return (simd_float4x4) {
-    (float4){ 1., 0., 0., 0. },
-    (float4){ 0., 1., 0., 0. },
-    (float4){ 0., 0., 1., 0. },
-    (float4){ 0., 0., 0., 1. }
-  };
+  return { {
+    { 1., 0., 0., 0. },
+    { 0., 1., 0., 0. },
+    { 0., 0., 1., 0. },
+    { 0., 0., 0., 1. }
+  } };
+}
+
+// matrices below are written row by row like simd_matrix_from_rows did
+static float4x4
+fromRows(const float4& r0, const float4& r1, const float4& r2, const float4& r3) {
+  return transpose(float4x4{ { r0, r1, r2, r3 } });
 }
 
 float4x4
@@ -26,41 +30,41 @@ makePerspective(float fov, float asp, float znear, float zfar) {
   float xs = ys / asp;
   float zs = zfar / (znear - zfar);
 
-  return simd_matrix_from_rows(
-    (float4){ xs, 0., 0., 0. },
-    (float4){ 0., ys, 0., 0. },
-    (float4){ 0., 0., zs, znear * zs },
-    (float4){ 0, 0, -1, 0 }
+  return fromRows(
+    { xs, 0., 0., 0. },
+    { 0., ys, 0., 0. },
+    { 0., 0., zs, znear * zs },
+    { 0, 0, -1, 0 }
   );
 }
 
 float4x4
 makeXRotate(float a) {
-  return simd_matrix_from_rows(
-    (float4){ 1., 0., 0., 0. },
-    (float4){ 0., cosf(a), sinf(a), 0. },
-    (float4){ 0., -sinf(a), cosf(a), 0. },
-    (float4){ 0., 0., 0., 1. }
+  return fromRows(
+    { 1., 0., 0., 0. },
+    { 0., cosf(a), sinf(a), 0. },
+    { 0., -sinf(a), cosf(a), 0. },
+    { 0., 0., 0., 1. }
   );
 }
 
 float4x4
 makeYRotate(float a) {
-  return simd_matrix_from_rows(
-    (float4){ cosf(a), 0., sinf(a), 0. },
-    (float4){ 0., 1., 0., 0. },
-    (float4){ -sinf(a), 0., cosf(a), 0. },
-    (float4){ 0., 0., 0., 1. }
+  return fromRows(
+    { cosf(a), 0., sinf(a), 0. },
+    { 0., 1., 0., 0. },
+    { -sinf(a), 0., cosf(a), 0. },
+    { 0., 0., 0., 1. }
   );
 }
 
 float4x4
 makeZRotate(float a) {
-  return simd_matrix_from_rows(
-    (float4){ cosf(a), sinf(a), 0., 0. },
-    (float4){ -sinf(a), cosf(a), 0., 0. },
-    (float4){ 0., 0., 1., 0. },
-    (float4){ 0., 0., 0., 1. }
+  return fromRows(
+    { cosf(a), sinf(a), 0., 0. },
+    { -sinf(a), cosf(a), 0., 0. },
+    { 0., 0., 1., 0. },
+    { 0., 0., 0., 1. }
   );
 }
 
@@ -70,22 +74,45 @@ makeTranslate(const float3& v) {
   const float4 c1 = { 0., 1., 0., 0. };
   const float4 c2 = { 0., 0., 1., 0. };
   const float4 c3 = { v.x, v.y, v.z, 1. };
-  return simd_matrix(c0, c1, c2, c3);
+  return { { c0, c1, c2, c3 } };
 }
 
 float4x4
 makeScale(const float3& v) {
-  return simd_matrix(
-    (float4){ v.x, 0, 0, 0 },
-    (float4){ 0, v.y, 0, 0 },
-    (float4){ 0, 0, v.z, 0 },
-    (float4){ 0, 0, 0, 1. }
-  );
+  return { {
+    { v.x, 0, 0, 0 },
+    { 0, v.y, 0, 0 },
+    { 0, 0, v.z, 0 },
+    { 0, 0, 0, 1. }
+  } };
 }
 
-simd::float3x3
+float3x3
 discardTranslation(const float4x4& m) {
-  return simd_matrix(m.columns[0].xyz, m.columns[1].xyz, m.columns[2].xyz);
+  return { { m.columns[0].xyz(), m.columns[1].xyz(), m.columns[2].xyz() } };
+}
+
+float4x4
+makeTranslateXYRotate(const float3& t, float ax, float ay) {
+  const float cx = cosf(ax), sx = sinf(ax);
+  const float cy = cosf(ay), sy = sinf(ay);
+  return { {
+    { cy, -sx * sy, -cx * sy, 0. },
+    { 0., cx, -sx, 0. },
+    { sy, sx * cy, cx * cy, 0. },
+    { t.x, t.y, t.z, 1. }
+  } };
+}
+
+float4x4
+makeTRS(const float3& t, const quat& q, const float3& s) {
+  const float3x3 r = toMatrix(q);
+  return { {
+    float4(r.columns[0] * s.x, 0.),
+    float4(r.columns[1] * s.y, 0.),
+    float4(r.columns[2] * s.z, 0.),
+    float4(t, 1.)
+  } };
 }
 
 } // ns math
\ No newline at end of file
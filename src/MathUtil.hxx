@@ -1,16 +1,12 @@
 #ifndef HARUHI_MATHUTIL_HXX
 #define HARUHI_MATHUTIL_HXX
 
-#include <simd/simd.h>
+#include "SimdMath.hxx"
 
 namespace math {
 
-using simd::float3;
-using simd::float3x3;
-using simd::float4x4;
-
 const float3 add(const float3&, const float3&);
-const simd_float4x4 makeIdentity();
+const float4x4 makeIdentity();
 float4x4 makePerspective(float, float, float, float);
 float4x4 makeXRotate(float);
 float4x4 makeYRotate(float);
@@ -19,6 +15,13 @@ float4x4 makeTranslate(const float3&);
 float4x4 makeScale(const float3&);
 float3x3 discardTranslation(const float4x4&);
 
+// fused builders, same result as the chained products without the 4x4 muls
+
+// makeTranslate(t) * makeXRotate(ax) * makeYRotate(ay)
+float4x4 makeTranslateXYRotate(const float3&, float, float);
+// makeTranslate(t) * rotation(q) * makeScale(s)
+float4x4 makeTRS(const float3&, const quat&, const float3&);
+
 } // ns math
 
 #endif
\ No newline at end of file
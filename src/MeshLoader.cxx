@@ -0,0 +1,974 @@
+#include "MeshLoader.hxx"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MeshOptimizer.hxx"
+#include "Profiler.hxx"
+#include "WorkerPool.hxx"
+
+namespace {
+
+using shader_t::VertexData;
+
+// obj text per parse job, large enough that the per chunk arrays amortize
+constexpr size_t CHUNK_BYTES = 1 << 20;
+// corners counted per histogram block and hash partitions, both fixed so
+// the vertex order doesn't depend on the pool
+constexpr size_t BLOCK_CORNERS = 1 << 16;
+constexpr unsigned PARTITION_BITS = 6;
+constexpr size_t PARTITIONS = size_t(1) << PARTITION_BITS;
+// obj indices stay below it, parse jobs write relative ones as local - LIMIT
+constexpr int64_t INDEX_LIMIT = int64_t(1) << 30;
+constexpr int32_t NONE = INT32_MIN;
+constexpr uint32_t NO_INDEX = ~0u;
+
+double
+elapsedMs(uint64_t since) noexcept {
+  return (prof::now() - since) * 1e-6;
+}
+
+void
+forRange(HaruhiWorkerPool* pPool, size_t count, size_t grain,
+         const HaruhiWorkerPool::RangeFn& fn) noexcept {
+  if(pPool) pPool->parallelFor(count, grain, fn);
+  else if(count) fn(0, count);
+}
+
+// read only mapping of a whole file
+class Mapping {
+  const uint8_t* p_base_ = nullptr;
+  size_t size_ = 0;
+public:
+  ~Mapping() {
+    if(p_base_) munmap(const_cast<uint8_t*>(p_base_), size_);
+  }
+
+  int
+  open(const char* pth) noexcept {
+    int fd = ::open(pth, O_RDONLY);
+    if(fd < 0) return -errno;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+      int err = -errno;
+      ::close(fd);
+      return err;
+    }
+    if(st.st_size <= 0) {
+      ::close(fd);
+      return -EINVAL;
+    }
+
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int err = p == MAP_FAILED ? -errno : 0;
+    ::close(fd);
+    if(err) return err;
+
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+    p_base_ = static_cast<const uint8_t*>(p);
+    size_ = st.st_size;
+    return 0;
+  }
+
+  const uint8_t* data() const noexcept { return p_base_; }
+  size_t size() const noexcept { return size_; }
+};
+
+// area weighted average of the faces around every vertex, corner c of
+// the triangles uses vertex idx(c) at pos(vertex)
+template <typename Idx, typename Pos>
+std::vector<math::float3>
+smoothNormals(size_t vertices, size_t corners, Idx idx, Pos pos) {
+  std::vector<math::float3> n(vertices);
+  for(size_t c = 0; c + 2 < corners; c += 3) {
+    const uint32_t a = idx(c), b = idx(c + 1), d = idx(c + 2);
+    const math::float3 p = pos(a);
+    const math::float3 f = math::cross(pos(b) - p, pos(d) - p);
+    n[a] = n[a] + f;
+    n[b] = n[b] + f;
+    n[d] = n[d] + f;
+  }
+  for(math::float3& v : n) {
+    const float l = math::length(v);
+    v = l > 0.f ? v * (1.f / l) : math::float3(0.f, 0.f, 1.f);
+  }
+  return n;
+}
+
+// bounds and the narrowest index type
+void
+finish(model::Mesh& m, std::vector<uint32_t>& indices) {
+  m.min = m.max = m.vertices.empty() ? math::float3() : m.vertices[0].pos;
+  for(const VertexData& v : m.vertices) {
+    m.min = { std::min(m.min.x, v.pos.x), std::min(m.min.y, v.pos.y), std::min(m.min.z, v.pos.z) };
+    m.max = { std::max(m.max.x, v.pos.x), std::max(m.max.y, v.pos.y), std::max(m.max.z, v.pos.z) };
+  }
+  if(m.vertices.size() <= 65536) {
+    m.indices16.assign(indices.begin(), indices.end());
+    m.indices32.clear();
+  } else {
+    m.indices32 = std::move(indices);
+    m.indices16.clear();
+  }
+}
+
+//
+// floats
+//
+
+constexpr double POW10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool
+isDigit(char c) noexcept {
+  return unsigned(c - '0') < 10;
+}
+
+// eight ascii digits at once in a 64 bit register, false unless all are
+inline bool
+eightDigits(const char* p, uint64_t& v) noexcept {
+  uint64_t w;
+  memcpy(&w, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  w = __builtin_bswap64(w);
+#endif
+  if(((w & 0xF0F0F0F0F0F0F0F0) | (((w + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4))
+     != 0x3333333333333333)
+    return false;
+  w = (w & 0x0F0F0F0F0F0F0F0F) * 2561 >> 8;
+  w = (w & 0x00FF00FF00FF00FF) * 6553601 >> 16;
+  v = (w & 0x0000FFFF0000FFFF) * 42949672960001 >> 32;
+  return true;
+}
+
+inline const char*
+skipBlank(const char* p, const char* end) noexcept {
+  while(p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+  return p;
+}
+
+inline bool
+isBlank(char c) noexcept {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+//
+// obj
+//
+
+struct Key {
+  uint32_t v, t, n;
+  bool operator==(const Key&) const noexcept = default;
+};
+
+inline uint64_t
+hash(const Key& k) noexcept {
+  uint64_t h = (uint64_t(k.v) | uint64_t(k.t) << 32) ^ uint64_t(k.n) * 0x9E3779B97F4A7C15;
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCD;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53;
+  return h ^ h >> 33;
+}
+
+// what one parse job found, indices as written until resolved
+struct Chunk {
+  const char *begin, *end;
+  std::vector<float> v, vt, vn;
+  std::vector<int32_t> corners; // v, vt, vn per triangle corner
+  size_t vBase, tBase, nBase, cBase;
+  bool failed;
+};
+
+const char*
+parseIndex(const char* p, const char* end, int64_t& out) noexcept {
+  bool neg = false;
+  if(p < end && *p == '-') neg = true, ++p;
+  if(p == end || !isDigit(*p)) return nullptr;
+  int64_t v = 0;
+  for(; p < end && isDigit(*p); ++p)
+    if(v <= INDEX_LIMIT) v = v * 10 + (*p - '0');
+  out = neg ? -v : v;
+  return p;
+}
+
+// one based or relative to the count so far in this chunk
+bool
+encode(int64_t raw, size_t local, int32_t& out) noexcept {
+  if(raw > 0 && raw <= INDEX_LIMIT) {
+    out = int32_t(raw - 1);
+    return true;
+  }
+  const int64_t r = int64_t(local) + raw;
+  if(raw >= 0 || r <= -INDEX_LIMIT) return false;
+  out = int32_t(r - INDEX_LIMIT);
+  return true;
+}
+
+bool
+resolve(int32_t enc, size_t base, size_t count, uint32_t& out) noexcept {
+  if(enc == NONE) {
+    out = NO_INDEX;
+    return true;
+  }
+  const int64_t i = enc >= 0 ? enc : int64_t(base) + (int64_t(enc) + INDEX_LIMIT);
+  if(i < 0 || i >= int64_t(count)) return false;
+  out = uint32_t(i);
+  return true;
+}
+
+// up to n floats, at least min of them
+const char*
+parseFloats(const char* p, const char* end, float* out, unsigned min, unsigned n) noexcept {
+  for(unsigned i = 0; i < n; ++i) {
+    const char* q = model::parseFloat(skipBlank(p, end), end, out[i]);
+    if(!q) {
+      if(i < min) return nullptr;
+      out[i] = 0.f;
+      continue;
+    }
+    p = q;
+  }
+  return p;
+}
+
+bool
+parseFace(const char* p, const char* eol, Chunk& c, std::vector<int32_t>& poly) noexcept {
+  poly.clear();
+  const size_t counts[3] = { c.v.size() / 3, c.vt.size() / 2, c.vn.size() / 3 };
+  for(;;) {
+    p = skipBlank(p, eol);
+    if(p == eol || *p == '#') break;
+    int32_t corner[3] = { NONE, NONE, NONE };
+    for(unsigned k = 0; k < 3; ++k) {
+      int64_t raw;
+      const char* q = parseIndex(p, eol, raw);
+      if(q) {
+        if(!encode(raw, counts[k], corner[k])) return false;
+        p = q;
+      } else if(k == 0) {
+        return false;
+      }
+      if(k == 2 || p == eol || *p != '/') break;
+      ++p;
+    }
+    if(p < eol && !isBlank(*p) && *p != '#') return false;
+    poly.insert(poly.end(), corner, corner + 3);
+  }
+  const size_t n = poly.size() / 3;
+  if(n < 3) return false;
+  // fan around the first corner
+  for(size_t i = 2; i < n; ++i) {
+    c.corners.insert(c.corners.end(), &poly[0], &poly[3]);
+    c.corners.insert(c.corners.end(), &poly[3 * (i - 1)], &poly[3 * i]);
+    c.corners.insert(c.corners.end(), &poly[3 * i], &poly[3 * i + 3]);
+  }
+  return true;
+}
+
+bool
+parseChunk(Chunk& c) noexcept {
+  std::vector<int32_t> poly;
+  float f[3];
+  const char* p = c.begin;
+  while(p < c.end) {
+    p = skipBlank(p, c.end);
+    const char* eol = static_cast<const char*>(memchr(p, '\n', c.end - p));
+    if(!eol) eol = c.end;
+
+    if(eol - p > 1 && p[0] == 'v' && isBlank(p[1])) {
+      if(!parseFloats(p + 1, eol, f, 3, 3)) return false;
+      c.v.insert(c.v.end(), f, f + 3);
+    } else if(eol - p > 2 && p[0] == 'v' && p[1] == 't' && isBlank(p[2])) {
+      if(!parseFloats(p + 2, eol, f, 1, 2)) return false;
+      c.vt.push_back(f[0]);
+      c.vt.push_back(1.f - f[1]);
+    } else if(eol - p > 2 && p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+      if(!parseFloats(p + 2, eol, f, 3, 3)) return false;
+      c.vn.insert(c.vn.end(), f, f + 3);
+    } else if(eol - p > 1 && p[0] == 'f' && isBlank(p[1])) {
+      if(!parseFace(p + 1, eol, c, poly)) return false;
+    }
+    p = eol + 1;
+  }
+  return c.v.size() / 3 < size_t(INDEX_LIMIT);
+}
+
+// vertex ids in hash partitions, each deduplicated on its own. the
+// partitions keep the corner order inside, so ids come out the same for
+// any pool
+std::vector<uint32_t>
+deduplicate(const std::vector<Key>& keys, std::vector<Key>& unique, HaruhiWorkerPool* pPool) {
+  const size_t n = keys.size();
+  const size_t blocks = (n + BLOCK_CORNERS - 1) / BLOCK_CORNERS;
+  std::vector<uint8_t> part(n);
+  std::vector<uint32_t> offset(blocks * PARTITIONS, 0);
+
+  forRange(pPool, blocks, 1, [&](size_t b, size_t e) {
+    for(size_t k = b; k < e; ++k) {
+      uint32_t* hist = &offset[k * PARTITIONS];
+      for(size_t c = k * BLOCK_CORNERS, end = std::min(n, c + BLOCK_CORNERS); c < end; ++c)
+        ++hist[part[c] = uint8_t(hash(keys[c]) >> (64 - PARTITION_BITS))];
+    }
+  });
+
+  std::vector<size_t> first(PARTITIONS + 1);
+  size_t running = 0;
+  for(size_t p = 0; p < PARTITIONS; ++p) {
+    first[p] = running;
+    for(size_t k = 0; k < blocks; ++k) {
+      const uint32_t h = offset[k * PARTITIONS + p];
+      offset[k * PARTITIONS + p] = uint32_t(running);
+      running += h;
+    }
+  }
+  first[PARTITIONS] = running;
+
+  // keys travel with their corner so the partitions read straight through
+  struct Entry {
+    Key key;
+    uint32_t corner;
+  };
+  std::vector<Entry> order(n);
+  forRange(pPool, blocks, 1, [&](size_t b, size_t e) {
+    for(size_t k = b; k < e; ++k) {
+      uint32_t* at = &offset[k * PARTITIONS];
+      for(size_t c = k * BLOCK_CORNERS, end = std::min(n, c + BLOCK_CORNERS); c < end; ++c)
+        order[at[part[c]]++] = { keys[c], uint32_t(c) };
+    }
+  });
+
+  std::vector<uint32_t> local(n);
+  std::vector<std::vector<Key>> found(PARTITIONS);
+  forRange(pPool, PARTITIONS, 1, [&](size_t b, size_t e) {
+    std::vector<uint32_t> table;
+    for(size_t p = b; p < e; ++p) {
+      const size_t count = first[p + 1] - first[p];
+      size_t size = 16;
+      while(size < count * 2) size <<= 1;
+      table.assign(size, 0);
+      std::vector<Key>& seen = found[p];
+      for(size_t i = first[p]; i < first[p + 1]; ++i) {
+        const Key& k = order[i].key;
+        size_t slot = hash(k) & (size - 1);
+        // slots hold id + 1, zero is empty
+        while(table[slot] && !(seen[table[slot] - 1] == k))
+          slot = (slot + 1) & (size - 1);
+        if(!table[slot]) {
+          seen.push_back(k);
+          table[slot] = uint32_t(seen.size());
+        }
+        local[i] = table[slot] - 1;
+      }
+    }
+  });
+
+  std::vector<size_t> base(PARTITIONS + 1, 0);
+  for(size_t p = 0; p < PARTITIONS; ++p)
+    base[p + 1] = base[p] + found[p].size();
+  unique.resize(base[PARTITIONS]);
+  std::vector<uint32_t> ids(n);
+  forRange(pPool, PARTITIONS, 1, [&](size_t b, size_t e) {
+    for(size_t p = b; p < e; ++p) {
+      for(size_t i = first[p]; i < first[p + 1]; ++i)
+        ids[order[i].corner] = local[i] + uint32_t(base[p]);
+      std::copy(found[p].begin(), found[p].end(), unique.begin() + base[p]);
+    }
+  });
+  return ids;
+}
+
+int
+buildObj(std::vector<Chunk>& chunks, model::Mesh& out, HaruhiWorkerPool* pPool) {
+  size_t v = 0, t = 0, n = 0, c = 0;
+  for(Chunk& ch : chunks) {
+    ch.vBase = v, ch.tBase = t, ch.nBase = n, ch.cBase = c;
+    v += ch.v.size() / 3, t += ch.vt.size() / 2, n += ch.vn.size() / 3;
+    c += ch.corners.size() / 3;
+  }
+  if(!c || v > size_t(INDEX_LIMIT)) return -EINVAL;
+
+  std::vector<float> pos(v * 3), tex(t * 2), norm(n * 3);
+  std::vector<Key> keys(c);
+  bool failed = false;
+  forRange(pPool, chunks.size(), 1, [&](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i) {
+      Chunk& ch = chunks[i];
+      std::copy(ch.v.begin(), ch.v.end(), pos.begin() + ch.vBase * 3);
+      std::copy(ch.vt.begin(), ch.vt.end(), tex.begin() + ch.tBase * 2);
+      std::copy(ch.vn.begin(), ch.vn.end(), norm.begin() + ch.nBase * 3);
+      const int32_t* src = ch.corners.data();
+      for(size_t k = 0, m = ch.corners.size() / 3; k < m; ++k, src += 3) {
+        Key& key = keys[ch.cBase + k];
+        if(!resolve(src[0], ch.vBase, v, key.v) || key.v == NO_INDEX
+           || !resolve(src[1], ch.tBase, t, key.t) || !resolve(src[2], ch.nBase, n, key.n))
+          ch.failed = true;
+      }
+      std::vector<float>().swap(ch.v);
+      std::vector<float>().swap(ch.vt);
+      std::vector<float>().swap(ch.vn);
+      std::vector<int32_t>().swap(ch.corners);
+    }
+  });
+  for(const Chunk& ch : chunks) failed |= ch.failed;
+  if(failed) return -EINVAL;
+
+  auto position = [&](uint32_t i) { return math::float3(pos[i * 3], pos[i * 3 + 1], pos[i * 3 + 2]); };
+  std::vector<math::float3> smooth;
+  if(std::any_of(keys.begin(), keys.end(), [](const Key& k) { return k.n == NO_INDEX; }))
+    smooth = smoothNormals(v, c, [&](size_t i) { return keys[i].v; }, position);
+
+  std::vector<Key> unique;
+  std::vector<uint32_t> ids = deduplicate(keys, unique, pPool);
+  std::vector<Key>().swap(keys);
+
+  // first use order, what the vertex fetch wants and the file had
+  std::vector<uint32_t> remap(unique.size());
+  mesh::optimizeVertexFetchRemap(remap.data(), ids.data(), c, unique.size());
+  std::vector<uint32_t> indices(c);
+  out.vertices.resize(unique.size());
+  forRange(pPool, c, 1 << 16, [&](size_t b, size_t e) {
+    mesh::remapIndices(indices.data() + b, ids.data() + b, e - b, remap.data());
+  });
+  forRange(pPool, unique.size(), 1 << 14, [&](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i) {
+      const Key& k = unique[i];
+      VertexData& d = out.vertices[remap[i]];
+      d.pos = position(k.v);
+      d.norm = k.n == NO_INDEX ? smooth[k.v]
+                               : math::float3(norm[k.n * 3], norm[k.n * 3 + 1], norm[k.n * 3 + 2]);
+      d.texcoord = k.t == NO_INDEX ? math::float2{ 0.f, 0.f } : math::float2{ tex[k.t * 2], tex[k.t * 2 + 1] };
+    }
+  });
+  finish(out, indices);
+  return 0;
+}
+
+//
+// glb
+//
+
+constexpr uint32_t GLB_MAGIC = 0x46546C67; // glTF
+constexpr uint32_t GLB_JSON = 0x4E4F534A;
+constexpr uint32_t GLB_BIN = 0x004E4942;
+constexpr unsigned JSON_DEPTH = 64;
+
+enum ComponentType : uint32_t {
+  COMPONENT_BYTE = 5120,
+  COMPONENT_UNSIGNED_BYTE = 5121,
+  COMPONENT_SHORT = 5122,
+  COMPONENT_UNSIGNED_SHORT = 5123,
+  COMPONENT_UNSIGNED_INT = 5125,
+  COMPONENT_FLOAT = 5126
+};
+
+// as much json as gltf needs, strings stay escaped
+struct Json {
+  enum Type : uint8_t { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+  Type type = JSON_NULL;
+  double number = 0.;
+  std::string_view string;
+  std::vector<std::string_view> keys;
+  std::vector<Json> items;
+
+  const Json*
+  operator[](std::string_view k) const noexcept {
+    for(size_t i = 0; i < keys.size(); ++i)
+      if(keys[i] == k) return &items[i];
+    return nullptr;
+  }
+
+  const Json*
+  at(size_t i) const noexcept {
+    return type == JSON_ARRAY && i < items.size() ? &items[i] : nullptr;
+  }
+};
+
+class JsonParser {
+  const char *p_, *end_;
+
+  void skip() noexcept {
+    while(p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) ++p_;
+  }
+
+  bool
+  string(std::string_view& out) noexcept {
+    if(p_ == end_ || *p_ != '"') return false;
+    const char* b = ++p_;
+    for(; p_ < end_ && *p_ != '"'; ++p_)
+      if(*p_ == '\\') ++p_;
+    if(p_ >= end_) return false;
+    out = std::string_view(b, p_++ - b);
+    return true;
+  }
+
+  bool
+  literal(const char* s) noexcept {
+    const size_t n = strlen(s);
+    if(size_t(end_ - p_) < n || memcmp(p_, s, n)) return false;
+    p_ += n;
+    return true;
+  }
+
+public:
+  JsonParser(const char* p, const char* end) noexcept : p_(p), end_(end) {}
+
+  bool
+  parse(Json& j, unsigned depth = 0) {
+    skip();
+    if(p_ == end_ || depth > JSON_DEPTH) return false;
+    switch(*p_) {
+    case '{':
+    case '[': {
+      const bool object = *p_++ == '{';
+      const char close = object ? '}' : ']';
+      j.type = object ? Json::JSON_OBJECT : Json::JSON_ARRAY;
+      skip();
+      if(p_ < end_ && *p_ == close) return ++p_, true;
+      for(;;) {
+        if(object) {
+          std::string_view k;
+          skip();
+          if(!string(k)) return false;
+          skip();
+          if(p_ == end_ || *p_++ != ':') return false;
+          j.keys.push_back(k);
+        }
+        j.items.emplace_back();
+        if(!parse(j.items.back(), depth + 1)) return false;
+        skip();
+        if(p_ == end_) return false;
+        if(*p_ == close) return ++p_, true;
+        if(*p_++ != ',') return false;
+      }
+    }
+    case '"':
+      j.type = Json::JSON_STRING;
+      return string(j.string);
+    case 't':
+      j.type = Json::JSON_BOOL, j.number = 1.;
+      return literal("true");
+    case 'f':
+      j.type = Json::JSON_BOOL;
+      return literal("false");
+    case 'n':
+      return literal("null");
+    default: {
+      char buf[64];
+      size_t n = 0;
+      while(p_ < end_ && n < sizeof(buf) - 1 && strchr("+-.0123456789eE", *p_) && *p_)
+        buf[n++] = *p_++;
+      buf[n] = 0;
+      char* e;
+      j.type = Json::JSON_NUMBER;
+      j.number = strtod(buf, &e);
+      return n && e == buf + n;
+    }
+    }
+  }
+
+  bool done() noexcept { skip(); return p_ == end_; }
+};
+
+bool
+integer(const Json* j, size_t& out, size_t fallback) noexcept {
+  if(!j) {
+    out = fallback;
+    return true;
+  }
+  if(j->type != Json::JSON_NUMBER || j->number < 0. || j->number > 9e15
+     || j->number != std::floor(j->number))
+    return false;
+  out = size_t(j->number);
+  return true;
+}
+
+// a bounds checked view of one accessor in the binary chunk
+struct Accessor {
+  const uint8_t* data;
+  size_t count, stride;
+  uint32_t component;
+  bool normalized;
+};
+
+size_t
+componentSize(uint32_t c) noexcept {
+  switch(c) {
+  case COMPONENT_BYTE:
+  case COMPONENT_UNSIGNED_BYTE: return 1;
+  case COMPONENT_SHORT:
+  case COMPONENT_UNSIGNED_SHORT: return 2;
+  case COMPONENT_UNSIGNED_INT:
+  case COMPONENT_FLOAT: return 4;
+  }
+  return 0;
+}
+
+bool
+accessor(const Json& doc, const Json* index, const uint8_t* bin, size_t binSize,
+         const char* type, unsigned components, Accessor& out) noexcept {
+  size_t i, view, buffer, viewOffset, viewLength, viewStride, offset, count, component;
+  const Json* a;
+  const Json* v;
+  const Json* t;
+  if(!index || !integer(index, i, 0) || !doc["accessors"] || !(a = doc["accessors"]->at(i))
+     || (*a)["sparse"] || !(*a)["bufferView"] || !integer((*a)["bufferView"], view, 0)
+     || !doc["bufferViews"] || !(v = doc["bufferViews"]->at(view))
+     || !integer((*v)["buffer"], buffer, SIZE_MAX) || buffer != 0
+     || !doc["buffers"] || !doc["buffers"]->at(0) || (*doc["buffers"]->at(0))["uri"]
+     || !integer((*v)["byteOffset"], viewOffset, 0) || !integer((*v)["byteLength"], viewLength, SIZE_MAX)
+     || !integer((*v)["byteStride"], viewStride, 0)
+     || !integer((*a)["byteOffset"], offset, 0) || !integer((*a)["count"], count, SIZE_MAX)
+     || !integer((*a)["componentType"], component, 0)
+     || !(t = (*a)["type"]) || t->type != Json::JSON_STRING || t->string != type)
+    return false;
+
+  const size_t size = componentSize(uint32_t(component)) * components;
+  const size_t stride = viewStride ? viewStride : size;
+  // the last element ends inside the view and the view inside the chunk
+  if(!size || stride < size || viewOffset > binSize || viewLength > binSize - viewOffset
+     || offset > viewLength || viewLength - offset < size || !count
+     || count - 1 > (viewLength - offset - size) / stride)
+    return false;
+
+  const Json* normalized = (*a)["normalized"];
+  out = { bin + viewOffset + offset, count, stride, uint32_t(component),
+          normalized && normalized->type == Json::JSON_BOOL && normalized->number != 0. };
+  return true;
+}
+
+inline float
+readFloat(const uint8_t* p) noexcept {
+  float f;
+  memcpy(&f, p, 4);
+  return f;
+}
+
+inline uint32_t
+readIndex(const Accessor& a, size_t i) noexcept {
+  const uint8_t* p = a.data + i * a.stride;
+  switch(a.component) {
+  case COMPONENT_UNSIGNED_BYTE: return *p;
+  case COMPONENT_UNSIGNED_SHORT: { uint16_t v; memcpy(&v, p, 2); return v; }
+  default: { uint32_t v; memcpy(&v, p, 4); return v; }
+  }
+}
+
+inline float
+readUnorm(const Accessor& a, const uint8_t* p) noexcept {
+  switch(a.component) {
+  case COMPONENT_UNSIGNED_BYTE: return *p * (1.f / 255.f);
+  case COMPONENT_UNSIGNED_SHORT: { uint16_t v; memcpy(&v, p, 2); return v * (1.f / 65535.f); }
+  default: return readFloat(p);
+  }
+}
+
+int
+primitive(const Json& doc, const Json& prim, const uint8_t* bin, size_t binSize, model::Mesh& out,
+          std::vector<uint32_t>& indices, HaruhiWorkerPool* pPool) {
+  size_t mode;
+  if(!integer(prim["mode"], mode, 4)) return -EINVAL;
+  // points, lines and strips are skipped
+  if(mode != 4) return 0;
+
+  const Json* attributes = prim["attributes"];
+  if(!attributes || attributes->type != Json::JSON_OBJECT) return -EINVAL;
+  Accessor pos, norm, tex, idx;
+  const bool hasNorm = (*attributes)["NORMAL"], hasTex = (*attributes)["TEXCOORD_0"];
+  if(!accessor(doc, (*attributes)["POSITION"], bin, binSize, "VEC3", 3, pos)
+     || pos.component != COMPONENT_FLOAT
+     || (hasNorm && (!accessor(doc, (*attributes)["NORMAL"], bin, binSize, "VEC3", 3, norm)
+                     || norm.component != COMPONENT_FLOAT || norm.count != pos.count))
+     || (hasTex && (!accessor(doc, (*attributes)["TEXCOORD_0"], bin, binSize, "VEC2", 2, tex)
+                    || tex.count != pos.count
+                    || (tex.component != COMPONENT_FLOAT
+                        && !(tex.normalized && (tex.component == COMPONENT_UNSIGNED_BYTE
+                                                || tex.component == COMPONENT_UNSIGNED_SHORT))))))
+    return -EINVAL;
+
+  const size_t base = out.vertices.size(), first = indices.size();
+  if(prim["indices"]) {
+    if(!accessor(doc, prim["indices"], bin, binSize, "SCALAR", 1, idx)
+       || (idx.component != COMPONENT_UNSIGNED_BYTE && idx.component != COMPONENT_UNSIGNED_SHORT
+           && idx.component != COMPONENT_UNSIGNED_INT)
+       || idx.count % 3)
+      return -EINVAL;
+    indices.resize(first + idx.count);
+    for(size_t i = 0; i < idx.count; ++i) {
+      const uint32_t k = readIndex(idx, i);
+      if(k >= pos.count) return -EINVAL;
+      indices[first + i] = uint32_t(base + k);
+    }
+  } else {
+    if(pos.count % 3) return -EINVAL;
+    indices.resize(first + pos.count);
+    for(size_t i = 0; i < pos.count; ++i)
+      indices[first + i] = uint32_t(base + i);
+  }
+  if(base + pos.count > UINT32_MAX) return -EINVAL;
+
+  out.vertices.resize(base + pos.count);
+  VertexData* dst = out.vertices.data() + base;
+  forRange(pPool, pos.count, 1 << 14, [&](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i) {
+      const uint8_t* p = pos.data + i * pos.stride;
+      dst[i].pos = { readFloat(p), readFloat(p + 4), readFloat(p + 8) };
+      if(hasNorm) {
+        p = norm.data + i * norm.stride;
+        dst[i].norm = { readFloat(p), readFloat(p + 4), readFloat(p + 8) };
+      }
+      if(hasTex) {
+        p = tex.data + i * tex.stride;
+        const size_t s = componentSize(tex.component);
+        dst[i].texcoord = { readUnorm(tex, p), readUnorm(tex, p + s) };
+      } else {
+        dst[i].texcoord = { 0.f, 0.f };
+      }
+    }
+  });
+  if(!hasNorm) {
+    const std::vector<math::float3> smooth = smoothNormals(
+      pos.count, indices.size() - first, [&](size_t i) { return indices[first + i] - uint32_t(base); },
+      [&](uint32_t i) { return dst[i].pos; });
+    for(size_t i = 0; i < pos.count; ++i) dst[i].norm = smooth[i];
+  }
+  return 0;
+}
+
+uint32_t
+read32(const uint8_t* p) noexcept {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+} // ns
+
+namespace model {
+
+void
+Mesh::clear() noexcept {
+  vertices.clear();
+  indices16.clear();
+  indices32.clear();
+  min = max = math::float3();
+}
+
+const char*
+parseFloat(const char* p, const char* end, float& out) noexcept {
+  const char* start = p;
+  bool neg = false;
+  if(p < end && (*p == '-' || *p == '+')) neg = *p++ == '-';
+
+  // up to 19 significant digits in m, more go through strtod
+  uint64_t m = 0;
+  int digits = 0, exp = 0;
+  bool exact = true;
+  auto run = [&](bool fraction) {
+    const char* b = p;
+    uint64_t v;
+    while(end - p >= 8 && digits <= 11 && eightDigits(p, v)) {
+      m = m * 100000000 + v;
+      if(m) digits += 8;
+      if(fraction) exp -= 8;
+      p += 8;
+    }
+    for(; p < end && isDigit(*p); ++p) {
+      if(digits < 19) {
+        m = m * 10 + (*p - '0');
+        if(m) ++digits;
+        if(fraction) --exp;
+      } else {
+        exact = false;
+      }
+    }
+    return p - b;
+  };
+
+  const ptrdiff_t whole = run(false);
+  ptrdiff_t fraction = 0;
+  if(p < end && *p == '.') {
+    ++p;
+    fraction = run(true);
+  }
+  if(!whole && !fraction) return nullptr;
+
+  if(p < end && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool eneg = false;
+    if(q < end && (*q == '-' || *q == '+')) eneg = *q++ == '-';
+    if(q < end && isDigit(*q)) {
+      int e = 0;
+      for(; q < end && isDigit(*q); ++q)
+        if(e < 100000) e = e * 10 + (*q - '0');
+      exp += eneg ? -e : e;
+      p = q;
+    }
+  }
+
+  if(!exact) {
+    out = strtof(std::string(start, p).c_str(), nullptr);
+    return p;
+  }
+
+  double d = double(m);
+  if(!m) {
+    d = 0.;
+  } else if(exp < -400) {
+    d = 0.;
+  } else if(exp > 400) {
+    d = HUGE_VAL;
+  } else {
+    for(; exp < -22; exp += 22) d /= 1e22;
+    for(; exp > 22; exp -= 22) d *= 1e22;
+    d = exp < 0 ? d / POW10[-exp] : d * POW10[exp];
+  }
+  out = float(neg ? -d : d);
+  return p;
+}
+
+int
+parseObj(const char* text, size_t size, Mesh& out, HaruhiWorkerPool* pPool, LoadStats* pStats) noexcept {
+  HARUHI_PROFILE_SCOPE("parseObj");
+  out.clear();
+  uint64_t t = prof::now();
+
+  // cut after line ends, every chunk starts a line
+  std::vector<Chunk> chunks;
+  const char* end = text + size;
+  for(const char* p = text; p < end;) {
+    const char* e = p + std::min<size_t>(CHUNK_BYTES, end - p);
+    if(e < end) {
+      const char* nl = static_cast<const char*>(memchr(e, '\n', end - e));
+      e = nl ? nl + 1 : end;
+    }
+    chunks.push_back({ p, e, {}, {}, {}, {}, 0, 0, 0, 0, false });
+    p = e;
+  }
+  forRange(pPool, chunks.size(), 1, [&](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i)
+      chunks[i].failed = !parseChunk(chunks[i]);
+  });
+  for(const Chunk& c : chunks)
+    if(c.failed) return -EINVAL;
+  if(pStats) {
+    pStats->bytes = size;
+    pStats->parseMs = elapsedMs(t);
+    t = prof::now();
+  }
+
+  int err = buildObj(chunks, out, pPool);
+  if(err) out.clear();
+  if(pStats) pStats->buildMs = elapsedMs(t);
+  return err;
+}
+
+int
+parseGlb(const uint8_t* data, size_t size, Mesh& out, HaruhiWorkerPool* pPool, LoadStats* pStats) noexcept {
+  HARUHI_PROFILE_SCOPE("parseGlb");
+  out.clear();
+  const uint64_t t = prof::now();
+
+  // header, then the json chunk and an optional binary one
+  if(size < 20 || read32(data) != GLB_MAGIC || read32(data + 4) != 2 || read32(data + 8) < 20 ||
+     read32(data + 8) > size)
+    return -EINVAL;
+  size = read32(data + 8);
+  const size_t jsonSize = read32(data + 12);
+  if(read32(data + 16) != GLB_JSON || jsonSize > size - 20) return -EINVAL;
+  const char* json = reinterpret_cast<const char*>(data + 20);
+  const uint8_t* bin = nullptr;
+  size_t binSize = 0;
+  const size_t next = 20 + (jsonSize + 3) / 4 * 4;
+  if(next + 8 <= size && read32(data + next + 4) == GLB_BIN) {
+    binSize = read32(data + next);
+    if(binSize > size - next - 8) return -EINVAL;
+    bin = data + next + 8;
+  }
+
+  Json doc;
+  JsonParser parser(json, json + jsonSize);
+  if(!parser.parse(doc) || !parser.done() || doc.type != Json::JSON_OBJECT) return -EINVAL;
+
+  std::vector<uint32_t> indices;
+  int err = 0;
+  if(const Json* meshes = doc["meshes"]) {
+    for(const Json& m : meshes->items) {
+      const Json* prims = m["primitives"];
+      if(!prims || prims->type != Json::JSON_ARRAY) {
+        err = -EINVAL;
+        break;
+      }
+      for(const Json& p : prims->items)
+        if((err = primitive(doc, p, bin, binSize, out, indices, pPool))) break;
+      if(err) break;
+    }
+  }
+  if(!err && indices.empty()) err = -EINVAL;
+  if(err) {
+    out.clear();
+    return err;
+  }
+  finish(out, indices);
+  if(pStats) {
+    pStats->bytes = size;
+    pStats->parseMs = elapsedMs(t);
+    pStats->buildMs = 0.;
+  }
+  return 0;
+}
+
+int
+loadObj(const char* pth, Mesh& out, HaruhiWorkerPool* pPool, LoadStats* pStats) noexcept {
+  HARUHI_PROFILE_SCOPE("loadObj");
+  const uint64_t t = prof::now();
+  Mapping m;
+  if(int err = m.open(pth)) {
+    out.clear();
+    return err;
+  }
+  const double mapMs = elapsedMs(t);
+  const int err = parseObj(reinterpret_cast<const char*>(m.data()), m.size(), out, pPool, pStats);
+  if(pStats) pStats->mapMs = mapMs;
+  return err;
+}
+
+int
+loadGlb(const char* pth, Mesh& out, HaruhiWorkerPool* pPool, LoadStats* pStats) noexcept {
+  HARUHI_PROFILE_SCOPE("loadGlb");
+  const uint64_t t = prof::now();
+  Mapping m;
+  if(int err = m.open(pth)) {
+    out.clear();
+    return err;
+  }
+  const double mapMs = elapsedMs(t);
+  const int err = parseGlb(m.data(), m.size(), out, pPool, pStats);
+  if(pStats) pStats->mapMs = mapMs;
+  return err;
+}
+
+int
+load(const char* pth, Mesh& out, HaruhiWorkerPool* pPool, LoadStats* pStats) noexcept {
+  const char* ext = strrchr(pth, '.');
+  if(ext && !strcasecmp(ext, ".obj")) return loadObj(pth, out, pPool, pStats);
+  if(ext && !strcasecmp(ext, ".glb")) return loadGlb(pth, out, pPool, pStats);
+  out.clear();
+  return -EINVAL;
+}
+
+} // ns model
\ No newline at end of file
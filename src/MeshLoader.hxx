@@ -0,0 +1,59 @@
+#ifndef HARUHI_MESHLOADER_HXX
+#define HARUHI_MESHLOADER_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ShaderTypes.hxx"
+
+class HaruhiWorkerPool;
+
+// wavefront obj and binary gltf (glb) meshes, mapped and parsed on the pool
+//
+// obj text is cut into chunks at line ends and parsed in parallel, digits
+// eight at a time. face corners are deduplicated into vertices by their
+// (position, texcoord, normal) triple in hash partitions, one per job,
+// and vertices end up in first use order. faces are fanned into
+// triangles, missing normals are averaged from the faces, texcoords are
+// flipped to the top left origin gltf and metal use. groups, materials
+// and everything but v, vt, vn and f are skipped.
+//
+// glb primitives of every mesh are appended in mesh space, the node tree
+// is ignored. only triangle lists stored in the file's binary chunk load
+namespace model {
+
+struct Mesh {
+  std::vector<shader_t::VertexData> vertices;
+  // one of the two, 16 bit when the vertices fit
+  std::vector<uint16_t> indices16;
+  std::vector<uint32_t> indices32;
+  math::float3 min, max;
+
+  bool wide() const noexcept { return !indices32.empty(); }
+  size_t indexCount() const noexcept { return indices16.size() + indices32.size(); }
+  void clear() noexcept;
+};
+
+struct LoadStats {
+  size_t bytes;
+  double mapMs, parseMs, buildMs; // build resolves, deduplicates and indexes
+};
+
+// by extension. 0, -errno when the file can't be mapped or -EINVAL when it
+// is malformed or uses what isn't supported
+int load(const char*, Mesh&, HaruhiWorkerPool* = nullptr, LoadStats* = nullptr) noexcept;
+int loadObj(const char*, Mesh&, HaruhiWorkerPool* = nullptr, LoadStats* = nullptr) noexcept;
+int loadGlb(const char*, Mesh&, HaruhiWorkerPool* = nullptr, LoadStats* = nullptr) noexcept;
+
+// the same from memory
+int parseObj(const char*, size_t, Mesh&, HaruhiWorkerPool* = nullptr, LoadStats* = nullptr) noexcept;
+int parseGlb(const uint8_t*, size_t, Mesh&, HaruhiWorkerPool* = nullptr, LoadStats* = nullptr) noexcept;
+
+// one decimal float as written in obj files, nullptr when there is none
+// at the pointer. stops at the end pointer
+const char* parseFloat(const char*, const char*, float&) noexcept;
+
+} // ns model
+
+#endif
\ No newline at end of file
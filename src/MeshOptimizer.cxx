@@ -0,0 +1,325 @@
+#include "MeshOptimizer.hxx"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr size_t FETCH_LINE = 64;
+constexpr unsigned FETCH_LINES = 4096 / FETCH_LINE;
+constexpr uint32_t UNUSED = ~0u;
+
+// fifo membership by insertion stamps, no shifting around
+class FifoCache {
+  std::vector<uint32_t> stamp_;
+  uint32_t time_;
+  unsigned size_;
+
+public:
+  FifoCache(size_t entries, unsigned size) : stamp_(entries, 0), time_(size + 1), size_(size) {}
+
+  // true on a miss, which inserts
+  bool
+  access(size_t e) noexcept {
+    if(time_ - stamp_[e] <= size_) return false;
+    stamp_[e] = time_++;
+    return true;
+  }
+
+  void restart() noexcept { time_ += size_ + 1; }
+};
+
+// forsyth's scores, the last triangle's vertices a flat bonus so the
+// next one doesn't simply continue a strip backwards. tabled, they are
+// looked up for every vertex of the cache after every triangle
+constexpr uint32_t VALENCE_TABLE = 32;
+
+struct ScoreTable {
+  float position[mesh::CACHE_SIZE + 1]; // the last one for not cached
+  float valence[VALENCE_TABLE];
+
+  ScoreTable() noexcept {
+    for(unsigned p = 0; p < mesh::CACHE_SIZE; ++p)
+      position[p] = p < 3 ? .75f : std::pow(1.f - float(p - 3) / float(mesh::CACHE_SIZE - 3), 1.5f);
+    position[mesh::CACHE_SIZE] = 0.f;
+    for(uint32_t v = 1; v < VALENCE_TABLE; ++v)
+      valence[v] = 2.f / std::sqrt(float(v));
+    valence[0] = 0.f;
+  }
+
+  float
+  operator()(int p, uint32_t remaining) const noexcept {
+    if(!remaining) return -1.f;
+    return position[p < 0 ? mesh::CACHE_SIZE : p]
+      + (remaining < VALENCE_TABLE ? valence[remaining] : 2.f / std::sqrt(float(remaining)));
+  }
+};
+
+struct Vec {
+  double x, y, z;
+};
+
+Vec
+sub(const math::float3& a, const math::float3& b) noexcept {
+  return { double(a.x) - b.x, double(a.y) - b.y, double(a.z) - b.z };
+}
+
+Vec
+cross(const Vec& a, const Vec& b) noexcept {
+  return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+} // ns
+
+namespace mesh {
+
+template <typename Index>
+CacheStats
+analyzeVertexCache(const Index* pIdx, size_t count, size_t vertices, unsigned cacheSize) {
+  FifoCache cache(vertices, cacheSize);
+  std::vector<uint8_t> seen(vertices, 0);
+  size_t transformed = 0, unique = 0;
+  for(size_t i = 0; i < count; ++i) {
+    transformed += cache.access(pIdx[i]);
+    unique += !seen[pIdx[i]];
+    seen[pIdx[i]] = 1;
+  }
+  return { transformed,
+           count ? double(transformed) / double(count / 3) : 0.,
+           unique ? double(transformed) / double(unique) : 0. };
+}
+
+template <typename Index>
+FetchStats
+analyzeVertexFetch(const Index* pIdx, size_t count, size_t vertices, size_t vertexSize) {
+  FifoCache cache((vertices * vertexSize + FETCH_LINE - 1) / FETCH_LINE, FETCH_LINES);
+  std::vector<uint8_t> seen(vertices, 0);
+  size_t lines = 0, unique = 0;
+  for(size_t i = 0; i < count; ++i) {
+    const size_t v = pIdx[i];
+    unique += !seen[v];
+    seen[v] = 1;
+    for(size_t l = v * vertexSize / FETCH_LINE; l <= (v * vertexSize + vertexSize - 1) / FETCH_LINE; ++l)
+      lines += cache.access(l);
+  }
+  return { lines * FETCH_LINE, unique ? double(lines * FETCH_LINE) / double(unique * vertexSize) : 0. };
+}
+
+template <typename Index>
+void
+optimizeVertexCache(Index* pDst, const Index* pIdx, size_t count, size_t vertices) {
+  const size_t tris = count / 3;
+  if(!tris) return;
+
+  // live triangles of every vertex at the front of its adjacency range,
+  // kept together as the scrambled inputs this is for miss on every vertex
+  struct Vertex {
+    uint32_t first, live;
+    float score;
+  };
+  std::vector<Vertex> vs(vertices, { 0, 0, 0.f });
+  std::vector<uint32_t> adj(tris * 3);
+  for(size_t i = 0; i < tris * 3; ++i) ++vs[pIdx[i]].live;
+  for(size_t v = 1; v < vertices; ++v) vs[v].first = vs[v - 1].first + vs[v - 1].live;
+  {
+    std::vector<uint32_t> fill(vertices);
+    for(size_t v = 0; v < vertices; ++v) fill[v] = vs[v].first;
+    for(size_t i = 0; i < tris * 3; ++i) adj[fill[pIdx[i]]++] = uint32_t(i / 3);
+  }
+
+  static const ScoreTable vertexScore;
+  std::vector<float> tscore(tris, 0.f);
+  std::vector<uint8_t> emitted(tris, 0);
+  for(Vertex& v : vs) v.score = vertexScore(-1, v.live);
+  for(size_t t = 0; t < tris; ++t)
+    for(int k = 0; k < 3; ++k) tscore[t] += vs[pIdx[t * 3 + k]].score;
+
+  uint32_t cache[CACHE_SIZE + 3], next[CACHE_SIZE + 3];
+  size_t cached = 0, cursor = 0;
+  size_t best = std::max_element(tscore.begin(), tscore.end()) - tscore.begin();
+  for(size_t out = 0; out < tris; ++out) {
+    // nothing in the cache left to continue with, the next in input order
+    if(best == SIZE_MAX) {
+      while(emitted[cursor]) ++cursor;
+      best = cursor;
+    }
+    const size_t t = best;
+    emitted[t] = 1;
+    const Index* tri = pIdx + t * 3;
+    std::copy(tri, tri + 3, pDst + out * 3);
+
+    size_t n = 0;
+    for(int k = 0; k < 3; ++k) {
+      Vertex& v = vs[tri[k]];
+      uint32_t* b = &adj[v.first];
+      uint32_t* e = b + v.live;
+      std::swap(*std::find(b, e, uint32_t(t)), e[-1]);
+      --v.live;
+      if(std::find(next, next + n, uint32_t(tri[k])) == next + n) next[n++] = tri[k];
+    }
+    for(size_t i = 0; i < cached; ++i)
+      if(cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2]) next[n++] = cache[i];
+
+    // the ones pushed past the end leave the cache
+    for(size_t i = 0; i < n; ++i) {
+      Vertex& v = vs[next[i]];
+      const float s = vertexScore(i < CACHE_SIZE ? int(i) : -1, v.live);
+      const float d = s - v.score;
+      v.score = s;
+      for(uint32_t j = v.first; j < v.first + v.live; ++j) tscore[adj[j]] += d;
+    }
+    cached = std::min<size_t>(n, CACHE_SIZE);
+    std::copy(next, next + cached, cache);
+
+    best = SIZE_MAX;
+    float bestScore = -1e30f;
+    for(size_t i = 0; i < cached; ++i) {
+      const Vertex& v = vs[cache[i]];
+      for(uint32_t j = v.first; j < v.first + v.live; ++j)
+        if(tscore[adj[j]] > bestScore) {
+          bestScore = tscore[adj[j]];
+          best = adj[j];
+        }
+    }
+  }
+}
+
+template <typename Index>
+void
+optimizeOverdraw(Index* pDst, const Index* pIdx, size_t count, const shader_t::VertexData* pVerts,
+                 size_t vertices, float threshold) {
+  const size_t tris = count / 3;
+  if(!tris) return;
+
+  // hard boundaries where a triangle misses with every vertex, the order
+  // had no locality there anyway
+  std::vector<size_t> hard;
+  {
+    FifoCache cache(vertices, CACHE_SIZE);
+    for(size_t t = 0; t < tris; ++t) {
+      int misses = 0;
+      for(int k = 0; k < 3; ++k) misses += cache.access(pIdx[t * 3 + k]);
+      if(misses == 3 || !t) hard.push_back(t);
+    }
+    hard.push_back(tris);
+  }
+
+  // soft ones inside, once a cluster started on a cold cache is about as
+  // good as the whole hard cluster
+  std::vector<size_t> clusters;
+  {
+    FifoCache cache(vertices, CACHE_SIZE);
+    for(size_t h = 0; h + 1 < hard.size(); ++h) {
+      const size_t b = hard[h], e = hard[h + 1];
+      cache.restart();
+      size_t misses = 0;
+      for(size_t i = b * 3; i < e * 3; ++i) misses += cache.access(pIdx[i]);
+      const double limit = threshold * double(misses) / double(e - b);
+
+      cache.restart();
+      size_t start = b;
+      misses = 0;
+      clusters.push_back(b);
+      for(size_t t = b; t < e; ++t) {
+        for(int k = 0; k < 3; ++k) misses += cache.access(pIdx[t * 3 + k]);
+        if(t + 1 < e && double(misses) / double(t + 1 - start) <= limit) {
+          clusters.push_back(t + 1);
+          start = t + 1;
+          misses = 0;
+          cache.restart();
+        }
+      }
+    }
+    clusters.push_back(tris);
+  }
+
+  // area weighted centroids and normals
+  struct Cluster {
+    size_t begin, end;
+    double key;
+  };
+  std::vector<Cluster> sorted;
+  std::vector<Vec> centroid, normal;
+  Vec total = { 0., 0., 0. };
+  double totalArea = 0.;
+  for(size_t c = 0; c + 1 < clusters.size(); ++c) {
+    Vec cc = { 0., 0., 0. }, cn = { 0., 0., 0. };
+    double area = 0.;
+    for(size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+      const math::float3& a = pVerts[pIdx[t * 3]].pos;
+      const math::float3& b = pVerts[pIdx[t * 3 + 1]].pos;
+      const math::float3& d = pVerts[pIdx[t * 3 + 2]].pos;
+      const Vec n = cross(sub(b, a), sub(d, a));
+      const double w = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+      cc = { cc.x + w * (double(a.x) + b.x + d.x) / 3., cc.y + w * (double(a.y) + b.y + d.y) / 3.,
+             cc.z + w * (double(a.z) + b.z + d.z) / 3. };
+      cn = { cn.x + n.x, cn.y + n.y, cn.z + n.z };
+      area += w;
+    }
+    total = { total.x + cc.x, total.y + cc.y, total.z + cc.z };
+    totalArea += area;
+    if(area > 0.) cc = { cc.x / area, cc.y / area, cc.z / area };
+    centroid.push_back(cc);
+    normal.push_back(cn);
+    sorted.push_back({ clusters[c], clusters[c + 1], 0. });
+  }
+  if(totalArea > 0.) total = { total.x / totalArea, total.y / totalArea, total.z / totalArea };
+
+  for(size_t c = 0; c < sorted.size(); ++c) {
+    const Vec& n = normal[c];
+    const double l = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+    if(l > 0.)
+      sorted[c].key = ((centroid[c].x - total.x) * n.x + (centroid[c].y - total.y) * n.y
+                       + (centroid[c].z - total.z) * n.z) / l;
+  }
+  std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) {
+    return a.key > b.key;
+  });
+
+  Index* p = pDst;
+  for(const Cluster& c : sorted)
+    p = std::copy(pIdx + c.begin * 3, pIdx + c.end * 3, p);
+}
+
+template <typename Index>
+size_t
+optimizeVertexFetchRemap(uint32_t* pRemap, const Index* pIdx, size_t count, size_t vertices) {
+  std::fill(pRemap, pRemap + vertices, UNUSED);
+  uint32_t next = 0;
+  for(size_t i = 0; i < count; ++i)
+    if(pRemap[pIdx[i]] == UNUSED) pRemap[pIdx[i]] = next++;
+  return next;
+}
+
+template <typename Index>
+void
+remapIndices(Index* pDst, const Index* pIdx, size_t count, const uint32_t* pRemap) noexcept {
+  for(size_t i = 0; i < count; ++i)
+    pDst[i] = Index(pRemap[pIdx[i]]);
+}
+
+void
+remapVertices(void* pDst, const void* pSrc, size_t vertices, size_t vertexSize,
+              const uint32_t* pRemap) noexcept {
+  for(size_t v = 0; v < vertices; ++v)
+    if(pRemap[v] != UNUSED)
+      memcpy(static_cast<char*>(pDst) + pRemap[v] * vertexSize,
+             static_cast<const char*>(pSrc) + v * vertexSize, vertexSize);
+}
+
+#define HARUHI_MESH_INSTANTIATE(Index) \
+  template CacheStats analyzeVertexCache(const Index*, size_t, size_t, unsigned); \
+  template FetchStats analyzeVertexFetch(const Index*, size_t, size_t, size_t); \
+  template void optimizeVertexCache(Index*, const Index*, size_t, size_t); \
+  template void optimizeOverdraw(Index*, const Index*, size_t, const shader_t::VertexData*, size_t, float); \
+  template size_t optimizeVertexFetchRemap(uint32_t*, const Index*, size_t, size_t); \
+  template void remapIndices(Index*, const Index*, size_t, const uint32_t*) noexcept;
+
+HARUHI_MESH_INSTANTIATE(uint16_t)
+HARUHI_MESH_INSTANTIATE(uint32_t)
+
+#undef HARUHI_MESH_INSTANTIATE
+
+} // ns mesh
\ No newline at end of file
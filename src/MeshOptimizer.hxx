@@ -0,0 +1,67 @@
+#ifndef HARUHI_MESHOPTIMIZER_HXX
+#define HARUHI_MESHOPTIMIZER_HXX
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ShaderTypes.hxx"
+
+// index and vertex order for the gpu's caches, and the stats to check it
+//
+// the usual pipeline is optimizeVertexCache, then optimizeOverdraw on its
+// output, then the fetch remap applied to the indices and the vertices.
+// reordering keeps every triangle and its winding. the functions take
+// uint16_t or uint32_t indices, output and input must not alias
+namespace mesh {
+
+// the post transform cache modeled, a fifo of transformed vertices
+constexpr unsigned CACHE_SIZE =
+#ifndef HARUHI_VERTEX_CACHE_SIZE
+16;
+#else
+HARUHI_VERTEX_CACHE_SIZE;
+#endif
+
+// vertex shader runs through the fifo cache
+struct CacheStats {
+  size_t transformed;
+  double acmr; // per triangle, 3 worst, about .5 best on regular grids
+  double atvr; // per vertex referenced, 1 best
+};
+
+// vertex bytes read through 64 byte lines and a 4k cache
+struct FetchStats {
+  size_t bytes;
+  double overfetch; // over the size of the referenced vertices, 1 best
+};
+
+template <typename Index>
+CacheStats analyzeVertexCache(const Index*, size_t, size_t, unsigned = CACHE_SIZE);
+// vertex size last
+template <typename Index>
+FetchStats analyzeVertexFetch(const Index*, size_t, size_t, size_t);
+
+// greedy triangle order by vertex scores (forsyth's linear speed
+// optimization), keeping recently used and nearly finished vertices hot
+template <typename Index>
+void optimizeVertexCache(Index*, const Index*, size_t, size_t);
+
+// splits a cache optimized order into clusters where restarting the
+// cache costs no more than threshold times the acmr, and sorts them
+// outward facing first so they tend to hide the rest
+template <typename Index>
+void optimizeOverdraw(Index*, const Index*, size_t, const shader_t::VertexData*, size_t,
+                      float = 1.05f);
+
+// the new place of every vertex in first use order, ~0u for unused ones.
+// returns how many are used
+template <typename Index>
+size_t optimizeVertexFetchRemap(uint32_t*, const Index*, size_t, size_t);
+template <typename Index>
+void remapIndices(Index*, const Index*, size_t, const uint32_t*) noexcept;
+// vertex count and size, then the remap
+void remapVertices(void*, const void*, size_t, size_t, const uint32_t*) noexcept;
+
+} // ns mesh
+
+#endif
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "MetalDraw.hxx"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <Metal/Metal.hpp>
+
+namespace {
+
+template <typename T>
+uint16_t
+append(std::vector<T*>& table, T* p) {
+  if(table.size() >= cmd::NONE) {
+    printf("out of draw backend ids\n");
+    abort();
+  }
+  table.push_back(p);
+  return uint16_t(table.size() - 1);
+}
+
+} // ns
+
+uint16_t
+HaruhiMetalDrawBackend::addPipeline(MTL::RenderPipelineState* p) {
+  return append(pipelines_, p);
+}
+
+uint16_t
+HaruhiMetalDrawBackend::addDepthState(MTL::DepthStencilState* p) {
+  return append(depth_states_, p);
+}
+
+uint16_t
+HaruhiMetalDrawBackend::addTexture(MTL::Texture* p) {
+  return append(textures_, p);
+}
+
+uint16_t
+HaruhiMetalDrawBackend::addBuffer(MTL::Buffer* p) {
+  if(free_buffers_.empty())
+    return append(buffers_, p);
+  const uint16_t id = free_buffers_.back();
+  free_buffers_.pop_back();
+  buffers_[id] = p;
+  return id;
+}
+
+void
+HaruhiMetalDrawBackend::removeBuffer(uint16_t id) {
+  buffers_[id] = nullptr;
+  free_buffers_.push_back(id);
+}
+
+void
+HaruhiMetalDrawBackend::begin(MTL::RenderCommandEncoder* pEncoder) noexcept {
+  p_encoder_ = pEncoder;
+  instance_buffer_ = cmd::NONE;
+}
+
+void
+HaruhiMetalDrawBackend::setPipeline(uint16_t id) noexcept {
+  p_encoder_->setRenderPipelineState(pipelines_[id]);
+}
+
+void
+HaruhiMetalDrawBackend::setDepthState(uint16_t id) noexcept {
+  p_encoder_->setDepthStencilState(depth_states_[id]);
+}
+
+void
+HaruhiMetalDrawBackend::setTexture(uint16_t id) noexcept {
+  p_encoder_->setFragmentTexture(textures_[id], 0);
+}
+
+void
+HaruhiMetalDrawBackend::setVertexBuffer(uint16_t id) noexcept {
+  p_encoder_->setVertexBuffer(buffers_[id], 0, 0);
+}
+
+// moving within the bound buffer only changes the offset
+void
+HaruhiMetalDrawBackend::setInstanceBuffer(uint16_t id, uint32_t offset) noexcept {
+  if(id == instance_buffer_)
+    p_encoder_->setVertexBufferOffset(offset, 1);
+  else
+    p_encoder_->setVertexBuffer(buffers_[id], offset, 1);
+  instance_buffer_ = id;
+}
+
+void
+HaruhiMetalDrawBackend::drawIndexed(uint16_t indices, uint32_t first, uint32_t count,
+                                    uint32_t instances, int32_t baseVertex) noexcept {
+  p_encoder_->drawIndexedPrimitives(
+    MTL::PrimitiveTypeTriangle,
+    count,
+    MTL::IndexType::IndexTypeUInt16,
+    buffers_[indices],
+    first * sizeof(uint16_t),
+    instances, baseVertex, 0);
+}
\ No newline at end of file
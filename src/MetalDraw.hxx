@@ -0,0 +1,50 @@
+#ifndef HARUHI_METALDRAW_HXX
+#define HARUHI_METALDRAW_HXX
+
+#include <vector>
+
+#include "DrawQueue.hxx"
+
+namespace MTL {
+class Buffer;
+class DepthStencilState;
+class RenderCommandEncoder;
+class RenderPipelineState;
+class Texture;
+} // ns MTL
+
+// draw packets into a render command encoder. ids index tables of objects
+// added up front, nothing is retained. vertices go to buffer 0, instances
+// to buffer 1, the texture to fragment texture 0. whatever else the pass
+// needs is bound on the encoder before submitting
+class HaruhiMetalDrawBackend : public HaruhiDrawBackend {
+  MTL::RenderCommandEncoder* p_encoder_;
+  std::vector<MTL::RenderPipelineState*> pipelines_;
+  std::vector<MTL::DepthStencilState*> depth_states_;
+  std::vector<MTL::Texture*> textures_;
+  std::vector<MTL::Buffer*> buffers_;
+  std::vector<uint16_t> free_buffers_;
+  uint16_t instance_buffer_;
+
+public:
+  HaruhiMetalDrawBackend() : p_encoder_(nullptr), instance_buffer_(cmd::NONE) {}
+
+  uint16_t addPipeline(MTL::RenderPipelineState*);
+  uint16_t addDepthState(MTL::DepthStencilState*);
+  uint16_t addTexture(MTL::Texture*);
+  // buffers come and go with the chunks, their ids are reused
+  uint16_t addBuffer(MTL::Buffer*);
+  void removeBuffer(uint16_t);
+
+  // the encoder the next submit goes to
+  void begin(MTL::RenderCommandEncoder*) noexcept;
+
+  void setPipeline(uint16_t) noexcept override;
+  void setDepthState(uint16_t) noexcept override;
+  void setTexture(uint16_t) noexcept override;
+  void setVertexBuffer(uint16_t) noexcept override;
+  void setInstanceBuffer(uint16_t, uint32_t) noexcept override;
+  void drawIndexed(uint16_t, uint32_t, uint32_t, uint32_t, int32_t) noexcept override;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,31 @@
+#include "MetalProfiler.hxx"
+
+#include <mach/mach_time.h>
+
+#include <Metal/Metal.hpp>
+
+namespace {
+
+// prof::now minus mach host time, both in ns
+int64_t
+hostClockOffset() noexcept {
+  static const double ns_per_tick = [] {
+    mach_timebase_info_data_t tb;
+    mach_timebase_info(&tb);
+    return double(tb.numer) / double(tb.denom);
+  }();
+  const uint64_t host = mach_absolute_time();
+  return int64_t(prof::now()) - int64_t(double(host) * ns_per_tick);
+}
+
+} // ns
+
+void
+HaruhiMetalGpuTimer::track(const char* name, void* pCmdBuf) noexcept {
+  static_cast<MTL::CommandBuffer*>(pCmdBuf)->addCompletedHandler([name](MTL::CommandBuffer* p_cmd) {
+    const double start = p_cmd->GPUStartTime(), end = p_cmd->GPUEndTime();
+    if(end <= start) return; // failed or never ran
+    const int64_t offset = hostClockOffset();
+    prof::gpu(name, uint64_t(int64_t(start * 1e9) + offset), uint64_t(int64_t(end * 1e9) + offset));
+  });
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#ifndef HARUHI_METALPROFILER_HXX
+#define HARUHI_METALPROFILER_HXX
+
+#include "Profiler.hxx"
+
+// reports a command buffer's gpu start and end as a gpu event once it
+// completes. metal's times are host seconds since boot, shifted onto
+// prof::now's clock when they arrive
+class HaruhiMetalGpuTimer : public HaruhiGpuTimer {
+public:
+  // before the command buffer is committed
+  void track(const char*, void*) noexcept override;
+};
+
+#endif
\ No newline at end of file
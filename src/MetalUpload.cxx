@@ -0,0 +1,21 @@
+#include "MetalUpload.hxx"
+
+#include <Metal/Metal.hpp>
+
+bool
+HaruhiMetalUploadBackend::allocate(size_t size, Page& page) noexcept {
+  MTL::Buffer* buf = p_device_->newBuffer(size, MTL::ResourceStorageModeManaged);
+  if(!buf) return false;
+  page = { static_cast<uint8_t*>(buf->contents()), size, buf };
+  return true;
+}
+
+void
+HaruhiMetalUploadBackend::free(const Page& page) noexcept {
+  static_cast<MTL::Buffer*>(page.buffer)->release();
+}
+
+void
+HaruhiMetalUploadBackend::flush(const Page& page, size_t offset, size_t size) noexcept {
+  static_cast<MTL::Buffer*>(page.buffer)->didModifyRange(NS::Range::Make(offset, size));
+}
\ No newline at end of file
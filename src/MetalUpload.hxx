@@ -0,0 +1,21 @@
+#ifndef HARUHI_METALUPLOAD_HXX
+#define HARUHI_METALUPLOAD_HXX
+
+#include "FrameAllocator.hxx"
+
+namespace MTL {
+class Device;
+} // ns MTL
+
+// managed buffers, flushes become didModifyRange. page.buffer is the MTL::Buffer
+class HaruhiMetalUploadBackend : public HaruhiUploadBackend {
+  MTL::Device* p_device_;
+public:
+  explicit HaruhiMetalUploadBackend(MTL::Device* pDevice) : p_device_(pDevice) {}
+
+  bool allocate(size_t, Page&) noexcept override;
+  void free(const Page&) noexcept override;
+  void flush(const Page&, size_t, size_t) noexcept override;
+};
+
+#endif
\ No newline at end of file
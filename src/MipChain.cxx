@@ -0,0 +1,203 @@
+#include "MipChain.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+#include "ColorUtil.hxx"
+#include "WorkerPool.hxx"
+
+namespace {
+
+// box footprint of destination texel d along one axis
+struct Taps {
+  uint32_t first, count;
+  float w[3];
+};
+
+Taps
+taps(uint32_t src, uint32_t dst, uint32_t d) noexcept {
+  if(src == 1) return { 0, 1, { 1.f, 0.f, 0.f } };
+  if(src % 2 == 0) return { 2 * d, 2, { .5f, .5f, 0.f } };
+  const float inv = 1.f / (2 * dst + 1);
+  return { 2 * d, 3, { (dst - d) * inv, dst * inv, (d + 1) * inv } };
+}
+
+// roughly 16k texels per task
+size_t
+rowGrain(uint32_t width) noexcept {
+  return std::max<size_t>(1, 16384 / width);
+}
+
+template <typename Fn>
+void
+forRows(HaruhiWorkerPool* pPool, uint32_t rows, uint32_t width, const Fn& fn) {
+  if(pPool) pPool->parallelFor(rows, rowGrain(width), fn);
+  else fn(0, rows);
+}
+
+float
+coverage(const uint8_t* pSrc, uint32_t w, uint32_t h, size_t pitch, float cutoff) noexcept {
+  size_t n = 0;
+  for(uint32_t y = 0; y < h; ++y)
+    for(uint32_t x = 0; x < w; ++x)
+      n += pSrc[y * pitch + x * 4 + 3] / 255.f >= cutoff;
+  return float(n) / ((size_t)w * h);
+}
+
+// separable box, the rows under a destination row are blended first, then
+// the columns of that blended row. fetch(x, y) yields a linear texel of the
+// source level
+template <typename Fetch>
+void
+reduceLevel(uint32_t sw, uint32_t sh, uint32_t dw, uint32_t dh, math::float4* pDst,
+            const Fetch& fetch, HaruhiWorkerPool* pPool) noexcept {
+  using namespace math::vec;
+
+  forRows(pPool, dh, dw, [&](size_t b, size_t e) {
+    std::vector<math::float4> row(sw);
+    for(size_t dy = b; dy < e; ++dy) {
+      const Taps ty = taps(sh, dh, dy);
+      const v4 w0 = splat(ty.w[0]), w1 = splat(ty.w[1]), w2 = splat(ty.w[2]);
+      for(uint32_t x = 0; x < sw; ++x) {
+        v4 acc = mul(fetch(x, ty.first), w0);
+        if(ty.count > 1) acc = madd(fetch(x, ty.first + 1), w1, acc);
+        if(ty.count > 2) acc = madd(fetch(x, ty.first + 2), w2, acc);
+        store(row[x], acc);
+      }
+
+      math::float4* out = pDst + dy * dw;
+      if(sw % 2 == 0) {
+        const v4 half = splat(.5f);
+        for(uint32_t dx = 0; dx < dw; ++dx)
+          store(out[dx], mul(add(load(row[2 * dx]), load(row[2 * dx + 1])), half));
+      } else {
+        for(uint32_t dx = 0; dx < dw; ++dx) {
+          const Taps tx = taps(sw, dw, dx);
+          v4 acc = mul(load(row[tx.first]), splat(tx.w[0]));
+          if(tx.count > 1) acc = madd(load(row[tx.first + 1]), splat(tx.w[1]), acc);
+          if(tx.count > 2) acc = madd(load(row[tx.first + 2]), splat(tx.w[2]), acc);
+          store(out[dx], acc);
+        }
+      }
+    }
+  });
+}
+
+} // ns
+
+uint32_t
+HaruhiMipChain::levelCount(uint32_t w, uint32_t h) noexcept {
+  uint32_t n = 1;
+  for(uint32_t m = std::max(w, h); m > 1; m >>= 1) ++n;
+  return n;
+}
+
+void
+HaruhiMipChain::build(const uint8_t* pSrc, uint32_t w, uint32_t h, size_t rowPitch,
+                      const Options& opts, HaruhiWorkerPool* pPool) {
+  assert(pSrc && w && h);
+
+  uint32_t count = levelCount(w, h);
+  if(opts.maxLevels) count = std::min(count, opts.maxLevels);
+
+  levels_.clear();
+  size_t off = 0;
+  for(uint32_t l = 0; l < count; ++l) {
+    const Level lv = { std::max(1u, w >> l), std::max(1u, h >> l), off };
+    levels_.push_back(lv);
+    off += (size_t)lv.width * lv.height * 4;
+  }
+  data_.resize(off);
+
+  const size_t pitch = rowPitch ? rowPitch : (size_t)w * 4;
+  for(uint32_t y = 0; y < h; ++y)
+    memcpy(data_.data() + (size_t)y * w * 4, pSrc + y * pitch, (size_t)w * 4);
+
+  const float target = opts.alphaCutoff > 0.f ? coverage(pSrc, w, h, pitch, opts.alphaCutoff) : 0.f;
+  for(uint32_t l = 1; l < count; ++l) {
+    reduce(l, pSrc, pitch, opts, pPool);
+    const float scale = opts.alphaCutoff > 0.f ? coverageScale(l, opts.alphaCutoff, target) : 1.f;
+    encode(l, scale, opts, pPool);
+  }
+}
+
+// the first reduction reads level 0 bytes directly, later ones the float
+// result of the level above
+void
+HaruhiMipChain::reduce(uint32_t l, const uint8_t* pSrc, size_t pitch, const Options& opts,
+                       HaruhiWorkerPool* pPool) noexcept {
+  const Level& sl = levels_[l - 1];
+  const Level& dl = levels_[l];
+  std::vector<math::float4>& dst = linear_[l & 1];
+  dst.resize((size_t)dl.width * dl.height);
+
+  if(l == 1) {
+    const float* a = color::srgb().unorm;
+    const float* lut = opts.linear ? a : color::srgb().decode;
+    reduceLevel(sl.width, sl.height, dl.width, dl.height, dst.data(),
+      [&](uint32_t x, uint32_t y) {
+        const uint8_t* p = pSrc + y * pitch + x * 4;
+        return math::vec::set(lut[p[0]], lut[p[1]], lut[p[2]], a[p[3]]);
+      }, pPool);
+  } else {
+    const math::float4* src = linear_[(l - 1) & 1].data();
+    reduceLevel(sl.width, sl.height, dl.width, dl.height, dst.data(),
+      [&](uint32_t x, uint32_t y) {
+        return math::vec::load(src[(size_t)y * sl.width + x]);
+      }, pPool);
+  }
+}
+
+void
+HaruhiMipChain::encode(uint32_t l, float alphaScale, const Options& opts,
+                       HaruhiWorkerPool* pPool) noexcept {
+  using namespace math::vec;
+
+  const Level& lv = levels_[l];
+  const math::float4* src = linear_[l & 1].data();
+  uint8_t* dst = data_.data() + lv.offset;
+
+  const auto& lut = color::srgb();
+  const v4 zero = splat(0.f), one = splat(1.f);
+  const v4 scale = set(1.f, 1.f, 1.f, alphaScale);
+
+  forRows(pPool, lv.height, lv.width, [&](size_t b, size_t e) {
+    alignas(16) float c[4];
+    for(size_t i = b * lv.width; i < e * lv.width; ++i) {
+      store(c, min(max(mul(load(src[i]), scale), zero), one));
+      uint8_t* px = dst + i * 4;
+      if(!opts.linear) {
+        px[0] = lut.toSrgbExact(c[0]);
+        px[1] = lut.toSrgbExact(c[1]);
+        px[2] = lut.toSrgbExact(c[2]);
+      } else {
+        px[0] = (uint8_t)(c[0] * 255.f + .5f);
+        px[1] = (uint8_t)(c[1] * 255.f + .5f);
+        px[2] = (uint8_t)(c[2] * 255.f + .5f);
+      }
+      px[3] = (uint8_t)(c[3] * 255.f + .5f);
+    }
+  });
+}
+
+// scale that lets the same fraction of texels as level 0 pass the cutoff,
+// the k-th largest alpha is lifted onto the cutoff
+float
+HaruhiMipChain::coverageScale(uint32_t l, float cutoff, float target) const {
+  const auto& px = linear_[l & 1];
+  const size_t k = (size_t)std::lround(target * px.size());
+  if(k == 0) return 1.f;
+
+  std::vector<float> alpha(px.size());
+  for(size_t i = 0; i < px.size(); ++i)
+    alpha[i] = px[i].w;
+  std::nth_element(alpha.begin(), alpha.begin() + (k - 1), alpha.end(), std::greater<float>());
+
+  const float t = alpha[k - 1];
+  if(t <= 0.f) return 1.f;
+  // a hair above so the pivot survives the 8 bit rounding
+  return cutoff / t * 1.001f;
+}
\ No newline at end of file
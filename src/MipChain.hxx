@@ -0,0 +1,58 @@
+#ifndef HARUHI_MIPCHAIN_HXX
+#define HARUHI_MIPCHAIN_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "SimdMath.hxx"
+
+class HaruhiWorkerPool;
+
+// full mip chain of an RGBA8 image, filtered in linear space
+//
+// every level is reduced from the float result of the previous one, odd
+// sizes round down and use the 3 tap box that covers the source exactly.
+// with an alpha cutoff, each level's alpha is scaled so the fraction of
+// texels passing the alpha test matches level 0, cutout blocks don't
+// dissolve into the distance
+class HaruhiMipChain {
+public:
+  // zero initialized is sRGB, full chain, no coverage preservation
+  struct Options {
+    bool linear;       // rgb isn't sRGB encoded, alpha is always linear
+    float alphaCutoff; // 0 turns coverage preservation off
+    uint32_t maxLevels; // 0 for the full chain
+  };
+
+  struct Level {
+    uint32_t width, height;
+    size_t offset; // into data(), rows are width * 4 bytes
+  };
+
+private:
+  std::vector<uint8_t> data_;
+  std::vector<Level> levels_;
+  std::vector<math::float4> linear_[2];
+
+  void reduce(uint32_t, const uint8_t*, size_t, const Options&, HaruhiWorkerPool*) noexcept;
+  void encode(uint32_t, float, const Options&, HaruhiWorkerPool*) noexcept;
+  float coverageScale(uint32_t, float, float) const;
+
+public:
+  static uint32_t levelCount(uint32_t, uint32_t) noexcept;
+
+  // source rows of width * 4 bytes when the pitch is 0, levels are
+  // filtered in parallel on the pool
+  void build(const uint8_t*, uint32_t, uint32_t, size_t,
+             const Options& = {}, HaruhiWorkerPool* = nullptr);
+
+  uint32_t levelCount() const noexcept { return (uint32_t)levels_.size(); }
+  const Level& level(uint32_t i) const noexcept { return levels_[i]; }
+  const uint8_t* levelData(uint32_t i) const noexcept { return data_.data() + levels_[i].offset; }
+
+  const uint8_t* data() const noexcept { return data_.data(); }
+  size_t size() const noexcept { return data_.size(); }
+};
+
+#endif
\ No newline at end of file
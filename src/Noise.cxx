@@ -0,0 +1,581 @@
+#include "Noise.hxx"
+
+#include <bit>
+#include <cmath>
+
+#include "SimdMath.hxx"
+
+namespace noise {
+
+namespace {
+
+// every backend has F (float lanes), I (uint32_t lanes, wrapping) and M
+// (lane masks) with the same operators. the noise below is written once
+// against them. one is the single position reference, wide is what the
+// batches run on
+
+namespace one {
+
+constexpr int W = 1;
+
+struct M { bool v; };
+struct F {
+  float v;
+  F() = default;
+  F(float a) noexcept : v(a) {}
+};
+struct I {
+  uint32_t v;
+  I() = default;
+  I(uint32_t a) noexcept : v(a) {}
+};
+
+inline F load(const float* p) noexcept { return *p; }
+inline void store(float* p, F a) noexcept { *p = a.v; }
+
+inline F operator+(F a, F b) noexcept { return a.v + b.v; }
+inline F operator-(F a, F b) noexcept { return a.v - b.v; }
+inline F operator*(F a, F b) noexcept { return a.v * b.v; }
+inline F floor(F a) noexcept { return std::floor(a.v); }
+inline F min(F a, F b) noexcept { return b.v < a.v ? b.v : a.v; }
+inline F max(F a, F b) noexcept { return b.v > a.v ? b.v : a.v; }
+inline F sqrt(F a) noexcept { return std::sqrt(a.v); }
+inline M operator<(F a, F b) noexcept { return { a.v < b.v }; }
+inline M operator>(F a, F b) noexcept { return { a.v > b.v }; }
+inline M operator>=(F a, F b) noexcept { return { a.v >= b.v }; }
+inline M operator&(M a, M b) noexcept { return { a.v && b.v }; }
+inline M operator|(M a, M b) noexcept { return { a.v || b.v }; }
+inline F select(M m, F a, F b) noexcept { return m.v ? a : b; }
+
+inline I operator+(I a, I b) noexcept { return a.v + b.v; }
+inline I operator*(I a, I b) noexcept { return a.v * b.v; }
+inline I operator^(I a, I b) noexcept { return a.v ^ b.v; }
+inline I operator&(I a, I b) noexcept { return a.v & b.v; }
+template <int S> inline I shr(I a) noexcept { return a.v >> S; }
+template <int S> inline I shl(I a) noexcept { return a.v << S; }
+inline M operator==(I a, I b) noexcept { return { a.v == b.v }; }
+inline I select(M m, I a, I b) noexcept { return m.v ? a : b; }
+
+// of floored floats, and of ints below 2^24 back
+inline I toInt(F a) noexcept { return uint32_t(int32_t(a.v)); }
+inline F toFloat(I a) noexcept { return float(int32_t(a.v)); }
+// flips the signs where s has bit 31 set
+inline F flip(F a, I s) noexcept { return std::bit_cast<float>(std::bit_cast<uint32_t>(a.v) ^ s.v); }
+
+} // ns one
+
+#if defined(HARUHI_SIMD_AVX2)
+
+namespace avx {
+
+constexpr int W = 8;
+
+struct M { __m256 v; };
+struct F {
+  __m256 v;
+  F() = default;
+  F(__m256 a) noexcept : v(a) {}
+  F(float a) noexcept : v(_mm256_set1_ps(a)) {}
+};
+struct I {
+  __m256i v;
+  I() = default;
+  I(__m256i a) noexcept : v(a) {}
+  I(uint32_t a) noexcept : v(_mm256_set1_epi32(int32_t(a))) {}
+};
+
+inline F load(const float* p) noexcept { return _mm256_loadu_ps(p); }
+inline void store(float* p, F a) noexcept { _mm256_storeu_ps(p, a.v); }
+
+inline F operator+(F a, F b) noexcept { return _mm256_add_ps(a.v, b.v); }
+inline F operator-(F a, F b) noexcept { return _mm256_sub_ps(a.v, b.v); }
+inline F operator*(F a, F b) noexcept { return _mm256_mul_ps(a.v, b.v); }
+inline F floor(F a) noexcept { return _mm256_floor_ps(a.v); }
+inline F min(F a, F b) noexcept { return _mm256_min_ps(a.v, b.v); }
+inline F max(F a, F b) noexcept { return _mm256_max_ps(a.v, b.v); }
+inline F sqrt(F a) noexcept { return _mm256_sqrt_ps(a.v); }
+inline M operator<(F a, F b) noexcept { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+inline M operator>(F a, F b) noexcept { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+inline M operator>=(F a, F b) noexcept { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+inline M operator&(M a, M b) noexcept { return { _mm256_and_ps(a.v, b.v) }; }
+inline M operator|(M a, M b) noexcept { return { _mm256_or_ps(a.v, b.v) }; }
+inline F select(M m, F a, F b) noexcept { return _mm256_blendv_ps(b.v, a.v, m.v); }
+
+inline I operator+(I a, I b) noexcept { return _mm256_add_epi32(a.v, b.v); }
+inline I operator*(I a, I b) noexcept { return _mm256_mullo_epi32(a.v, b.v); }
+inline I operator^(I a, I b) noexcept { return _mm256_xor_si256(a.v, b.v); }
+inline I operator&(I a, I b) noexcept { return _mm256_and_si256(a.v, b.v); }
+template <int S> inline I shr(I a) noexcept { return _mm256_srli_epi32(a.v, S); }
+template <int S> inline I shl(I a) noexcept { return _mm256_slli_epi32(a.v, S); }
+inline M operator==(I a, I b) noexcept { return { _mm256_castsi256_ps(_mm256_cmpeq_epi32(a.v, b.v)) }; }
+inline I select(M m, I a, I b) noexcept {
+  return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), m.v));
+}
+
+inline I toInt(F a) noexcept { return _mm256_cvttps_epi32(a.v); }
+inline F toFloat(I a) noexcept { return _mm256_cvtepi32_ps(a.v); }
+inline F flip(F a, I s) noexcept { return _mm256_xor_ps(a.v, _mm256_castsi256_ps(s.v)); }
+
+} // ns avx
+
+namespace wide = avx;
+
+#elif defined(HARUHI_SIMD_SSE2) || defined(HARUHI_SIMD_NEON)
+
+// floats on math::vec, the integer half per instruction set
+namespace quad {
+
+using math::vec::v4;
+#if defined(HARUHI_SIMD_SSE2)
+using v4i = __m128i;
+#else
+using v4i = uint32x4_t;
+#endif
+
+constexpr int W = 4;
+
+struct M { v4 v; };
+struct F {
+  v4 v;
+  F() = default;
+  F(v4 a) noexcept : v(a) {}
+  F(float a) noexcept : v(math::vec::splat(a)) {}
+};
+struct I {
+  v4i v;
+  I() = default;
+  I(v4i a) noexcept : v(a) {}
+#if defined(HARUHI_SIMD_SSE2)
+  I(uint32_t a) noexcept : v(_mm_set1_epi32(int32_t(a))) {}
+#else
+  I(uint32_t a) noexcept : v(vdupq_n_u32(a)) {}
+#endif
+};
+
+inline F load(const float* p) noexcept { return math::vec::loadu(p); }
+
+inline F operator+(F a, F b) noexcept { return math::vec::add(a.v, b.v); }
+inline F operator-(F a, F b) noexcept { return math::vec::sub(a.v, b.v); }
+inline F operator*(F a, F b) noexcept { return math::vec::mul(a.v, b.v); }
+inline F floor(F a) noexcept { return math::vec::floor(a.v); }
+inline F min(F a, F b) noexcept { return math::vec::min(a.v, b.v); }
+inline F max(F a, F b) noexcept { return math::vec::max(a.v, b.v); }
+inline F sqrt(F a) noexcept { return math::vec::sqrt(a.v); }
+inline M operator<(F a, F b) noexcept { return { math::vec::cmplt(a.v, b.v) }; }
+inline M operator>(F a, F b) noexcept { return { math::vec::cmpgt(a.v, b.v) }; }
+inline M operator>=(F a, F b) noexcept { return { math::vec::cmpge(a.v, b.v) }; }
+inline M operator&(M a, M b) noexcept { return { math::vec::and_(a.v, b.v) }; }
+inline M operator|(M a, M b) noexcept { return { math::vec::or_(a.v, b.v) }; }
+inline F select(M m, F a, F b) noexcept { return math::vec::select(m.v, a.v, b.v); }
+
+#if defined(HARUHI_SIMD_SSE2)
+
+inline void store(float* p, F a) noexcept { _mm_storeu_ps(p, a.v); }
+
+inline I operator+(I a, I b) noexcept { return _mm_add_epi32(a.v, b.v); }
+inline I
+operator*(I a, I b) noexcept {
+#if defined(__SSE4_1__)
+  return _mm_mullo_epi32(a.v, b.v);
+#else
+  // even and odd lanes through the 32 x 32 -> 64 multiply
+  const __m128i even = _mm_mul_epu32(a.v, b.v);
+  const __m128i odd = _mm_mul_epu32(_mm_srli_si128(a.v, 4), _mm_srli_si128(b.v, 4));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+inline I operator^(I a, I b) noexcept { return _mm_xor_si128(a.v, b.v); }
+inline I operator&(I a, I b) noexcept { return _mm_and_si128(a.v, b.v); }
+template <int S> inline I shr(I a) noexcept { return _mm_srli_epi32(a.v, S); }
+template <int S> inline I shl(I a) noexcept { return _mm_slli_epi32(a.v, S); }
+inline M operator==(I a, I b) noexcept { return { _mm_castsi128_ps(_mm_cmpeq_epi32(a.v, b.v)) }; }
+inline I select(M m, I a, I b) noexcept {
+  return _mm_castps_si128(math::vec::select(m.v, _mm_castsi128_ps(a.v), _mm_castsi128_ps(b.v)));
+}
+
+inline I toInt(F a) noexcept { return _mm_cvttps_epi32(a.v); }
+inline F toFloat(I a) noexcept { return _mm_cvtepi32_ps(a.v); }
+inline F flip(F a, I s) noexcept { return _mm_xor_ps(a.v, _mm_castsi128_ps(s.v)); }
+
+#else
+
+inline void store(float* p, F a) noexcept { vst1q_f32(p, a.v); }
+
+inline I operator+(I a, I b) noexcept { return vaddq_u32(a.v, b.v); }
+inline I operator*(I a, I b) noexcept { return vmulq_u32(a.v, b.v); }
+inline I operator^(I a, I b) noexcept { return veorq_u32(a.v, b.v); }
+inline I operator&(I a, I b) noexcept { return vandq_u32(a.v, b.v); }
+template <int S> inline I shr(I a) noexcept { return vshrq_n_u32(a.v, S); }
+template <int S> inline I shl(I a) noexcept { return vshlq_n_u32(a.v, S); }
+inline M operator==(I a, I b) noexcept { return { vreinterpretq_f32_u32(vceqq_u32(a.v, b.v)) }; }
+inline I select(M m, I a, I b) noexcept { return vbslq_u32(vreinterpretq_u32_f32(m.v), a.v, b.v); }
+
+inline I toInt(F a) noexcept { return vreinterpretq_u32_s32(vcvtq_s32_f32(a.v)); }
+inline F toFloat(I a) noexcept { return vcvtq_f32_s32(vreinterpretq_s32_u32(a.v)); }
+inline F flip(F a, I s) noexcept {
+  return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a.v), s.v));
+}
+
+#endif
+
+} // ns quad
+
+namespace wide = quad;
+
+#else
+
+namespace wide = one;
+
+#endif
+
+constexpr uint32_t PRIME_X = 501125321u;
+constexpr uint32_t PRIME_Y = 1136930381u;
+constexpr uint32_t PRIME_Z = 1720413743u;
+// seed offsets of the two warp fields
+constexpr uint32_t WARP_X = 0x68bc21ebu;
+constexpr uint32_t WARP_Y = 0x02e5be93u;
+constexpr uint32_t WARP_Z = 0x967a889bu;
+
+// lattice coordinates come in premultiplied by their primes, so the
+// neighbouring cell is one add away
+template <typename I>
+inline I
+hash(I seed, I xp, I yp) noexcept {
+  const I h = (seed ^ xp ^ yp) * I(0x27d4eb2du);
+  return h ^ shr<15>(h);
+}
+
+template <typename I>
+inline I
+hash(I seed, I xp, I yp, I zp) noexcept {
+  const I h = (seed ^ xp ^ yp ^ zp) * I(0x27d4eb2du);
+  return h ^ shr<15>(h);
+}
+
+// top 24 bits to [-1, 1)
+template <typename F, typename I>
+inline F
+unit(I h) noexcept {
+  return toFloat(shr<8>(h)) * F(2.f / 16777216.f) - F(1.f);
+}
+
+template <typename F>
+inline F
+fade(F t) noexcept {
+  return t * t * t * (t * (t * F(6.f) - F(15.f)) + F(10.f));
+}
+
+template <typename F>
+inline F
+lerp(F a, F b, F t) noexcept {
+  return a + (b - a) * t;
+}
+
+// simplex kernel, (r^2 - d^2)^4 where positive
+template <typename F>
+inline F
+falloff(F t) noexcept {
+  t = max(t, F(0.f));
+  t = t * t;
+  return t * t;
+}
+
+template <typename F>
+inline F
+clamp1(F a) noexcept {
+  return min(max(a, F(-1.f)), F(1.f));
+}
+
+template <typename F, typename I>
+F
+value2(I seed, F x, F y) noexcept {
+  const F xf = floor(x), yf = floor(y);
+  const F tx = fade(x - xf), ty = fade(y - yf);
+  const I x0 = toInt(xf) * I(PRIME_X), y0 = toInt(yf) * I(PRIME_Y);
+  const I x1 = x0 + I(PRIME_X), y1 = y0 + I(PRIME_Y);
+  const F a = lerp(unit<F>(hash(seed, x0, y0)), unit<F>(hash(seed, x1, y0)), tx);
+  const F b = lerp(unit<F>(hash(seed, x0, y1)), unit<F>(hash(seed, x1, y1)), tx);
+  return lerp(a, b, ty);
+}
+
+template <typename F, typename I>
+F
+value3(I seed, F x, F y, F z) noexcept {
+  const F xf = floor(x), yf = floor(y), zf = floor(z);
+  const F tx = fade(x - xf), ty = fade(y - yf), tz = fade(z - zf);
+  const I x0 = toInt(xf) * I(PRIME_X), y0 = toInt(yf) * I(PRIME_Y), z0 = toInt(zf) * I(PRIME_Z);
+  const I x1 = x0 + I(PRIME_X), y1 = y0 + I(PRIME_Y), z1 = z0 + I(PRIME_Z);
+  const F a = lerp(lerp(unit<F>(hash(seed, x0, y0, z0)), unit<F>(hash(seed, x1, y0, z0)), tx),
+                   lerp(unit<F>(hash(seed, x0, y1, z0)), unit<F>(hash(seed, x1, y1, z0)), tx), ty);
+  const F b = lerp(lerp(unit<F>(hash(seed, x0, y0, z1)), unit<F>(hash(seed, x1, y0, z1)), tx),
+                   lerp(unit<F>(hash(seed, x0, y1, z1)), unit<F>(hash(seed, x1, y1, z1)), tx), ty);
+  return lerp(a, b, tz);
+}
+
+// eight gradients, (+-1, +-2) and (+-2, +-1)
+template <typename F, typename I>
+inline F
+grad2(I h, F x, F y) noexcept {
+  const auto low = (h & I(4u)) == I(0u);
+  const F u = select(low, x, y), v = select(low, y, x);
+  return flip(u, shl<31>(h)) + flip(v * F(2.f), shl<30>(h & I(2u)));
+}
+
+// twelve cube edge gradients, four of them twice
+template <typename F, typename I>
+inline F
+grad3(I h, F x, F y, F z) noexcept {
+  const F u = select((h & I(8u)) == I(0u), x, y);
+  const F v = select((h & I(12u)) == I(0u), y, select((h & I(13u)) == I(12u), x, z));
+  return flip(u, shl<31>(h)) + flip(v, shl<30>(h & I(2u)));
+}
+
+template <typename F, typename I>
+F
+simplex2(I seed, F x, F y) noexcept {
+  constexpr float F2 = .366025403784f, G2 = .211324865405f;
+  const F s = (x + y) * F(F2);
+  const F i = floor(x + s), j = floor(y + s);
+  const F t = (i + j) * F(G2);
+  const F x0 = x - (i - t), y0 = y - (j - t);
+
+  // the middle corner steps along the larger offset first
+  const auto xFirst = x0 > y0;
+  const F i1 = select(xFirst, F(1.f), F(0.f)), j1 = F(1.f) - i1;
+  const F x1 = x0 - i1 + F(G2), y1 = y0 - j1 + F(G2);
+  const F x2 = x0 + F(2.f * G2 - 1.f), y2 = y0 + F(2.f * G2 - 1.f);
+
+  const I ip = toInt(i) * I(PRIME_X), jp = toInt(j) * I(PRIME_Y);
+  const I ip1 = ip + select(xFirst, I(PRIME_X), I(0u)), jp1 = jp + select(xFirst, I(0u), I(PRIME_Y));
+  const F n0 = falloff(F(.5f) - x0 * x0 - y0 * y0) * grad2(hash(seed, ip, jp), x0, y0);
+  const F n1 = falloff(F(.5f) - x1 * x1 - y1 * y1) * grad2(hash(seed, ip1, jp1), x1, y1);
+  const F n2 = falloff(F(.5f) - x2 * x2 - y2 * y2)
+             * grad2(hash(seed, ip + I(PRIME_X), jp + I(PRIME_Y)), x2, y2);
+  return clamp1((n0 + n1 + n2) * F(45.23f));
+}
+
+template <typename F, typename I>
+F
+simplex3(I seed, F x, F y, F z) noexcept {
+  constexpr float F3 = 1.f / 3.f, G3 = 1.f / 6.f;
+  const F s = (x + y + z) * F(F3);
+  const F i = floor(x + s), j = floor(y + s), k = floor(z + s);
+  const F t = (i + j + k) * F(G3);
+  const F x0 = x - (i - t), y0 = y - (j - t), z0 = z - (k - t);
+
+  // the two middle corners from the order of the offsets
+  const auto xy = x0 >= y0, xz = x0 >= z0, yz = y0 >= z0;
+  const auto yx = y0 > x0, zx = z0 > x0, zy = z0 > y0;
+  const auto i1 = xy & xz, j1 = yx & yz, k1 = zx & zy;
+  const auto i2 = xy | xz, j2 = yx | yz, k2 = zx | zy;
+  const F on = F(1.f), off = F(0.f);
+  const F x1 = x0 - select(i1, on, off) + F(G3), y1 = y0 - select(j1, on, off) + F(G3);
+  const F z1 = z0 - select(k1, on, off) + F(G3);
+  const F x2 = x0 - select(i2, on, off) + F(2.f * G3), y2 = y0 - select(j2, on, off) + F(2.f * G3);
+  const F z2 = z0 - select(k2, on, off) + F(2.f * G3);
+  const F x3 = x0 + F(3.f * G3 - 1.f), y3 = y0 + F(3.f * G3 - 1.f), z3 = z0 + F(3.f * G3 - 1.f);
+
+  const I ip = toInt(i) * I(PRIME_X), jp = toInt(j) * I(PRIME_Y), kp = toInt(k) * I(PRIME_Z);
+  const I px = I(PRIME_X), py = I(PRIME_Y), pz = I(PRIME_Z), none = I(0u);
+  const F n0 = falloff(F(.6f) - x0 * x0 - y0 * y0 - z0 * z0) * grad3(hash(seed, ip, jp, kp), x0, y0, z0);
+  const F n1 = falloff(F(.6f) - x1 * x1 - y1 * y1 - z1 * z1)
+             * grad3(hash(seed, ip + select(i1, px, none), jp + select(j1, py, none), kp + select(k1, pz, none)),
+                     x1, y1, z1);
+  const F n2 = falloff(F(.6f) - x2 * x2 - y2 * y2 - z2 * z2)
+             * grad3(hash(seed, ip + select(i2, px, none), jp + select(j2, py, none), kp + select(k2, pz, none)),
+                     x2, y2, z2);
+  const F n3 = falloff(F(.6f) - x3 * x3 - y3 * y3 - z3 * z3) * grad3(hash(seed, ip + px, jp + py, kp + pz), x3, y3, z3);
+  return clamp1((n0 + n1 + n2 + n3) * F(32.7f));
+}
+
+// feature points jittered over their whole cell, the nearest of the 3 x 3
+// around the position
+template <typename F, typename I>
+F
+cellular2(I seed, F x, F y) noexcept {
+  const F xf = floor(x), yf = floor(y);
+  const F fx = x - xf, fy = y - yf;
+  const I xp = toInt(xf) * I(PRIME_X), yp = toInt(yf) * I(PRIME_Y);
+  F d = F(8.f);
+  for(int cy = -1; cy <= 1; ++cy)
+    for(int cx = -1; cx <= 1; ++cx) {
+      const I h = hash(seed, xp + I(uint32_t(cx) * PRIME_X), yp + I(uint32_t(cy) * PRIME_Y));
+      const F px = F(float(cx)) + toFloat(h & I(0xffffu)) * F(1.f / 65536.f) - fx;
+      const F py = F(float(cy)) + toFloat(shr<16>(h)) * F(1.f / 65536.f) - fy;
+      d = min(d, px * px + py * py);
+    }
+  return min(sqrt(d), F(1.f)) * F(2.f) - F(1.f);
+}
+
+template <typename F, typename I>
+F
+cellular3(I seed, F x, F y, F z) noexcept {
+  const F xf = floor(x), yf = floor(y), zf = floor(z);
+  const F fx = x - xf, fy = y - yf, fz = z - zf;
+  const I xp = toInt(xf) * I(PRIME_X), yp = toInt(yf) * I(PRIME_Y), zp = toInt(zf) * I(PRIME_Z);
+  F d = F(8.f);
+  for(int cz = -1; cz <= 1; ++cz)
+    for(int cy = -1; cy <= 1; ++cy)
+      for(int cx = -1; cx <= 1; ++cx) {
+        const I h = hash(seed, xp + I(uint32_t(cx) * PRIME_X), yp + I(uint32_t(cy) * PRIME_Y),
+                         zp + I(uint32_t(cz) * PRIME_Z));
+        const F px = F(float(cx)) + toFloat(h & I(1023u)) * F(1.f / 1024.f) - fx;
+        const F py = F(float(cy)) + toFloat(shr<10>(h) & I(1023u)) * F(1.f / 1024.f) - fy;
+        const F pz = F(float(cz)) + toFloat(shr<22>(h)) * F(1.f / 1024.f) - fz;
+        d = min(d, px * px + py * py + pz * pz);
+      }
+  return min(sqrt(d), F(1.f)) * F(2.f) - F(1.f);
+}
+
+template <typename F, typename I, typename Fn>
+F
+fbm2(const Fractal& f, uint32_t seed, F x, F y, Fn noise) noexcept {
+  F sum = F(0.f);
+  float amp = 1.f, freq = f.frequency, total = 0.f;
+  for(int o = 0; o < f.octaves; ++o) {
+    sum = sum + noise(I(seed + uint32_t(o)), x * F(freq), y * F(freq)) * F(amp);
+    total += amp;
+    amp *= f.gain;
+    freq *= f.lacunarity;
+  }
+  return total > 0.f ? sum * F(1.f / total) : sum;
+}
+
+template <typename F, typename I, typename Fn>
+F
+fbm3(const Fractal& f, uint32_t seed, F x, F y, F z, Fn noise) noexcept {
+  F sum = F(0.f);
+  float amp = 1.f, freq = f.frequency, total = 0.f;
+  for(int o = 0; o < f.octaves; ++o) {
+    sum = sum + noise(I(seed + uint32_t(o)), x * F(freq), y * F(freq), z * F(freq)) * F(amp);
+    total += amp;
+    amp *= f.gain;
+    freq *= f.lacunarity;
+  }
+  return total > 0.f ? sum * F(1.f / total) : sum;
+}
+
+const auto SIMPLEX2 = [](auto s, auto x, auto y) { return simplex2(s, x, y); };
+const auto SIMPLEX3 = [](auto s, auto x, auto y, auto z) { return simplex3(s, x, y, z); };
+
+template <typename F, typename I, typename Fn>
+F
+warped2(const Fractal& f, uint32_t seed, F x, F y, Fn noise) noexcept {
+  if(f.warp != 0.f) {
+    const F wx = fbm2<F, I>(f, seed ^ WARP_X, x, y, SIMPLEX2);
+    const F wy = fbm2<F, I>(f, seed ^ WARP_Y, x, y, SIMPLEX2);
+    x = x + wx * F(f.warp);
+    y = y + wy * F(f.warp);
+  }
+  return fbm2<F, I>(f, seed, x, y, noise);
+}
+
+template <typename F, typename I, typename Fn>
+F
+warped3(const Fractal& f, uint32_t seed, F x, F y, F z, Fn noise) noexcept {
+  if(f.warp != 0.f) {
+    const F wx = fbm3<F, I>(f, seed ^ WARP_X, x, y, z, SIMPLEX3);
+    const F wy = fbm3<F, I>(f, seed ^ WARP_Y, x, y, z, SIMPLEX3);
+    const F wz = fbm3<F, I>(f, seed ^ WARP_Z, x, y, z, SIMPLEX3);
+    x = x + wx * F(f.warp);
+    y = y + wy * F(f.warp);
+    z = z + wz * F(f.warp);
+  }
+  return fbm3<F, I>(f, seed, x, y, z, noise);
+}
+
+// the kind is picked once per call, not per position
+template <typename Run>
+inline auto
+byKind2(Kind kind, Run run) noexcept {
+  switch(kind) {
+  case KIND_VALUE: return run([](auto s, auto x, auto y) { return value2(s, x, y); });
+  case KIND_CELLULAR: return run([](auto s, auto x, auto y) { return cellular2(s, x, y); });
+  default: return run(SIMPLEX2);
+  }
+}
+
+template <typename Run>
+inline auto
+byKind3(Kind kind, Run run) noexcept {
+  switch(kind) {
+  case KIND_VALUE: return run([](auto s, auto x, auto y, auto z) { return value3(s, x, y, z); });
+  case KIND_CELLULAR: return run([](auto s, auto x, auto y, auto z) { return cellular3(s, x, y, z); });
+  default: return run(SIMPLEX3);
+  }
+}
+
+} // ns
+
+float value2(uint32_t seed, float x, float y) noexcept { return value2(one::I(seed), one::F(x), one::F(y)).v; }
+float simplex2(uint32_t seed, float x, float y) noexcept { return simplex2(one::I(seed), one::F(x), one::F(y)).v; }
+float cellular2(uint32_t seed, float x, float y) noexcept { return cellular2(one::I(seed), one::F(x), one::F(y)).v; }
+
+float
+value3(uint32_t seed, float x, float y, float z) noexcept {
+  return value3(one::I(seed), one::F(x), one::F(y), one::F(z)).v;
+}
+
+float
+simplex3(uint32_t seed, float x, float y, float z) noexcept {
+  return simplex3(one::I(seed), one::F(x), one::F(y), one::F(z)).v;
+}
+
+float
+cellular3(uint32_t seed, float x, float y, float z) noexcept {
+  return cellular3(one::I(seed), one::F(x), one::F(y), one::F(z)).v;
+}
+
+float
+sample2(const Fractal& f, uint32_t seed, float x, float y) noexcept {
+  return byKind2(f.kind, [&](auto noise) {
+    return warped2<one::F, one::I>(f, seed, x, y, noise).v;
+  });
+}
+
+float
+sample3(const Fractal& f, uint32_t seed, float x, float y, float z) noexcept {
+  return byKind3(f.kind, [&](auto noise) {
+    return warped3<one::F, one::I>(f, seed, x, y, z, noise).v;
+  });
+}
+
+void
+sample2(const Fractal& f, uint32_t seed, const float* pX, const float* pY, float* pOut, size_t n) noexcept {
+  using namespace wide;
+  byKind2(f.kind, [&](auto noise) {
+    size_t i = 0;
+    for(; i + W <= n; i += W)
+      store(pOut + i, warped2<F, I>(f, seed, load(pX + i), load(pY + i), noise));
+    if(i == n) return;
+    // the tail through a full step too, so every position gets lane values
+    float x[W] = {}, y[W] = {}, out[W];
+    for(size_t j = i; j < n; ++j) x[j - i] = pX[j], y[j - i] = pY[j];
+    store(out, warped2<F, I>(f, seed, load(x), load(y), noise));
+    for(size_t j = i; j < n; ++j) pOut[j] = out[j - i];
+  });
+}
+
+void
+sample3(const Fractal& f, uint32_t seed, const float* pX, const float* pY, const float* pZ,
+        float* pOut, size_t n) noexcept {
+  using namespace wide;
+  byKind3(f.kind, [&](auto noise) {
+    size_t i = 0;
+    for(; i + W <= n; i += W)
+      store(pOut + i, warped3<F, I>(f, seed, load(pX + i), load(pY + i), load(pZ + i), noise));
+    if(i == n) return;
+    float x[W] = {}, y[W] = {}, z[W] = {}, out[W];
+    for(size_t j = i; j < n; ++j) x[j - i] = pX[j], y[j - i] = pY[j], z[j - i] = pZ[j];
+    store(out, warped3<F, I>(f, seed, load(x), load(y), load(z), noise));
+    for(size_t j = i; j < n; ++j) pOut[j] = out[j - i];
+  });
+}
+
+int
+lanes() noexcept {
+  return wide::W;
+}
+
+} // ns noise
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef HARUHI_NOISE_HXX
+#define HARUHI_NOISE_HXX
+
+#include <cstddef>
+#include <cstdint>
+
+// seeded gradient and cell noise for world generation
+//
+// every function is a pure function of the seed and the position, the same
+// on every thread and every run. the batch functions evaluate lanes()
+// positions per step, eight with avx2 and four with sse2 or neon, and give
+// the single position functions' values up to float rounding. positions
+// are in noise units, one cell per unit at frequency 1, and stay exact up
+// to about 2^23 cells
+namespace noise {
+
+enum Kind : uint32_t {
+  KIND_VALUE,
+  KIND_SIMPLEX,
+  KIND_CELLULAR
+};
+
+// fractal brownian motion, octaves of one kind summed with growing
+// frequency and shrinking amplitude, normalized back to [-1, 1]
+struct Fractal {
+  Kind kind = KIND_SIMPLEX;
+  int octaves = 1;
+  float frequency = 1.f;
+  float lacunarity = 2.f;
+  float gain = .5f;
+  // displaces positions by a simplex fbm of the same octaves and
+  // frequency, scaled by warp in position units. 0 samples undisplaced
+  float warp = 0.f;
+};
+
+// one octave at frequency 1, in [-1, 1]. cellular is the distance to the
+// nearest jittered feature point, [0, 1] mapped to [-1, 1]
+float value2(uint32_t, float, float) noexcept;
+float value3(uint32_t, float, float, float) noexcept;
+float simplex2(uint32_t, float, float) noexcept;
+float simplex3(uint32_t, float, float, float) noexcept;
+float cellular2(uint32_t, float, float) noexcept;
+float cellular3(uint32_t, float, float, float) noexcept;
+
+float sample2(const Fractal&, uint32_t, float, float) noexcept;
+float sample3(const Fractal&, uint32_t, float, float, float) noexcept;
+
+// n positions from separate x, y (and z) arrays into out
+void sample2(const Fractal&, uint32_t, const float*, const float*, float*, size_t) noexcept;
+void sample3(const Fractal&, uint32_t, const float*, const float*, const float*, float*, size_t) noexcept;
+
+// positions per batch step
+int lanes() noexcept;
+
+} // ns noise
+
+#endif
\ No newline at end of file
@@ -0,0 +1,413 @@
+#include "OcclusionBuffer.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include "MathUtil.hxx"
+#include "WorkerPool.hxx"
+
+namespace {
+
+// triangles per setup chunk, chunks bin separately and are replayed in
+// submission order, so the result doesn't depend on the thread count
+constexpr size_t SETUP_GRAIN = 1024;
+
+constexpr unsigned BIN_W = HaruhiOcclusionBuffer::TILE_W * HaruhiOcclusionBuffer::BIN_TILES_X;
+constexpr unsigned BIN_H = HaruhiOcclusionBuffer::TILE_H * HaruhiOcclusionBuffer::BIN_TILES_Y;
+
+double
+msSince(std::chrono::steady_clock::time_point t0) noexcept {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// sutherland-hodgman against z >= 0, metal's near plane
+int
+clipNear(const math::float4* in, int n, math::float4* out) noexcept {
+  int m = 0;
+  for(int i = 0; i < n; ++i) {
+    const math::float4& a = in[i];
+    const math::float4& b = in[(i + 1) % n];
+    if(a.z >= 0.f) out[m++] = a;
+    if((a.z >= 0.f) != (b.z >= 0.f))
+      out[m++] = a + (b - a) * (a.z / (a.z - b.z));
+  }
+  return m;
+}
+
+} // ns
+
+struct HaruhiOcclusionBuffer::Tri {
+  // e = a*(x - ox) + b*(y - oy) >= 0 inside, edge i opposite vertex i
+  float ea[3], eb[3], eox[3], eoy[3];
+  // z = zc + zdx*(x - x0) + zdy*(y - y0), never past zmax
+  float zc, zdx, zdy, x0, y0, zmax;
+  int min_x, min_y, max_x, max_y; // pixel bounds, max exclusive
+};
+
+struct HaruhiOcclusionBuffer::Chunk {
+  std::vector<Tri> tris;
+  std::vector<std::vector<uint32_t>> bins;
+  uint64_t culled, clipped;
+};
+
+HaruhiOcclusionBuffer::HaruhiOcclusionBuffer(uint32_t w, uint32_t h, HaruhiWorkerPool* pPool)
+: width_((w + TILE_W - 1) / TILE_W * TILE_W), height_((h + TILE_H - 1) / TILE_H * TILE_H),
+  tiles_x_(width_ / TILE_W), tiles_y_(height_ / TILE_H),
+  bins_x_((tiles_x_ + BIN_TILES_X - 1) / BIN_TILES_X),
+  bins_y_((tiles_y_ + BIN_TILES_Y - 1) / BIN_TILES_Y),
+  p_pool_(pPool)
+{
+  const size_t tiles = (size_t)tiles_x_ * tiles_y_;
+  zmax0_.resize(tiles + 3);
+  zmax1_.resize(tiles);
+  mask_.resize(tiles);
+  resetTimings();
+  begin(math::makeIdentity());
+}
+
+HaruhiOcclusionBuffer::~HaruhiOcclusionBuffer() {
+  ;
+}
+
+void
+HaruhiOcclusionBuffer::resetTimings() noexcept {
+  timings_ = {};
+}
+
+void
+HaruhiOcclusionBuffer::begin(const math::float4x4& viewProj) noexcept {
+  view_proj_ = viewProj;
+  verts_.clear();
+  std::fill(zmax0_.begin(), zmax0_.end(), 1.f);
+  std::fill(zmax1_.begin(), zmax1_.end(), 0.f);
+  std::fill(mask_.begin(), mask_.end(), 0u);
+}
+
+void
+HaruhiOcclusionBuffer::addTriangle(const math::float3& a, const math::float3& b, const math::float3& c) {
+  verts_.push_back(a);
+  verts_.push_back(b);
+  verts_.push_back(c);
+}
+
+void
+HaruhiOcclusionBuffer::addQuad(const math::float3& a, const math::float3& b,
+                               const math::float3& c, const math::float3& d) {
+  addTriangle(a, b, c);
+  addTriangle(a, c, d);
+}
+
+void
+HaruhiOcclusionBuffer::render() noexcept {
+  const size_t tris = verts_.size() / 3;
+  const size_t nchunks = (tris + SETUP_GRAIN - 1) / SETUP_GRAIN;
+  const size_t nbins = (size_t)bins_x_ * bins_y_;
+
+  auto t0 = std::chrono::steady_clock::now();
+  if(chunks_.size() < nchunks)
+    chunks_.resize(nchunks);
+  for(auto& ch : chunks_) {
+    ch.tris.clear();
+    ch.bins.resize(nbins);
+    for(auto& it : ch.bins) it.clear();
+    ch.culled = ch.clipped = 0;
+  }
+
+  // a single thread pool hands over the whole range at once
+  auto setup = [&](size_t b, size_t e) {
+    for(size_t t = b; t < e; ++t) {
+      Chunk& ch = chunks_[t / SETUP_GRAIN];
+      math::float4 p[3];
+      for(int i = 0; i < 3; ++i)
+        p[i] = view_proj_ * math::float4(verts_[t * 3 + i], 1.);
+
+      // trivial reject against the six frustum planes
+      unsigned outside = ~0u;
+      for(const math::float4& v : p)
+        outside &=
+          unsigned(v.x > v.w) | unsigned(v.x < -v.w) << 1 | unsigned(v.y > v.w) << 2
+          | unsigned(v.y < -v.w) << 3 | unsigned(v.z > v.w) << 4 | unsigned(v.z < 0.f) << 5;
+      if(outside) {
+        ++ch.culled;
+        continue;
+      }
+
+      if(p[0].z >= 0.f && p[1].z >= 0.f && p[2].z >= 0.f) {
+        setupTriangle(ch, p[0], p[1], p[2]);
+        continue;
+      }
+      math::float4 fan[4];
+      const int n = clipNear(p, 3, fan);
+      ++ch.clipped;
+      for(int i = 1; i + 1 < n; ++i)
+        setupTriangle(ch, fan[0], fan[i], fan[i + 1]);
+    }
+  };
+  if(p_pool_) p_pool_->parallelFor(tris, SETUP_GRAIN, setup);
+  else setup(0, tris);
+
+  for(size_t c = 0; c < nchunks; ++c) {
+    timings_.culled += chunks_[c].culled;
+    timings_.clipped += chunks_[c].clipped;
+  }
+  timings_.triangles += tris;
+  timings_.setupMs += msSince(t0);
+
+  t0 = std::chrono::steady_clock::now();
+  auto raster = [&](size_t b, size_t e) {
+    for(size_t bin = b; bin < e; ++bin) rasterBin(bin);
+  };
+  if(p_pool_) p_pool_->parallelFor(nbins, 1, raster);
+  else raster(0, nbins);
+  timings_.rasterMs += msSince(t0);
+}
+
+void
+HaruhiOcclusionBuffer::setupTriangle(Chunk& ch, const math::float4& c0,
+                                     const math::float4& c1, const math::float4& c2) noexcept {
+  struct Screen { float x, y, z; } s[3];
+  const math::float4* cv[3] = { &c0, &c1, &c2 };
+  for(int i = 0; i < 3; ++i) {
+    const float invw = 1.f / cv[i]->w;
+    s[i].x = (cv[i]->x * invw * .5f + .5f) * width_;
+    s[i].y = (.5f - cv[i]->y * invw * .5f) * height_;
+    s[i].z = cv[i]->z * invw;
+  }
+
+  // y points down on screen, so a ccw (front) triangle has negative area
+  float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[1].y - s[0].y) * (s[2].x - s[0].x);
+  if(!(area < 0.f)) {
+    ++ch.culled;
+    return;
+  }
+  std::swap(s[1], s[2]);
+  area = -area;
+
+  Tri tri;
+  const float minx = std::min({ s[0].x, s[1].x, s[2].x });
+  const float maxx = std::max({ s[0].x, s[1].x, s[2].x });
+  const float miny = std::min({ s[0].y, s[1].y, s[2].y });
+  const float maxy = std::max({ s[0].y, s[1].y, s[2].y });
+  tri.min_x = std::max(0, (int)std::ceil(minx - .5f));
+  tri.min_y = std::max(0, (int)std::ceil(miny - .5f));
+  tri.max_x = std::min((int)width_, (int)std::floor(maxx - .5f) + 1);
+  tri.max_y = std::min((int)height_, (int)std::floor(maxy - .5f) + 1);
+  if(tri.min_x >= tri.max_x || tri.min_y >= tri.max_y) {
+    ++ch.culled;
+    return;
+  }
+
+  for(int i = 0; i < 3; ++i) {
+    const Screen& a = s[(i + 1) % 3];
+    const Screen& b = s[(i + 2) % 3];
+    tri.ea[i] = a.y - b.y;
+    tri.eb[i] = b.x - a.x;
+    tri.eox[i] = a.x;
+    tri.eoy[i] = a.y;
+  }
+
+  const float inva = 1.f / area;
+  float dx = 0.f, dy = 0.f;
+  for(int i = 0; i < 3; ++i) {
+    dx += tri.ea[i] * s[i].z;
+    dy += tri.eb[i] * s[i].z;
+  }
+  tri.zc = s[0].z;
+  tri.zdx = dx * inva;
+  tri.zdy = dy * inva;
+  tri.x0 = s[0].x;
+  tri.y0 = s[0].y;
+  tri.zmax = std::max({ s[0].z, s[1].z, s[2].z });
+
+  const uint32_t id = ch.tris.size();
+  ch.tris.push_back(tri);
+
+  const int bx0 = tri.min_x / BIN_W, bx1 = (tri.max_x - 1) / BIN_W;
+  const int by0 = tri.min_y / BIN_H, by1 = (tri.max_y - 1) / BIN_H;
+  for(int by = by0; by <= by1; ++by)
+    for(int bx = bx0; bx <= bx1; ++bx)
+      ch.bins[by * bins_x_ + bx].push_back(id);
+}
+
+// the working layer takes the triangle unless the triangle lies closer to
+// the reference than to the layer, then starting the layer over loses less
+void
+HaruhiOcclusionBuffer::merge(uint32_t t, uint32_t m, float z) noexcept {
+  float& z0 = zmax0_[t];
+  if(z >= z0) return;
+  uint32_t m1 = mask_[t];
+  float z1 = zmax1_[t];
+  if(!m1 || z - z1 > z0 - z) {
+    m1 = 0;
+    z1 = z;
+  } else {
+    z1 = std::max(z1, z);
+  }
+  m1 |= m;
+  if(m1 == ~0u) {
+    z0 = z1;
+    m1 = 0;
+    z1 = 0.f;
+  }
+  mask_[t] = m1;
+  zmax1_[t] = z1;
+}
+
+void
+HaruhiOcclusionBuffer::rasterBin(unsigned bin) noexcept {
+  using namespace math::vec;
+
+  const int btx0 = (bin % bins_x_) * BIN_TILES_X, bty0 = (bin / bins_x_) * BIN_TILES_Y;
+  const int btx1 = std::min<int>(btx0 + BIN_TILES_X, tiles_x_);
+  const int bty1 = std::min<int>(bty0 + BIN_TILES_Y, tiles_y_);
+  const v4 zero = splat(0.f);
+  const v4 lane = set(.5f, 1.5f, 2.5f, 3.5f);
+
+  for(const Chunk& ch : chunks_) {
+    if(ch.bins.empty()) continue;
+    for(uint32_t id : ch.bins[bin]) {
+      const Tri& tri = ch.tris[id];
+      const int tx0 = std::max<int>(tri.min_x / TILE_W, btx0);
+      const int tx1 = std::min<int>((tri.max_x - 1) / TILE_W + 1, btx1);
+      const int ty0 = std::max<int>(tri.min_y / TILE_H, bty0);
+      const int ty1 = std::min<int>((tri.max_y - 1) / TILE_H + 1, bty1);
+
+      v4 ea[3], eox[3];
+      for(int i = 0; i < 3; ++i) {
+        ea[i] = splat(tri.ea[i]);
+        eox[i] = splat(tri.eox[i]);
+      }
+
+      for(int ty = ty0; ty < ty1; ++ty) {
+        const float py = float(ty * TILE_H);
+        // farthest pixel center along y
+        const float zy = tri.zdy * ((tri.zdy > 0.f ? py + TILE_H - .5f : py + .5f) - tri.y0);
+        v4 edy[TILE_H][3];
+        for(unsigned r = 0; r < TILE_H; ++r)
+          for(int i = 0; i < 3; ++i)
+            edy[r][i] = splat(tri.eb[i] * (py + r + .5f - tri.eoy[i]));
+
+        for(int tx = tx0; tx < tx1; ++tx) {
+          const float px = float(tx * TILE_W);
+          uint32_t m = 0;
+          for(unsigned g = 0; g < TILE_W; g += 4) {
+            const v4 xs = add(splat(px + g), lane);
+            v4 ex[3];
+            for(int i = 0; i < 3; ++i) ex[i] = mul(ea[i], sub(xs, eox[i]));
+            for(unsigned r = 0; r < TILE_H; ++r) {
+              v4 c = cmpge(add(ex[0], edy[r][0]), zero);
+              c = and_(c, cmpge(add(ex[1], edy[r][1]), zero));
+              c = and_(c, cmpge(add(ex[2], edy[r][2]), zero));
+              m |= uint32_t(movemask(c)) << (r * TILE_W + g);
+            }
+          }
+          if(!m) continue;
+
+          const float zx = tri.zdx * ((tri.zdx > 0.f ? px + TILE_W - .5f : px + .5f) - tri.x0);
+          merge(ty * tiles_x_ + tx, m, std::min(tri.zmax, tri.zc + zx + zy));
+        }
+      }
+    }
+  }
+}
+
+bool
+HaruhiOcclusionBuffer::visible(const cull::Aabb& box) const noexcept {
+  using namespace math::vec;
+
+  // the eight corners in two batches of four
+  const auto& c = view_proj_.columns;
+  const v4 xs = set(box.min.x, box.max.x, box.min.x, box.max.x);
+  const v4 ys = set(box.min.y, box.min.y, box.max.y, box.max.y);
+  const v4 zero = splat(0.f);
+  v4 lo_x = splat(INFINITY), hi_x = splat(-INFINITY);
+  v4 lo_y = lo_x, hi_y = hi_x, lo_z = lo_x;
+  for(float z : { box.min.z, box.max.z }) {
+    const v4 zs = splat(z);
+    const v4 X = madd(splat(c[0].x), xs, madd(splat(c[1].x), ys, madd(splat(c[2].x), zs, splat(c[3].x))));
+    const v4 Y = madd(splat(c[0].y), xs, madd(splat(c[1].y), ys, madd(splat(c[2].y), zs, splat(c[3].y))));
+    const v4 Z = madd(splat(c[0].z), xs, madd(splat(c[1].z), ys, madd(splat(c[2].z), zs, splat(c[3].z))));
+    const v4 W = madd(splat(c[0].w), xs, madd(splat(c[1].w), ys, madd(splat(c[2].w), zs, splat(c[3].w))));
+    // reaching the near plane or behind the camera
+    if(movemask(or_(cmplt(Z, zero), cmplt(W, splat(1e-6f))))) return true;
+    const v4 invw = div(splat(1.f), W);
+    const v4 sx = mul(X, invw), sy = mul(Y, invw);
+    lo_x = min(lo_x, sx); hi_x = max(hi_x, sx);
+    lo_y = min(lo_y, sy); hi_y = max(hi_y, sy);
+    lo_z = min(lo_z, mul(Z, invw));
+  }
+  alignas(16) float f[5][4];
+  store(f[0], lo_x); store(f[1], hi_x); store(f[2], lo_y); store(f[3], hi_y); store(f[4], lo_z);
+  auto reduce = [](const float* v, bool lower) {
+    return lower ? std::min({ v[0], v[1], v[2], v[3] }) : std::max({ v[0], v[1], v[2], v[3] });
+  };
+  const float zmin = reduce(f[4], true);
+  if(zmin > 1.f) return false;
+
+  // pixels whose centers the screen rect can touch, y flips
+  const int px0 = std::max(0, (int)std::floor((reduce(f[0], true) * .5f + .5f) * width_));
+  const int px1 = std::min((int)width_, (int)std::ceil((reduce(f[1], false) * .5f + .5f) * width_));
+  const int py0 = std::max(0, (int)std::floor((.5f - reduce(f[3], false) * .5f) * height_));
+  const int py1 = std::min((int)height_, (int)std::ceil((.5f - reduce(f[2], true) * .5f) * height_));
+  if(px0 >= px1 || py0 >= py1) return false;
+
+  const int tx0 = px0 / TILE_W, tx1 = (px1 - 1) / TILE_W;
+  const int ty0 = py0 / TILE_H, ty1 = (py1 - 1) / TILE_H;
+  const v4 vz = splat(zmin);
+  for(int ty = ty0; ty <= ty1; ++ty) {
+    // rows of the rect inside this tile row
+    const int r0 = std::max(py0 - ty * (int)TILE_H, 0);
+    const int r1 = std::min(py1 - ty * (int)TILE_H, (int)TILE_H);
+    const uint32_t rows =
+      uint32_t((uint64_t(1) << (r1 * TILE_W)) - 1) & ~uint32_t((uint64_t(1) << (r0 * TILE_W)) - 1);
+    for(int tx = tx0; tx <= tx1; tx += 4) {
+      // four tiles against their reference depth at once
+      const int n = std::min(4, tx1 - tx + 1);
+      int front = movemask(cmpge(loadu(&zmax0_[ty * tiles_x_ + tx]), vz)) & ((1 << n) - 1);
+      for(; front; front &= front - 1) {
+        const int x = tx + __builtin_ctz(front);
+        const uint32_t t = ty * tiles_x_ + x;
+        // the layer can still hide it when it covers the rect in front
+        const int c0 = std::max(px0 - x * (int)TILE_W, 0);
+        const int c1 = std::min(px1 - x * (int)TILE_W, (int)TILE_W);
+        const uint32_t cols = ((1u << c1) - 1) & ~((1u << c0) - 1);
+        const uint32_t rect = rows & (cols * 0x01010101u);
+        if(zmin > zmax1_[t] && !(rect & ~mask_[t])) continue;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+float
+HaruhiOcclusionBuffer::depthAt(uint32_t x, uint32_t y) const noexcept {
+  const uint32_t t = (y / TILE_H) * tiles_x_ + x / TILE_W;
+  const uint32_t bit = (y % TILE_H) * TILE_W + x % TILE_W;
+  return mask_[t] >> bit & 1 ? zmax1_[t] : zmax0_[t];
+}
+
+bool
+HaruhiOcclusionBuffer::writePGM(const char* pth) const noexcept {
+  // stretched over the covered range, perspective depth bunches up near 1
+  float lo = 1.f;
+  for(uint32_t y = 0; y < height_; ++y)
+    for(uint32_t x = 0; x < width_; ++x)
+      lo = std::min(lo, depthAt(x, y));
+  const float scale = lo < 1.f ? 223.f / (1.f - lo) : 0.f;
+
+  FILE* fp = fopen(pth, "wb");
+  if(!fp) return false;
+  fprintf(fp, "P5\n%u %u\n255\n", width_, height_);
+  std::vector<uint8_t> row(width_);
+  for(uint32_t y = 0; y < height_; ++y) {
+    for(uint32_t x = 0; x < width_; ++x) {
+      const float d = depthAt(x, y);
+      row[x] = d >= 1.f ? 0 : uint8_t(32.f + (1.f - d) * scale);
+    }
+    fwrite(row.data(), 1, row.size(), fp);
+  }
+  return fclose(fp) == 0;
+}
\ No newline at end of file
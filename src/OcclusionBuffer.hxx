@@ -0,0 +1,86 @@
+#ifndef HARUHI_OCCLUSIONBUFFER_HXX
+#define HARUHI_OCCLUSIONBUFFER_HXX
+
+#include <cstdint>
+#include <vector>
+
+#include "BoundsTree.hxx"
+
+class HaruhiWorkerPool;
+
+// low resolution occluder depth for culling on the cpu, masked
+// occlusion style
+//
+// the screen is cut into TILE_W x TILE_H pixel tiles. a tile keeps a
+// reference depth every pixel of it is known to be in front of, plus a
+// working layer: a coverage bitmask and the farthest depth within it.
+// occluder triangles are merged into the layer, once it covers the whole
+// tile it becomes the new reference. depths are metal's z / w, 0 at the
+// near plane. nothing is stored per pixel, which keeps both the
+// rasterizer and the box test to a few vector ops per tile
+class HaruhiOcclusionBuffer {
+public:
+  static constexpr unsigned TILE_W = 8, TILE_H = 4;
+  // tiles per bin, bins are rasterized in parallel
+  static constexpr unsigned BIN_TILES_X = 8, BIN_TILES_Y = 8;
+
+  // accumulated over render calls until resetTimings
+  struct Timings {
+    double setupMs, rasterMs;
+    uint64_t triangles, culled, clipped;
+  };
+
+private:
+  struct Tri;
+  struct Chunk;
+
+  uint32_t width_, height_;
+  uint32_t tiles_x_, tiles_y_, bins_x_, bins_y_;
+
+  // per tile, zmax0_ padded so four tiles can always be loaded
+  std::vector<float> zmax0_, zmax1_;
+  std::vector<uint32_t> mask_;
+
+  math::float4x4 view_proj_;
+  std::vector<math::float3> verts_;
+  std::vector<Chunk> chunks_;
+
+  HaruhiWorkerPool* p_pool_;
+  Timings timings_;
+
+  void setupTriangle(Chunk&, const math::float4&, const math::float4&, const math::float4&) noexcept;
+  void rasterBin(unsigned) noexcept;
+  void merge(uint32_t, uint32_t, float) noexcept;
+
+public:
+  // sizes round up to whole tiles
+  HaruhiOcclusionBuffer(uint32_t, uint32_t, HaruhiWorkerPool* = nullptr);
+  ~HaruhiOcclusionBuffer();
+
+  uint32_t width() const noexcept { return width_; }
+  uint32_t height() const noexcept { return height_; }
+
+  // clears the depth and the queued occluders for a new projection * view
+  void begin(const math::float4x4&) noexcept;
+  // world space, ccw seen from the front, back faces are dropped
+  void addTriangle(const math::float3&, const math::float3&, const math::float3&);
+  // (a b c) (a c d)
+  void addQuad(const math::float3&, const math::float3&, const math::float3&, const math::float3&);
+  size_t queued() const noexcept { return verts_.size() / 3; }
+  // rasterizes the queued occluders
+  void render() noexcept;
+
+  // false when the box is certainly hidden behind the occluders or off
+  // screen. boxes reaching the near plane are always visible
+  bool visible(const cull::Aabb&) const noexcept;
+
+  // farthest depth an occluder can have at the pixel, 1 where none is
+  float depthAt(uint32_t, uint32_t) const noexcept;
+  // binary 8 bit pgm of depthAt, near is bright, empty is black
+  bool writePGM(const char*) const noexcept;
+
+  const Timings& timings() const noexcept { return timings_; }
+  void resetTimings() noexcept;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "Primitives.hxx"
+
+#include <cstring>
+
+namespace primitives {
+
+void
+makeCube(float s, shader_t::VertexData* pVerts, uint16_t* pIndices) noexcept {
+  const shader_t::VertexData cube[] = {
+    { { -s, -s, +s }, {  0.f,  0.f,  1.f }, { 0.f, 1.f } },
+    { { +s, -s, +s }, {  0.f,  0.f,  1.f }, { 1.f, 1.f } },
+    { { +s, +s, +s }, {  0.f,  0.f,  1.f }, { 1.f, 0.f } },
+    { { -s, +s, +s }, {  0.f,  0.f,  1.f }, { 0.f, 0.f } },
+
+    { { +s, -s, +s }, {  1.f,  0.f,  0.f }, { 0.f, 1.f } },
+    { { +s, -s, -s }, {  1.f,  0.f,  0.f }, { 1.f, 1.f } },
+    { { +s, +s, -s }, {  1.f,  0.f,  0.f }, { 1.f, 0.f } },
+    { { +s, +s, +s }, {  1.f,  0.f,  0.f }, { 0.f, 0.f } },
+
+    { { +s, -s, -s }, {  0.f,  0.f, -1.f }, { 0.f, 1.f } },
+    { { -s, -s, -s }, {  0.f,  0.f, -1.f }, { 1.f, 1.f } },
+    { { -s, +s, -s }, {  0.f,  0.f, -1.f }, { 1.f, 0.f } },
+    { { +s, +s, -s }, {  0.f,  0.f, -1.f }, { 0.f, 0.f } },
+
+    { { -s, -s, -s }, { -1.f,  0.f,  0.f }, { 0.f, 1.f } },
+    { { -s, -s, +s }, { -1.f,  0.f,  0.f }, { 1.f, 1.f } },
+    { { -s, +s, +s }, { -1.f,  0.f,  0.f }, { 1.f, 0.f } },
+    { { -s, +s, -s }, { -1.f,  0.f,  0.f }, { 0.f, 0.f } },
+
+    { { -s, +s, +s }, {  0.f,  1.f,  0.f }, { 0.f, 1.f } },
+    { { +s, +s, +s }, {  0.f,  1.f,  0.f }, { 1.f, 1.f } },
+    { { +s, +s, -s }, {  0.f,  1.f,  0.f }, { 1.f, 0.f } },
+    { { -s, +s, -s }, {  0.f,  1.f,  0.f }, { 0.f, 0.f } },
+
+    { { -s, -s, -s }, {  0.f, -1.f,  0.f }, { 0.f, 1.f } },
+    { { +s, -s, -s }, {  0.f, -1.f,  0.f }, { 1.f, 1.f } },
+    { { +s, -s, +s }, {  0.f, -1.f,  0.f }, { 1.f, 0.f } },
+    { { -s, -s, +s }, {  0.f, -1.f,  0.f }, { 0.f, 0.f } }
+  };
+  
+  const uint16_t cube_indices[] = {
+    // front
+    0,  1,  2, // ㄱ
+    2,  3,  0, // ㄴ
+    // right
+    4,  5,  6,
+    6,  7,  4,
+    // back
+    8,  9, 10,
+    10, 11, 8,
+    // left
+    12, 13, 14,
+    14, 15, 12,
+    //top
+    16, 17, 18,
+    18, 19, 16,
+    //bot
+    20, 21, 22,
+    22, 23, 20,
+  };
+
+  static_assert(sizeof(cube) / sizeof(cube[0]) == CUBE_VERTEX_COUNT);
+  static_assert(sizeof(cube_indices) / sizeof(cube_indices[0]) == CUBE_INDEX_COUNT);
+
+  memcpy(pVerts, cube, sizeof(cube));
+  memcpy(pIndices, cube_indices, sizeof(cube_indices));
+}
+
+} // ns primitives
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef HARUHI_PRIMITIVES_HXX
+#define HARUHI_PRIMITIVES_HXX
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ShaderTypes.hxx"
+
+namespace primitives {
+
+// textured cube with per face normals, ccw front faces
+constexpr size_t CUBE_VERTEX_COUNT = 24;
+constexpr size_t CUBE_INDEX_COUNT = 36;
+
+void makeCube(float, shader_t::VertexData*, uint16_t*) noexcept;
+
+} // ns primitives
+
+#endif
\ No newline at end of file
@@ -0,0 +1,268 @@
+#include "Profiler.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+constexpr uint64_t RING_MASK = prof::RING_SIZE - 1;
+static_assert((prof::RING_SIZE & RING_MASK) == 0, "the ring size is a power of two");
+
+// written by its thread only. head counts every event ever written, the
+// last RING_SIZE of them are still there
+struct Ring {
+  prof::Event events[prof::RING_SIZE];
+  std::atomic<uint64_t> head;
+  char name[32];
+};
+
+// rings outlive their threads, so a capture still shows finished ones
+struct Registry {
+  std::mutex mtx;
+  std::vector<std::unique_ptr<Ring>> rings;
+};
+
+Registry&
+registry() noexcept {
+  static Registry r;
+  return r;
+}
+
+// ticks and ns read together, collect scales ticks by the rate since
+struct Calibration {
+  uint64_t ticks, ns;
+};
+
+const Calibration&
+origin() noexcept {
+  static const Calibration c = { prof::ticks(), prof::now() };
+  return c;
+}
+
+thread_local Ring* tl_ring = nullptr;
+thread_local uint32_t tl_thread = 0;
+
+Ring&
+ownRing() noexcept {
+  if(!tl_ring) [[unlikely]] {
+    origin();
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.mtx);
+    r.rings.push_back(std::make_unique<Ring>());
+    tl_ring = r.rings.back().get();
+    tl_thread = uint32_t(r.rings.size() - 1);
+    snprintf(tl_ring->name, sizeof(tl_ring->name), "thread %u", tl_thread);
+  }
+  return *tl_ring;
+}
+
+void
+push(prof::EventKind kind, const char* name, uint64_t start, uint64_t end) noexcept {
+  Ring& r = ownRing();
+  if(!name) [[unlikely]] name = "unnamed";
+  const uint64_t h = r.head.load(std::memory_order_relaxed);
+  r.events[h & RING_MASK] = { name, start, end, tl_thread, kind };
+  r.head.store(h + 1, std::memory_order_release);
+}
+
+void
+writeJsonString(FILE* fp, const char* s) noexcept {
+  fputc('"', fp);
+  for(; *s; ++s) {
+    if(*s == '"' || *s == '\\') fprintf(fp, "\\%c", *s);
+    else if((unsigned char)*s < 0x20) fprintf(fp, "\\u%04x", *s);
+    else fputc(*s, fp);
+  }
+  fputc('"', fp);
+}
+
+} // ns
+
+namespace prof {
+
+void
+scope(const char* name, uint64_t start, uint64_t end) noexcept {
+  push(EVENT_SCOPE, name, start, end);
+}
+
+void
+counter(const char* name, int64_t value) noexcept {
+  push(EVENT_COUNTER, name, ticks(), uint64_t(value));
+}
+
+void
+frame() noexcept {
+  const uint64_t t = ticks();
+  push(EVENT_FRAME, "frame", t, t);
+}
+
+void
+gpu(const char* name, uint64_t start, uint64_t end) noexcept {
+  push(EVENT_GPU, name, start, end);
+}
+
+void
+setThreadName(const char* name) noexcept {
+  Ring& r = ownRing();
+  snprintf(r.name, sizeof(r.name), "%s", name);
+}
+
+std::vector<Event>
+collect() {
+  std::vector<Event> out;
+  Registry& reg = registry();
+  std::lock_guard<std::mutex> lk(reg.mtx);
+  for(const auto& r : reg.rings) {
+    const uint64_t head = r->head.load(std::memory_order_acquire);
+    const uint64_t first = head > RING_SIZE ? head - RING_SIZE : 0;
+    const size_t at = out.size();
+    for(uint64_t i = first; i < head; ++i)
+      out.push_back(r->events[i & RING_MASK]);
+    // the oldest ones may have been overwritten while copying. the owner
+    // may also be writing event after right now, unpublished, into the
+    // slot of after - RING_SIZE, so that one is dropped too
+    const uint64_t after = r->head.load(std::memory_order_acquire);
+    if(after + 1 - first > RING_SIZE) {
+      const size_t lost = std::min<uint64_t>(after + 1 - first - RING_SIZE, head - first);
+      out.erase(out.begin() + at, out.begin() + at + lost);
+    }
+  }
+
+  const Calibration& o = origin();
+  const uint64_t t = ticks(), ns = now();
+  const double rate = t > o.ticks ? double(ns - o.ns) / double(t - o.ticks) : 1.;
+  auto toNs = [&](uint64_t v) { return o.ns + uint64_t(int64_t(double(int64_t(v - o.ticks)) * rate)); };
+  for(Event& e : out) {
+    if(e.kind == EVENT_GPU) continue;
+    e.start = toNs(e.start);
+    if(e.kind != EVENT_COUNTER) e.end = toNs(e.end);
+  }
+  std::stable_sort(out.begin(), out.end(), [](const Event& a, const Event& b) {
+    return a.start < b.start;
+  });
+  return out;
+}
+
+bool
+writeChromeTrace(const char* pth, const std::vector<Event>& events) noexcept {
+  FILE* fp = fopen(pth, "w");
+  if(!fp) return false;
+
+  uint64_t base = UINT64_MAX;
+  for(const Event& e : events)
+    base = std::min(base, e.start);
+
+  // gpu work gets a track after the threads
+  uint32_t gpuTrack;
+  fprintf(fp, "{\"traceEvents\":[\n");
+  {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lk(reg.mtx);
+    gpuTrack = uint32_t(reg.rings.size());
+    for(uint32_t t = 0; t < reg.rings.size(); ++t) {
+      fprintf(fp, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", t);
+      writeJsonString(fp, reg.rings[t]->name);
+      fprintf(fp, "}},\n");
+    }
+  }
+  fprintf(fp, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"gpu\"}}", gpuTrack);
+
+  for(const Event& e : events) {
+    const double ts = (e.start - base) * 1e-3;
+    fprintf(fp, ",\n{\"name\":");
+    writeJsonString(fp, e.name);
+    switch(e.kind) {
+    case EVENT_SCOPE:
+    case EVENT_GPU:
+      fprintf(fp, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+              e.kind == EVENT_GPU ? gpuTrack : e.thread, ts, (e.end - e.start) * 1e-3);
+      break;
+    case EVENT_COUNTER:
+      fprintf(fp, ",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+              e.thread, ts, (long long)(int64_t)e.end);
+      break;
+    case EVENT_FRAME:
+      fprintf(fp, ",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}", e.thread, ts);
+      break;
+    }
+  }
+  fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  return fclose(fp) == 0;
+}
+
+std::vector<Summary>
+summarize(const std::vector<Event>& events, size_t frames) {
+  std::vector<uint64_t> marks;
+  for(const Event& e : events)
+    if(e.kind == EVENT_FRAME) marks.push_back(e.start);
+  std::sort(marks.begin(), marks.end());
+  if(marks.size() < 2 || !frames) return {};
+  frames = std::min(frames, marks.size() - 1);
+  const uint64_t begin = marks[marks.size() - 1 - frames], end = marks.back();
+
+  struct Acc {
+    Summary s;
+    std::vector<double> perFrame;
+    uint64_t samples;
+  };
+  std::unordered_map<std::string, Acc> acc;
+  for(const Event& e : events) {
+    if(e.kind == EVENT_FRAME || e.start < begin || e.start >= end) continue;
+    // the gpu may share names with the cpu markers
+    auto [it, added] = acc.try_emplace(std::string(e.name) + char('0' + e.kind));
+    Acc& a = it->second;
+    if(added) {
+      a.s = { e.name, e.kind, 0, 0., 0. };
+      a.perFrame.assign(frames, 0.);
+      a.samples = 0;
+    }
+    ++a.s.calls;
+    if(e.kind == EVENT_COUNTER) {
+      const double v = double(int64_t(e.end));
+      a.s.average += v;
+      a.s.max = a.samples++ ? std::max(a.s.max, v) : v;
+    } else {
+      const size_t f = std::upper_bound(marks.end() - 1 - frames, marks.end(), e.start)
+                       - (marks.end() - 1 - frames) - 1;
+      a.perFrame[f] += (e.end - e.start) * 1e-6;
+    }
+  }
+
+  std::vector<Summary> out;
+  for(auto& it : acc) {
+    Summary s = it.second.s;
+    if(s.kind == EVENT_COUNTER) {
+      s.average /= double(it.second.samples);
+    } else {
+      for(double ms : it.second.perFrame) {
+        s.average += ms;
+        s.max = std::max(s.max, ms);
+      }
+      s.average /= double(frames);
+    }
+    out.push_back(s);
+  }
+  std::sort(out.begin(), out.end(), [](const Summary& a, const Summary& b) {
+    if((a.kind == EVENT_COUNTER) != (b.kind == EVENT_COUNTER)) return b.kind == EVENT_COUNTER;
+    if(a.kind == EVENT_COUNTER) return std::string(a.name) < std::string(b.name);
+    return a.average > b.average;
+  });
+  return out;
+}
+
+void
+printSummary(FILE* fp, const std::vector<Summary>& summary) noexcept {
+  for(const Summary& s : summary) {
+    if(s.kind == EVENT_COUNTER)
+      fprintf(fp, "%-32s %12.1f avg %12.1f max\n", s.name, s.average, s.max);
+    else
+      fprintf(fp, "%-32s %9.3f ms %9.3f ms max %8llu calls%s\n", s.name, s.average, s.max,
+              (unsigned long long)s.calls, s.kind == EVENT_GPU ? " (gpu)" : "");
+  }
+}
+
+} // ns prof
\ No newline at end of file
@@ -0,0 +1,125 @@
+#ifndef HARUHI_PROFILER_HXX
+#define HARUHI_PROFILER_HXX
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// cpu markers, counters and frame boundaries in per thread rings
+//
+// every thread writes its own ring of RING_SIZE events, the oldest get
+// overwritten and a full ring yields RING_SIZE - 1 of them. recording
+// takes no lock, collecting reads all rings and may lose events written
+// meanwhile. markers stamp raw cpu ticks, collect
+// turns them into ns on now's clock. names are never copied, they have
+// to outlive the capture, string literals in practice. the macros
+// compile to nothing unless HARUHI_PROFILE is defined
+namespace prof {
+
+constexpr size_t RING_SIZE = 1 << 14;
+
+enum EventKind : uint8_t {
+  EVENT_SCOPE,
+  EVENT_COUNTER,
+  EVENT_FRAME,
+  // on the gpu track, from HaruhiGpuTimer
+  EVENT_GPU
+};
+
+struct Event {
+  const char* name;
+  // ns on now's clock once collected, ticks before except for the gpu
+  uint64_t start;
+  // end for scopes, the value for counters
+  uint64_t end;
+  uint32_t thread;
+  EventKind kind;
+};
+
+inline uint64_t
+now() noexcept {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the invariant counter, a fraction of now's cost
+inline uint64_t
+ticks() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t t;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(t));
+  return t;
+#else
+  return now();
+#endif
+}
+
+// start and end in ticks
+void scope(const char*, uint64_t, uint64_t) noexcept;
+void counter(const char*, int64_t) noexcept;
+// the frame before ends here
+void frame() noexcept;
+// ns on now's clock, from whatever thread the gpu reports on
+void gpu(const char*, uint64_t, uint64_t) noexcept;
+// shows up in the trace, copied
+void setThreadName(const char*) noexcept;
+
+class Scope {
+  const char* name_;
+  uint64_t start_;
+public:
+  explicit Scope(const char* name) noexcept : name_(name), start_(ticks()) {}
+  ~Scope() { scope(name_, start_, ticks()); }
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+};
+
+// every event still in a ring, by start time
+std::vector<Event> collect();
+// chrome://tracing and perfetto read it
+bool writeChromeTrace(const char*, const std::vector<Event>&) noexcept;
+
+// per frame totals of one marker or counter over the summarized frames
+struct Summary {
+  const char* name;
+  EventKind kind;
+  uint64_t calls;
+  // ms for scopes, values for counters
+  double average, max;
+};
+
+// the last n complete frames, scopes first, slowest first
+std::vector<Summary> summarize(const std::vector<Event>&, size_t);
+void printSummary(FILE*, const std::vector<Summary>&) noexcept;
+
+} // ns prof
+
+// backend timestamps of gpu work, reported through prof::gpu once the
+// gpu is done. the command buffer is the backend's
+class HaruhiGpuTimer {
+public:
+  virtual ~HaruhiGpuTimer() = default;
+  virtual void track(const char*, void*) noexcept = 0;
+};
+
+#define HARUHI_PROFILE_CAT2(a, b) a##b
+#define HARUHI_PROFILE_CAT(a, b) HARUHI_PROFILE_CAT2(a, b)
+
+#ifdef HARUHI_PROFILE
+#define HARUHI_PROFILE_SCOPE(name) prof::Scope HARUHI_PROFILE_CAT(profScope_, __LINE__)(name)
+#define HARUHI_PROFILE_COUNTER(name, value) prof::counter(name, int64_t(value))
+#define HARUHI_PROFILE_FRAME() prof::frame()
+#else
+#define HARUHI_PROFILE_SCOPE(name) ((void)0)
+#define HARUHI_PROFILE_COUNTER(name, value) ((void)0)
+#define HARUHI_PROFILE_FRAME() ((void)0)
+#endif
+
+#endif
\ No newline at end of file
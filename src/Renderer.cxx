@@ -1,34 +1,93 @@
 #include "Renderer.hxx"
 
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
 #include "GameEngine.hxx"
+#include "VertexFormat.hxx"
 
 using namespace NS;
 
+namespace {
+
+// chunks recorded per draw list
+constexpr size_t CHUNK_RECORD_GRAIN = 16;
+// frames per printed profile summary
+constexpr size_t SUMMARY_FRAMES = 300;
+
+// chunk vertices are packed relative to the chunk, positions in 1/1024
+// blocks and texcoords, below ATLAS_TILES, in 1/2048 so block corners
+// and tiles land exactly on steps
+constexpr float CHUNK_POSITION_STEP = 1.f / 1024.f;
+constexpr float CHUNK_TEXCOORD_STEP = 1.f / 2048.f;
+static_assert(voxel::CHUNK_SIZE / CHUNK_POSITION_STEP <= 65535.f);
+static_assert(voxel::ATLAS_TILES / CHUNK_TEXCOORD_STEP <= 65536.f);
+
+// a chunk's vertex buffer starts with its PackedMeshData, which is bound
+// as the instance buffer, the vertices follow
+constexpr uint32_t CHUNK_HEADER_VERTICES =
+  sizeof(shader_t::PackedMeshData) / sizeof(shader_t::PackedVertexData);
+static_assert(sizeof(shader_t::PackedMeshData) % sizeof(shader_t::PackedVertexData) == 0);
+
+vtx::Quantization
+chunkQuantization(const voxel::ChunkCoord& c) noexcept {
+  constexpr float S = voxel::CHUNK_SIZE;
+  return { { c.x * S, c.y * S, c.z * S }, CHUNK_POSITION_STEP,
+           { 0., 0. }, { CHUNK_TEXCOORD_STEP, CHUNK_TEXCOORD_STEP } };
+}
+
+cull::Aabb
+chunkBounds(const voxel::ChunkCoord& c) noexcept {
+  constexpr float S = voxel::CHUNK_SIZE;
+  return { { c.x * S, c.y * S, c.z * S }, { (c.x + 1) * S, (c.y + 1) * S, (c.z + 1) * S } };
+}
+
+} // ns
+
 HaruhiRenderer::HaruhiRenderer(Haruhi* pHaru, MTL::Device* pDev)
-: p_haruhi_(pHaru), p_device_(pDev), angle_(0.), frame_(0), animation_ind_(0)
+: p_haruhi_(pHaru), p_device_(pDev), gather_(MAX_FRAMES_IN_FLIGHT),
+  occlusion_(OCCLUSION_WIDTH, OCCLUSION_HEIGHT, pHaru->accessWorkerPool()), light_(voxels_),
+  upload_backend_(pDev), trace_path_(getenv("HARUHI_TRACE")),
+  print_summary_(getenv("HARUHI_PROFILE_SUMMARY") != nullptr), frame_(0), animation_ind_(0)
 {
+#ifdef HARUHI_PROFILE
+  prof::setThreadName("main");
+#endif
   p_cmd_queue_ = p_device_->newCommandQueue();
+  uploads_ = std::make_unique<HaruhiFrameAllocator>(
+    upload_backend_, fence_, MAX_FRAMES_IN_FLIGHT, UPLOAD_RING_SIZE);
   buildShaders();
   buildComputePipeline();
   buildDepthStencilStates();
   buildTextures();
   buildBufs();
-
-  sema_ = dispatch_semaphore_create(MAX_FRAMES_IN_FLIGHT);
+  buildScene();
 }
 
 HaruhiRenderer::~HaruhiRenderer() {
+  // the rings may still be read by frames in flight
+  fence_.wait(uploads_->frame());
+  uploads_.reset();
+#ifdef HARUHI_PROFILE
+  if(trace_path_ && !prof::writeChromeTrace(trace_path_, prof::collect()))
+    printf("could not write the trace to %s\n", trace_path_);
+#endif
   pTextureAnimationBuf->release();
-  p_texture_->release();
+  if(texture_handle_)
+    p_haruhi_->accessResourcePool()->table().release(texture_handle_);
   p_shader_lib_->release();
   p_dss_->release();
   pVertexBuf->release();
   for(int i = 0; i< MAX_FRAMES_IN_FLIGHT; ++i)
     pInstanceBuf[i]->release();
-  for(int i = 0; i< MAX_FRAMES_IN_FLIGHT; ++i)
-    pCameraBuf[i]->release();
   pIndexBuf->release();
+  for(auto& it : chunk_bufs_) {
+    it.second.pVertices->release();
+    it.second.pIndices->release();
+  }
   p_cps_->release();
+  p_voxel_rps_->release();
   p_rps_->release();
   p_cmd_queue_->release();
   p_device_->release();
@@ -36,53 +95,71 @@ HaruhiRenderer::~HaruhiRenderer() {
 
 void
 HaruhiRenderer::buildShaders() {
-  const char * shader_source = R"(
+  HARUHI_PROFILE_SCOPE("buildShaders");
+  // the shared structs and the instance expansion go in between
+  const std::string shader_source = std::string(R"(
     #include <metal_stdlib>
     using namespace metal;
+    )") + shader_t::STRUCTS_SOURCE + shader_t::INSTANCE_SOURCE + R"(
     struct v2f
     {
         float4 position [[position]];
         float3 normal;
         // half3 color; // is this necessary
         float2 texcoord;
-    };
-    struct VertexData
-    {
-        float3 position;
-        float3 normal;
-        float2 texcoord;
-    };
-    struct InstanceData
-    {
-        float4x4 instanceTransform;
-        float3x3 instanceNormalTransform;
-        // float4 instanceColor;
-    };
-    struct CameraData
-    {
-        float4x4 perspectiveTransform;
-        float4x4 worldTransform;
-        float3x3 worldNormalTransform;
+        // sky and block light, 0..1
+        float2 light;
     };
     v2f vertex fn_vertex(device const VertexData* vertexData [[buffer(0)]],
-                          device const InstanceData* instanceData [[buffer(1)]],
+                          device const CompactInstanceData* instanceData [[buffer(1)]],
                           device const CameraData& cameraData [[buffer(2)]],
                           uint vertexId [[vertex_id]],
                           uint instanceId [[instance_id]] )
     {
       device const auto& cvert = vertexData[vertexId];
-      device const auto& cinst = instanceData[instanceId];
+      ExpandedInstance cinst = expandInstance(instanceData[instanceId]);
       device const auto& ccam = cameraData;
 
       float4 pos =
-        ccam.perspectiveTransform * ccam.worldTransform
-        * cinst.instanceTransform * float4(cvert.position, 1.0);
+        ccam.perspTransform * ccam.worldTransform
+        * cinst.transform * float4(cvert.pos, 1.0);
 
       float3 norm =
         ccam.worldNormalTransform *
-        (cinst.instanceNormalTransform * cvert.normal);
+        (cinst.normalTransform * cvert.norm);
       ;
-      return (struct v2f){pos, norm, /*half3(cinst.instanceColor.rgb),*/ cvert.texcoord.xy};
+      return (struct v2f){pos, norm, /*half3(cinst.color.rgb),*/ cvert.texcoord.xy, float2(1., 0.)};
+    }
+    float3 octDecode(short2 e)
+    {
+      float2 f = max(float2(e) / 32767., -1.);
+      float3 n = float3(f, 1. - abs(f.x) - abs(f.y));
+      float t = max(-n.z, 0.);
+      n.xy += select(float2(t), float2(-t), n.xy >= 0.);
+      return normalize(n);
+    }
+    // one mesh per draw, its dequantization where the instances would be
+    v2f vertex fn_packed_vertex(device const PackedVertexData* vertexData [[buffer(0)]],
+                                 device const PackedMeshData& meshData [[buffer(1)]],
+                                 device const CameraData& cameraData [[buffer(2)]],
+                                 uint vertexId [[vertex_id]] )
+    {
+      device const auto& cvert = vertexData[vertexId];
+      device const auto& ccam = cameraData;
+
+      float4 pos =
+        ccam.perspTransform * ccam.worldTransform
+        * meshData.meshTransform * float4(cvert.pos[0], cvert.pos[1], cvert.pos[2], 1.0);
+
+      float3 norm =
+        ccam.worldNormalTransform *
+        (meshData.meshNormalTransform * octDecode(short2(cvert.norm[0], cvert.norm[1])));
+      float2 texcoord =
+        float2(cvert.texcoord[0], cvert.texcoord[1]) * meshData.texcoordTransform.xy
+        + meshData.texcoordTransform.zw;
+      // voxel::MAX_LIGHT per channel, sky << 4 | block
+      float2 light = float2(float(cvert.pos[3] >> 4), float(cvert.pos[3] & 15)) / 15.;
+      return (struct v2f){pos, norm, texcoord, light};
     }
     half4 fragment fn_frag(
         v2f in [[stage_in]],
@@ -103,6 +180,31 @@ HaruhiRenderer::buildShaders() {
       // return half4(1.);
       // return half4(tex.sample(texSampler, in.texcoord).rgb, 1.);
     }
+    // texcoord = tile + local / 33 (voxel::TEXCOORD_SPAN), local in blocks
+    // across a merged quad. the gradients are taken on the continuous
+    // texcoord so the wrap at block edges doesn't pick a tiny mip
+    half4 fragment fn_voxel_frag(
+        v2f in [[stage_in]],
+        texture2d<half, access::sample> tex [[texture(0)]],
+        sampler texSampler [[sampler(0)]]
+      ) {
+      float2 tile = floor(in.texcoord);
+      float2 local = fract(in.texcoord) * 33.;
+      float2 uv = (tile + fract(local)) / 32.;
+      half3 texel = tex.sample(texSampler, uv,
+        gradient2d(dfdx(in.texcoord) * (33. / 32.), dfdy(in.texcoord) * (33. / 32.))).rgb;
+
+      float3 l = normalize(float3( 1.0, 1.0, 0.8 ));
+      float3 n = normalize( in.normal );
+
+      half ndotl = half( saturate( dot( n, l ) ) );
+
+      // every level of light is 0.8 of the one above, the sun only
+      // reaches as far as the sky light does
+      float2 level = pow(float2(0.8), 15. - in.light * 15.);
+      half3 illum = texel * half(max(level.x * (0.1 + float(ndotl)), level.y));
+      return half4( illum, 1.0 );
+    }
     )";
   ;
 
@@ -110,7 +212,7 @@ HaruhiRenderer::buildShaders() {
 
   MTL::Library* pLib =
     p_device_->newLibrary(
-      String::string(shader_source, UTF8StringEncoding),
+      String::string(shader_source.c_str(), UTF8StringEncoding),
       nullptr, &pErr);
   ;
 
@@ -136,8 +238,22 @@ HaruhiRenderer::buildShaders() {
     printf("%s", pErr->localizedDescription()->utf8String());
     abort();
   }
+  rps_id_ = draw_backend_.addPipeline(p_rps_);
+
+  MTL::Function* packedVertexFn =
+    pLib->newFunction(String::string("fn_packed_vertex", UTF8StringEncoding));
+  MTL::Function* voxelFragFn =
+    pLib->newFunction(String::string("fn_voxel_frag", UTF8StringEncoding));
+  pDesc->setVertexFunction(packedVertexFn);
+  pDesc->setFragmentFunction(voxelFragFn);
+  p_voxel_rps_ = p_device_->newRenderPipelineState(pDesc, &pErr);
+  if(!p_voxel_rps_) {
+    printf("%s", pErr->localizedDescription()->utf8String());
+    abort();
+  }
+  voxel_rps_id_ = draw_backend_.addPipeline(p_voxel_rps_);
 
-  for(auto it : (Object*[]){vertexFn, fragFn, pDesc})
+  for(auto it : (Object*[]){vertexFn, fragFn, packedVertexFn, voxelFragFn, pDesc})
     it->release();
   p_shader_lib_ = pLib;
 }
@@ -188,6 +304,7 @@ HaruhiRenderer::buildDepthStencilStates() {
   pDSdesc->setDepthWriteEnabled(true);
 
   p_dss_ = p_device_->newDepthStencilState(pDSdesc);
+  dss_id_ = draw_backend_.addDepthState(p_dss_);
 
   pDSdesc->release();
 }
@@ -198,7 +315,10 @@ HaruhiRenderer::buildTextures() {
   Error* pErr = nullptr;
 
   // 22, 8 9 10
-  p_texture_ = p_haruhi_->accessResourcePool()->getTexture("blocks");
+  HaruhiResourcePool* pool = p_haruhi_->accessResourcePool();
+  texture_handle_ = pool->table().acquire(resource::CATEGORY_TEXTURE, resource::Name("blocks"));
+  p_texture_ = pool->texture(texture_handle_);
+  texture_id_ = draw_backend_.addTexture(p_texture_);
 
   // MTL::TextureDescriptor::textureBufferDescriptor texDesc(
   //   MTL::PixelFormatA8Unorm, 16,
@@ -220,89 +340,14 @@ HaruhiRenderer::buildTextures() {
   // pTextureDesc->release();
 }
 
-#include <simd/simd.h>
-
-namespace shader_t {
-
-struct VertexData {
-  simd::float3 pos;
-  simd::float3 norm;
-  simd::float2 texcoord;
-};
-
-struct InstanceData {
-  simd::float4x4 instanceTransform;
-  simd::float3x3 instanceNormalTransform;
-  simd::float4 instanceColor;
-};
-
-struct CameraData {
-  simd::float4x4 perspTransform;
-  simd::float4x4 worldTransform;
-  simd::float3x3 worldNormalTransform;
-};
-
-} // ns shader_t
+#include "Primitives.hxx"
+#include "ShaderTypes.hxx"
 
 void
 HaruhiRenderer::buildBufs() {
-  using simd::float2;
-  using simd::float3;
-
-  constexpr float s = .5f;
-
-  shader_t::VertexData verts[] = {
-    { { -s, -s, +s }, {  0.f,  0.f,  1.f }, { 0.f, 1.f } },
-    { { +s, -s, +s }, {  0.f,  0.f,  1.f }, { 1.f, 1.f } },
-    { { +s, +s, +s }, {  0.f,  0.f,  1.f }, { 1.f, 0.f } },
-    { { -s, +s, +s }, {  0.f,  0.f,  1.f }, { 0.f, 0.f } },
-
-    { { +s, -s, +s }, {  1.f,  0.f,  0.f }, { 0.f, 1.f } },
-    { { +s, -s, -s }, {  1.f,  0.f,  0.f }, { 1.f, 1.f } },
-    { { +s, +s, -s }, {  1.f,  0.f,  0.f }, { 1.f, 0.f } },
-    { { +s, +s, +s }, {  1.f,  0.f,  0.f }, { 0.f, 0.f } },
-
-    { { +s, -s, -s }, {  0.f,  0.f, -1.f }, { 0.f, 1.f } },
-    { { -s, -s, -s }, {  0.f,  0.f, -1.f }, { 1.f, 1.f } },
-    { { -s, +s, -s }, {  0.f,  0.f, -1.f }, { 1.f, 0.f } },
-    { { +s, +s, -s }, {  0.f,  0.f, -1.f }, { 0.f, 0.f } },
-
-    { { -s, -s, -s }, { -1.f,  0.f,  0.f }, { 0.f, 1.f } },
-    { { -s, -s, +s }, { -1.f,  0.f,  0.f }, { 1.f, 1.f } },
-    { { -s, +s, +s }, { -1.f,  0.f,  0.f }, { 1.f, 0.f } },
-    { { -s, +s, -s }, { -1.f,  0.f,  0.f }, { 0.f, 0.f } },
-
-    { { -s, +s, +s }, {  0.f,  1.f,  0.f }, { 0.f, 1.f } },
-    { { +s, +s, +s }, {  0.f,  1.f,  0.f }, { 1.f, 1.f } },
-    { { +s, +s, -s }, {  0.f,  1.f,  0.f }, { 1.f, 0.f } },
-    { { -s, +s, -s }, {  0.f,  1.f,  0.f }, { 0.f, 0.f } },
-
-    { { -s, -s, -s }, {  0.f, -1.f,  0.f }, { 0.f, 1.f } },
-    { { +s, -s, -s }, {  0.f, -1.f,  0.f }, { 1.f, 1.f } },
-    { { +s, -s, +s }, {  0.f, -1.f,  0.f }, { 1.f, 0.f } },
-    { { -s, -s, +s }, {  0.f, -1.f,  0.f }, { 0.f, 0.f } }
-  };
-  
-  uint16_t indices[] = {
-    // front
-    0,  1,  2, // ㄱ
-    2,  3,  0, // ㄴ
-    // right
-    4,  5,  6,
-    6,  7,  4,
-    // back
-    8,  9, 10,
-    10, 11, 8,
-    // left
-    12, 13, 14,
-    14, 15, 12,
-    //top
-    16, 17, 18,
-    18, 19, 16,
-    //bot
-    20, 21, 22,
-    22, 23, 20,
-  };
+  shader_t::VertexData verts[primitives::CUBE_VERTEX_COUNT];
+  uint16_t indices[primitives::CUBE_INDEX_COUNT];
+  primitives::makeCube(.5f, verts, indices);
 
   constexpr size_t vertexData_sz = sizeof(verts);
   constexpr size_t indexData_sz = sizeof(indices);
@@ -321,14 +366,14 @@ HaruhiRenderer::buildBufs() {
 
   pVertexBuf->didModifyRange(Range::Make(0, pVertexBuf->length()));
   pIndexBuf->didModifyRange(Range::Make(0, pIndexBuf->length()));
+  vertex_buf_id_ = draw_backend_.addBuffer(pVertexBuf);
+  index_buf_id_ = draw_backend_.addBuffer(pIndexBuf);
 
-  const size_t instanceData_sz = MAX_FRAMES_IN_FLIGHT*1*sizeof(shader_t::InstanceData);
-  for(size_t i = 0; i< MAX_FRAMES_IN_FLIGHT; ++i)
+  const size_t instanceData_sz = MAX_INSTANCES*sizeof(shader_t::CompactInstanceData);
+  for(size_t i = 0; i< MAX_FRAMES_IN_FLIGHT; ++i) {
     pInstanceBuf[i] = p_device_->newBuffer(instanceData_sz, MTL::ResourceStorageModeManaged);
-
-  const size_t cameraData_sz = MAX_FRAMES_IN_FLIGHT*sizeof(shader_t::CameraData);
-  for(size_t i = 0; i< MAX_FRAMES_IN_FLIGHT; ++i)
-    pCameraBuf[i] = p_device_->newBuffer(cameraData_sz, MTL::ResourceStorageModeManaged);
+    instance_buf_ids_[i] = draw_backend_.addBuffer(pInstanceBuf[i]);
+  }
 
   pTextureAnimationBuf = p_device_->newBuffer(sizeof(unsigned), MTL::ResourceStorageModeManaged);
 }
@@ -362,49 +407,219 @@ HaruhiRenderer::computeTexture(MTL::CommandBuffer* pCmdBuf) {
 }
 
 #include "MathUtil.hxx"
+#include "Terrain.hxx"
+
+void
+HaruhiRenderer::buildScene() {
+  using scene::Transform;
+  using scene::Mesh;
+  using scene::Spin;
+
+  // same pose the old translate * rotX * rotY chain produced
+  world_.create(
+    Transform{ { 0., 0., -3. }, { 0., 0., 0., 1. }, { 1., 1., 1. } },
+    Mesh{ { .5, .5, .5, 1. }, 0 },
+    scene::Bounds{ { .5, .5, .5 }, cull::NULL_PROXY },
+    Spin{ math::makeQuat({ 1., 0., 0. }, -0.2), { 0., 1., 0. }, 0., .002*3.14 });
+
+  // a patch of hills under the cube, sixteen chunks in front of the camera
+  std::vector<voxel::ChunkCoord> patch;
+  for(int cz = -4; cz < 0; ++cz)
+    for(int cx = -2; cx < 2; ++cx) patch.push_back({ cx, -1, cz });
+  terrain::Settings settings;
+  // surfaces between 12 and 2 blocks below the camera
+  settings.base = -7.f;
+  settings.amplitude = 5.f;
+  settings.ground.frequency = 1.f / 64.f;
+  settings.ground.warp = 8.f;
+  terrain::generate(settings, voxels_, patch.data(), patch.size(), p_haruhi_->accessWorkerPool());
+  light_.relight(patch.data(), patch.size(), p_haruhi_->accessWorkerPool());
+
+  systems_.add("spin", ecs::maskOf<Spin>(), ecs::maskOf<Transform>(),
+    [this](HaruhiEntityWorld& world, HaruhiEntityCommands&) {
+      scene::spin(world, p_haruhi_->accessWorkerPool());
+    });
+
+  systems_.add("bounds", ecs::maskOf<Transform>(), ecs::maskOf<scene::Bounds>(),
+    [this](HaruhiEntityWorld& world, HaruhiEntityCommands&) {
+      visibility_.update(world, p_haruhi_->accessWorkerPool());
+    });
+
+  // waits for everything writing Transform, Mesh or Bounds, and the camera
+  const auto instances = systems_.add("instances", ecs::maskOf<Transform, Mesh, scene::Bounds>(), 0,
+    [this](HaruhiEntityWorld& world, HaruhiEntityCommands&) {
+      const auto* p_cameraData = static_cast<const shader_t::CameraData*>(frame_camera_.cpu);
+      const math::float4x4 viewProj = p_cameraData->perspTransform * p_cameraData->worldTransform;
+
+      // the terrain hides instances and other chunks, chunks out of view
+      // can't hide anything
+      const cull::Frustum frustum = cull::makeFrustum(viewProj);
+      occlusion_.begin(viewProj);
+      voxels_.forEachChunk([&](const voxel::ChunkCoord& c, const voxel::ChunkMesh& mesh) {
+        if(cull::classify(frustum, chunkBounds(c)) == cull::RESULT_OUTSIDE) return;
+        for(uint32_t v : mesh.occluders)
+          occlusion_.addQuad(mesh.vertices[v].pos, mesh.vertices[v + 1].pos,
+                             mesh.vertices[v + 2].pos, mesh.vertices[v + 3].pos);
+      });
+      occlusion_.render();
+
+      const auto& visible = visibility_.cull(viewProj, p_haruhi_->accessWorkerPool(), &occlusion_);
+      frame_written_ = gather_.writeVisible(world, visible.data(), visible.size(),
+                                            p_frame_instances_, MAX_INSTANCES,
+                                            p_haruhi_->accessWorkerPool());
+
+      // one instanced draw of every visible cube, everything culled draws nothing
+      if(frame_written_.composed) {
+        const cmd::Packet cubes = {
+          rps_id_, dss_id_, texture_id_, vertex_buf_id_, index_buf_id_, instance_buf_ids_[frame_], 0,
+          0, primitives::CUBE_INDEX_COUNT, uint32_t(frame_written_.composed), 0
+        };
+        draw_queue_.list(0).add(cmd::makeKey(cmd::PASS_OPAQUE, rps_id_, texture_id_, 0.f), cubes);
+      }
+    });
+
+  // chunks in view and not hidden by the terrain in front of them, front
+  // to back. lists past the first get a grain of chunks each
+  const auto chunks = systems_.add("chunks", 0, 0, [this](HaruhiEntityWorld&, HaruhiEntityCommands&) {
+    const auto* p_cameraData = static_cast<const shader_t::CameraData*>(frame_camera_.cpu);
+    const math::float4x4 viewProj = p_cameraData->perspTransform * p_cameraData->worldTransform;
+    const cull::Frustum frustum = cull::makeFrustum(viewProj);
+
+    frame_chunks_.clear();
+    for(const auto& it : chunk_bufs_)
+      frame_chunks_.push_back(&it.second);
+    auto record = [&](size_t b, size_t e) {
+      for(size_t i = b; i < e; ++i) {
+        const ChunkBuffers& bufs = *frame_chunks_[i];
+        if(cull::classify(frustum, bufs.bounds) == cull::RESULT_OUTSIDE) continue;
+        if(!occlusion_.visible(bufs.bounds)) continue;
+        // clip w is the view depth
+        const math::float3 c = (bufs.bounds.min + bufs.bounds.max) * .5f;
+        const float depth = (viewProj * math::float4(c, 1.)).w;
+        const uint64_t key = cmd::makeKey(cmd::PASS_OPAQUE, voxel_rps_id_, texture_id_, depth);
+        cmd::DrawList& list = draw_queue_.list(1 + i / CHUNK_RECORD_GRAIN);
+        for(const voxel::MeshSection& section : bufs.sections)
+          list.add(key, {
+            voxel_rps_id_, dss_id_, texture_id_, bufs.vertexId, bufs.indexId, bufs.vertexId, 0,
+            section.firstIndex, section.indexCount, 1, int32_t(CHUNK_HEADER_VERTICES + section.baseVertex)
+          });
+      }
+    };
+    HaruhiWorkerPool* pPool = p_haruhi_->accessWorkerPool();
+    if(pPool) pPool->parallelFor(frame_chunks_.size(), CHUNK_RECORD_GRAIN, record);
+    else record(0, frame_chunks_.size());
+  });
+
+  const auto camera = systems_.add("camera", 0, 0, [this](HaruhiEntityWorld&, HaruhiEntityCommands&) {
+    // constant buffer offsets want 256 byte alignment
+    frame_camera_ = uploads_->allocate(sizeof(shader_t::CameraData), 256);
+    shader_t::CameraData* p_cameraData = static_cast<shader_t::CameraData*>(frame_camera_.cpu);
+    constexpr float FOV = 90.;
+    p_cameraData->perspTransform =
+      math::makePerspective(FOV * 3.141592 / 180., 1., .03, 500.);
+    // const auto delta = animation_ind_/10.;  // printf("%d\n", animation_ind_);
+    p_cameraData->worldTransform = math::makeIdentity();
+      // // * math::makeTranslate({cosf(3.14*frame_*.02), sinf(3.14*frame_*.02), 1.});
+    p_cameraData->worldNormalTransform = math::discardTranslation(p_cameraData->worldTransform);
+  });
+  systems_.after(camera, instances);
+  systems_.after(instances, chunks);
+}
+
+void
+HaruhiRenderer::uploadChunks() {
+  HARUHI_PROFILE_SCOPE("uploadChunks");
+  // a few ms of meshing per frame, the rest waits for the next one
+  voxels_.remesh(p_haruhi_->accessWorkerPool(), 2.);
+
+  for(const voxel::ChunkCoord& c : voxels_.remeshed()) {
+    const uint64_t key = HaruhiVoxelWorld::key(c);
+    auto it = chunk_bufs_.find(key);
+    if(it != chunk_bufs_.end()) {
+      draw_backend_.removeBuffer(it->second.vertexId);
+      draw_backend_.removeBuffer(it->second.indexId);
+      it->second.pVertices->release();
+      it->second.pIndices->release();
+      chunk_bufs_.erase(it);
+    }
+
+    const voxel::ChunkMesh* mesh = voxels_.mesh(c);
+    if(!mesh || mesh->indices.empty()) continue;
+
+    const size_t vertexData_sz =
+      sizeof(shader_t::PackedMeshData) + mesh->vertices.size() * sizeof(shader_t::PackedVertexData);
+    const size_t indexData_sz = mesh->indices.size() * sizeof(uint16_t);
+    ChunkBuffers bufs;
+    bufs.bounds = chunkBounds(c);
+    bufs.pVertices = p_device_->newBuffer(vertexData_sz, MTL::ResourceStorageModeManaged);
+    bufs.pIndices = p_device_->newBuffer(indexData_sz, MTL::ResourceStorageModeManaged);
+    const vtx::Quantization q = chunkQuantization(c);
+    auto* p_meshData = static_cast<shader_t::PackedMeshData*>(bufs.pVertices->contents());
+    *p_meshData = vtx::meshData(q);
+    auto* p_packed = reinterpret_cast<shader_t::PackedVertexData*>(p_meshData + 1);
+    vtx::pack(mesh->vertices.data(), mesh->vertices.size(), q, p_packed);
+    // the chunk's light rides in the free position lane
+    for(size_t i = 0; i < mesh->light.size(); ++i) p_packed[i].pos[3] = mesh->light[i];
+    memcpy(bufs.pIndices->contents(), mesh->indices.data(), indexData_sz);
+    bufs.pVertices->didModifyRange(Range::Make(0, vertexData_sz));
+    bufs.pIndices->didModifyRange(Range::Make(0, indexData_sz));
+    bufs.sections = mesh->sections;
+    bufs.vertexId = draw_backend_.addBuffer(bufs.pVertices);
+    bufs.indexId = draw_backend_.addBuffer(bufs.pIndices);
+    chunk_bufs_.emplace(key, std::move(bufs));
+  }
+}
 
 void
 HaruhiRenderer::draw(MTK::View * pView) {
-  using simd::float3;
-  using simd::float4;
-  using simd::float4x4;
+  using math::float3;
+  using math::float4;
+  using math::float4x4;
 
+  HARUHI_PROFILE_FRAME();
+  HARUHI_PROFILE_SCOPE("draw");
   AutoreleasePool* pARPool = AutoreleasePool::alloc()->init();
 
-  frame_ = (frame_ + 1) % MAX_FRAMES_IN_FLIGHT;
+  // waits for the frame that last used this frame's ring and instance buffer
+  uint64_t frame;
+  {
+    HARUHI_PROFILE_SCOPE("wait for frame");
+    frame = uploads_->beginFrame();
+  }
+  frame_ = frame % MAX_FRAMES_IN_FLIGHT;
   MTL::Buffer* p_instanceData_buf = pInstanceBuf[frame_];
 
   MTL::CommandBuffer* p_cmd_buf = p_cmd_queue_->commandBuffer();
 
-  dispatch_semaphore_wait(sema_, DISPATCH_TIME_FOREVER);
-  p_cmd_buf->addCompletedHandler([this](MTL::CommandBuffer* p_cmd) {
-    dispatch_semaphore_signal(this->sema_);
+  p_cmd_buf->addCompletedHandler([this, frame](MTL::CommandBuffer* p_cmd) {
+    this->fence_.signal(frame);
   });
 
-  static uint __cnt = 0; ++__cnt;
-
-  shader_t::InstanceData* p_instanceData =
-    reinterpret_cast<shader_t::InstanceData*>(p_instanceData_buf->contents());
-  p_instanceData[0].instanceTransform =
-    math::makeTranslate({ 0., 0., -3. })
-    * math::makeXRotate(0.2)
-    * math::makeYRotate(__cnt*.002*3.14);
-  p_instanceData[0].instanceNormalTransform =
-    math::discardTranslation(p_instanceData[0].instanceTransform);
-  p_instanceData[0].instanceColor = {.5,.5,.5,1.};//{ 0., 5., 5., 1. };
-  p_instanceData_buf->didModifyRange(Range::Make(0, p_instanceData_buf->length()));
-
-  MTL::Buffer* p_cameraData_buf = pCameraBuf[frame_];
-  shader_t::CameraData* p_cameraData =
-    reinterpret_cast<shader_t::CameraData *>(p_cameraData_buf->contents());
-  constexpr float FOV = 90.;
-  p_cameraData->perspTransform =
-    math::makePerspective(FOV * 3.141592 / 180., 1., .03, 500.);
-  // const auto delta = animation_ind_/10.;  // printf("%d\n", animation_ind_);
-  p_cameraData->worldTransform = math::makeIdentity();
-    // // * math::makeTranslate({cosf(3.14*frame_*.02), sinf(3.14*frame_*.02), 1.});
-  p_cameraData->worldNormalTransform = math::discardTranslation(p_cameraData->worldTransform);
-  p_cameraData_buf->didModifyRange(Range::Make(0, 1*sizeof(shader_t::CameraData)));
+  // before the systems, occluders come from the meshes drawn this frame
+  uploadChunks();
+  draw_queue_.reset(1 + (chunk_bufs_.size() + CHUNK_RECORD_GRAIN - 1) / CHUNK_RECORD_GRAIN);
+
+  p_frame_instances_ =
+    reinterpret_cast<shader_t::CompactInstanceData*>(p_instanceData_buf->contents());
+  systems_.run(world_, *p_haruhi_->accessWorkerPool());
+
+  const auto& written = frame_written_;
+  if(written.composed)
+    p_instanceData_buf->didModifyRange(Range::Make(
+      written.first*sizeof(shader_t::CompactInstanceData),
+      (written.last - written.first)*sizeof(shader_t::CompactInstanceData)));
+  const auto& camera = frame_camera_;
+  {
+    const HaruhiFrameAllocator::Stats us = uploads_->stats();
+    HARUHI_PROFILE_COUNTER("instances", written.composed);
+    HARUHI_PROFILE_COUNTER("instance bytes", written.composed*sizeof(shader_t::CompactInstanceData));
+    HARUHI_PROFILE_COUNTER("bytes uploaded", us.ringBytes + us.overflowBytes);
+  }
+  uploads_->endFrame();
+  {
+    HARUHI_PROFILE_SCOPE("sort draws");
+    draw_queue_.sort();
+  }
 
   // WARNING: Maybe you should restart your computer
   // computeTexture(p_cmd_buf);
@@ -415,6 +630,7 @@ HaruhiRenderer::draw(MTK::View * pView) {
   p_sd->setNormalizedCoordinates(true);
   p_sd->setMagFilter(MTL::SamplerMinMagFilterNearest);
   p_sd->setMinFilter(MTL::SamplerMinMagFilterNearest);
+  p_sd->setMipFilter(MTL::SamplerMipFilterNearest);
   p_sd->setSAddressMode(MTL::SamplerAddressModeRepeat);
   p_sd->setTAddressMode(MTL::SamplerAddressModeRepeat);
   auto p_ss = p_device_->newSamplerState(p_sd);
@@ -426,34 +642,36 @@ HaruhiRenderer::draw(MTK::View * pView) {
 
   MTL::RenderCommandEncoder* p_rce = p_cmd_buf->renderCommandEncoder(p_rpd);
 
-  p_rce->setRenderPipelineState(p_rps_);
-  p_rce->setDepthStencilState(p_dss_);
-
-  p_rce->setVertexBuffer(pVertexBuf, 0, 0);
-  p_rce->setVertexBuffer(p_instanceData_buf, 0, 1);
-  p_rce->setVertexBuffer(p_cameraData_buf, 0, 2);
-
-  p_rce->setFragmentTexture(p_texture_, 0);
+  // the same for every packet
+  p_rce->setVertexBuffer(static_cast<MTL::Buffer*>(camera.buffer), camera.offset, 2);
   p_rce->setFragmentSamplerState(p_ss, 0);
-
   p_rce->setCullMode(MTL::CullModeBack);
   p_rce->setFrontFacingWinding(MTL::WindingCounterClockwise);
 
-  p_rce->drawIndexedPrimitives(
-    MTL::PrimitiveTypeTriangle,
-    6*6,
-    MTL::IndexType::IndexTypeUInt16,
-    pIndexBuf,
-    0,
-    1/*instance cnt*/);
-  ;
+  {
+    HARUHI_PROFILE_SCOPE("submit draws");
+    draw_backend_.begin(p_rce);
+    const cmd::SubmitStats ss = draw_queue_.submit(draw_backend_);
+    HARUHI_PROFILE_COUNTER("draws", ss.draws);
+    HARUHI_PROFILE_COUNTER("pipeline changes", ss.pipelines);
+  }
 
   p_rce->endEncoding();
   p_cmd_buf->presentDrawable(pView->currentDrawable());
+#ifdef HARUHI_PROFILE
+  gpu_timer_.track("frame", p_cmd_buf);
+#endif
   p_cmd_buf->commit();
 
   p_sd->release();
   p_ss->release();
 
+#ifdef HARUHI_PROFILE
+  if(print_summary_ && frame % SUMMARY_FRAMES == SUMMARY_FRAMES - 1) {
+    printf("last %zu frames:\n", SUMMARY_FRAMES);
+    prof::printSummary(stdout, prof::summarize(prof::collect(), SUMMARY_FRAMES));
+  }
+#endif
+
   pARPool->release();
 }
\ No newline at end of file
@@ -3,6 +3,21 @@
 
 #include <mtl.hpp>
 
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "DrawQueue.hxx"
+#include "FrameAllocator.hxx"
+#include "MetalDraw.hxx"
+#include "MetalProfiler.hxx"
+#include "MetalUpload.hxx"
+#include "OcclusionBuffer.hxx"
+#include "ResourceTable.hxx"
+#include "SceneSystems.hxx"
+#include "VoxelLight.hxx"
+#include "VoxelWorld.hxx"
+
 constexpr auto MAX_FRAMES_IN_FLIGHT =
 #ifndef HARUHI_FRAMES_IN_FLIGHT
 3;
@@ -10,6 +25,36 @@ constexpr auto MAX_FRAMES_IN_FLIGHT =
 HARUHI_MAX_FRAMES_IN_FLIGHT;
 #endif
 
+constexpr size_t MAX_INSTANCES =
+#ifndef HARUHI_MAX_INSTANCES
+1 << 17;
+#else
+HARUHI_MAX_INSTANCES;
+#endif
+
+// cpu occlusion buffer, rounded up to whole tiles
+constexpr uint32_t OCCLUSION_WIDTH =
+#ifndef HARUHI_OCCLUSION_WIDTH
+256;
+#else
+HARUHI_OCCLUSION_WIDTH;
+#endif
+
+constexpr uint32_t OCCLUSION_HEIGHT =
+#ifndef HARUHI_OCCLUSION_HEIGHT
+256;
+#else
+HARUHI_OCCLUSION_HEIGHT;
+#endif
+
+// per frame in flight, spills into overflow pages past it
+constexpr size_t UPLOAD_RING_SIZE =
+#ifndef HARUHI_UPLOAD_RING_SIZE
+4 << 20;
+#else
+HARUHI_UPLOAD_RING_SIZE;
+#endif
+
 class Haruhi;
 
 class HaruhiRenderer {
@@ -19,20 +64,71 @@ class HaruhiRenderer {
   MTL::CommandQueue* p_cmd_queue_;
   MTL::Library* p_shader_lib_;
   MTL::RenderPipelineState* p_rps_;
+  // same vertex stage, fragment decodes the voxel tile texcoords
+  MTL::RenderPipelineState* p_voxel_rps_;
   MTL::ComputePipelineState* p_cps_;
   MTL::DepthStencilState* p_dss_;
 
+  // referenced in the resource pool while the renderer lives
+  resource::Handle texture_handle_;
   MTL::Texture* p_texture_;
   MTL::Buffer
     * pVertexBuf,
     * pInstanceBuf[MAX_FRAMES_IN_FLIGHT],
-    * pCameraBuf[MAX_FRAMES_IN_FLIGHT],
     * pIndexBuf, * pTextureAnimationBuf;
   ;
 
-  float angle_;
+  // the systems record draw packets into the queue, draw sorts and
+  // replays them. ids are the backend's names for the objects above
+  HaruhiMetalDrawBackend draw_backend_;
+  HaruhiDrawQueue draw_queue_;
+  uint16_t rps_id_, voxel_rps_id_, dss_id_, texture_id_;
+  uint16_t vertex_buf_id_, index_buf_id_, instance_buf_ids_[MAX_FRAMES_IN_FLIGHT];
+
+  // pInstanceBuf gets the visible instances packed each frame, the
+  // gather targets stay for drawing everything unculled
+  HaruhiEntityWorld world_;
+  HaruhiInstanceGather gather_;
+  HaruhiVisibility visibility_;
+  // the opaque chunk faces in view, rendered by the instances system
+  // and read by the chunk draws
+  HaruhiOcclusionBuffer occlusion_;
+
+  // gpu copies of the chunk meshes, packed, keyed by HaruhiVoxelWorld::key.
+  // replaced buffers are released right away, command buffers still
+  // holding them retain them
+  struct ChunkBuffers {
+    // world space box of the chunk, for culling
+    cull::Aabb bounds;
+    MTL::Buffer* pVertices;
+    MTL::Buffer* pIndices;
+    uint16_t vertexId, indexId;
+    std::vector<voxel::MeshSection> sections;
+  };
+  HaruhiVoxelWorld voxels_;
+  HaruhiVoxelLight light_;
+  std::unordered_map<uint64_t, ChunkBuffers> chunk_bufs_;
+  std::vector<const ChunkBuffers*> frame_chunks_;
+
+  // everything else rewritten each frame comes from the upload rings,
+  // the fence is signaled by command buffer completion
+  HaruhiMetalUploadBackend upload_backend_;
+  HaruhiFrameFence fence_;
+  std::unique_ptr<HaruhiFrameAllocator> uploads_;
+
+  // HARUHI_TRACE names a chrome trace written on destruction,
+  // HARUHI_PROFILE_SUMMARY prints the frame summary every so often
+  HaruhiMetalGpuTimer gpu_timer_;
+  const char* trace_path_;
+  bool print_summary_;
+
+  // cpu side of a frame, run on the worker pool before encoding. the
+  // systems talk to draw through the frame_* members
+  HaruhiSystemSchedule systems_;
+  shader_t::CompactInstanceData* p_frame_instances_;
+  scene::InstanceRange frame_written_;
+  HaruhiFrameAllocator::Allocation frame_camera_;
   unsigned frame_;
-  dispatch_semaphore_t sema_;
   unsigned animation_ind_;
 
 public:
@@ -45,6 +141,8 @@ public:
   void buildDepthStencilStates();
   void buildTextures();
   void buildBufs();
+  void buildScene();
+  void uploadChunks();
   void computeTexture(MTL::CommandBuffer*);
   void draw(MTK::View*);
 };
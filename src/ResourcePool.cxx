@@ -1,25 +1,64 @@
 #include "ResourcePool.hxx"
 
+#include <cassert>
+
 #include <Metal/Metal.hpp>
 
-HaruhiResourcePool::HaruhiResourcePool() {
-  texture_pool_ = {};
+#include "AssetArchive.hxx"
+
+namespace {
+
+void
+releaseObject(resource::Category, void* pObject, void*) {
+  static_cast<NS::Object*>(pObject)->release();
 }
 
-HaruhiResourcePool::~HaruhiResourcePool() {
-  for(auto& it : texture_pool_) {
-    // free(it.second->buffer());
-    it.second->release();
-  }
+resource::Handle
+adopt(HaruhiResourceTable& table, resource::Category cat, resource::Name name,
+      NS::Object* pObject, size_t size) {
+  const resource::Handle h = table.add(cat, name, pObject, size);
+  if(!h) pObject->release();
+  return h;
+}
+
+} // ns
+
+HaruhiResourcePool::HaruhiResourcePool()
+  : table_(releaseObject) {}
+
+// the table goes first, textures release before the archives they alias unmap
+HaruhiResourcePool::~HaruhiResourcePool() = default;
+
+resource::Handle
+HaruhiResourcePool::addTexture(resource::Name name, MTL::Texture* tex) {
+  assert(tex);
+  return adopt(table_, resource::CATEGORY_TEXTURE, name, tex, tex->allocatedSize());
+}
+
+resource::Handle
+HaruhiResourcePool::addBuffer(resource::Name name, MTL::Buffer* buf) {
+  assert(buf);
+  return adopt(table_, resource::CATEGORY_BUFFER, name, buf, buf->allocatedSize());
+}
+
+resource::Handle
+HaruhiResourcePool::addMesh(resource::Name name, MTL::Buffer* buf) {
+  assert(buf);
+  return adopt(table_, resource::CATEGORY_MESH, name, buf, buf->allocatedSize());
 }
 
 MTL::Texture*
-HaruhiResourcePool::getTexture(std::string name) noexcept {
-  return texture_pool_[name];
+HaruhiResourcePool::texture(resource::Handle h) const noexcept {
+  return static_cast<MTL::Texture*>(table_.get(h));
+}
+
+MTL::Buffer*
+HaruhiResourcePool::buffer(resource::Handle h) const noexcept {
+  return static_cast<MTL::Buffer*>(table_.get(h));
 }
 
 void
-HaruhiResourcePool::setTexture(std::string name, MTL::Texture * tex) noexcept {
-  assert(tex);
-  texture_pool_[name] = tex;
+HaruhiResourcePool::adoptArchive(std::unique_ptr<HaruhiAssetArchive> archive) noexcept {
+  assert(archive);
+  archives_.push_back(std::move(archive));
 }
\ No newline at end of file
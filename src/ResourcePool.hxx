@@ -1,21 +1,42 @@
 #ifndef HARUHI_RESOURCEPOOL_HXX
 #define HARUHI_RESOURCEPOOL_HXX
 
-#include <string>
-#include <map>
+#include <memory>
+#include <vector>
+
+#include "ResourceTable.hxx"
 
 namespace MTL {
+class Buffer;
 class Texture;
 } // ns MTL
+class HaruhiAssetArchive;
 
+// metal objects in a resource table, the table owns one retain of each.
+// a mesh is the buffer holding its vertices and indices
 class HaruhiResourcePool {
-  std::map<std::string, MTL::Texture*> texture_pool_;
+  // mapped archives backing no-copy textures, outlive the table
+  std::vector<std::unique_ptr<HaruhiAssetArchive>> archives_;
+  HaruhiResourceTable table_;
 public:
   HaruhiResourcePool();
   ~HaruhiResourcePool();
 
-  MTL::Texture* getTexture(std::string) noexcept;
-  void setTexture(std::string, MTL::Texture*) noexcept;
+  HaruhiResourceTable& table() noexcept { return table_; }
+  const HaruhiResourceTable& table() const noexcept { return table_; }
+
+  // takes the caller's retain, budgets count allocatedSize. null handle
+  // when the name is taken, the object is released then
+  resource::Handle addTexture(resource::Name, MTL::Texture*);
+  resource::Handle addBuffer(resource::Name, MTL::Buffer*);
+  resource::Handle addMesh(resource::Name, MTL::Buffer*);
+
+  // nullptr for stale handles
+  MTL::Texture* texture(resource::Handle) const noexcept;
+  MTL::Buffer* buffer(resource::Handle) const noexcept;
+
+  // keeps the archive mapped until every texture is released
+  void adoptArchive(std::unique_ptr<HaruhiAssetArchive>) noexcept;
 };
 
 #endif
\ No newline at end of file
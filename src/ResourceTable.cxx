@@ -0,0 +1,250 @@
+#include "ResourceTable.hxx"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace resource;
+
+HaruhiResourceTable::HaruhiResourceTable(ReleaseFn fn, void* pUser)
+  : free_(NIL), release_fn_(fn), p_user_(pUser) {
+  for(auto& c : categories_) {
+    c.budget = c.resident = 0;
+    c.lru_head = c.lru_tail = NIL;
+  }
+}
+
+HaruhiResourceTable::~HaruhiResourceTable() {
+  if(!release_fn_) return;
+  for(auto& s : slots_)
+    if(s.object) release_fn_(s.category, s.object, p_user_);
+}
+
+HaruhiResourceTable::Slot*
+HaruhiResourceTable::lookup(Handle h) noexcept {
+  if(h.index >= slots_.size()) return nullptr;
+  Slot& s = slots_[h.index];
+  return s.generation == h.generation && s.object ? &s : nullptr;
+}
+
+const HaruhiResourceTable::Slot*
+HaruhiResourceTable::lookup(Handle h) const noexcept {
+  return const_cast<HaruhiResourceTable*>(this)->lookup(h);
+}
+
+void
+HaruhiResourceTable::unlink(uint32_t i) noexcept {
+  Slot& s = slots_[i];
+  CategoryState& c = categories_[s.category];
+  (s.prev == NIL ? c.lru_head : slots_[s.prev].next) = s.next;
+  (s.next == NIL ? c.lru_tail : slots_[s.next].prev) = s.prev;
+  s.prev = s.next = NIL;
+}
+
+void
+HaruhiResourceTable::linkTail(uint32_t i) noexcept {
+  Slot& s = slots_[i];
+  CategoryState& c = categories_[s.category];
+  s.prev = c.lru_tail;
+  s.next = NIL;
+  (c.lru_tail == NIL ? c.lru_head : slots_[c.lru_tail].next) = i;
+  c.lru_tail = i;
+}
+
+void
+HaruhiResourceTable::evictSlot(uint32_t i, std::vector<Evicted>& out) noexcept {
+  Slot& s = slots_[i];
+  assert(s.refs == 0);
+  CategoryState& c = categories_[s.category];
+  unlink(i);
+  c.names.erase(s.name);
+  c.resident -= s.bytes;
+  out.push_back({ s.category, s.object });
+
+  s.object = nullptr;
+  if(++s.generation == 0) s.generation = 1;
+  s.next = free_;
+  free_ = i;
+}
+
+void
+HaruhiResourceTable::evictOver(Category cat, size_t limit, std::vector<Evicted>& out) noexcept {
+  CategoryState& c = categories_[cat];
+  while(c.resident > limit && c.lru_head != NIL)
+    evictSlot(c.lru_head, out);
+}
+
+void
+HaruhiResourceTable::releaseEvicted(const std::vector<Evicted>& evicted) const noexcept {
+  if(release_fn_)
+    for(auto& e : evicted)
+      release_fn_(e.category, e.object, p_user_);
+}
+
+Name
+HaruhiResourceTable::intern(std::string_view s) {
+  const Name n(s);
+  std::unique_lock lock(mtx_);
+  auto [it, inserted] = interned_.try_emplace(n.hash, s);
+  if(!inserted && it->second != s) {
+    printf("resource names %s and %.*s collide\n", it->second.c_str(), (int)s.size(), s.data());
+    abort();
+  }
+  return n;
+}
+
+const char*
+HaruhiResourceTable::nameOf(Name n) const noexcept {
+  std::shared_lock lock(mtx_);
+  auto it = interned_.find(n.hash);
+  return it == interned_.end() ? nullptr : it->second.c_str();
+}
+
+void
+HaruhiResourceTable::setBudget(Category cat, size_t bytes) {
+  std::vector<Evicted> evicted;
+  {
+    std::unique_lock lock(mtx_);
+    categories_[cat].budget = bytes;
+    if(bytes) evictOver(cat, bytes, evicted);
+  }
+  releaseEvicted(evicted);
+}
+
+size_t
+HaruhiResourceTable::budget(Category cat) const noexcept {
+  std::shared_lock lock(mtx_);
+  return categories_[cat].budget;
+}
+
+size_t
+HaruhiResourceTable::residentBytes(Category cat) const noexcept {
+  std::shared_lock lock(mtx_);
+  return categories_[cat].resident;
+}
+
+Handle
+HaruhiResourceTable::add(Category cat, Name name, void* pObject, size_t bytes) {
+  assert(pObject && cat < CATEGORY_COUNT);
+  std::vector<Evicted> evicted;
+  Handle h;
+  {
+    std::unique_lock lock(mtx_);
+    CategoryState& c = categories_[cat];
+    if(c.names.count(name.hash)) return NULL_HANDLE;
+    if(c.budget)
+      evictOver(cat, c.budget > bytes ? c.budget - bytes : 0, evicted);
+
+    uint32_t i = free_;
+    if(i != NIL) {
+      free_ = slots_[i].next;
+    } else {
+      i = (uint32_t)slots_.size();
+      slots_.push_back({});
+      slots_[i].generation = 1;
+    }
+    Slot& s = slots_[i];
+    s.object = pObject;
+    s.bytes = bytes;
+    s.name = name.hash;
+    s.refs = 0;
+    s.category = cat;
+    linkTail(i);
+
+    c.names.emplace(name.hash, i);
+    c.resident += bytes;
+    h = { i, s.generation };
+  }
+  releaseEvicted(evicted);
+  return h;
+}
+
+Handle
+HaruhiResourceTable::find(Category cat, Name name) const noexcept {
+  std::shared_lock lock(mtx_);
+  const auto& names = categories_[cat].names;
+  auto it = names.find(name.hash);
+  return it == names.end() ? NULL_HANDLE : Handle{ it->second, slots_[it->second].generation };
+}
+
+void*
+HaruhiResourceTable::get(Handle h) const noexcept {
+  std::shared_lock lock(mtx_);
+  const Slot* s = lookup(h);
+  return s ? s->object : nullptr;
+}
+
+bool
+HaruhiResourceTable::acquire(Handle h) noexcept {
+  std::unique_lock lock(mtx_);
+  Slot* s = lookup(h);
+  if(!s) return false;
+  if(s->refs++ == 0) unlink(h.index);
+  return true;
+}
+
+Handle
+HaruhiResourceTable::acquire(Category cat, Name name) noexcept {
+  std::unique_lock lock(mtx_);
+  auto& names = categories_[cat].names;
+  auto it = names.find(name.hash);
+  if(it == names.end()) return NULL_HANDLE;
+  Slot& s = slots_[it->second];
+  if(s.refs++ == 0) unlink(it->second);
+  return { it->second, s.generation };
+}
+
+void
+HaruhiResourceTable::release(Handle h) {
+  std::vector<Evicted> evicted;
+  {
+    std::unique_lock lock(mtx_);
+    Slot* s = lookup(h);
+    assert(s && s->refs);
+    if(!s || !s->refs || --s->refs) return;
+    linkTail(h.index);
+    const CategoryState& c = categories_[s->category];
+    if(c.budget) evictOver(s->category, c.budget, evicted);
+  }
+  releaseEvicted(evicted);
+}
+
+uint32_t
+HaruhiResourceTable::refCount(Handle h) const noexcept {
+  std::shared_lock lock(mtx_);
+  const Slot* s = lookup(h);
+  return s ? s->refs : 0;
+}
+
+bool
+HaruhiResourceTable::remove(Handle h) {
+  std::vector<Evicted> evicted;
+  {
+    std::unique_lock lock(mtx_);
+    Slot* s = lookup(h);
+    if(!s || s->refs) return false;
+    evictSlot(h.index, evicted);
+  }
+  releaseEvicted(evicted);
+  return true;
+}
+
+size_t
+HaruhiResourceTable::trim(Category cat, size_t bytes) {
+  std::vector<Evicted> evicted;
+  size_t freed;
+  {
+    std::unique_lock lock(mtx_);
+    const size_t before = categories_[cat].resident;
+    evictOver(cat, bytes, evicted);
+    freed = before - categories_[cat].resident;
+  }
+  releaseEvicted(evicted);
+  return freed;
+}
+
+size_t
+HaruhiResourceTable::size(Category cat) const noexcept {
+  std::shared_lock lock(mtx_);
+  return categories_[cat].names.size();
+}
\ No newline at end of file
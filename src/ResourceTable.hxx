@@ -0,0 +1,141 @@
+#ifndef HARUHI_RESOURCETABLE_HXX
+#define HARUHI_RESOURCETABLE_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace resource {
+
+enum Category : uint32_t {
+  CATEGORY_TEXTURE,
+  CATEGORY_BUFFER,
+  CATEGORY_MESH,
+  CATEGORY_COUNT
+};
+
+// 64 bit FNV-1a of the name, usable in constant expressions
+struct Name {
+  uint64_t hash;
+
+  constexpr explicit Name(std::string_view s) noexcept : hash(14695981039346656037ull) {
+    for(char c : s)
+      hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+  }
+  constexpr bool operator==(const Name& o) const noexcept { return hash == o.hash; }
+};
+
+// slot index and its generation, stale once the slot is reused. zero is
+// never a live generation
+struct Handle {
+  uint32_t index;
+  uint32_t generation;
+
+  constexpr explicit operator bool() const noexcept { return generation != 0; }
+  constexpr bool operator==(const Handle& o) const noexcept {
+    return index == o.index && generation == o.generation;
+  }
+};
+
+constexpr Handle NULL_HANDLE = { 0, 0 };
+
+// frees a backend object once it leaves the table
+using ReleaseFn = void (*)(Category, void*, void*);
+
+} // ns resource
+
+// named, reference counted backend objects behind generational handles
+//
+// entries start unreferenced. unreferenced entries stay cached in least
+// recently released order and are evicted first when a category goes over
+// its memory budget. lookups take a shared lock, anything changing counts
+// or membership an exclusive one. the release function runs outside the
+// lock and may not call back into the table
+class HaruhiResourceTable {
+  static constexpr uint32_t NIL = ~0u;
+
+  struct Slot {
+    void* object;
+    size_t bytes;
+    uint64_t name;
+    uint32_t generation;
+    uint32_t refs;
+    resource::Category category;
+    // unreferenced list links, or free list
+    uint32_t prev, next;
+  };
+
+  struct CategoryState {
+    std::unordered_map<uint64_t, uint32_t> names;
+    size_t budget, resident;
+    uint32_t lru_head, lru_tail; // oldest first
+  };
+
+  struct Evicted {
+    resource::Category category;
+    void* object;
+  };
+
+  mutable std::shared_mutex mtx_;
+  std::vector<Slot> slots_;
+  uint32_t free_;
+  CategoryState categories_[resource::CATEGORY_COUNT];
+  std::unordered_map<uint64_t, std::string> interned_;
+  resource::ReleaseFn release_fn_;
+  void* p_user_;
+
+  Slot* lookup(resource::Handle) noexcept;
+  const Slot* lookup(resource::Handle) const noexcept;
+  void unlink(uint32_t) noexcept;
+  void linkTail(uint32_t) noexcept;
+  void evictSlot(uint32_t, std::vector<Evicted>&) noexcept;
+  void evictOver(resource::Category, size_t, std::vector<Evicted>&) noexcept;
+  void releaseEvicted(const std::vector<Evicted>&) const noexcept;
+
+public:
+  explicit HaruhiResourceTable(resource::ReleaseFn = nullptr, void* = nullptr);
+  // releases every entry, referenced or not
+  ~HaruhiResourceTable();
+
+  HaruhiResourceTable(const HaruhiResourceTable&) = delete;
+  HaruhiResourceTable& operator=(const HaruhiResourceTable&) = delete;
+
+  // remembers the string of a name for nameOf, aborts on a hash collision
+  resource::Name intern(std::string_view);
+  // nullptr for names never interned
+  const char* nameOf(resource::Name) const noexcept;
+
+  // resident bytes before cached entries get evicted, 0 is unlimited
+  void setBudget(resource::Category, size_t);
+  size_t budget(resource::Category) const noexcept;
+  size_t residentBytes(resource::Category) const noexcept;
+
+  // null handle when the name is taken in the category. evicts cached
+  // entries to make room first, referenced ones may push it over budget
+  resource::Handle add(resource::Category, resource::Name, void*, size_t);
+  resource::Handle find(resource::Category, resource::Name) const noexcept;
+  // nullptr for stale handles
+  void* get(resource::Handle) const noexcept;
+
+  // a reference keeps the entry from being evicted
+  bool acquire(resource::Handle) noexcept;
+  resource::Handle acquire(resource::Category, resource::Name) noexcept;
+  // the last release caches the entry, evicting if over budget
+  void release(resource::Handle);
+  uint32_t refCount(resource::Handle) const noexcept;
+
+  // drops an unreferenced entry right away
+  bool remove(resource::Handle);
+  // evicts cached entries until the category holds at most the given
+  // bytes, returns the bytes freed
+  size_t trim(resource::Category, size_t);
+
+  size_t size(resource::Category) const noexcept;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "SceneSystems.hxx"
+
+#include <algorithm>
+#include <bit>
+
+#include "MathUtil.hxx"
+#include "OcclusionBuffer.hxx"
+#include "VertexFormat.hxx"
+#include "WorkerPool.hxx"
+
+namespace scene {
+
+void
+spin(HaruhiEntityWorld& world, HaruhiWorkerPool* pPool) noexcept {
+  world.each<Spin, Transform>(pPool, [](size_t n, Spin* s, Transform* t) {
+    for(size_t i = 0; i < n; ++i) {
+      s[i].angle += s[i].rate;
+      t[i].rotation = s[i].tilt * math::makeQuat(s[i].axis, s[i].angle);
+    }
+  });
+}
+
+cull::Aabb
+worldBounds(const Transform& t, const math::float3& extent) noexcept {
+  // |R| * (extent * scale) covers every rotated corner
+  const math::float3x3 r = math::toMatrix(t.rotation);
+  const math::float3 h = extent * t.scale;
+  const auto& c = r.columns;
+  const math::float3 e = {
+    std::abs(c[0].x) * h.x + std::abs(c[1].x) * h.y + std::abs(c[2].x) * h.z,
+    std::abs(c[0].y) * h.x + std::abs(c[1].y) * h.y + std::abs(c[2].y) * h.z,
+    std::abs(c[0].z) * h.x + std::abs(c[1].z) * h.y + std::abs(c[2].z) * h.z
+  };
+  return { t.position - e, t.position + e };
+}
+
+} // ns scene
+
+HaruhiInstanceGather::HaruhiInstanceGather(unsigned targets)
+: targets_(targets ? targets : 1, Target{ 0, ~uint64_t(0) })
+{
+  ;
+}
+
+scene::InstanceRange
+HaruhiInstanceGather::write(HaruhiEntityWorld& world, unsigned target,
+                            shader_t::InstanceData* dst, size_t capacity,
+                            HaruhiWorkerPool* pPool) noexcept {
+  using scene::Transform;
+  using scene::Mesh;
+
+  Target& t = targets_[target];
+  const bool full = t.structure != world.structure();
+  const uint64_t seen = t.version;
+  // taken before the query so writes racing it are seen next time
+  t.version = world.version();
+  t.structure = world.structure();
+
+  std::atomic<size_t> composed(0), first(capacity), last(0);
+  world.eachChunk<const Transform, const Mesh>(pPool,
+    [&](const ecs::ChunkInfo& c, const Transform* tr, const Mesh* m) {
+      if(!full && c.version <= seen) return;
+      if(c.first >= capacity) return;
+      const size_t n = std::min(c.count, capacity - c.first);
+      shader_t::InstanceData* d = dst + c.first;
+      for(size_t i = 0; i < n; ++i) {
+        const math::float4x4 model = math::makeTRS(tr[i].position, tr[i].rotation, tr[i].scale);
+        d[i].instanceTransform = model;
+        d[i].instanceNormalTransform = math::discardTranslation(model);
+        d[i].instanceColor = m[i].color;
+      }
+      composed.fetch_add(n, std::memory_order_relaxed);
+      // chunks are disjoint, a relaxed min/max is enough
+      size_t cur = first.load(std::memory_order_relaxed);
+      while(c.first < cur && !first.compare_exchange_weak(cur, c.first, std::memory_order_relaxed));
+      cur = last.load(std::memory_order_relaxed);
+      while(c.first + n > cur && !last.compare_exchange_weak(cur, c.first + n, std::memory_order_relaxed));
+    });
+
+  if(!composed.load()) return { 0, 0, 0 };
+  return { composed.load(), first.load(), last.load() };
+}
+
+scene::InstanceRange
+HaruhiInstanceGather::writeVisible(HaruhiEntityWorld& world, const ecs::Entity* entities, size_t n,
+                                   shader_t::InstanceData* dst, size_t capacity,
+                                   HaruhiWorkerPool* pPool) noexcept {
+  n = std::min(n, capacity);
+  auto run = [&](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i) {
+      const scene::Transform* tr = world.get<const scene::Transform>(entities[i]);
+      const scene::Mesh* m = world.get<const scene::Mesh>(entities[i]);
+      const math::float4x4 model = math::makeTRS(tr->position, tr->rotation, tr->scale);
+      dst[i].instanceTransform = model;
+      dst[i].instanceNormalTransform = math::discardTranslation(model);
+      dst[i].instanceColor = m->color;
+    }
+  };
+  if(pPool) pPool->parallelFor(n, 1024, run);
+  else run(0, n);
+  return { n, 0, n };
+}
+
+scene::InstanceRange
+HaruhiInstanceGather::writeVisible(HaruhiEntityWorld& world, const ecs::Entity* entities, size_t n,
+                                   shader_t::CompactInstanceData* dst, size_t capacity,
+                                   HaruhiWorkerPool* pPool) noexcept {
+  n = std::min(n, capacity);
+  auto run = [&](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i) {
+      const scene::Transform* tr = world.get<const scene::Transform>(entities[i]);
+      const scene::Mesh* m = world.get<const scene::Mesh>(entities[i]);
+      dst[i] = vtx::packInstance(tr->position, tr->rotation, tr->scale, m->color);
+    }
+  };
+  if(pPool) pPool->parallelFor(n, 1024, run);
+  else run(0, n);
+  return { n, 0, n };
+}
+
+HaruhiVisibility::HaruhiVisibility()
+: version_(0), structure_(~uint64_t(0)), stats_{ 0, 0, 0, 0, 0 }
+{
+  ;
+}
+
+void
+HaruhiVisibility::update(HaruhiEntityWorld& world, HaruhiWorkerPool* pPool) {
+  using scene::Transform;
+  using scene::Bounds;
+
+  const uint64_t seen = version_;
+  if(structure_ != world.structure()) {
+    // proxies of entities gone or stripped of their bounds
+    for(uint32_t p = 0; p < entities_.size(); ++p) {
+      const ecs::Entity e = entities_[p];
+      if(!e) continue;
+      const Bounds* b = world.get<const Bounds>(e);
+      if(b && b->proxy == p && world.has<Transform>(e)) continue;
+      tree_.remove(p);
+      entities_[p] = ecs::NULL_ENTITY;
+    }
+    world.eachChunk<const Transform, Bounds>([&](const ecs::ChunkInfo& c, const Transform* t, Bounds* b) {
+      for(size_t i = 0; i < c.count; ++i) {
+        if(b[i].proxy != cull::NULL_PROXY && b[i].proxy < entities_.size() &&
+           entities_[b[i].proxy] == c.entities[i]) continue;
+        b[i].proxy = tree_.insert(scene::worldBounds(t[i], b[i].extent));
+        if(b[i].proxy >= entities_.size()) entities_.resize(b[i].proxy + 1, ecs::NULL_ENTITY);
+        entities_[b[i].proxy] = c.entities[i];
+      }
+    });
+    structure_ = world.structure();
+  }
+  version_ = world.version();
+
+  world.eachChunk<const Transform, const Bounds>(pPool,
+    [&](const ecs::ChunkInfo& c, const Transform* t, const Bounds* b) {
+      if(c.version <= seen) return;
+      for(size_t i = 0; i < c.count; ++i)
+        tree_.update(b[i].proxy, scene::worldBounds(t[i], b[i].extent));
+    });
+  tree_.refit(pPool);
+}
+
+const std::vector<ecs::Entity>&
+HaruhiVisibility::cull(const math::float4x4& viewProj, HaruhiWorkerPool* pPool,
+                       const HaruhiOcclusionBuffer* pOcclusion) {
+  proxies_.clear();
+  stats_ = tree_.cull(cull::makeFrustum(viewProj), proxies_, pPool);
+
+  if(pOcclusion) {
+    hidden_.resize(proxies_.size());
+    auto run = [&](size_t b, size_t e) {
+      for(size_t i = b; i < e; ++i)
+        hidden_[i] = !pOcclusion->visible(tree_.bounds(proxies_[i]));
+    };
+    if(pPool) pPool->parallelFor(proxies_.size(), 1024, run);
+    else run(0, proxies_.size());
+
+    size_t kept = 0;
+    for(size_t i = 0; i < proxies_.size(); ++i)
+      if(!hidden_[i]) proxies_[kept++] = proxies_[i];
+    stats_.occluded = proxies_.size() - kept;
+    stats_.visible = kept;
+    proxies_.resize(kept);
+  }
+
+  // back to proxy order, which follows creation order and so mostly the
+  // chunks. the gather then walks memory forward instead of hopping
+  // around in tree order
+  bits_.assign((entities_.size() + 63) / 64, 0);
+  for(uint32_t p : proxies_) bits_[p / 64] |= uint64_t(1) << (p % 64);
+  visible_.clear();
+  for(size_t w = 0; w < bits_.size(); ++w)
+    for(uint64_t b = bits_[w]; b; b &= b - 1)
+      visible_.push_back(entities_[w * 64 + std::countr_zero(b)]);
+  return visible_;
+}
\ No newline at end of file
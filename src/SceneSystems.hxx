@@ -0,0 +1,114 @@
+#ifndef HARUHI_SCENESYSTEMS_HXX
+#define HARUHI_SCENESYSTEMS_HXX
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "BoundsTree.hxx"
+#include "EntityWorld.hxx"
+#include "ShaderTypes.hxx"
+
+class HaruhiOcclusionBuffer;
+
+// the engine's own components and the systems working on them
+namespace scene {
+
+struct Transform {
+  math::float3 position;
+  math::quat rotation;
+  math::float3 scale;
+};
+
+struct Mesh {
+  math::float4 color;
+  uint32_t id;
+};
+
+// rotation = tilt * (axis, angle), the angle grows by rate per step
+struct Spin {
+  math::quat tilt;
+  math::float3 axis;
+  float angle;
+  float rate;
+};
+
+void spin(HaruhiEntityWorld&, HaruhiWorkerPool* = nullptr) noexcept;
+
+// half size of the mesh around its origin. create with cull::NULL_PROXY,
+// HaruhiVisibility fills the proxy in
+struct Bounds {
+  math::float3 extent;
+  uint32_t proxy;
+};
+
+// box around the local box (-extent, extent) once transformed
+cull::Aabb worldBounds(const Transform&, const math::float3&) noexcept;
+
+struct InstanceRange {
+  size_t composed;
+  // touched instance range [first, last), empty when nothing changed
+  size_t first, last;
+};
+
+} // ns scene
+
+// composes Transform + Mesh entities into shader_t::InstanceData, in query
+// order. every target (e.g. one gpu buffer per frame in flight) remembers
+// the world version it saw, only chunks written since are recomposed. any
+// structural change recomposes everything
+class HaruhiInstanceGather {
+  struct Target {
+    uint64_t version;
+    uint64_t structure;
+  };
+  std::vector<Target> targets_;
+
+public:
+  explicit HaruhiInstanceGather(unsigned = 1);
+
+  // instances past the capacity are dropped
+  scene::InstanceRange write(HaruhiEntityWorld&, unsigned, shader_t::InstanceData*, size_t,
+                             HaruhiWorkerPool* = nullptr) noexcept;
+  // composes the given entities packed from dst[0], e.g. the visible ones.
+  // every call rewrites them all, the targets aren't involved
+  scene::InstanceRange writeVisible(HaruhiEntityWorld&, const ecs::Entity*, size_t,
+                                    shader_t::InstanceData*, size_t,
+                                    HaruhiWorkerPool* = nullptr) noexcept;
+  // the same packed for the gpu to expand, a quarter of the bytes
+  scene::InstanceRange writeVisible(HaruhiEntityWorld&, const ecs::Entity*, size_t,
+                                    shader_t::CompactInstanceData*, size_t,
+                                    HaruhiWorkerPool* = nullptr) noexcept;
+};
+
+// keeps a HaruhiBoundsTree in sync with Transform + Bounds entities and
+// answers which of them a camera sees. like the gather, only chunks
+// written since the last update are looked at
+class HaruhiVisibility {
+  HaruhiBoundsTree tree_;
+  // entity per proxy
+  std::vector<ecs::Entity> entities_;
+  std::vector<uint32_t> proxies_;
+  std::vector<uint64_t> bits_;
+  std::vector<uint8_t> hidden_;
+  std::vector<ecs::Entity> visible_;
+  uint64_t version_;
+  uint64_t structure_;
+  cull::Stats stats_;
+
+public:
+  HaruhiVisibility();
+
+  void update(HaruhiEntityWorld&, HaruhiWorkerPool* = nullptr);
+  // visible entities in proxy order, valid until the next call. with an
+  // occlusion buffer rendered for the same camera, the ones it hides
+  // are dropped too
+  const std::vector<ecs::Entity>& cull(const math::float4x4&, HaruhiWorkerPool* = nullptr,
+                                       const HaruhiOcclusionBuffer* = nullptr);
+
+  // counters of the last cull
+  const cull::Stats& stats() const noexcept { return stats_; }
+  const HaruhiBoundsTree& tree() const noexcept { return tree_; }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,117 @@
+#ifndef HARUHI_SHADERTYPES_HXX
+#define HARUHI_SHADERTYPES_HXX
+
+#include <cstddef>
+#include <cstdint>
+
+#include "SimdMath.hxx"
+
+// every struct the shaders read, written once. the c++ structs and the
+// msl text the renderer compiles come from the same list, with the msl
+// type names spelled out on the c++ side. metal's float3 is 16 bytes like
+// math::float3, packed_float3 is 12
+#define HARUHI_SHADER_STRUCTS(S) \
+  S(VertexData, \
+    float3 pos; \
+    float3 norm; \
+    float2 texcoord;) \
+  /* 16 byte vertex, quantized by vtx::pack. pos is unorm16 over the    \
+     mesh's quantization, norm an octahedral snorm16 pair, texcoord      \
+     unorm16 over the mesh's texcoord range. pos.w is 0, chunks put      \
+     their light in it (voxel::ChunkMesh::light) */ \
+  S(PackedVertexData, \
+    ushort pos[4]; \
+    short norm[2]; \
+    ushort texcoord[2];) \
+  S(InstanceData, \
+    float4x4 instanceTransform; \
+    float3x3 instanceNormalTransform; \
+    float4 instanceColor;) \
+  /* 32 byte instance, packed by vtx::packInstance and expanded by      \
+     expandInstance in the vertex shader. rotation is a quaternion of    \
+     snorm16 xy and zw pairs, scale half xy and z, color rgba8 unorm */ \
+  S(CompactInstanceData, \
+    packed_float3 position; \
+    uint color; \
+    uint rotation[2]; \
+    uint scale[2];) \
+  /* dequantizes one mesh of PackedVertexData, bound where the          \
+     instances go. texcoordTransform is xy scale, zw offset */ \
+  S(PackedMeshData, \
+    float4x4 meshTransform; \
+    float3x3 meshNormalTransform; \
+    float4 texcoordTransform;) \
+  S(CameraData, \
+    float4x4 perspTransform; \
+    float4x4 worldTransform; \
+    float3x3 worldNormalTransform;)
+
+#define HARUHI_SHADER_STRUCT_CXX(name, ...) struct name { __VA_ARGS__ };
+#define HARUHI_SHADER_STRUCT_MSL(name, ...) "struct " #name " { " #__VA_ARGS__ " };\n"
+
+namespace shader_t {
+
+using math::float2;
+using math::float3;
+using math::float4;
+using math::float3x3;
+using math::float4x4;
+using uint = uint32_t;
+using ushort = uint16_t;
+
+struct packed_float3 {
+  float x, y, z;
+};
+
+HARUHI_SHADER_STRUCTS(HARUHI_SHADER_STRUCT_CXX)
+
+// the same structs for the shader source
+inline constexpr const char STRUCTS_SOURCE[] = HARUHI_SHADER_STRUCTS(HARUHI_SHADER_STRUCT_MSL);
+
+// CompactInstanceData to what InstanceData holds, vtx::expandInstance
+// does the same on the cpu. the normal transform is the cofactor of the
+// upper 3x3, right under non uniform scale, its length is normalized away
+inline constexpr const char INSTANCE_SOURCE[] = R"(
+struct ExpandedInstance
+{
+  float4x4 transform;
+  float3x3 normalTransform;
+  float4 color;
+};
+ExpandedInstance expandInstance(device const CompactInstanceData& d)
+{
+  float4 q = normalize(float4(unpack_snorm2x16_to_float(d.rotation[0]),
+                              unpack_snorm2x16_to_float(d.rotation[1])));
+  float3 s = float3(float2(as_type<half2>(d.scale[0])), float(as_type<half2>(d.scale[1]).x));
+  float3 c0 = float3(1. - 2. * (q.y * q.y + q.z * q.z), 2. * (q.x * q.y + q.w * q.z), 2. * (q.x * q.z - q.w * q.y));
+  float3 c1 = float3(2. * (q.x * q.y - q.w * q.z), 1. - 2. * (q.x * q.x + q.z * q.z), 2. * (q.y * q.z + q.w * q.x));
+  float3 c2 = float3(2. * (q.x * q.z + q.w * q.y), 2. * (q.y * q.z - q.w * q.x), 1. - 2. * (q.x * q.x + q.y * q.y));
+  ExpandedInstance e;
+  e.transform = float4x4(float4(c0 * s.x, 0.), float4(c1 * s.y, 0.), float4(c2 * s.z, 0.),
+                         float4(float3(d.position), 1.));
+  e.normalTransform = float3x3(c0 * (s.y * s.z), c1 * (s.x * s.z), c2 * (s.x * s.y));
+  e.color = unpack_unorm4x8_to_float(d.color);
+  return e;
+}
+)";
+
+// must stay identical to the msl side
+static_assert(sizeof(VertexData) == 48);
+static_assert(offsetof(VertexData, texcoord) == 32);
+static_assert(sizeof(PackedVertexData) == 16);
+static_assert(offsetof(PackedVertexData, texcoord) == 12);
+static_assert(sizeof(InstanceData) == 128);
+static_assert(offsetof(InstanceData, instanceNormalTransform) == 64);
+static_assert(offsetof(InstanceData, instanceColor) == 112);
+static_assert(sizeof(CompactInstanceData) == 32 && alignof(CompactInstanceData) == 4);
+static_assert(offsetof(CompactInstanceData, color) == 12);
+static_assert(offsetof(CompactInstanceData, rotation) == 16);
+static_assert(offsetof(CompactInstanceData, scale) == 24);
+static_assert(sizeof(PackedMeshData) == 128);
+static_assert(offsetof(PackedMeshData, texcoordTransform) == 112);
+static_assert(sizeof(CameraData) == 176);
+static_assert(offsetof(CameraData, worldNormalTransform) == 128);
+
+} // ns shader_t
+
+#endif
\ No newline at end of file
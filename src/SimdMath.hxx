@@ -0,0 +1,449 @@
+#ifndef HARUHI_SIMDMATH_HXX
+#define HARUHI_SIMDMATH_HXX
+
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// backend selection, define HARUHI_SIMD_FORCE_SCALAR to get reference results
+#if !defined(HARUHI_SIMD_FORCE_SCALAR) && (defined(__SSE2__) || defined(_M_X64))
+#define HARUHI_SIMD_SSE2 1
+#include <immintrin.h>
+#if defined(__AVX2__)
+#define HARUHI_SIMD_AVX2 1
+#endif
+#elif !defined(HARUHI_SIMD_FORCE_SCALAR) && defined(__ARM_NEON)
+#define HARUHI_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define HARUHI_SIMD_SCALAR 1
+#endif
+
+namespace math {
+
+// layouts follow <simd/simd.h> so gpu buffers can be filled with plain memcpy
+// float3 is padded to 16 bytes, matrices are column major
+
+struct alignas(8) float2 {
+  float x, y;
+};
+
+struct alignas(16) float3 {
+  float x, y, z;
+  float _pad = 0.f;
+
+  constexpr float3() noexcept : x(0.f), y(0.f), z(0.f) {}
+  constexpr float3(float a, float b, float c) noexcept : x(a), y(b), z(c) {}
+};
+
+struct alignas(16) float4 {
+  float x, y, z, w;
+
+  constexpr float4() noexcept : x(0.f), y(0.f), z(0.f), w(0.f) {}
+  constexpr float4(float a, float b, float c, float d) noexcept
+  : x(a), y(b), z(c), w(d) {}
+  constexpr float4(const float3& v, float d) noexcept
+  : x(v.x), y(v.y), z(v.z), w(d) {}
+
+  constexpr float3 xyz() const noexcept { return { x, y, z }; }
+};
+
+struct float3x3 {
+  float3 columns[3];
+};
+
+struct float4x4 {
+  float4 columns[4];
+};
+
+// (x, y, z) imaginary, w real
+struct alignas(16) quat {
+  float x, y, z, w;
+};
+
+static_assert(sizeof(float2) == 8 && alignof(float2) == 8);
+static_assert(sizeof(float3) == 16 && alignof(float3) == 16);
+static_assert(sizeof(float4) == 16 && alignof(float4) == 16);
+static_assert(sizeof(float3x3) == 48 && alignof(float3x3) == 16);
+static_assert(sizeof(float4x4) == 64 && alignof(float4x4) == 16);
+static_assert(sizeof(quat) == 16);
+
+namespace vec {
+
+// 4-wide register abstraction, everything above this namespace is backend free
+
+#if defined(HARUHI_SIMD_SSE2)
+
+using v4 = __m128;
+
+inline v4 load(const float* p) noexcept { return _mm_load_ps(p); }
+inline v4 loadu(const float* p) noexcept { return _mm_loadu_ps(p); }
+inline void store(float* p, v4 a) noexcept { _mm_store_ps(p, a); }
+inline v4 splat(float a) noexcept { return _mm_set1_ps(a); }
+inline v4 set(float a, float b, float c, float d) noexcept {
+  return _mm_setr_ps(a, b, c, d);
+}
+inline v4 add(v4 a, v4 b) noexcept { return _mm_add_ps(a, b); }
+inline v4 sub(v4 a, v4 b) noexcept { return _mm_sub_ps(a, b); }
+inline v4 mul(v4 a, v4 b) noexcept { return _mm_mul_ps(a, b); }
+inline v4 madd(v4 a, v4 b, v4 c) noexcept {
+#if defined(__FMA__)
+  return _mm_fmadd_ps(a, b, c);
+#else
+  return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+#if defined(HARUHI_SIMD_AVX2)
+// -mavx2 doesn't imply -mfma
+inline __m256 madd8(__m256 a, __m256 b, __m256 c) noexcept {
+#if defined(__FMA__)
+  return _mm256_fmadd_ps(a, b, c);
+#else
+  return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+#endif
+template <int I>
+inline v4 lane(v4 a) noexcept { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(I, I, I, I)); }
+inline v4 clear_w(v4 a) noexcept {
+  return _mm_and_ps(a, _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0)));
+}
+inline void transpose(v4& a, v4& b, v4& c, v4& d) noexcept {
+  _MM_TRANSPOSE4_PS(a, b, c, d);
+}
+// bypasses the cache, meant for write combined gpu memory
+inline void stream(float* p, v4 a) noexcept { _mm_stream_ps(p, a); }
+inline void stream_fence() noexcept { _mm_sfence(); }
+
+inline v4 div(v4 a, v4 b) noexcept { return _mm_div_ps(a, b); }
+inline v4 min(v4 a, v4 b) noexcept { return _mm_min_ps(a, b); }
+inline v4 max(v4 a, v4 b) noexcept { return _mm_max_ps(a, b); }
+inline v4 sqrt(v4 a) noexcept { return _mm_sqrt_ps(a); }
+inline v4 floor(v4 a) noexcept {
+  const v4 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+  return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.f)));
+}
+// comparisons give all-ones/all-zero lanes
+inline v4 cmpge(v4 a, v4 b) noexcept { return _mm_cmpge_ps(a, b); }
+inline v4 cmpgt(v4 a, v4 b) noexcept { return _mm_cmpgt_ps(a, b); }
+inline v4 cmplt(v4 a, v4 b) noexcept { return _mm_cmplt_ps(a, b); }
+inline v4 and_(v4 a, v4 b) noexcept { return _mm_and_ps(a, b); }
+inline v4 or_(v4 a, v4 b) noexcept { return _mm_or_ps(a, b); }
+inline v4 select(v4 m, v4 a, v4 b) noexcept {
+  return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+inline int movemask(v4 m) noexcept { return _mm_movemask_ps(m); }
+
+#elif defined(HARUHI_SIMD_NEON)
+
+using v4 = float32x4_t;
+
+inline v4 load(const float* p) noexcept { return vld1q_f32(p); }
+inline v4 loadu(const float* p) noexcept { return vld1q_f32(p); }
+inline void store(float* p, v4 a) noexcept { vst1q_f32(p, a); }
+inline v4 splat(float a) noexcept { return vdupq_n_f32(a); }
+inline v4 set(float a, float b, float c, float d) noexcept {
+  const float t[4] = { a, b, c, d };
+  return vld1q_f32(t);
+}
+inline v4 add(v4 a, v4 b) noexcept { return vaddq_f32(a, b); }
+inline v4 sub(v4 a, v4 b) noexcept { return vsubq_f32(a, b); }
+inline v4 mul(v4 a, v4 b) noexcept { return vmulq_f32(a, b); }
+inline v4 madd(v4 a, v4 b, v4 c) noexcept { return vfmaq_f32(c, a, b); }
+template <int I>
+inline v4 lane(v4 a) noexcept { return vdupq_laneq_f32(a, I); }
+inline v4 clear_w(v4 a) noexcept { return vsetq_lane_f32(0.f, a, 3); }
+inline void transpose(v4& a, v4& b, v4& c, v4& d) noexcept {
+  const float32x4x2_t ab = vtrnq_f32(a, b);
+  const float32x4x2_t cd = vtrnq_f32(c, d);
+  a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+  b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+  c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+  d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+}
+inline void stream(float* p, v4 a) noexcept { vst1q_f32(p, a); }
+inline void stream_fence() noexcept {}
+
+inline v4 div(v4 a, v4 b) noexcept { return vdivq_f32(a, b); }
+inline v4 min(v4 a, v4 b) noexcept { return vminq_f32(a, b); }
+inline v4 max(v4 a, v4 b) noexcept { return vmaxq_f32(a, b); }
+inline v4 sqrt(v4 a) noexcept { return vsqrtq_f32(a); }
+inline v4 floor(v4 a) noexcept { return vrndmq_f32(a); }
+inline v4 cmpge(v4 a, v4 b) noexcept { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+inline v4 cmpgt(v4 a, v4 b) noexcept { return vreinterpretq_f32_u32(vcgtq_f32(a, b)); }
+inline v4 cmplt(v4 a, v4 b) noexcept { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+inline v4 and_(v4 a, v4 b) noexcept {
+  return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+inline v4 or_(v4 a, v4 b) noexcept {
+  return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+inline v4 select(v4 m, v4 a, v4 b) noexcept { return vbslq_f32(vreinterpretq_u32_f32(m), a, b); }
+inline int movemask(v4 m) noexcept {
+  static const uint32_t bits[4] = { 1, 2, 4, 8 };
+  const uint32x4_t t = vandq_u32(vshrq_n_u32(vreinterpretq_u32_f32(m), 31), vld1q_u32(bits));
+  return (int)vaddvq_u32(t);
+}
+
+#else
+
+struct v4 { float e[4]; };
+
+inline v4 load(const float* p) noexcept { return { { p[0], p[1], p[2], p[3] } }; }
+inline v4 loadu(const float* p) noexcept { return load(p); }
+inline void store(float* p, v4 a) noexcept {
+  for(int i = 0; i < 4; ++i) p[i] = a.e[i];
+}
+inline v4 splat(float a) noexcept { return { { a, a, a, a } }; }
+inline v4 set(float a, float b, float c, float d) noexcept { return { { a, b, c, d } }; }
+inline v4 add(v4 a, v4 b) noexcept {
+  return { { a.e[0]+b.e[0], a.e[1]+b.e[1], a.e[2]+b.e[2], a.e[3]+b.e[3] } };
+}
+inline v4 sub(v4 a, v4 b) noexcept {
+  return { { a.e[0]-b.e[0], a.e[1]-b.e[1], a.e[2]-b.e[2], a.e[3]-b.e[3] } };
+}
+inline v4 mul(v4 a, v4 b) noexcept {
+  return { { a.e[0]*b.e[0], a.e[1]*b.e[1], a.e[2]*b.e[2], a.e[3]*b.e[3] } };
+}
+inline v4 madd(v4 a, v4 b, v4 c) noexcept { return add(mul(a, b), c); }
+template <int I>
+inline v4 lane(v4 a) noexcept { return splat(a.e[I]); }
+inline v4 clear_w(v4 a) noexcept { a.e[3] = 0.f; return a; }
+inline void transpose(v4& a, v4& b, v4& c, v4& d) noexcept {
+  v4* r[4] = { &a, &b, &c, &d };
+  for(int i = 0; i < 4; ++i)
+    for(int j = i + 1; j < 4; ++j) {
+      const float t = r[i]->e[j];
+      r[i]->e[j] = r[j]->e[i];
+      r[j]->e[i] = t;
+    }
+}
+inline void stream(float* p, v4 a) noexcept { store(p, a); }
+inline void stream_fence() noexcept {}
+
+template <typename Fn>
+inline v4 map2(v4 a, v4 b, Fn fn) noexcept {
+  return { { fn(a.e[0], b.e[0]), fn(a.e[1], b.e[1]), fn(a.e[2], b.e[2]), fn(a.e[3], b.e[3]) } };
+}
+inline float mask_lane(bool c) noexcept { return std::bit_cast<float>(c ? ~0u : 0u); }
+inline uint32_t bits_lane(float a) noexcept { return std::bit_cast<uint32_t>(a); }
+
+inline v4 div(v4 a, v4 b) noexcept { return map2(a, b, [](float x, float y) { return x / y; }); }
+inline v4 min(v4 a, v4 b) noexcept { return map2(a, b, [](float x, float y) { return y < x ? y : x; }); }
+inline v4 max(v4 a, v4 b) noexcept { return map2(a, b, [](float x, float y) { return y > x ? y : x; }); }
+inline v4 sqrt(v4 a) noexcept { return map2(a, a, [](float x, float) { return std::sqrt(x); }); }
+inline v4 floor(v4 a) noexcept { return map2(a, a, [](float x, float) { return std::floor(x); }); }
+inline v4 cmpge(v4 a, v4 b) noexcept { return map2(a, b, [](float x, float y) { return mask_lane(x >= y); }); }
+inline v4 cmpgt(v4 a, v4 b) noexcept { return map2(a, b, [](float x, float y) { return mask_lane(x > y); }); }
+inline v4 cmplt(v4 a, v4 b) noexcept { return map2(a, b, [](float x, float y) { return mask_lane(x < y); }); }
+inline v4 and_(v4 a, v4 b) noexcept {
+  return map2(a, b, [](float x, float y) { return std::bit_cast<float>(bits_lane(x) & bits_lane(y)); });
+}
+inline v4 or_(v4 a, v4 b) noexcept {
+  return map2(a, b, [](float x, float y) { return std::bit_cast<float>(bits_lane(x) | bits_lane(y)); });
+}
+inline v4 select(v4 m, v4 a, v4 b) noexcept {
+  v4 r;
+  for(int i = 0; i < 4; ++i) r.e[i] = bits_lane(m.e[i]) ? a.e[i] : b.e[i];
+  return r;
+}
+inline int movemask(v4 m) noexcept {
+  int r = 0;
+  for(int i = 0; i < 4; ++i) r |= int(bits_lane(m.e[i]) >> 31) << i;
+  return r;
+}
+
+#endif
+
+inline v4 load(const float4& a) noexcept { return load(&a.x); }
+inline v4 load(const float3& a) noexcept { return load(&a.x); }
+inline void store(float4& a, v4 v) noexcept { store(&a.x, v); }
+inline void store(float3& a, v4 v) noexcept { store(&a.x, clear_w(v)); }
+
+} // ns vec
+
+// float3
+
+inline float3 operator+(const float3& a, const float3& b) noexcept {
+  return { a.x + b.x, a.y + b.y, a.z + b.z };
+}
+inline float3 operator-(const float3& a, const float3& b) noexcept {
+  return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+inline float3 operator-(const float3& a) noexcept { return { -a.x, -a.y, -a.z }; }
+inline float3 operator*(const float3& a, float s) noexcept {
+  return { a.x * s, a.y * s, a.z * s };
+}
+inline float3 operator*(float s, const float3& a) noexcept { return a * s; }
+inline float3 operator*(const float3& a, const float3& b) noexcept {
+  return { a.x * b.x, a.y * b.y, a.z * b.z };
+}
+
+inline float dot(const float3& a, const float3& b) noexcept {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+inline float3 cross(const float3& a, const float3& b) noexcept {
+  return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+inline float length(const float3& a) noexcept { return std::sqrt(dot(a, a)); }
+inline float3 normalize(const float3& a) noexcept { return a * (1.f / length(a)); }
+
+// float4
+
+inline float4 operator+(const float4& a, const float4& b) noexcept {
+  float4 r; vec::store(r, vec::add(vec::load(a), vec::load(b))); return r;
+}
+inline float4 operator-(const float4& a, const float4& b) noexcept {
+  float4 r; vec::store(r, vec::sub(vec::load(a), vec::load(b))); return r;
+}
+inline float4 operator*(const float4& a, float s) noexcept {
+  float4 r; vec::store(r, vec::mul(vec::load(a), vec::splat(s))); return r;
+}
+inline float4 operator*(const float4& a, const float4& b) noexcept {
+  float4 r; vec::store(r, vec::mul(vec::load(a), vec::load(b))); return r;
+}
+inline float dot(const float4& a, const float4& b) noexcept {
+  return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+// matrices
+
+inline float4
+operator*(const float4x4& m, const float4& v) noexcept {
+  using namespace vec;
+  const v4 x = load(v);
+  v4 r = mul(load(m.columns[0]), lane<0>(x));
+  r = madd(load(m.columns[1]), lane<1>(x), r);
+  r = madd(load(m.columns[2]), lane<2>(x), r);
+  r = madd(load(m.columns[3]), lane<3>(x), r);
+  float4 o; store(o, r); return o;
+}
+
+inline float3
+operator*(const float3x3& m, const float3& v) noexcept {
+  using namespace vec;
+  v4 r = mul(load(m.columns[0]), splat(v.x));
+  r = madd(load(m.columns[1]), splat(v.y), r);
+  r = madd(load(m.columns[2]), splat(v.z), r);
+  float3 o; store(o, r); return o;
+}
+
+inline float4x4
+operator*(const float4x4& a, const float4x4& b) noexcept {
+  float4x4 r;
+#if defined(HARUHI_SIMD_AVX2)
+  // two result columns per iteration, a's columns duplicated in both lanes
+  const __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.columns[0]));
+  const __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.columns[1]));
+  const __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.columns[2]));
+  const __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a.columns[3]));
+  for(int j = 0; j < 4; j += 2) {
+    const __m256 bc = _mm256_loadu_ps(&b.columns[j].x);
+    __m256 o = _mm256_mul_ps(a0, _mm256_shuffle_ps(bc, bc, 0x00));
+    o = vec::madd8(a1, _mm256_shuffle_ps(bc, bc, 0x55), o);
+    o = vec::madd8(a2, _mm256_shuffle_ps(bc, bc, 0xAA), o);
+    o = vec::madd8(a3, _mm256_shuffle_ps(bc, bc, 0xFF), o);
+    _mm256_storeu_ps(&r.columns[j].x, o);
+  }
+#else
+  using namespace vec;
+  const v4 a0 = load(a.columns[0]), a1 = load(a.columns[1]);
+  const v4 a2 = load(a.columns[2]), a3 = load(a.columns[3]);
+  for(int j = 0; j < 4; ++j) {
+    const v4 bc = load(b.columns[j]);
+    v4 o = mul(a0, lane<0>(bc));
+    o = madd(a1, lane<1>(bc), o);
+    o = madd(a2, lane<2>(bc), o);
+    o = madd(a3, lane<3>(bc), o);
+    store(r.columns[j], o);
+  }
+#endif
+  return r;
+}
+
+inline float3x3
+operator*(const float3x3& a, const float3x3& b) noexcept {
+  return { { a * b.columns[0], a * b.columns[1], a * b.columns[2] } };
+}
+
+inline float4x4
+transpose(const float4x4& m) noexcept {
+  const auto& c = m.columns;
+  return { {
+    { c[0].x, c[1].x, c[2].x, c[3].x },
+    { c[0].y, c[1].y, c[2].y, c[3].y },
+    { c[0].z, c[1].z, c[2].z, c[3].z },
+    { c[0].w, c[1].w, c[2].w, c[3].w }
+  } };
+}
+
+inline float3x3
+transpose(const float3x3& m) noexcept {
+  const auto& c = m.columns;
+  return { {
+    { c[0].x, c[1].x, c[2].x },
+    { c[0].y, c[1].y, c[2].y },
+    { c[0].z, c[1].z, c[2].z }
+  } };
+}
+
+// quaternion
+
+inline quat
+operator*(const quat& a, const quat& b) noexcept {
+  return {
+    a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+    a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+    a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+    a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+  };
+}
+
+inline quat
+normalize(const quat& q) noexcept {
+  const float inv = 1.f / std::sqrt(q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w);
+  return { q.x * inv, q.y * inv, q.z * inv, q.w * inv };
+}
+
+inline quat conjugate(const quat& q) noexcept { return { -q.x, -q.y, -q.z, q.w }; }
+
+inline quat
+makeQuat(const float3& axis, float a) noexcept {
+  const float s = std::sin(a * .5f);
+  const float3 n = normalize(axis);
+  return { n.x * s, n.y * s, n.z * s, std::cos(a * .5f) };
+}
+
+inline float3
+rotate(const quat& q, const float3& v) noexcept {
+  // v + 2w(u x v) + 2u x (u x v)
+  const float3 u = { q.x, q.y, q.z };
+  const float3 t = cross(u, v) * 2.f;
+  return v + t * q.w + cross(u, t);
+}
+
+inline quat
+nlerp(const quat& a, const quat& b, float t) noexcept {
+  const float d = a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w;
+  const float s = d < 0.f ? -t : t;
+  return normalize({
+    a.x + (b.x * s - a.x * t), a.y + (b.y * s - a.y * t),
+    a.z + (b.z * s - a.z * t), a.w + (b.w * s - a.w * t) });
+}
+
+inline float3x3
+toMatrix(const quat& q) noexcept {
+  const float xx = q.x*q.x, yy = q.y*q.y, zz = q.z*q.z;
+  const float xy = q.x*q.y, xz = q.x*q.z, yz = q.y*q.z;
+  const float wx = q.w*q.x, wy = q.w*q.y, wz = q.w*q.z;
+  return { {
+    { 1.f - 2.f*(yy + zz), 2.f*(xy + wz), 2.f*(xz - wy) },
+    { 2.f*(xy - wz), 1.f - 2.f*(xx + zz), 2.f*(yz + wx) },
+    { 2.f*(xz + wy), 2.f*(yz - wx), 1.f - 2.f*(xx + yy) }
+  } };
+}
+
+} // ns math
+
+#endif
\ No newline at end of file
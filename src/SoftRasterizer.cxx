@@ -0,0 +1,485 @@
+#include "SoftRasterizer.hxx"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "ColorUtil.hxx"
+#include "WorkerPool.hxx"
+
+namespace {
+
+// triangles per setup chunk, each chunk bins into its own lists so the
+// raster stage can replay them in submission order
+constexpr size_t SETUP_GRAIN = 1024;
+
+enum Plane { PLANE_Z, PLANE_INVW, PLANE_U, PLANE_V, PLANE_NX, PLANE_NY, PLANE_NZ, PLANE_COUNT };
+
+double
+msSince(std::chrono::steady_clock::time_point t0) noexcept {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+} // ns
+
+struct HaruhiSoftRasterizer::Tri {
+  // edge i is opposite vertex i, e = a*(x - ox) + b*(y - oy) with the origin
+  // on the lower endpoint so shared edges evaluate to exactly -e
+  float ea[3], eb[3], eox[3], eoy[3];
+  bool top_left[3];
+  // attribute planes, p = c + dx*(x - x0) + dy*(y - y0)
+  float pc[PLANE_COUNT], pdx[PLANE_COUNT], pdy[PLANE_COUNT];
+  float x0, y0;
+  int min_x, min_y, max_x, max_y; // pixel bounds, max exclusive
+};
+
+struct HaruhiSoftRasterizer::Chunk {
+  std::vector<Tri> tris;
+  std::vector<std::vector<uint32_t>> bins;
+  uint64_t culled, clipped;
+};
+
+HaruhiSoftRasterizer::HaruhiSoftRasterizer(uint32_t w, uint32_t h, HaruhiWorkerPool* pPool)
+: width_(w), height_(h), stride_((w + 3) & ~3u),
+  tiles_x_((w + TILE_SIZE - 1) / TILE_SIZE), tiles_y_((h + TILE_SIZE - 1) / TILE_SIZE),
+  p_pool_(pPool), p_texture_(nullptr)
+{
+  assert(w && h);
+  color_.resize((size_t)stride_ * height_);
+  depth_.resize((size_t)stride_ * height_);
+  resetTimings();
+  clear({ 0., 0., 0., 1. });
+}
+
+HaruhiSoftRasterizer::~HaruhiSoftRasterizer() {
+  ;
+}
+
+template <typename Fn>
+void
+HaruhiSoftRasterizer::parallel(size_t count, size_t grain, const Fn& fn) noexcept {
+  if(p_pool_)
+    p_pool_->parallelFor(count, grain, fn);
+  else
+    fn(0, count);
+}
+
+void
+HaruhiSoftRasterizer::resetTimings() noexcept {
+  timings_ = {};
+}
+
+void
+HaruhiSoftRasterizer::clear(const math::float4& c, float depth) noexcept {
+  const auto& t = color::srgb();
+  const uint32_t px =
+    t.toSrgb(c.x) | (t.toSrgb(c.y) << 8) | (t.toSrgb(c.z) << 16)
+    | ((uint32_t)(std::clamp(c.w, 0.f, 1.f) * 255.f + .5f) << 24);
+  std::fill(color_.begin(), color_.end(), px);
+  std::fill(depth_.begin(), depth_.end(), (uint16_t)(std::clamp(depth, 0.f, 1.f) * 65535.f + .5f));
+}
+
+void
+HaruhiSoftRasterizer::draw(const DrawCall& dc) noexcept {
+  assert(dc.vertices && dc.indices && dc.instances && dc.camera && dc.texture);
+  assert(dc.indexCount % 3 == 0);
+  if(!dc.indexCount || !dc.instanceCount) return;
+
+  p_texture_ = dc.texture;
+
+  auto t0 = std::chrono::steady_clock::now();
+  runVertexStage(dc);
+  timings_.vertexMs += msSince(t0);
+
+  t0 = std::chrono::steady_clock::now();
+  runSetupStage(dc);
+  timings_.setupMs += msSince(t0);
+
+  t0 = std::chrono::steady_clock::now();
+  runRasterStage();
+  timings_.rasterMs += msSince(t0);
+}
+
+// fn_vertex: perspective * world * instance * position, normals through the
+// two normal matrices
+void
+HaruhiSoftRasterizer::runVertexStage(const DrawCall& dc) noexcept {
+  clip_verts_.resize(dc.vertexCount * dc.instanceCount);
+
+  const auto& cam = *dc.camera;
+  const math::float4x4 viewProj = cam.perspTransform * cam.worldTransform;
+
+  parallel(dc.instanceCount, 64, [&](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i) {
+      const auto& inst = dc.instances[i];
+      const math::float4x4 m = viewProj * inst.instanceTransform;
+      const math::float3x3 n = cam.worldNormalTransform * inst.instanceNormalTransform;
+
+      ClipVertex* out = &clip_verts_[i * dc.vertexCount];
+      for(size_t v = 0; v < dc.vertexCount; ++v) {
+        const auto& in = dc.vertices[v];
+        out[v].pos = m * math::float4(in.pos, 1.);
+        out[v].norm = n * in.norm;
+        out[v].texcoord = in.texcoord;
+      }
+    }
+  });
+}
+
+namespace {
+
+using ClipPoly = std::array<float, 10>; // x y z w nx ny nz u v pad
+
+// sutherland-hodgman against one clip plane, d(v) >= 0 is kept
+template <typename Dist>
+int
+clipPolygon(const ClipPoly* in, int n, ClipPoly* out, Dist d) noexcept {
+  int m = 0;
+  for(int i = 0; i < n; ++i) {
+    const ClipPoly& a = in[i];
+    const ClipPoly& b = in[(i + 1) % n];
+    const float da = d(a), db = d(b);
+    if(da >= 0.f) out[m++] = a;
+    if((da >= 0.f) != (db >= 0.f)) {
+      const float t = da / (da - db);
+      for(int k = 0; k < 10; ++k)
+        out[m][k] = a[k] + (b[k] - a[k]) * t;
+      ++m;
+    }
+  }
+  return m;
+}
+
+} // ns
+
+void
+HaruhiSoftRasterizer::runSetupStage(const DrawCall& dc) noexcept {
+  const size_t triPerInst = dc.indexCount / 3;
+  const size_t tris = triPerInst * dc.instanceCount;
+  const size_t nchunks = (tris + SETUP_GRAIN - 1) / SETUP_GRAIN;
+  const size_t ntiles = (size_t)tiles_x_ * tiles_y_;
+
+  if(chunks_.size() < nchunks)
+    chunks_.resize(nchunks);
+  for(size_t c = 0; c < chunks_.size(); ++c) {
+    auto& ch = chunks_[c];
+    ch.tris.clear();
+    ch.bins.resize(ntiles);
+    for(auto& it : ch.bins) it.clear();
+    ch.culled = ch.clipped = 0;
+  }
+
+  parallel(tris, SETUP_GRAIN, [&](size_t b, size_t e) {
+    Chunk& ch = chunks_[b / SETUP_GRAIN];
+
+    for(size_t t = b; t < e; ++t) {
+      const size_t inst = t / triPerInst;
+      const uint16_t* idx = &dc.indices[(t % triPerInst) * 3];
+      const ClipVertex* base = &clip_verts_[inst * dc.vertexCount];
+      const ClipVertex& v0 = base[idx[0]];
+      const ClipVertex& v1 = base[idx[1]];
+      const ClipVertex& v2 = base[idx[2]];
+
+      // trivial reject against the six frustum planes
+      unsigned outside = ~0u;
+      for(const ClipVertex* v : { &v0, &v1, &v2 }) {
+        const auto& p = v->pos;
+        outside &=
+          (p.x > p.w) | (p.x < -p.w) << 1 | (p.y > p.w) << 2
+          | (p.y < -p.w) << 3 | (p.z > p.w) << 4 | (p.z < 0.f) << 5;
+      }
+      if(outside) {
+        ++ch.culled;
+        continue;
+      }
+
+      const bool needClip =
+        v0.pos.z < 0.f || v1.pos.z < 0.f || v2.pos.z < 0.f
+        || v0.pos.z > v0.pos.w || v1.pos.z > v1.pos.w || v2.pos.z > v2.pos.w;
+      if(!needClip) {
+        setupTriangle(ch, v0, v1, v2);
+        continue;
+      }
+
+      // metal clip space keeps 0 <= z <= w
+      ClipPoly a[9], c[9];
+      int n = 0;
+      for(const ClipVertex* v : { &v0, &v1, &v2 })
+        a[n++] = { v->pos.x, v->pos.y, v->pos.z, v->pos.w,
+                   v->norm.x, v->norm.y, v->norm.z,
+                   v->texcoord.x, v->texcoord.y, 0.f };
+      n = clipPolygon(a, n, c, [](const ClipPoly& p) { return p[2]; });
+      n = clipPolygon(c, n, a, [](const ClipPoly& p) { return p[3] - p[2]; });
+      ++ch.clipped;
+
+      ClipVertex fan[9];
+      for(int i = 0; i < n; ++i) {
+        fan[i].pos = { a[i][0], a[i][1], a[i][2], a[i][3] };
+        fan[i].norm = { a[i][4], a[i][5], a[i][6] };
+        fan[i].texcoord = { a[i][7], a[i][8] };
+      }
+      for(int i = 1; i + 1 < n; ++i)
+        setupTriangle(ch, fan[0], fan[i], fan[i + 1]);
+    }
+  });
+
+  for(size_t c = 0; c < nchunks; ++c) {
+    timings_.culled += chunks_[c].culled;
+    timings_.clipped += chunks_[c].clipped;
+  }
+  timings_.triangles += tris;
+}
+
+void
+HaruhiSoftRasterizer::setupTriangle(Chunk& ch, const ClipVertex& c0,
+                                    const ClipVertex& c1, const ClipVertex& c2) noexcept {
+  struct Screen { float x, y, z, invw, attr[PLANE_COUNT]; } s[3];
+
+  const ClipVertex* cv[3] = { &c0, &c1, &c2 };
+  for(int i = 0; i < 3; ++i) {
+    const auto& p = cv[i]->pos;
+    const float invw = 1.f / p.w;
+    s[i].x = (p.x * invw * .5f + .5f) * width_;
+    s[i].y = (.5f - p.y * invw * .5f) * height_;
+    s[i].z = p.z * invw;
+    s[i].invw = invw;
+    s[i].attr[PLANE_Z] = s[i].z;
+    s[i].attr[PLANE_INVW] = invw;
+    s[i].attr[PLANE_U] = cv[i]->texcoord.x * invw;
+    s[i].attr[PLANE_V] = cv[i]->texcoord.y * invw;
+    s[i].attr[PLANE_NX] = cv[i]->norm.x * invw;
+    s[i].attr[PLANE_NY] = cv[i]->norm.y * invw;
+    s[i].attr[PLANE_NZ] = cv[i]->norm.z * invw;
+  }
+
+  // y points down on screen, so a ccw (front) triangle has negative area
+  float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[1].y - s[0].y) * (s[2].x - s[0].x);
+  if(!(area < 0.f)) {
+    ++ch.culled;
+    return;
+  }
+  std::swap(s[1], s[2]);
+  area = -area;
+
+  Tri tri;
+
+  const float minx = std::min({ s[0].x, s[1].x, s[2].x });
+  const float maxx = std::max({ s[0].x, s[1].x, s[2].x });
+  const float miny = std::min({ s[0].y, s[1].y, s[2].y });
+  const float maxy = std::max({ s[0].y, s[1].y, s[2].y });
+  tri.min_x = std::max(0, (int)std::ceil(minx - .5f));
+  tri.min_y = std::max(0, (int)std::ceil(miny - .5f));
+  tri.max_x = std::min((int)width_, (int)std::floor(maxx - .5f) + 1);
+  tri.max_y = std::min((int)height_, (int)std::floor(maxy - .5f) + 1);
+  if(tri.min_x >= tri.max_x || tri.min_y >= tri.max_y) {
+    ++ch.culled;
+    return;
+  }
+
+  for(int i = 0; i < 3; ++i) {
+    const Screen* a = &s[(i + 1) % 3];
+    const Screen* b = &s[(i + 2) % 3];
+    // interior is e >= 0, left edges grow with x, top edges with y
+    tri.ea[i] = a->y - b->y;
+    tri.eb[i] = b->x - a->x;
+    tri.top_left[i] = tri.ea[i] > 0.f || (tri.ea[i] == 0.f && tri.eb[i] > 0.f);
+    if(b->y < a->y || (b->y == a->y && b->x < a->x)) {
+      tri.eox[i] = b->x; tri.eoy[i] = b->y;
+    } else {
+      tri.eox[i] = a->x; tri.eoy[i] = a->y;
+    }
+  }
+
+  // barycentric weight of vertex i is its opposite edge over the area
+  const float inva = 1.f / area;
+  tri.x0 = s[0].x;
+  tri.y0 = s[0].y;
+  for(int k = 0; k < PLANE_COUNT; ++k) {
+    float dx = 0.f, dy = 0.f;
+    for(int i = 0; i < 3; ++i) {
+      dx += tri.ea[i] * s[i].attr[k];
+      dy += tri.eb[i] * s[i].attr[k];
+    }
+    tri.pc[k] = s[0].attr[k];
+    tri.pdx[k] = dx * inva;
+    tri.pdy[k] = dy * inva;
+  }
+
+  const uint32_t id = ch.tris.size();
+  ch.tris.push_back(tri);
+
+  const int tx0 = tri.min_x / TILE_SIZE, tx1 = (tri.max_x - 1) / TILE_SIZE;
+  const int ty0 = tri.min_y / TILE_SIZE, ty1 = (tri.max_y - 1) / TILE_SIZE;
+  for(int ty = ty0; ty <= ty1; ++ty)
+    for(int tx = tx0; tx <= tx1; ++tx)
+      ch.bins[ty * tiles_x_ + tx].push_back(id);
+}
+
+void
+HaruhiSoftRasterizer::runRasterStage() noexcept {
+  const size_t ntiles = (size_t)tiles_x_ * tiles_y_;
+  std::vector<uint64_t> frags(ntiles, 0);
+  parallel(ntiles, 1, [&](size_t b, size_t e) {
+    for(size_t t = b; t < e; ++t)
+      frags[t] = rasterTile(t);
+  });
+  for(auto it : frags)
+    timings_.fragments += it;
+}
+
+// four horizontal pixels per step, texture fetches are the only scalar part
+uint64_t
+HaruhiSoftRasterizer::rasterTile(unsigned tile) noexcept {
+  using namespace math::vec;
+
+  const int tx0 = (tile % tiles_x_) * TILE_SIZE;
+  const int ty0 = (tile / tiles_x_) * TILE_SIZE;
+  const int tx1 = std::min<int>(tx0 + TILE_SIZE, width_);
+  const int ty1 = std::min<int>(ty0 + TILE_SIZE, height_);
+
+  const auto& lut = color::srgb();
+  const Texture& tex = *p_texture_;
+  const v4 texw = splat((float)tex.width), texh = splat((float)tex.height);
+
+  const math::float3 l = math::normalize(math::float3(1., 1., .8));
+  const v4 lx = splat(l.x), ly = splat(l.y), lz = splat(l.z);
+  const v4 zero = splat(0.f), one = splat(1.f), ambient = splat(.1f);
+  const v4 lane_ofs = set(.5f, 1.5f, 2.5f, 3.5f);
+  const v4 d16 = splat(65535.f);
+
+  uint64_t shaded = 0;
+
+  for(auto& ch : chunks_) {
+    if(ch.bins.empty()) continue;
+    for(uint32_t id : ch.bins[tile]) {
+      const Tri& tri = ch.tris[id];
+
+      const int x0 = std::max(tri.min_x, tx0) & ~3;
+      const int x1 = std::min(tri.max_x, tx1);
+      const int y0 = std::max(tri.min_y, ty0);
+      const int y1 = std::min(tri.max_y, ty1);
+
+      v4 ea[3], eox[3];
+      bool tl[3];
+      for(int i = 0; i < 3; ++i) {
+        ea[i] = splat(tri.ea[i]);
+        eox[i] = splat(tri.eox[i]);
+        tl[i] = tri.top_left[i];
+      }
+      v4 pdx[PLANE_COUNT];
+      for(int k = 0; k < PLANE_COUNT; ++k)
+        pdx[k] = splat(tri.pdx[k]);
+      const v4 minx = splat((float)tri.min_x), maxx = splat((float)x1);
+
+      for(int y = y0; y < y1; ++y) {
+        const float fy = y + .5f;
+        v4 edy[3];
+        for(int i = 0; i < 3; ++i)
+          edy[i] = splat(tri.eb[i] * (fy - tri.eoy[i]));
+        v4 prow[PLANE_COUNT];
+        for(int k = 0; k < PLANE_COUNT; ++k)
+          prow[k] = splat(tri.pc[k] + tri.pdy[k] * (fy - tri.y0));
+
+        uint32_t* crow = &color_[(size_t)y * stride_];
+        uint16_t* drow = &depth_[(size_t)y * stride_];
+
+        for(int x = x0; x < x1; x += 4) {
+          const v4 xs = add(splat((float)x), lane_ofs);
+
+          v4 cover = and_(cmpge(xs, minx), cmplt(xs, maxx));
+          for(int i = 0; i < 3; ++i) {
+            const v4 e = madd(ea[i], sub(xs, eox[i]), edy[i]);
+            cover = and_(cover, tl[i] ? cmpge(e, zero) : cmpgt(e, zero));
+          }
+          int mask = movemask(cover);
+          if(!mask) continue;
+
+          const v4 dxs = sub(xs, splat(tri.x0));
+          auto plane = [&](int k) { return madd(pdx[k], dxs, prow[k]); };
+
+          // Depth16Unorm, less
+          const v4 z = min(max(plane(PLANE_Z), zero), one);
+          alignas(16) float zq[4];
+          store(zq, madd(z, d16, splat(.5f)));
+          for(int i = 0; i < 4; ++i) {
+            if(!(mask >> i & 1)) continue;
+            const uint16_t q = (uint16_t)zq[i];
+            if(q < drow[x + i]) drow[x + i] = q;
+            else mask &= ~(1 << i);
+          }
+          if(!mask) continue;
+
+          const v4 w = div(one, plane(PLANE_INVW));
+          const v4 u = mul(plane(PLANE_U), w);
+          const v4 v = mul(plane(PLANE_V), w);
+          const v4 nx = mul(plane(PLANE_NX), w);
+          const v4 ny = mul(plane(PLANE_NY), w);
+          const v4 nz = mul(plane(PLANE_NZ), w);
+
+          // saturate(dot(normalize(n), l))
+          const v4 nn = madd(nx, nx, madd(ny, ny, mul(nz, nz)));
+          const v4 ndl = madd(nx, lx, madd(ny, ly, mul(nz, lz)));
+          const v4 ndotl = min(max(div(ndl, sqrt(nn)), zero), one);
+          const v4 illum = add(ambient, ndotl);
+
+          // nearest + repeat
+          alignas(16) float fu[4], fv[4], fl[4];
+          store(fu, mul(sub(u, floor(u)), texw));
+          store(fv, mul(sub(v, floor(v)), texh));
+          store(fl, illum);
+
+          for(int i = 0; i < 4; ++i) {
+            if(!(mask >> i & 1)) continue;
+            const uint32_t tu = std::min<uint32_t>((uint32_t)fu[i], tex.width - 1);
+            const uint32_t tv = std::min<uint32_t>((uint32_t)fv[i], tex.height - 1);
+            const uint8_t* texel = &tex.rgba[((size_t)tv * tex.width + tu) * 4];
+            crow[x + i] =
+              lut.toSrgb(lut.decode[texel[0]] * fl[i])
+              | lut.toSrgb(lut.decode[texel[1]] * fl[i]) << 8
+              | lut.toSrgb(lut.decode[texel[2]] * fl[i]) << 16
+              | 0xFF000000u;
+            ++shaded;
+          }
+        }
+      }
+    }
+  }
+  return shaded;
+}
+
+std::vector<uint8_t>
+HaruhiSoftRasterizer::readPixels() const {
+  std::vector<uint8_t> out((size_t)width_ * height_ * 4);
+  for(uint32_t y = 0; y < height_; ++y)
+    memcpy(&out[(size_t)y * width_ * 4], &color_[(size_t)y * stride_], width_ * 4);
+  return out;
+}
+
+uint16_t
+HaruhiSoftRasterizer::depthAt(uint32_t x, uint32_t y) const noexcept {
+  assert(x < width_ && y < height_);
+  return depth_[(size_t)y * stride_ + x];
+}
+
+bool
+HaruhiSoftRasterizer::writePPM(const char* pth) const noexcept {
+  FILE* fp = fopen(pth, "wb");
+  if(!fp) return false;
+
+  fprintf(fp, "P6\n%u %u\n255\n", width_, height_);
+  std::vector<uint8_t> row(width_ * 3);
+  for(uint32_t y = 0; y < height_; ++y) {
+    for(uint32_t x = 0; x < width_; ++x) {
+      const uint32_t px = color_[(size_t)y * stride_ + x];
+      row[x * 3 + 0] = px & 0xFF;
+      row[x * 3 + 1] = px >> 8 & 0xFF;
+      row[x * 3 + 2] = px >> 16 & 0xFF;
+    }
+    fwrite(row.data(), 1, row.size(), fp);
+  }
+  return fclose(fp) == 0;
+}
\ No newline at end of file
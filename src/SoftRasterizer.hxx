@@ -0,0 +1,96 @@
+#ifndef HARUHI_SOFTRASTERIZER_HXX
+#define HARUHI_SOFTRASTERIZER_HXX
+
+#include <cstdint>
+#include <vector>
+
+#include "ShaderTypes.hxx"
+
+class HaruhiWorkerPool;
+
+// cpu reference of the fn_vertex/fn_frag pipeline in HaruhiRenderer
+// ccw front faces with back face culling, Depth16Unorm less compare,
+// nearest/repeat sampling of an RGBA8 sRGB texture and the N.L light,
+// rendered into an sRGB encoded RGBA8 target
+class HaruhiSoftRasterizer {
+public:
+  static constexpr unsigned TILE_SIZE = 64;
+
+  struct Texture {
+    uint32_t width, height;
+    const uint8_t* rgba;
+  };
+
+  struct DrawCall {
+    const shader_t::VertexData* vertices;
+    size_t vertexCount;
+    const uint16_t* indices;
+    size_t indexCount;
+    const shader_t::InstanceData* instances;
+    size_t instanceCount;
+    const shader_t::CameraData* camera;
+    const Texture* texture;
+  };
+
+  // accumulated over draw calls until resetTimings
+  struct Timings {
+    double vertexMs, setupMs, rasterMs;
+    uint64_t triangles, culled, clipped, fragments;
+  };
+
+private:
+  struct ClipVertex {
+    math::float4 pos;
+    math::float3 norm;
+    math::float2 texcoord;
+  };
+
+  struct Tri;
+  struct Chunk;
+
+  uint32_t width_, height_, stride_;
+  uint32_t tiles_x_, tiles_y_;
+
+  std::vector<uint32_t> color_;
+  std::vector<uint16_t> depth_;
+
+  std::vector<ClipVertex> clip_verts_;
+  std::vector<Chunk> chunks_;
+
+  HaruhiWorkerPool* p_pool_;
+  const Texture* p_texture_;
+  Timings timings_;
+
+  void runVertexStage(const DrawCall&) noexcept;
+  void runSetupStage(const DrawCall&) noexcept;
+  void runRasterStage() noexcept;
+
+  void setupTriangle(Chunk&, const ClipVertex&, const ClipVertex&, const ClipVertex&) noexcept;
+  uint64_t rasterTile(unsigned) noexcept;
+
+  template <typename Fn>
+  void parallel(size_t, size_t, const Fn&) noexcept;
+
+public:
+  HaruhiSoftRasterizer(uint32_t, uint32_t, HaruhiWorkerPool* = nullptr);
+  ~HaruhiSoftRasterizer();
+
+  uint32_t width() const noexcept { return width_; }
+  uint32_t height() const noexcept { return height_; }
+
+  // linear clear color like MTL::ClearColor on an sRGB target
+  void clear(const math::float4&, float = 1.f) noexcept;
+  void draw(const DrawCall&) noexcept;
+
+  // RGBA8, sRGB encoded, rows of width() pixels
+  std::vector<uint8_t> readPixels() const;
+  uint16_t depthAt(uint32_t, uint32_t) const noexcept;
+
+  // binary ppm, rgb only
+  bool writePPM(const char*) const noexcept;
+
+  const Timings& timings() const noexcept { return timings_; }
+  void resetTimings() noexcept;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include "Terrain.hxx"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "Profiler.hxx"
+#include "WorkerPool.hxx"
+
+namespace {
+
+using voxel::Block;
+constexpr int S = voxel::CHUNK_SIZE;
+// grass or sand on top, then this many blocks of dirt or sand over stone
+constexpr int SOIL_DEPTH = 3;
+// cave noise lattice spacing in blocks, divides CHUNK_SIZE
+constexpr int CAVE_STEP = 4;
+
+// surface height of every (x, z) of a chunk column, x fastest
+void
+heightmap(const terrain::Settings& s, int cx, int cz, int* pOut) noexcept {
+  float x[S], z[S], h[S];
+  for(int i = 0; i < S; ++i) x[i] = float(cx * S + i);
+  for(int j = 0; j < S; ++j) {
+    std::fill(z, z + S, float(cz * S + j));
+    noise::sample2(s.ground, s.seed, x, z, h, S);
+    for(int i = 0; i < S; ++i) pOut[j * S + i] = int(std::floor(s.base + s.amplitude * h[i]));
+  }
+}
+
+void
+fill(const terrain::Settings& s, const voxel::ChunkCoord& c, const int* pHeights, Block* pBlocks) noexcept {
+  const int y0 = c.y * S;
+  int tops[S];
+  int top = INT_MIN;
+  for(int z = 0; z < S; ++z) {
+    tops[z] = *std::max_element(pHeights + z * S, pHeights + (z + 1) * S);
+    top = std::max(top, tops[z]);
+  }
+  memset(pBlocks, 0, voxel::CHUNK_VOLUME * sizeof(Block));
+  if(top < y0) return;
+
+  // a row of x at a time, the rows above the surface stay air
+  for(int z = 0; z < S; ++z) {
+    const int* h = pHeights + z * S;
+    Block surface[S], soil[S];
+    for(int x = 0; x < S; ++x) {
+      const bool shore = h[x] <= s.shore;
+      surface[x] = shore ? voxel::BLOCK_SAND : voxel::BLOCK_GRASS;
+      soil[x] = shore ? voxel::BLOCK_SAND : voxel::BLOCK_DIRT;
+    }
+    for(int y = 0; y < S && y0 + y <= tops[z]; ++y) {
+      Block* row = pBlocks + (z * S + y) * S;
+      for(int x = 0; x < S; ++x) {
+        const int depth = h[x] - (y0 + y);
+        row[x] = depth < 0 ? Block(voxel::BLOCK_AIR) : depth == 0 ? surface[x]
+               : depth <= SOIL_DEPTH ? soil[x] : Block(voxel::BLOCK_STONE);
+      }
+    }
+  }
+
+  if(s.caveWidth <= 0.f) return;
+  // the cave field is smooth at block scale, it is sampled on a lattice
+  // every CAVE_STEP blocks, all of it in one batch, and interpolated.
+  // lattice points sit on world multiples of the step, so chunks agree
+  constexpr int G = S / CAVE_STEP + 1;
+  float x[G * G * G], y[G * G * G], z[G * G * G], n[G * G * G];
+  for(int k = 0, i = 0; k < G; ++k)
+    for(int j = 0; j < G; ++j)
+      for(int l = 0; l < G; ++l, ++i) {
+        x[i] = float(c.x * S + l * CAVE_STEP);
+        y[i] = float(y0 + j * CAVE_STEP);
+        z[i] = float(c.z * S + k * CAVE_STEP);
+      }
+  noise::sample3(s.caves, s.seed + 1, x, y, z, n, G * G * G);
+
+  // lattice rows widened to blocks along x first, then blended along y
+  // and z a block row at a time
+  constexpr float STEP = 1.f / CAVE_STEP;
+  float rows[G * G][S];
+  for(int r = 0; r < G * G; ++r)
+    for(int xi = 0; xi < S; ++xi) {
+      const float* p = n + r * G + xi / CAVE_STEP;
+      rows[r][xi] = p[0] + (p[1] - p[0]) * ((xi % CAVE_STEP) * STEP);
+    }
+  for(int zi = 0; zi < S; ++zi) {
+    const int k = zi / CAVE_STEP;
+    const float tz = (zi % CAVE_STEP) * STEP;
+    for(int yi = 0; yi < S && y0 + yi <= tops[zi]; ++yi) {
+      const int j = yi / CAVE_STEP;
+      const float ty = (yi % CAVE_STEP) * STEP;
+      const float* a0 = rows[k * G + j], * a1 = rows[k * G + j + 1];
+      const float* b0 = rows[(k + 1) * G + j], * b1 = rows[(k + 1) * G + j + 1];
+      Block* row = pBlocks + (zi * S + yi) * S;
+      for(int xi = 0; xi < S; ++xi) {
+        const float a = a0[xi] + (a1[xi] - a0[xi]) * ty;
+        const float b = b0[xi] + (b1[xi] - b0[xi]) * ty;
+        const float v = a + (b - a) * tz;
+        row[xi] = std::abs(v) < s.caveWidth ? Block(voxel::BLOCK_AIR) : row[xi];
+      }
+    }
+  }
+}
+
+} // ns
+
+namespace terrain {
+
+void
+generateChunk(const Settings& s, const voxel::ChunkCoord& c, voxel::Block* pBlocks) noexcept {
+  int heights[voxel::CHUNK_AREA];
+  heightmap(s, c.x, c.z, heights);
+  fill(s, c, heights, pBlocks);
+}
+
+size_t
+generate(const Settings& s, HaruhiVoxelWorld& world, const voxel::ChunkCoord* pCoords, size_t count,
+         HaruhiWorkerPool* pPool) {
+  HARUHI_PROFILE_SCOPE("terrain::generate");
+  struct Job {
+    voxel::ChunkCoord coord;
+    voxel::BlockStorage* pBlocks;
+  };
+
+  // columns together, each chunk once
+  std::vector<voxel::ChunkCoord> coords(pCoords, pCoords + count);
+  std::sort(coords.begin(), coords.end(), [](const voxel::ChunkCoord& a, const voxel::ChunkCoord& b) {
+    return a.x != b.x ? a.x < b.x : a.z != b.z ? a.z < b.z : a.y < b.y;
+  });
+  coords.erase(std::unique(coords.begin(), coords.end()), coords.end());
+
+  // the world's table isn't safe to grow from the jobs, chunks are made here
+  std::vector<Job> jobs(coords.size());
+  std::vector<size_t> columns;
+  for(size_t i = 0; i < coords.size(); ++i) {
+    jobs[i] = { coords[i], &world.edit(coords[i]) };
+    if(!i || coords[i].x != coords[i - 1].x || coords[i].z != coords[i - 1].z) columns.push_back(i);
+  }
+  columns.push_back(jobs.size());
+
+  // filled dense, then packed into the chunk's palette
+  auto run = [&](size_t b, size_t e) {
+    int heights[voxel::CHUNK_AREA];
+    thread_local std::unique_ptr<Block[]> blocks;
+    if(!blocks) blocks = std::make_unique<Block[]>(voxel::CHUNK_VOLUME);
+    for(size_t c = b; c < e; ++c) {
+      heightmap(s, jobs[columns[c]].coord.x, jobs[columns[c]].coord.z, heights);
+      for(size_t j = columns[c]; j < columns[c + 1]; ++j) {
+        fill(s, jobs[j].coord, heights, blocks.get());
+        jobs[j].pBlocks->assign(blocks.get());
+      }
+    }
+  };
+  const size_t n = columns.size() - 1;
+  if(pPool) pPool->parallelFor(n, 1, run);
+  else run(0, n);
+  return jobs.size();
+}
+
+} // ns terrain
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef HARUHI_TERRAIN_HXX
+#define HARUHI_TERRAIN_HXX
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Noise.hxx"
+#include "VoxelWorld.hxx"
+
+class HaruhiWorkerPool;
+
+// procedural chunk population, the stage in front of meshing
+//
+// a column of chunks shares one heightmap, a domain warped fbm sampled
+// a row of blocks per batch. below the surface grass, dirt and stone
+// layer down, sand near the shore, and a 3d fbm carves caves where it
+// is close to zero. the blocks are a function of the settings and the
+// chunk coordinate only, so chunks can be generated in any order
+namespace terrain {
+
+struct Settings {
+  uint32_t seed = 1;
+  // surface height in blocks, base + amplitude * ground
+  float base = 0.f;
+  float amplitude = 24.f;
+  noise::Fractal ground = { noise::KIND_SIMPLEX, 5, 1.f / 256.f, 2.f, .5f, 24.f };
+  // surfaces up to this height are sand instead of grass and dirt
+  float shore = -12.f;
+  // 0 turns caves off
+  noise::Fractal caves = { noise::KIND_SIMPLEX, 2, 1.f / 48.f, 2.f, .5f, 0.f };
+  float caveWidth = .06f;
+};
+
+// every block of the chunk, x fastest
+void generateChunk(const Settings&, const voxel::ChunkCoord&, voxel::Block*) noexcept;
+
+// creates the chunks in the world, queueing them for remesh, and fills
+// them on the pool a column at a time. returns how many were generated
+size_t generate(const Settings&, HaruhiVoxelWorld&, const voxel::ChunkCoord*, size_t,
+                HaruhiWorkerPool* = nullptr);
+
+} // ns terrain
+
+#endif
\ No newline at end of file
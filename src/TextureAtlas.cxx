@@ -0,0 +1,214 @@
+#include "TextureAtlas.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "WorkerPool.hxx"
+
+HaruhiTextureAtlas::HaruhiTextureAtlas(uint32_t pageSize, uint32_t padding)
+  : page_size_(pageSize), padding_(padding) {
+  assert(pageSize > 2 * padding);
+}
+
+bool
+HaruhiTextureAtlas::add(const std::string& name, uint32_t width, uint32_t height,
+                        const void* rgba, size_t rowPitch) {
+  if(width == 0 || height == 0
+     || width + 2 * padding_ > page_size_ || height + 2 * padding_ > page_size_)
+    return false;
+  if(!index_.emplace(name, (uint32_t)sprites_.size()).second)
+    return false;
+
+  sprites_.push_back({ name, width, height,
+    static_cast<const uint8_t*>(rgba), rowPitch ? rowPitch : (size_t)width * 4 });
+  return true;
+}
+
+// lowest y a w x h cell can rest at when its left edge is on segment i
+bool
+HaruhiTextureAtlas::fit(const std::vector<Segment>& sky, size_t i,
+                        uint32_t w, uint32_t h, uint32_t& y) const noexcept {
+  if(sky[i].x + w > page_size_) return false;
+
+  y = 0;
+  int64_t left = w;
+  for(size_t j = i; left > 0; ++j) {
+    y = std::max(y, sky[j].y);
+    if(y + h > page_size_) return false;
+    left -= sky[j].width;
+  }
+  return true;
+}
+
+void
+HaruhiTextureAtlas::place(std::vector<Segment>& sky, size_t i,
+                          uint32_t w, uint32_t h, uint32_t y) noexcept {
+  const Segment top = { sky[i].x, y + h, w };
+  sky.insert(sky.begin() + i, top);
+
+  // cut away what the new segment shadows
+  const uint32_t end = top.x + top.width;
+  size_t j = i + 1;
+  while(j < sky.size() && sky[j].x < end) {
+    const uint32_t over = end - sky[j].x;
+    if(over >= sky[j].width) {
+      sky.erase(sky.begin() + j);
+    } else {
+      sky[j].x += over;
+      sky[j].width -= over;
+      break;
+    }
+  }
+
+  // merge neighbours of the same height
+  for(size_t k = i ? i - 1 : 0; k + 1 < sky.size() && k <= i + 1;) {
+    if(sky[k].y == sky[k + 1].y) {
+      sky[k].width += sky[k + 1].width;
+      sky.erase(sky.begin() + k + 1);
+    } else {
+      ++k;
+    }
+  }
+}
+
+void
+HaruhiTextureAtlas::pack() noexcept {
+  const size_t n = sprites_.size();
+
+  std::vector<uint32_t> order(n);
+  for(uint32_t i = 0; i < n; ++i) order[i] = i;
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    const Sprite& sa = sprites_[a];
+    const Sprite& sb = sprites_[b];
+    if(sa.height != sb.height) return sa.height > sb.height;
+    if(sa.width != sb.width) return sa.width > sb.width;
+    return a < b;
+  });
+
+  skylines_.clear();
+  pages_.clear();
+  regions_.assign(n, {});
+
+  const float inv = 1.f / page_size_;
+  for(uint32_t s : order) {
+    const uint32_t w = sprites_[s].width + 2 * padding_;
+    const uint32_t h = sprites_[s].height + 2 * padding_;
+
+    uint32_t best_page = 0, best_y = 0;
+    size_t best_seg = SIZE_MAX;
+    for(uint32_t p = 0; p < skylines_.size() && best_seg == SIZE_MAX; ++p) {
+      const auto& sky = skylines_[p];
+      uint32_t best_top = UINT32_MAX;
+      for(size_t i = 0; i < sky.size(); ++i) {
+        uint32_t y;
+        if(fit(sky, i, w, h, y) && y + h < best_top) {
+          best_top = y + h;
+          best_page = p;
+          best_seg = i;
+          best_y = y;
+        }
+      }
+    }
+    if(best_seg == SIZE_MAX) {
+      skylines_.push_back({ { 0, 0, page_size_ } });
+      best_page = (uint32_t)skylines_.size() - 1;
+      best_seg = 0;
+      best_y = 0;
+    }
+
+    auto& sky = skylines_[best_page];
+    Region& r = regions_[s];
+    r.layer = best_page;
+    r.x = sky[best_seg].x + padding_;
+    r.y = best_y + padding_;
+    r.width = sprites_[s].width;
+    r.height = sprites_[s].height;
+    r.uvMin = { r.x * inv, r.y * inv };
+    r.uvMax = { (r.x + r.width) * inv, (r.y + r.height) * inv };
+
+    place(sky, best_seg, w, h, best_y);
+  }
+}
+
+// sprite plus its gutter, clamped to the sprite edge
+void
+HaruhiTextureAtlas::blit(uint32_t s) noexcept {
+  const Sprite& sp = sprites_[s];
+  if(!sp.rgba) return;
+
+  const Region& r = regions_[s];
+  const size_t pitch = (size_t)page_size_ * 4;
+  const int pad = (int)padding_;
+  uint8_t* page = pages_[r.layer].data();
+
+  for(int dy = -pad; dy < (int)r.height + pad; ++dy) {
+    const int sy = std::clamp(dy, 0, (int)r.height - 1);
+    const uint8_t* src = sp.rgba + sy * sp.rowPitch;
+    uint8_t* dst = page + (r.y + dy) * pitch + (r.x - padding_) * 4;
+
+    for(int g = 0; g < pad; ++g)
+      memcpy(dst + g * 4, src, 4);
+    dst += pad * 4;
+    memcpy(dst, src, (size_t)r.width * 4);
+    dst += (size_t)r.width * 4;
+    for(int g = 0; g < pad; ++g)
+      memcpy(dst + g * 4, src + (r.width - 1) * 4, 4);
+  }
+}
+
+void
+HaruhiTextureAtlas::compose(HaruhiWorkerPool* pPool) {
+  assert(regions_.size() == sprites_.size());
+
+  // pages keep their storage across composes
+  pages_.resize(skylines_.size());
+  auto clear = [this](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i)
+      pages_[i].assign((size_t)page_size_ * page_size_ * 4, 0);
+  };
+
+  // cells never overlap, so sprites can be copied in any order
+  auto fn = [this](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i)
+      blit((uint32_t)i);
+  };
+
+  if(pPool) {
+    pPool->parallelFor(pages_.size(), 1, clear);
+    pPool->parallelFor(sprites_.size(), 64, fn);
+  } else {
+    clear(0, pages_.size());
+    fn(0, sprites_.size());
+  }
+}
+
+const HaruhiTextureAtlas::Region*
+HaruhiTextureAtlas::find(const std::string& name) const noexcept {
+  auto it = index_.find(name);
+  if(it == index_.end() || it->second >= regions_.size()) return nullptr;
+  return &regions_[it->second];
+}
+
+double
+HaruhiTextureAtlas::occupancy() const noexcept {
+  if(skylines_.empty()) return 0.;
+  double used = 0.;
+  for(auto& r : regions_)
+    used += (double)r.width * r.height;
+  return used / ((double)page_size_ * page_size_ * skylines_.size());
+}
+
+namespace atlas {
+
+void
+remapTexcoords(const HaruhiTextureAtlas::Region& r, shader_t::VertexData* pVerts, size_t n) noexcept {
+  const float du = r.uvMax.x - r.uvMin.x;
+  const float dv = r.uvMax.y - r.uvMin.y;
+  for(size_t i = 0; i < n; ++i) {
+    math::float2& tc = pVerts[i].texcoord;
+    tc = { r.uvMin.x + tc.x * du, r.uvMin.y + tc.y * dv };
+  }
+}
+
+} // ns atlas
\ No newline at end of file
@@ -0,0 +1,89 @@
+#ifndef HARUHI_TEXTUREATLAS_HXX
+#define HARUHI_TEXTUREATLAS_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ShaderTypes.hxx"
+
+class HaruhiWorkerPool;
+
+// packs many small RGBA8 images into square pages of one size, so the pages
+// can be bound as separate textures or as the layers of one array texture
+//
+// skyline bottom-left packing, tallest first. every sprite gets a gutter of
+// padding pixels filled with its clamped edge, a gutter of p keeps sampling
+// clean down to mip level log2(p)
+class HaruhiTextureAtlas {
+public:
+  struct Region {
+    uint32_t layer;
+    uint32_t x, y, width, height; // texels, without the gutter
+    math::float2 uvMin, uvMax;
+  };
+
+private:
+  struct Sprite {
+    std::string name;
+    uint32_t width, height;
+    const uint8_t* rgba;
+    size_t rowPitch;
+  };
+
+  struct Segment {
+    uint32_t x, y, width;
+  };
+
+  uint32_t page_size_, padding_;
+
+  std::vector<Sprite> sprites_;
+  std::vector<Region> regions_;
+  std::unordered_map<std::string, uint32_t> index_;
+
+  std::vector<std::vector<Segment>> skylines_;
+  std::vector<std::vector<uint8_t>> pages_;
+
+  bool fit(const std::vector<Segment>&, size_t, uint32_t, uint32_t, uint32_t&) const noexcept;
+  void place(std::vector<Segment>&, size_t, uint32_t, uint32_t, uint32_t) noexcept;
+  void blit(uint32_t) noexcept;
+
+public:
+  explicit HaruhiTextureAtlas(uint32_t = 2048, uint32_t = 2);
+
+  // pixels are only read by compose and must stay alive until then,
+  // nullptr reserves space only. false on a duplicate name or a sprite
+  // that can never fit a page
+  bool add(const std::string&, uint32_t, uint32_t,
+           const void* = nullptr, size_t = 0);
+
+  // lays out every added sprite, forgets the previous layout
+  void pack() noexcept;
+  // renders the pages, sprites are copied in parallel on the pool
+  void compose(HaruhiWorkerPool* = nullptr);
+
+  uint32_t pageSize() const noexcept { return page_size_; }
+  uint32_t pageCount() const noexcept { return (uint32_t)skylines_.size(); }
+  size_t spriteCount() const noexcept { return sprites_.size(); }
+
+  // RGBA8 rows of pageSize() * 4 bytes, valid after compose
+  const uint8_t* pageData(uint32_t i) const noexcept { return pages_[i].data(); }
+
+  // valid after pack, nullptr for unknown names
+  const Region* find(const std::string&) const noexcept;
+  const Region& region(size_t i) const noexcept { return regions_[i]; }
+
+  // fraction of page area covered by sprites, gutters excluded
+  double occupancy() const noexcept;
+};
+
+namespace atlas {
+
+// maps 0..1 texcoords of a mesh onto the region
+void remapTexcoords(const HaruhiTextureAtlas::Region&, shader_t::VertexData*, size_t) noexcept;
+
+} // ns atlas
+
+#endif
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include "TransformStore.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+
+#include "WorkerPool.hxx"
+
+namespace {
+
+constexpr size_t WORD_BITS = 64;
+// instances per worker chunk is WORD_GRAIN * WORD_BITS
+constexpr size_t WORD_GRAIN = 16;
+
+size_t
+wordCount(size_t n) noexcept {
+  return (n + WORD_BITS - 1) / WORD_BITS;
+}
+
+template <typename T>
+void
+atomicMin(std::atomic<T>& a, T v) noexcept {
+  T cur = a.load(std::memory_order_relaxed);
+  while(v < cur && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed));
+}
+
+template <typename T>
+void
+atomicMax(std::atomic<T>& a, T v) noexcept {
+  T cur = a.load(std::memory_order_relaxed);
+  while(v > cur && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed));
+}
+
+} // ns
+
+HaruhiTransformStore::HaruhiTransformStore(unsigned targets)
+: dirty_(targets ? targets : 1), size_(0)
+{
+  ;
+}
+
+void
+HaruhiTransformStore::grow(size_t n) {
+  // arrays stay a multiple of one dirty word so the kernel never reads past them
+  const size_t cap = wordCount(n) * WORD_BITS;
+  if(cap <= px_.size()) return;
+
+  for(auto* it : { &px_, &py_, &pz_, &qx_, &qy_, &qz_ })
+    it->resize(cap, 0.f);
+  for(auto* it : { &qw_, &sx_, &sy_, &sz_ })
+    it->resize(cap, 1.f);
+  color_.resize(cap);
+  for(auto& it : dirty_)
+    it.resize(wordCount(cap), 0);
+}
+
+void
+HaruhiTransformStore::markDirty(Index i) noexcept {
+  const uint64_t bit = uint64_t(1) << (i % WORD_BITS);
+  for(auto& it : dirty_)
+    it[i / WORD_BITS] |= bit;
+}
+
+HaruhiTransformStore::Index
+HaruhiTransformStore::add(const math::float3& p, const math::quat& q,
+                          const math::float3& s, const math::float4& c) {
+  const Index i = size_++;
+  grow(size_);
+  px_[i] = p.x; py_[i] = p.y; pz_[i] = p.z;
+  qx_[i] = q.x; qy_[i] = q.y; qz_[i] = q.z; qw_[i] = q.w;
+  sx_[i] = s.x; sy_[i] = s.y; sz_[i] = s.z;
+  color_[i] = c;
+  markDirty(i);
+  return i;
+}
+
+HaruhiTransformStore::Index
+HaruhiTransformStore::remove(Index i) noexcept {
+  assert(i < size_);
+  const Index last = --size_;
+  if(i != last) {
+    for(auto* it : { &px_, &py_, &pz_, &qx_, &qy_, &qz_, &qw_, &sx_, &sy_, &sz_ })
+      (*it)[i] = (*it)[last];
+    color_[i] = color_[last];
+    markDirty(i);
+  }
+  for(auto& it : dirty_)
+    it[last / WORD_BITS] &= ~(uint64_t(1) << (last % WORD_BITS));
+  return last;
+}
+
+void
+HaruhiTransformStore::clear() noexcept {
+  size_ = 0;
+  for(auto& it : dirty_)
+    std::fill(it.begin(), it.end(), 0);
+}
+
+void
+HaruhiTransformStore::setPosition(Index i, const math::float3& p) noexcept {
+  assert(i < size_);
+  px_[i] = p.x; py_[i] = p.y; pz_[i] = p.z;
+  markDirty(i);
+}
+
+void
+HaruhiTransformStore::setRotation(Index i, const math::quat& q) noexcept {
+  assert(i < size_);
+  qx_[i] = q.x; qy_[i] = q.y; qz_[i] = q.z; qw_[i] = q.w;
+  markDirty(i);
+}
+
+void
+HaruhiTransformStore::setScale(Index i, const math::float3& s) noexcept {
+  assert(i < size_);
+  sx_[i] = s.x; sy_[i] = s.y; sz_[i] = s.z;
+  markDirty(i);
+}
+
+void
+HaruhiTransformStore::setColor(Index i, const math::float4& c) noexcept {
+  assert(i < size_);
+  color_[i] = c;
+  markDirty(i);
+}
+
+math::float3
+HaruhiTransformStore::position(Index i) const noexcept {
+  return { px_[i], py_[i], pz_[i] };
+}
+
+math::quat
+HaruhiTransformStore::rotation(Index i) const noexcept {
+  return { qx_[i], qy_[i], qz_[i], qw_[i] };
+}
+
+math::float3
+HaruhiTransformStore::scale(Index i) const noexcept {
+  return { sx_[i], sy_[i], sz_[i] };
+}
+
+void
+HaruhiTransformStore::markAllDirty() noexcept {
+  for(auto& it : dirty_) {
+    std::fill(it.begin(), it.end(), ~uint64_t(0));
+    if(size_ % WORD_BITS)
+      it[size_ / WORD_BITS] = (uint64_t(1) << (size_ % WORD_BITS)) - 1;
+    std::fill(it.begin() + wordCount(size_), it.end(), 0);
+  }
+}
+
+bool
+HaruhiTransformStore::isDirty(unsigned target, Index i) const noexcept {
+  return (dirty_[target][i / WORD_BITS] >> (i % WORD_BITS)) & 1;
+}
+
+// composes four instances per step: rotation * scale from the quaternion,
+// then a 4x4 transpose turns the lanes back into per instance columns
+size_t
+HaruhiTransformStore::composeWords(shader_t::InstanceData* dst, uint64_t* words,
+                                   size_t wbegin, size_t wend,
+                                   size_t& first, size_t& last) const noexcept {
+  using namespace math::vec;
+  using math::vec::add; // shadowed by the member otherwise
+
+  const v4 one = splat(1.f), two = splat(2.f), zero = splat(0.f);
+  size_t composed = 0;
+
+  for(size_t w = wbegin; w < wend; ++w) {
+    uint64_t bits = words[w];
+    if(!bits) continue;
+    words[w] = 0;
+
+    while(bits) {
+      const unsigned g = std::countr_zero(bits) / 4;
+      const uint64_t nib = (bits >> (4 * g)) & 0xF;
+      bits &= ~(uint64_t(0xF) << (4 * g));
+
+      const size_t base = w * WORD_BITS + 4 * g;
+      composed += std::popcount(nib);
+      if(base < first) first = base;
+
+      const v4 qx = loadu(&qx_[base]), qy = loadu(&qy_[base]);
+      const v4 qz = loadu(&qz_[base]), qw = loadu(&qw_[base]);
+      const v4 sx = loadu(&sx_[base]), sy = loadu(&sy_[base]), sz = loadu(&sz_[base]);
+
+      const v4 xx = mul(qx, qx), yy = mul(qy, qy), zz = mul(qz, qz);
+      const v4 xy = mul(qx, qy), xz = mul(qx, qz), yz = mul(qy, qz);
+      const v4 wx = mul(qw, qx), wy = mul(qw, qy), wz = mul(qw, qz);
+
+      v4 c0x = mul(sub(one, mul(two, add(yy, zz))), sx);
+      v4 c0y = mul(mul(two, add(xy, wz)), sx);
+      v4 c0z = mul(mul(two, sub(xz, wy)), sx);
+      v4 c0w = zero;
+
+      v4 c1x = mul(mul(two, sub(xy, wz)), sy);
+      v4 c1y = mul(sub(one, mul(two, add(xx, zz))), sy);
+      v4 c1z = mul(mul(two, add(yz, wx)), sy);
+      v4 c1w = zero;
+
+      v4 c2x = mul(mul(two, add(xz, wy)), sz);
+      v4 c2y = mul(mul(two, sub(yz, wx)), sz);
+      v4 c2z = mul(sub(one, mul(two, add(xx, yy))), sz);
+      v4 c2w = zero;
+
+      v4 c3x = loadu(&px_[base]), c3y = loadu(&py_[base]), c3z = loadu(&pz_[base]);
+      v4 c3w = one;
+
+      transpose(c0x, c0y, c0z, c0w);
+      transpose(c1x, c1y, c1z, c1w);
+      transpose(c2x, c2y, c2z, c2w);
+      transpose(c3x, c3y, c3z, c3w);
+
+      const v4 c0[4] = { c0x, c0y, c0z, c0w };
+      const v4 c1[4] = { c1x, c1y, c1z, c1w };
+      const v4 c2[4] = { c2x, c2y, c2z, c2w };
+      const v4 c3[4] = { c3x, c3y, c3z, c3w };
+
+      // clean lanes of the group hold the same values already, rewriting
+      // them keeps whole cache lines going to the buffer
+      const size_t n = std::min<size_t>(4, size_ - base);
+      for(size_t k = 0; k < n; ++k) {
+        auto& d = dst[base + k];
+        stream(&d.instanceTransform.columns[0].x, c0[k]);
+        stream(&d.instanceTransform.columns[1].x, c1[k]);
+        stream(&d.instanceTransform.columns[2].x, c2[k]);
+        stream(&d.instanceTransform.columns[3].x, c3[k]);
+        stream(&d.instanceNormalTransform.columns[0].x, c0[k]);
+        stream(&d.instanceNormalTransform.columns[1].x, c1[k]);
+        stream(&d.instanceNormalTransform.columns[2].x, c2[k]);
+        stream(&d.instanceColor.x, load(color_[base + k]));
+      }
+      if(base + n > last) last = base + n;
+    }
+  }
+  // streamed stores are only ordered by a fence on the storing thread
+  stream_fence();
+  return composed;
+}
+
+HaruhiTransformStore::WriteResult
+HaruhiTransformStore::writeInstances(unsigned target, shader_t::InstanceData* dst,
+                                     HaruhiWorkerPool* pPool) noexcept {
+  assert(target < dirty_.size());
+  assert(dst);
+
+  uint64_t* words = dirty_[target].data();
+  const size_t nwords = wordCount(size_);
+
+  WriteResult res = { 0, size_, 0 };
+
+  if(!pPool || nwords <= WORD_GRAIN) {
+    res.composed = composeWords(dst, words, 0, nwords, res.first, res.last);
+  } else {
+    std::atomic<size_t> composed = 0, first = size_, last = 0;
+    pPool->parallelFor(nwords, WORD_GRAIN, [&](size_t b, size_t e) {
+      size_t f = size_, l = 0;
+      const size_t n = composeWords(dst, words, b, e, f, l);
+      if(!n) return;
+      composed.fetch_add(n, std::memory_order_relaxed);
+      atomicMin(first, f);
+      atomicMax(last, l);
+    });
+    res = { composed.load(), first.load(), last.load() };
+  }
+
+  if(!res.composed)
+    res.first = res.last = 0;
+  return res;
+}
\ No newline at end of file
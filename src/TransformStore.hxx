@@ -0,0 +1,65 @@
+#ifndef HARUHI_TRANSFORMSTORE_HXX
+#define HARUHI_TRANSFORMSTORE_HXX
+
+#include <cstdint>
+#include <vector>
+
+#include "ShaderTypes.hxx"
+
+class HaruhiWorkerPool;
+
+// structure of arrays instance transforms, composed into shader_t::InstanceData
+// every target (e.g. one gpu buffer per frame in flight) keeps its own dirty bits
+class HaruhiTransformStore {
+public:
+  using Index = uint32_t;
+
+  struct WriteResult {
+    size_t composed;
+    // touched instance range [first, last), empty when nothing was dirty
+    size_t first, last;
+  };
+
+private:
+  std::vector<float> px_, py_, pz_;
+  std::vector<float> qx_, qy_, qz_, qw_;
+  std::vector<float> sx_, sy_, sz_;
+  std::vector<math::float4> color_;
+  std::vector<std::vector<uint64_t>> dirty_;
+  size_t size_;
+
+  void grow(size_t);
+  void markDirty(Index) noexcept;
+  size_t composeWords(shader_t::InstanceData*, uint64_t*, size_t, size_t, size_t&, size_t&) const noexcept;
+
+public:
+  explicit HaruhiTransformStore(unsigned = 1);
+
+  Index add(const math::float3&,
+            const math::quat& = { 0., 0., 0., 1. },
+            const math::float3& = { 1., 1., 1. },
+            const math::float4& = { 1., 1., 1., 1. });
+  // moves the last instance into the freed slot, returns its old index
+  Index remove(Index) noexcept;
+  void clear() noexcept;
+
+  size_t size() const noexcept { return size_; }
+  unsigned targets() const noexcept { return dirty_.size(); }
+
+  void setPosition(Index, const math::float3&) noexcept;
+  void setRotation(Index, const math::quat&) noexcept;
+  void setScale(Index, const math::float3&) noexcept;
+  void setColor(Index, const math::float4&) noexcept;
+
+  math::float3 position(Index) const noexcept;
+  math::quat rotation(Index) const noexcept;
+  math::float3 scale(Index) const noexcept;
+
+  void markAllDirty() noexcept;
+  bool isDirty(unsigned, Index) const noexcept;
+
+  // recomposes dirty instances of the target into dst[0, size()), clears their bits
+  WriteResult writeInstances(unsigned, shader_t::InstanceData*, HaruhiWorkerPool* = nullptr) noexcept;
+};
+
+#endif
\ No newline at end of file
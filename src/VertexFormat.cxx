@@ -0,0 +1,206 @@
+#include "VertexFormat.hxx"
+
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+
+constexpr float UNORM16_MAX = 65535.f;
+constexpr float SNORM16_MAX = 32767.f;
+
+uint16_t
+quantize(float v, float offset, float invScale) noexcept {
+  return uint16_t(std::clamp((v - offset) * invScale + .5f, 0.f, UNORM16_MAX));
+}
+
+int16_t
+quantizeSnorm(float v) noexcept {
+  const float q = std::clamp(v, -1.f, 1.f) * SNORM16_MAX;
+  return int16_t(q + (q >= 0.f ? .5f : -.5f));
+}
+
+float
+signNotZero(float v) noexcept {
+  return v >= 0.f ? 1.f : -1.f;
+}
+
+uint32_t
+unorm8(float v) noexcept {
+  return uint32_t(std::clamp(v, 0.f, 1.f) * 255.f + .5f);
+}
+
+uint32_t
+snormPair(float a, float b) noexcept {
+  return uint32_t(uint16_t(quantizeSnorm(a))) | uint32_t(uint16_t(quantizeSnorm(b))) << 16;
+}
+
+// what unpack_snorm2x16_to_float does with either half
+float
+snorm(uint32_t v) noexcept {
+  return std::max(int16_t(uint16_t(v)) / SNORM16_MAX, -1.f);
+}
+
+// a zero scale still has to divide
+float
+inverse(float scale) noexcept {
+  return scale > 0.f ? 1.f / scale : 0.f;
+}
+
+} // ns
+
+namespace vtx {
+
+Quantization
+fitQuantization(const shader_t::VertexData* pVerts, size_t n) noexcept {
+  if(!n) return { {}, 0.f, {}, {} };
+  math::float3 lo = { FLT_MAX, FLT_MAX, FLT_MAX }, hi = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+  math::float2 tlo = { FLT_MAX, FLT_MAX }, thi = { -FLT_MAX, -FLT_MAX };
+  for(size_t i = 0; i < n; ++i) {
+    const shader_t::VertexData& v = pVerts[i];
+    lo = { std::min(lo.x, v.pos.x), std::min(lo.y, v.pos.y), std::min(lo.z, v.pos.z) };
+    hi = { std::max(hi.x, v.pos.x), std::max(hi.y, v.pos.y), std::max(hi.z, v.pos.z) };
+    tlo = { std::min(tlo.x, v.texcoord.x), std::min(tlo.y, v.texcoord.y) };
+    thi = { std::max(thi.x, v.texcoord.x), std::max(thi.y, v.texcoord.y) };
+  }
+  const float extent = std::max({ hi.x - lo.x, hi.y - lo.y, hi.z - lo.z });
+  return { lo, extent / UNORM16_MAX, tlo, { (thi.x - tlo.x) / UNORM16_MAX, (thi.y - tlo.y) / UNORM16_MAX } };
+}
+
+shader_t::PackedMeshData
+meshData(const Quantization& q) noexcept {
+  shader_t::PackedMeshData d;
+  d.meshTransform = { {
+    { q.scale, 0., 0., 0. },
+    { 0., q.scale, 0., 0. },
+    { 0., 0., q.scale, 0. },
+    { q.offset.x, q.offset.y, q.offset.z, 1. }
+  } };
+  d.meshNormalTransform = { { { 1., 0., 0. }, { 0., 1., 0. }, { 0., 0., 1. } } };
+  d.texcoordTransform = { q.texcoordScale.x, q.texcoordScale.y, q.texcoordOffset.x, q.texcoordOffset.y };
+  return d;
+}
+
+// the unit octahedron unfolded onto a square, the lower half folded over
+// the diagonals
+void
+octEncode(const math::float3& n, int16_t* pOut) noexcept {
+  const float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+  const float inv = l1 > 0.f ? 1.f / l1 : 0.f;
+  float x = n.x * inv, y = n.y * inv;
+  if(n.z < 0.f) {
+    const float fx = (1.f - std::fabs(y)) * signNotZero(x);
+    const float fy = (1.f - std::fabs(x)) * signNotZero(y);
+    x = fx, y = fy;
+  }
+  pOut[0] = quantizeSnorm(x);
+  pOut[1] = quantizeSnorm(y);
+}
+
+math::float3
+octDecode(const int16_t* pIn) noexcept {
+  const float x = std::max(pIn[0] / SNORM16_MAX, -1.f), y = std::max(pIn[1] / SNORM16_MAX, -1.f);
+  math::float3 n = { x, y, 1.f - std::fabs(x) - std::fabs(y) };
+  const float t = std::max(-n.z, 0.f);
+  n.x += n.x >= 0.f ? -t : t;
+  n.y += n.y >= 0.f ? -t : t;
+  const float inv = 1.f / std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+  return { n.x * inv, n.y * inv, n.z * inv };
+}
+
+void
+pack(const shader_t::VertexData* pIn, size_t n, const Quantization& q,
+     shader_t::PackedVertexData* pOut) noexcept {
+  const float inv = inverse(q.scale);
+  const float invU = inverse(q.texcoordScale.x), invV = inverse(q.texcoordScale.y);
+  for(size_t i = 0; i < n; ++i) {
+    const shader_t::VertexData& v = pIn[i];
+    shader_t::PackedVertexData& p = pOut[i];
+    p.pos[0] = quantize(v.pos.x, q.offset.x, inv);
+    p.pos[1] = quantize(v.pos.y, q.offset.y, inv);
+    p.pos[2] = quantize(v.pos.z, q.offset.z, inv);
+    p.pos[3] = 0;
+    octEncode(v.norm, p.norm);
+    p.texcoord[0] = quantize(v.texcoord.x, q.texcoordOffset.x, invU);
+    p.texcoord[1] = quantize(v.texcoord.y, q.texcoordOffset.y, invV);
+  }
+}
+
+void
+unpack(const shader_t::PackedVertexData* pIn, size_t n, const Quantization& q,
+       shader_t::VertexData* pOut) noexcept {
+  for(size_t i = 0; i < n; ++i) {
+    const shader_t::PackedVertexData& p = pIn[i];
+    shader_t::VertexData& v = pOut[i];
+    v.pos = { q.offset.x + p.pos[0] * q.scale, q.offset.y + p.pos[1] * q.scale, q.offset.z + p.pos[2] * q.scale };
+    v.norm = octDecode(p.norm);
+    v.texcoord = { q.texcoordOffset.x + p.texcoord[0] * q.texcoordScale.x,
+                   q.texcoordOffset.y + p.texcoord[1] * q.texcoordScale.y };
+  }
+}
+
+// normals go through the float bits, rounding included. subnormal halves
+// come from the fpu's own rounding against .5f
+uint16_t
+toHalf(float f) noexcept {
+  const uint32_t bits = std::bit_cast<uint32_t>(f);
+  const uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+  uint32_t a = bits & 0x7FFFFFFF;
+  if(a >= 0x47800000) // 65536 and up, inf and nan
+    return sign | (a > 0x7F800000 ? 0x7E00 : 0x7C00);
+  if(a < 0x38800000) // below the smallest normal half
+    return sign | uint16_t(std::bit_cast<uint32_t>(std::bit_cast<float>(a) + .5f) - 0x3F000000);
+  // rebias the exponent, round the 13 dropped bits to even
+  a += 0xC8000FFF + ((a >> 13) & 1);
+  return sign | uint16_t(a >> 13);
+}
+
+float
+fromHalf(uint16_t h) noexcept {
+  const uint32_t sign = uint32_t(h & 0x8000) << 16, e = (h >> 10) & 0x1F, m = h & 0x3FF;
+  if(!e) {
+    const float v = m * 0x1p-24f;
+    return sign ? -v : v;
+  }
+  return std::bit_cast<float>(sign | (e == 31 ? 0x7F800000 : (e + 112) << 23) | m << 13);
+}
+
+shader_t::CompactInstanceData
+packInstance(const math::float3& p, const math::quat& q, const math::float3& s,
+             const math::float4& color) noexcept {
+  const math::quat n = math::normalize(q);
+  shader_t::CompactInstanceData d;
+  d.position = { p.x, p.y, p.z };
+  d.color = unorm8(color.x) | unorm8(color.y) << 8 | unorm8(color.z) << 16 | unorm8(color.w) << 24;
+  d.rotation[0] = snormPair(n.x, n.y);
+  d.rotation[1] = snormPair(n.z, n.w);
+  d.scale[0] = uint32_t(toHalf(s.x)) | uint32_t(toHalf(s.y)) << 16;
+  d.scale[1] = toHalf(s.z);
+  return d;
+}
+
+shader_t::InstanceData
+expandInstance(const shader_t::CompactInstanceData& d) noexcept {
+  const math::quat q = math::normalize(math::quat{ snorm(d.rotation[0]), snorm(d.rotation[0] >> 16),
+                                                   snorm(d.rotation[1]), snorm(d.rotation[1] >> 16) });
+  const math::float3 s = { fromHalf(uint16_t(d.scale[0])), fromHalf(uint16_t(d.scale[0] >> 16)),
+                           fromHalf(uint16_t(d.scale[1])) };
+  const math::float3x3 r = math::toMatrix(q);
+  shader_t::InstanceData e;
+  e.instanceTransform = { {
+    { r.columns[0] * s.x, 0.f },
+    { r.columns[1] * s.y, 0.f },
+    { r.columns[2] * s.z, 0.f },
+    { { d.position.x, d.position.y, d.position.z }, 1.f }
+  } };
+  // the cofactor, the inverse transpose times the determinant
+  e.instanceNormalTransform = { {
+    r.columns[0] * (s.y * s.z), r.columns[1] * (s.x * s.z), r.columns[2] * (s.x * s.y)
+  } };
+  e.instanceColor = { (d.color & 0xFF) / 255.f, ((d.color >> 8) & 0xFF) / 255.f,
+                      ((d.color >> 16) & 0xFF) / 255.f, (d.color >> 24) / 255.f };
+  return e;
+}
+
+} // ns vtx
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef HARUHI_VERTEXFORMAT_HXX
+#define HARUHI_VERTEXFORMAT_HXX
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ShaderTypes.hxx"
+
+// VertexData <-> PackedVertexData, 48 bytes down to 16, and instances
+// to CompactInstanceData, 128 bytes down to 32
+//
+// positions are stored as unorm16 steps of a uniform scale from the
+// mesh's min corner, so the dequantizing transform is a translate and a
+// scale the normals don't notice. texcoords get their own range. normals
+// are octahedral, within about .01 degrees of the original. instance
+// rotations come back within about 1e-4, scales with half's 11 bits
+namespace vtx {
+
+// position = offset + q * scale, texcoord = texcoordOffset + q * texcoordScale
+struct Quantization {
+  math::float3 offset;
+  float scale;
+  math::float2 texcoordOffset, texcoordScale;
+};
+
+// the tightest quantization covering every vertex
+Quantization fitQuantization(const shader_t::VertexData*, size_t) noexcept;
+// goes with the packed mesh in place of its instance data
+shader_t::PackedMeshData meshData(const Quantization&) noexcept;
+
+void octEncode(const math::float3&, int16_t*) noexcept;
+// unit length
+math::float3 octDecode(const int16_t*) noexcept;
+
+// values outside the quantization are clamped to it
+void pack(const shader_t::VertexData*, size_t, const Quantization&,
+          shader_t::PackedVertexData*) noexcept;
+void unpack(const shader_t::PackedVertexData*, size_t, const Quantization&,
+            shader_t::VertexData*) noexcept;
+
+// round to nearest even, overflow goes to infinity
+uint16_t toHalf(float) noexcept;
+float fromHalf(uint16_t) noexcept;
+
+// position, rotation, scale and linear color, the rotation needn't be
+// normalized
+shader_t::CompactInstanceData packInstance(const math::float3&, const math::quat&,
+                                           const math::float3&, const math::float4&) noexcept;
+// what the vertex shader's expandInstance computes, the reference for it
+shader_t::InstanceData expandInstance(const shader_t::CompactInstanceData&) noexcept;
+
+} // ns vtx
+
+#endif
\ No newline at end of file
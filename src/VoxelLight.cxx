@@ -0,0 +1,502 @@
+#include "VoxelLight.hxx"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include "Profiler.hxx"
+#include "WorkerPool.hxx"
+
+namespace {
+
+using voxel::Block;
+using voxel::MAX_LIGHT;
+constexpr int S = voxel::CHUNK_SIZE;
+constexpr int M = S - 1;
+// shift of the sky nibble, block light is at 0
+constexpr int SKY = 4;
+
+const int DIRS[voxel::FACE_COUNT][3] = {
+  { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+};
+
+constexpr voxel::ChunkCoord NO_CHUNK = { INT32_MIN, INT32_MIN, INT32_MIN };
+
+inline int
+index(int x, int y, int z) noexcept {
+  return (z * S + y) * S + x;
+}
+
+// cell (u, v) of the chunk's layer facing f, the same (u, v) as the
+// neighbour's layer facing back
+inline int
+faceCell(int f, int u, int v) noexcept {
+  const int w = f & 1 ? 0 : M;
+  if(f < 2) return index(w, u, v);
+  if(f < 4) return index(u, w, v);
+  return index(u, v, w);
+}
+
+// what light needs of blockInfo, a table read per cell
+struct Lookup {
+  bool opaque[voxel::BLOCK_COUNT];
+  uint8_t emission[voxel::BLOCK_COUNT];
+};
+
+const Lookup g_lookup = [] {
+  Lookup l;
+  for(Block b = 0; b < voxel::BLOCK_COUNT; ++b) {
+    l.opaque[b] = voxel::blockInfo(b).opaque;
+    l.emission[b] = voxel::blockInfo(b).emission;
+  }
+  return l;
+}();
+
+inline bool
+opaque(Block b) noexcept {
+  return b < voxel::BLOCK_COUNT && g_lookup.opaque[b];
+}
+
+inline uint8_t
+emission(Block b) noexcept {
+  return b < voxel::BLOCK_COUNT ? g_lookup.emission[b] : 0;
+}
+
+inline uint8_t
+raise(uint8_t light, int sky, int block) noexcept {
+  return uint8_t(std::max(light >> SKY, sky) << SKY | std::max(light & MAX_LIGHT, block));
+}
+
+// a chunk being relit, both channels at once
+struct Volume {
+  voxel::ChunkCoord coord;
+  const voxel::BlockStorage* pBlocks;
+  uint8_t* pLight;
+  // [z][y] bit x, a cell's row is its index >> 5
+  uint32_t opaque[voxel::CHUNK_AREA];
+  // the layer facing each neighbour as of the last round, [v][u]
+  uint8_t borders[voxel::FACE_COUNT][voxel::CHUNK_AREA];
+  Volume* pNeighbours[voxel::FACE_COUNT];
+  // lit chunks next to it that aren't relit
+  const uint8_t* pOutside[voxel::FACE_COUNT];
+  // raised by the last round, its neighbours import from it
+  bool changed, imported;
+};
+
+// cells of the flood, indices into one chunk
+std::vector<uint16_t>&
+localQueue() {
+  thread_local std::vector<uint16_t> queue;
+  queue.clear();
+  return queue;
+}
+
+void
+flood(Volume& vol, std::vector<uint16_t>& queue) noexcept {
+  uint8_t* light = vol.pLight;
+  auto reach = [&](int n, int sky, int block) {
+    if(vol.opaque[n >> 5] >> (n & M) & 1) return;
+    const uint8_t next = raise(light[n], sky, block);
+    if(next == light[n]) return;
+    light[n] = next;
+    queue.push_back(uint16_t(n));
+  };
+
+  for(size_t h = 0; h < queue.size(); ++h) {
+    const int i = queue[h];
+    const int sky = light[i] >> SKY, block = light[i] & MAX_LIGHT;
+    if(sky <= 1 && block <= 1) continue;
+    const int x = i & M, y = i >> 5 & M, z = i >> 10;
+    const int dimSky = std::max(sky - 1, 0), dimBlock = std::max(block - 1, 0);
+    if(x < M) reach(i + 1, dimSky, dimBlock);
+    if(x > 0) reach(i - 1, dimSky, dimBlock);
+    if(y < M) reach(i + S, dimSky, dimBlock);
+    // full sky falls without loss
+    if(y > 0) reach(i - S, sky == MAX_LIGHT ? sky : dimSky, dimBlock);
+    if(z < M) reach(i + S * S, dimSky, dimBlock);
+    if(z > 0) reach(i - S * S, dimSky, dimBlock);
+  }
+  queue.clear();
+}
+
+void
+snapshot(Volume& vol) noexcept {
+  for(int f = 0; f < int(voxel::FACE_COUNT); ++f)
+    for(int v = 0; v < S; ++v)
+      for(int u = 0; u < S; ++u) vol.borders[f][v * S + u] = vol.pLight[faceCell(f, u, v)];
+}
+
+// sky columns, emitters and the flood inside the chunk. pExposed is the
+// sky entering the top layer, [z] bit x, and leaves the bottom one
+void
+lightChunk(Volume& vol, uint32_t* pExposed) noexcept {
+  std::vector<uint16_t>& queue = localQueue();
+  uint8_t* light = vol.pLight;
+  memset(light, 0, voxel::CHUNK_VOLUME);
+
+  // rows of one block, all stone or all air, are most of them
+  const voxel::BlockStorage& blocks = *vol.pBlocks;
+  if(blocks.uniform() && !emission(blocks.value())) {
+    std::fill(vol.opaque, vol.opaque + voxel::CHUNK_AREA, opaque(blocks.value()) ? ~0u : 0u);
+  } else for(int r = 0; r < voxel::CHUNK_AREA; ++r) {
+    Block row[S];
+    blocks.row(r, row);
+    Block mixed = 0;
+    for(int x = 1; x < S; ++x) mixed |= row[x] ^ row[0];
+    if(!mixed && !emission(row[0])) {
+      vol.opaque[r] = opaque(row[0]) ? ~0u : 0;
+      continue;
+    }
+    uint32_t bits = 0;
+    for(int x = 0; x < S; ++x) {
+      bits |= uint32_t(opaque(row[x])) << x;
+      if(const uint8_t e = emission(row[x])) {
+        light[r * S + x] = e;
+        queue.push_back(uint16_t(r * S + x));
+      }
+    }
+    vol.opaque[r] = bits;
+  }
+
+  // straight down until something opaque, a row of x at a time
+  uint32_t sky[voxel::CHUNK_AREA];
+  for(int y = M; y >= 0; --y)
+    for(int z = 0; z < S; ++z) {
+      const uint32_t open = pExposed[z] &= ~vol.opaque[z * S + y];
+      sky[z * S + y] = open;
+      uint8_t* row = light + index(0, y, z);
+      if(open == ~0u) memset(row, voxel::FULL_SKY, S);
+      else for(uint32_t b = open; b; b &= b - 1) row[__builtin_ctz(b)] = voxel::FULL_SKY;
+    }
+
+  // full sky only spreads sideways into the dark, the cells above and
+  // below a lit one are lit or opaque
+  auto dark = [&](int z, int y) { return ~(sky[z * S + y] | vol.opaque[z * S + y]); };
+  for(int z = 0; z < S; ++z)
+    for(int y = 0; y < S; ++y) {
+      const uint32_t d = dark(z, y);
+      uint32_t near = d << 1 | d >> 1;
+      if(z > 0) near |= dark(z - 1, y);
+      if(z < M) near |= dark(z + 1, y);
+      for(uint32_t b = sky[z * S + y] & near; b; b &= b - 1) queue.push_back(uint16_t(index(__builtin_ctz(b), y, z)));
+    }
+
+  flood(vol, queue);
+  snapshot(vol);
+}
+
+// light of the neighbour's layer facing f into the chunk's, returns
+// whether the chunk's changed
+bool
+import(Volume& vol, int f, const uint8_t* pLayer) noexcept {
+  std::vector<uint16_t>& queue = localQueue();
+  for(int v = 0; v < S; ++v)
+    for(int u = 0; u < S; ++u) {
+      const int i = faceCell(f, u, v);
+      if(vol.opaque[i >> 5] >> (i & M) & 1) continue;
+      const int from = pLayer[v * S + u];
+      const int sky = from >> SKY, block = from & MAX_LIGHT;
+      const uint8_t next = raise(vol.pLight[i], f == voxel::FACE_POS_Y && sky == MAX_LIGHT ? sky : sky - 1, block - 1);
+      if(next == vol.pLight[i]) continue;
+      vol.pLight[i] = next;
+      queue.push_back(uint16_t(i));
+    }
+  const bool changed = !queue.empty();
+  flood(vol, queue);
+  return changed;
+}
+
+} // ns
+
+HaruhiVoxelLight::HaruhiVoxelLight(HaruhiVoxelWorld& world) noexcept
+    : world_(world), cached_coord_(NO_CHUNK), p_cached_(nullptr) {}
+
+// the lit chunk of a cell, null when there is none
+HaruhiVoxelWorld::Chunk*
+HaruhiVoxelLight::chunkAt(int x, int y, int z) noexcept {
+  const voxel::ChunkCoord c = HaruhiVoxelWorld::chunkOf(x, y, z);
+  if(c != cached_coord_) {
+    cached_coord_ = c;
+    p_cached_ = world_.find(c);
+    if(p_cached_ && !p_cached_->light) p_cached_ = nullptr;
+  }
+  return p_cached_;
+}
+
+// the lit chunk of the cell next to the step's across face f, mostly the
+// same one
+inline HaruhiVoxelWorld::Chunk*
+HaruhiVoxelLight::next(const Step& p, int f, int x, int y, int z) noexcept {
+  if(!(((x ^ p.x) | (y ^ p.y) | (z ^ p.z)) & ~M)) return p.pChunk;
+  HaruhiVoxelWorld::Chunk* n = p.pChunk->neighbours[f];
+  return n && n->light ? n : nullptr;
+}
+
+// queues the chunk of a cell whose light changed for remeshing, and the
+// neighbour it borders on
+void
+HaruhiVoxelLight::touch(HaruhiVoxelWorld::Chunk* pChunk, int x, int y, int z) noexcept {
+  auto queue = [&](HaruhiVoxelWorld::Chunk* pQueued) {
+    if(!pQueued || pQueued->queued) return;
+    pQueued->queued = true;
+    world_.queue_.push_back(pQueued->coord);
+  };
+  queue(pChunk);
+  const int l[3] = { x & M, y & M, z & M };
+  for(int a = 0; a < 3; ++a) {
+    if(l[a] == M) queue(pChunk->neighbours[a * 2]);
+    else if(!l[a]) queue(pChunk->neighbours[a * 2 + 1]);
+  }
+}
+
+// the cells of dark_ were cleared, clears the channel around them as far
+// as their light reached. brighter cells on the edge, lit from elsewhere,
+// and emitters go to lit_ to fill the hole back in
+template <int SHIFT>
+size_t
+HaruhiVoxelLight::unlight() {
+  size_t writes = 0;
+  for(size_t h = 0; h < dark_.size(); ++h) {
+    const Step p = dark_[h];
+    for(int f = 0; f < int(voxel::FACE_COUNT); ++f) {
+      const int x = p.x + DIRS[f][0], y = p.y + DIRS[f][1], z = p.z + DIRS[f][2];
+      HaruhiVoxelWorld::Chunk* chunk = next(p, f, x, y, z);
+      if(!chunk) continue;
+      const int i = index(x & M, y & M, z & M);
+      uint8_t& cell = chunk->light[i];
+      const int level = cell >> SHIFT & MAX_LIGHT;
+      if(!level) continue;
+      const bool fed = level < p.level || (SHIFT == SKY && f == voxel::FACE_NEG_Y && p.level == MAX_LIGHT);
+      if(fed && !(SHIFT != SKY && emission(chunk->blocks.get(i)))) {
+        cell &= uint8_t(~(MAX_LIGHT << SHIFT));
+        touch(chunk, x, y, z);
+        ++writes;
+        dark_.push_back({ chunk, x, y, z, uint8_t(level) });
+      } else {
+        lit_.push_back({ chunk, x, y, z, 0 });
+      }
+    }
+  }
+  dark_.clear();
+  return writes;
+}
+
+// floods the channel out of the cells of lit_
+template <int SHIFT>
+size_t
+HaruhiVoxelLight::spread() {
+  size_t writes = 0;
+  for(size_t h = 0; h < lit_.size(); ++h) {
+    const Step p = lit_[h];
+    const int level = p.pChunk->light[index(p.x & M, p.y & M, p.z & M)] >> SHIFT & MAX_LIGHT;
+    if(level <= 1) continue;
+    for(int f = 0; f < int(voxel::FACE_COUNT); ++f) {
+      const int x = p.x + DIRS[f][0], y = p.y + DIRS[f][1], z = p.z + DIRS[f][2];
+      HaruhiVoxelWorld::Chunk* chunk = next(p, f, x, y, z);
+      if(!chunk) continue;
+      const int i = index(x & M, y & M, z & M);
+      if(opaque(chunk->blocks.get(i))) continue;
+      const int want = SHIFT == SKY && f == voxel::FACE_NEG_Y && level == MAX_LIGHT ? level : level - 1;
+      uint8_t& cell = chunk->light[i];
+      if((cell >> SHIFT & MAX_LIGHT) >= want) continue;
+      cell = uint8_t((cell & ~(MAX_LIGHT << SHIFT)) | want << SHIFT);
+      touch(chunk, x, y, z);
+      ++writes;
+      lit_.push_back({ chunk, x, y, z, 0 });
+    }
+  }
+  lit_.clear();
+  return writes;
+}
+
+void
+HaruhiVoxelLight::neighbours(int x, int y, int z) {
+  for(int f = 0; f < int(voxel::FACE_COUNT); ++f) {
+    const int nx = x + DIRS[f][0], ny = y + DIRS[f][1], nz = z + DIRS[f][2];
+    if(HaruhiVoxelWorld::Chunk* chunk = chunkAt(nx, ny, nz)) lit_.push_back({ chunk, nx, ny, nz, 0 });
+  }
+}
+
+size_t
+HaruhiVoxelLight::relight(const voxel::ChunkCoord* pCoords, size_t count, HaruhiWorkerPool* pPool) {
+  HARUHI_PROFILE_SCOPE("HaruhiVoxelLight::relight");
+  cached_coord_ = NO_CHUNK;
+
+  // stacks together, top down, each chunk once
+  std::vector<voxel::ChunkCoord> coords(pCoords, pCoords + count);
+  std::sort(coords.begin(), coords.end(), [](const voxel::ChunkCoord& a, const voxel::ChunkCoord& b) {
+    return a.x != b.x ? a.x < b.x : a.z != b.z ? a.z < b.z : a.y > b.y;
+  });
+  coords.erase(std::unique(coords.begin(), coords.end()), coords.end());
+
+  std::vector<std::unique_ptr<Volume>> volumes;
+  std::unordered_map<uint64_t, Volume*> relit;
+  for(const voxel::ChunkCoord& c : coords) {
+    HaruhiVoxelWorld::Chunk* chunk = world_.find(c);
+    if(!chunk) continue;
+    if(!chunk->light) chunk->light = std::make_unique<uint8_t[]>(voxel::CHUNK_VOLUME);
+    volumes.push_back(std::make_unique<Volume>());
+    Volume& vol = *volumes.back();
+    vol.coord = c;
+    vol.pBlocks = &chunk->blocks;
+    vol.pLight = chunk->light.get();
+    relit[HaruhiVoxelWorld::key(c)] = &vol;
+  }
+  std::vector<size_t> stacks;
+  for(size_t i = 0; i < volumes.size(); ++i) {
+    Volume& vol = *volumes[i];
+    const voxel::ChunkCoord& c = vol.coord;
+    if(!i || c.x != volumes[i - 1]->coord.x || c.z != volumes[i - 1]->coord.z) stacks.push_back(i);
+    for(int f = 0; f < int(voxel::FACE_COUNT); ++f) {
+      const voxel::ChunkCoord n = { c.x + DIRS[f][0], c.y + DIRS[f][1], c.z + DIRS[f][2] };
+      auto it = relit.find(HaruhiVoxelWorld::key(n));
+      vol.pNeighbours[f] = it == relit.end() ? nullptr : it->second;
+      const HaruhiVoxelWorld::Chunk* outside = vol.pNeighbours[f] ? nullptr : world_.find(n);
+      vol.pOutside[f] = outside ? outside->light.get() : nullptr;
+    }
+  }
+  stacks.push_back(volumes.size());
+
+  auto forEach = [&](size_t n, size_t grain, auto&& fn) {
+    if(pPool) pPool->parallelFor(n, grain, fn);
+    else fn(0, n);
+  };
+
+  // sky comes in from the lit chunk above the stack, or from open sky
+  forEach(stacks.size() - 1, 1, [&](size_t b, size_t e) {
+    uint32_t exposed[S];
+    for(size_t s = b; s < e; ++s)
+      for(size_t j = stacks[s]; j < stacks[s + 1]; ++j) {
+        Volume& vol = *volumes[j];
+        if(j == stacks[s] || volumes[j - 1]->coord.y != vol.coord.y + 1) {
+          const uint8_t* above = vol.pOutside[voxel::FACE_POS_Y];
+          for(int z = 0; z < S; ++z) {
+            exposed[z] = above ? 0 : ~0u;
+            for(int x = 0; above && x < S; ++x) exposed[z] |= uint32_t(above[index(x, 0, z)] >> SKY == MAX_LIGHT) << x;
+          }
+        }
+        lightChunk(vol, exposed);
+      }
+  });
+
+  // rounds of exchanging borders, the chunks outside only once
+  for(bool first = true;; first = false) {
+    forEach(volumes.size(), 4, [&](size_t b, size_t e) {
+      uint8_t layer[voxel::CHUNK_AREA];
+      for(size_t j = b; j < e; ++j) {
+        Volume& vol = *volumes[j];
+        vol.imported = false;
+        for(int f = 0; f < int(voxel::FACE_COUNT); ++f) {
+          if(const Volume* n = vol.pNeighbours[f]) {
+            if(first || n->changed) vol.imported |= import(vol, f, n->borders[f ^ 1]);
+          } else if(first && vol.pOutside[f]) {
+            for(int v = 0; v < S; ++v)
+              for(int u = 0; u < S; ++u) layer[v * S + u] = vol.pOutside[f][faceCell(f ^ 1, u, v)];
+            vol.imported |= import(vol, f, layer);
+          }
+        }
+      }
+    });
+    if(std::none_of(volumes.begin(), volumes.end(), [](const auto& v) { return v->imported; })) break;
+    forEach(volumes.size(), 4, [&](size_t b, size_t e) {
+      for(size_t j = b; j < e; ++j) {
+        Volume& vol = *volumes[j];
+        vol.changed = vol.imported;
+        if(vol.changed) snapshot(vol);
+      }
+    });
+  }
+
+  // and back out into the chunks outside. a chunk below took this one
+  // for open sky before it was there
+  for(int shift : { SKY, 0 }) {
+    for(const auto& vol : volumes)
+      for(int f = 0; f < int(voxel::FACE_COUNT); ++f) {
+        const uint8_t* out = vol->pOutside[f];
+        if(!out) continue;
+        const voxel::ChunkCoord& c = vol->coord;
+        HaruhiVoxelWorld::Chunk* self = chunkAt(c.x * S, c.y * S, c.z * S);
+        HaruhiVoxelWorld::Chunk* below = f == voxel::FACE_NEG_Y ? chunkAt(c.x * S, c.y * S - 1, c.z * S) : nullptr;
+        for(int v = 0; v < S; ++v)
+          for(int u = 0; u < S; ++u) {
+            const int i = faceCell(f, u, v);
+            const int x = c.x * S + (i & M), y = c.y * S + (i >> 5 & M), z = c.z * S + (i >> 10);
+            const int o = faceCell(f ^ 1, u, v);
+            if(shift == SKY && f == voxel::FACE_NEG_Y && out[o] >> SKY == MAX_LIGHT && vol->pLight[i] >> SKY != MAX_LIGHT) {
+              below->light[o] &= MAX_LIGHT;
+              touch(below, x, y - 1, z);
+              dark_.push_back({ below, x, y - 1, z, MAX_LIGHT });
+            }
+            if((vol->pLight[i] >> shift & MAX_LIGHT) > 1) lit_.push_back({ self, x, y, z, 0 });
+          }
+      }
+    if(shift == SKY) {
+      unlight<SKY>();
+      spread<SKY>();
+    } else {
+      spread<0>();
+    }
+  }
+
+  for(const auto& vol : volumes) {
+    const voxel::ChunkCoord& c = vol->coord;
+    world_.enqueue(c);
+    for(int f = 0; f < int(voxel::FACE_COUNT); ++f) world_.enqueue({ c.x + DIRS[f][0], c.y + DIRS[f][1], c.z + DIRS[f][2] });
+  }
+  return volumes.size();
+}
+
+size_t
+HaruhiVoxelLight::changed(int x, int y, int z) {
+  cached_coord_ = NO_CHUNK;
+  HaruhiVoxelWorld::Chunk* chunk = chunkAt(x, y, z);
+  if(!chunk) return 0;
+  const int i = index(x & M, y & M, z & M);
+  const Block b = chunk->blocks.get(i);
+  const bool solid = opaque(b);
+  uint8_t& cell = chunk->light[i];
+  size_t writes = 0;
+
+  // an opaque block loses its light and casts its shadow, a see through
+  // one takes light from its neighbours
+  if(const uint8_t sky = cell >> SKY; solid && sky) {
+    cell &= MAX_LIGHT;
+    dark_.push_back({ chunk, x, y, z, sky });
+    ++writes;
+  }
+  writes += unlight<SKY>();
+  if(!solid) {
+    // under open sky when the chunk above isn't lit
+    if(!chunkAt(x, y + 1, z) && cell >> SKY != MAX_LIGHT) {
+      cell |= voxel::FULL_SKY;
+      lit_.push_back({ chunk, x, y, z, 0 });
+      ++writes;
+    }
+    neighbours(x, y, z);
+  }
+  writes += spread<SKY>();
+
+  if(const uint8_t block = cell & MAX_LIGHT) {
+    cell &= uint8_t(~MAX_LIGHT);
+    dark_.push_back({ chunk, x, y, z, block });
+    ++writes;
+  }
+  writes += unlight<0>();
+  if(const uint8_t e = emission(b)) {
+    cell |= e;
+    lit_.push_back({ chunk, x, y, z, 0 });
+    ++writes;
+  }
+  if(!solid) neighbours(x, y, z);
+  writes += spread<0>();
+
+  touch(chunk, x, y, z);
+  return writes;
+}
+
+uint8_t
+HaruhiVoxelLight::get(int x, int y, int z) const noexcept {
+  const HaruhiVoxelWorld::Chunk* chunk = world_.find(HaruhiVoxelWorld::chunkOf(x, y, z));
+  if(!chunk || !chunk->light) return voxel::FULL_SKY;
+  return chunk->light[index(x & M, y & M, z & M)];
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef HARUHI_VOXELLIGHT_HXX
+#define HARUHI_VOXELLIGHT_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "VoxelWorld.hxx"
+
+class HaruhiWorkerPool;
+
+// sky and block light flooded through the blocks of a HaruhiVoxelWorld
+//
+// both are 0..MAX_LIGHT per cell and stored with the chunk. sky light
+// enters every column from above at full strength and falls straight
+// down without loss, block light starts at the emission of its block.
+// otherwise both lose one per step and stop at opaque blocks. a chunk
+// without a lit chunk above is under open sky.
+//
+// relight floods whole chunks from scratch on the pool, columns of sky
+// first, then rounds of a local flood per chunk from the neighbours'
+// borders of the round before, until no border changes. changed() runs
+// the incremental removal and add queues after an edit, which reach no
+// further than MAX_LIGHT blocks from it. chunks whose light changes are
+// queued for remeshing, the mesher bakes it into the vertices
+class HaruhiVoxelLight {
+  // a cell and its chunk, lit
+  struct Step {
+    HaruhiVoxelWorld::Chunk* pChunk;
+    int32_t x, y, z;
+    uint8_t level;
+  };
+
+  HaruhiVoxelWorld& world_;
+  // removal and add queues of the channel being updated
+  std::vector<Step> dark_, lit_;
+  // the chunk of the last cell looked up
+  voxel::ChunkCoord cached_coord_;
+  HaruhiVoxelWorld::Chunk* p_cached_;
+
+  HaruhiVoxelWorld::Chunk* chunkAt(int, int, int) noexcept;
+  HaruhiVoxelWorld::Chunk* next(const Step&, int, int, int, int) noexcept;
+  void touch(HaruhiVoxelWorld::Chunk*, int, int, int) noexcept;
+  template <int SHIFT> size_t unlight();
+  template <int SHIFT> size_t spread();
+  void neighbours(int, int, int);
+
+public:
+  explicit HaruhiVoxelLight(HaruhiVoxelWorld&) noexcept;
+
+  // for chunks new to the world, generated or loaded. lit neighbours
+  // outside the set exchange light with it. returns how many were lit
+  size_t relight(const voxel::ChunkCoord*, size_t, HaruhiWorkerPool* = nullptr);
+
+  // after the block at the position was set, returns how many light
+  // values were written on the way
+  size_t changed(int, int, int);
+
+  // sky << 4 | block, full sky outside lit chunks
+  uint8_t get(int, int, int) const noexcept;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,219 @@
+#include "VoxelQuery.hxx"
+
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include "WorkerPool.hxx"
+
+namespace {
+
+constexpr int S = voxel::CHUNK_SIZE;
+constexpr int M = S - 1;
+constexpr float INF = std::numeric_limits<float>::infinity();
+
+constexpr voxel::ChunkCoord NO_CHUNK = { INT32_MIN, INT32_MIN, INT32_MIN };
+
+inline int
+index(int x, int y, int z) noexcept {
+  return ((z & M) * S + (y & M)) * S + (x & M);
+}
+
+} // ns
+
+HaruhiVoxelQuery::HaruhiVoxelQuery(const HaruhiVoxelWorld& world) noexcept : world_(world) {}
+
+// the chunk at c, through a neighbour link when it is next to the last one
+const HaruhiVoxelWorld::Chunk*
+HaruhiVoxelQuery::chunkAt(Cursor& cursor, const voxel::ChunkCoord& c) const noexcept {
+  if(c == cursor.coord) return cursor.pChunk;
+  const HaruhiVoxelWorld::Chunk* next = nullptr;
+  bool linked = false;
+  if(cursor.pChunk) {
+    const int dx = c.x - cursor.coord.x, dy = c.y - cursor.coord.y, dz = c.z - cursor.coord.z;
+    if(std::abs(dx) + std::abs(dy) + std::abs(dz) == 1) {
+      next = cursor.pChunk->neighbours[dx ? (dx < 0) : dy ? 2 + (dy < 0) : 4 + (dz < 0)];
+      linked = true;
+    }
+  }
+  cursor.pChunk = linked ? next : world_.find(c);
+  cursor.coord = c;
+  return cursor.pChunk;
+}
+
+bool
+HaruhiVoxelQuery::solid(Cursor& cursor, int x, int y, int z) const noexcept {
+  const HaruhiVoxelWorld::Chunk* chunk = chunkAt(cursor, HaruhiVoxelWorld::chunkOf(x, y, z));
+  if(!chunk) return false;
+  const int i = index(x, y, z);
+  return (chunk->blocks.bricks() >> voxel::BlockStorage::brickOf(i) & 1) && chunk->blocks.get(i);
+}
+
+// any solid cell at k on the axis, over [lo0, hi0] x [lo1, hi1] on the
+// other two in order
+bool
+HaruhiVoxelQuery::solidLayer(Cursor& cursor, int axis, int k, int lo0, int hi0, int lo1, int hi1) const noexcept {
+  const int a0 = axis == 0 ? 1 : 0, a1 = axis == 2 ? 1 : 2;
+  int c[3];
+  c[axis] = k;
+  for(c[a1] = lo1; c[a1] <= hi1; ++c[a1])
+    for(c[a0] = lo0; c[a0] <= hi0; ++c[a0])
+      if(solid(cursor, c[0], c[1], c[2])) return true;
+  return false;
+}
+
+bool
+HaruhiVoxelQuery::raycast(const voxel::Ray& ray, voxel::RayHit& hit) const noexcept {
+  const float o[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+  const float d[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+  // the cell, the t of the next boundary per axis and between two of them
+  int p[3], step[3];
+  float next[3], delta[3];
+  for(int a = 0; a < 3; ++a) {
+    p[a] = int(std::floor(o[a]));
+    step[a] = d[a] > 0.f ? 1 : d[a] < 0.f ? -1 : 0;
+    delta[a] = step[a] ? float(step[a]) / d[a] : INF;
+    next[a] = step[a] > 0 ? (float(p[a] + 1) - o[a]) * delta[a] : step[a] ? (o[a] - float(p[a])) * delta[a] : INF;
+  }
+
+  Cursor cursor = { NO_CHUNK, nullptr };
+  const HaruhiVoxelWorld::Chunk* chunk = chunkAt(cursor, HaruhiVoxelWorld::chunkOf(p[0], p[1], p[2]));
+  float t = 0.f;
+  int axis = -1;
+  for(;;) {
+    // the cube of empty cells around p to cross in one step
+    int size = S;
+    if(chunk) {
+      const voxel::BlockStorage& blocks = chunk->blocks;
+      const int i = index(p[0], p[1], p[2]);
+      if(blocks.bricks() >> voxel::BlockStorage::brickOf(i) & 1) {
+        size = 1;
+        if(const voxel::Block b = blocks.get(i)) {
+          hit = { p[0], p[1], p[2], b,
+                  axis < 0 ? voxel::FACE_COUNT : voxel::Face(axis * 2 + (step[axis] > 0)), t };
+          return true;
+        }
+      } else if(blocks.bricks()) {
+        size = voxel::BRICK_SIZE;
+      }
+    }
+
+    if(size == 1) {
+      // the plain dda step, the chunk only changes past its border
+      int e = next[1] < next[0] ? 1 : 0;
+      if(next[2] < next[e]) e = 2;
+      if(!(next[e] <= ray.length)) break;
+      t = next[e];
+      axis = e;
+      p[e] += step[e];
+      next[e] += delta[e];
+      if((p[e] & M) != (step[e] > 0 ? 0 : M)) continue;
+      chunk = chunkAt(cursor, HaruhiVoxelWorld::chunkOf(p[0], p[1], p[2]));
+      continue;
+    }
+
+    // cells to the cube's far side per axis, and the axis the ray leaves by
+    int cells[3] = {};
+    int e = 0;
+    float exit = INF;
+    for(int a = 0; a < 3; ++a) {
+      if(!step[a]) continue;
+      const int lo = p[a] & -size;
+      cells[a] = step[a] > 0 ? lo + size - p[a] : p[a] - lo + 1;
+      const float te = next[a] + float(cells[a] - 1) * delta[a];
+      if(te < exit) {
+        exit = te;
+        e = a;
+      }
+    }
+    if(!(exit <= ray.length)) break;
+
+    // the other axes cross the boundaries before the exit, inside the cube
+    for(int a = 0; a < 3; ++a) {
+      if(!step[a]) continue;
+      int n = cells[a];
+      if(a != e) {
+        const float k = (exit - next[a]) / delta[a];
+        n = k <= 0.f ? 0 : k >= float(cells[a] - 1) ? cells[a] - 1 : int(std::ceil(k));
+      }
+      p[a] += step[a] * n;
+      next[a] += float(n) * delta[a];
+    }
+    t = exit;
+    axis = e;
+    chunk = chunkAt(cursor, HaruhiVoxelWorld::chunkOf(p[0], p[1], p[2]));
+  }
+  hit = { p[0], p[1], p[2], voxel::Block(voxel::BLOCK_AIR), voxel::FACE_COUNT, ray.length };
+  return false;
+}
+
+void
+HaruhiVoxelQuery::raycast(const voxel::Ray* pRays, size_t n, voxel::RayHit* pHits, HaruhiWorkerPool* pPool) const {
+  auto run = [&](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i) raycast(pRays[i], pHits[i]);
+  };
+  if(pPool) pPool->parallelFor(n, 64, run);
+  else run(0, n);
+}
+
+uint32_t
+HaruhiVoxelQuery::sweep(cull::Aabb& box, const math::float3& offset) const noexcept {
+  float lo[3] = { box.min.x, box.min.y, box.min.z };
+  float hi[3] = { box.max.x, box.max.y, box.max.z };
+  const float move[3] = { offset.x, offset.y, offset.z };
+  Cursor cursor = { NO_CHUNK, nullptr };
+  uint32_t blocked = 0;
+  for(int axis : { 1, 0, 2 }) {
+    const float m = move[axis];
+    if(m == 0.f) continue;
+    // cells the box covers on the other axes, touching faces don't count
+    const int a0 = axis == 0 ? 1 : 0, a1 = axis == 2 ? 1 : 2;
+    const int lo0 = int(std::floor(lo[a0])), hi0 = int(std::ceil(hi[a0])) - 1;
+    const int lo1 = int(std::floor(lo[a1])), hi1 = int(std::ceil(hi[a1])) - 1;
+    const float size = hi[axis] - lo[axis];
+    // layers of cells the leading face passes, nearest first. a stopped
+    // box is put right against the face it hit
+    if(m > 0.f) {
+      const float from = hi[axis];
+      hi[axis] += m;
+      for(int k = int(std::ceil(from)), last = int(std::ceil(hi[axis])) - 1; k <= last; ++k)
+        if(solidLayer(cursor, axis, k, lo0, hi0, lo1, hi1)) {
+          hi[axis] = float(k);
+          blocked |= 1u << axis;
+          break;
+        }
+      lo[axis] = hi[axis] - size;
+    } else {
+      const float from = lo[axis];
+      lo[axis] += m;
+      for(int k = int(std::floor(from)) - 1, last = int(std::floor(lo[axis])); k >= last; --k)
+        if(solidLayer(cursor, axis, k, lo0, hi0, lo1, hi1)) {
+          lo[axis] = float(k + 1);
+          blocked |= 1u << axis;
+          break;
+        }
+      hi[axis] = lo[axis] + size;
+    }
+  }
+  box.min = { lo[0], lo[1], lo[2] };
+  box.max = { hi[0], hi[1], hi[2] };
+  return blocked;
+}
+
+void
+HaruhiVoxelQuery::step(voxel::Body* pBodies, size_t n, float dt, const math::float3& acceleration,
+                       HaruhiWorkerPool* pPool) const {
+  auto run = [&](size_t b, size_t e) {
+    for(size_t i = b; i < e; ++i) {
+      voxel::Body& body = pBodies[i];
+      body.velocity = body.velocity + acceleration * dt;
+      body.blocked = sweep(body.box, body.velocity * dt);
+      if(body.blocked & voxel::BLOCKED_X) body.velocity.x = 0.f;
+      if(body.blocked & voxel::BLOCKED_Y) body.velocity.y = 0.f;
+      if(body.blocked & voxel::BLOCKED_Z) body.velocity.z = 0.f;
+    }
+  };
+  if(pPool) pPool->parallelFor(n, 256, run);
+  else run(0, n);
+}
\ No newline at end of file
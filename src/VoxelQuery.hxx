@@ -0,0 +1,92 @@
+#ifndef HARUHI_VOXELQUERY_HXX
+#define HARUHI_VOXELQUERY_HXX
+
+#include <cstddef>
+#include <cstdint>
+
+#include "BoundsTree.hxx"
+#include "VoxelWorld.hxx"
+
+class HaruhiWorkerPool;
+
+namespace voxel {
+
+// points origin + direction * t for 0 <= t <= length, direction needn't
+// be unit length
+struct Ray {
+  math::float3 origin;
+  math::float3 direction;
+  float length;
+};
+
+// the block a ray stopped in, air when it hit nothing. face is the side
+// it came in through, the cell next to it is where a placed block goes.
+// FACE_COUNT when the ray started inside the block
+struct RayHit {
+  int32_t x, y, z;
+  Block block;
+  Face face;
+  float t;
+};
+
+// axes a box was stopped on by HaruhiVoxelQuery::sweep
+enum : uint32_t {
+  BLOCKED_X = 1,
+  BLOCKED_Y = 2,
+  BLOCKED_Z = 4
+};
+
+// a box moving through the blocks, velocity in blocks per second
+struct Body {
+  cull::Aabb box;
+  math::float3 velocity;
+  // BLOCKED_ bits of the last step, BLOCKED_Y with velocity.y <= 0 is
+  // standing on the ground
+  uint32_t blocked;
+};
+
+} // ns voxel
+
+// ray and box queries against the blocks of a HaruhiVoxelWorld, every
+// block but air is solid
+//
+// raycast walks the cells along the ray the way Amanatides and Woo's dda
+// does, but a missing chunk, a chunk of air or an empty brick of
+// BRICK_SIZE^3 cells is crossed in one step, the dda state is advanced to
+// where the ray leaves it. chunks are followed along their neighbour
+// links. sweep moves a box one axis at a time, y first, and stops it at
+// the first layer of cells in its path holding a solid block, so nothing
+// is tunnelled through however far it moves. queries only read the
+// world, batches of them run on the pool
+class HaruhiVoxelQuery {
+  // the chunk of the last cell looked up
+  struct Cursor {
+    voxel::ChunkCoord coord;
+    const HaruhiVoxelWorld::Chunk* pChunk;
+  };
+
+  const HaruhiVoxelWorld& world_;
+
+  const HaruhiVoxelWorld::Chunk* chunkAt(Cursor&, const voxel::ChunkCoord&) const noexcept;
+  bool solid(Cursor&, int, int, int) const noexcept;
+  bool solidLayer(Cursor&, int, int, int, int, int, int) const noexcept;
+
+public:
+  explicit HaruhiVoxelQuery(const HaruhiVoxelWorld&) noexcept;
+
+  // the first solid block along the ray, returns whether there is one
+  bool raycast(const voxel::Ray&, voxel::RayHit&) const noexcept;
+  // n rays at once, split over the pool
+  void raycast(const voxel::Ray*, size_t, voxel::RayHit*, HaruhiWorkerPool* = nullptr) const;
+
+  // moves the box by up to the offset, as far as the blocks let it, and
+  // returns the BLOCKED_ bits of the axes it was stopped on. the box
+  // shouldn't start inside a solid block
+  uint32_t sweep(cull::Aabb&, const math::float3&) const noexcept;
+
+  // accelerates the bodies, then sweeps them by velocity * dt and stops
+  // them on the axes they were blocked on
+  void step(voxel::Body*, size_t, float, const math::float3&, HaruhiWorkerPool* = nullptr) const;
+};
+
+#endif
\ No newline at end of file
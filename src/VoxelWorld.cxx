@@ -0,0 +1,472 @@
+#include "VoxelWorld.hxx"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "WorkerPool.hxx"
+
+namespace {
+
+using voxel::Block;
+
+constexpr uint16_t
+tile(uint16_t column, uint16_t row) noexcept {
+  return row * voxel::ATLAS_TILES + column;
+}
+
+// +x -x +y -y +z -z
+const voxel::BlockInfo g_blocks[voxel::BLOCK_COUNT] = {
+  { { 0, 0, 0, 0, 0, 0 }, false, 0 }, // air
+  { { tile(21, 1), tile(21, 1), tile(21, 1), tile(21, 1), tile(21, 1), tile(21, 1) }, true, 0 },
+  { { tile(2, 5), tile(2, 5), tile(2, 5), tile(2, 5), tile(2, 5), tile(2, 5) }, true, 0 },
+  { { tile(12, 10), tile(12, 10), tile(20, 4), tile(2, 5), tile(12, 10), tile(12, 10) }, true, 0 },
+  { { tile(19, 7), tile(19, 7), tile(19, 7), tile(19, 7), tile(19, 7), tile(19, 7) }, true, 0 },
+  { { tile(1, 5), tile(1, 5), tile(1, 5), tile(1, 5), tile(1, 5), tile(1, 5) }, true, 0 },
+  { { tile(5, 3), tile(5, 3), tile(5, 3), tile(5, 3), tile(5, 3), tile(5, 3) }, true, 0 },
+  { { tile(16, 2), tile(16, 2), tile(16, 2), tile(16, 2), tile(16, 2), tile(16, 2) }, true, 0 },
+  { { tile(6, 2), tile(6, 2), tile(6, 2), tile(6, 2), tile(6, 2), tile(6, 2) }, false, 0 },
+  { { tile(9, 10), tile(9, 10), tile(9, 10), tile(9, 10), tile(9, 10), tile(9, 10) }, true, voxel::MAX_LIGHT },
+};
+
+constexpr int P = voxel::PADDED_SIZE;
+constexpr int STRIDES[3] = { 1, P, P * P };
+
+// in place transpose of a 32x32 bit matrix, bit i of row j <-> bit j of row i
+void
+transpose32(uint32_t* m) noexcept {
+  uint32_t mask = 0x0000FFFF;
+  for(int j = 16; j; j >>= 1, mask ^= mask << j)
+    for(int k = 0; k < 32; k = (k + j + 1) & ~j) {
+      const uint32_t t = ((m[k] >> j) ^ m[k + j]) & mask;
+      m[k] ^= t << j;
+      m[k + j] ^= t;
+    }
+}
+
+// one chunk of cells plus the facing layer of each neighbour, fill where
+// there is none. edges and corners are never read. sources hand out rows
+// of x, row(z * S + y, out), and single cells, get(i)
+template <typename T, typename Source, typename Neighbour>
+void
+padChunk(const Source& core, T fill, T* pOut, Neighbour neighbour) noexcept {
+  constexpr int S = voxel::CHUNK_SIZE;
+  std::fill(pOut, pOut + voxel::PADDED_VOLUME, fill);
+
+  for(int z = 0; z < S; ++z)
+    for(int y = 0; y < S; ++y) core.row(z * S + y, pOut + ((z + 1) * P + y + 1) * P + 1);
+
+  auto at = [](int x, int y, int z) { return (z * P + y) * P + x; };
+  auto in = [](int x, int y, int z) { return (z * S + y) * S + x; };
+  if(const Source* n = neighbour(voxel::FACE_NEG_X))
+    for(int z = 0; z < S; ++z) for(int y = 0; y < S; ++y) pOut[at(0, y + 1, z + 1)] = n->get(in(S - 1, y, z));
+  if(const Source* n = neighbour(voxel::FACE_POS_X))
+    for(int z = 0; z < S; ++z) for(int y = 0; y < S; ++y) pOut[at(S + 1, y + 1, z + 1)] = n->get(in(0, y, z));
+  if(const Source* n = neighbour(voxel::FACE_NEG_Y))
+    for(int z = 0; z < S; ++z) n->row(z * S + S - 1, pOut + at(1, 0, z + 1));
+  if(const Source* n = neighbour(voxel::FACE_POS_Y))
+    for(int z = 0; z < S; ++z) n->row(z * S, pOut + at(1, S + 1, z + 1));
+  if(const Source* n = neighbour(voxel::FACE_NEG_Z))
+    for(int y = 0; y < S; ++y) n->row((S - 1) * S + y, pOut + at(1, y + 1, 0));
+  if(const Source* n = neighbour(voxel::FACE_POS_Z))
+    for(int y = 0; y < S; ++y) n->row(y, pOut + at(1, y + 1, S + 1));
+}
+
+// a chunk's light as a padChunk source
+struct DenseLight {
+  const uint8_t* pLight;
+  void row(int r, uint8_t* pOut) const noexcept {
+    memcpy(pOut, pLight + r * voxel::CHUNK_SIZE, voxel::CHUNK_SIZE);
+  }
+  uint8_t get(int i) const noexcept { return pLight[i]; }
+};
+
+const int NEIGHBOURS[voxel::FACE_COUNT][3] = {
+  { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }
+};
+
+constexpr uint32_t MAX_SECTION_VERTICES = 1 << 16;
+
+void
+emitQuad(voxel::ChunkMesh& mesh, const math::float3& origin, int d, bool positive,
+         int plane, int i, int j, int w, int h, Block b, uint8_t light) noexcept {
+  const int u = (d + 1) % 3, v = (d + 2) % 3;
+  const voxel::Face face = voxel::Face(d * 2 + (positive ? 0 : 1));
+  const uint16_t t = g_blocks[b].tiles[face];
+  const float col = float(t % voxel::ATLAS_TILES), row = float(t / voxel::ATLAS_TILES);
+
+  if(mesh.sections.empty() ||
+     mesh.vertices.size() + 4 - mesh.sections.back().baseVertex > MAX_SECTION_VERTICES)
+    mesh.sections.push_back({ uint32_t(mesh.indices.size()), 0, uint32_t(mesh.vertices.size()) });
+  voxel::MeshSection& sec = mesh.sections.back();
+  const uint16_t base = uint16_t(mesh.vertices.size() - sec.baseVertex);
+
+  math::float3 n = { 0., 0., 0. };
+  (&n.x)[d] = positive ? 1.f : -1.f;
+
+  if(g_blocks[b].opaque)
+    mesh.occluders.push_back(uint32_t(mesh.vertices.size()));
+
+  // corners in (along u, along v) order, ccw seen from the front
+  const int cu[4] = { 0, w, w, 0 }, cv[4] = { 0, 0, h, h };
+  for(int k = 0; k < 4; ++k) {
+    const int c = positive ? k : (4 - k) % 4;
+    float p[3];
+    p[d] = float(plane);
+    p[u] = float(i + cu[c]);
+    p[v] = float(j + cv[c]);
+
+    // tiles stand upright on the sides, lay along x/z on top and bottom
+    float lu, lv;
+    if(d == 1) { lu = float(cv[c]); lv = float(cu[c]); }
+    else if(d == 0) { lu = float(cv[c]); lv = float(w - cu[c]); }
+    else { lu = float(cu[c]); lv = float(h - cv[c]); }
+
+    mesh.vertices.push_back({
+      { origin.x + p[0], origin.y + p[1], origin.z + p[2] }, n,
+      { col + lu / voxel::TEXCOORD_SPAN, row + lv / voxel::TEXCOORD_SPAN }
+    });
+    mesh.light.push_back(light);
+  }
+  const uint16_t quad[6] = { 0, 1, 2, 2, 3, 0 };
+  for(uint16_t it : quad)
+    mesh.indices.push_back(base + it);
+  sec.indexCount += 6;
+}
+
+} // ns
+
+namespace voxel {
+
+const BlockInfo&
+blockInfo(Block b) noexcept {
+  return g_blocks[b < BLOCK_COUNT ? b : Block(BLOCK_AIR)];
+}
+
+void
+ChunkMesh::clear() noexcept {
+  vertices.clear();
+  indices.clear();
+  sections.clear();
+  occluders.clear();
+  light.clear();
+}
+
+// solid and opaque cells become bit rows along x, a face is visible where
+// a solid cell meets a cell that isn't opaque. per direction that gives a
+// 32x32 bit plane per slice, covered by maximal rectangles of one block
+// type. see through neighbours of the same type are the only per cell test
+void
+meshChunk(const Block* pPadded, const uint8_t* pLight, const math::float3& origin, ChunkMesh& mesh) noexcept {
+  mesh.clear();
+
+  // [z][y] over the padded volume, bit x
+  uint64_t solid[P * P], opaque[P * P];
+  for(int r = 0; r < P * P; ++r) {
+    const Block* row = pPadded + r * P;
+    uint64_t s = 0, o = 0;
+    for(int x = 0; x < P; ++x) {
+      const Block b = row[x];
+      const bool known = b != BLOCK_AIR && b < BLOCK_COUNT;
+      s |= uint64_t(known) << x;
+      o |= uint64_t(known && g_blocks[b].opaque) << x;
+    }
+    solid[r] = s;
+    opaque[r] = o;
+  }
+
+  auto at = [](int x, int y, int z) { return ((z + 1) * P + y + 1) * P + x + 1; };
+  auto core = [](uint64_t v) { return uint32_t(v >> 1); };
+
+  // planes[slice][row], bits along the row
+  uint32_t planes[CHUNK_SIZE][CHUNK_SIZE];
+
+  for(int d = 0; d < 3; ++d)
+    for(int dir = 0; dir < 2; ++dir) {
+      const bool positive = dir == 0;
+      const int step = positive ? 1 : -1;
+
+      // d = x: slice x, rows z, bits y (transposed below)
+      // d = y: slice y, rows z, bits x
+      // d = z: slice z, rows y, bits x
+      for(int a = 0; a < CHUNK_SIZE; ++a)
+        for(int c = 0; c < CHUNK_SIZE; ++c) {
+          int r, rn;
+          if(d == 0) { r = (c + 1) * P + a + 1; rn = r; }               // a = y, c = z
+          else if(d == 1) { r = (c + 1) * P + a + 1; rn = r + step; }    // a = y, c = z
+          else { r = (a + 1) * P + c + 1; rn = r + step * P; }          // a = z, c = y
+          const uint64_t s = solid[r];
+          uint64_t sn = solid[rn], on = opaque[rn];
+          if(d == 0) {
+            sn = positive ? sn >> 1 : sn << 1;
+            on = positive ? on >> 1 : on << 1;
+          }
+          uint32_t vis = core(s & ~on);
+          // see through neighbours hide faces of their own kind
+          for(uint32_t t = core(s & sn & ~on); t; t &= t - 1) {
+            const int x = __builtin_ctz(t);
+            const int dx = d == 0 ? step : 0;
+            const int cell = r * P + x + 1;
+            const int ncell = rn * P + x + 1 + dx;
+            if(pPadded[cell] == pPadded[ncell]) vis &= ~(uint32_t(1) << x);
+          }
+          if(d == 0) planes[c][a] = vis;      // [z][y] bits x, transposed below
+          else if(d == 1) planes[a][c] = vis; // [y][z] bits x
+          else planes[a][c] = vis;            // [z][y] bits x
+        }
+
+      if(d == 0) {
+        // [z][y] bits x -> per z, [x] bits y, then swap to [x][z]
+        uint32_t tmp[CHUNK_SIZE][CHUNK_SIZE];
+        for(int z = 0; z < CHUNK_SIZE; ++z) {
+          transpose32(planes[z]);
+          for(int x = 0; x < CHUNK_SIZE; ++x) tmp[x][z] = planes[z][x];
+        }
+        memcpy(planes, tmp, sizeof(planes));
+      }
+
+      const int front = step * STRIDES[d];
+      for(int sl = 0; sl < CHUNK_SIZE; ++sl) {
+        uint32_t* rows = planes[sl];
+        // block under plane bit (i, j) and the light in front of it, faces
+        // merge where both match
+        auto type = [&](int i, int j) {
+          const int cell = d == 0 ? at(sl, i, j) : d == 1 ? at(i, sl, j) : at(i, j, sl);
+          return uint32_t(pPadded[cell]) | uint32_t(pLight ? pLight[cell + front] : FULL_SKY) << 16;
+        };
+        const int plane = positive ? sl + 1 : sl;
+
+        for(int j = 0; j < CHUNK_SIZE; ++j)
+          while(rows[j]) {
+            const int i = __builtin_ctz(rows[j]);
+            const uint32_t b = type(i, j);
+
+            int w = 1;
+            while(i + w < CHUNK_SIZE && (rows[j] >> (i + w) & 1) && type(i + w, j) == b) ++w;
+            const uint32_t run = (w == 32 ? ~uint32_t(0) : (uint32_t(1) << w) - 1) << i;
+
+            int h = 1;
+            for(; j + h < CHUNK_SIZE && (rows[j + h] & run) == run; ++h) {
+              int k = 0;
+              while(k < w && type(i + k, j + h) == b) ++k;
+              if(k < w) break;
+            }
+            for(int y = 0; y < h; ++y) rows[j + y] &= ~run;
+
+            // plane bits run along u except for y faces, where rows are z = u
+            const Block block = Block(b);
+            const uint8_t light = uint8_t(b >> 16);
+            if(d == 1) emitQuad(mesh, origin, d, positive, plane, j, i, h, w, block, light);
+            else emitQuad(mesh, origin, d, positive, plane, i, j, w, h, block, light);
+          }
+      }
+    }
+}
+
+void
+meshChunk(const Block* pPadded, const math::float3& origin, ChunkMesh& mesh) noexcept {
+  meshChunk(pPadded, nullptr, origin, mesh);
+}
+
+} // ns voxel
+
+uint64_t
+HaruhiVoxelWorld::key(const voxel::ChunkCoord& c) noexcept {
+  constexpr uint64_t MASK = (uint64_t(1) << 21) - 1;
+  return (uint64_t(c.x) & MASK) | (uint64_t(c.y) & MASK) << 21 | (uint64_t(c.z) & MASK) << 42;
+}
+
+voxel::ChunkCoord
+HaruhiVoxelWorld::chunkOf(int x, int y, int z) noexcept {
+  // arithmetic shifts floor towards -inf
+  static_assert(voxel::CHUNK_SIZE == 32);
+  return { x >> 5, y >> 5, z >> 5 };
+}
+
+HaruhiVoxelWorld::Chunk*
+HaruhiVoxelWorld::find(const voxel::ChunkCoord& c) const noexcept {
+  auto it = chunks_.find(key(c));
+  return it == chunks_.end() ? nullptr : it->second.get();
+}
+
+HaruhiVoxelWorld::Chunk*
+HaruhiVoxelWorld::create(const voxel::ChunkCoord& c) {
+  auto& slot = chunks_[key(c)];
+  if(!slot) {
+    slot = std::make_unique<Chunk>();
+    slot->coord = c;
+    slot->queued = false;
+    for(int f = 0; f < int(voxel::FACE_COUNT); ++f) {
+      const int* d = NEIGHBOURS[f];
+      Chunk* n = find({ c.x + d[0], c.y + d[1], c.z + d[2] });
+      slot->neighbours[f] = n;
+      if(n) n->neighbours[f ^ 1] = slot.get();
+    }
+  }
+  return slot.get();
+}
+
+void
+HaruhiVoxelWorld::enqueue(const voxel::ChunkCoord& c) noexcept {
+  Chunk* chunk = find(c);
+  if(!chunk || chunk->queued) return;
+  chunk->queued = true;
+  queue_.push_back(c);
+}
+
+voxel::Block
+HaruhiVoxelWorld::get(int x, int y, int z) const noexcept {
+  const Chunk* chunk = find(chunkOf(x, y, z));
+  if(!chunk) return voxel::BLOCK_AIR;
+  constexpr int M = voxel::CHUNK_SIZE - 1;
+  return chunk->blocks.get(((z & M) * voxel::CHUNK_SIZE + (y & M)) * voxel::CHUNK_SIZE + (x & M));
+}
+
+void
+HaruhiVoxelWorld::set(int x, int y, int z, voxel::Block b) {
+  const voxel::ChunkCoord c = chunkOf(x, y, z);
+  Chunk* chunk = find(c);
+  if(!chunk) {
+    if(b == voxel::BLOCK_AIR) return;
+    chunk = create(c);
+  }
+  constexpr int M = voxel::CHUNK_SIZE - 1;
+  const int lx = x & M, ly = y & M, lz = z & M;
+  const int i = (lz * voxel::CHUNK_SIZE + ly) * voxel::CHUNK_SIZE + lx;
+  if(chunk->blocks.get(i) == b) return;
+  chunk->blocks.set(i, b);
+
+  enqueue(c);
+  // only the neighbours whose border layer this block is
+  if(lx == 0) enqueue({ c.x - 1, c.y, c.z });
+  if(lx == M) enqueue({ c.x + 1, c.y, c.z });
+  if(ly == 0) enqueue({ c.x, c.y - 1, c.z });
+  if(ly == M) enqueue({ c.x, c.y + 1, c.z });
+  if(lz == 0) enqueue({ c.x, c.y, c.z - 1 });
+  if(lz == M) enqueue({ c.x, c.y, c.z + 1 });
+}
+
+voxel::BlockStorage&
+HaruhiVoxelWorld::edit(const voxel::ChunkCoord& c) {
+  Chunk* chunk = create(c);
+  enqueue(c);
+  enqueue({ c.x - 1, c.y, c.z });
+  enqueue({ c.x + 1, c.y, c.z });
+  enqueue({ c.x, c.y - 1, c.z });
+  enqueue({ c.x, c.y + 1, c.z });
+  enqueue({ c.x, c.y, c.z - 1 });
+  enqueue({ c.x, c.y, c.z + 1 });
+  return chunk->blocks;
+}
+
+const voxel::BlockStorage*
+HaruhiVoxelWorld::blocks(const voxel::ChunkCoord& c) const noexcept {
+  const Chunk* chunk = find(c);
+  return chunk ? &chunk->blocks : nullptr;
+}
+
+size_t
+HaruhiVoxelWorld::blockBytes() const noexcept {
+  size_t bytes = 0;
+  for(const auto& it : chunks_) bytes += it.second->blocks.bytes();
+  return bytes;
+}
+
+void
+HaruhiVoxelWorld::erase(const voxel::ChunkCoord& c) noexcept {
+  auto it = chunks_.find(key(c));
+  if(it == chunks_.end()) return;
+  for(int f = 0; f < int(voxel::FACE_COUNT); ++f)
+    if(Chunk* n = it->second->neighbours[f]) n->neighbours[f ^ 1] = nullptr;
+  const bool queued = it->second->queued;
+  chunks_.erase(it);
+  // remesh reports it with a null mesh, a queued chunk has its entry already
+  if(erased_.insert(key(c)).second && !queued) queue_.push_back(c);
+  enqueue({ c.x - 1, c.y, c.z });
+  enqueue({ c.x + 1, c.y, c.z });
+  enqueue({ c.x, c.y - 1, c.z });
+  enqueue({ c.x, c.y + 1, c.z });
+  enqueue({ c.x, c.y, c.z - 1 });
+  enqueue({ c.x, c.y, c.z + 1 });
+}
+
+const voxel::ChunkMesh*
+HaruhiVoxelWorld::mesh(const voxel::ChunkCoord& c) const noexcept {
+  const Chunk* chunk = find(c);
+  return chunk ? &chunk->mesh : nullptr;
+}
+
+void
+HaruhiVoxelWorld::pad(const Chunk& chunk, voxel::Block* pOut) const noexcept {
+  padChunk(chunk.blocks, voxel::Block(voxel::BLOCK_AIR), pOut, [&](int f) {
+    const Chunk* n = chunk.neighbours[f];
+    return n ? &n->blocks : nullptr;
+  });
+}
+
+void
+HaruhiVoxelWorld::padLight(const Chunk& chunk, uint8_t* pOut) const noexcept {
+  // unlit neighbours are open sky
+  DenseLight sides[voxel::FACE_COUNT];
+  for(int f = 0; f < int(voxel::FACE_COUNT); ++f) {
+    const Chunk* n = chunk.neighbours[f];
+    sides[f].pLight = n ? n->light.get() : nullptr;
+  }
+  padChunk(DenseLight{ chunk.light.get() }, voxel::FULL_SKY, pOut, [&](int f) {
+    return sides[f].pLight ? &sides[f] : nullptr;
+  });
+}
+
+size_t
+HaruhiVoxelWorld::remesh(HaruhiWorkerPool* pPool, double budgetMs) {
+  using clock = std::chrono::steady_clock;
+  const auto start = clock::now();
+  remeshed_.clear();
+
+  const size_t batch = pPool ? pPool->concurrency() : 1;
+  std::vector<Chunk*> work;
+  size_t head = 0, meshed = 0;
+
+  while(head < queue_.size()) {
+    work.clear();
+    for(; head < queue_.size() && work.size() < batch; ++head) {
+      // stale duplicates are dropped, a chunk is meshed and reported once
+      const voxel::ChunkCoord c = queue_[head];
+      const bool erased = erased_.erase(key(c)) != 0;
+      if(Chunk* chunk = find(c)) {
+        if(!chunk->queued) continue;
+        chunk->queued = false;
+        work.push_back(chunk);
+      } else if(!erased) {
+        continue;
+      }
+      remeshed_.push_back(c);
+    }
+
+    auto run = [&](size_t b, size_t e) {
+      thread_local std::unique_ptr<voxel::Block[]> padded;
+      thread_local std::unique_ptr<uint8_t[]> light;
+      if(!padded) padded = std::make_unique<voxel::Block[]>(voxel::PADDED_VOLUME);
+      if(!light) light = std::make_unique<uint8_t[]>(voxel::PADDED_VOLUME);
+      for(size_t i = b; i < e; ++i) {
+        Chunk* chunk = work[i];
+        const voxel::ChunkCoord& c = chunk->coord;
+        pad(*chunk, padded.get());
+        if(chunk->light) padLight(*chunk, light.get());
+        const math::float3 origin = {
+          float(c.x * voxel::CHUNK_SIZE), float(c.y * voxel::CHUNK_SIZE), float(c.z * voxel::CHUNK_SIZE)
+        };
+        voxel::meshChunk(padded.get(), chunk->light ? light.get() : nullptr, origin, chunk->mesh);
+      }
+    };
+    if(pPool) pPool->parallelFor(work.size(), 1, run);
+    else run(0, work.size());
+    meshed += work.size();
+
+    const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    if(budgetMs > 0. && ms >= budgetMs) break;
+  }
+
+  queue_.erase(queue_.begin(), queue_.begin() + head);
+  return meshed;
+}
\ No newline at end of file
@@ -0,0 +1,182 @@
+#ifndef HARUHI_VOXELWORLD_HXX
+#define HARUHI_VOXELWORLD_HXX
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "BlockStorage.hxx"
+#include "ShaderTypes.hxx"
+
+class HaruhiWorkerPool;
+
+// chunked block storage and the mesher turning chunks into VertexData and
+// uint16_t index buffers
+//
+// faces between two opaque blocks are dropped, the rest are merged into
+// the largest rectangles of one block type per slice (greedy meshing).
+// a merged quad repeats its block's tile, so texcoords can't be plain
+// atlas uvs, they carry the tile and the position inside the quad:
+//   texcoord = tile + local / TEXCOORD_SPAN
+// with tile the (column, row) of the tile in the atlas and local in
+// blocks, [0, CHUNK_SIZE]. the voxel fragment shader undoes it
+namespace voxel {
+
+constexpr float TEXCOORD_SPAN = CHUNK_SIZE + 1;
+
+// blocks.png is a grid of 32 x 32 tiles
+constexpr uint32_t ATLAS_TILES = 32;
+
+// light of a cell, sky light in the high nibble and block light in the
+// low one, each 0..MAX_LIGHT. see HaruhiVoxelLight
+constexpr uint8_t MAX_LIGHT = 15;
+constexpr uint8_t FULL_SKY = MAX_LIGHT << 4;
+
+enum : Block {
+  BLOCK_AIR,
+  BLOCK_STONE,
+  BLOCK_DIRT,
+  BLOCK_GRASS,
+  BLOCK_SAND,
+  BLOCK_COBBLESTONE,
+  BLOCK_BRICK,
+  BLOCK_PLANKS,
+  BLOCK_LEAVES,
+  BLOCK_LAMP,
+  BLOCK_COUNT
+};
+
+enum Face : uint32_t {
+  FACE_POS_X,
+  FACE_NEG_X,
+  FACE_POS_Y,
+  FACE_NEG_Y,
+  FACE_POS_Z,
+  FACE_NEG_Z,
+  FACE_COUNT
+};
+
+struct BlockInfo {
+  // atlas tile per face, row * ATLAS_TILES + column
+  uint16_t tiles[FACE_COUNT];
+  // hides the faces of its neighbours. see through blocks only hide
+  // faces of their own kind. opaque blocks stop light too
+  bool opaque;
+  // block light it gives off, 0..MAX_LIGHT
+  uint8_t emission;
+};
+
+const BlockInfo& blockInfo(Block) noexcept;
+
+struct ChunkCoord {
+  int32_t x, y, z;
+  bool operator==(const ChunkCoord&) const noexcept = default;
+};
+
+// indices of a section are relative to its base vertex, keeping them in
+// uint16_t for chunks with more than 64k vertices
+struct MeshSection {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t baseVertex;
+};
+
+struct ChunkMesh {
+  std::vector<shader_t::VertexData> vertices;
+  std::vector<uint16_t> indices;
+  std::vector<MeshSection> sections;
+  // first vertex of every quad of an opaque block, 4 ccw corners each.
+  // occluder geometry for HaruhiOcclusionBuffer
+  std::vector<uint32_t> occluders;
+  // per vertex, the light of the cell in front of the face
+  std::vector<uint8_t> light;
+
+  size_t quads() const noexcept { return indices.size() / 6; }
+  void clear() noexcept;
+};
+
+// blocks of one chunk plus a one block border from the six face
+// neighbours, x fastest. absent neighbours read as air
+constexpr int PADDED_SIZE = CHUNK_SIZE + 2;
+constexpr int PADDED_VOLUME = PADDED_SIZE * PADDED_SIZE * PADDED_SIZE;
+
+// positions are in blocks, the chunk's min corner at origin. quads only
+// merge over faces in the same light. light is padded like the blocks,
+// without it everything is in full sky light
+void meshChunk(const Block*, const uint8_t*, const math::float3&, ChunkMesh&) noexcept;
+void meshChunk(const Block*, const math::float3&, ChunkMesh&) noexcept;
+
+} // ns voxel
+
+// sparse grid of chunks, hashed by key() and linked to their six face
+// neighbours. blocks are palette compressed, see voxel::BlockStorage.
+// edits queue the touched chunk, and the neighbours whose border they
+// change, for remeshing, remesh works the queue off in parallel until its
+// time budget runs out
+class HaruhiVoxelWorld {
+  struct Chunk {
+    voxel::ChunkCoord coord;
+    voxel::BlockStorage blocks;
+    // set once HaruhiVoxelLight lit the chunk
+    std::unique_ptr<uint8_t[]> light;
+    voxel::ChunkMesh mesh;
+    // by voxel::Face, null where there is none
+    Chunk* neighbours[voxel::FACE_COUNT];
+    bool queued;
+  };
+
+  std::unordered_map<uint64_t, std::unique_ptr<Chunk>> chunks_;
+  // a coordinate may sit in the queue more than once, an entry counts
+  // while its chunk is queued or, once erased, its key is in erased_
+  std::vector<voxel::ChunkCoord> queue_;
+  std::unordered_set<uint64_t> erased_;
+  std::vector<voxel::ChunkCoord> remeshed_;
+
+  Chunk* find(const voxel::ChunkCoord&) const noexcept;
+  Chunk* create(const voxel::ChunkCoord&);
+  void enqueue(const voxel::ChunkCoord&) noexcept;
+  void pad(const Chunk&, voxel::Block*) const noexcept;
+  void padLight(const Chunk&, uint8_t*) const noexcept;
+
+  friend class HaruhiVoxelLight;
+  friend class HaruhiVoxelQuery;
+
+public:
+  static voxel::ChunkCoord chunkOf(int, int, int) noexcept;
+  // unique per chunk, for tables kept next to the world
+  static uint64_t key(const voxel::ChunkCoord&) noexcept;
+
+  voxel::Block get(int, int, int) const noexcept;
+  // creates the chunk when needed, setting air in an absent one is a no-op
+  void set(int, int, int, voxel::Block);
+
+  // whole chunk access for generators, queues it and all its neighbours
+  voxel::BlockStorage& edit(const voxel::ChunkCoord&);
+  const voxel::BlockStorage* blocks(const voxel::ChunkCoord&) const noexcept;
+  void erase(const voxel::ChunkCoord&) noexcept;
+
+  size_t size() const noexcept { return chunks_.size(); }
+  // block storage of every chunk
+  size_t blockBytes() const noexcept;
+  size_t pending() const noexcept { return queue_.size(); }
+
+  // meshes queued chunks, oldest first, and returns how many. a budget
+  // of 0 ms empties the queue. at least one batch of one chunk per
+  // thread is meshed
+  size_t remesh(HaruhiWorkerPool* = nullptr, double = 0.);
+  // chunks meshed by the last remesh, for uploading. erased chunks show
+  // up here with a null mesh
+  const std::vector<voxel::ChunkCoord>& remeshed() const noexcept { return remeshed_; }
+  const voxel::ChunkMesh* mesh(const voxel::ChunkCoord&) const noexcept;
+
+  template <typename Fn>
+  void forEachChunk(Fn&& fn) const {
+    for(const auto& it : chunks_)
+      fn(it.second->coord, it.second->mesh);
+  }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,345 @@
+#include "WorkerPool.hxx"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+#include "Profiler.hxx"
+
+namespace {
+
+// which pool's worker this thread is, if any
+thread_local const HaruhiWorkerPool* tl_pool = nullptr;
+thread_local int tl_index = -1;
+
+uint32_t
+xorshift(uint32_t& s) noexcept {
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  return s;
+}
+
+} // ns
+
+// Lê et al., "Correct and efficient work-stealing for weak memory models"
+
+bool
+HaruhiWorkerPool::Deque::push(Job* pJob) noexcept {
+  const int64_t b = bottom_.load(std::memory_order_relaxed);
+  const int64_t t = top_.load(std::memory_order_acquire);
+  if(b - t >= CAPACITY) return false;
+  jobs_[b & (CAPACITY - 1)].store(pJob, std::memory_order_relaxed);
+  // publishes the job to thieves, a plain store on x86
+  bottom_.store(b + 1, std::memory_order_release);
+  return true;
+}
+
+HaruhiWorkerPool::Job*
+HaruhiWorkerPool::Deque::pop() noexcept {
+  const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+  bottom_.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = top_.load(std::memory_order_relaxed);
+
+  Job* job = nullptr;
+  if(t <= b) {
+    job = jobs_[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if(t == b) {
+      // the last one, race the thieves for it
+      if(!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        job = nullptr;
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+  } else {
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+HaruhiWorkerPool::Job*
+HaruhiWorkerPool::Deque::steal() noexcept {
+  int64_t t = top_.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  const int64_t b = bottom_.load(std::memory_order_acquire);
+  if(t >= b) return nullptr;
+
+  Job* job = jobs_[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+  if(!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    return nullptr;
+  return job;
+}
+
+HaruhiWorkerPool::HaruhiWorkerPool(unsigned concurrency)
+: main_id_(std::this_thread::get_id()), injected_count_(0), main_count_(0),
+  epoch_(0), sleepers_(0), stop_(false)
+{
+  if(!concurrency)
+    concurrency = std::max(1u, std::thread::hardware_concurrency());
+  concurrency_ = concurrency;
+
+  deques_ = std::make_unique<Deque[]>(concurrency);
+  threads_.reserve(concurrency - 1);
+  for(unsigned i = 1; i < concurrency; ++i)
+    threads_.emplace_back([this, i] { workerLoop((int)i); });
+}
+
+HaruhiWorkerPool::~HaruhiWorkerPool() {
+  runMainJobs();
+  // workers finish what is queued before they look at stop_, without
+  // workers nobody else empties the main deque
+  uint32_t seed = 1;
+  while(Job* job = take(ownIndex(), seed))
+    execute(job);
+
+  {
+    std::lock_guard<std::mutex> lk(sleep_mtx_);
+    stop_ = true;
+  }
+  sleep_cv_.notify_all();
+  for(auto& it : threads_)
+    it.join();
+}
+
+unsigned
+HaruhiWorkerPool::concurrency() const noexcept {
+  return concurrency_;
+}
+
+bool
+HaruhiWorkerPool::isMainThread() const noexcept {
+  return std::this_thread::get_id() == main_id_;
+}
+
+int
+HaruhiWorkerPool::ownIndex() const noexcept {
+  if(tl_pool == this) return tl_index;
+  return isMainThread() ? 0 : -1;
+}
+
+void
+HaruhiWorkerPool::wake() noexcept {
+  epoch_.fetch_add(1, std::memory_order_seq_cst);
+  if(sleepers_.load(std::memory_order_seq_cst)) {
+    { std::lock_guard<std::mutex> lk(sleep_mtx_); }
+    sleep_cv_.notify_one();
+  }
+}
+
+void
+HaruhiWorkerPool::submit(Job* pJob) noexcept {
+  const int index = ownIndex();
+  if(index >= 0) {
+    if(!deques_[index].push(pJob)) {
+      execute(pJob);
+      return;
+    }
+  } else {
+    std::lock_guard<std::mutex> lk(inject_mtx_);
+    injected_.push_back(pJob);
+    injected_count_.fetch_add(1, std::memory_order_release);
+  }
+  wake();
+}
+
+// own deque, then handed in jobs, then a victim picked at random
+HaruhiWorkerPool::Job*
+HaruhiWorkerPool::take(int index, uint32_t& seed) noexcept {
+  if(index >= 0)
+    if(Job* job = deques_[index].pop()) return job;
+
+  if(injected_count_.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lk(inject_mtx_);
+    if(!injected_.empty()) {
+      Job* job = injected_.front();
+      injected_.pop_front();
+      injected_count_.fetch_sub(1, std::memory_order_relaxed);
+      return job;
+    }
+  }
+
+  const unsigned n = concurrency();
+  const unsigned start = xorshift(seed) % n;
+  for(unsigned k = 0; k < n; ++k) {
+    const unsigned victim = (start + k) % n;
+    if((int)victim == index) continue;
+    if(Job* job = deques_[victim].steal()) return job;
+  }
+  return nullptr;
+}
+
+HaruhiWorkerPool::Job*
+HaruhiWorkerPool::takeMain() noexcept {
+  if(!main_count_.load(std::memory_order_acquire)) return nullptr;
+  std::lock_guard<std::mutex> lk(inject_mtx_);
+  if(main_jobs_.empty()) return nullptr;
+  Job* job = main_jobs_.front();
+  main_jobs_.pop_front();
+  main_count_.fetch_sub(1, std::memory_order_relaxed);
+  return job;
+}
+
+void
+HaruhiWorkerPool::execute(Job* pJob) noexcept {
+  pJob->fn();
+  Counter* counter = pJob->counter;
+  delete pJob;
+  // the waiter may free the counter right after this
+  if(counter) counter->pending_.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void
+HaruhiWorkerPool::workerLoop(int index) noexcept {
+  tl_pool = this;
+  tl_index = index;
+  uint32_t seed = 0x9e3779b9u * (index + 1);
+#ifdef HARUHI_PROFILE
+  char name[32];
+  snprintf(name, sizeof(name), "worker %d", index);
+  prof::setThreadName(name);
+#endif
+
+  for(;;) {
+    const uint32_t epoch = epoch_.load(std::memory_order_seq_cst);
+    if(Job* job = take(index, seed)) {
+      execute(job);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lk(sleep_mtx_);
+    if(stop_) return;
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    sleep_cv_.wait(lk, [&] { return stop_ || epoch_.load(std::memory_order_seq_cst) != epoch; });
+    sleepers_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+}
+
+void
+HaruhiWorkerPool::run(JobFn fn, Counter* pCounter) noexcept {
+  if(pCounter) pCounter->pending_.fetch_add(1, std::memory_order_relaxed);
+  submit(new Job{ std::move(fn), pCounter });
+}
+
+void
+HaruhiWorkerPool::runOnMain(JobFn fn, Counter* pCounter) noexcept {
+  if(pCounter) pCounter->pending_.fetch_add(1, std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lk(inject_mtx_);
+  main_jobs_.push_back(new Job{ std::move(fn), pCounter });
+  main_count_.fetch_add(1, std::memory_order_release);
+}
+
+void
+HaruhiWorkerPool::wait(Counter& counter) noexcept {
+  const int index = ownIndex();
+  uint32_t seed = 0x2545f491u;
+  while(!counter.done()) {
+    Job* job = index == 0 ? takeMain() : nullptr;
+    if(!job) job = take(index, seed);
+    if(job) execute(job);
+    else std::this_thread::yield();
+  }
+}
+
+size_t
+HaruhiWorkerPool::runMainJobs() noexcept {
+  assert(isMainThread());
+  size_t n = 0;
+  for(; Job* job = takeMain(); ++n)
+    execute(job);
+  return n;
+}
+
+void
+HaruhiWorkerPool::parallelFor(size_t count, size_t grain, const RangeFn& fn) noexcept {
+  if(!count) return;
+  if(!grain) grain = 1;
+
+  // not worth waking anybody
+  if(concurrency_ == 1 || count <= grain) {
+    fn(0, count);
+    return;
+  }
+
+  // helpers pull chunks off one shared cursor, late ones find nothing left
+  std::atomic<size_t> next(0);
+  auto drain = [&] {
+    for(;;) {
+      const size_t begin = next.fetch_add(grain, std::memory_order_relaxed);
+      if(begin >= count) break;
+      fn(begin, std::min(begin + grain, count));
+    }
+  };
+
+  const size_t chunks = (count + grain - 1) / grain;
+  const size_t helpers = std::min<size_t>(chunks, concurrency()) - 1;
+  Counter done;
+  for(size_t i = 0; i < helpers; ++i)
+    run(drain, &done);
+  drain();
+  wait(done);
+}
+
+HaruhiTaskGraph::Task
+HaruhiTaskGraph::add(const char* name, HaruhiWorkerPool::JobFn fn, bool mainThread) {
+  Node& n = nodes_.emplace_back();
+  n.name = name;
+  n.fn = std::move(fn);
+  n.main_thread = mainThread;
+  n.predecessors = 0;
+  return Task(nodes_.size() - 1);
+}
+
+void
+HaruhiTaskGraph::precede(Task before, Task after) {
+  assert(before < nodes_.size() && after < nodes_.size());
+  nodes_[before].successors.push_back(after);
+  ++nodes_[after].predecessors;
+}
+
+void
+HaruhiTaskGraph::schedule(HaruhiWorkerPool& pool, HaruhiWorkerPool::Counter& done, Task t) noexcept {
+  // successors are scheduled before the task counts as done
+  auto job = [this, &pool, &done, t] {
+    Node& n = nodes_[t];
+    {
+      HARUHI_PROFILE_SCOPE(n.name);
+      n.fn();
+    }
+    for(Task s : n.successors)
+      if(nodes_[s].remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        schedule(pool, done, s);
+  };
+  if(nodes_[t].main_thread) pool.runOnMain(std::move(job), &done);
+  else pool.run(std::move(job), &done);
+}
+
+void
+HaruhiTaskGraph::run(HaruhiWorkerPool& pool) noexcept {
+  // Kahn's walk, everything reachable from the roots or there is a cycle
+  std::vector<uint32_t> indegree(nodes_.size());
+  std::vector<Task> ready;
+  for(Task t = 0; t < nodes_.size(); ++t) {
+    indegree[t] = nodes_[t].predecessors;
+    nodes_[t].remaining.store(nodes_[t].predecessors, std::memory_order_relaxed);
+    if(!indegree[t]) ready.push_back(t);
+  }
+  const std::vector<Task> roots = ready;
+  size_t seen = 0;
+  while(!ready.empty()) {
+    const Task t = ready.back();
+    ready.pop_back();
+    ++seen;
+    for(Task s : nodes_[t].successors)
+      if(--indegree[s] == 0) ready.push_back(s);
+  }
+  if(seen != nodes_.size()) {
+    printf("task graph has a cycle\n");
+    abort();
+  }
+
+  HaruhiWorkerPool::Counter done;
+  for(Task t : roots)
+    schedule(pool, done, t);
+  pool.wait(done);
+}
\ No newline at end of file
@@ -0,0 +1,144 @@
+#ifndef HARUHI_WORKERPOOL_HXX
+#define HARUHI_WORKERPOOL_HXX
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// work stealing job system, the engine's scheduler
+//
+// every worker and the thread that made the pool (the main thread) own a
+// Chase-Lev deque: the owner pushes and pops at the bottom, idle threads
+// steal from the top. other threads hand jobs in through a shared queue.
+// waiting on a counter runs jobs instead of blocking, so jobs may spawn
+// and wait on jobs and parallelFor nests. main thread jobs only run on
+// the main thread, when it waits or calls runMainJobs
+class HaruhiWorkerPool {
+public:
+  using JobFn = std::function<void()>;
+  using RangeFn = std::function<void(size_t, size_t)>;
+
+  // jobs still pending, zero when all jobs started against it are done
+  class Counter {
+    friend class HaruhiWorkerPool;
+    std::atomic<uint32_t> pending_;
+  public:
+    Counter() : pending_(0) {}
+    bool done() const noexcept { return pending_.load(std::memory_order_acquire) == 0; }
+  };
+
+private:
+  struct Job {
+    JobFn fn;
+    Counter* counter;
+  };
+
+  // fixed size, a full deque runs the job inline
+  class Deque {
+    static constexpr int64_t CAPACITY = 4096;
+    alignas(64) std::atomic<int64_t> top_;
+    alignas(64) std::atomic<int64_t> bottom_;
+    std::atomic<Job*> jobs_[CAPACITY];
+  public:
+    Deque() : top_(0), bottom_(0) {}
+    bool push(Job*) noexcept;
+    Job* pop() noexcept;
+    Job* steal() noexcept;
+  };
+
+  unsigned concurrency_;
+  std::vector<std::thread> threads_;
+  std::unique_ptr<Deque[]> deques_; // [0] is the main thread's
+  std::thread::id main_id_;
+
+  std::mutex inject_mtx_;
+  std::deque<Job*> injected_, main_jobs_;
+  std::atomic<size_t> injected_count_, main_count_;
+
+  // sleeping workers wake when the epoch moves
+  std::mutex sleep_mtx_;
+  std::condition_variable sleep_cv_;
+  std::atomic<uint32_t> epoch_;
+  std::atomic<unsigned> sleepers_;
+  bool stop_;
+
+  int ownIndex() const noexcept;
+  void submit(Job*) noexcept;
+  void wake() noexcept;
+  Job* take(int, uint32_t&) noexcept;
+  Job* takeMain() noexcept;
+  void execute(Job*) noexcept;
+  void workerLoop(int) noexcept;
+
+public:
+  // 0 picks hardware_concurrency, the count includes the calling thread
+  explicit HaruhiWorkerPool(unsigned = 0);
+  // drains every queued job first
+  ~HaruhiWorkerPool();
+
+  HaruhiWorkerPool(const HaruhiWorkerPool&) = delete;
+  HaruhiWorkerPool& operator=(const HaruhiWorkerPool&) = delete;
+
+  unsigned concurrency() const noexcept;
+  bool isMainThread() const noexcept;
+
+  // from any thread, the counter is optional
+  void run(JobFn, Counter* = nullptr) noexcept;
+  void runOnMain(JobFn, Counter* = nullptr) noexcept;
+
+  // runs jobs until the counter is done
+  void wait(Counter&) noexcept;
+  // main thread only, returns how many ran
+  size_t runMainJobs() noexcept;
+
+  // calls fn(begin, end) over [0, count) in chunks of grain, blocks until
+  // done. the caller takes chunks too
+  void parallelFor(size_t, size_t, const RangeFn&) noexcept;
+};
+
+// per frame graph of tasks over the pool
+//
+// a task starts once every task preceding it is done. build it once and
+// run it every frame, run blocks until all tasks are done and has to be
+// called on the pool's main thread when the graph has main thread tasks
+class HaruhiTaskGraph {
+public:
+  using Task = uint32_t;
+
+private:
+  struct Node {
+    const char* name;
+    HaruhiWorkerPool::JobFn fn;
+    bool main_thread;
+    std::vector<Task> successors;
+    uint32_t predecessors;
+    std::atomic<uint32_t> remaining;
+  };
+
+  std::deque<Node> nodes_;
+
+  void schedule(HaruhiWorkerPool&, HaruhiWorkerPool::Counter&, Task) noexcept;
+
+public:
+  // the name also marks the task's runs for the profiler, it has to
+  // outlive the graph
+  Task add(const char*, HaruhiWorkerPool::JobFn, bool = false);
+  // before runs to completion before after starts
+  void precede(Task, Task);
+
+  // aborts on a cycle
+  void run(HaruhiWorkerPool&) noexcept;
+
+  size_t size() const noexcept { return nodes_.size(); }
+  const char* name(Task t) const noexcept { return nodes_[t].name; }
+  void clear() noexcept { nodes_.clear(); }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef HARUHI_TEST_EXPECT_HXX
+#define HARUHI_TEST_EXPECT_HXX
+
+#include <cstdio>
+
+// every test is one translation unit, main reports the count at the end
+static int failures = 0;
+
+// records a failed expectation and keeps going
+#define expect(cond) do { \
+  if(!(cond)) { \
+    printf("%s:%d: expectation failed: %s\n", __FILE__, __LINE__, #cond); \
+    ++failures; \
+  } \
+} while(0)
+
+#endif
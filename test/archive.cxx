@@ -0,0 +1,152 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <AssetArchive.hxx>
+
+#include "Expect.hxx"
+
+static std::vector<uint8_t>
+pattern(uint32_t w, uint32_t h, uint8_t seed) {
+  std::vector<uint8_t> px((size_t)w * h * 4);
+  for(size_t i = 0; i < px.size(); ++i)
+    px[i] = (uint8_t)(i * 31 + seed);
+  return px;
+}
+
+static bool
+sameRows(const uint8_t* a, size_t pitchA, const uint8_t* b, size_t pitchB, size_t row, uint32_t rows) {
+  for(uint32_t y = 0; y < rows; ++y)
+    if(memcmp(a + y * pitchA, b + y * pitchB, row)) return false;
+  return true;
+}
+
+static void
+corrupt(const char* pth, size_t off, uint8_t v) {
+  FILE* fp = fopen(pth, "r+b");
+  fseek(fp, off, SEEK_SET);
+  fwrite(&v, 1, 1, fp);
+  fclose(fp);
+}
+
+int main() {
+  using namespace archive;
+
+  const char* pth = "test_archive.hpak";
+
+  // 37 * 4 bytes per row forces padding, a mip chain down to 1x1
+  const auto l0 = pattern(37, 20, 1), l1 = pattern(18, 10, 2), l2 = pattern(9, 5, 3),
+             l3 = pattern(4, 2, 4), l4 = pattern(2, 1, 5), l5 = pattern(1, 1, 6);
+  const HaruhiAssetPacker::Image chain[] = {
+    { 37, 20, l0.data(), 0 }, { 18, 10, l1.data(), 0 }, { 9, 5, l2.data(), 0 },
+    { 4, 2, l3.data(), 0 }, { 2, 1, l4.data(), 0 }, { 1, 1, l5.data(), 0 } };
+
+  // source rows with their own pitch
+  std::vector<uint8_t> padded(64 * 64 * 4 + 16 * 64, 0xee);
+  const auto flat = pattern(64, 64, 7);
+  for(uint32_t y = 0; y < 64; ++y)
+    memcpy(padded.data() + y * (64 * 4 + 16), flat.data() + y * 64 * 4, 64 * 4);
+  const HaruhiAssetPacker::Image big = { 64, 64, padded.data(), 64 * 4 + 16 };
+
+  HaruhiAssetPacker packer;
+  expect(packer.addTexture("zeta", chain, 6));
+  expect(packer.addTexture("blocks", &big, 1));
+  expect(packer.addTexture("alpha", chain + 2, 1));
+
+  expect(!packer.addTexture("blocks", &big, 1));  // duplicate
+  expect(!packer.addTexture("", &big, 1));
+  expect(!packer.addTexture(std::string(NAME_LENGTH, 'x'), &big, 1));
+  expect(!packer.addTexture("gap", chain, 0));
+  const HaruhiAssetPacker::Image bad_chain[] = { chain[0], chain[2] };
+  expect(!packer.addTexture("gap", bad_chain, 2));
+  expect(packer.textureCount() == 3);
+
+  expect(packer.write(pth) == 0);
+
+  HaruhiAssetArchive ar;
+  expect(ar.open("does/not/exist.hpak") == -ENOENT);
+  expect(!ar.isOpen());
+
+  expect(ar.open(pth) == 0);
+  expect(ar.isOpen() && ar.textureCount() == 3);
+  expect(ar.size() % FILE_ALIGNMENT == 0);
+  expect(strcmp(ar.texture(0).name, "alpha") == 0);
+  expect(strcmp(ar.texture(2).name, "zeta") == 0);
+  expect(ar.findTexture("missing") == nullptr);
+  expect(ar.findTexture("") == nullptr);
+
+  const TextureEntry* z = ar.findTexture("zeta");
+  expect(z && z->mipCount == 6 && z->width == 37 && z->height == 20);
+  if(z) {
+    for(uint32_t l = 0; l < z->mipCount; ++l) {
+      const MipLevel& m = z->mips[l];
+      expect(m.offset % DATA_ALIGNMENT == 0);
+      expect(m.rowPitch % DATA_ALIGNMENT == 0);
+      expect(m.width == chain[l].width && m.height == chain[l].height);
+      expect(sameRows(ar.levelData(*z, l), m.rowPitch,
+                      static_cast<const uint8_t*>(chain[l].data), m.width * 4, m.width * 4, m.height));
+    }
+  }
+
+  const TextureEntry* b = ar.findTexture("blocks");
+  expect(b && b->mipCount == 1 && b->mips[0].rowPitch == 256);
+  if(b)
+    expect(sameRows(ar.levelData(*b, 0), 256, flat.data(), 256, 256, 64));
+
+  // tight rows when the gpu doesn't need any
+  HaruhiAssetPacker tight(4);
+  expect(tight.addTexture("t", chain, 1));
+  expect(tight.write(pth) == 0);
+  expect(ar.open(pth) == 0 && ar.textureCount() == 1);
+  expect(ar.texture(0).mips[0].rowPitch == 37 * 4);
+
+  // damaged files are rejected
+  corrupt(pth, 0, 'X');
+  expect(ar.open(pth) == -EINVAL && !ar.isOpen());
+  expect(tight.write(pth) == 0);
+  corrupt(pth, offsetof(Header, tocOffset), 0x01);
+  expect(ar.open(pth) == -EINVAL);
+  expect(tight.write(pth) == 0);
+  {
+    HaruhiAssetArchive ok;
+    expect(ok.open(pth) == 0);
+    const size_t toc = reinterpret_cast<const Header*>(ok.data())->tocOffset;
+    ok.close();
+    corrupt(pth, toc + offsetof(TextureEntry, mips) + offsetof(MipLevel, size) + 7, 0x7f);
+    expect(ar.open(pth) == -EINVAL);
+  }
+  expect(tight.write(pth) == 0);
+  {
+    HaruhiAssetArchive ok;
+    expect(ok.open(pth) == 0);
+    const size_t toc = reinterpret_cast<const Header*>(ok.data())->tocOffset;
+    ok.close();
+    // zero sized, consistently so
+    corrupt(pth, toc + offsetof(TextureEntry, width), 0);
+    corrupt(pth, toc + offsetof(TextureEntry, mips) + offsetof(MipLevel, width), 0);
+    expect(ar.open(pth) == -EINVAL);
+  }
+
+  // a level smaller than the chain says still fits its data, but not the texture
+  expect(packer.write(pth) == 0);
+  {
+    HaruhiAssetArchive ok;
+    expect(ok.open(pth) == 0);
+    const size_t zeta = reinterpret_cast<const Header*>(ok.data())->tocOffset + 2 * sizeof(TextureEntry);
+    ok.close();
+    corrupt(pth, zeta + offsetof(TextureEntry, mips) + sizeof(MipLevel) + offsetof(MipLevel, width), 17);
+    expect(ar.open(pth) == -EINVAL);
+  }
+
+  remove(pth);
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
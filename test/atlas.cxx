@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <Primitives.hxx>
+#include <TextureAtlas.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+static uint32_t
+texel(uint32_t sprite, uint32_t x, uint32_t y) {
+  return sprite * 2654435761u ^ (x * 73856093u) ^ (y * 19349663u);
+}
+
+static uint32_t
+read(const uint8_t* page, uint32_t size, uint32_t x, uint32_t y) {
+  uint32_t v;
+  memcpy(&v, page + ((size_t)y * size + x) * 4, 4);
+  return v;
+}
+
+int main() {
+  constexpr uint32_t PAGE = 256, PAD = 2, N = 300;
+
+  // deterministic mix of sizes, enough to spill onto several pages
+  std::vector<std::vector<uint32_t>> pixels(N);
+  std::vector<uint32_t> ws(N), hs(N);
+  HaruhiTextureAtlas atlas(PAGE, PAD);
+  uint32_t seed = 7;
+  for(uint32_t i = 0; i < N; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    ws[i] = 1 + (seed >> 8) % 40;
+    hs[i] = 1 + (seed >> 20) % 40;
+    pixels[i].resize(ws[i] * hs[i]);
+    for(uint32_t y = 0; y < hs[i]; ++y)
+      for(uint32_t x = 0; x < ws[i]; ++x)
+        pixels[i][y * ws[i] + x] = texel(i, x, y);
+    expect(atlas.add("sprite" + std::to_string(i), ws[i], hs[i], pixels[i].data()));
+  }
+
+  expect(!atlas.add("sprite3", 4, 4));                   // duplicate
+  expect(!atlas.add("huge", PAGE - 2 * PAD + 1, 4));     // can't fit with its gutter
+  expect(!atlas.add("empty", 0, 4));
+  expect(atlas.add("exact", PAGE - 2 * PAD, 8));
+  expect(atlas.find("sprite0") == nullptr);               // not packed yet
+
+  atlas.pack();
+  expect(atlas.pageCount() > 1);
+  expect(atlas.occupancy() > .5);
+
+  // every cell including the gutter is inside its page and overlaps no other
+  std::vector<std::vector<uint16_t>> owner(atlas.pageCount(), std::vector<uint16_t>(PAGE * PAGE, 0));
+  bool inside = true, disjoint = true;
+  for(size_t i = 0; i < atlas.spriteCount(); ++i) {
+    const auto& r = atlas.region(i);
+    if(r.x < PAD || r.y < PAD || r.x + r.width + PAD > PAGE || r.y + r.height + PAD > PAGE) {
+      inside = false;
+      continue;
+    }
+    for(uint32_t y = r.y - PAD; y < r.y + r.height + PAD; ++y)
+      for(uint32_t x = r.x - PAD; x < r.x + r.width + PAD; ++x) {
+        uint16_t& o = owner[r.layer][y * PAGE + x];
+        if(o) disjoint = false;
+        o = (uint16_t)(i + 1);
+      }
+  }
+  expect(inside);
+  expect(disjoint);
+
+  const auto* r7 = atlas.find("sprite7");
+  expect(r7 && r7->width == ws[7] && r7->height == hs[7]);
+  expect(atlas.find("nope") == nullptr);
+  if(r7) {
+    expect(r7->uvMin.x == r7->x / float(PAGE) && r7->uvMax.y == (r7->y + r7->height) / float(PAGE));
+
+    shader_t::VertexData verts[primitives::CUBE_VERTEX_COUNT];
+    uint16_t idx[primitives::CUBE_INDEX_COUNT];
+    primitives::makeCube(.5f, verts, idx);
+    atlas::remapTexcoords(*r7, verts, primitives::CUBE_VERTEX_COUNT);
+    bool in_rect = true;
+    for(auto& v : verts)
+      in_rect = in_rect && v.texcoord.x >= r7->uvMin.x && v.texcoord.x <= r7->uvMax.x
+        && v.texcoord.y >= r7->uvMin.y && v.texcoord.y <= r7->uvMax.y;
+    expect(in_rect);
+    expect(verts[0].texcoord.x == r7->uvMin.x && verts[0].texcoord.y == r7->uvMax.y);
+  }
+
+  // pixels land in place, gutters repeat the edge, same result on the pool
+  HaruhiWorkerPool pool(4);
+  for(int pass = 0; pass < 2; ++pass) {
+    atlas.compose(pass ? &pool : nullptr);
+    bool body = true, gutter = true;
+    for(uint32_t i = 0; i < N; ++i) {
+      const auto& r = *atlas.find("sprite" + std::to_string(i));
+      const uint8_t* page = atlas.pageData(r.layer);
+      for(uint32_t y = 0; y < r.height; ++y)
+        for(uint32_t x = 0; x < r.width; ++x)
+          body = body && read(page, PAGE, r.x + x, r.y + y) == texel(i, x, y);
+      const uint32_t w = r.width - 1, h = r.height - 1;
+      gutter = gutter
+        && read(page, PAGE, r.x - PAD, r.y - PAD) == texel(i, 0, 0)
+        && read(page, PAGE, r.x + w + PAD, r.y) == texel(i, w, 0)
+        && read(page, PAGE, r.x, r.y + h + 1) == texel(i, 0, h)
+        && read(page, PAGE, r.x + w + 1, r.y + h + PAD) == texel(i, w, h);
+    }
+    expect(body);
+    expect(gutter);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <BlockCompress.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+// smooth gradients with some detail, alpha ramps unless opaque
+static std::vector<uint8_t>
+image(uint32_t w, uint32_t h, bool opaque) {
+  std::vector<uint8_t> px((size_t)w * h * 4);
+  for(uint32_t y = 0; y < h; ++y)
+    for(uint32_t x = 0; x < w; ++x) {
+      uint8_t* p = px.data() + ((size_t)y * w + x) * 4;
+      p[0] = (uint8_t)(128 + 100 * std::sin(x * .11f));
+      p[1] = (uint8_t)(x * 255 / w);
+      p[2] = (uint8_t)(128 + 90 * std::cos((x + y) * .07f));
+      p[3] = opaque ? 255 : (uint8_t)(y * 255 / h);
+    }
+  return px;
+}
+
+static double
+roundTrip(texcomp::Codec c, texcomp::Quality q, const std::vector<uint8_t>& px,
+          uint32_t w, uint32_t h, bool alpha) {
+  std::vector<uint8_t> blocks(texcomp::encodedSize(c, w, h)), out(px.size());
+  texcomp::encode(c, q, px.data(), w, h, 0, blocks.data());
+  texcomp::decode(c, blocks.data(), w, h, out.data());
+  return texcomp::psnr(px.data(), out.data(), (size_t)w * h, alpha);
+}
+
+int main() {
+  using namespace texcomp;
+
+  expect(encodedSize(CODEC_BC1, 4, 4) == 8);
+  expect(encodedSize(CODEC_BC3, 5, 4) == 32);
+  expect(encodedSize(CODEC_ASTC_6x6, 12, 13) == 2 * 3 * 16);
+
+  // a solid color survives unchanged, BC7 mode 6 shares one p bit per
+  // endpoint so pure red is off by one there
+  {
+    std::vector<uint8_t> px(8 * 8 * 4);
+    for(size_t i = 0; i < px.size(); i += 4) {
+      px[i] = 255; px[i + 1] = 0; px[i + 2] = 0; px[i + 3] = 255;
+    }
+    for(uint32_t c = 0; c < CODEC_COUNT; ++c)
+      expect(roundTrip(Codec(c), QUALITY_FAST, px, 8, 8, true) >= (c == CODEC_BC7 ? 48. : 99.));
+
+    // 8 bit exact where the endpoints are
+    for(size_t i = 0; i < px.size(); i += 4) {
+      px[i] = 37; px[i + 1] = 201; px[i + 2] = 90; px[i + 3] = 140;
+    }
+    expect(roundTrip(CODEC_ASTC_4x4, QUALITY_FAST, px, 8, 8, true) == 99.);
+    expect(roundTrip(CODEC_ASTC_6x6, QUALITY_FAST, px, 8, 8, true) == 99.);
+    expect(roundTrip(CODEC_BC3, QUALITY_FAST, px, 8, 8, true) > 40.);
+    expect(roundTrip(CODEC_BC7, QUALITY_FAST, px, 8, 8, true) > 45.);
+  }
+
+  // gradients keep a usable quality, high never does worse than fast
+  {
+    const uint32_t W = 64, H = 64;
+    const auto opaque = image(W, H, true), alpha = image(W, H, false);
+    const double min_psnr[CODEC_COUNT] = { 32., 32., 38., 34., 28. };
+    for(uint32_t c = 0; c < CODEC_COUNT; ++c) {
+      const bool a = c != CODEC_BC1;
+      const auto& px = a ? alpha : opaque;
+      const double fast = roundTrip(Codec(c), QUALITY_FAST, px, W, H, a);
+      const double high = roundTrip(Codec(c), QUALITY_HIGH, px, W, H, a);
+      if(fast < min_psnr[c] || high + .01 < fast)
+        printf("%s: fast %.2f high %.2f dB\n", codecName(Codec(c)), fast, high);
+      expect(fast >= min_psnr[c]);
+      expect(high + .01 >= fast);
+    }
+  }
+
+  // BC1 cutout alpha decodes to transparent black or opaque
+  {
+    std::vector<uint8_t> px(4 * 4 * 4), out(px.size()), blk(8);
+    for(uint32_t i = 0; i < 16; ++i) {
+      px[i * 4] = 200; px[i * 4 + 1] = 100; px[i * 4 + 2] = 50;
+      px[i * 4 + 3] = i % 3 ? 255 : 0;
+    }
+    encode(CODEC_BC1, QUALITY_HIGH, px.data(), 4, 4, 0, blk.data());
+    decode(CODEC_BC1, blk.data(), 4, 4, out.data());
+    bool ok = true;
+    for(uint32_t i = 0; i < 16; ++i)
+      ok = ok && (i % 3 ? out[i * 4 + 3] == 255 && std::abs(out[i * 4] - 200) < 8
+                        : out[i * 4 + 3] == 0 && out[i * 4] == 0);
+    expect(ok);
+  }
+
+  // partial edge blocks and padded rows, steep gradients at this size
+  {
+    const uint32_t W = 13, H = 7;
+    auto px = image(W, H, true);
+    std::vector<uint8_t> padded((size_t)H * 64, 0xee);
+    for(uint32_t y = 0; y < H; ++y)
+      memcpy(padded.data() + y * 64, px.data() + y * W * 4, W * 4);
+    for(uint32_t c = 0; c < CODEC_COUNT; ++c) {
+      std::vector<uint8_t> a(encodedSize(Codec(c), W, H)), b(a.size());
+      encode(Codec(c), QUALITY_FAST, px.data(), W, H, 0, a.data());
+      encode(Codec(c), QUALITY_FAST, padded.data(), W, H, 64, b.data());
+      expect(a == b);
+      expect(roundTrip(Codec(c), QUALITY_FAST, px, W, H, false) > 24.);
+    }
+  }
+
+  // identical on the pool
+  {
+    const uint32_t W = 90, H = 70;
+    const auto px = image(W, H, false);
+    HaruhiWorkerPool pool(4);
+    for(uint32_t c = 0; c < CODEC_COUNT; ++c) {
+      std::vector<uint8_t> a(encodedSize(Codec(c), W, H)), b(a.size());
+      encode(Codec(c), QUALITY_HIGH, px.data(), W, H, 0, a.data());
+      encode(Codec(c), QUALITY_HIGH, px.data(), W, H, 0, b.data(), &pool);
+      expect(a == b);
+    }
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,269 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <BoundsTree.hxx>
+#include <MathUtil.hxx>
+#include <SceneSystems.hxx>
+#include <VertexFormat.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+namespace {
+
+// distance of the box's farthest point past each plane, negative is outside
+float
+margin(const cull::Frustum& f, const cull::Aabb& b) {
+  const math::float3 c = (b.min + b.max) * .5f, e = (b.max - b.min) * .5f;
+  float m = INFINITY;
+  for(const auto& p : f.planes)
+    m = std::min(m, p.x * c.x + p.y * c.y + p.z * c.z + p.w
+                    + std::fabs(p.x) * e.x + std::fabs(p.y) * e.y + std::fabs(p.z) * e.z);
+  return m;
+}
+
+// every live box is reported exactly once when visible, never when
+// outside. boxes touching a plane may go either way
+bool
+sameAsBruteForce(const cull::Frustum& f, const std::vector<cull::Aabb>& boxes,
+                 const std::vector<char>& live, const std::vector<uint32_t>& got) {
+  constexpr float EPS = 1e-3f;
+  std::vector<int> seen(boxes.size(), 0);
+  for(uint32_t p : got) {
+    if(p >= boxes.size() || !live[p] || seen[p]++) return false;
+    if(margin(f, boxes[p]) < -EPS) return false;
+  }
+  for(size_t p = 0; p < boxes.size(); ++p)
+    if(live[p] && !seen[p] && margin(f, boxes[p]) > EPS) return false;
+  return true;
+}
+
+cull::Aabb
+randomBox(std::mt19937& rng) {
+  std::uniform_real_distribution<float> pos(-100.f, 100.f), size(.1f, 3.f);
+  const math::float3 c = { pos(rng), pos(rng), pos(rng) };
+  const math::float3 e = { size(rng), size(rng), size(rng) };
+  return { c - e, c + e };
+}
+
+} // ns
+
+int main() {
+  HaruhiWorkerPool pool(4);
+  const math::float4x4 proj = math::makePerspective(90. * 3.141592 / 180., 1., .1, 100.);
+
+  // planes of the camera at the origin looking down -z
+  {
+    const cull::Frustum f = cull::makeFrustum(proj);
+    auto box = [](float x, float y, float z, float h) {
+      return cull::Aabb{ { x - h, y - h, z - h }, { x + h, y + h, z + h } };
+    };
+    expect(cull::classify(f, box(0, 0, -5, .5)) == cull::RESULT_INSIDE);
+    expect(cull::classify(f, box(0, 0, 5, .5)) == cull::RESULT_OUTSIDE);
+    expect(cull::classify(f, box(0, 0, -200, .5)) == cull::RESULT_OUTSIDE);
+    expect(cull::classify(f, box(20, 0, -5, .5)) == cull::RESULT_OUTSIDE);
+    // 90 degrees, x = -z is the right plane
+    expect(cull::classify(f, box(5, 0, -5, .5)) == cull::RESULT_INTERSECTING);
+    expect(cull::classify(f, box(0, 0, -.1, .5)) == cull::RESULT_INTERSECTING);
+
+    // a moved camera moves the frustum
+    const cull::Frustum g = cull::makeFrustum(proj * math::makeTranslate({ -40., 0., 0. }));
+    expect(cull::classify(g, box(40, 0, -5, .5)) == cull::RESULT_INSIDE);
+    expect(cull::classify(g, box(0, 0, -5, .5)) == cull::RESULT_OUTSIDE);
+  }
+
+  // the tree agrees with testing every box, through moves, removes and inserts
+  {
+    std::mt19937 rng(7);
+    constexpr size_t N = 20000;
+    HaruhiBoundsTree tree;
+    std::vector<cull::Aabb> boxes;
+    std::vector<char> live;
+    for(size_t i = 0; i < N; ++i) {
+      const cull::Aabb b = randomBox(rng);
+      const uint32_t p = tree.insert(b);
+      expect(p == boxes.size());
+      boxes.push_back(b);
+      live.push_back(1);
+    }
+    expect(tree.size() == N && tree.pending() == N);
+    tree.refit();
+    expect(tree.pending() == 0);
+
+    const cull::Frustum views[] = {
+      cull::makeFrustum(proj),
+      cull::makeFrustum(proj * math::makeYRotate(1.3)),
+      cull::makeFrustum(proj * math::makeTranslate({ 0., 0., 90. })),
+      cull::makeFrustum(proj * math::makeXRotate(-.4) * math::makeTranslate({ 30., -20., 10. }))
+    };
+    auto check = [&]() {
+      for(const cull::Frustum& f : views) {
+        std::vector<uint32_t> serial, parallel;
+        const cull::Stats s = tree.cull(f, serial);
+        const cull::Stats p = tree.cull(f, parallel, &pool);
+        expect(sameAsBruteForce(f, boxes, live, serial));
+        expect(serial == parallel);
+        expect(s.visible == serial.size() && s.visible + s.culled == tree.size());
+        expect(p.visible == s.visible && p.tested == s.tested);
+        expect(s.tested <= tree.size() && s.nodes > 0);
+      }
+    };
+    check();
+
+    // the camera at the origin sees a small part, most boxes never get tested
+    {
+      std::vector<uint32_t> out;
+      const cull::Stats s = tree.cull(views[0], out);
+      expect(s.culled > N / 2 && s.tested < N / 2);
+    }
+
+    std::uniform_int_distribution<size_t> pick(0, N - 1);
+    for(size_t i = 0; i < N / 4; ++i) {
+      const size_t p = pick(rng);
+      boxes[p] = randomBox(rng);
+      tree.update(p, boxes[p]);
+    }
+    tree.refit(&pool);
+    check();
+
+    for(size_t i = 0; i < N / 3; ++i) {
+      const size_t p = pick(rng);
+      if(!live[p]) continue;
+      tree.remove(p);
+      live[p] = 0;
+    }
+    tree.refit();
+    check();
+
+    // a few inserts wait in the flat list, reusing freed proxies
+    for(size_t i = 0; i < 500; ++i) {
+      const cull::Aabb b = randomBox(rng);
+      const uint32_t p = tree.insert(b);
+      expect(p < boxes.size() && !live[p]);
+      boxes[p] = b;
+      live[p] = 1;
+    }
+    tree.refit();
+    expect(tree.pending() == 500);
+    check();
+    // moves and removes hitting both tree slots and pending inserts
+    for(size_t i = 0, moved = 0; i < boxes.size() && moved < 100; ++i) {
+      if(!live[i]) continue;
+      boxes[i] = randomBox(rng);
+      tree.update(i, boxes[i]);
+      if(++moved % 2) { tree.remove(i); live[i] = 0; }
+    }
+    tree.refit();
+    check();
+
+    // enough of them rebuild the tree
+    for(size_t i = 0; i < N / 4; ++i) {
+      const cull::Aabb b = randomBox(rng);
+      const uint32_t p = tree.insert(b);
+      if(p >= boxes.size()) { boxes.resize(p + 1); live.resize(p + 1, 0); }
+      boxes[p] = b;
+      live[p] = 1;
+    }
+    tree.refit(&pool);
+    expect(tree.pending() == 0);
+    check();
+
+    bool same = true;
+    for(uint32_t p = 0; p < boxes.size(); ++p)
+      if(live[p]) same = same && std::fabs(tree.bounds(p).min.y - boxes[p].min.y) < 1e-4f;
+    expect(same);
+  }
+
+  // small and empty trees
+  {
+    HaruhiBoundsTree tree;
+    std::vector<uint32_t> out;
+    cull::Stats s = tree.cull(cull::makeFrustum(proj), out, &pool);
+    expect(out.empty() && s.visible == 0 && s.culled == 0);
+
+    const uint32_t a = tree.insert({ { -1., -1., -6. }, { 1., 1., -4. } });
+    tree.rebuild();
+    s = tree.cull(cull::makeFrustum(proj), out);
+    expect(out.size() == 1 && out[0] == a && s.culled == 0);
+    tree.update(a, { { -1., -1., 4. }, { 1., 1., 6. } });
+    tree.refit();
+    out.clear();
+    s = tree.cull(cull::makeFrustum(proj), out);
+    expect(out.empty() && s.culled == 1);
+  }
+
+  // scene side, entities follow their transforms and leave with them
+  {
+    using scene::Transform;
+    using scene::Mesh;
+    using scene::Bounds;
+
+    HaruhiEntityWorld world;
+    HaruhiVisibility visibility;
+    std::vector<ecs::Entity> front, back;
+    for(int i = 0; i < 1000; ++i) {
+      const float x = float(i % 20) - 10.f;
+      const float z = i % 2 ? -20.f : 20.f;
+      const ecs::Entity e = world.create(
+        Transform{ { x, 0., z }, { 0., 0., 0., 1. }, { 1., 1., 1. } },
+        Mesh{ { 1., 1., 1., 1. }, 0 },
+        Bounds{ { .5, .5, .5 }, cull::NULL_PROXY });
+      (i % 2 ? front : back).push_back(e);
+    }
+    visibility.update(world, &pool);
+    auto visible = visibility.cull(proj, &pool);
+    expect(visible.size() == front.size());
+    expect(visibility.stats().culled == back.size());
+
+    // the back half moves in front, turning the cubes on the spot keeps them
+    for(const ecs::Entity e : back)
+      world.get<Transform>(e)->position.z = -20.f;
+    for(const ecs::Entity e : front)
+      world.get<Transform>(e)->rotation = math::makeQuat({ 0., 1., 0. }, 3.141592f);
+    visibility.update(world, &pool);
+    visible = visibility.cull(proj, &pool);
+    expect(visible.size() == front.size() + back.size());
+
+    for(const ecs::Entity e : front)
+      world.get<Transform>(e)->position.z = 20.f;
+    world.destroy(back[0]);
+    world.remove<Bounds>(back[1]);
+    visibility.update(world);
+    visible = visibility.cull(proj);
+    expect(visible.size() == back.size() - 2);
+    expect(visibility.tree().size() == front.size() + back.size() - 2);
+
+    std::vector<shader_t::InstanceData> instances(visible.size());
+    HaruhiInstanceGather gather;
+    const scene::InstanceRange r =
+      gather.writeVisible(world, visible.data(), visible.size(), instances.data(), instances.size(), &pool);
+    expect(r.composed == visible.size() && r.first == 0 && r.last == visible.size());
+    bool placed = true;
+    for(size_t i = 0; i < visible.size(); ++i)
+      placed = placed && instances[i].instanceTransform.columns[3].z == -20.f
+                      && instances[i].instanceTransform.columns[3].x ==
+                         world.get<const Transform>(visible[i])->position.x;
+    expect(placed);
+
+    // what the renderer uploads, the same instances a quarter the size
+    std::vector<shader_t::CompactInstanceData> compact(visible.size());
+    expect(gather.writeVisible(world, visible.data(), visible.size(), compact.data(), compact.size(),
+                               &pool).composed == visible.size());
+    bool same = true;
+    for(size_t i = 0; i < visible.size(); ++i) {
+      const shader_t::InstanceData e = vtx::expandInstance(compact[i]);
+      same = same && e.instanceTransform.columns[3].x == instances[i].instanceTransform.columns[3].x
+                  && e.instanceTransform.columns[3].z == -20.f;
+    }
+    expect(same);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <DrawQueue.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+namespace {
+
+using Op = HaruhiNullDrawBackend::Op;
+
+// firstIndex names the packet
+cmd::Packet
+packet(uint16_t pipeline, uint16_t texture, uint16_t vertices, uint32_t id) {
+  return { pipeline, 0, texture, vertices, 0, 0, 0, id, 36, 1, 0 };
+}
+
+} // ns
+
+int main() {
+  HaruhiWorkerPool pool(4);
+
+  // key order: pass, then state, then depth
+  {
+    expect(cmd::makeKey(cmd::PASS_OPAQUE, 9, 9, 1000.f) < cmd::makeKey(cmd::PASS_TRANSPARENT, 0, 0, 0.f));
+    expect(cmd::makeKey(0, 1, 9, 1000.f) < cmd::makeKey(0, 2, 0, 0.f));
+    expect(cmd::makeKey(0, 1, 1, 1000.f) < cmd::makeKey(0, 1, 2, 0.f));
+    expect(cmd::makeKey(0, 1, 1, .5f) < cmd::makeKey(0, 1, 1, 2.f));
+    expect(cmd::makeKey(0, 1, 1, -3.f) == cmd::makeKey(0, 1, 1, 0.f));
+    // blending draws far ones first, across pipelines
+    expect(cmd::makeBackToFrontKey(1, 5, 0, 10.f) < cmd::makeBackToFrontKey(1, 0, 0, 2.f));
+    expect(cmd::makeBackToFrontKey(1, 0, 0, 2.f) < cmd::makeBackToFrontKey(2, 0, 0, 10.f));
+    expect(cmd::makeKey(cmd::PASS_OPAQUE, 0, 0, 1.f) < cmd::makeBackToFrontKey(cmd::PASS_TRANSPARENT, 0, 0, 1.f));
+  }
+
+  // the merged stream is a stable sort over the lists in order
+  {
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<unsigned> small(0, 3);
+    std::uniform_real_distribution<float> depth(0.f, 100.f);
+    HaruhiDrawQueue queue;
+    queue.reset(5);
+    std::vector<std::tuple<uint64_t, size_t, uint32_t>> ref;
+    uint32_t id = 0;
+    for(size_t l = 0; l < 5; ++l)
+      for(int i = 0; i < 3000; ++i, ++id) {
+        // few distinct depths, plenty of ties
+        const uint64_t key = cmd::makeKey(small(rng), small(rng), small(rng), float(int(depth(rng))));
+        queue.list(l).add(key, packet(0, 0, 0, id));
+        ref.emplace_back(key, l, id);
+      }
+    std::sort(ref.begin(), ref.end());
+    queue.sort();
+    expect(queue.sorted().size() == ref.size());
+    bool same = true;
+    for(size_t i = 0; i < ref.size(); ++i)
+      same = same && queue.sorted()[i].firstIndex == std::get<2>(ref[i]);
+    expect(same);
+
+    // a reset forgets everything, an empty queue submits nothing
+    queue.reset(2);
+    queue.sort();
+    HaruhiNullDrawBackend backend;
+    const cmd::SubmitStats s = queue.submit(backend);
+    expect(queue.sorted().empty() && s.draws == 0 && backend.count(HaruhiNullDrawBackend::OP_DRAW) == 0);
+  }
+
+  // only state that changes is bound
+  {
+    HaruhiDrawQueue queue;
+    queue.reset(1);
+    cmd::DrawList& list = queue.list(0);
+    // recorded out of order, pipeline 1 texture 0 draws first
+    list.add(cmd::makeKey(0, 2, 0, 1.f), packet(2, 0, 7, 0));
+    list.add(cmd::makeKey(0, 1, 1, 1.f), packet(1, 1, 7, 1));
+    list.add(cmd::makeKey(0, 1, 0, 2.f), packet(1, 0, 8, 2));
+    list.add(cmd::makeKey(0, 1, 0, 1.f), packet(1, 0, 7, 3));
+    cmd::Packet moved = packet(2, 0, 7, 4);
+    moved.instanceOffset = 256;
+    list.add(cmd::makeKey(0, 2, 0, 5.f), moved);
+    queue.sort();
+
+    HaruhiNullDrawBackend backend(true);
+    const cmd::SubmitStats s = queue.submit(backend);
+    expect(s.draws == 5 && s.pipelines == 2 && s.textures == 3 && s.depthStates == 1);
+    expect(s.vertexBuffers == 3 && s.instanceBuffers == 2);
+
+    std::vector<uint32_t> order;
+    std::vector<Op> ops;
+    for(const auto& c : backend.calls()) {
+      ops.push_back(c.op);
+      if(c.op == HaruhiNullDrawBackend::OP_DRAW) order.push_back(c.args[0]);
+    }
+    expect((order == std::vector<uint32_t>{ 3, 2, 1, 0, 4 }));
+    const std::vector<Op> expected = {
+      HaruhiNullDrawBackend::OP_PIPELINE, HaruhiNullDrawBackend::OP_DEPTH_STATE,
+      HaruhiNullDrawBackend::OP_TEXTURE, HaruhiNullDrawBackend::OP_VERTEX_BUFFER,
+      HaruhiNullDrawBackend::OP_INSTANCE_BUFFER, HaruhiNullDrawBackend::OP_DRAW,
+      HaruhiNullDrawBackend::OP_VERTEX_BUFFER, HaruhiNullDrawBackend::OP_DRAW,
+      HaruhiNullDrawBackend::OP_TEXTURE, HaruhiNullDrawBackend::OP_VERTEX_BUFFER,
+      HaruhiNullDrawBackend::OP_DRAW,
+      HaruhiNullDrawBackend::OP_PIPELINE, HaruhiNullDrawBackend::OP_TEXTURE,
+      HaruhiNullDrawBackend::OP_DRAW,
+      HaruhiNullDrawBackend::OP_INSTANCE_BUFFER, HaruhiNullDrawBackend::OP_DRAW
+    };
+    expect(ops == expected);
+    expect(backend.indices() == 5 * 36);
+  }
+
+  // recording on the pool gives the same stream as on one thread
+  {
+    constexpr size_t N = 100000, GRAIN = 1000;
+    auto record = [&](HaruhiDrawQueue& queue, HaruhiWorkerPool* pPool) {
+      queue.reset(N / GRAIN);
+      auto fn = [&](size_t b, size_t e) {
+        for(size_t i = b; i < e; ++i) {
+          const uint32_t h = uint32_t(i * 2654435761u);
+          queue.list(i / GRAIN).add(cmd::makeKey(h >> 30, h >> 20 & 7, h >> 12 & 15, float(h & 1023)),
+                                    packet(h >> 20 & 7, h >> 12 & 15, h & 3, uint32_t(i)));
+        }
+      };
+      if(pPool) pPool->parallelFor(N, GRAIN, fn);
+      else fn(0, N);
+      queue.sort();
+    };
+    HaruhiDrawQueue serial, parallel;
+    record(serial, nullptr);
+    record(parallel, &pool);
+    bool same = serial.sorted().size() == N;
+    for(size_t i = 0; same && i < N; ++i)
+      same = serial.sorted()[i].firstIndex == parallel.sorted()[i].firstIndex;
+    expect(same);
+
+    HaruhiNullDrawBackend backend;
+    const cmd::SubmitStats s = serial.submit(backend);
+    expect(s.draws == N && backend.count(HaruhiNullDrawBackend::OP_DRAW) == N);
+    // sorting leaves a pipeline change per pass and pipeline at most
+    expect(s.pipelines <= 4 * 8 && s.textures <= 4 * 8 * 16);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
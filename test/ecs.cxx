@@ -0,0 +1,213 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <EntityWorld.hxx>
+#include <MathUtil.hxx>
+#include <SceneSystems.hxx>
+
+#include "Expect.hxx"
+
+namespace {
+
+struct Position { float x, y, z; };
+struct Velocity { float x, y, z; };
+struct Health { int hp; };
+struct Tag { };
+
+} // ns
+
+int main() {
+  HaruhiWorkerPool pool(4);
+
+  // creation, lookup, structural moves keep the component values
+  {
+    HaruhiEntityWorld world;
+    const auto a = world.create(Position{ 1, 2, 3 }, Velocity{ 1, 0, 0 });
+    const auto b = world.create(Position{ 4, 5, 6 });
+    expect(world.size() == 2 && world.alive(a) && world.alive(b));
+    expect(world.has<Velocity>(a) && !world.has<Velocity>(b));
+    expect(world.get<Position>(b)->y == 5 && !world.get<Velocity>(b));
+
+    world.add(b, Health{ 7 });
+    world.add(a, Tag{});
+    expect(world.get<Position>(b)->z == 6 && world.get<Health>(b)->hp == 7);
+    expect(world.get<Position>(a)->x == 1 && world.get<Velocity>(a)->x == 1);
+    world.add(b, Health{ 9 }); // replaces
+    expect(world.get<Health>(b)->hp == 9);
+
+    world.remove<Velocity>(a);
+    expect(!world.has<Velocity>(a) && world.has<Tag>(a) && world.get<Position>(a)->z == 3);
+
+    const size_t structure = world.structure();
+    world.destroy(a);
+    expect(!world.alive(a) && world.size() == 1 && world.structure() != structure);
+    world.destroy(a); // stale handles are ignored
+    const auto c = world.create(Health{ 1 });
+    expect(c.index == a.index && c.generation != a.generation);
+    expect(!world.alive(a) && !world.get<Health>(a));
+  }
+
+  // many entities over many chunks, swap removal keeps the rest intact
+  {
+    constexpr int N = 20000;
+    HaruhiEntityWorld world;
+    std::vector<ecs::Entity> es;
+    for(int i = 0; i < N; ++i)
+      es.push_back(i % 3 ? world.create(Position{ float(i), 0, 0 }, Velocity{ 1, 2, 3 })
+                         : world.create(Position{ float(i), 0, 0 }, Velocity{ 1, 2, 3 }, Health{ i }));
+    expect((world.count<Position, Velocity>() == N && world.count<Health>() == (N + 2) / 3));
+
+    for(int i = 0; i < N; i += 2)
+      world.destroy(es[i]);
+    bool kept = true;
+    for(int i = 1; i < N; i += 2)
+      kept = kept && world.get<Position>(es[i])->x == float(i);
+    expect(kept && world.size() == N / 2);
+
+    // chunk columns are cache line aligned and cover every entity once
+    size_t seen = 0, next = 0;
+    bool aligned = true, ordered = true;
+    world.eachChunk<Position, const Velocity>([&](const ecs::ChunkInfo& c, Position* p, const Velocity* v) {
+      aligned = aligned && reinterpret_cast<uintptr_t>(p) % 64 == 0 && reinterpret_cast<uintptr_t>(v) % 64 == 0;
+      ordered = ordered && c.first == next;
+      next += c.count;
+      for(size_t i = 0; i < c.count; ++i) {
+        p[i].x += v[i].x;
+        ++seen;
+      }
+    });
+    expect(aligned && ordered && seen == N / 2);
+
+    // the parallel walk sees the same
+    std::atomic<size_t> pseen(0);
+    world.each<Position, const Velocity>(&pool, [&](size_t n, Position* p, const Velocity* v) {
+      for(size_t i = 0; i < n; ++i)
+        p[i].y += v[i].y;
+      pseen.fetch_add(n);
+    });
+    expect(pseen.load() == N / 2);
+    bool moved = true;
+    for(int i = 1; i < N; i += 2) {
+      const Position* p = world.get<const Position>(es[i]);
+      moved = moved && p->x == float(i) + 1 && p->y == 2;
+    }
+    expect(moved);
+  }
+
+  // deferred changes apply in recording order, dead targets are dropped
+  {
+    HaruhiEntityWorld world;
+    HaruhiEntityCommands cmds;
+    const auto a = world.create(Health{ 3 });
+    const auto b = world.create(Health{ 0 });
+    world.each<const Health>([&](size_t n, const Health* h) {
+      for(size_t i = 0; i < n; ++i)
+        if(h[i].hp == 0) cmds.destroy(b);
+    });
+    cmds.add(a, Position{ 1, 1, 1 });
+    cmds.destroy(b);
+    cmds.add(b, Position{ 2, 2, 2 });
+    cmds.create(Position{ 5, 5, 5 }, Tag{});
+    cmds.remove<Health>(a);
+    expect(!cmds.empty());
+    world.apply(cmds);
+    expect(cmds.empty());
+    expect(!world.alive(b) && world.size() == 2);
+    expect(world.has<Position>(a) && !world.has<Health>(a));
+    expect((world.count<Position, Tag>() == 1));
+  }
+
+  // systems order by their component access, commands apply after the run
+  {
+    HaruhiEntityWorld world;
+    for(int i = 0; i < 1000; ++i)
+      world.create(Position{ 0, 0, 0 }, Velocity{ 1, 0, 0 });
+
+    HaruhiSystemSchedule schedule;
+    std::atomic<int> stage(0);
+    int move_at = -1, read_at = -1, free_at = -1;
+    float sum = 0;
+    const auto move = schedule.add("move", ecs::maskOf<Velocity>(), ecs::maskOf<Position>(),
+      [&](HaruhiEntityWorld& w, HaruhiEntityCommands&) {
+        w.each<Position, const Velocity>(&pool, [](size_t n, Position* p, const Velocity* v) {
+          for(size_t i = 0; i < n; ++i) p[i].x += v[i].x;
+        });
+        move_at = stage.fetch_add(1);
+      });
+    schedule.add("sum", ecs::maskOf<Position>(), 0,
+      [&](HaruhiEntityWorld& w, HaruhiEntityCommands& cmds) {
+        sum = 0;
+        w.each<const Position>([&](size_t n, const Position* p) {
+          for(size_t i = 0; i < n; ++i) sum += p[i].x;
+        });
+        cmds.create(Health{ 1 });
+        read_at = stage.fetch_add(1);
+      });
+    schedule.add("free", ecs::maskOf<Health>(), 0,
+      [&](HaruhiEntityWorld&, HaruhiEntityCommands&) { free_at = stage.fetch_add(1); });
+    expect(schedule.size() == 3 && schedule.name(move)[0] == 'm');
+
+    for(int frame = 1; frame <= 3; ++frame) {
+      schedule.run(world, pool);
+      expect(move_at < read_at && free_at >= 0);
+      expect(sum == 1000.f * frame);
+    }
+    expect(world.count<Health>() == 3);
+  }
+
+  // instance gather rewrites only the chunks written since the target's last write
+  {
+    using scene::Transform;
+    using scene::Mesh;
+    using scene::Spin;
+
+    HaruhiEntityWorld world;
+    constexpr size_t N = 3000;
+    for(size_t i = 0; i < N; ++i) {
+      const Transform t = { { float(i), 0., 0. }, { 0., 0., 0., 1. }, { 1., 2., 1. } };
+      const Mesh m = { { 1., 0., 0., 1. }, 0 };
+      if(i < 10)
+        world.create(t, m, Spin{ { 0., 0., 0., 1. }, { 0., 1., 0. }, 0., .5 });
+      else
+        world.create(t, m);
+    }
+    HaruhiInstanceGather gather(2);
+    std::vector<shader_t::InstanceData> buf0(N), buf1(N);
+    auto r = gather.write(world, 0, buf0.data(), N, &pool);
+    expect(r.composed == N && r.first == 0 && r.last == N);
+    r = gather.write(world, 0, buf0.data(), N, &pool);
+    expect(r.composed == 0 && r.first == r.last);
+
+    scene::spin(world, &pool);
+    r = gather.write(world, 0, buf0.data(), N);
+    expect(r.composed > 0 && r.composed < N);
+    r = gather.write(world, 1, buf1.data(), N);
+    expect(r.composed == N);
+
+    bool match = true;
+    world.eachChunk<const Transform, const Spin>([&](const ecs::ChunkInfo& c, const Transform* t, const Spin*) {
+      for(size_t i = 0; i < c.count; ++i) {
+        const math::float4x4 ref = math::makeTRS(t[i].position, t[i].rotation, t[i].scale);
+        for(size_t k = 0; k < N; ++k) {
+          if(buf0[k].instanceTransform.columns[3].x != t[i].position.x) continue;
+          match = match && std::fabs(buf0[k].instanceTransform.columns[0].x - ref.columns[0].x) < 1e-5f
+                        && std::fabs(ref.columns[0].x - std::cos(.5f)) < 1e-5f;
+        }
+      }
+    });
+    expect(match);
+
+    // a capacity smaller than the world drops the tail
+    HaruhiInstanceGather small;
+    r = small.write(world, 0, buf1.data(), 100);
+    expect(r.composed == 100 && r.last == 100);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
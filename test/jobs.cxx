@@ -0,0 +1,151 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+// every level spawns two children and waits on them
+static uint64_t
+fib(HaruhiWorkerPool& pool, int n) {
+  if(n < 12) {
+    uint64_t a = 0, b = 1;
+    for(int i = 0; i < n; ++i) {
+      const uint64_t c = a + b;
+      a = b;
+      b = c;
+    }
+    return a;
+  }
+  uint64_t x = 0, y = 0;
+  HaruhiWorkerPool::Counter c;
+  pool.run([&] { x = fib(pool, n - 1); }, &c);
+  pool.run([&] { y = fib(pool, n - 2); }, &c);
+  pool.wait(c);
+  return x + y;
+}
+
+int main() {
+  for(unsigned workers : { 1u, 4u }) {
+    HaruhiWorkerPool pool(workers);
+    expect(pool.concurrency() == workers);
+    expect(pool.isMainThread());
+
+    // counters, jobs spawning and waiting on jobs
+    expect(fib(pool, 25) == 75025);
+
+    {
+      std::atomic<int> sum(0);
+      HaruhiWorkerPool::Counter c;
+      for(int i = 1; i <= 10000; ++i)
+        pool.run([&sum, i] { sum.fetch_add(i, std::memory_order_relaxed); }, &c);
+      pool.wait(c);
+      expect(c.done() && sum.load() == 50005000);
+    }
+
+    // parallelFor covers every index once, and nests
+    {
+      std::vector<std::atomic<int>> hits(64 * 64);
+      pool.parallelFor(64, 1, [&](size_t b, size_t e) {
+        for(size_t y = b; y < e; ++y)
+          pool.parallelFor(64, 5, [&](size_t xb, size_t xe) {
+            for(size_t x = xb; x < xe; ++x)
+              hits[y * 64 + x].fetch_add(1, std::memory_order_relaxed);
+          });
+      });
+      bool once = true;
+      for(auto& h : hits) once = once && h.load() == 1;
+      expect(once);
+    }
+
+    // jobs handed in from outside threads
+    {
+      std::atomic<int> ran(0);
+      HaruhiWorkerPool::Counter c;
+      std::vector<std::thread> outside;
+      std::mutex mtx;
+      for(int t = 0; t < 4; ++t)
+        outside.emplace_back([&] {
+          HaruhiWorkerPool::Counter own;
+          for(int i = 0; i < 100; ++i)
+            pool.run([&] { ran.fetch_add(1, std::memory_order_relaxed); }, &own);
+          pool.wait(own);
+        });
+      for(auto& t : outside) t.join();
+      expect(ran.load() == 400);
+    }
+
+    // main thread jobs run on the main thread only, also when spawned by workers
+    {
+      const auto main_id = std::this_thread::get_id();
+      std::atomic<int> on_main(0), off_main(0);
+      HaruhiWorkerPool::Counter c;
+      for(int i = 0; i < 50; ++i)
+        pool.run([&] {
+          pool.runOnMain([&] {
+            (std::this_thread::get_id() == main_id ? on_main : off_main).fetch_add(1);
+          }, &c);
+        }, &c);
+      pool.wait(c);
+      expect(on_main.load() == 50 && off_main.load() == 0);
+
+      pool.runOnMain([&] { on_main.fetch_add(1); });
+      expect(pool.runMainJobs() == 1 && on_main.load() == 51);
+    }
+
+    // a diamond and a chain, every edge respected, main thread tasks included
+    {
+      HaruhiTaskGraph graph;
+      std::atomic<int> clock(0);
+      int at[6];
+      const auto main_id = std::this_thread::get_id();
+      bool encode_on_main = false;
+      auto stamp = [&](int i) { return [&, i] { at[i] = clock.fetch_add(1); }; };
+      const auto input = graph.add("input", stamp(0));
+      const auto transforms = graph.add("transforms", stamp(1));
+      const auto culling = graph.add("culling", stamp(2));
+      const auto decode = graph.add("decode", stamp(3));
+      const auto encode = graph.add("encode", [&] {
+        at[4] = clock.fetch_add(1);
+        encode_on_main = std::this_thread::get_id() == main_id;
+      }, true);
+      const auto meshing = graph.add("meshing", stamp(5));
+      graph.precede(input, transforms);
+      graph.precede(input, culling);
+      graph.precede(transforms, encode);
+      graph.precede(culling, encode);
+      graph.precede(decode, meshing);
+      graph.precede(meshing, encode);
+      expect(graph.size() == 6 && graph.name(culling)[0] == 'c');
+
+      for(int frame = 0; frame < 20; ++frame) {
+        graph.run(pool);
+        expect(at[0] < at[1] && at[0] < at[2] && at[3] < at[5]);
+        expect(at[1] < at[4] && at[2] < at[4] && at[5] < at[4]);
+        expect(encode_on_main);
+      }
+    }
+  }
+
+  // destruction runs whatever is still queued
+  {
+    std::atomic<int> ran(0);
+    {
+      HaruhiWorkerPool pool(3);
+      for(int i = 0; i < 1000; ++i)
+        pool.run([&] { ran.fetch_add(1); });
+      pool.runOnMain([&] { ran.fetch_add(1); });
+    }
+    expect(ran.load() == 1001);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
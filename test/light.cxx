@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <Terrain.hxx>
+#include <VoxelLight.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+namespace {
+
+constexpr int S = voxel::CHUNK_SIZE;
+using voxel::MAX_LIGHT;
+
+// chunks x and z in [-1, 1], y in [-1, 0]
+constexpr int LO = -S, HI_XZ = 2 * S, HI_Y = S;
+constexpr int W = HI_XZ - LO, H = HI_Y - LO;
+
+std::vector<voxel::ChunkCoord>
+box() {
+  std::vector<voxel::ChunkCoord> coords;
+  for(int x = -1; x <= 1; ++x)
+    for(int z = -1; z <= 1; ++z)
+      for(int y = -1; y <= 0; ++y) coords.push_back({ x, y, z });
+  return coords;
+}
+
+// the same light by relaxing every cell of the box until nothing
+// changes, open sky above it and nothing beside it
+std::vector<uint8_t>
+reference(const HaruhiVoxelWorld& world) {
+  auto at = [](int x, int y, int z) { return ((z - LO) * H + (y - LO)) * W + (x - LO); };
+  std::vector<uint8_t> light(size_t(W) * W * H, 0);
+  std::vector<voxel::Block> blocks(light.size());
+  for(int z = LO; z < HI_XZ; ++z)
+    for(int y = LO; y < HI_Y; ++y)
+      for(int x = LO; x < HI_XZ; ++x) blocks[at(x, y, z)] = world.get(x, y, z);
+
+  for(bool changed = true; changed;) {
+    changed = false;
+    for(int z = LO; z < HI_XZ; ++z)
+      for(int y = HI_Y - 1; y >= LO; --y)
+        for(int x = LO; x < HI_XZ; ++x) {
+          const voxel::BlockInfo& info = voxel::blockInfo(blocks[at(x, y, z)]);
+          int sky = 0, block = info.emission;
+          if(!info.opaque) {
+            const int up = y + 1 == HI_Y ? MAX_LIGHT : light[at(x, y + 1, z)] >> 4;
+            sky = up == MAX_LIGHT ? up : up - 1;
+            const int n[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+            for(const auto& d : n) {
+              const int nx = x + d[0], ny = y + d[1], nz = z + d[2];
+              if(nx < LO || ny < LO || nz < LO || nx >= HI_XZ || ny >= HI_Y || nz >= HI_XZ) continue;
+              const uint8_t l = light[at(nx, ny, nz)];
+              sky = std::max(sky, (l >> 4) - 1);
+              block = std::max(block, (l & MAX_LIGHT) - 1);
+            }
+          }
+          const uint8_t next = uint8_t(std::max(sky, 0) << 4 | block);
+          if(next == light[at(x, y, z)]) continue;
+          light[at(x, y, z)] = next;
+          changed = true;
+        }
+  }
+  return light;
+}
+
+// cells of the box where the two disagree
+size_t
+mismatches(const HaruhiVoxelLight& light, const std::vector<uint8_t>& expected) {
+  size_t bad = 0;
+  for(int z = LO, i = 0; z < HI_XZ; ++z)
+    for(int y = LO; y < HI_Y; ++y)
+      for(int x = LO; x < HI_XZ; ++x, ++i) bad += light.get(x, y, z) != expected[i];
+  return bad;
+}
+
+size_t
+mismatches(const HaruhiVoxelLight& a, const HaruhiVoxelLight& b) {
+  size_t bad = 0;
+  for(int z = LO; z < HI_XZ; ++z)
+    for(int y = LO; y < HI_Y; ++y)
+      for(int x = LO; x < HI_XZ; ++x) bad += a.get(x, y, z) != b.get(x, y, z);
+  return bad;
+}
+
+// hills crossing the chunk layers, caves, and a few lamps underground
+void
+build(HaruhiVoxelWorld& world) {
+  terrain::Settings s;
+  s.seed = 5;
+  s.amplitude = 24.f;
+  s.ground.frequency = 1.f / 48.f;
+  s.caveWidth = .12f;
+  const std::vector<voxel::ChunkCoord> coords = box();
+  terrain::generate(s, world, coords.data(), coords.size());
+  std::mt19937 rng(2);
+  std::uniform_int_distribution<int> xz(LO, HI_XZ - 1), y(LO, HI_Y - 1);
+  for(int i = 0; i < 40; ++i) world.set(xz(rng), y(rng), xz(rng), voxel::BLOCK_LAMP);
+}
+
+} // ns
+
+int main() {
+  // a whole relight is the relaxed light, the same on a pool
+  {
+    HaruhiVoxelWorld world, pooled;
+    build(world);
+    build(pooled);
+    HaruhiVoxelLight light(world), pooledLight(pooled);
+    const std::vector<voxel::ChunkCoord> coords = box();
+    expect(light.relight(coords.data(), coords.size()) == coords.size());
+    HaruhiWorkerPool pool(4);
+    expect(pooledLight.relight(coords.data(), coords.size(), &pool) == coords.size());
+
+    const std::vector<uint8_t> expected = reference(world);
+    expect(mismatches(light, expected) == 0);
+    expect(mismatches(light, pooledLight) == 0);
+    expect(std::count(expected.begin(), expected.end(), voxel::FULL_SKY) > 1000);
+    expect(std::any_of(expected.begin(), expected.end(), [](uint8_t l) { return (l & MAX_LIGHT) == MAX_LIGHT - 1; }));
+
+    // chunks lit in two goes exchange light across the seam
+    HaruhiVoxelWorld halves;
+    build(halves);
+    HaruhiVoxelLight halvesLight(halves);
+    std::vector<voxel::ChunkCoord> west, east;
+    for(const voxel::ChunkCoord& c : coords) (c.x < 0 ? west : east).push_back(c);
+    halvesLight.relight(east.data(), east.size());
+    halvesLight.relight(west.data(), west.size(), &pool);
+    expect(mismatches(halvesLight, expected) == 0);
+    // and the bottom layer after the top one
+    HaruhiVoxelWorld layers;
+    build(layers);
+    HaruhiVoxelLight layersLight(layers);
+    std::vector<voxel::ChunkCoord> top, bottom;
+    for(const voxel::ChunkCoord& c : coords) (c.y < 0 ? bottom : top).push_back(c);
+    layersLight.relight(bottom.data(), bottom.size());
+    layersLight.relight(top.data(), top.size());
+    expect(mismatches(layersLight, expected) == 0);
+  }
+
+  // edits update the light as a relight from scratch would
+  {
+    HaruhiVoxelWorld world;
+    build(world);
+    HaruhiVoxelLight light(world);
+    const std::vector<voxel::ChunkCoord> coords = box();
+    light.relight(coords.data(), coords.size());
+
+    std::mt19937 rng(9);
+    std::uniform_int_distribution<int> xz(LO, HI_XZ - 1), y(LO, HI_Y - 1), kind(0, 3);
+    size_t writes = 0;
+    for(int i = 0; i < 60; ++i) {
+      const voxel::Block blocks[] = { voxel::BLOCK_AIR, voxel::BLOCK_STONE, voxel::BLOCK_LAMP, voxel::BLOCK_LEAVES };
+      // near the surface, where the light is
+      int x = xz(rng), z = xz(rng), h = HI_Y - 1;
+      while(h > LO && world.get(x, h - 1, z) == voxel::BLOCK_AIR) --h;
+      const int at = std::min(HI_Y - 1, std::max(LO, h + y(rng) % 6));
+      world.set(x, at, z, blocks[kind(rng)]);
+      writes += light.changed(x, at, z);
+    }
+    expect(writes > 0);
+    expect(mismatches(light, reference(world)) == 0);
+    expect(world.pending() > 0);
+  }
+
+  // a lamp in a closed room, light falls off by walking distance
+  {
+    HaruhiVoxelWorld world;
+    voxel::BlockStorage& blocks = world.edit({ 0, 0, 0 });
+    blocks.fill(voxel::BLOCK_STONE);
+    for(int z = 4; z < 28; ++z)
+      for(int y = 4; y < 28; ++y)
+        for(int x = 4; x < 28; ++x) blocks.set((z * S + y) * S + x, voxel::BLOCK_AIR);
+    HaruhiVoxelLight light(world);
+    const voxel::ChunkCoord c = { 0, 0, 0 };
+    light.relight(&c, 1);
+    expect(light.get(16, 16, 16) == 0 && light.get(16, 31, 16) == 0);
+
+    world.set(16, 16, 16, voxel::BLOCK_LAMP);
+    const size_t placed = light.changed(16, 16, 16);
+    expect(placed > 1000);
+    bool falls = true;
+    for(int z = 4; z < 28; ++z)
+      for(int y = 4; y < 28; ++y)
+        for(int x = 4; x < 28; ++x) {
+          const int d = std::abs(x - 16) + std::abs(y - 16) + std::abs(z - 16);
+          if(d) falls &= light.get(x, y, z) == std::max(MAX_LIGHT - d, 0);
+        }
+    expect(falls);
+    expect(light.get(16, 16, 16) == MAX_LIGHT);
+    expect(light.get(16, 16, 3) == 0);
+
+    // a wall next to it, light walks around
+    world.set(17, 16, 16, voxel::BLOCK_STONE);
+    light.changed(17, 16, 16);
+    expect(light.get(18, 16, 16) == MAX_LIGHT - 4);
+
+    world.set(16, 16, 16, voxel::BLOCK_AIR);
+    light.changed(16, 16, 16);
+    bool dark = true;
+    for(int z = 4; z < 28; ++z)
+      for(int y = 4; y < 28; ++y)
+        for(int x = 4; x < 28; ++x) dark &= light.get(x, y, z) == 0;
+    expect(dark);
+
+    // opening the roof lets the sky in, closing it takes it away
+    for(int y = 28; y < S; ++y) world.set(10, y, 10, voxel::BLOCK_AIR), light.changed(10, y, 10);
+    expect(light.get(10, 4, 10) == voxel::FULL_SKY);
+    expect(light.get(11, 4, 10) == (MAX_LIGHT - 1) << 4);
+    world.set(10, 30, 10, voxel::BLOCK_DIRT);
+    light.changed(10, 30, 10);
+    expect(light.get(10, 4, 10) == 0);
+  }
+
+  // the light in front of a face is baked into its vertices and quads
+  // only merge over the same light
+  {
+    HaruhiVoxelWorld world;
+    for(int z = 0; z < S; ++z)
+      for(int x = 0; x < S; ++x) world.set(x, 0, z, voxel::BLOCK_STONE);
+    world.remesh();
+    expect(world.mesh({ 0, 0, 0 })->light.size() == world.mesh({ 0, 0, 0 })->vertices.size());
+    const size_t flat = world.mesh({ 0, 0, 0 })->quads();
+
+    HaruhiVoxelLight light(world);
+    const voxel::ChunkCoord c = { 0, 0, 0 };
+    light.relight(&c, 1);
+    world.set(16, 1, 16, voxel::BLOCK_LAMP);
+    light.changed(16, 1, 16);
+    world.remesh();
+    const voxel::ChunkMesh* mesh = world.mesh({ 0, 0, 0 });
+    expect(mesh->quads() > flat + 5);
+    expect(mesh->light.size() == mesh->vertices.size());
+
+    bool baked = true;
+    int lit = 0;
+    for(size_t q = 0; q < mesh->light.size(); q += 4) {
+      const shader_t::VertexData& v = mesh->vertices[q];
+      // the cell in front of the quad's first corner, stepping back on the
+      // axes where the corner is the quad's max
+      const float p[3] = { v.pos.x, v.pos.y, v.pos.z }, n[3] = { v.norm.x, v.norm.y, v.norm.z };
+      int cell[3];
+      for(int a = 0; a < 3; ++a) {
+        cell[a] = int(std::floor(p[a] + n[a] * .5f));
+        for(size_t k = 1; k < 4; ++k) {
+          const math::float3& o = mesh->vertices[q + k].pos;
+          const float oa = a == 0 ? o.x : a == 1 ? o.y : o.z;
+          if(oa < p[a]) cell[a] = int(p[a]) - 1;
+        }
+      }
+      for(size_t k = 0; k < 4; ++k) baked &= mesh->light[q + k] == mesh->light[q];
+      baked &= mesh->light[q] == light.get(cell[0], cell[1], cell[2]);
+      lit += (mesh->light[q] & MAX_LIGHT) == MAX_LIGHT - 1;
+    }
+    expect(baked);
+    expect(lit >= 4);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <MathUtil.hxx>
+
+#include "Expect.hxx"
+
+static bool
+near(const math::float4x4& a, const math::float4x4& b, float eps = 1e-5f) {
+  for(int c = 0; c < 4; ++c) {
+    const float* pa = &a.columns[c].x;
+    const float* pb = &b.columns[c].x;
+    for(int r = 0; r < 4; ++r)
+      if(std::fabs(pa[r] - pb[r]) > eps) return false;
+  }
+  return true;
+}
+
+static bool
+near(const math::float3& a, const math::float3& b, float eps = 1e-5f) {
+  return std::fabs(a.x - b.x) <= eps
+    && std::fabs(a.y - b.y) <= eps
+    && std::fabs(a.z - b.z) <= eps;
+}
+
+int main() {
+  using namespace math;
+
+  // row/column convention, translation lives in the last column
+  {
+    float4 p = makeTranslate({ 1., 2., 3. }) * float4(0., 0., 0., 1.);
+    expect(p.x == 1.f && p.y == 2.f && p.z == 3.f && p.w == 1.f);
+
+    float4x4 persp = makePerspective(1.2, 1.5, .1, 100.);
+    expect(persp.columns[2].w == -1.f);
+    expect(persp.columns[3].w == 0.f);
+  }
+
+  // matrix product against a naive reference
+  {
+    float4x4 a = makeXRotate(.3) * makeScale({ 2., 3., 4. });
+    float4x4 b = makeTranslate({ -1., 5., .5 }) * makeZRotate(1.1);
+    float4x4 ref{};
+    for(int c = 0; c < 4; ++c) {
+      float* o = &ref.columns[c].x;
+      for(int r = 0; r < 4; ++r)
+        for(int k = 0; k < 4; ++k)
+          o[r] += (&a.columns[k].x)[r] * (&b.columns[c].x)[k];
+    }
+    expect(near(a * b, ref));
+    expect(near(transpose(transpose(a)), a));
+  }
+
+  // fused builders equal the chained products
+  for(float t = -3.f; t < 3.f; t += .37f) {
+    const float3 pos = { t, -2.f * t, .5f };
+    expect(near(
+      makeTranslateXYRotate(pos, .2f * t, t),
+      makeTranslate(pos) * makeXRotate(.2f * t) * makeYRotate(t)));
+
+    const quat q = makeQuat({ 0., 1., 0. }, t);
+    expect(near(
+      makeTRS(pos, q, { 1., 2., 3. }),
+      makeTranslate(pos) * makeYRotate(t) * makeScale({ 1., 2., 3. })));
+  }
+
+  // quaternion rotation agrees with its matrix
+  {
+    const quat q = normalize(makeQuat({ 1., 2., 3. }, .7f) * makeQuat({ 0., 0., 1. }, -1.3f));
+    const float3 v = { .3, -.4, 2. };
+    expect(near(rotate(q, v), toMatrix(q) * v));
+    expect(near(rotate(conjugate(q), rotate(q, v)), v));
+    expect(near(rotate(nlerp(q, q, .5f), v), rotate(q, v)));
+  }
+
+  // normal matrix keeps the upper 3x3
+  {
+    float4x4 m = makeTranslateXYRotate({ 4., 5., 6. }, .4, .9);
+    float3x3 n = discardTranslation(m);
+    expect(near(n * float3(1., 0., 0.), m.columns[0].xyz()));
+    expect(n.columns[2]._pad == 0.f);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
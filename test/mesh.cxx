@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <MeshOptimizer.hxx>
+#include <Primitives.hxx>
+#include <VertexFormat.hxx>
+
+#include "Expect.hxx"
+
+namespace {
+
+using shader_t::VertexData;
+
+// n by n quads in the xy plane facing +z, rows of triangles
+void
+grid(int n, std::vector<VertexData>& verts, std::vector<uint32_t>& indices) {
+  for(int y = 0; y <= n; ++y)
+    for(int x = 0; x <= n; ++x)
+      verts.push_back({ { float(x), float(y), 0. }, { 0., 0., 1. }, { x / float(n), y / float(n) } });
+  for(int y = 0; y < n; ++y)
+    for(int x = 0; x < n; ++x) {
+      const uint32_t a = y * (n + 1) + x, b = a + 1, c = a + n + 1, d = c + 1;
+      indices.insert(indices.end(), { a, b, d, a, d, c });
+    }
+}
+
+// triangles as sorted triples of their rotations, winding kept
+std::vector<std::array<uint32_t, 3>>
+triangles(const std::vector<uint32_t>& indices) {
+  std::vector<std::array<uint32_t, 3>> out;
+  for(size_t i = 0; i < indices.size(); i += 3) {
+    std::array<uint32_t, 3> t = { indices[i], indices[i + 1], indices[i + 2] };
+    std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+    out.push_back(t);
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+void
+shuffleTriangles(std::vector<uint32_t>& indices, std::mt19937& rng) {
+  std::vector<size_t> order(indices.size() / 3);
+  for(size_t i = 0; i < order.size(); ++i) order[i] = i;
+  std::shuffle(order.begin(), order.end(), rng);
+  std::vector<uint32_t> out;
+  for(size_t t : order) out.insert(out.end(), indices.begin() + t * 3, indices.begin() + t * 3 + 3);
+  indices = out;
+}
+
+} // ns
+
+int main() {
+  std::mt19937 rng(3);
+
+  // octahedral normals come back within a hundredth of a degree
+  {
+    std::normal_distribution<float> g;
+    double worst = 0.;
+    std::vector<math::float3> dirs = { { 1., 0., 0. }, { 0., -1., 0. }, { 0., 0., 1. }, { 0., 0., -1. },
+                                       { -1., -1., -1. }, { 1., 0., -1. } };
+    for(int i = 0; i < 10000; ++i) dirs.push_back({ g(rng), g(rng), g(rng) });
+    for(math::float3 d : dirs) {
+      const float l = math::length(d);
+      d = { d.x / l, d.y / l, d.z / l };
+      int16_t e[2];
+      vtx::octEncode(d, e);
+      const math::float3 r = vtx::octDecode(e);
+      const math::float3 c = math::cross(d, r);
+      worst = std::max(worst, std::atan2(double(math::length(c)), double(math::dot(d, r))) * 180. / 3.14159265);
+      expect(std::fabs(math::length(r) - 1.f) < 1e-5f);
+    }
+    expect(worst < .01);
+  }
+
+  // packing a mesh loses less than a quantization step
+  {
+    std::uniform_real_distribution<float> pos(-50.f, 80.f), uv(-1.f, 3.f), n(-1.f, 1.f);
+    std::vector<VertexData> verts(1000), back(1000);
+    for(auto& v : verts) {
+      math::float3 d = { n(rng), n(rng), n(rng) + 2.f };
+      const float l = math::length(d);
+      v = { { pos(rng), pos(rng), pos(rng) }, { d.x / l, d.y / l, d.z / l }, { uv(rng), uv(rng) } };
+    }
+    const vtx::Quantization q = vtx::fitQuantization(verts.data(), verts.size());
+    std::vector<shader_t::PackedVertexData> packed(verts.size());
+    vtx::pack(verts.data(), verts.size(), q, packed.data());
+    vtx::unpack(packed.data(), packed.size(), q, back.data());
+    float posErr = 0.f, uvErr = 0.f, dot = 1.f;
+    for(size_t i = 0; i < verts.size(); ++i) {
+      const VertexData& a = verts[i];
+      const VertexData& b = back[i];
+      posErr = std::max({ posErr, std::fabs(a.pos.x - b.pos.x), std::fabs(a.pos.y - b.pos.y), std::fabs(a.pos.z - b.pos.z) });
+      uvErr = std::max({ uvErr, std::fabs(a.texcoord.x - b.texcoord.x), std::fabs(a.texcoord.y - b.texcoord.y) });
+      dot = std::min(dot, a.norm.x * b.norm.x + a.norm.y * b.norm.y + a.norm.z * b.norm.z);
+    }
+    expect(posErr <= q.scale * .5f * 1.01f && posErr > 0.f);
+    expect(uvErr <= std::max(q.texcoordScale.x, q.texcoordScale.y) * .5f * 1.01f);
+    expect(dot > .99999f);
+
+    // the shader's transform does the same as unpack
+    const shader_t::PackedMeshData md = vtx::meshData(q);
+    const math::float4 p = md.meshTransform * math::float4(packed[7].pos[0], packed[7].pos[1], packed[7].pos[2], 1.f);
+    expect(std::fabs(p.x - back[7].pos.x) < 1e-3f && std::fabs(p.z - back[7].pos.z) < 1e-3f);
+    const float u = packed[7].texcoord[0] * md.texcoordTransform.x + md.texcoordTransform.z;
+    expect(std::fabs(u - back[7].texcoord.x) < 1e-5f);
+
+    // outside the range is clamped, an empty mesh packs to nothing
+    VertexData far = verts[0];
+    far.pos.x = 1e6f;
+    shader_t::PackedVertexData fp;
+    vtx::pack(&far, 1, q, &fp);
+    expect(fp.pos[0] == 65535);
+    expect(vtx::fitQuantization(nullptr, 0).scale == 0.f);
+  }
+
+  // halves round to nearest even, every finite one survives the round trip
+  {
+    expect(vtx::toHalf(1.f) == 0x3C00 && vtx::toHalf(-2.f) == 0xC000);
+    expect(vtx::toHalf(65504.f) == 0x7BFF && vtx::toHalf(65520.f) == 0x7C00);
+    expect(vtx::toHalf(2049.f) == vtx::toHalf(2048.f) && vtx::toHalf(2051.f) == vtx::toHalf(2052.f));
+    expect(vtx::toHalf(0x1p-24f) == 1 && vtx::toHalf(1e-9f) == 0 && vtx::toHalf(-0.f) == 0x8000);
+    expect(vtx::fromHalf(0x7C00) == INFINITY && vtx::fromHalf(0x0001) == 0x1p-24f);
+    bool trip = true;
+    for(uint32_t h = 0; h < 0x10000; ++h)
+      if((h & 0x7C00) != 0x7C00) trip = trip && vtx::toHalf(vtx::fromHalf(uint16_t(h))) == h;
+    expect(trip);
+  }
+
+  // compact instances expand to the transform they were packed from, the
+  // normal transform to the inverse transpose up to its length
+  {
+    std::uniform_real_distribution<float> pos(-500.f, 500.f), unit(-1.f, 1.f), scale(.1f, 8.f);
+    float posErr = 0.f, colErr = 0.f, axisErr = 0.f, skew = 0.f;
+    for(int i = 0; i < 1000; ++i) {
+      const math::float3 p = { pos(rng), pos(rng), pos(rng) };
+      const math::quat q = math::normalize(math::quat{ unit(rng), unit(rng), unit(rng), unit(rng) });
+      const math::float3 s = i & 1 ? math::float3(scale(rng), scale(rng), scale(rng))
+                                   : math::float3(2.5f, 2.5f, 2.5f);
+      const math::float4 color = { unit(rng) * .5f + .5f, .25f, 1.f, 0.f };
+      const shader_t::InstanceData e = vtx::expandInstance(vtx::packInstance(p, q, s, color));
+      const math::float3x3 r = math::toMatrix(q);
+      const float sv[3] = { s.x, s.y, s.z };
+      for(int c = 0; c < 3; ++c) {
+        const math::float3 want = r.columns[c] * sv[c], got = e.instanceTransform.columns[c].xyz();
+        axisErr = std::max(axisErr, math::length(got - want) / sv[c]);
+        for(int k = 0; k < 3; ++k) {
+          // n_c . m_k is the determinant on the diagonal, zero off it
+          const float d = math::dot(e.instanceNormalTransform.columns[c], e.instanceTransform.columns[k].xyz());
+          const float det = s.x * s.y * s.z;
+          skew = std::max(skew, std::fabs(c == k ? d / det - 1.f : d / det));
+        }
+      }
+      posErr = std::max(posErr, math::length(e.instanceTransform.columns[3].xyz() - p));
+      colErr = std::max({ colErr, std::fabs(e.instanceColor.x - color.x), std::fabs(e.instanceColor.y - color.y),
+                          std::fabs(e.instanceColor.w - color.w) });
+      expect(e.instanceTransform.columns[3].w == 1.f && e.instanceTransform.columns[0].w == 0.f);
+    }
+    expect(posErr == 0.f);
+    expect(axisErr < 2e-3f);
+    expect(skew < 4e-3f);
+    expect(colErr <= .5f / 255.f + 1e-6f);
+    // the shader sees the same layout, its text comes from the one list
+    expect(strstr(shader_t::STRUCTS_SOURCE,
+                  "struct CompactInstanceData { packed_float3 position; uint color; uint rotation[2]; uint scale[2]; };"));
+  }
+
+  // a grid in any triangle order gets close to the best cache behaviour
+  {
+    std::vector<VertexData> verts;
+    std::vector<uint32_t> indices;
+    grid(40, verts, indices);
+    const auto before = triangles(indices);
+    const mesh::CacheStats ordered = mesh::analyzeVertexCache(indices.data(), indices.size(), verts.size());
+    shuffleTriangles(indices, rng);
+    const mesh::CacheStats shuffled = mesh::analyzeVertexCache(indices.data(), indices.size(), verts.size());
+    std::vector<uint32_t> opt(indices.size());
+    mesh::optimizeVertexCache(opt.data(), indices.data(), indices.size(), verts.size());
+    const mesh::CacheStats optimized = mesh::analyzeVertexCache(opt.data(), opt.size(), verts.size());
+    expect(triangles(opt) == before);
+    expect(shuffled.acmr > 2.f && optimized.acmr < .8f && optimized.acmr < ordered.acmr);
+    expect(optimized.atvr < 1.5f && optimized.atvr >= 1.f);
+    // every vertex once at best, three times per triangle at worst
+    expect(shuffled.transformed <= indices.size() && optimized.transformed >= verts.size());
+
+    // 16 bit indices give the same order
+    std::vector<uint16_t> small(indices.begin(), indices.end()), smallOpt(small.size());
+    mesh::optimizeVertexCache(smallOpt.data(), small.data(), small.size(), verts.size());
+    expect(std::equal(smallOpt.begin(), smallOpt.end(), opt.begin()));
+
+    // clusters keep the triangles and most of the cache efficiency
+    std::vector<uint32_t> od(opt.size());
+    mesh::optimizeOverdraw(od.data(), opt.data(), opt.size(), verts.data(), verts.size(), 1.05f);
+    expect(triangles(od) == before);
+    const mesh::CacheStats overdrawn = mesh::analyzeVertexCache(od.data(), od.size(), verts.size());
+    expect(overdrawn.acmr < optimized.acmr * 1.2f);
+
+    // vertices in first use order fetch far fewer lines than scattered ones
+    std::mt19937 vrng(11);
+    std::vector<uint32_t> perm(verts.size());
+    for(size_t i = 0; i < perm.size(); ++i) perm[i] = uint32_t(i);
+    std::shuffle(perm.begin(), perm.end(), vrng);
+    std::vector<VertexData> scattered(verts.size());
+    mesh::remapVertices(scattered.data(), verts.data(), verts.size(), sizeof(VertexData), perm.data());
+    std::vector<uint32_t> scatteredIdx(opt.size());
+    mesh::remapIndices(scatteredIdx.data(), opt.data(), opt.size(), perm.data());
+    const mesh::FetchStats loose = mesh::analyzeVertexFetch(scatteredIdx.data(), scatteredIdx.size(), verts.size(), sizeof(VertexData));
+
+    std::vector<uint32_t> remap(verts.size());
+    expect(mesh::optimizeVertexFetchRemap(remap.data(), scatteredIdx.data(), scatteredIdx.size(), verts.size()) == verts.size());
+    std::vector<VertexData> fetched(verts.size());
+    std::vector<uint32_t> fetchedIdx(opt.size());
+    mesh::remapVertices(fetched.data(), scattered.data(), verts.size(), sizeof(VertexData), remap.data());
+    mesh::remapIndices(fetchedIdx.data(), scatteredIdx.data(), scatteredIdx.size(), remap.data());
+    const mesh::FetchStats tight = mesh::analyzeVertexFetch(fetchedIdx.data(), fetchedIdx.size(), verts.size(), sizeof(VertexData));
+    expect(tight.overfetch < 1.5 && tight.overfetch < loose.overfetch * .7);
+    // the same positions behind the indices
+    bool same = true;
+    for(size_t i = 0; i < opt.size(); ++i)
+      same = same && fetched[fetchedIdx[i]].pos.x == verts[opt[i]].pos.x && fetched[fetchedIdx[i]].pos.y == verts[opt[i]].pos.y;
+    expect(same);
+  }
+
+  // the outward facing cluster goes first, unused vertices stay unmapped
+  {
+    // two quads sharing no vertices, both facing -z, at z 1 and z -1
+    std::vector<VertexData> verts;
+    for(float z : { 1.f, -1.f })
+      for(int i = 0; i < 4; ++i)
+        verts.push_back({ { float(i & 1), float(i >> 1), z }, { 0., 0., -1. }, { 0., 0. } });
+    verts.push_back({ { 9., 9., 9. }, { 0., 0., 1. }, { 0., 0. } });
+    // cw seen from -z is ccw seen from +z, so these face -z
+    const std::vector<uint32_t> indices = { 0, 3, 1, 0, 2, 3, 4, 7, 5, 4, 6, 7 };
+    std::vector<uint32_t> od(indices.size());
+    mesh::optimizeOverdraw(od.data(), indices.data(), indices.size(), verts.data(), verts.size(), 1.05f);
+    expect((od == std::vector<uint32_t>{ 4, 7, 5, 4, 6, 7, 0, 3, 1, 0, 2, 3 }));
+
+    std::vector<uint32_t> remap(verts.size());
+    expect(mesh::optimizeVertexFetchRemap(remap.data(), od.data(), od.size(), verts.size()) == 8);
+    expect(remap[4] == 0 && remap[8] == ~0u);
+  }
+
+  // the cube's 36 indices as 16 bit ones
+  {
+    VertexData verts[primitives::CUBE_VERTEX_COUNT];
+    uint16_t indices[primitives::CUBE_INDEX_COUNT], opt[primitives::CUBE_INDEX_COUNT];
+    primitives::makeCube(1.f, verts, indices);
+    mesh::optimizeVertexCache(opt, indices, primitives::CUBE_INDEX_COUNT, primitives::CUBE_VERTEX_COUNT);
+    const mesh::CacheStats s = mesh::analyzeVertexCache(opt, primitives::CUBE_INDEX_COUNT, primitives::CUBE_VERTEX_COUNT);
+    expect(s.transformed == primitives::CUBE_VERTEX_COUNT && s.atvr == 1.);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <ColorUtil.hxx>
+#include <MipChain.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+static float
+coverage(const uint8_t* px, size_t n, float cutoff) {
+  size_t c = 0;
+  for(size_t i = 0; i < n; ++i)
+    c += px[i * 4 + 3] / 255.f >= cutoff;
+  return float(c) / n;
+}
+
+int main() {
+  const auto& lut = color::srgb();
+
+  // exact encode agrees with the reference transfer function
+  bool exact = true;
+  for(int i = 0; i < 256; ++i)
+    exact = exact && lut.toSrgbExact(lut.decode[i]) == i;
+  expect(exact);
+  expect(lut.toSrgbExact(0.f) == 0 && lut.toSrgbExact(1.f) == 255);
+
+  expect(HaruhiMipChain::levelCount(1, 1) == 1);
+  expect(HaruhiMipChain::levelCount(512, 512) == 10);
+  expect(HaruhiMipChain::levelCount(5, 3) == 3);
+  expect(HaruhiMipChain::levelCount(1, 100) == 7);
+
+  HaruhiMipChain chain;
+
+  // black and white average in linear light, not to 128
+  {
+    const uint8_t px[] = { 0, 0, 0, 255,  255, 255, 255, 255,
+                           255, 255, 255, 255,  0, 0, 0, 255 };
+    chain.build(px, 2, 2, 0);
+    expect(chain.levelCount() == 2);
+    const uint8_t* m = chain.levelData(1);
+    expect(m[0] == lut.toSrgbExact(.5f) && m[0] == 188 && m[3] == 255);
+
+    HaruhiMipChain::Options linear = {};
+    linear.linear = true;
+    chain.build(px, 2, 2, 0, linear);
+    expect(chain.levelData(1)[0] == 128);
+  }
+
+  // odd sizes round down and cover every source texel, a constant stays constant
+  {
+    std::vector<uint8_t> px(5 * 3 * 4);
+    for(size_t i = 0; i < px.size(); i += 4) {
+      px[i] = 90; px[i + 1] = 140; px[i + 2] = 200; px[i + 3] = 77;
+    }
+    chain.build(px.data(), 5, 3, 0);
+    expect(chain.levelCount() == 3);
+    expect(chain.level(1).width == 2 && chain.level(1).height == 1);
+    expect(chain.level(2).width == 1 && chain.level(2).height == 1);
+    bool same = true;
+    for(uint32_t l = 0; l < chain.levelCount(); ++l) {
+      const uint8_t* d = chain.levelData(l);
+      for(uint32_t i = 0; i < chain.level(l).width * chain.level(l).height; ++i)
+        same = same && d[i * 4] == 90 && d[i * 4 + 1] == 140 && d[i * 4 + 2] == 200 && d[i * 4 + 3] == 77;
+    }
+    expect(same);
+    expect(chain.size() == (5 * 3 + 2 * 1 + 1) * 4);
+  }
+
+  // 3 wide with the bright texel in the middle, weights 1/3 each
+  {
+    const uint8_t px[] = { 0, 0, 0, 0,  0, 0, 0, 255,  0, 0, 0, 0 };
+    HaruhiMipChain::Options linear = {};
+    linear.linear = true;
+    chain.build(px, 3, 1, 0, linear);
+    expect(chain.levelData(1)[3] == 85);
+  }
+
+  // padded source rows
+  {
+    std::vector<uint8_t> px(4 * 20, 0xcc);
+    for(uint32_t y = 0; y < 4; ++y)
+      memset(px.data() + y * 20, 40, 16);
+    chain.build(px.data(), 4, 4, 20);
+    expect(chain.levelData(2)[0] == 40 && chain.levelData(0)[16] == 40);
+  }
+
+  // sparse cutout foliage, a fixed alpha fades out, the preserved one keeps its coverage
+  {
+    const uint32_t W = 64;
+    std::vector<uint8_t> px(W * W * 4);
+    for(uint32_t y = 0; y < W; ++y)
+      for(uint32_t x = 0; x < W; ++x) {
+        uint8_t* p = px.data() + (y * W + x) * 4;
+        p[0] = 60; p[1] = 160; p[2] = 40;
+        p[3] = std::sin(x * .45f) * std::sin(y * .35f) > .6f ? 255 : 0;
+      }
+    const float base = coverage(px.data(), W * W, .5f);
+
+    HaruhiMipChain::Options keep = {};
+    keep.alphaCutoff = .5f;
+    HaruhiMipChain plain, kept;
+    plain.build(px.data(), W, W, 0);
+    kept.build(px.data(), W, W, 0, keep);
+
+    const uint32_t l = 3;
+    const size_t n = kept.level(l).width * kept.level(l).height;
+    expect(coverage(plain.levelData(l), n, .5f) < base * .5f);
+    expect(std::fabs(coverage(kept.levelData(l), n, .5f) - base) < .05f);
+    expect(kept.levelData(0)[3] == px[3]);
+  }
+
+  // identical on the pool
+  {
+    const uint32_t W = 301, H = 170;
+    std::vector<uint8_t> px(W * H * 4);
+    for(size_t i = 0; i < px.size(); ++i)
+      px[i] = (uint8_t)(i * 2654435761u >> 13);
+    HaruhiMipChain::Options opts = {};
+    opts.alphaCutoff = .3f;
+    HaruhiMipChain serial, parallel;
+    HaruhiWorkerPool pool(4);
+    serial.build(px.data(), W, H, 0, opts);
+    parallel.build(px.data(), W, H, 0, opts, &pool);
+    expect(serial.levelCount() == 9);
+    expect(serial.size() == parallel.size()
+      && memcmp(serial.data(), parallel.data(), serial.size()) == 0);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
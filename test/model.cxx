@@ -0,0 +1,283 @@
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <MeshLoader.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+namespace {
+
+bool
+parses(const char* s, float want) {
+  float f = -1.f;
+  const char* e = model::parseFloat(s, s + strlen(s), f);
+  return e == s + strlen(s) && f == want;
+}
+
+int
+obj(const std::string& text, model::Mesh& m, HaruhiWorkerPool* pPool = nullptr) {
+  return model::parseObj(text.data(), text.size(), m, pPool);
+}
+
+uint32_t
+index(const model::Mesh& m, size_t i) {
+  return m.wide() ? m.indices32[i] : m.indices16[i];
+}
+
+bool
+same(const math::float3& a, const math::float3& b) {
+  return std::fabs(a.x - b.x) < 1e-5f && std::fabs(a.y - b.y) < 1e-5f && std::fabs(a.z - b.z) < 1e-5f;
+}
+
+// n by n quads with a normal and texcoord per vertex, faces use relative
+// indices every other row
+std::string
+gridObj(int n) {
+  std::string s = "# grid\n";
+  // a face line is 12 %d of up to 11 chars plus separators
+  char line[12 * 12 + 8];
+  for(int y = 0; y <= n; ++y)
+    for(int x = 0; x <= n; ++x) {
+      snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0 0 1\n",
+               x * .1, y * .1, std::sin(x * .3) * .2, x / double(n), y / double(n));
+      s += line;
+    }
+  const int verts = (n + 1) * (n + 1);
+  for(int y = 0; y < n; ++y)
+    for(int x = 0; x < n; ++x) {
+      const int a = y * (n + 1) + x + 1, b = a + 1, c = a + n + 1, d = c + 1;
+      if(y & 1)
+        snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+                 a, a, a, b, b, b, d, d, d, c, c, c);
+      else
+        snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\r\n",
+                 a - verts - 1, a - verts - 1, a - verts - 1, b - verts - 1, b - verts - 1, b - verts - 1,
+                 d - verts - 1, d - verts - 1, d - verts - 1, c - verts - 1, c - verts - 1, c - verts - 1);
+      s += line;
+    }
+  return s;
+}
+
+// a glb of the json, padded with spaces, and the binary chunk
+std::vector<uint8_t>
+glb(std::string json, std::vector<uint8_t> bin) {
+  while(json.size() % 4) json += ' ';
+  while(bin.size() % 4) bin.push_back(0);
+  std::vector<uint8_t> out;
+  auto put = [&](uint32_t v) { out.insert(out.end(), (uint8_t*)&v, (uint8_t*)&v + 4); };
+  put(0x46546C67), put(2), put(uint32_t(28 + json.size() + bin.size()));
+  put(uint32_t(json.size())), put(0x4E4F534A);
+  out.insert(out.end(), json.begin(), json.end());
+  put(uint32_t(bin.size())), put(0x004E4942);
+  out.insert(out.end(), bin.begin(), bin.end());
+  return out;
+}
+
+template <typename T>
+void
+append(std::vector<uint8_t>& bin, const T* p, size_t n) {
+  bin.insert(bin.end(), (const uint8_t*)p, (const uint8_t*)(p + n));
+}
+
+} // ns
+
+int main() {
+  // floats as obj files write them, checked against strtof
+  {
+    expect(parses("1", 1.f));
+    expect(parses("-2.5", -2.5f));
+    expect(parses("+.5", .5f));
+    expect(parses("5.", 5.f));
+    expect(parses("1e3", 1000.f));
+    expect(parses("3.25E-2", 3.25e-2f));
+    expect(parses("-0.000001", -1e-6f));
+    expect(parses("123456789.125", 123456789.125f));
+    expect(parses("3.14159265358979323846264338", 3.14159265358979323846264338f));
+    expect(parses("1e-50", 0.f));
+    expect(parses("1e50", INFINITY));
+
+    float f;
+    const char* s = "abc";
+    expect(!model::parseFloat(s, s + 3, f));
+    s = "-.e5";
+    expect(!model::parseFloat(s, s + 4, f));
+    // the end pointer bounds the digits
+    s = "12345678";
+    expect(model::parseFloat(s, s + 4, f) == s + 4 && f == 1234.f);
+    s = "2.5e";
+    expect(model::parseFloat(s, s + 4, f) == s + 3 && f == 2.5f);
+
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> mant(-1., 1.);
+    std::uniform_int_distribution<int> ex(-30, 30);
+    int mismatches = 0;
+    char buf[64];
+    for(int i = 0; i < 10000; ++i) {
+      snprintf(buf, sizeof(buf), i & 1 ? "%.9g" : "%.6f", mant(rng) * std::pow(10., ex(rng)));
+      float a;
+      const char* e = model::parseFloat(buf, buf + strlen(buf), a);
+      mismatches += !e || *e || a != strtof(buf, nullptr);
+    }
+    expect(mismatches == 0);
+  }
+
+  // a quad, a relative triangle over the same corners and a corner set
+  // without texcoords
+  {
+    const std::string text =
+      "# comment\r\n"
+      "o quad\r\n"
+      "v 0 0 0\r\n"
+      "v 1 0 0\r\n"
+      "v  1 1 0 1.0\r\n"
+      "v\t0 1 0\r\n"
+      "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+      "vn 0 0 1\n"
+      "usemtl none\n"
+      "f 1/1/1 2/2/1 3/3/1 4/4/1 # quad\n"
+      "f -4/-4/-1 -2/-2/-1 -1/-1/-1\n"
+      "f 1//1 2//1 3//1";
+    model::Mesh m;
+    expect(obj(text, m) == 0);
+    expect(m.vertices.size() == 7 && m.indexCount() == 12 && !m.wide());
+    // first use order
+    const uint32_t want[] = { 0, 1, 2, 0, 2, 3, 0, 2, 3, 4, 5, 6 };
+    for(size_t i = 0; i < 12; ++i) expect(index(m, i) == want[i]);
+    const shader_t::VertexData& v = m.vertices[2];
+    expect(same(v.pos, { 1.f, 1.f, 0.f }) && same(v.norm, { 0.f, 0.f, 1.f }));
+    // flipped to the top left origin
+    expect(v.texcoord.x == 1.f && v.texcoord.y == 0.f && m.vertices[0].texcoord.y == 1.f);
+    expect(m.vertices[5].texcoord.x == 0.f && m.vertices[5].texcoord.y == 0.f);
+    expect(same(m.min, { 0.f, 0.f, 0.f }) && same(m.max, { 1.f, 1.f, 0.f }));
+  }
+
+  // missing normals come from the faces
+  {
+    model::Mesh m;
+    expect(obj("v 0 0 0\nv 2 0 0\nv 0 2 0\nv 0 0 -2\nf 1 2 3\nf 1 4 3\n", m) == 0);
+    expect(m.vertices.size() == 4 && m.indexCount() == 6);
+    expect(same(m.vertices[1].norm, { 0.f, 0.f, 1.f }) && same(m.vertices[3].norm, { 1.f, 0.f, 0.f }));
+    const float s = std::sqrt(.5f);
+    expect(same(m.vertices[0].norm, { s, 0.f, s }));
+  }
+
+  // several chunks, the same mesh from any pool
+  {
+    const std::string text = gridObj(320);
+    expect(text.size() > 4 << 20);
+    model::Mesh serial, pooled;
+    model::LoadStats stats = {};
+    expect(model::parseObj(text.data(), text.size(), serial, nullptr, &stats) == 0);
+    expect(stats.bytes == text.size());
+    expect(serial.vertices.size() == 321 * 321 && serial.wide());
+    expect(serial.indexCount() == 320 * 320 * 6);
+    HaruhiWorkerPool pool(4);
+    expect(obj(text, pooled, &pool) == 0);
+    expect(pooled.indices32 == serial.indices32);
+    expect(pooled.vertices.size() == serial.vertices.size()
+           && !memcmp(pooled.vertices.data(), serial.vertices.data(),
+                      serial.vertices.size() * sizeof(shader_t::VertexData)));
+    const shader_t::VertexData& v = serial.vertices[serial.indices32[5]];
+    expect(same(v.pos, { 0.f, .1f, 0.f }) && v.texcoord.y == 1.f - 1.f / 320.f);
+    expect(same(serial.max, { 32.f, 32.f, serial.max.z }));
+  }
+
+  // malformed
+  {
+    model::Mesh m;
+    expect(obj("", m) == -EINVAL);
+    expect(obj("v 0 0 0\nv 1 0 0\nv 0 1 0\n", m) == -EINVAL);
+    expect(obj("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\n", m) == -EINVAL);
+    expect(obj("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 0 1 2\n", m) == -EINVAL);
+    expect(obj("v 0 0 0\nv 1 0 0\nv 0 1 0\nf -4 1 2\n", m) == -EINVAL);
+    expect(obj("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2\n", m) == -EINVAL);
+    expect(obj("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1/2 2 3\n", m) == -EINVAL);
+    expect(obj("v 0 0 0\nv 1 0\nv 0 1 0\nf 1 2 3\n", m) == -EINVAL);
+    expect(obj("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3x\n", m) == -EINVAL);
+    expect(m.vertices.empty() && m.indexCount() == 0);
+  }
+
+  // from a file
+  {
+    const char* pth = "test_model.obj";
+    FILE* fp = fopen(pth, "wb");
+    fputs("v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n", fp);
+    fclose(fp);
+    model::Mesh m;
+    model::LoadStats stats = {};
+    expect(model::load(pth, m, nullptr, &stats) == 0 && m.indexCount() == 3);
+    expect(stats.bytes == 32);
+    remove(pth);
+    expect(model::loadObj("does/not/exist.obj", m) == -ENOENT && m.vertices.empty());
+    expect(model::load("mesh.fbx", m) == -EINVAL);
+  }
+
+  // a glb triangle pair with 16 bit indices, unorm16 texcoords and no normals
+  {
+    const float pos[] = { 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0 };
+    const uint16_t tex[] = { 0, 0, 65535, 0, 65535, 65535, 0, 65535 };
+    const uint16_t idx[] = { 0, 1, 2, 0, 2, 3 };
+    std::vector<uint8_t> bin;
+    append(bin, pos, 12);
+    append(bin, tex, 8);
+    append(bin, idx, 6);
+    const std::string json =
+      "{\"asset\":{\"version\":\"2.0\"},\"buffers\":[{\"byteLength\":76}],"
+      "\"bufferViews\":[{\"buffer\":0,\"byteLength\":48},"
+      "{\"buffer\":0,\"byteOffset\":48,\"byteLength\":16},"
+      "{\"buffer\":0,\"byteOffset\":64,\"byteLength\":12}],"
+      "\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":4,\"type\":\"VEC3\"},"
+      "{\"bufferView\":1,\"componentType\":5123,\"normalized\":true,\"count\":4,\"type\":\"VEC2\"},"
+      "{\"bufferView\":2,\"componentType\":5123,\"count\":6,\"type\":\"SCALAR\"}],"
+      "\"meshes\":[{\"name\":\"q\\\"uad\",\"primitives\":[{\"attributes\":{\"POSITION\":0,\"TEXCOORD_0\":1},"
+      "\"indices\":2},{\"attributes\":{\"POSITION\":0},\"mode\":1}]}]}";
+    const std::vector<uint8_t> file = glb(json, bin);
+    model::Mesh m;
+    expect(model::parseGlb(file.data(), file.size(), m) == 0);
+    expect(m.vertices.size() == 4 && m.indexCount() == 6 && !m.wide());
+    expect(m.indices16[5] == 3);
+    expect(same(m.vertices[2].pos, { 1.f, 1.f, 0.f }) && same(m.vertices[2].norm, { 0.f, 0.f, 1.f }));
+    expect(m.vertices[2].texcoord.x == 1.f && m.vertices[2].texcoord.y == 1.f);
+
+    std::vector<uint8_t> bad = file;
+    bad[0] = 'x';
+    expect(model::parseGlb(bad.data(), bad.size(), m) == -EINVAL);
+    expect(model::parseGlb(file.data(), 40, m) == -EINVAL);
+    // a header length short of the header, a json chunk past the length
+    std::vector<uint8_t> shortHeader(file.begin(), file.begin() + 20);
+    shortHeader[8] = 8, shortHeader[9] = shortHeader[10] = shortHeader[11] = 0;
+    shortHeader[12] = 0, shortHeader[13] = 0, shortHeader[14] = 1, shortHeader[15] = 0;
+    shortHeader.resize(28, ' ');
+    shortHeader.shrink_to_fit();
+    expect(model::parseGlb(shortHeader.data(), shortHeader.size(), m) == -EINVAL);
+    bad = file;
+    bad[8] = 24, bad[9] = bad[10] = bad[11] = 0;
+    expect(model::parseGlb(bad.data(), bad.size(), m) == -EINVAL);
+    // an index past the vertices
+    bad = file;
+    bad[bad.size() - 4] = 9;
+    expect(model::parseGlb(bad.data(), bad.size(), m) == -EINVAL);
+    std::string broken = json;
+    broken.replace(broken.find("\"count\":4"), 9, "\"count\":5");
+    expect(model::parseGlb(glb(broken, bin).data(), glb(broken, bin).size(), m) == -EINVAL);
+    broken = json;
+    broken.replace(broken.find("\"byteOffset\":64"), 15, "\"byteOffset\":70");
+    expect(model::parseGlb(glb(broken, bin).data(), glb(broken, bin).size(), m) == -EINVAL);
+    broken = json.substr(0, json.size() - 1);
+    expect(model::parseGlb(glb(broken, bin).data(), glb(broken, bin).size(), m) == -EINVAL);
+    expect(m.vertices.empty());
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <MathUtil.hxx>
+#include <OcclusionBuffer.hxx>
+#include <SceneSystems.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+namespace {
+
+cull::Aabb
+cube(float x, float y, float z, float h) {
+  return { { x - h, y - h, z - h }, { x + h, y + h, z + h } };
+}
+
+// facing +z, towards a camera looking down -z
+void
+wall(HaruhiOcclusionBuffer& buf, float x0, float y0, float x1, float y1, float z) {
+  buf.addQuad({ x0, y0, z }, { x1, y0, z }, { x1, y1, z }, { x0, y1, z });
+}
+
+// nearest occluder depth at every pixel center, one triangle at a time.
+// only for occluders entirely in front of the near plane
+struct Reference {
+  uint32_t w, h;
+  math::float4x4 vp;
+  std::vector<float> depth;
+
+  Reference(uint32_t w, uint32_t h, const math::float4x4& vp)
+  : w(w), h(h), vp(vp), depth(size_t(w) * h, 1.f) {}
+
+  math::float3 screen(const math::float3& p) const {
+    const math::float4 c = vp * math::float4(p, 1.);
+    return { (c.x / c.w * .5f + .5f) * w, (.5f - c.y / c.w * .5f) * h, c.z / c.w };
+  }
+
+  void triangle(const math::float3& a, const math::float3& b, const math::float3& c) {
+    const math::float3 s[3] = { screen(a), screen(b), screen(c) };
+    const float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[1].y - s[0].y) * (s[2].x - s[0].x);
+    if(area >= 0.f) return;
+    for(uint32_t y = 0; y < h; ++y)
+      for(uint32_t x = 0; x < w; ++x) {
+        const float px = x + .5f, py = y + .5f;
+        float l[3];
+        bool inside = true;
+        for(int i = 0; i < 3; ++i) {
+          const math::float3& p = s[(i + 1) % 3];
+          const math::float3& q = s[(i + 2) % 3];
+          l[i] = ((q.x - p.x) * (py - p.y) - (q.y - p.y) * (px - p.x)) / area;
+          // a hundredth of a pixel of slack for rounding along the edges
+          const float len = std::hypot(q.x - p.x, q.y - p.y);
+          inside = inside && l[i] * std::fabs(area) >= -.01f * len;
+        }
+        if(!inside) continue;
+        const float z = l[0] * s[0].z + l[1] * s[1].z + l[2] * s[2].z;
+        float& d = depth[size_t(y) * w + x];
+        d = std::min(d, z);
+      }
+  }
+
+  // every pixel the box's screen rect reaches has an occluder in front
+  bool hidden(const cull::Aabb& b) const {
+    float x0 = INFINITY, x1 = -INFINITY, y0 = INFINITY, y1 = -INFINITY, zmin = INFINITY;
+    for(int i = 0; i < 8; ++i) {
+      const math::float3 s = screen({ i & 1 ? b.max.x : b.min.x, i & 2 ? b.max.y : b.min.y,
+                                      i & 4 ? b.max.z : b.min.z });
+      x0 = std::min(x0, s.x); x1 = std::max(x1, s.x);
+      y0 = std::min(y0, s.y); y1 = std::max(y1, s.y);
+      zmin = std::min(zmin, s.z);
+    }
+    const int px0 = std::max(0, (int)std::floor(x0)), px1 = std::min((int)w, (int)std::ceil(x1));
+    const int py0 = std::max(0, (int)std::floor(y0)), py1 = std::min((int)h, (int)std::ceil(y1));
+    for(int y = py0; y < py1; ++y)
+      for(int x = px0; x < px1; ++x)
+        if(depth[size_t(y) * w + x] >= zmin - 1e-5f) return false;
+    return true;
+  }
+};
+
+} // ns
+
+int main() {
+  HaruhiWorkerPool pool(4);
+  const math::float4x4 proj = math::makePerspective(90. * 3.141592 / 180., 1., .1, 100.);
+
+  // sizes round up to whole tiles
+  {
+    HaruhiOcclusionBuffer buf(250, 130);
+    expect(buf.width() == 256 && buf.height() == 132);
+  }
+
+  // nothing drawn hides nothing, but off screen and past the far plane
+  // is never visible and crossing the near plane always is
+  {
+    HaruhiOcclusionBuffer buf(128, 128);
+    buf.begin(proj);
+    buf.render();
+    expect(buf.visible(cube(0, 0, -20, 1)));
+    expect(buf.visible(cube(0, 0, 0, 1)));
+    expect(buf.visible(cube(0, 0, 10, 1)));
+    expect(!buf.visible(cube(40, 0, -20, 1)));
+    expect(!buf.visible(cube(0, 0, -200, 1)));
+    expect(buf.depthAt(64, 64) == 1.f);
+  }
+
+  // a wall over the whole screen
+  {
+    HaruhiOcclusionBuffer buf(128, 128, &pool);
+    buf.begin(proj);
+    wall(buf, -20, -20, 20, 20, -10);
+    expect(buf.queued() == 2);
+    buf.render();
+    expect(buf.depthAt(0, 0) < 1.f && buf.depthAt(127, 127) < 1.f);
+    expect(!buf.visible(cube(0, 0, -20, 1)));
+    expect(!buf.visible(cube(8, -8, -30, 1)));
+    expect(buf.visible(cube(0, 0, -5, 1)));
+    // poking through
+    expect(buf.visible(cube(0, 0, -10.5, 1)));
+    expect(buf.timings().triangles == 2 && buf.timings().culled == 0);
+
+    // seen from behind it hides nothing
+    buf.begin(proj);
+    buf.addQuad({ -20., -20., -10. }, { -20., 20., -10. }, { 20., 20., -10. }, { 20., -20., -10. });
+    buf.render();
+    expect(buf.visible(cube(0, 0, -20, 1)));
+    expect(buf.depthAt(64, 64) == 1.f);
+  }
+
+  // the left half of the screen
+  {
+    HaruhiOcclusionBuffer buf(128, 128);
+    buf.begin(proj);
+    wall(buf, -20, -20, 0, 20, -10);
+    buf.render();
+    expect(!buf.visible(cube(-8, 0, -20, 1)));
+    expect(buf.visible(cube(8, 0, -20, 1)));
+    expect(buf.visible(cube(0, 0, -20, 1)));
+    // two walls meeting in the middle hide what neither does alone
+    wall(buf, 0, -20, 20, 20, -12);
+    buf.render();
+    expect(!buf.visible(cube(0, 0, -20, 1)));
+    expect(buf.visible(cube(0, 0, -11, .5)));
+  }
+
+  // a floor running behind the camera gets clipped at the near plane
+  {
+    HaruhiOcclusionBuffer buf(128, 128);
+    buf.begin(proj);
+    buf.addQuad({ -50., -1., 10. }, { 50., -1., 10. }, { 50., -1., -100. }, { -50., -1., -100. });
+    buf.render();
+    expect(buf.timings().clipped > 0);
+    expect(!buf.visible(cube(0, -5, -20, .5)));
+    expect(buf.visible(cube(0, 3, -20, .5)));
+    expect(buf.visible(cube(0, -1, -20, .5)));
+  }
+
+  // random walls, hidden boxes are always hidden pixel for pixel, and
+  // threads don't change the result
+  {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> pos(-30.f, 30.f), depth(-60.f, -5.f), size(1.f, 15.f);
+    const math::float4x4 vp = math::makePerspective(70. * 3.141592 / 180., 2., .1, 100.)
+                              * math::makeXRotate(.1);
+    HaruhiOcclusionBuffer serial(192, 96), parallel(192, 96, &pool);
+    Reference ref(192, 96, vp);
+    serial.begin(vp);
+    parallel.begin(vp);
+    for(int i = 0; i < 300; ++i) {
+      const float x = pos(rng), y = pos(rng) * .5f, z = depth(rng), w = size(rng), h = size(rng);
+      for(HaruhiOcclusionBuffer* b : { &serial, &parallel }) wall(*b, x, y, x + w, y + h, z);
+      ref.triangle({ x, y, z }, { x + w, y, z }, { x + w, y + h, z });
+      ref.triangle({ x, y, z }, { x + w, y + h, z }, { x, y + h, z });
+    }
+    serial.render();
+    parallel.render();
+
+    bool same = true;
+    for(uint32_t y = 0; y < serial.height(); ++y)
+      for(uint32_t x = 0; x < serial.width(); ++x) {
+        same = same && serial.depthAt(x, y) == parallel.depthAt(x, y);
+        // never nearer than the nearest occluder
+        same = same && serial.depthAt(x, y) >= ref.depth[size_t(y) * 192 + x] - 1e-5f;
+      }
+    expect(same);
+
+    size_t hidden = 0, refHidden = 0;
+    bool conservative = true, agree = true;
+    for(int i = 0; i < 5000; ++i) {
+      const cull::Aabb b = cube(pos(rng) * 2.f, pos(rng), depth(rng) * 1.5f, size(rng) * .2f);
+      const bool v = serial.visible(b);
+      agree = agree && v == parallel.visible(b);
+      const bool r = b.max.z < -.2f && ref.hidden(b);
+      conservative = conservative && (v || r);
+      hidden += !v;
+      refHidden += r;
+    }
+    expect(conservative && agree);
+    // most of what could be hidden is
+    expect(refHidden > 500 && hidden * 10 > refHidden * 6);
+
+    const char* pth = "/tmp/haruhi_occlusion_test.pgm";
+    expect(serial.writePGM(pth));
+    FILE* fp = fopen(pth, "rb");
+    unsigned w = 0, h = 0;
+    expect(fp && fscanf(fp, "P5 %u %u 255", &w, &h) == 2 && w == 192 && h == 96);
+    if(fp) {
+      fseek(fp, 0, SEEK_END);
+      expect(ftell(fp) > 192 * 96);
+      fclose(fp);
+    }
+    remove(pth);
+  }
+
+  // the scene drops entities behind a wall after frustum culling
+  {
+    HaruhiEntityWorld world;
+    HaruhiVisibility visibility;
+    std::vector<ecs::Entity> near, far;
+    for(int i = 0; i < 200; ++i) {
+      const float x = float(i % 10) - 5.f, z = i % 2 ? -5.f : -30.f;
+      const ecs::Entity e = world.create(
+        scene::Transform{ { x, 0., z }, { 0., 0., 0., 1. }, { 1., 1., 1. } },
+        scene::Mesh{ { 1., 1., 1., 1. }, 0 },
+        scene::Bounds{ { .4, .4, .4 }, cull::NULL_PROXY });
+      (i % 2 ? near : far).push_back(e);
+    }
+    visibility.update(world, &pool);
+
+    HaruhiOcclusionBuffer buf(128, 128, &pool);
+    buf.begin(proj);
+    wall(buf, -20, -20, 20, 20, -10);
+    buf.render();
+    const auto& visible = visibility.cull(proj, &pool, &buf);
+    expect(visible.size() == near.size());
+    expect(visibility.stats().occluded == far.size() && visibility.stats().visible == near.size());
+    bool nearOnly = true;
+    for(const ecs::Entity e : visible)
+      nearOnly = nearOnly && world.get<const scene::Transform>(e)->position.z == -5.f;
+    expect(nearOnly);
+
+    visibility.cull(proj, &pool);
+    expect(visibility.stats().occluded == 0 && visibility.stats().visible == near.size() + far.size());
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Profiler.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+namespace {
+
+size_t
+countNamed(const std::vector<prof::Event>& events, const char* name, prof::EventKind kind) {
+  return std::count_if(events.begin(), events.end(), [&](const prof::Event& e) {
+    return e.kind == kind && !strcmp(e.name, name);
+  });
+}
+
+const prof::Summary*
+find(const std::vector<prof::Summary>& summary, const char* name, prof::EventKind kind) {
+  for(const auto& s : summary)
+    if(s.kind == kind && !strcmp(s.name, name)) return &s;
+  return nullptr;
+}
+
+} // ns
+
+int main() {
+  prof::setThreadName("main");
+
+  // scopes end after they start, everything comes back sorted by start
+  {
+    {
+      prof::Scope outer("outer");
+      prof::Scope inner("inner");
+      prof::counter("count", -7);
+    }
+    const auto events = prof::collect();
+    expect(countNamed(events, "outer", prof::EVENT_SCOPE) == 1);
+    expect(countNamed(events, "inner", prof::EVENT_SCOPE) == 1);
+    expect(countNamed(events, "count", prof::EVENT_COUNTER) == 1);
+    bool sorted = true, ordered = true;
+    for(size_t i = 0; i < events.size(); ++i) {
+      if(i) sorted = sorted && events[i - 1].start <= events[i].start;
+      if(events[i].kind == prof::EVENT_SCOPE) ordered = ordered && events[i].start <= events[i].end;
+      if(events[i].kind == prof::EVENT_COUNTER) expect(int64_t(events[i].end) == -7);
+    }
+    expect(sorted && ordered);
+  }
+
+  // a full ring keeps the newest events
+  {
+    for(size_t i = 0; i < prof::RING_SIZE + 100; ++i)
+      prof::counter("wrap", int64_t(i));
+    const auto events = prof::collect();
+    std::vector<int64_t> values;
+    for(const auto& e : events)
+      if(e.thread == events.back().thread) values.push_back(int64_t(e.end));
+    // the oldest slot of a full ring may be mid write, it's never returned
+    expect(values.size() == prof::RING_SIZE - 1);
+    expect(values.back() == int64_t(prof::RING_SIZE + 99) && values.front() == 101);
+  }
+
+  // every thread records into its own track, named or not
+  {
+    std::thread a([] {
+      prof::setThreadName("loader");
+      for(int i = 0; i < 1000; ++i) prof::Scope s("load");
+    });
+    std::thread b([] {
+      for(int i = 0; i < 500; ++i) prof::Scope s("load");
+    });
+    a.join();
+    b.join();
+    const auto events = prof::collect();
+    expect(countNamed(events, "load", prof::EVENT_SCOPE) == 1500);
+    std::vector<uint32_t> threads;
+    for(const auto& e : events)
+      if(!strcmp(e.name, "load")) threads.push_back(e.thread);
+    std::sort(threads.begin(), threads.end());
+    expect(std::unique(threads.begin(), threads.end()) - threads.begin() == 2);
+  }
+
+  // tasks of a graph show up under their names, when the markers are
+  // compiled in
+  {
+    HaruhiWorkerPool pool(3);
+    HaruhiTaskGraph graph;
+    auto first = graph.add("first task", [] {});
+    auto second = graph.add("second task", [] {});
+    graph.precede(first, second);
+    for(int i = 0; i < 10; ++i) graph.run(pool);
+    const auto events = prof::collect();
+#ifdef HARUHI_PROFILE
+    constexpr size_t RUNS = 10;
+#else
+    constexpr size_t RUNS = 0;
+#endif
+    expect(countNamed(events, "first task", prof::EVENT_SCOPE) == RUNS);
+    expect(countNamed(events, "second task", prof::EVENT_SCOPE) == RUNS);
+  }
+
+  // per frame totals over complete frames only, from synthetic events
+  {
+    std::vector<prof::Event> events;
+    auto frameAt = [&](uint64_t t) { events.push_back({ "frame", t, t, 0, prof::EVENT_FRAME }); };
+    auto scopeAt = [&](const char* n, uint64_t b, uint64_t ms, prof::EventKind k = prof::EVENT_SCOPE) {
+      events.push_back({ n, b, b + ms * 1000000, 0, k });
+    };
+    auto counterAt = [&](const char* n, uint64_t t, int64_t v) {
+      events.push_back({ n, t, uint64_t(v), 0, prof::EVENT_COUNTER });
+    };
+    constexpr uint64_t F = 100000000; // 100 ms apart
+    for(uint64_t f = 0; f < 5; ++f) frameAt(f * F);
+    // before the summarized frames, ignored
+    scopeAt("work", 0, 50);
+    // two calls in one frame add up
+    scopeAt("work", F, 2);
+    scopeAt("work", F + 10, 4);
+    scopeAt("work", 2 * F, 3);
+    scopeAt("work", 3 * F, 9);
+    scopeAt("work", 3 * F + 1, 1, prof::EVENT_GPU);
+    counterAt("draws", F + 5, 10);
+    counterAt("draws", 3 * F + 5, 30);
+    // after the last mark, an incomplete frame
+    scopeAt("work", 4 * F + 1, 40);
+
+    const auto summary = prof::summarize(events, 3);
+    const prof::Summary* work = find(summary, "work", prof::EVENT_SCOPE);
+    expect(work && work->calls == 4);
+    expect(work && std::abs(work->average - 6.) < 1e-9 && std::abs(work->max - 9.) < 1e-9);
+    const prof::Summary* gpu = find(summary, "work", prof::EVENT_GPU);
+    expect(gpu && gpu->calls == 1 && std::abs(gpu->average - 1. / 3.) < 1e-9);
+    const prof::Summary* draws = find(summary, "draws", prof::EVENT_COUNTER);
+    expect(draws && draws->average == 20. && draws->max == 30.);
+    expect(summary.back().kind == prof::EVENT_COUNTER);
+
+    // more frames asked for than recorded
+    expect(prof::summarize(events, 10).size() == summary.size());
+    expect(prof::summarize({}, 3).empty());
+  }
+
+  // the trace has the thread names and every event
+  {
+    const char* pth = "profile_test_trace.json";
+    prof::frame();
+    prof::gpu("gpu work", prof::now(), prof::now() + 1000);
+    const auto events = prof::collect();
+    expect(prof::writeChromeTrace(pth, events));
+    std::ifstream in(pth);
+    const std::string json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    expect(json.find("\"traceEvents\"") != std::string::npos);
+    expect(json.find("\"loader\"") != std::string::npos);
+    expect(json.find("\"gpu work\",\"ph\":\"X\"") != std::string::npos);
+    expect(json.find("\"wrap\",\"ph\":\"C\"") != std::string::npos);
+    expect(json.find("\"ph\":\"i\"") != std::string::npos);
+    size_t n = 0;
+    for(size_t at = json.find(",\n{\"name\""); at != std::string::npos; at = json.find(",\n{\"name\"", at + 1))
+      ++n;
+    expect(n == events.size());
+    remove(pth);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
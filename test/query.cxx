@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <Broadphase.hxx>
+#include <VoxelQuery.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+namespace {
+
+constexpr int S = voxel::CHUNK_SIZE;
+
+// the plain dda, one cell at a time through world.get
+bool
+reference(const HaruhiVoxelWorld& w, const voxel::Ray& ray, voxel::RayHit& hit) {
+  const float o[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+  const float d[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+  int p[3], step[3];
+  float next[3], delta[3];
+  for(int a = 0; a < 3; ++a) {
+    p[a] = int(std::floor(o[a]));
+    step[a] = d[a] > 0.f ? 1 : d[a] < 0.f ? -1 : 0;
+    delta[a] = step[a] ? float(step[a]) / d[a] : INFINITY;
+    next[a] = step[a] > 0 ? (float(p[a] + 1) - o[a]) * delta[a] : step[a] ? (o[a] - float(p[a])) * delta[a] : INFINITY;
+  }
+  float t = 0.f;
+  int axis = -1;
+  for(;;) {
+    if(const voxel::Block b = w.get(p[0], p[1], p[2])) {
+      hit = { p[0], p[1], p[2], b, axis < 0 ? voxel::FACE_COUNT : voxel::Face(axis * 2 + (step[axis] > 0)), t };
+      return true;
+    }
+    int e = 0;
+    for(int a = 1; a < 3; ++a)
+      if(next[a] < next[e]) e = a;
+    if(!(next[e] <= ray.length)) return false;
+    t = next[e];
+    axis = e;
+    p[e] += step[e];
+    next[e] += delta[e];
+  }
+}
+
+// no solid cell under the box, touching faces allowed
+bool
+clear(const HaruhiVoxelWorld& w, const cull::Aabb& b) {
+  for(int z = int(std::floor(b.min.z)); z < int(std::ceil(b.max.z)); ++z)
+    for(int y = int(std::floor(b.min.y)); y < int(std::ceil(b.max.y)); ++y)
+      for(int x = int(std::floor(b.min.x)); x < int(std::ceil(b.max.x)); ++x)
+        if(w.get(x, y, z)) return false;
+  return true;
+}
+
+} // ns
+
+int main() {
+  HaruhiWorkerPool pool(4);
+
+  // sparse blocks over a few chunks, some missing, one all stone: the
+  // skipping raycast stops where the plain dda does
+  {
+    HaruhiVoxelWorld w;
+    std::mt19937 rng(5);
+    for(int cx = -2; cx < 2; ++cx)
+      for(int cy = -1; cy < 1; ++cy)
+        for(int cz = -2; cz < 2; ++cz) {
+          if((cx + cy + cz) % 3 == 0) continue;
+          voxel::BlockStorage& b = w.edit({ cx, cy, cz });
+          // a few bricks with blocks in them, the rest empty
+          for(int n = 0; n < 400; ++n) {
+            const int i = int(rng() % voxel::CHUNK_VOLUME);
+            if(voxel::BlockStorage::brickOf(i) % 5 == 0) b.set(i, voxel::Block(1 + rng() % 4));
+          }
+        }
+    w.edit({ 3, 0, 0 }).fill(voxel::BLOCK_STONE);
+    HaruhiVoxelQuery q(w);
+
+    std::uniform_real_distribution<float> pos(-70.f, 70.f), dir(-1.f, 1.f);
+    std::vector<voxel::Ray> rays(4000);
+    for(size_t i = 0; i < rays.size(); ++i) {
+      voxel::Ray& r = rays[i];
+      r.origin = { pos(rng), pos(rng) * .5f, pos(rng) };
+      r.direction = { dir(rng), dir(rng), dir(rng) };
+      // some along the axes
+      if(i % 7 == 0) r.direction.y = 0.f;
+      if(i % 11 == 0) r.direction.x = r.direction.z = 0.f;
+      r.length = 300.f;
+    }
+    std::vector<voxel::RayHit> hits(rays.size()), pooled(rays.size());
+    size_t hitCount = 0;
+    bool same = true;
+    for(size_t i = 0; i < rays.size(); ++i) {
+      voxel::RayHit ref;
+      const bool a = q.raycast(rays[i], hits[i]), b = reference(w, rays[i], ref);
+      hitCount += a;
+      same &= a == b;
+      if(a && b)
+        same &= hits[i].x == ref.x && hits[i].y == ref.y && hits[i].z == ref.z && hits[i].block == ref.block &&
+                hits[i].face == ref.face && std::fabs(hits[i].t - ref.t) <= 1e-3f * (1.f + ref.t);
+    }
+    expect(same);
+    expect(hitCount > rays.size() / 10 && hitCount < rays.size());
+
+    q.raycast(rays.data(), rays.size(), pooled.data(), &pool);
+    bool parallel = true;
+    for(size_t i = 0; i < rays.size(); ++i)
+      parallel &= pooled[i].x == hits[i].x && pooled[i].y == hits[i].y && pooled[i].z == hits[i].z &&
+                  pooled[i].block == hits[i].block && pooled[i].t == hits[i].t;
+    expect(parallel);
+
+    // starting inside a block, and stopping short of one
+    voxel::RayHit hit;
+    expect(q.raycast({ { 100.5f, 3.5f, 3.5f }, { 1.f, 0.f, 0.f }, 10.f }, hit));
+    expect(hit.x == 100 && hit.face == voxel::FACE_COUNT && hit.t == 0.f && hit.block == voxel::BLOCK_STONE);
+    expect(q.raycast({ { 70.5f, 3.5f, 3.5f }, { 1.f, 0.f, 0.f }, 40.f }, hit));
+    expect(hit.x == 96 && hit.face == voxel::FACE_NEG_X && hit.t == 25.5f);
+    expect(!q.raycast({ { 70.5f, 3.5f, 3.5f }, { 1.f, 0.f, 0.f }, 25.f }, hit));
+    expect(hit.block == voxel::BLOCK_AIR);
+    expect(q.raycast({ { 200.5f, 3.5f, 3.5f }, { -2.f, 0.f, 0.f }, 100.f }, hit));
+    expect(hit.x == 127 && hit.face == voxel::FACE_POS_X && hit.t == 36.25f);
+  }
+
+  // boxes stop flush against the faces they run into, however far they
+  // move in one go, and slide along them on the other axes
+  {
+    HaruhiVoxelWorld w;
+    for(int cx = -3; cx < 4; ++cx)
+      for(int cz = -3; cz < 4; ++cz) w.edit({ cx, -1, cz }).fill(voxel::BLOCK_STONE);
+    for(int y = 0; y < 4; ++y)
+      for(int z = -3 * S; z < 4 * S; ++z) w.set(20, y, z, voxel::BLOCK_BRICK);
+    HaruhiVoxelQuery q(w);
+
+    cull::Aabb box = { { 2.2f, 10.f, 3.7f }, { 2.8f, 11.8f, 4.3f } };
+    expect(q.sweep(box, { 0.f, -500.f, 0.f }) == voxel::BLOCKED_Y);
+    expect(box.min.y == 0.f && std::fabs(box.max.y - 1.8f) < 1e-5f);
+    expect(q.sweep(box, { 100.f, 0.f, 3.f }) == voxel::BLOCKED_X);
+    expect(box.max.x == 20.f && std::fabs(box.min.z - 6.7f) < 1e-5f && box.min.y == 0.f);
+    // flush against the wall and on the floor stays put
+    expect(q.sweep(box, { .5f, -.5f, 0.f }) == (voxel::BLOCKED_X | voxel::BLOCKED_Y));
+    expect(box.max.x == 20.f && box.min.y == 0.f);
+    // over the wall it goes on
+    box = { { 10.f, 4.f, 0.f }, { 11.f, 5.f, 1.f } };
+    expect(q.sweep(box, { 30.f, 0.f, 0.f }) == 0 && box.min.x == 40.f);
+
+    // bodies under gravity come to rest on the floor or the wall
+    std::vector<voxel::Body> bodies;
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<float> pos(-25.f, 50.f), vel(-4.f, 4.f), up(-40.f, 40.f);
+    for(int i = 0; i < 500; ++i) {
+      const math::float3 p = { pos(rng), 5.f + float(i % 20), pos(rng) };
+      bodies.push_back({ { p, p + math::float3{ .6f, 1.8f, .6f } }, { 0.f, up(rng), vel(rng) }, 0 });
+      if(!clear(w, bodies.back().box)) bodies.pop_back();
+    }
+    bool inside = false;
+    for(int frame = 0; frame < 200; ++frame) {
+      q.step(bodies.data(), bodies.size(), 1.f / 30.f, { 0.f, -30.f, 0.f }, frame & 1 ? &pool : nullptr);
+      for(const voxel::Body& b : bodies) inside |= !clear(w, b.box);
+    }
+    expect(!inside);
+    bool resting = true;
+    for(const voxel::Body& b : bodies)
+      resting &= b.velocity.y == 0.f && (b.blocked & voxel::BLOCKED_Y) && (b.box.min.y == 0.f || b.box.min.y == 4.f);
+    expect(resting);
+  }
+
+  // the pairs the sweep finds are the ones testing every box against
+  // every other finds, while the boxes move and their number changes
+  {
+    std::mt19937 rng(13);
+    std::uniform_real_distribution<float> pos(0.f, 100.f), size(.5f, 4.f), step(-1.f, 1.f);
+    std::vector<cull::Aabb> boxes;
+    HaruhiBroadphase broad;
+    bool same = true;
+    size_t found = 0;
+    for(int frame = 0; frame < 30; ++frame) {
+      if(frame % 10 == 0) {
+        boxes.resize(300 + 100 * frame / 10);
+        for(cull::Aabb& b : boxes) {
+          b.min = { pos(rng), pos(rng) * .3f, pos(rng) };
+          b.max = b.min + math::float3{ size(rng), size(rng), size(rng) };
+        }
+      } else {
+        for(cull::Aabb& b : boxes) {
+          const math::float3 d = { step(rng), step(rng), step(rng) };
+          b.min = b.min + d;
+          b.max = b.max + d;
+        }
+      }
+      std::vector<std::pair<uint32_t, uint32_t>> brute, got;
+      for(uint32_t i = 0; i < boxes.size(); ++i)
+        for(uint32_t j = i + 1; j < boxes.size(); ++j) {
+          const cull::Aabb& a = boxes[i];
+          const cull::Aabb& b = boxes[j];
+          if(a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y && b.min.y <= a.max.y &&
+             a.min.z <= b.max.z && b.min.z <= a.max.z) brute.push_back({ i, j });
+        }
+      expect(broad.update(boxes.data(), boxes.size()) == brute.size());
+      for(const cull::Pair& p : broad.pairs()) got.push_back({ p.a, p.b });
+      std::sort(got.begin(), got.end());
+      same &= got == brute;
+      found += got.size();
+    }
+    expect(same && found > 0);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <MathUtil.hxx>
+#include <Primitives.hxx>
+#include <SoftRasterizer.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+// same scene setup as HaruhiRenderer::draw, a few more cubes and one
+// crossing the near plane
+static void
+renderScene(HaruhiSoftRasterizer& rast) {
+  static shader_t::VertexData verts[primitives::CUBE_VERTEX_COUNT];
+  static uint16_t indices[primitives::CUBE_INDEX_COUNT];
+  primitives::makeCube(.5f, verts, indices);
+
+  // 8x8 checker, sRGB
+  static uint8_t texels[8 * 8 * 4];
+  for(int y = 0; y < 8; ++y)
+    for(int x = 0; x < 8; ++x) {
+      uint8_t* p = &texels[(y * 8 + x) * 4];
+      const bool odd = (x ^ y) & 1;
+      p[0] = odd ? 220 : 60;
+      p[1] = odd ? 160 : 90;
+      p[2] = x * 32;
+      p[3] = 255;
+    }
+  const HaruhiSoftRasterizer::Texture tex = { 8, 8, texels };
+
+  std::vector<shader_t::InstanceData> inst(4);
+  const math::float3 pos[] = { { 0., 0., -3. }, { 1.5, .8, -4. }, { -1.6, -.5, -2.5 }, { .7, -.5, -.5 } };
+  for(size_t i = 0; i < inst.size(); ++i) {
+    inst[i].instanceTransform = math::makeTranslateXYRotate(pos[i], .2f + i, .3f * i + .5f);
+    inst[i].instanceNormalTransform = math::discardTranslation(inst[i].instanceTransform);
+    inst[i].instanceColor = { .5, .5, .5, 1. };
+  }
+
+  shader_t::CameraData cam;
+  cam.perspTransform = math::makePerspective(90. * 3.141592 / 180., 4. / 3., .03, 500.);
+  cam.worldTransform = math::makeIdentity();
+  cam.worldNormalTransform = math::discardTranslation(cam.worldTransform);
+
+  rast.clear({ 0., .8, 1., 1. });
+  rast.draw({
+    verts, primitives::CUBE_VERTEX_COUNT,
+    indices, primitives::CUBE_INDEX_COUNT,
+    inst.data(), inst.size(), &cam, &tex });
+}
+
+static bool
+readPPM(const char* pth, uint32_t& w, uint32_t& h, std::vector<uint8_t>& rgb) {
+  FILE* fp = fopen(pth, "rb");
+  if(!fp) return false;
+  int maxv = 0;
+  bool ok = fscanf(fp, "P6 %u %u %d", &w, &h, &maxv) == 3 && maxv == 255 && fgetc(fp) != EOF;
+  if(ok) {
+    rgb.resize((size_t)w * h * 3);
+    ok = fread(rgb.data(), 1, rgb.size(), fp) == rgb.size();
+  }
+  fclose(fp);
+  return ok;
+}
+
+int main(int argc, char * argv[]) {
+  constexpr uint32_t W = 160, H = 120;
+
+  HaruhiSoftRasterizer serial(W, H);
+  renderScene(serial);
+
+  HaruhiWorkerPool pool(4);
+  HaruhiSoftRasterizer threaded(W, H, &pool);
+  renderScene(threaded);
+
+  // binning keeps submission order, threads must not change a single pixel
+  expect(serial.readPixels() == threaded.readPixels());
+
+  const auto& t = serial.timings();
+  printf("vertex %.3fms setup %.3fms raster %.3fms, %llu tris %llu culled %llu clipped %llu frags\n",
+    t.vertexMs, t.setupMs, t.rasterMs,
+    (unsigned long long)t.triangles, (unsigned long long)t.culled,
+    (unsigned long long)t.clipped, (unsigned long long)t.fragments);
+  expect(t.triangles == 4 * 12);
+  expect(t.clipped > 0);
+  // back faces go, roughly half of what is on screen survives
+  expect(t.culled >= 4 * 6 - 6);
+
+  // the center cube is hit, the corner keeps the clear color and depth
+  expect(serial.depthAt(W / 2, H / 2) < 65535);
+  expect(serial.depthAt(W - 1, 0) == 65535);
+
+  if(argc > 1) {
+    // golden image, pass --update as the second argument to regenerate it
+    if(argc > 2 && !strcmp(argv[2], "--update")) {
+      expect(serial.writePPM(argv[1]));
+    } else {
+      uint32_t gw = 0, gh = 0;
+      std::vector<uint8_t> golden;
+      expect(readPPM(argv[1], gw, gh, golden));
+      expect(gw == W && gh == H);
+
+      if(gw == W && gh == H) {
+        // fma and rcp differences between backends may move an edge pixel
+        const auto px = serial.readPixels();
+        size_t off = 0;
+        for(size_t i = 0; i < (size_t)W * H; ++i)
+          for(int c = 0; c < 3; ++c)
+            if(std::abs(px[i * 4 + c] - golden[i * 3 + c]) > 2) { ++off; break; }
+        printf("%zu pixels differ from golden\n", off);
+        expect(off <= W * H / 200);
+        if(off > W * H / 200)
+          serial.writePPM("raster_failed.ppm");
+      }
+    }
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ResourceTable.hxx>
+
+#include "Expect.hxx"
+
+// stands in for a gpu object
+struct FakeResource {
+  int id;
+  bool released;
+};
+
+static void
+releaseFake(resource::Category, void* pObject, void* pUser) {
+  static_cast<FakeResource*>(pObject)->released = true;
+  ++*static_cast<int*>(pUser);
+}
+
+int main() {
+  using namespace resource;
+
+  static_assert(Name("blocks").hash == Name(std::string_view("blocks")).hash);
+  static_assert(!(Name("a") == Name("b")));
+
+  int released = 0;
+  std::vector<FakeResource> fakes(16);
+  for(int i = 0; i < 16; ++i)
+    fakes[i] = { i, false };
+
+  {
+    HaruhiResourceTable table(releaseFake, &released);
+
+    // names are per category, lookups never insert
+    const Name blocks = table.intern("blocks");
+    expect(table.nameOf(blocks) != nullptr);
+    expect(table.nameOf(Name("nope")) == nullptr);
+    const Handle t = table.add(CATEGORY_TEXTURE, blocks, &fakes[0], 100);
+    expect(t);
+    expect(!table.add(CATEGORY_TEXTURE, blocks, &fakes[1], 100));
+    expect(table.add(CATEGORY_BUFFER, blocks, &fakes[1], 100));
+    expect(table.find(CATEGORY_TEXTURE, blocks) == t);
+    expect(!table.find(CATEGORY_TEXTURE, Name("missing")));
+    expect(table.size(CATEGORY_TEXTURE) == 1);
+    expect(table.get(t) == &fakes[0]);
+    expect(table.get(NULL_HANDLE) == nullptr);
+
+    // reference counts
+    expect(table.refCount(t) == 0);
+    expect(table.acquire(t));
+    expect(table.acquire(CATEGORY_TEXTURE, blocks) == t);
+    expect(table.refCount(t) == 2);
+    expect(!table.remove(t));
+    table.release(t);
+    table.release(t);
+    expect(table.refCount(t) == 0);
+
+    // removal makes the handle stale, the slot comes back with a new generation
+    expect(table.remove(t));
+    expect(fakes[0].released && released == 1);
+    expect(table.get(t) == nullptr && !table.acquire(t));
+    const Handle t2 = table.add(CATEGORY_TEXTURE, blocks, &fakes[2], 100);
+    expect(t2.index == t.index && t2.generation != t.generation);
+    expect(table.get(t) == nullptr && table.get(t2) == &fakes[2]);
+  }
+  // everything left is released with the table
+  expect(released == 3 && fakes[1].released && fakes[2].released);
+
+  // budget eviction in least recently released order, referenced entries stay
+  {
+    released = 0;
+    for(auto& f : fakes) f.released = false;
+    HaruhiResourceTable table(releaseFake, &released);
+    table.setBudget(CATEGORY_MESH, 300);
+
+    Handle h[4];
+    for(int i = 0; i < 4; ++i)
+      h[i] = table.add(CATEGORY_MESH, Name(std::to_string(i)), &fakes[i], 100);
+    // room for the fourth came from the oldest
+    expect(fakes[0].released && !fakes[1].released);
+    expect(table.residentBytes(CATEGORY_MESH) == 300);
+
+    expect(table.acquire(h[1]));
+    expect(table.acquire(h[2]));
+    table.release(h[2]);
+    // 3 is now the least recently released, 1 is referenced
+    const Handle big = table.add(CATEGORY_MESH, Name("big"), &fakes[4], 200);
+    expect(fakes[3].released && fakes[2].released && !fakes[1].released);
+    expect(table.get(big) == &fakes[4] && table.get(h[1]) == &fakes[1]);
+    expect(table.residentBytes(CATEGORY_MESH) == 300);
+
+    // referenced entries may push it over
+    expect(table.acquire(big));
+    table.add(CATEGORY_MESH, Name("over"), &fakes[5], 100);
+    expect(table.residentBytes(CATEGORY_MESH) == 400);
+    expect(table.size(CATEGORY_MESH) == 3);
+
+    // releasing brings it back under, categories don't share budgets
+    table.release(big);
+    expect(table.residentBytes(CATEGORY_MESH) <= 300);
+    table.add(CATEGORY_TEXTURE, Name("0"), &fakes[6], 1000);
+    expect(!fakes[6].released);
+
+    expect(table.trim(CATEGORY_MESH, 0) > 0);
+    expect(table.size(CATEGORY_MESH) == 1 && table.get(h[1]));
+  }
+
+  // concurrent lookups against acquire/release churn
+  {
+    HaruhiResourceTable table;
+    std::vector<Handle> hs;
+    for(int i = 0; i < 16; ++i)
+      hs.push_back(table.add(CATEGORY_BUFFER, Name(std::to_string(i)), &fakes[i], 64));
+    std::vector<std::thread> threads;
+    std::vector<int> bad(4, 0);
+    for(int t = 0; t < 4; ++t)
+      threads.emplace_back([&, t] {
+        for(int n = 0; n < 20000; ++n) {
+          const int i = (n * 7 + t) & 15;
+          const Handle h = table.find(CATEGORY_BUFFER, Name(std::to_string(i)));
+          if(!table.acquire(h) || table.get(h) != &fakes[i]) ++bad[t];
+          table.release(h);
+        }
+      });
+    for(auto& th : threads) th.join();
+    expect(bad[0] + bad[1] + bad[2] + bad[3] == 0);
+    bool zero = true;
+    for(auto h : hs) zero = zero && table.refCount(h) == 0;
+    expect(zero);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <Noise.hxx>
+#include <Terrain.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+namespace {
+
+using Noise2 = float (*)(uint32_t, float, float) noexcept;
+using Noise3 = float (*)(uint32_t, float, float, float) noexcept;
+
+// in range, seeded, not constant, and close values for close positions
+void
+checkNoise(Noise2 fn2, Noise3 fn3) {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> pos(-3000.f, 3000.f);
+  double sum = 0., sq = 0.;
+  int differs = 0;
+  float step = 0.f;
+  for(int i = 0; i < 20000; ++i) {
+    const float x = pos(rng), y = pos(rng), z = pos(rng);
+    const float a = fn2(11, x, y), b = fn3(11, x, y, z);
+    expect(a >= -1.f && a <= 1.f && b >= -1.f && b <= 1.f);
+    expect(a == fn2(11, x, y) && b == fn3(11, x, y, z));
+    differs += a != fn2(12, x, y);
+    sum += a;
+    sq += a * a;
+    step = std::max(step, std::abs(fn2(11, x + 1e-3f, y) - a));
+    step = std::max(step, std::abs(fn3(11, x, y, z + 1e-3f) - b));
+  }
+  expect(differs > 19000);
+  expect(sq / 20000 - (sum / 20000) * (sum / 20000) > .01);
+  expect(step < .02f);
+}
+
+// the batches give the single position values, whatever the tail
+void
+checkBatch(const noise::Fractal& f) {
+  std::mt19937 rng(3);
+  std::uniform_real_distribution<float> pos(-500.f, 500.f);
+  const size_t n = 1003;
+  std::vector<float> x(n), y(n), z(n), out2(n), out3(n);
+  for(size_t i = 0; i < n; ++i) x[i] = pos(rng), y[i] = pos(rng), z[i] = pos(rng);
+  noise::sample2(f, 5, x.data(), y.data(), out2.data(), n);
+  noise::sample3(f, 5, x.data(), y.data(), z.data(), out3.data(), n);
+  float err = 0.f;
+  for(size_t i = 0; i < n; ++i) {
+    err = std::max(err, std::abs(out2[i] - noise::sample2(f, 5, x[i], y[i])));
+    err = std::max(err, std::abs(out3[i] - noise::sample3(f, 5, x[i], y[i], z[i])));
+  }
+  expect(err < 1e-4f);
+}
+
+} // ns
+
+int main() {
+  // the single octave kinds
+  {
+    checkNoise(noise::value2, noise::value3);
+    checkNoise(noise::simplex2, noise::simplex3);
+    checkNoise(noise::cellular2, noise::cellular3);
+
+    // value noise is continuous across lattice lines, cellular dips near its points
+    expect(std::abs(noise::value2(1, 4.f, -7.f) - noise::value2(1, 4.f + 1e-4f, -7.f)) < 1e-3f);
+    float nearest = 1.f;
+    for(int i = 0; i < 64; ++i) nearest = std::min(nearest, noise::cellular2(1, i * .37f, i * .11f));
+    expect(nearest < -.5f);
+  }
+
+  // fbm stays in range, and warp moves it
+  {
+    noise::Fractal f;
+    f.octaves = 5;
+    f.frequency = .01f;
+    int moved = 0;
+    for(int i = 0; i < 1000; ++i) {
+      const float x = i * 3.1f, y = i * -1.7f;
+      const float a = noise::sample2(f, 9, x, y);
+      expect(a >= -1.f && a <= 1.f);
+      noise::Fractal w = f;
+      w.warp = 20.f;
+      moved += a != noise::sample2(w, 9, x, y);
+    }
+    expect(moved > 990);
+
+    // one octave at frequency 1 is the plain kind
+    noise::Fractal one;
+    expect(noise::sample2(one, 4, 1.5f, 2.25f) == noise::simplex2(4, 1.5f, 2.25f));
+    one.kind = noise::KIND_CELLULAR;
+    expect(noise::sample3(one, 4, 1.5f, 2.25f, 3.f) == noise::cellular3(4, 1.5f, 2.25f, 3.f));
+  }
+
+  // batches
+  {
+    expect(noise::lanes() >= 1);
+    noise::Fractal f;
+    for(noise::Kind k : { noise::KIND_VALUE, noise::KIND_SIMPLEX, noise::KIND_CELLULAR }) {
+      f.kind = k;
+      f.octaves = 3;
+      f.frequency = .05f;
+      f.warp = 0.f;
+      checkBatch(f);
+      f.warp = 8.f;
+      checkBatch(f);
+    }
+  }
+
+  // chunks
+  {
+    terrain::Settings s;
+    s.base = 8.f;
+    s.amplitude = 6.f;
+    s.caveWidth = 0.f;
+    std::vector<voxel::Block> a(voxel::CHUNK_VOLUME), b(voxel::CHUNK_VOLUME);
+    terrain::generateChunk(s, { 3, 0, -2 }, a.data());
+    terrain::generateChunk(s, { 3, 0, -2 }, b.data());
+    expect(a == b);
+
+    // one surface per column, grass over dirt over stone, air above
+    constexpr int S = voxel::CHUNK_SIZE;
+    auto at = [&](int x, int y, int z) { return a[(z * S + y) * S + x]; };
+    bool layered = true;
+    for(int z = 0; z < S; ++z)
+      for(int x = 0; x < S; ++x) {
+        int top = -1;
+        for(int y = 0; y < S; ++y)
+          if(at(x, y, z) != voxel::BLOCK_AIR) top = y;
+        layered &= top >= 2 && top <= 14;
+        if(top < 0) continue;
+        layered &= at(x, top, z) == voxel::BLOCK_GRASS;
+        for(int y = 0; y < top; ++y)
+          layered &= at(x, y, z) == (y >= top - 3 ? voxel::BLOCK_DIRT : voxel::BLOCK_STONE);
+      }
+    expect(layered);
+
+    // nothing but air above the hills, caves only take blocks away
+    terrain::generateChunk(s, { 3, 1, -2 }, b.data());
+    expect(std::all_of(b.begin(), b.end(), [](voxel::Block v) { return v == voxel::BLOCK_AIR; }));
+    s.caveWidth = .1f;
+    terrain::generateChunk(s, { 3, 0, -2 }, b.data());
+    size_t carved = 0;
+    bool subset = true;
+    for(int i = 0; i < voxel::CHUNK_VOLUME; ++i) {
+      carved += a[i] != b[i];
+      subset &= b[i] == a[i] || b[i] == voxel::BLOCK_AIR;
+    }
+    expect(subset && carved > 0);
+
+    // neighbouring columns meet without steps
+    std::vector<voxel::Block> c(voxel::CHUNK_VOLUME);
+    s.caveWidth = 0.f;
+    terrain::generateChunk(s, { 4, 0, -2 }, c.data());
+    int worst = 0;
+    for(int z = 0; z < S; ++z) {
+      int ha = 0, hc = 0;
+      for(int y = 0; y < S; ++y) {
+        if(a[(z * S + y) * S + S - 1]) ha = y;
+        if(c[(z * S + y) * S]) hc = y;
+      }
+      worst = std::max(worst, std::abs(ha - hc));
+    }
+    expect(worst <= 2);
+  }
+
+  // the stage fills the world the same on a pool and queues the chunks
+  {
+    terrain::Settings s;
+    s.base = 10.f;
+    s.amplitude = 20.f;
+    std::vector<voxel::ChunkCoord> coords;
+    for(int x = -2; x < 2; ++x)
+      for(int z = -2; z < 2; ++z)
+        for(int y = -1; y < 2; ++y) coords.push_back({ x, y, z });
+    coords.push_back({ 0, 0, 0 });
+
+    HaruhiVoxelWorld serial, pooled;
+    HaruhiWorkerPool pool(4);
+    expect(terrain::generate(s, serial, coords.data(), coords.size()) == 48);
+    expect(terrain::generate(s, pooled, coords.data(), coords.size(), &pool) == 48);
+    expect(serial.size() == 48 && pooled.size() == 48);
+    expect(pooled.pending() > 0);
+
+    std::vector<voxel::Block> one(voxel::CHUNK_VOLUME), got(voxel::CHUNK_VOLUME);
+    bool same = true;
+    for(const voxel::ChunkCoord& c : coords) {
+      terrain::generateChunk(s, c, one.data());
+      serial.blocks(c)->store(got.data());
+      same &= got == one;
+      pooled.blocks(c)->store(got.data());
+      same &= got == one;
+    }
+    expect(same);
+    expect(pooled.remesh(&pool) > 0);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <MathUtil.hxx>
+#include <TransformStore.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+static bool
+near(const float* a, const float* b, int n, float eps = 1e-4f) {
+  for(int i = 0; i < n; ++i)
+    if(std::fabs(a[i] - b[i]) > eps) return false;
+  return true;
+}
+
+static bool
+matches(const shader_t::InstanceData& d, const HaruhiTransformStore& s, size_t i) {
+  const math::float4x4 ref = math::makeTRS(s.position(i), s.rotation(i), s.scale(i));
+  const math::float3x3 nref = math::discardTranslation(ref);
+  return near(&d.instanceTransform.columns[0].x, &ref.columns[0].x, 16)
+    && near(&d.instanceNormalTransform.columns[0].x, &nref.columns[0].x, 12);
+}
+
+int main() {
+  using namespace math;
+
+  constexpr size_t N = 5000;
+  HaruhiTransformStore store(2);
+  HaruhiWorkerPool pool(4);
+
+  for(size_t i = 0; i < N; ++i)
+    store.add(
+      { float(i), -float(i) * .5f, 3.f },
+      normalize(makeQuat({ 1., float(i % 7), 2. }, i * .01f)),
+      { 1.f + i % 3, 1., .5 },
+      { 1., 0., 0., 1. });
+
+  std::vector<shader_t::InstanceData> buf0(N), buf1(N);
+
+  // the first write composes everything, serial and parallel agree
+  auto r0 = store.writeInstances(0, buf0.data());
+  auto r1 = store.writeInstances(1, buf1.data(), &pool);
+  expect(r0.composed == N && r0.first == 0 && r0.last == N);
+  expect(r1.composed == N && r1.first == 0 && r1.last == N);
+
+  bool all = true;
+  for(size_t i = 0; i < N; ++i)
+    all = all && matches(buf0[i], store, i) && matches(buf1[i], store, i);
+  expect(all);
+  expect(buf0[17].instanceColor.x == 1.f && buf0[17].instanceColor.w == 1.f);
+  expect(buf0[17].instanceNormalTransform.columns[1]._pad == 0.f);
+
+  // nothing dirty, nothing written
+  auto r2 = store.writeInstances(0, buf0.data(), &pool);
+  expect(r2.composed == 0 && r2.first == r2.last);
+
+  // only the touched instance is recomposed, per target
+  store.setPosition(1234, { 9., 9., 9. });
+  expect(store.isDirty(0, 1234) && store.isDirty(1, 1234));
+  buf0[1235].instanceColor.x = 42.f; // clean neighbour in the same group
+  auto r3 = store.writeInstances(0, buf0.data(), &pool);
+  expect(r3.composed == 1 && r3.first <= 1234 && r3.last > 1234);
+  expect(matches(buf0[1234], store, 1234));
+  expect(buf0[1234].instanceTransform.columns[3].x == 9.f);
+  expect(!store.isDirty(0, 1234) && store.isDirty(1, 1234));
+
+  // swap removal keeps the tail consistent
+  const auto moved = store.remove(10);
+  expect(moved == N - 1 && store.size() == N - 1);
+  store.writeInstances(1, buf1.data(), &pool);
+  expect(matches(buf1[10], store, 10));
+  expect(matches(buf1[1234], store, 1234));
+
+  store.markAllDirty();
+  auto r4 = store.writeInstances(0, buf0.data(), &pool);
+  expect(r4.composed == N - 1 && r4.last == N - 1);
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <FrameAllocator.hxx>
+
+#include "Expect.hxx"
+
+// heap pages standing in for shared gpu buffers
+class MockBackend : public HaruhiUploadBackend {
+public:
+  struct Flush {
+    uint8_t* cpu;
+    size_t offset, size;
+  };
+
+  std::mutex mtx;
+  std::vector<Flush> flushes;
+  int live = 0, allocations = 0;
+  size_t limit = ~size_t(0);
+
+  bool allocate(size_t size, Page& page) noexcept override {
+    if(size > limit) return false;
+    page.cpu = static_cast<uint8_t*>(aligned_alloc(256, (size + 255) / 256 * 256));
+    page.size = size;
+    page.buffer = page.cpu;
+    ++live;
+    ++allocations;
+    return true;
+  }
+  void free(const Page& page) noexcept override {
+    ::free(page.cpu);
+    --live;
+  }
+  void flush(const Page& page, size_t offset, size_t size) noexcept override {
+    std::lock_guard<std::mutex> lk(mtx);
+    flushes.push_back({ page.cpu, offset, size });
+  }
+
+  bool flushed(const uint8_t* p, size_t size) {
+    std::lock_guard<std::mutex> lk(mtx);
+    for(auto& f : flushes)
+      if(p >= f.cpu + f.offset && p + size <= f.cpu + f.offset + f.size) return true;
+    return false;
+  }
+};
+
+struct Written {
+  uint8_t* cpu;
+  size_t size;
+  uint8_t tag;
+};
+
+int main() {
+  // bump allocation, alignment, spilling and exact flushes
+  {
+    MockBackend backend;
+    HaruhiFrameFence fence;
+    {
+      HaruhiFrameAllocator alloc(backend, fence, 2, 1024, 4096);
+      expect(backend.live == 2);
+      expect(alloc.beginFrame() == 1);
+
+      auto a = alloc.allocate(10, 16);
+      auto b = alloc.allocate(100, 256);
+      expect(a.cpu && a.offset == 0);
+      expect(b.offset == 256 && b.buffer == a.buffer);
+      auto c = alloc.allocate(700, 16);
+      expect(c.buffer != a.buffer && c.offset == 0);
+      auto d = alloc.allocate(700, 64);
+      expect(d.buffer == c.buffer && d.offset == 704);
+      auto big = alloc.allocate(10000, 16);
+      expect(big.cpu && big.offset == 0);
+      expect(alloc.stats().ringBytes == 356 && alloc.stats().overflowPages == 2);
+
+      alloc.endFrame();
+      expect(backend.flushes.size() == 3);
+      expect(backend.flushes[0].offset == 0 && backend.flushes[0].size == 356);
+      expect(backend.flushed(static_cast<uint8_t*>(d.cpu), 700) && backend.flushed(static_cast<uint8_t*>(big.cpu), 10000));
+      fence.signal(1);
+
+      // frame 3 reuses frame 1's ring, the standard page is kept, the big one freed
+      alloc.beginFrame();
+      alloc.endFrame();
+      const int before = backend.live;
+      alloc.beginFrame();
+      expect(backend.live == before - 1);
+      expect(alloc.stats().ringBytes == 0 && alloc.stats().overflowPages == 0);
+      const int allocs = backend.allocations;
+      expect(alloc.allocate(1000, 16).offset == 0);
+      expect(alloc.allocate(1000, 16).cpu && backend.allocations == allocs);
+
+      // out of backend memory
+      backend.limit = 0;
+      expect(alloc.allocate(1 << 20, 16).cpu == nullptr);
+      alloc.endFrame();
+      fence.signal(3);
+    }
+    expect(backend.live == 0);
+  }
+
+  // the ring of frame n + frames in flight waits for frame n's fence
+  {
+    MockBackend backend;
+    HaruhiFrameFence fence;
+    HaruhiFrameAllocator alloc(backend, fence, 2, 256);
+    alloc.beginFrame();
+    alloc.endFrame();
+    alloc.beginFrame();
+    alloc.endFrame();
+    std::thread gpu([&] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      fence.signal(1);
+    });
+    alloc.beginFrame();
+    expect(fence.completed() >= 1);
+    gpu.join();
+    alloc.endFrame();
+    fence.signal(3);
+  }
+
+  // many producers a frame, a gpu thread checking every allocation of a
+  // frame before signaling it, while later frames are written
+  {
+    MockBackend backend;
+    HaruhiFrameFence fence;
+    constexpr int FRAMES = 60, THREADS = 8, PER_THREAD = 200;
+    {
+      HaruhiFrameAllocator alloc(backend, fence, 3, 32 << 10, 8 << 10);
+
+      std::mutex mtx;
+      std::condition_variable cv;
+      std::deque<std::pair<uint64_t, std::vector<Written>>> submitted;
+      bool done = false;
+      int corrupt = 0, unflushed = 0;
+      std::atomic<int> misaligned = 0;
+
+      std::thread gpu([&] {
+        for(;;) {
+          std::pair<uint64_t, std::vector<Written>> frame;
+          {
+            std::unique_lock<std::mutex> lk(mtx);
+            cv.wait(lk, [&] { return done || !submitted.empty(); });
+            if(submitted.empty()) return;
+            frame = std::move(submitted.front());
+            submitted.pop_front();
+          }
+          for(auto& w : frame.second) {
+            for(size_t i = 0; i < w.size; ++i)
+              corrupt += w.cpu[i] != w.tag;
+            unflushed += !backend.flushed(w.cpu, w.size);
+          }
+          fence.signal(frame.first);
+        }
+      });
+
+      for(int f = 0; f < FRAMES; ++f) {
+        const uint64_t frame = alloc.beginFrame();
+        std::vector<std::vector<Written>> written(THREADS);
+        std::vector<std::thread> producers;
+        for(int t = 0; t < THREADS; ++t)
+          producers.emplace_back([&, t] {
+            uint32_t seed = (uint32_t)(frame * 977 + t);
+            for(int n = 0; n < PER_THREAD; ++n) {
+              seed = seed * 1103515245u + 12345u;
+              const size_t size = 1 + (seed >> 16) % 300;
+              const size_t align = size_t(4) << (seed >> 8) % 7;
+              auto a = alloc.allocate(size, align);
+              misaligned += a.offset % align != 0;
+              const uint8_t tag = uint8_t(frame * 31 + t * 7 + n);
+              memset(a.cpu, tag, size);
+              written[t].push_back({ static_cast<uint8_t*>(a.cpu), size, tag });
+            }
+          });
+        for(auto& p : producers) p.join();
+        alloc.endFrame();
+
+        std::vector<Written> all;
+        for(auto& w : written) all.insert(all.end(), w.begin(), w.end());
+        {
+          std::lock_guard<std::mutex> lk(mtx);
+          submitted.emplace_back(frame, std::move(all));
+        }
+        cv.notify_one();
+      }
+      {
+        std::lock_guard<std::mutex> lk(mtx);
+        done = true;
+      }
+      cv.notify_one();
+      gpu.join();
+
+      expect(corrupt == 0);
+      expect(unflushed == 0);
+      expect(misaligned == 0);
+      // overflow pages are recycled rather than piling up
+      expect(backend.live < 3 + 3 * 60);
+      expect(backend.allocations < 3 + 3 * 60);
+    }
+    expect(backend.live == 0);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <VoxelWorld.hxx>
+#include <WorkerPool.hxx>
+
+#include "Expect.hxx"
+
+using namespace voxel;
+
+// area covered by the quads, in block faces
+static double
+area(const ChunkMesh& m) {
+  double a = 0;
+  for(const auto& s : m.sections)
+    for(uint32_t i = s.firstIndex; i < s.firstIndex + s.indexCount; i += 6) {
+      const auto& p0 = m.vertices[s.baseVertex + m.indices[i]].pos;
+      const auto& p1 = m.vertices[s.baseVertex + m.indices[i + 1]].pos;
+      const auto& p2 = m.vertices[s.baseVertex + m.indices[i + 2]].pos;
+      const math::float3 e0 = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+      const math::float3 e1 = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+      const math::float3 c = math::cross(e0, e1);
+      a += std::sqrt(c.x * c.x + c.y * c.y + c.z * c.z);
+    }
+  return a;
+}
+
+// every triangle faces along its normal, every texcoord decodes to its tile
+static bool
+wellFormed(const ChunkMesh& m) {
+  size_t indices = 0;
+  for(const auto& s : m.sections) {
+    indices += s.indexCount;
+    for(uint32_t i = s.firstIndex; i < s.firstIndex + s.indexCount; i += 3) {
+      if(s.baseVertex + m.indices[i + 2] >= m.vertices.size()) return false;
+      const auto& v0 = m.vertices[s.baseVertex + m.indices[i]];
+      const auto& v1 = m.vertices[s.baseVertex + m.indices[i + 1]];
+      const auto& v2 = m.vertices[s.baseVertex + m.indices[i + 2]];
+      const math::float3 c = math::cross(v1.pos - v0.pos, v2.pos - v0.pos);
+      if(math::dot(c, v0.norm) <= 0.f) return false;
+      // all corners of a triangle sit in the same tile
+      if(std::floor(v0.texcoord.x) != std::floor(v1.texcoord.x) ||
+         std::floor(v0.texcoord.y) != std::floor(v2.texcoord.y)) return false;
+    }
+  }
+  return indices == m.indices.size();
+}
+
+static size_t
+visibleFaces(const HaruhiVoxelWorld& w, ChunkCoord c) {
+  size_t n = 0;
+  const int d[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+  for(int z = 0; z < CHUNK_SIZE; ++z)
+    for(int y = 0; y < CHUNK_SIZE; ++y)
+      for(int x = 0; x < CHUNK_SIZE; ++x) {
+        const int wx = c.x * CHUNK_SIZE + x, wy = c.y * CHUNK_SIZE + y, wz = c.z * CHUNK_SIZE + z;
+        const Block a = w.get(wx, wy, wz);
+        if(!a) continue;
+        for(const auto& it : d) {
+          const Block b = w.get(wx + it[0], wy + it[1], wz + it[2]);
+          if(!b || (!blockInfo(b).opaque && a != b)) ++n;
+        }
+      }
+  return n;
+}
+
+int main() {
+  HaruhiWorkerPool pool(4);
+
+  // one block, six faces with the right tiles
+  {
+    HaruhiVoxelWorld w;
+    w.set(3, 4, 5, BLOCK_GRASS);
+    expect(w.size() == 1 && w.pending() == 1);
+    expect(w.remesh() == 1 && w.pending() == 0);
+    const ChunkMesh* m = w.mesh({ 0, 0, 0 });
+    expect(m && m->quads() == 6 && m->vertices.size() == 24);
+    expect(wellFormed(*m) && area(*m) == 6.);
+    bool top = false;
+    for(const auto& v : m->vertices) {
+      expect(v.pos.x >= 3.f && v.pos.x <= 4.f && v.pos.z >= 5.f && v.pos.z <= 6.f);
+      if(v.norm.y == 1.f) {
+        const uint16_t t = blockInfo(BLOCK_GRASS).tiles[FACE_POS_Y];
+        top = std::floor(v.texcoord.x) == t % ATLAS_TILES && std::floor(v.texcoord.y) == t / ATLAS_TILES;
+      }
+    }
+    expect(top);
+  }
+
+  // a layer merges into one quad per side, negative coordinates work
+  {
+    HaruhiVoxelWorld w;
+    for(int z = -32; z < 0; ++z)
+      for(int x = -32; x < 0; ++x)
+        w.set(x, -1, z, BLOCK_STONE);
+    w.remesh();
+    const ChunkMesh* m = w.mesh({ -1, -1, -1 });
+    expect(m && m->quads() == 6 && area(*m) == 32. * 32. * 2 + 32. * 4);
+    // largest quad repeats the tile 32 times, locals stay inside the span
+    float hi = 0.f;
+    for(const auto& v : m->vertices)
+      hi = std::max(hi, v.texcoord.x - std::floor(v.texcoord.x));
+    expect(std::fabs(hi * TEXCOORD_SPAN - 32.f) < 1e-3f);
+  }
+
+  // faces between chunks are culled from both sides, edits on a border
+  // remesh the neighbour too
+  {
+    HaruhiVoxelWorld w;
+    w.set(31, 0, 0, BLOCK_DIRT);
+    w.set(32, 0, 0, BLOCK_DIRT);
+    w.remesh();
+    expect(w.mesh({ 0, 0, 0 })->quads() == 5 && w.mesh({ 1, 0, 0 })->quads() == 5);
+
+    w.set(32, 0, 0, BLOCK_AIR);
+    expect(w.pending() == 2);
+    expect(w.remesh() == 2 && w.remeshed().size() == 2);
+    expect(w.mesh({ 0, 0, 0 })->quads() == 6 && w.mesh({ 1, 0, 0 })->quads() == 0);
+
+    w.set(10, 10, 10, BLOCK_DIRT);
+    expect(w.pending() == 1);
+
+    w.erase({ 1, 0, 0 });
+    w.remesh();
+    bool gone = false;
+    for(const auto& c : w.remeshed())
+      gone = gone || (c == ChunkCoord{ 1, 0, 0 } && !w.mesh(c));
+    expect(gone);
+  }
+
+  // see through blocks show what is behind them, but not their own kind
+  {
+    HaruhiVoxelWorld w;
+    w.set(0, 0, 0, BLOCK_STONE);
+    w.set(1, 0, 0, BLOCK_LEAVES);
+    w.set(2, 0, 0, BLOCK_LEAVES);
+    w.remesh();
+    const ChunkMesh* m = w.mesh({ 0, 0, 0 });
+    // stone all 6, the leaves 4 sides each merged to 4 quads and the far end
+    expect(area(*m) == 6. + 4. * 2 + 1.);
+    expect(m->quads() == 6 + 4 + 1);
+    // only the stone hides things behind it
+    expect(m->occluders.size() == 6);
+    bool stone = true;
+    for(uint32_t v : m->occluders)
+      for(uint32_t k = v; k < v + 4; ++k) stone = stone && m->vertices[k].pos.x <= 1.f;
+    expect(stone);
+  }
+
+  // a 3d checkerboard needs more than 64k vertices, split into sections
+  {
+    HaruhiVoxelWorld w;
+    BlockStorage& b = w.edit({ 0, 0, 0 });
+    for(int z = 0; z < CHUNK_SIZE; ++z)
+      for(int y = 0; y < CHUNK_SIZE; ++y)
+        for(int x = 0; x < CHUNK_SIZE; ++x)
+          b.set((z * CHUNK_SIZE + y) * CHUNK_SIZE + x, (x + y + z) & 1 ? BLOCK_BRICK : BLOCK_AIR);
+    w.remesh(&pool);
+    const ChunkMesh* m = w.mesh({ 0, 0, 0 });
+    expect(m->quads() == CHUNK_VOLUME / 2 * 6);
+    expect(m->sections.size() > 1 && wellFormed(*m));
+  }
+
+  // random worlds: quads cover exactly the visible faces, parallel == serial
+  {
+    std::mt19937 rng(7);
+    HaruhiVoxelWorld a, b;
+    for(int cz = 0; cz < 2; ++cz)
+      for(int cx = 0; cx < 3; ++cx) {
+        BlockStorage& pa = a.edit({ cx, 0, cz });
+        BlockStorage& pb = b.edit({ cx, 0, cz });
+        for(int i = 0; i < CHUNK_VOLUME; ++i) {
+          const uint32_t r = rng() % 16;
+          const Block v = r < BLOCK_COUNT ? Block(r) : Block(BLOCK_AIR);
+          pa.set(i, v);
+          pb.set(i, v);
+        }
+      }
+    expect(a.remesh(&pool) == 6 && b.remesh() == 6);
+    bool same = true, covered = true, formed = true;
+    a.forEachChunk([&](const ChunkCoord& c, const ChunkMesh& m) {
+      const ChunkMesh* o = b.mesh(c);
+      same = same && o && o->vertices.size() == m.vertices.size() && o->indices == m.indices;
+      covered = covered && area(m) == double(visibleFaces(a, c));
+      formed = formed && wellFormed(m);
+    });
+    expect(same && covered && formed);
+
+    // a tiny budget still meshes one batch and leaves the rest queued
+    for(int i = 0; i < 6; ++i)
+      a.set(i * CHUNK_SIZE / 2, 5, 5, BLOCK_SAND);
+    const size_t queued = a.pending();
+    const size_t done = a.remesh(nullptr, 1e-6);
+    expect(done == 1 && a.pending() == queued - 1);
+    a.remesh(&pool);
+    expect(a.pending() == 0);
+  }
+
+  // palette storage reads back what was written through every width
+  {
+    std::mt19937 rng(11);
+    std::vector<Block> dense(CHUNK_VOLUME, BLOCK_DIRT), out(CHUNK_VOLUME);
+    BlockStorage s(BLOCK_DIRT);
+    expect(s.uniform() && s.bits() == 0 && s.get(CHUNK_VOLUME - 1) == BLOCK_DIRT);
+    bool same = true;
+    uint32_t widths = 0;
+    for(int kinds : { 2, 3, 5, 16, 17, 200, 300 }) {
+      for(int n = 0; n < 4000; ++n) {
+        const int i = int(rng() % CHUNK_VOLUME);
+        dense[i] = Block(1000 + rng() % kinds);
+        s.set(i, dense[i]);
+      }
+      widths |= s.bits();
+      for(int i = 0; i < CHUNK_VOLUME; ++i) same &= s.get(i) == dense[i];
+    }
+    expect(same && widths == (2 | 4 | 8 | 16));
+    expect(s.paletteSize() <= 301);
+    s.store(out.data());
+    expect(out == dense);
+    Block row[CHUNK_SIZE];
+    s.row(CHUNK_AREA - 5, row);
+    expect(std::equal(row, row + CHUNK_SIZE, dense.begin() + (CHUNK_AREA - 5) * CHUNK_SIZE));
+
+    // overwritten entries are dropped before the indices widen
+    s.fill(BLOCK_AIR);
+    for(int n = 0; n < 100; ++n) s.set(7, Block(1000 + n));
+    expect(s.get(7) == 1099 && s.get(8) == BLOCK_AIR && s.bits() <= 2 && s.paletteSize() <= 4);
+
+    // dense arrays pack to the narrowest width, one block to none
+    s.assign(dense.data());
+    s.store(out.data());
+    expect(out == dense && s.bits() == 16);
+    std::fill(dense.begin(), dense.end(), BLOCK_STONE);
+    for(int i = 0; i < CHUNK_VOLUME; i += 3) dense[i] = BLOCK_GRASS;
+    s.assign(dense.data());
+    s.store(out.data());
+    expect(out == dense && s.bits() == 1 && s.bytes() < CHUNK_VOLUME * sizeof(Block) / 8);
+    std::fill(dense.begin(), dense.end(), BLOCK_SAND);
+    s.assign(dense.data());
+    expect(s.uniform() && s.value() == BLOCK_SAND && s.bytes() < 128);
+  }
+
+  // the world reads through palettes and neighbour links, erased chunks
+  // read as air again
+  {
+    HaruhiVoxelWorld w;
+    for(int x = -1; x <= 1; ++x) w.edit({ x, 0, 0 }).fill(BLOCK_STONE);
+    expect(w.blockBytes() < 3 * 128);
+    w.set(CHUNK_SIZE, 3, 3, BLOCK_BRICK);
+    expect(w.get(CHUNK_SIZE, 3, 3) == BLOCK_BRICK && w.get(CHUNK_SIZE - 1, 3, 3) == BLOCK_STONE);
+    expect(w.blocks({ 1, 0, 0 })->bits() == 1);
+    w.erase({ 0, 0, 0 });
+    expect(w.get(5, 5, 5) == BLOCK_AIR && w.get(-1, 5, 5) == BLOCK_STONE);
+    w.remesh(&pool);
+    const ChunkMesh* m = w.mesh({ 1, 0, 0 });
+    expect(m && m->quads() > 0);
+  }
+
+  // a chunk erased and set again before remeshing is meshed and reported
+  // once, so is one erased twice
+  {
+    HaruhiVoxelWorld w;
+    w.set(5, 5, 5, BLOCK_STONE);
+    w.set(CHUNK_SIZE + 5, 5, 5, BLOCK_STONE);
+    w.remesh(&pool);
+    w.erase({ 0, 0, 0 });
+    w.set(5, 5, 5, BLOCK_DIRT);
+    w.set(6, 5, 5, BLOCK_DIRT);
+    w.erase({ 1, 0, 0 });
+    w.set(CHUNK_SIZE + 5, 5, 5, BLOCK_DIRT);
+    w.erase({ 1, 0, 0 });
+    w.remesh(&pool);
+    std::vector<ChunkCoord> seen = w.remeshed();
+    std::sort(seen.begin(), seen.end(), [](const ChunkCoord& a, const ChunkCoord& b) { return a.x < b.x; });
+    const ChunkCoord set = { 0, 0, 0 }, gone = { 1, 0, 0 };
+    expect(seen.size() == 2 && seen[0] == set && seen[1] == gone);
+    expect(w.mesh(set)->quads() == 6 && !w.mesh(gone) && w.pending() == 0);
+  }
+
+  if(failures) {
+    printf("%d failure(s)\n", failures);
+    return EXIT_FAILURE;
+  }
+  return 0;
+}
\ No newline at end of file
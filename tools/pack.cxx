@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <AssetArchive.hxx>
+#include <BlockCompress.hxx>
+#include <ImageUtil.hxx>
+#include <MipChain.hxx>
+#include <WorkerPool.hxx>
+
+namespace {
+
+struct FormatName {
+  const char* name;
+  archive::Format format;
+  texcomp::Codec codec;
+};
+
+const FormatName FORMATS[] = {
+  { "rgba8", archive::FORMAT_RGBA8_SRGB, texcomp::CODEC_COUNT },
+  { "bc1", archive::FORMAT_BC1_SRGB, texcomp::CODEC_BC1 },
+  { "bc3", archive::FORMAT_BC3_SRGB, texcomp::CODEC_BC3 },
+  { "bc7", archive::FORMAT_BC7_SRGB, texcomp::CODEC_BC7 },
+  { "astc4x4", archive::FORMAT_ASTC_4x4_SRGB, texcomp::CODEC_ASTC_4x4 },
+  { "astc6x6", archive::FORMAT_ASTC_6x6_SRGB, texcomp::CODEC_ASTC_6x6 },
+};
+
+} // ns
+
+// haruhiPack [--no-mips] [--alpha-cutoff=a] [--max-levels=n] [--format=f] [--hq] <out.hpak> name=image.png ...
+// decodes every png on all cores, builds the mip chains, block compresses
+// every level when a format other than rgba8 is given and bakes them into
+// one archive
+int main(int argc, char * argv[]) {
+  using namespace HaruhiResourceLoader::ImageUtil;
+
+  bool mips = true;
+  HaruhiMipChain::Options mip_opts = {};
+  const FormatName* fmt = &FORMATS[0];
+  texcomp::Quality quality = texcomp::QUALITY_FAST;
+  int arg = 1;
+  for(; arg < argc && strncmp(argv[arg], "--", 2) == 0; ++arg) {
+    if(strcmp(argv[arg], "--no-mips") == 0) {
+      mips = false;
+    } else if(strncmp(argv[arg], "--alpha-cutoff=", 15) == 0) {
+      mip_opts.alphaCutoff = strtof(argv[arg] + 15, nullptr);
+    } else if(strncmp(argv[arg], "--max-levels=", 13) == 0) {
+      mip_opts.maxLevels = (uint32_t)strtoul(argv[arg] + 13, nullptr, 10);
+    } else if(strncmp(argv[arg], "--format=", 9) == 0) {
+      fmt = nullptr;
+      for(auto& f : FORMATS)
+        if(strcmp(argv[arg] + 9, f.name) == 0) fmt = &f;
+      if(!fmt) {
+        printf("unknown format %s\n", argv[arg] + 9);
+        return EXIT_FAILURE;
+      }
+    } else if(strcmp(argv[arg], "--hq") == 0) {
+      quality = texcomp::QUALITY_HIGH;
+    } else {
+      printf("unknown option %s\n", argv[arg]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if(argc - arg < 2) {
+    printf("usage: %s [--no-mips] [--alpha-cutoff=a] [--max-levels=n] [--format=rgba8|bc1|bc3|bc7|astc4x4|astc6x6] [--hq]"
+           " <out.hpak> name=image.png ...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const char* out = argv[arg++];
+
+  const auto t0 = std::chrono::steady_clock::now();
+
+  std::vector<std::string> names;
+  std::vector<const char*> paths;
+  for(int i = arg; i < argc; ++i) {
+    const char* eq = strchr(argv[i], '=');
+    if(!eq || eq == argv[i] || !eq[1]) {
+      printf("%s: expected name=path\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+    names.emplace_back(argv[i], eq - argv[i]);
+    paths.push_back(eq + 1);
+  }
+  const size_t n = paths.size();
+
+  HaruhiWorkerPool pool;
+
+  auto probes = probeImages(paths.data(), n, &pool);
+  std::vector<std::vector<uint8_t>> pixels(n);
+  std::vector<DecodeRequest> reqs(n);
+  for(size_t i = 0; i < n; ++i) {
+    if(probes[i].error) {
+      printf("%s: %s\n", paths[i], errorString(probes[i].error));
+      return EXIT_FAILURE;
+    }
+    pixels[i].resize(probes[i].info.size);
+    reqs[i] = { paths[i], pixels[i].data(), pixels[i].size(), 0 };
+  }
+
+  auto results = decodeImages(reqs.data(), n, &pool);
+
+  HaruhiAssetPacker packer;
+  HaruhiMipChain chain;
+  std::vector<std::vector<uint8_t>> blocks(archive::MAX_MIPS);
+  for(size_t i = 0; i < n; ++i) {
+    if(results[i].error) {
+      printf("%s: %s\n", paths[i], errorString(results[i].error));
+      return EXIT_FAILURE;
+    }
+
+    const uint32_t w = results[i].info.width, h = results[i].info.height;
+    std::vector<HaruhiAssetPacker::Image> levels = { { w, h, pixels[i].data(), 0 } };
+    if(mips) {
+      // levels are filtered in parallel, textures one after another
+      chain.build(pixels[i].data(), w, h, 0, mip_opts, &pool);
+      levels.resize(std::min(chain.levelCount(), archive::MAX_MIPS));
+      for(uint32_t l = 0; l < levels.size(); ++l)
+        levels[l] = { chain.level(l).width, chain.level(l).height, chain.levelData(l), 0 };
+    }
+    if(fmt->format != archive::FORMAT_RGBA8_SRGB) {
+      // blocks of a level are encoded in parallel
+      for(uint32_t l = 0; l < levels.size(); ++l) {
+        auto& lv = levels[l];
+        blocks[l].resize(texcomp::encodedSize(fmt->codec, lv.width, lv.height));
+        texcomp::encode(fmt->codec, quality, static_cast<const uint8_t*>(lv.data),
+                        lv.width, lv.height, lv.rowPitch, blocks[l].data(), &pool);
+        lv = { lv.width, lv.height, blocks[l].data(), 0 };
+      }
+    }
+    if(!packer.addTexture(names[i], levels.data(), (uint32_t)levels.size(), fmt->format)) {
+      printf("%s: bad or duplicate texture name\n", names[i].c_str());
+      return EXIT_FAILURE;
+    }
+  }
+
+  if(int err = packer.write(out)) {
+    printf("%s: %s\n", out, strerror(-err));
+    return EXIT_FAILURE;
+  }
+
+  const double ms = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - t0).count();
+  printf("packed %zu %s texture(s) into %s in %.1f ms\n", n, fmt->name, out, ms);
+  return 0;
+}
\ No newline at end of file